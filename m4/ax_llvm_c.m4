@@ -95,6 +95,16 @@ AC_DEFUN([AX_LLVM_C], [
                                  [LLVM has new ORC API])
           fi
 
+          if test "$llvm_ver_num" -ge "70"; then
+              AC_DEFINE_UNQUOTED(LLVM_HAS_MERGE_FUNCTIONS, [1],
+                                 [LLVM has LLVMAddMergeFunctionsPass])
+          fi
+
+          if test "$llvm_ver_num" -ge "50" -a "$llvm_ver_num" -lt "120"; then
+              AC_DEFINE_UNQUOTED(LLVM_HAS_ORC_BINDINGS, [1],
+                                 [LLVM has lazily compiling ORC C bindings])
+          fi
+
           LLVM_OBJ_EXT="o"
           case $host_os in
               *cygwin*|msys*|mingw32*)
@@ -991,6 +991,38 @@ void bounds_check(tree_t top)
    tree_visit(top, bounds_visit_fn, NULL);
 }
 
+bool bounds_check_kind(tree_kind_t kind)
+{
+   // Must match the cases handled by bounds_visit_fn
+
+   switch (kind) {
+   case T_PCALL:
+   case T_FCALL:
+   case T_ARRAY_REF:
+   case T_ARRAY_SLICE:
+   case T_AGGREGATE:
+   case T_SIGNAL_DECL:
+   case T_CONST_DECL:
+   case T_VAR_DECL:
+   case T_PORT_DECL:
+   case T_SIGNAL_ASSIGN:
+   case T_VAR_ASSIGN:
+   case T_CASE:
+   case T_LITERAL:
+   case T_TYPE_CONV:
+   case T_ATTR_REF:
+   case T_WAIT:
+      return true;
+   default:
+      return false;
+   }
+}
+
+void bounds_check_tree(tree_t t)
+{
+   bounds_visit_fn(t, NULL);
+}
+
 int bounds_errors(void)
 {
    return errors;
@@ -21,16 +21,20 @@
 #include "common.h"
 #include "vcode.h"
 #include "array.h"
+#include "hash.h"
 #include "rt/rt.h"
 #include "rt/cover.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
 #include <llvm-c/Core.h>
+#include <llvm-c/BitReader.h>
 #include <llvm-c/BitWriter.h>
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Analysis.h>
@@ -39,6 +43,14 @@
 #include <llvm-c/Transforms/PassManagerBuilder.h>
 #include <llvm-c/TargetMachine.h>
 
+#ifdef LLVM_HAS_ORC_BINDINGS
+#include <llvm-c/OrcBindings.h>
+#endif
+
+#if RT_MULTITHREAD
+#include <pthread.h>
+#endif
+
 #undef NDEBUG
 #include <assert.h>
 
@@ -71,12 +83,70 @@ typedef enum {
    FUNC_ATTR_READONLY,
    FUNC_ATTR_NOCAPTURE,
    FUNC_ATTR_BYVAL,
+   FUNC_ATTR_COLD,
 
    FUNC_ATTR_DLLEXPORT,   // Should be last
 } func_attr_t;
 
+typedef enum {
+   PROC_WARM,
+   PROC_HOT,
+   PROC_COLD
+} proc_temp_t;
+
+typedef struct {
+   LLVMModuleRef        module;
+   unsigned             weight;
+   unsigned             n_hot;
+   unsigned             n_cold;
+   unsigned             n_other;
+   char                *obj_path;
+   char                *error;
+   bool                 cached;
+   LLVMMemoryBufferRef  bitcode;
+} cgen_part_t;
+
+typedef struct {
+   cgen_part_t **parts;
+   int           count;
+   int           next;
+   const char   *triple;
+} cgen_queue_t;
+
 static LLVMModuleRef  module = NULL;
 static LLVMBuilderRef builder = NULL;
+static cgen_part_t   *parts = NULL;
+static int            n_parts = 0;
+static cover_mode_t   cover_mode = COVER_OFF;
+static int            next_part = 0;
+static hash_t        *decl_index = NULL;
+static tree_t         stream_top = NULL;
+static hash_t        *profile = NULL;
+
+#ifdef LLVM_HAS_ORC_BINDINGS
+static LLVMOrcJITStackRef   orc_stack = NULL;
+static LLVMModuleRef        orc_module = NULL;
+static LLVMTargetMachineRef orc_tm = NULL;
+#endif
+
+#if defined LLVM_HAS_ORC_BINDINGS && RT_MULTITHREAD
+typedef struct tier_req tier_req_t;
+
+struct tier_req {
+   char        *name;
+   void       **result;
+   tier_req_t  *next;
+};
+
+static LLVMMemoryBufferRef tier_bitcode = NULL;
+static char               *tier_triple = NULL;
+static char              **tier_names = NULL;
+static size_t              tier_nnames = 0;
+static shash_t            *tier_globals = NULL;
+static tier_req_t         *tier_queue = NULL;
+static pthread_mutex_t     tier_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      tier_cond = PTHREAD_COND_INITIALIZER;
+#endif
 
 static char **link_args = NULL;
 static size_t n_link_args = 0;
@@ -258,7 +328,7 @@ static void cgen_add_func_attr(LLVMValueRef fn, func_attr_t attr, int param)
 
 #if LLVM_NEW_ATTRIBUTE_API
    const char *names[] = {
-      "nounwind", "noreturn", "readonly", "nocapture", "byval"
+      "nounwind", "noreturn", "readonly", "nocapture", "byval", "cold"
    };
    assert(attr < ARRAY_LEN(names));
 
@@ -272,6 +342,9 @@ static void cgen_add_func_attr(LLVMValueRef fn, func_attr_t attr, int param)
 
    LLVMAddAttributeAtIndex(fn, param, ref);
 #else
+   if (attr == FUNC_ATTR_COLD)
+      return;   // Not available in the old attribute API
+
    LLVMAttribute llvm_attrs[] = {
       LLVMNoUnwindAttribute,
       LLVMNoReturnAttribute,
@@ -402,7 +475,16 @@ static LLVMValueRef cgen_get_var(vcode_var_t var, cgen_ctx_t *ctx)
       // Shared global variable
       const char *name = safe_symbol(istr(vcode_var_name(var)));
       value = LLVMGetNamedGlobal(module, name);
-      if (value == NULL)
+      if (value == NULL && vcode_var_extern(var)) {
+         // A streamed process may add an external variable to the
+         // context after the shared variables were emitted
+         value = LLVMAddGlobal(module, cgen_type(vcode_var_type(var)), name);
+#ifdef IMPLIB_REQUIRED
+         LLVMSetDLLStorageClass(value, LLVMDLLImportStorageClass);
+#endif
+         LLVMSetLinkage(value, LLVMExternalLinkage);
+      }
+      else if (value == NULL)
          fatal_trace("missing LLVM global for %s", istr(vcode_var_name(var)));
    }
    else if (my_depth == var_depth) {
@@ -437,10 +519,34 @@ static LLVMValueRef cgen_get_var(vcode_var_t var, cgen_ctx_t *ctx)
       return value;
 }
 
+static LLVMValueRef cgen_tmp_var(const char *name)
+{
+   LLVMValueRef global = LLVMGetNamedGlobal(module, name);
+
+#if RT_MULTITHREAD
+   if (opt_get_int("jit")) {
+      // The JIT cannot relocate references to thread-local variables in
+      // the runtime so call a function to get the address instead
+      char *fname LOCAL = xasprintf("%s_ptr", name);
+      LLVMValueRef fn = LLVMGetNamedFunction(module, fname);
+      if (fn == NULL) {
+         LLVMTypeRef type =
+            LLVMFunctionType(LLVMTypeOf(global), NULL, 0, false);
+         fn = LLVMAddFunction(module, fname, type);
+         cgen_add_func_attr(fn, FUNC_ATTR_NOUNWIND, -1);
+      }
+
+      return LLVMBuildCall(builder, fn, NULL, 0, "");
+   }
+#endif
+
+   return global;
+}
+
 static LLVMValueRef cgen_tmp_alloc(LLVMValueRef bytes, LLVMTypeRef type)
 {
-   LLVMValueRef _tmp_stack_ptr = LLVMGetNamedGlobal(module, "_tmp_stack");
-   LLVMValueRef _tmp_alloc_ptr = LLVMGetNamedGlobal(module, "_tmp_alloc");
+   LLVMValueRef _tmp_stack_ptr = cgen_tmp_var("_tmp_stack");
+   LLVMValueRef _tmp_alloc_ptr = cgen_tmp_var("_tmp_alloc");
 
    LLVMValueRef alloc = LLVMBuildLoad(builder, _tmp_alloc_ptr, "alloc");
    LLVMValueRef stack = LLVMBuildLoad(builder, _tmp_stack_ptr, "stack");
@@ -457,6 +563,29 @@ static LLVMValueRef cgen_tmp_alloc(LLVMValueRef bytes, LLVMTypeRef type)
                    llvm_int32(~3),
                    "alloc_next");
 
+   // The runtime keeps _tmp_limit at the high water mark of the active
+   // process so the slow path both records peak usage and checks the
+   // allocation against the size of the stack
+
+   LLVMValueRef _tmp_limit_ptr = cgen_tmp_var("_tmp_limit");
+   LLVMValueRef limit = LLVMBuildLoad(builder, _tmp_limit_ptr, "limit");
+
+   LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+   LLVMBasicBlockRef grow_bb = LLVMAppendBasicBlock(fn, "tmp_grow");
+   LLVMBasicBlockRef done_bb = LLVMAppendBasicBlock(fn, "tmp_done");
+
+   LLVMValueRef over =
+      LLVMBuildICmp(builder, LLVMIntUGT, alloc_next, limit, "over");
+   LLVMBuildCondBr(builder, over, grow_bb, done_bb);
+
+   LLVMPositionBuilderAtEnd(builder, grow_bb);
+   LLVMValueRef args[] = { alloc_next };
+   LLVMBuildCall(builder, llvm_fn("_tmp_stack_grow"),
+                 args, ARRAY_LEN(args), "");
+   LLVMBuildBr(builder, done_bb);
+
+   LLVMPositionBuilderAtEnd(builder, done_bb);
+
    LLVMBuildStore(builder, alloc_next, _tmp_alloc_ptr);
 
    return LLVMBuildPointerCast(builder, buf,
@@ -785,37 +914,66 @@ static void cgen_op_const(int op, cgen_ctx_t *ctx)
                                     vcode_get_value(op), false);
 }
 
+static LLVMValueRef cgen_const_data(LLVMTypeRef elem_type,
+                                    const int64_t *values, int length)
+{
+   // Byte arrays are built directly from the raw data
+   if (LLVMGetIntTypeWidth(elem_type) == 8) {
+      char *bytes LOCAL = xmalloc(MAX(length, 1));
+      for (int i = 0; i < length; i++)
+         bytes[i] = values[i];
+
+      return LLVMConstStringInContext(LLVMGetTypeContext(elem_type),
+                                      bytes, length, true);
+   }
+
+   LLVMValueRef *tmp LOCAL = xmalloc(length * sizeof(LLVMValueRef));
+   for (int i = 0; i < length; i++)
+      tmp[i] = LLVMConstInt(elem_type, values[i], true);
+
+   return LLVMConstArray(elem_type, tmp, length);
+}
+
 static void cgen_op_const_array(int op, cgen_ctx_t *ctx)
 {
    vcode_reg_t result = vcode_get_result(op);
    vcode_type_t type  = vcode_reg_type(result);
 
-   const int length = vcode_count_args(op);
-   LLVMValueRef *tmp LOCAL = xmalloc(length * sizeof(LLVMValueRef));
-   for (int i = 0; i < length; i++)
-      tmp[i] = ctx->regs[vcode_get_arg(op, i)];
+   const bool is_pointer = vtype_kind(type) == VCODE_TYPE_POINTER;
+   LLVMTypeRef elem_type =
+      cgen_type(is_pointer ? vtype_pointed(type) : vtype_elem(type));
+
+   int length;
+   LLVMValueRef init;
+   const int64_t *data = vcode_get_data(op, &length);
+   if (data != NULL)
+      init = cgen_const_data(elem_type, data, length);
+   else {
+      length = vcode_count_args(op);
+      LLVMValueRef *tmp LOCAL = xmalloc(length * sizeof(LLVMValueRef));
+      for (int i = 0; i < length; i++)
+         tmp[i] = ctx->regs[vcode_get_arg(op, i)];
 
-   if (vtype_kind(vcode_reg_type(result)) == VCODE_TYPE_POINTER) {
+      init = LLVMConstArray(elem_type, tmp, length);
+   }
+
+   if (is_pointer) {
       char *name LOCAL = xasprintf("%s_const_array_r%d",
                                    istr(vcode_unit_name()), result);
 
-      LLVMTypeRef elem_type  = cgen_type(vtype_pointed(type));
       LLVMTypeRef array_type = LLVMArrayType(elem_type, length);
 
       LLVMValueRef global = LLVMAddGlobal(module, array_type, name);
       LLVMSetLinkage(global, LLVMInternalLinkage);
       LLVMSetGlobalConstant(global, true);
       LLVMSetUnnamedAddr(global, true);
-
-      LLVMValueRef init = LLVMConstArray(elem_type, tmp, length);
       LLVMSetInitializer(global, init);
 
       ctx->regs[result] = cgen_array_pointer(global);
       LLVMSetValueName(ctx->regs[result], cgen_reg_name(result));
    }
    else
-      ctx->regs[result] = LLVMConstArray(cgen_type(vtype_elem(type)),
-                                         tmp, length);
+      ctx->regs[result] = init;
 }
 
 static void cgen_op_cmp(int op, cgen_ctx_t *ctx)
@@ -1822,6 +1980,9 @@ static LLVMValueRef cgen_resolution_wrapper(const vcode_res_elem_t *rdata)
                         LLVMFunctionType(result_type, args,
                                          ARRAY_LEN(args), false));
 
+   // Each module generates its own copy of the wrapper
+   LLVMSetLinkage(fn, LLVMInternalLinkage);
+
    LLVMBasicBlockRef saved_bb = LLVMGetInsertBlock(builder);
 
    LLVMBasicBlockRef entry_bb = LLVMAppendBasicBlock(fn, "entry");
@@ -1892,6 +2053,10 @@ static void cgen_op_set_initial(int op, cgen_ctx_t *ctx)
    // Assuming array nets are sequential
    netid_t nid = vcode_signal_nets(sig)[0];
 
+   // Lets the runtime find the declaration without a name lookup
+   const int decl = decl_index == NULL ? -1
+      : (intptr_t)hash_get(decl_index, vcode_signal_name(sig)) - 1;
+
    const char *sig_name = istr(vcode_signal_name(sig));
    const char *global_name LOCAL = xasprintf("%s.name", sig_name);
    LLVMValueRef name_ll = LLVMGetNamedGlobal(module, global_name);
@@ -1913,6 +2078,7 @@ static void cgen_op_set_initial(int op, cgen_ctx_t *ctx)
          size_list.items[0].size,
          llvm_int32(size_list.items[0].count),
          llvm_void_cast(size_list.items[0].resolution),
+         llvm_int32(decl),
          llvm_void_cast(name_ll)
       };
       LLVMBuildCall(builder, llvm_fn("_set_initial_1"), args,
@@ -1943,6 +2109,7 @@ static void cgen_op_set_initial(int op, cgen_ctx_t *ctx)
          llvm_void_cast(valptr),
          list_mem,
          llvm_int32(size_list.count),
+         llvm_int32(decl),
          llvm_void_cast(name_ll)
       };
       LLVMBuildCall(builder, llvm_fn("_set_initial"), args,
@@ -2387,12 +2554,21 @@ static void cgen_op_new(int op, cgen_ctx_t *ctx)
 
    LLVMTypeRef lltype = cgen_type(vtype_pointed(vcode_reg_type(result)));
 
-   if (vcode_count_args(op) == 0)
-      ctx->regs[result] = LLVMBuildMalloc(builder, lltype, name);
-   else {
+   // Objects come from the runtime's size class allocator rather than
+   // malloc as they are often small and short lived
+   LLVMValueRef bytes = LLVMSizeOf(lltype);
+   if (vcode_count_args(op) > 0) {
       LLVMValueRef length = cgen_get_arg(op, 0, ctx);
-      ctx->regs[result] = LLVMBuildArrayMalloc(builder, lltype, length, name);
+      bytes = LLVMBuildMul(builder, bytes,
+                           LLVMBuildZExt(builder, length,
+                                         LLVMInt64Type(), ""), "");
    }
+
+   LLVMValueRef args[] = { bytes };
+   LLVMValueRef mem = LLVMBuildCall(builder, llvm_fn("_access_new"),
+                                    args, ARRAY_LEN(args), "");
+   ctx->regs[result] =
+      LLVMBuildPointerCast(builder, mem, LLVMPointerType(lltype, 0), name);
 }
 
 static void cgen_op_all(int op, cgen_ctx_t *ctx)
@@ -2427,7 +2603,10 @@ static void cgen_op_deallocate(int op, cgen_ctx_t *ctx)
 {
    LLVMValueRef ptr = cgen_get_arg(op, 0, ctx);
    LLVMValueRef access = LLVMBuildLoad(builder, ptr, "");
-   LLVMBuildFree(builder, access);
+   LLVMValueRef args[] = {
+      LLVMBuildPointerCast(builder, access, llvm_void_ptr(), "")
+   };
+   LLVMBuildCall(builder, llvm_fn("_access_free"), args, ARRAY_LEN(args), "");
    LLVMBuildStore(builder, LLVMConstNull(LLVMTypeOf(access)), ptr);
 }
 
@@ -2668,8 +2847,22 @@ static void cgen_op_cover_stmt(int op, cgen_ctx_t *ctx)
    LLVMValueRef count_ptr = LLVMBuildGEP(builder, cover_counts,
                                          indexes, ARRAY_LEN(indexes), "");
 
+   if (cover_mode == COVER_ONCE) {
+      // Only whether the statement was executed is recorded so there is
+      // no need to load the old value
+      LLVMBuildStore(builder, llvm_int32(1), count_ptr);
+      return;
+   }
+
+   LLVMValueRef incr = llvm_int32(1);
+   if (cover_mode == COVER_SAMPLE) {
+      // The runtime sets this to one for the cycles that are sampled
+      LLVMValueRef sample = LLVMGetNamedGlobal(module, "cover_sample");
+      incr = LLVMBuildLoad(builder, sample, "cover_sample");
+   }
+
    LLVMValueRef count = LLVMBuildLoad(builder, count_ptr, "cover_count");
-   LLVMValueRef count1 = LLVMBuildAdd(builder, count, llvm_int32(1), "");
+   LLVMValueRef count1 = LLVMBuildAdd(builder, count, incr, "");
 
    LLVMBuildStore(builder, count1, count_ptr);
 }
@@ -2702,7 +2895,7 @@ static void cgen_op_cover_cond(int op, cgen_ctx_t *ctx)
 
 static void cgen_op_heap_save(int op, cgen_ctx_t *ctx)
 {
-   LLVMValueRef cur_ptr = LLVMGetNamedGlobal(module, "_tmp_alloc");
+   LLVMValueRef cur_ptr = cgen_tmp_var("_tmp_alloc");
 
    vcode_reg_t result = vcode_get_result(op);
    ctx->regs[result] = LLVMBuildLoad(builder, cur_ptr, cgen_reg_name(result));
@@ -2710,7 +2903,7 @@ static void cgen_op_heap_save(int op, cgen_ctx_t *ctx)
 
 static void cgen_op_heap_restore(int op, cgen_ctx_t *ctx)
 {
-   LLVMValueRef cur_ptr = LLVMGetNamedGlobal(module, "_tmp_alloc");
+   LLVMValueRef cur_ptr = cgen_tmp_var("_tmp_alloc");
    LLVMBuildStore(builder, cgen_get_arg(op, 0, ctx), cur_ptr);
 }
 
@@ -3116,7 +3309,13 @@ static void cgen_params(cgen_ctx_t *ctx)
 
 static void cgen_locals(cgen_ctx_t *ctx)
 {
-   LLVMPositionBuilderAtEnd(builder, ctx->blocks[0]);
+   // Allocating on the temporary stack may branch to the slow path so
+   // give the locals their own entry block that falls through to the
+   // first block of the function body
+
+   LLVMBasicBlockRef locals_bb =
+      LLVMInsertBasicBlock(ctx->blocks[0], "locals");
+   LLVMPositionBuilderAtEnd(builder, locals_bb);
 
    const int nvars = vcode_count_vars();
    for (int i = 0; i < nvars; i++) {
@@ -3129,12 +3328,28 @@ static void cgen_locals(cgen_ctx_t *ctx)
       else
          ctx->locals[i] = LLVMBuildAlloca(builder, lltype, name);
    }
+
+   LLVMBuildBr(builder, ctx->blocks[0]);
+}
+
+static cgen_part_t *cgen_current_part(void)
+{
+   for (int i = 0; i < n_parts; i++) {
+      if (parts[i].module == module)
+         return &(parts[i]);
+   }
+
+   return NULL;
 }
 
 static void cgen_function(LLVMTypeRef display_type)
 {
    assert(vcode_unit_kind() == VCODE_UNIT_FUNCTION);
 
+   cgen_part_t *part = cgen_current_part();
+   if (part != NULL)
+      part->n_other++;
+
    const int nparams = vcode_count_params();
    vcode_type_t params[nparams];
    for (int i = 0; i < nparams; i++)
@@ -3194,13 +3409,66 @@ static LLVMTypeRef cgen_state_type(cgen_ctx_t *ctx)
    return LLVMStructType(fields, nfields, false);
 }
 
+static bool cgen_type_has_pointers(vcode_type_t type)
+{
+   switch (vtype_kind(type)) {
+   case VCODE_TYPE_CARRAY:
+      return cgen_type_has_pointers(vtype_elem(type));
+
+   case VCODE_TYPE_RECORD:
+      {
+         const int nfields = vtype_fields(type);
+         for (int i = 0; i < nfields; i++) {
+            if (cgen_type_has_pointers(vtype_field(type, i)))
+               return true;
+         }
+         return false;
+      }
+
+   case VCODE_TYPE_UARRAY:
+   case VCODE_TYPE_POINTER:
+   case VCODE_TYPE_ACCESS:
+   case VCODE_TYPE_SIGNAL:
+   case VCODE_TYPE_FILE:
+      return true;
+
+   default:
+      return false;
+   }
+}
+
 static void cgen_state_struct(cgen_ctx_t *ctx)
 {
    char *name LOCAL = xasprintf("%s__state", istr(vcode_unit_name()));
    LLVMTypeRef state_ty = cgen_state_type(ctx);
    ctx->state = LLVMAddGlobal(module, state_ty, safe_symbol(name));
-   LLVMSetLinkage(ctx->state, LLVMInternalLinkage);
+#ifdef IMPLIB_REQUIRED
+   LLVMSetDLLStorageClass(ctx->state, LLVMDLLExportStorageClass);
+#endif
    LLVMSetInitializer(ctx->state, LLVMGetUndef(state_ty));
+
+   // The runtime copies the state of processes without pointers in
+   // and out of checkpoint files and needs to know its size
+   bool has_pointers = false;
+   const int nvars = vcode_count_vars();
+   for (int i = 0; i < nvars && !has_pointers; i++)
+      has_pointers =
+         cgen_type_has_pointers(vcode_var_type(vcode_var_handle(i)));
+
+   char *size_name LOCAL = xasprintf("%s__state_size",
+                                     istr(vcode_unit_name()));
+   LLVMValueRef size_glob =
+      LLVMAddGlobal(module, LLVMInt32Type(), safe_symbol(size_name));
+#ifdef IMPLIB_REQUIRED
+   LLVMSetDLLStorageClass(size_glob, LLVMDLLExportStorageClass);
+#endif
+   LLVMSetGlobalConstant(size_glob, true);
+
+   if (has_pointers)
+      LLVMSetInitializer(size_glob, llvm_int32(-1));
+   else
+      LLVMSetInitializer(size_glob, LLVMConstTrunc(LLVMSizeOf(state_ty),
+                                                   LLVMInt32Type()));
 }
 
 static void cgen_jump_table(cgen_ctx_t *ctx)
@@ -3241,6 +3509,10 @@ static void cgen_procedure(LLVMTypeRef display_type)
 {
    assert(vcode_unit_kind() == VCODE_UNIT_PROCEDURE);
 
+   cgen_part_t *part = cgen_current_part();
+   if (part != NULL)
+      part->n_other++;
+
    const int nparams = vcode_count_params();
    vcode_type_t params[nparams];
    for (int i = 0; i < nparams; i++)
@@ -3311,6 +3583,39 @@ static void cgen_procedure(LLVMTypeRef display_type)
    cgen_free_context(&ctx);
 }
 
+static void cgen_process_temp(LLVMValueRef fn)
+{
+   // Use the counts from an earlier run to group the processes that ran
+   // most often and to optimise their module harder
+
+   cgen_part_t *part = cgen_current_part();
+   if (part == NULL)
+      return;
+   else if (profile == NULL) {
+      part->n_other++;
+      return;
+   }
+
+   switch ((proc_temp_t)(intptr_t)hash_get(profile, vcode_unit_name())) {
+   case PROC_HOT:
+#if !defined __APPLE__ && !defined __MINGW32__
+      LLVMSetSection(fn, ".text.hot");
+#endif
+      part->n_hot++;
+      break;
+   case PROC_COLD:
+#if !defined __APPLE__ && !defined __MINGW32__
+      LLVMSetSection(fn, ".text.unlikely");
+#endif
+      cgen_add_func_attr(fn, FUNC_ATTR_COLD, -1);
+      part->n_cold++;
+      break;
+   default:
+      part->n_other++;
+      break;
+   }
+}
+
 static void cgen_process(vcode_unit_t code)
 {
    vcode_select_unit(code);
@@ -3322,6 +3627,7 @@ static void cgen_process(vcode_unit_t code)
    LLVMValueRef fn = LLVMAddFunction(module, name, ftype);
    cgen_add_func_attr(fn, FUNC_ATTR_NOUNWIND, -1);
    cgen_add_func_attr(fn, FUNC_ATTR_DLLEXPORT, -1);
+   cgen_process_temp(fn);
 
    LLVMBasicBlockRef entry_bb = LLVMAppendBasicBlock(fn, "entry");
    LLVMBasicBlockRef reset_bb = LLVMAppendBasicBlock(fn, "reset");
@@ -3456,26 +3762,109 @@ static void cgen_reset_function(tree_t top)
    cgen_free_context(&ctx);
 }
 
-static void cgen_coverage_state(tree_t t)
+static void cgen_coverage_state(tree_t t, bool external)
 {
    const int stmt_tags = tree_attr_int(t, ident_new("stmt_tags"), 0);
    if (stmt_tags > 0) {
       LLVMTypeRef type = LLVMArrayType(LLVMInt32Type(), stmt_tags);
       LLVMValueRef var = LLVMAddGlobal(module, type, "cover_stmts");
-      LLVMSetInitializer(var, LLVMGetUndef(type));
-      cgen_add_func_attr(var, FUNC_ATTR_DLLEXPORT, -1);
+      if (external)
+         LLVMSetLinkage(var, LLVMExternalLinkage);
+      else {
+         LLVMSetInitializer(var, LLVMGetUndef(type));
+         cgen_add_func_attr(var, FUNC_ATTR_DLLEXPORT, -1);
+      }
+   }
+
+   if (stmt_tags > 0 && cover_mode == COVER_SAMPLE) {
+      LLVMTypeRef type = LLVMInt32Type();
+      LLVMValueRef var = LLVMAddGlobal(module, type, "cover_sample");
+      if (external)
+         LLVMSetLinkage(var, LLVMExternalLinkage);
+      else {
+         LLVMSetInitializer(var, llvm_int32(1));
+         cgen_add_func_attr(var, FUNC_ATTR_DLLEXPORT, -1);
+      }
    }
 
    const int cond_tags = tree_attr_int(t, ident_new("cond_tags"), 0);
    if (cond_tags > 0) {
       LLVMTypeRef type = LLVMArrayType(LLVMInt32Type(), stmt_tags);
       LLVMValueRef var = LLVMAddGlobal(module, type, "cover_conds");
-      LLVMSetInitializer(var, LLVMGetUndef(type));
-      cgen_add_func_attr(var, FUNC_ATTR_DLLEXPORT, -1);
+      if (external)
+         LLVMSetLinkage(var, LLVMExternalLinkage);
+      else {
+         LLVMSetInitializer(var, LLVMGetUndef(type));
+         cgen_add_func_attr(var, FUNC_ATTR_DLLEXPORT, -1);
+      }
    }
 }
 
-static void cgen_subprograms(vcode_unit_t vcode)
+static unsigned cgen_unit_weight(vcode_unit_t unit)
+{
+   vcode_select_unit(unit);
+
+   unsigned weight = 0;
+   const int nblocks = vcode_count_blocks();
+   for (int i = 0; i < nblocks; i++) {
+      vcode_select_block(i);
+      weight += vcode_count_ops();
+   }
+
+   for (vcode_unit_t it = vcode_unit_child(unit);
+        it != NULL;
+        it = vcode_unit_next(it))
+      weight += cgen_unit_weight(it);
+
+   return weight;
+}
+
+static void cgen_select_part(vcode_unit_t unit)
+{
+   // Place each top-level unit in the module with the least code so far
+
+   if (n_parts <= 1)
+      return;
+   else if (opt_get_int("cgen-cache")) {
+      // Each unit has a module of its own so it can be cached separately
+      module = parts[++next_part].module;
+      return;
+   }
+
+   cgen_part_t *best = &(parts[0]);
+   for (int i = 1; i < n_parts; i++) {
+      if (parts[i].weight < best->weight)
+         best = &(parts[i]);
+   }
+
+   best->weight += cgen_unit_weight(unit);
+   module = best->module;
+}
+
+static void cgen_subprograms(vcode_unit_t vcode, bool split);
+
+static void cgen_stream_processes(vcode_unit_t context)
+{
+   // Lower each process only once the code for the previous one has
+   // been emitted so that at most one process worth of vcode is live
+
+   const int nstmts = tree_stmts(stream_top);
+   for (int i = 0; i < nstmts; i++) {
+      vcode_unit_t vu = lower_elab_process(tree_stmt(stream_top, i), context);
+      vcode_optimise(vu);
+
+      cgen_select_part(vu);
+
+      cgen_subprograms(vu, false);
+      cgen_process(vu);
+
+      vcode_unit_free(vu);
+   }
+
+   vcode_select_unit(context);
+}
+
+static void cgen_subprograms(vcode_unit_t vcode, bool split)
 {
    vcode_select_unit(vcode);
 
@@ -3487,12 +3876,15 @@ static void cgen_subprograms(vcode_unit_t vcode)
         it != NULL;
         it = vcode_unit_next(it)) {
 
+      if (split)
+         cgen_select_part(it);
+
       vcode_select_unit(it);
 
       switch (vcode_unit_kind()) {
       case VCODE_UNIT_PROCEDURE:
       case VCODE_UNIT_FUNCTION:
-         cgen_subprograms(it);
+         cgen_subprograms(it, false);
          if (display == NULL && needs_display)
             display = cgen_display_type(vcode);
          vcode_select_unit(it);
@@ -3502,16 +3894,22 @@ static void cgen_subprograms(vcode_unit_t vcode)
             cgen_procedure(display);
          break;
       case VCODE_UNIT_PROCESS:
-         cgen_subprograms(it);
+         cgen_subprograms(it, false);
          cgen_process(it);
          break;
       default:
          break;
       }
    }
+
+   if (split && stream_top != NULL)
+      cgen_stream_processes(vcode);
+
+   if (split)
+      module = parts[0].module;
 }
 
-static void cgen_shared_variables(void)
+static void cgen_shared_variables(bool external)
 {
    const int nvars = vcode_count_vars();
    for (int i = 0; i < nvars; i++) {
@@ -3520,7 +3918,9 @@ static void cgen_shared_variables(void)
       LLVMTypeRef type = cgen_type(vcode_var_type(var));
       const char *name = safe_symbol(istr(vcode_var_name(var)));
       LLVMValueRef global = LLVMAddGlobal(module, type, name);
-      if (vcode_var_extern(var)) {
+      if (external && !vcode_var_extern(var))
+         LLVMSetLinkage(global, LLVMExternalLinkage);
+      else if (vcode_var_extern(var)) {
 #ifdef IMPLIB_REQUIRED
          LLVMSetDLLStorageClass(global, LLVMDLLImportStorageClass);
 #endif
@@ -3535,7 +3935,7 @@ static void cgen_shared_variables(void)
    }
 }
 
-static void cgen_signals(void)
+static void cgen_signals(bool external)
 {
    const int nsignals = vcode_count_signals();
    for (int i = 0 ; i < nsignals; i++) {
@@ -3563,6 +3963,17 @@ static void cgen_signals(void)
 
             LLVMSetInitializer(map_var, LLVMConstArray(nid_type, init, nnets));
             free(init);
+
+            if (external) {
+               // Keep a private copy so the net IDs can be folded
+               LLVMSetLinkage(map_var, LLVMPrivateLinkage);
+               continue;
+            }
+         }
+         else if (external) {
+            // Filled in by the reset function in the primary module
+            LLVMSetLinkage(map_var, LLVMExternalLinkage);
+            continue;
          }
          else {
             // Values will be filled in by reset function
@@ -3576,21 +3987,88 @@ static void cgen_signals(void)
    }
 }
 
+static void cgen_process_table(tree_t top)
+{
+   // Export the entry point of every process in statement order so
+   // the runtime can bind them all with a single symbol lookup
+
+   const int nstmts = tree_stmts(top);
+
+   LLVMTypeRef pargs[] = { LLVMInt32Type() };
+   LLVMTypeRef ftype = LLVMFunctionType(LLVMVoidType(), pargs, 1, false);
+
+   LLVMValueRef *entries LOCAL = xmalloc(MAX(nstmts, 1) * sizeof(LLVMValueRef));
+   for (int i = 0; i < nstmts; i++) {
+      const char *name = safe_symbol(istr(tree_ident(tree_stmt(top, i))));
+
+      // Processes may be defined in another part of the design
+      LLVMValueRef fn = LLVMGetNamedFunction(module, name);
+      if (fn == NULL)
+         fn = LLVMAddFunction(module, name, ftype);
+
+      entries[i] = LLVMConstBitCast(fn, llvm_void_ptr());
+   }
+
+   char *name LOCAL = xasprintf("%s_processes", istr(tree_ident(top)));
+   LLVMTypeRef type = LLVMArrayType(llvm_void_ptr(), nstmts);
+   LLVMValueRef table = LLVMAddGlobal(module, type, safe_symbol(name));
+   LLVMSetInitializer(table, LLVMConstArray(llvm_void_ptr(), entries, nstmts));
+   LLVMSetGlobalConstant(table, true);
+   cgen_add_func_attr(table, FUNC_ATTR_DLLEXPORT, -1);
+}
+
 static void cgen_top(tree_t t, vcode_unit_t vcode)
 {
    vcode_select_unit(vcode);
 
-   cgen_coverage_state(t);
-   cgen_shared_variables();
-   cgen_signals();
+   cgen_coverage_state(t, false);
+   cgen_shared_variables(false);
+   cgen_signals(false);
    cgen_reset_function(t);
-   cgen_subprograms(vcode);
+   cgen_subprograms(vcode, true);
+
+   if (tree_kind(t) == T_ELAB) {
+      module = parts[0].module;
+      cgen_process_table(t);
+   }
+}
+
+static void cgen_extern_decls(tree_t t, vcode_unit_t vcode)
+{
+   // Declare the globals defined in the primary module
+
+   vcode_select_unit(vcode);
+
+   cgen_coverage_state(t, true);
+   cgen_shared_variables(true);
+   cgen_signals(true);
+}
+
+static int cgen_opt_level(const cgen_part_t *part)
+{
+   // Modules holding any hot process are optimised at -O3 and those
+   // holding only processes which never ran after reset at -O1
+
+   const int level = opt_get_int("optimise");
+   if (part->n_hot > 0)
+      return MAX(level, 3);
+   else if (part->n_cold > 0 && part->n_other == 0)
+      return MIN(level, 1);
+   else
+      return level;
 }
 
-static void cgen_optimise(void)
+static void cgen_optimise(LLVMModuleRef m, int level)
 {
    LLVMPassManagerRef pass_mgr = LLVMCreatePassManager();
 
+#ifdef LLVM_HAS_MERGE_FUNCTIONS
+   // Each instance of an architecture has its own renamed copy of any
+   // subprograms declared there: fold the identical bodies first so
+   // the rest of the pipeline and code generation only see one
+   LLVMAddMergeFunctionsPass(pass_mgr);
+#endif
+
    LLVMAddPromoteMemoryToRegisterPass(pass_mgr);
    LLVMAddInstructionCombiningPass(pass_mgr);
    LLVMAddReassociatePass(pass_mgr);
@@ -3598,10 +4076,10 @@ static void cgen_optimise(void)
    LLVMAddCFGSimplificationPass(pass_mgr);
 
    LLVMPassManagerBuilderRef builder = LLVMPassManagerBuilderCreate();
-   LLVMPassManagerBuilderSetOptLevel(builder, opt_get_int("optimise"));
+   LLVMPassManagerBuilderSetOptLevel(builder, level);
    LLVMPassManagerBuilderPopulateModulePassManager(builder, pass_mgr);
 
-   LLVMRunPassManager(pass_mgr, module);
+   LLVMRunPassManager(pass_mgr, m);
 
    LLVMDisposePassManager(pass_mgr);
    LLVMPassManagerBuilderDispose(builder);
@@ -3655,6 +4133,7 @@ static LLVMValueRef cgen_support_fn(const char *name)
          llvm_void_ptr(),
          LLVMPointerType(llvm_size_list_type(), 0),
          LLVMInt32Type(),
+         LLVMInt32Type(),
          LLVMPointerType(LLVMInt8Type(), 0)
       };
       fn = LLVMAddFunction(module, "_set_initial",
@@ -3668,6 +4147,7 @@ static LLVMValueRef cgen_support_fn(const char *name)
          LLVMInt32Type(),
          LLVMInt32Type(),
          llvm_void_ptr(),
+         LLVMInt32Type(),
          LLVMPointerType(LLVMInt8Type(), 0)
       };
       fn = LLVMAddFunction(module, "_set_initial_1",
@@ -3865,6 +4345,18 @@ static LLVMValueRef cgen_support_fn(const char *name)
                                             args, ARRAY_LEN(args), false));
       cgen_add_func_attr(fn, FUNC_ATTR_NORETURN, -1);
    }
+   else if (strcmp(name, "_access_new") == 0) {
+      LLVMTypeRef args[] = { LLVMInt64Type() };
+      fn = LLVMAddFunction(module, "_access_new",
+                           LLVMFunctionType(llvm_void_ptr(),
+                                            args, ARRAY_LEN(args), false));
+   }
+   else if (strcmp(name, "_access_free") == 0) {
+      LLVMTypeRef args[] = { llvm_void_ptr() };
+      fn = LLVMAddFunction(module, "_access_free",
+                           LLVMFunctionType(LLVMVoidType(),
+                                            args, ARRAY_LEN(args), false));
+   }
    else if (strcmp(name, "_null_deref") == 0) {
       LLVMTypeRef args[] = {
          LLVMPointerType(llvm_rt_loc(), 0)
@@ -3937,6 +4429,14 @@ static LLVMValueRef cgen_support_fn(const char *name)
                            LLVMFunctionType(LLVMVoidType(),
                                             NULL, 0, false));
    }
+   else if (strcmp(name, "_tmp_stack_grow") == 0) {
+      LLVMTypeRef args[] = {
+         LLVMInt32Type()
+      };
+      fn = LLVMAddFunction(module, "_tmp_stack_grow",
+                           LLVMFunctionType(LLVMVoidType(),
+                                            args, ARRAY_LEN(args), false));
+   }
 
    if (fn != NULL)
       cgen_add_func_attr(fn, FUNC_ATTR_NOUNWIND, -1);
@@ -3953,6 +4453,16 @@ static void cgen_tmp_stack(void)
    LLVMValueRef _tmp_alloc =
       LLVMAddGlobal(module, LLVMInt32Type(), "_tmp_alloc");
    LLVMSetLinkage(_tmp_alloc, LLVMExternalLinkage);
+
+   LLVMValueRef _tmp_limit =
+      LLVMAddGlobal(module, LLVMInt32Type(), "_tmp_limit");
+   LLVMSetLinkage(_tmp_limit, LLVMExternalLinkage);
+
+#if RT_MULTITHREAD
+   LLVMSetThreadLocalMode(_tmp_stack, LLVMInitialExecTLSModel);
+   LLVMSetThreadLocalMode(_tmp_alloc, LLVMInitialExecTLSModel);
+   LLVMSetThreadLocalMode(_tmp_limit, LLVMInitialExecTLSModel);
+#endif
 }
 
 static void cgen_link_arg(const char *fmt, ...)
@@ -4011,18 +4521,9 @@ static void cgen_find_implib_deps(ident_t unit_name, ident_list_t **deps)
 }
 #endif  // IMPLIB_REQUIRED
 
-static void cgen_native(tree_t top, LLVMTargetMachineRef tm_ref)
+static void cgen_native(tree_t top)
 {
    ident_t unit_name = tree_ident(top);
-   char *obj_name LOCAL = xasprintf("_%s." LLVM_OBJ_EXT, istr(unit_name));
-
-   char obj_path[PATH_MAX];
-   lib_realpath(lib_work(), obj_name, obj_path, sizeof(obj_path));
-
-   char *error;
-   if (LLVMTargetMachineEmitToFile(tm_ref, module, obj_path,
-                                   LLVMObjectFile, &error))
-      fatal("Failed to write object file: %s", error);
 
    max_link_args = 64;
    link_args = xmalloc(sizeof(char *) * max_link_args);
@@ -4049,7 +4550,9 @@ static void cgen_native(tree_t top, LLVMTargetMachineRef tm_ref)
 
    cgen_link_arg("-o");
    cgen_link_arg("%s", so_path);
-   cgen_link_arg("%s", obj_path);
+
+   for (int i = 0; i < n_parts; i++)
+      cgen_link_arg("%s", parts[i].obj_path);
 
 #if IMPLIB_REQUIRED
    char *impname LOCAL = xasprintf("_%s.lib", istr(unit_name));
@@ -4101,39 +4604,573 @@ static void cgen_native(tree_t top, LLVMTargetMachineRef tm_ref)
    link_args = NULL;
 }
 
+static LLVMTargetMachineRef cgen_target_machine(const char *triple,
+                                                LLVMCodeModel code_model,
+                                                int level)
+{
+   char *error;
+   LLVMTargetRef target_ref;
+   if (LLVMGetTargetFromTriple(triple, &target_ref, &error))
+      fatal("failed to get LLVM target for %s: %s", triple, error);
+
+   LLVMCodeGenOptLevel code_gen_level;
+   switch (level) {
+   case 0: code_gen_level = LLVMCodeGenLevelNone; break;
+   case 1: code_gen_level = LLVMCodeGenLevelLess; break;
+   case 3: code_gen_level = LLVMCodeGenLevelAggressive; break;
+   default: code_gen_level = LLVMCodeGenLevelDefault;
+   }
+
+   return LLVMCreateTargetMachine(target_ref, triple, "", "",
+                                  code_gen_level,
+                                  LLVMRelocPIC,
+                                  code_model);
+}
+
+static int cgen_count_parts(tree_t top, vcode_unit_t vcode)
+{
+#ifdef IMPLIB_REQUIRED
+   // Symbols shared between modules would need import libraries
+   return 1;
+#else
+   if (tree_kind(top) != T_ELAB || opt_get_int("jit"))
+      return 1;
+
+   int nunits = 0;
+   for (vcode_unit_t it = vcode_unit_child(vcode);
+        it != NULL;
+        it = vcode_unit_next(it))
+      nunits++;
+
+   if (stream_top != NULL)
+      nunits += tree_stmts(top);
+
+   if (opt_get_int("cgen-cache"))
+      return nunits + 1;
+   else
+      return MAX(MIN(opt_get_int("cgen-jobs"), nunits), 1);
+#endif
+}
+
+static void cgen_strip_decls(LLVMModuleRef m)
+{
+   // Remove extern declarations and private copies this module never uses
+
+   LLVMValueRef next;
+   for (LLVMValueRef g = LLVMGetFirstGlobal(m); g != NULL; g = next) {
+      next = LLVMGetNextGlobal(g);
+
+      const bool unused = LLVMGetFirstUse(g) == NULL;
+      const bool local = LLVMIsDeclaration(g)
+         || LLVMGetLinkage(g) == LLVMPrivateLinkage;
+
+      if (unused && local)
+         LLVMDeleteGlobal(g);
+   }
+}
+
+static void cgen_cache_lookup(cgen_part_t *part, const char *triple)
+{
+   // The object file is named after a hash of the module bitcode and
+   // everything else that affects the generated code
+
+   part->bitcode = LLVMWriteBitcodeToMemoryBuffer(part->module);
+
+   const char *bytes = LLVMGetBufferStart(part->bitcode);
+   const size_t size = LLVMGetBufferSize(part->bitcode);
+
+   uint64_t hash = UINT64_C(14695981039346656037);
+   for (size_t i = 0; i < size; i++)
+      hash = (hash ^ (uint8_t)bytes[i]) * UINT64_C(1099511628211);
+
+   for (const char *p = triple; *p != '\0'; p++)
+      hash = (hash ^ (uint8_t)*p) * UINT64_C(1099511628211);
+
+   hash = (hash ^ cgen_opt_level(part)) * UINT64_C(1099511628211);
+
+   char *name LOCAL = xasprintf("_cache" PATH_SEP "%016" PRIx64
+                                "." LLVM_OBJ_EXT, hash);
+
+   char obj_path[PATH_MAX];
+   lib_realpath(lib_work(), name, obj_path, sizeof(obj_path));
+
+   free(part->obj_path);
+   part->obj_path = xstrdup(obj_path);
+   part->cached   = (access(obj_path, F_OK) == 0);
+}
+
+static void cgen_emit_part(cgen_part_t *part, LLVMModuleRef m,
+                           LLVMTargetMachineRef tm_ref)
+{
+   cgen_optimise(m, cgen_opt_level(part));
+
+   char *path = part->obj_path, *tmp_path LOCAL = NULL;
+   if (opt_get_int("cgen-cache")) {
+      // Write to a temporary file first so another process sharing the
+      // cache never sees a partial object
+      path = tmp_path = xasprintf("%s.%d.tmp", part->obj_path, getpid());
+   }
+
+   if (LLVMTargetMachineEmitToFile(tm_ref, m, path,
+                                   LLVMObjectFile, &(part->error)))
+      return;
+
+   part->error = NULL;
+
+   if (tmp_path != NULL && rename(tmp_path, part->obj_path) != 0)
+      part->error = xasprintf("rename: %s", strerror(errno));
+}
+
+#if RT_MULTITHREAD
+static void *cgen_emit_thread(void *arg)
+{
+   // Each thread needs its own LLVM context so modules are moved across
+   // by serialising them to bitcode
+
+   cgen_queue_t *queue = arg;
+
+   LLVMContextRef context = LLVMContextCreate();
+   LLVMTargetMachineRef tm_ref = cgen_target_machine(queue->triple,
+                                                      LLVMCodeModelDefault,
+                                                      opt_get_int("optimise"));
+
+   int next;
+   while ((next = __atomic_fetch_add(&(queue->next), 1, __ATOMIC_RELAXED))
+          < queue->count) {
+      cgen_part_t *part = queue->parts[next];
+
+      LLVMModuleRef m;
+      if (!LLVMParseBitcodeInContext(context, part->bitcode,
+                                     &m, &(part->error))) {
+         cgen_emit_part(part, m, tm_ref);
+         LLVMDisposeModule(m);
+      }
+   }
+
+   LLVMDisposeTargetMachine(tm_ref);
+   LLVMContextDispose(context);
+   return NULL;
+}
+#endif  // RT_MULTITHREAD
+
+static void cgen_emit(LLVMTargetMachineRef tm_ref, const char *triple)
+{
+   const bool cache = opt_get_int("cgen-cache");
+   if (cache)
+      lib_mkdir(lib_work(), "_cache");
+
+   cgen_part_t *misses[n_parts];
+   int n_misses = 0;
+
+   for (int i = 0; i < n_parts; i++) {
+      if (cache)
+         cgen_cache_lookup(&(parts[i]), triple);
+
+      if (!parts[i].cached)
+         misses[n_misses++] = &(parts[i]);
+   }
+
+   if (cache && opt_get_int("verbose"))
+      notef("object cache: %d hits, %d misses", n_parts - n_misses, n_misses);
+
+#if RT_MULTITHREAD
+   const int nthreads = MIN(opt_get_int("cgen-jobs"), n_misses);
+   if (nthreads > 1) {
+      for (int i = 0; i < n_misses; i++) {
+         if (misses[i]->bitcode == NULL)
+            misses[i]->bitcode =
+               LLVMWriteBitcodeToMemoryBuffer(misses[i]->module);
+         LLVMDisposeModule(misses[i]->module);
+         misses[i]->module = NULL;
+      }
+
+      cgen_queue_t queue = {
+         .parts  = misses,
+         .count  = n_misses,
+         .next   = 0,
+         .triple = triple
+      };
+
+      pthread_t threads[nthreads];
+      for (int i = 0; i < nthreads; i++) {
+         if (pthread_create(&(threads[i]), NULL, cgen_emit_thread, &queue))
+            fatal_errno("pthread_create");
+      }
+
+      for (int i = 0; i < nthreads; i++)
+         pthread_join(threads[i], NULL);
+   }
+   else
+#endif
+   for (int i = 0; i < n_misses; i++)
+      cgen_emit_part(misses[i], misses[i]->module, tm_ref);
+
+   for (int i = 0; i < n_misses; i++) {
+      if (misses[i]->error != NULL)
+         fatal("Failed to write object file %s: %s",
+               misses[i]->obj_path, misses[i]->error);
+   }
+}
+
+#ifdef LLVM_HAS_ORC_BINDINGS
+static uint64_t cgen_jit_resolve(const char *name, void *ctx)
+{
+#ifdef __APPLE__
+   if (*name == '_')
+      name++;   // Remove global prefix added by mangling
+#endif
+
+   return (uintptr_t)jit_find_native_symbol(name, false);
+}
+
+static void *cgen_jit_symbol(const char *name)
+{
+   if (orc_stack == NULL) {
+      // Add the module on the first lookup so that the shared libraries
+      // for packages have already been loaded by the runtime
+
+      orc_stack = LLVMOrcCreateInstance(orc_tm);
+      orc_tm = NULL;
+
+      // With --perf-map compile everything up front so the addresses
+      // given to perf are the functions themselves rather than stubs
+      LLVMOrcModuleHandle handle;
+      if (opt_get_int("perf-map")) {
+         if (LLVMOrcAddEagerlyCompiledIR(orc_stack, &handle, orc_module,
+                                         cgen_jit_resolve, NULL))
+            fatal("failed to add module to JIT");
+      }
+      else if (LLVMOrcAddLazilyCompiledIR(orc_stack, &handle, orc_module,
+                                          cgen_jit_resolve, NULL))
+         fatal("failed to add module to JIT");
+      orc_module = NULL;
+   }
+
+   char *mangled;
+   LLVMOrcGetMangledSymbol(orc_stack, &mangled, name);
+
+   LLVMOrcTargetAddress addr = 0;
+   if (LLVMOrcGetSymbolAddress(orc_stack, &addr, mangled))
+      fatal("JIT failed to compile %s", name);
+
+   LLVMOrcDisposeMangledSymbol(mangled);
+
+   return (void *)(uintptr_t)addr;
+}
+#endif  // LLVM_HAS_ORC_BINDINGS
+
+#if defined LLVM_HAS_ORC_BINDINGS && RT_MULTITHREAD
+static uint64_t cgen_tier_resolve(const char *name, void *ctx)
+{
+#ifdef __APPLE__
+   if (*name == '_')
+      name++;   // Remove global prefix added by mangling
+#endif
+
+   // Variables are shared with the unoptimised code
+   void *addr = shash_get(tier_globals, name);
+   if (addr != NULL)
+      return (uintptr_t)addr;
+
+   return (uintptr_t)jit_find_native_symbol(name, false);
+}
+
+static LLVMModuleRef cgen_tier_module(LLVMContextRef context,
+                                      const char *name)
+{
+   // Make a module from the unoptimised bitcode containing only the
+   // process and the subprograms it calls where every variable refers
+   // to the copy already in use by the running simulation
+
+   LLVMModuleRef m;
+   char *error;
+   if (LLVMParseBitcodeInContext(context, tier_bitcode, &m, &error)) {
+      warnf("cannot recompile %s: %s", name, error);
+      LLVMDisposeMessage(error);
+      return NULL;
+   }
+
+   LLVMValueRef target = LLVMGetNamedFunction(m, name);
+   if (target == NULL || LLVMIsDeclaration(target)) {
+      LLVMDisposeModule(m);
+      return NULL;
+   }
+
+   for (LLVMValueRef fn = LLVMGetFirstFunction(m);
+        fn != NULL; fn = LLVMGetNextFunction(fn)) {
+      if (fn != target && !LLVMIsDeclaration(fn))
+         LLVMSetLinkage(fn, LLVMInternalLinkage);
+   }
+
+   LLVMValueRef next;
+   for (LLVMValueRef g = LLVMGetFirstGlobal(m); g != NULL; g = next) {
+      next = LLVMGetNextGlobal(g);
+
+      if (LLVMIsDeclaration(g))
+         continue;
+
+      const LLVMLinkage linkage = LLVMGetLinkage(g);
+      if (linkage == LLVMPrivateLinkage || linkage == LLVMInternalLinkage) {
+         if (LLVMIsGlobalConstant(g))
+            continue;   // Each module has its own copy
+
+         LLVMDisposeModule(m);
+         return NULL;
+      }
+
+      char *gname LOCAL = xstrdup(LLVMGetValueName(g));
+      LLVMSetValueName(g, "");
+
+      LLVMTypeRef type = LLVMGetElementType(LLVMTypeOf(g));
+      LLVMValueRef decl = LLVMAddGlobal(m, type, gname);
+      LLVMReplaceAllUsesWith(g, decl);
+      LLVMDeleteGlobal(g);
+   }
+
+   return m;
+}
+
+static void *cgen_tier_thread(void *arg)
+{
+   LLVMContextRef context = LLVMContextCreate();
+   const int level = MAX(opt_get_int("optimise"), 1);
+   LLVMTargetMachineRef tm =
+      cgen_target_machine(tier_triple, LLVMCodeModelJITDefault, level);
+   LLVMOrcJITStackRef stack = LLVMOrcCreateInstance(tm);
+
+   for (;;) {
+      pthread_mutex_lock(&tier_lock);
+      while (tier_queue == NULL)
+         pthread_cond_wait(&tier_cond, &tier_lock);
+
+      tier_req_t *req = tier_queue;
+      tier_queue = req->next;
+      pthread_mutex_unlock(&tier_lock);
+
+      LLVMModuleRef m = cgen_tier_module(context, req->name);
+      if (m != NULL) {
+         cgen_optimise(m, level);
+
+         LLVMOrcModuleHandle handle;
+         if (LLVMOrcAddEagerlyCompiledIR(stack, &handle, m,
+                                         cgen_tier_resolve, NULL) == 0) {
+            char *mangled;
+            LLVMOrcGetMangledSymbol(stack, &mangled, req->name);
+
+            LLVMOrcTargetAddress addr = 0;
+            if (LLVMOrcGetSymbolAddress(stack, &addr, mangled) == 0
+                && addr != 0)
+               __atomic_store_n(req->result, (void *)(uintptr_t)addr,
+                                __ATOMIC_RELEASE);
+
+            LLVMOrcDisposeMangledSymbol(mangled);
+         }
+      }
+
+      free(req->name);
+      free(req);
+   }
+
+   return NULL;
+}
+
+static void cgen_tier_up(const char *name, void **result)
+{
+   // Called by the simulation kernel when a process has run often
+   // enough: the address of the optimised code is stored in result
+   // when it is ready
+
+   if (tier_globals == NULL) {
+      // Addresses of the variables are found on this thread as the lazy
+      // JIT stack is not safe to use from another thread
+      tier_globals = shash_new(MAX(tier_nnames * 2, 16));
+      for (size_t i = 0; i < tier_nnames; i++) {
+         shash_put(tier_globals, tier_names[i],
+                   cgen_jit_symbol(tier_names[i]));
+         free(tier_names[i]);
+      }
+      free(tier_names);
+      tier_names = NULL;
+
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, cgen_tier_thread, NULL))
+         fatal_errno("pthread_create");
+      pthread_detach(thread);
+   }
+
+   tier_req_t *req = xmalloc(sizeof(tier_req_t));
+   req->name   = xstrdup(name);
+   req->result = result;
+
+   pthread_mutex_lock(&tier_lock);
+   req->next = tier_queue;
+   tier_queue = req;
+   pthread_cond_signal(&tier_cond);
+   pthread_mutex_unlock(&tier_lock);
+}
+
+static void cgen_tier_prepare(LLVMModuleRef m, const char *triple)
+{
+   // Keep the unoptimised module and the names of the variables in it
+   // for recompiling hot processes later
+
+   tier_bitcode = LLVMWriteBitcodeToMemoryBuffer(m);
+   tier_triple  = xstrdup(triple);
+
+   size_t max_names = 0;
+   for (LLVMValueRef g = LLVMGetFirstGlobal(m);
+        g != NULL; g = LLVMGetNextGlobal(g)) {
+      const LLVMLinkage linkage = LLVMGetLinkage(g);
+      if (!LLVMIsDeclaration(g) && linkage != LLVMPrivateLinkage
+          && linkage != LLVMInternalLinkage)
+         ARRAY_APPEND(tier_names, xstrdup(LLVMGetValueName(g)),
+                      tier_nnames, max_names);
+   }
+
+   jit_set_tier_up(cgen_tier_up);
+}
+#endif  // LLVM_HAS_ORC_BINDINGS && RT_MULTITHREAD
+
+static void cgen_jit(tree_t top, const char *triple)
+{
+   // Keep the module in memory and compile each function the first
+   // time it is called rather than linking a shared library
+
+#ifdef LLVM_HAS_ORC_BINDINGS
+   assert(n_parts == 1);
+
+   // Stop a later run picking up a stale library from an earlier
+   // elaboration without --jit
+   char *so_name LOCAL = xasprintf("_%s." DLL_EXT, istr(tree_ident(top)));
+   lib_delete(lib_work(), so_name);
+
+   if (orc_stack != NULL)
+      fatal("only one design can be elaborated with --jit");
+
+   int level = cgen_opt_level(&(parts[0]));
+
+   if (opt_get_int("jit-tiered")) {
+#if RT_MULTITHREAD
+      // Start quickly on unoptimised code and let the simulation kernel
+      // ask for the processes that run most to be optimised
+      cgen_tier_prepare(parts[0].module, triple);
+      level = 0;
+#else
+      fatal("--tiered requires thread support");
+#endif
+   }
+
+   cgen_optimise(parts[0].module, level);
+
+   orc_module = parts[0].module;
+   orc_tm     = cgen_target_machine(triple, LLVMCodeModelJITDefault, level);
+
+   parts[0].module = NULL;
+
+   jit_set_lookup(cgen_jit_symbol);
+#else
+   fatal("--jit is not supported by this version of LLVM");
+#endif
+}
+
+typedef struct {
+   ident_t  name;
+   uint64_t wakeups;
+} proc_count_t;
+
+static int cgen_count_cmp(const void *a, const void *b)
+{
+   const uint64_t wa = ((const proc_count_t *)a)->wakeups;
+   const uint64_t wb = ((const proc_count_t *)b)->wakeups;
+   return (wa < wb) - (wa > wb);
+}
+
+static void cgen_load_profile(const char *file)
+{
+   // Read the process counts written by --profile-out and classify the
+   // processes which account for most wakeups as hot and those which
+   // never ran after initialisation as cold
+
+   FILE *f = fopen(file, "r");
+   if (f == NULL)
+      fatal_errno("failed to open %s", file);
+
+   proc_count_t *counts = NULL;
+   size_t ncounts = 0, maxcounts = 0;
+   uint64_t total = 0;
+
+   char line[1024];
+   while (fgets(line, sizeof(line), f) != NULL) {
+      if (line[0] == '#')
+         continue;
+
+      uint64_t wakeups, ticks;
+      int pos;
+      if (sscanf(line, "%"SCNu64" %"SCNu64" %n", &wakeups, &ticks, &pos) < 2)
+         fatal("%s is not a profile written by --profile-out", file);
+
+      char *nl = strchr(line + pos, '\n');
+      if (nl == NULL)
+         fatal("%s has a process name which is too long", file);
+      *nl = '\0';
+
+      ARRAY_APPEND(counts, ((proc_count_t){ ident_new(line + pos), wakeups }),
+                   ncounts, maxcounts);
+      total += wakeups;
+   }
+
+   fclose(f);
+
+   qsort(counts, ncounts, sizeof(proc_count_t), cgen_count_cmp);
+
+   profile = hash_new(MAX(ncounts * 2, 16), true);
+
+   uint64_t sum = 0;
+   for (size_t i = 0; i < ncounts; i++) {
+      proc_temp_t temp = PROC_WARM;
+      if (counts[i].wakeups <= 1)
+         temp = PROC_COLD;
+      else if (sum < total - total / 10)
+         temp = PROC_HOT;
+
+      sum += counts[i].wakeups;
+      hash_put(profile, counts[i].name, (void *)(intptr_t)temp);
+   }
+
+   free(counts);
+}
+
 void cgen(tree_t top, vcode_unit_t vcode)
 {
    tree_kind_t kind = tree_kind(top);
    if (kind != T_ELAB && kind != T_PACK_BODY && kind != T_PACKAGE)
       fatal("cannot generate code for %s", tree_kind_str(kind));
 
-   module = LLVMModuleCreateWithName(istr(tree_ident(top)));
+   vcode_optimise(vcode);
+
+   cover_mode = tree_attr_int(top, ident_new("cover_mode"), COVER_COUNT);
+
+   const char *profile_file = opt_get_str("profile-use");
+   if (kind == T_ELAB && profile_file != NULL)
+      cgen_load_profile(profile_file);
+
+   if (kind == T_ELAB) {
+      const int ndecls = tree_decls(top);
+      decl_index = hash_new(MAX(ndecls * 2, 16), true);
+      for (int i = 0; i < ndecls; i++)
+         hash_put(decl_index, tree_ident(tree_decl(top, i)),
+                  (void *)(intptr_t)(i + 1));
+   }
+
    builder = LLVMCreateBuilder();
 
    LLVMInitializeNativeTarget();
    LLVMInitializeNativeAsmPrinter();
 
    char *def_triple = LLVMGetDefaultTargetTriple();
-   char *error;
-   LLVMTargetRef target_ref;
-   if (LLVMGetTargetFromTriple(def_triple, &target_ref, &error))
-      fatal("failed to get LLVM target for %s: %s", def_triple, error);
-
-   LLVMCodeGenOptLevel code_gen_level;
-   switch (opt_get_int("optimise")) {
-   case 0: code_gen_level = LLVMCodeGenLevelNone; break;
-   case 1: code_gen_level = LLVMCodeGenLevelLess; break;
-   case 3: code_gen_level = LLVMCodeGenLevelAggressive; break;
-   default: code_gen_level = LLVMCodeGenLevelDefault;
-   }
-
    LLVMTargetMachineRef tm_ref =
-      LLVMCreateTargetMachine(target_ref, def_triple, "", "",
-                              code_gen_level,
-                              LLVMRelocPIC,
-                              LLVMCodeModelDefault);
-
-   LLVMSetTarget(module, def_triple);
+      cgen_target_machine(def_triple, LLVMCodeModelDefault,
+                          opt_get_int("optimise"));
 
 #if LLVM_HAS_CREATE_TARGET_DATA_LAYOUT
    LLVMTargetDataRef data_ref = LLVMCreateTargetDataLayout(tm_ref);
@@ -4142,22 +5179,104 @@ void cgen(tree_t top, vcode_unit_t vcode)
 #endif
 
    char *layout LOCAL = LLVMCopyStringRepOfTargetData(data_ref);
-   LLVMSetDataLayout(module, layout);
 
-   cgen_tmp_stack();
+   // Large designs are split into several modules which are optimised
+   // and compiled in parallel then linked into the same library
+
+   n_parts = cgen_count_parts(top, vcode);
+   parts = xcalloc(n_parts * sizeof(cgen_part_t));
+   next_part = 0;
+
+   const bool cache = opt_get_int("cgen-cache");
+   vcode_unit_t child = vcode_unit_child(vcode);
+   int next_stmt = 0;
+
+   const char *unit_name = istr(tree_ident(top));
+   for (int i = 0; i < n_parts; i++) {
+      char *name LOCAL = NULL, *obj_name LOCAL = NULL;
+      if (i == 0) {
+         name = xstrdup(unit_name);
+         obj_name = xasprintf("_%s." LLVM_OBJ_EXT, unit_name);
+      }
+      else {
+         if (cache) {
+            // Module name is part of the bitcode so must not depend on
+            // the position of the unit
+            if (child != NULL) {
+               vcode_select_unit(child);
+               name = xstrdup(istr(vcode_unit_name()));
+               child = vcode_unit_next(child);
+            }
+            else {
+               // Streamed processes are lowered later in this order
+               tree_t s = tree_stmt(top, next_stmt++);
+               name = xstrdup(istr(tree_ident(s)));
+            }
+         }
+         else
+            name = xasprintf("%s.%d", unit_name, i);
+         obj_name = xasprintf("_%s.%d." LLVM_OBJ_EXT, unit_name, i);
+      }
+
+      char obj_path[PATH_MAX];
+      lib_realpath(lib_work(), obj_name, obj_path, sizeof(obj_path));
+
+      parts[i].module   = LLVMModuleCreateWithName(name);
+      parts[i].obj_path = xstrdup(obj_path);
+
+      module = parts[i].module;
+
+      LLVMSetTarget(module, def_triple);
+      LLVMSetDataLayout(module, layout);
+
+      cgen_tmp_stack();
+
+      if (i > 0)
+         cgen_extern_decls(top, vcode);
+   }
+
+   module = parts[0].module;
 
    cgen_top(top, vcode);
 
-   if (opt_get_int("dump-llvm"))
-      LLVMDumpModule(module);
+   for (int i = 0; i < n_parts; i++) {
+      if (i > 0)
+         cgen_strip_decls(parts[i].module);
+
+      if (opt_get_int("dump-llvm"))
+         LLVMDumpModule(parts[i].module);
+
+      if (LLVMVerifyModule(parts[i].module, LLVMPrintMessageAction, NULL))
+         fatal("LLVM verification failed");
+   }
+
+   if (opt_get_int("jit"))
+      cgen_jit(top, def_triple);
+   else {
+      cgen_emit(tm_ref, def_triple);
+      cgen_native(top);
+   }
+
+   for (int i = 0; i < n_parts; i++) {
+      if (parts[i].module != NULL)
+         LLVMDisposeModule(parts[i].module);
+      if (parts[i].bitcode != NULL)
+         LLVMDisposeMemoryBuffer(parts[i].bitcode);
+      free(parts[i].obj_path);
+   }
+   free(parts);
+   parts = NULL;
+   n_parts = 0;
+   module = NULL;
 
-   if (LLVMVerifyModule(module, LLVMPrintMessageAction, NULL))
-      fatal("LLVM verification failed");
+   if (decl_index != NULL)
+      hash_free(decl_index);
+   decl_index = NULL;
 
-   cgen_optimise();
-   cgen_native(top, tm_ref);
+   if (profile != NULL)
+      hash_free(profile);
+   profile = NULL;
 
-   LLVMDisposeModule(module);
    LLVMDisposeBuilder(builder);
    LLVMDisposeTargetMachine(tm_ref);
 #if LLVM_HAS_CREATE_TARGET_DATA_LAYOUT
@@ -4165,3 +5284,13 @@ void cgen(tree_t top, vcode_unit_t vcode)
 #endif
    LLVMDisposeMessage(def_triple);
 }
+
+void cgen_streamed(tree_t top, vcode_unit_t context)
+{
+   assert(tree_kind(top) == T_ELAB);
+   assert(stream_top == NULL);
+
+   stream_top = top;
+   cgen(top, context);
+   stream_top = NULL;
+}
@@ -19,6 +19,7 @@
 #include "util.h"
 #include "common.h"
 #include "rt/cover.h"
+#include "hash.h"
 
 #include <ctype.h>
 #include <assert.h>
@@ -60,13 +61,6 @@ typedef struct map_list {
    tree_t name;
 } map_list_t;
 
-typedef struct copy_list copy_list_t;
-
-struct copy_list {
-   copy_list_t *next;
-   tree_t       tree;
-};
-
 typedef struct {
    lib_t    lib;
    ident_t  name;
@@ -82,6 +76,12 @@ struct generic_list {
    bool            used;
 };
 
+typedef struct {
+   char        kind;    // Unit, Architectures of entity, or Missing
+   ident_t     name;
+   lib_mtime_t mtime;
+} elab_dep_t;
+
 static void elab_arch(tree_t t, const elab_ctx_t *ctx);
 static void elab_block(tree_t t, const elab_ctx_t *ctx);
 static void elab_stmts(tree_t t, const elab_ctx_t *ctx);
@@ -89,10 +89,17 @@ static void elab_decls(tree_t t, const elab_ctx_t *ctx);
 static void elab_copy_context(tree_t src, const elab_ctx_t *ctx);
 static void elab_package_signals(tree_t unit, const elab_ctx_t *ctx);
 
-static int errors = 0;
+static int     errors = 0;
+static hash_t *arch_cache = NULL;
+static hash_t *entity_cache = NULL;
 
 static generic_list_t *generic_override = NULL;
 
+static elab_dep_t *deps = NULL;
+static unsigned    ndeps = 0;
+static unsigned    maxdeps = 0;
+static hash_t     *dep_units = NULL;
+
 static ident_t hpathf(ident_t path, char sep, const char *fmt, ...)
 {
    va_list ap;
@@ -124,6 +131,20 @@ static const char *simple_name(const char *full)
    return start;
 }
 
+static void elab_add_dep(char kind, ident_t name, lib_mtime_t mtime)
+{
+   ARRAY_APPEND(deps, ((elab_dep_t){ kind, name, mtime }), ndeps, maxdeps);
+}
+
+static void elab_dep_unit(lib_t lib, tree_t unit)
+{
+   ident_t name = tree_ident(unit);
+   if (hash_get(dep_units, name) == NULL) {
+      hash_put(dep_units, name, unit);
+      elab_add_dep('U', name, lib_mtime(lib, name));
+   }
+}
+
 static lib_t elab_find_lib(ident_t name, const elab_ctx_t *ctx)
 {
    ident_t lib_name = ident_until(name, '.');
@@ -140,15 +161,20 @@ static void find_arch(ident_t name, int kind, void *context)
    ident_t prefix = ident_until(name, '-');
 
    if ((kind == T_ARCH) && (prefix == params->name)) {
-      tree_t t = lib_get_check_stale(params->lib, name);
-      assert(t != NULL);
-
       if (*(params->tree) == NULL)
-         *(params->tree) = t;
+         *(params->tree) = lib_get_check_stale(params->lib, name);
       else {
+         // The analysis time comes from the library index so only
+         // architectures which might be selected are read
          lib_mtime_t old_mtime = lib_mtime(params->lib,
                                            tree_ident(*(params->tree)));
-         lib_mtime_t new_mtime = lib_mtime(params->lib, tree_ident(t));
+         lib_mtime_t new_mtime = lib_mtime(params->lib, name);
+
+         if (new_mtime < old_mtime)
+            return;
+
+         tree_t t = lib_get_check_stale(params->lib, name);
+         assert(t != NULL);
 
          if (new_mtime == old_mtime) {
             // Analysed at the same time: compare line number
@@ -177,14 +203,27 @@ static tree_t pick_arch(const loc_t *loc, ident_t name, lib_t *new_lib,
    ident_t search_name =
       ident_prefix(lib_name(lib), ident_rfrom(name, '.'), '.');
 
-   tree_t arch = lib_get_check_stale(lib, search_name);
-   if ((arch == NULL) || (tree_kind(arch) != T_ARCH)) {
-      arch = NULL;
-      lib_search_params_t params = { lib, search_name, &arch };
-      lib_walk_index(lib, find_arch, &params);
+   // Large designs instance the same entities many times and each
+   // search below walks the whole library index
+   tree_t arch = hash_get(arch_cache, search_name);
+   if (arch == NULL) {
+      arch = lib_get_check_stale(lib, search_name);
+      if ((arch == NULL) || (tree_kind(arch) != T_ARCH)) {
+         arch = NULL;
+         lib_search_params_t params = { lib, search_name, &arch };
+         lib_walk_index(lib, find_arch, &params);
+
+         if (arch == NULL)
+            fatal_at(loc, "no suitable architecture for %s",
+                     istr(search_name));
+
+         // A more recently analysed architecture would be picked instead
+         elab_add_dep('A', search_name, lib_mtime(lib, tree_ident(arch)));
+      }
 
-      if (arch == NULL)
-         fatal_at(loc, "no suitable architecture for %s", istr(search_name));
+      hash_put(arch_cache, search_name, arch);
+      elab_dep_unit(lib, arch);
+      elab_dep_unit(lib, tree_ref(arch));
    }
 
    if (new_lib != NULL)
@@ -310,6 +349,7 @@ static void elab_add_context(tree_t t, const elab_ctx_t *ctx)
 
    // Always use real library name rather than WORK alias
    tree_set_ident(t, tree_ident(unit));
+   elab_dep_unit(lib, unit);
 
    tree_add_context(ctx->out, t);
 
@@ -322,6 +362,7 @@ static void elab_add_context(tree_t t, const elab_ctx_t *ctx)
       ident_t body_i = ident_prefix(name, ident_new("body"), '-');
       tree_t body = lib_get(lib, body_i);
       if (body != NULL) {
+         elab_dep_unit(lib, body);
          elab_copy_context(body, ctx);
          elab_package_signals(unit, ctx);
 
@@ -833,50 +874,35 @@ static bool elab_should_copy(tree_t t)
    }
 }
 
-static void elab_build_copy_list(tree_t t, void *context)
+static void elab_build_copy_set(tree_t t, void *context)
 {
-   copy_list_t **list = context;
-
-   if (elab_should_copy(t)) {
-      copy_list_t *new = xmalloc(sizeof(copy_list_t));
-      new->tree = t;
-      new->next = *list;
+   hash_t *set = context;
 
-      *list = new;
-   }
+   if (elab_should_copy(t))
+      hash_put(set, t, t);
 }
 
 static bool elab_copy_trees(tree_t t, void *context)
 {
-   copy_list_t *list = context;
+   hash_t *set = context;
 
-   if (elab_should_copy(t)) {
-      for (; list != NULL; list = list->next) {
-         if (list->tree == t)
-            return true;
-      }
-   }
-
-   return false;
+   // Every instance of a large architecture tests each of its trees
+   // here so the copy set is hashed rather than searched linearly
+   return elab_should_copy(t) && hash_get(set, t) != NULL;
 }
 
 static tree_t elab_copy(tree_t t)
 {
-   copy_list_t *copy_list = NULL;
-   tree_visit(t, elab_build_copy_list, &copy_list);
+   hash_t *copy_set = hash_new(256, true);
+   tree_visit(t, elab_build_copy_set, copy_set);
 
    // For achitectures, also make a copy of the entity ports
    if (tree_kind(t) == T_ARCH)
-      tree_visit(tree_ref(t), elab_build_copy_list, &copy_list);
+      tree_visit(tree_ref(t), elab_build_copy_set, copy_set);
 
-   tree_t copy = tree_copy(t, elab_copy_trees, copy_list);
-
-   while (copy_list != NULL) {
-      copy_list_t *tmp = copy_list->next;
-      free(copy_list);
-      copy_list = tmp;
-   }
+   tree_t copy = tree_copy(t, elab_copy_trees, copy_set);
 
+   hash_free(copy_set);
    return copy;
 }
 
@@ -964,12 +990,22 @@ static tree_t elab_default_binding(tree_t inst, lib_t *new_lib,
       full_i = ident_prefix(lib_i, ident_rfrom(full_i, '.'), '.');
    }
 
-   tree_t entity = NULL;
-   lib_search_params_t params = { lib, full_i, &entity };
-   lib_walk_index(params.lib, find_entity, &params);
+   // Only entities found in the component's own library are cached as
+   // the search below depends on the library clauses seen so far
+   tree_t entity = hash_get(entity_cache, full_i);
+   if (entity == NULL) {
+      lib_search_params_t params = { lib, full_i, &entity };
+      lib_walk_index(params.lib, find_entity, &params);
+
+      if (entity != NULL)
+         hash_put(entity_cache, full_i, entity);
+   }
 
    if (entity == NULL) {
       if (search_others) {
+         // Analysing this entity later would change the binding
+         elab_add_dep('M', full_i, 0);
+
          const int ncontext = tree_contexts(ctx->out);
          for (int i = 0; entity == NULL && i < ncontext; i++) {
             tree_t c = tree_context(ctx->out, i);
@@ -1109,8 +1145,7 @@ static void elab_instance(tree_t t, const elab_ctx_t *ctx)
    elab_free_maps(maps);
 
    set_hint_fn(elab_hint_fn, t);
-   simplify(arch, EVAL_LOWER);
-   bounds_check(arch);
+   simplify_check(arch, EVAL_LOWER);
    clear_hint();
 
    if (eval_errors() > 0 || bounds_errors() > 0)
@@ -1288,8 +1323,7 @@ static void elab_for_generate(tree_t t, elab_ctx_t *ctx)
          .count = 1
       };
       tree_rewrite(copy, rewrite_refs, &params);
-      simplify(copy, EVAL_LOWER);
-      bounds_check(copy);
+      simplify_check(copy, EVAL_LOWER);
 
       if (eval_errors() > 0)
          break;
@@ -1547,8 +1581,7 @@ static void elab_entity_arch(tree_t t, tree_t arch, const elab_ctx_t *ctx)
 
    tree_add_attr_str(ctx->out, simple_name_i, npath);
 
-   simplify(arch, EVAL_LOWER);
-   bounds_check(arch);
+   simplify_check(arch, EVAL_LOWER);
 
    if (bounds_errors() > 0 || eval_errors() > 0)
       return;
@@ -1643,6 +1676,20 @@ tree_t elab(tree_t top)
 
    errors = 0;
 
+   arch_cache   = hash_new(256, true);
+   entity_cache = hash_new(256, true);
+   dep_units    = hash_new(256, true);
+
+   maxdeps = 64;
+   ndeps   = 0;
+   deps    = xrealloc(deps, maxdeps * sizeof(elab_dep_t));
+
+   // The outputs of a previous run are about to be overwritten
+   char *deps_name LOCAL = xasprintf("_%s.deps", istr(tree_ident(e)));
+   lib_delete(lib_work(), deps_name);
+
+   elab_dep_unit(lib_work(), top);
+
    netid_t next_net = 0;
    elab_ctx_t ctx = {
       .out      = e,
@@ -1666,13 +1713,18 @@ tree_t elab(tree_t top)
       fatal("%s is not a suitable top-level unit", istr(tree_ident(top)));
    }
 
+   hash_free(arch_cache);
+   hash_free(entity_cache);
+   hash_free(dep_units);
+   arch_cache = entity_cache = dep_units = NULL;
+
    if (errors > 0 || eval_errors() > 0)
       return NULL;
 
    tree_add_attr_int(e, nnets_i, next_net);
 
-   if (opt_get_int("cover"))
-      cover_tag(e);
+   if (opt_get_int("cover") != COVER_OFF)
+      cover_tag(e, opt_get_int("cover"));
 
    for (generic_list_t *it = generic_override; it != NULL; it = it->next) {
       if (!it->used)
@@ -1686,3 +1738,130 @@ tree_t elab(tree_t top)
    else
       return NULL;
 }
+
+static uint64_t elab_fingerprint(void)
+{
+   // Hash of everything apart from the design units which affects the
+   // elaborated design or the generated code
+
+   LOCAL_TEXT_BUF tb = tb_new();
+   tb_printf(tb, "%s", PACKAGE_VERSION);
+
+   for (generic_list_t *it = generic_override; it != NULL; it = it->next)
+      tb_printf(tb, " %s=%s", istr(it->name), it->value);
+
+   tb_printf(tb, " O%d cover=%d", opt_get_int("optimise"),
+             opt_get_int("cover"));
+
+   uint64_t hash = UINT64_C(14695981039346656037);
+   for (const char *p = tb_get(tb); *p != '\0'; p++)
+      hash = (hash ^ (uint8_t)*p) * UINT64_C(1099511628211);
+
+   return hash;
+}
+
+static void find_newer_arch(ident_t name, int kind, void *context)
+{
+   elab_dep_t *dep = context;
+
+   if (kind == T_ARCH && ident_until(name, '-') == dep->name) {
+      lib_t lib = lib_find(ident_until(name, '.'), true);
+      if (lib_mtime(lib, name) > dep->mtime)
+         dep->kind = '!';
+   }
+}
+
+static bool elab_dep_valid(elab_dep_t *dep)
+{
+   lib_t lib = lib_find(ident_until(dep->name, '.'), false);
+   if (lib == NULL)
+      return false;
+
+   const int kind = lib_index_kind(lib, dep->name);
+
+   switch (dep->kind) {
+   case 'U':
+      return kind != T_LAST_TREE_KIND
+         && lib_mtime(lib, dep->name) == dep->mtime;
+   case 'A':
+      lib_walk_index(lib, find_newer_arch, dep);
+      return dep->kind == 'A';
+   case 'M':
+      return kind == T_LAST_TREE_KIND;
+   default:
+      return false;
+   }
+}
+
+static bool elab_reusable(void)
+{
+   // Code generated in memory and profile guided builds are never
+   // reused, nor are pruned designs as the signals kept depend on the
+   // contents of the include file
+   return !opt_get_int("jit") && opt_get_str("profile-use") == NULL
+      && !opt_get_int("elab-prune");
+}
+
+bool elab_up_to_date(tree_t top)
+{
+   if (!elab_reusable())
+      return false;
+
+   lib_t work = lib_work();
+   ident_t name = ident_prefix(tree_ident(top), ident_new("elab"), '.');
+
+   if (lib_index_kind(work, name) != T_ELAB)
+      return false;
+
+   char *netdb LOCAL = xasprintf("_%s.netdb", istr(name));
+   char *dll LOCAL = xasprintf("_%s." DLL_EXT, istr(name));
+   if (!lib_stat(work, netdb, NULL) || !lib_stat(work, dll, NULL))
+      return false;
+
+   char *deps_name LOCAL = xasprintf("_%s.deps", istr(name));
+   FILE *f = lib_fopen(work, deps_name, "r");
+   if (f == NULL)
+      return false;
+
+   bool valid = false;
+   uint64_t fingerprint;
+   if (fscanf(f, "fingerprint %"SCNx64"\n", &fingerprint) == 1)
+      valid = (fingerprint == elab_fingerprint());
+
+   char line[1024];
+   while (valid && fgets(line, sizeof(line), f) != NULL) {
+      elab_dep_t dep;
+      char unit[sizeof(line)];
+      if (sscanf(line, "%c %s %"SCNu64, &dep.kind, unit, &dep.mtime) != 3)
+         valid = false;
+      else {
+         dep.name = ident_new(unit);
+         valid = elab_dep_valid(&dep);
+      }
+   }
+
+   fclose(f);
+   return valid;
+}
+
+void elab_save_deps(tree_t e)
+{
+   // Called once the generated code has been written so a partial build
+   // is never mistaken for an up to date one
+
+   if (!elab_reusable())
+      return;
+
+   char *deps_name LOCAL = xasprintf("_%s.deps", istr(tree_ident(e)));
+   FILE *f = lib_fopen(lib_work(), deps_name, "w");
+   if (f == NULL)
+      fatal_errno("failed to create %s", deps_name);
+
+   fprintf(f, "fingerprint %016"PRIx64"\n", elab_fingerprint());
+
+   for (unsigned i = 0; i < ndeps; i++)
+      fprintf(f, "%c %s %"PRIu64"\n", deps[i].kind, istr(deps[i].name),
+              deps[i].mtime);
+
+   fclose(f);
+}
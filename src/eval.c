@@ -19,6 +19,7 @@
 #include "util.h"
 #include "common.h"
 #include "vcode.h"
+#include "hash.h"
 
 #include <assert.h>
 #include <string.h>
@@ -30,7 +31,9 @@
 
 #define MAX_DIMS   4
 #define EVAL_HEAP  (16 * 1024)
-#define ITER_LIMIT 1000
+#define ITER_LIMIT 100000
+#define POOL_LIMIT 64
+#define MEMO_LIMIT 65536
 
 typedef enum {
    VALUE_INVALID,
@@ -76,6 +79,17 @@ struct context {
    value_t   *regs;
    value_t   *vars;
    int        refcount;
+   size_t     size;
+};
+
+typedef struct eval_memo eval_memo_t;
+
+struct eval_memo {
+   eval_memo_t  *next;
+   vcode_unit_t  vcode;
+   value_t       result;
+   int           nargs;
+   value_t       args[0];
 };
 
 typedef struct {
@@ -106,13 +120,27 @@ typedef struct {
          eval_assert_fail(op, value, #value, NULL, __FILE__, __LINE__); \
    } while (0)
 
-static int errors = 0;
+static int       errors = 0;
+static hash_t   *memo_table = NULL;
+static unsigned  memo_count = 0;
+static hash_t   *vcode_loaded = NULL;
+static context_t *context_pool = NULL;
+static unsigned   pool_count = 0;
 
 static void eval_vcode(eval_state_t *state);
 static bool eval_possible(tree_t t, eval_flags_t flags, bool top_level);
 
 static void eval_load_vcode(lib_t lib, tree_t unit, eval_flags_t flags)
 {
+   // Units read from the library stay registered so each file only
+   // needs to be read once however many calls are folded
+   if (vcode_loaded == NULL)
+      vcode_loaded = hash_new(64, true);
+   else if (hash_get(vcode_loaded, unit) != NULL)
+      return;
+
+   hash_put(vcode_loaded, unit, unit);
+
    ident_t unit_name = tree_ident(unit);
 
    if (flags & EVAL_VERBOSE)
@@ -126,7 +154,7 @@ static void eval_load_vcode(lib_t lib, tree_t unit, eval_flags_t flags)
       return;
    }
 
-   vcode_read(f);
+   vcode_read(f, lib_ident_table(lib));
    fbuf_close(f);
 }
 
@@ -415,12 +443,46 @@ static bool eval_new_var(value_t *value, vcode_type_t type, eval_state_t *state)
    return true;
 }
 
+static void *eval_alloc_context(size_t size)
+{
+   // Every function call needs a new register file and most are freed
+   // again before the next call so recycle them instead of using malloc
+   for (context_t **it = &context_pool; *it != NULL; it = &((*it)->parent)) {
+      context_t *context = *it;
+      if (context->size >= size) {
+         *it = context->parent;
+         pool_count--;
+
+         const size_t capacity = context->size;
+         memset(context, '\0', size);
+         context->size = capacity;
+         return context;
+      }
+   }
+
+   context_t *context = xcalloc(size);
+   context->size = size;
+   return context;
+}
+
+static void eval_release_context(context_t *context)
+{
+   if (pool_count == POOL_LIMIT)
+      free(context);
+   else {
+      context->parent = context_pool;
+      context_pool = context;
+      pool_count++;
+   }
+}
+
 static context_t *eval_new_context(eval_state_t *state)
 {
    const int nregs = vcode_count_regs();
    const int nvars = vcode_count_vars();
 
-   void *mem = xcalloc(sizeof(context_t) + sizeof(value_t) * (nregs + nvars));
+   void *mem = eval_alloc_context(sizeof(context_t)
+                                  + sizeof(value_t) * (nregs + nvars));
 
    context_t *context = mem;
    context->regs = (value_t *)((uint8_t *)mem + sizeof(context_t));
@@ -449,7 +511,7 @@ static context_t *eval_new_context(eval_state_t *state)
    return context;
 
  fail:
-   free(context);
+   eval_release_context(context);
    return NULL;
 }
 
@@ -469,7 +531,7 @@ static void eval_free_context(context_t *context)
 
       context->regs = NULL;
       context->vars = NULL;
-      free(context);
+      eval_release_context(context);
    }
 }
 
@@ -893,6 +955,73 @@ static void eval_op_abs(int op, eval_state_t *state)
    }
 }
 
+static bool eval_memo_scalar(value_t *value)
+{
+   return value->kind == VALUE_INTEGER || value->kind == VALUE_REAL;
+}
+
+static bool eval_memo_same(value_t *a, value_t *b)
+{
+   if (a->kind != b->kind)
+      return false;
+   else if (a->kind == VALUE_INTEGER)
+      return a->integer == b->integer;
+   else
+      return memcmp(&(a->real), &(b->real), sizeof(double)) == 0;
+}
+
+static bool eval_memo_possible(value_t **params, int nparams)
+{
+   for (int i = 0; i < nparams; i++) {
+      if (!eval_memo_scalar(params[i]))
+         return false;
+   }
+
+   return true;
+}
+
+static eval_memo_t *eval_memo_find(ident_t name, vcode_unit_t vcode,
+                                   value_t **params, int nparams)
+{
+   if (memo_table == NULL)
+      return NULL;
+
+   for (eval_memo_t *it = hash_get(memo_table, name); it; it = it->next) {
+      if (it->vcode != vcode || it->nargs != nparams)
+         continue;   // Different overload or reanalysed since
+
+      int i = 0;
+      while (i < nparams && eval_memo_same(&(it->args[i]), params[i]))
+         i++;
+
+      if (i == nparams)
+         return it;
+   }
+
+   return NULL;
+}
+
+static void eval_memo_add(ident_t name, vcode_unit_t vcode,
+                          value_t **params, int nparams, value_t *result)
+{
+   if (memo_count == MEMO_LIMIT)
+      return;
+   else if (memo_table == NULL)
+      memo_table = hash_new(256, true);
+
+   eval_memo_t *m = xmalloc(sizeof(eval_memo_t) + nparams * sizeof(value_t));
+   m->next   = hash_get(memo_table, name);
+   m->vcode  = vcode;
+   m->result = *result;
+   m->nargs  = nparams;
+
+   for (int i = 0; i < nparams; i++)
+      m->args[i] = *params[i];
+
+   hash_put(memo_table, name, m);
+   memo_count++;
+}
+
 static void eval_op_fcall(int op, eval_state_t *state)
 {
    vcode_state_t vcode_state;
@@ -915,6 +1044,21 @@ static void eval_op_fcall(int op, eval_state_t *state)
 
    const bool nested = vcode_get_op(op) == VCODE_OP_NESTED_FCALL;
 
+   // Calls to pure functions with only scalar arguments and results
+   // give the same answer every time so are evaluated only once
+   const vcode_reg_t result = vcode_get_result(op);
+   const bool memoise = !nested && result != VCODE_INVALID_REG
+      && eval_memo_possible(params, nparams);
+
+   if (memoise) {
+      eval_memo_t *m = eval_memo_find(func_name, vcode, params, nparams);
+      if (m != NULL) {
+         *eval_get_reg(result, state) = m->result;
+         vcode_state_restore(&vcode_state);
+         return;
+      }
+   }
+
    vcode_select_unit(vcode);
    vcode_select_block(0);
 
@@ -952,6 +1096,9 @@ static void eval_op_fcall(int op, eval_state_t *state)
       EVAL_ASSERT_VALID(op, &(context->regs[new.result]));
       *dst = context->regs[new.result];
 
+      if (memoise && eval_memo_scalar(dst))
+         eval_memo_add(func_name, vcode, params, nparams, dst);
+
       if (state->flags & EVAL_VERBOSE) {
          const char *name = istr(vcode_get_func(op));
          const char *nest = istr(tree_ident(state->fcall));
@@ -1054,13 +1201,23 @@ static void eval_op_const_array(int op, eval_state_t *state)
 {
    value_t *dst = eval_get_reg(vcode_get_result(op), state);
 
-   const int nargs = vcode_count_args(op);
+   int ndata;
+   const int64_t *data = vcode_get_data(op, &ndata);
+   const int nargs = data ? ndata : vcode_count_args(op);
 
    dst->kind = VALUE_POINTER;
    dst->length = nargs;
    if ((dst->pointer = eval_alloc(sizeof(value_t) * nargs, state))) {
-      for (int i = 0; i < nargs; i++)
-         dst->pointer[i] = *eval_get_reg(vcode_get_arg(op, i), state);
+      if (data != NULL) {
+         for (int i = 0; i < nargs; i++) {
+            dst->pointer[i].kind    = VALUE_INTEGER;
+            dst->pointer[i].integer = data[i];
+         }
+      }
+      else {
+         for (int i = 0; i < nargs; i++)
+            dst->pointer[i] = *eval_get_reg(vcode_get_arg(op, i), state);
+      }
    }
 }
 
@@ -1212,7 +1369,6 @@ static void eval_op_or(int op, eval_state_t *state)
 static void eval_op_jump(int op, eval_state_t *state)
 {
    vcode_select_block(vcode_get_target(op, 0));
-   eval_vcode(state);
 }
 
 static void eval_op_cond(int op, eval_state_t *state)
@@ -1221,7 +1377,6 @@ static void eval_op_cond(int op, eval_state_t *state)
 
    const vcode_block_t next = vcode_get_target(op, !(test->integer));
    vcode_select_block(next);
-   eval_vcode(state);
 }
 
 static void eval_op_undefined(int op, eval_state_t *state)
@@ -1297,7 +1452,6 @@ static void eval_op_case(int op, eval_state_t *state)
    }
 
    vcode_select_block(target);
-   eval_vcode(state);
 }
 
 static void eval_op_copy(int op, eval_state_t *state)
@@ -1829,14 +1983,10 @@ static void eval_op_range_null(int op, eval_state_t *state)
       result->integer = right->integer > left->integer;
 }
 
-static void eval_vcode(eval_state_t *state)
+static bool eval_block(eval_state_t *state)
 {
-   if (++(state->iterations) >= ITER_LIMIT) {
-      EVAL_WARN(state->fcall, "iteration limit reached while evaluating %s",
-                istr(tree_ident(state->fcall)));
-      state->failed = true;
-      return;
-   }
+   // Returns true if the block ends with a branch to another block
+   // which has been selected as the current block
 
    const int nops = vcode_count_ops();
    for (int i = 0; i < nops && !(state->failed); i++) {
@@ -1854,7 +2004,7 @@ static void eval_vcode(eval_state_t *state)
 
       case VCODE_OP_RETURN:
          eval_op_return(i, state);
-         return;
+         return false;
 
       case VCODE_OP_NOT:
          eval_op_not(i, state);
@@ -1934,11 +2084,11 @@ static void eval_vcode(eval_state_t *state)
 
       case VCODE_OP_COND:
          eval_op_cond(i, state);
-         return;
+         return true;
 
       case VCODE_OP_JUMP:
          eval_op_jump(i, state);
-         return;
+         return true;
 
       case VCODE_OP_LOAD:
          eval_op_load(i, state);
@@ -1950,7 +2100,7 @@ static void eval_vcode(eval_state_t *state)
 
       case VCODE_OP_CASE:
          eval_op_case(i, state);
-         return;
+         return true;
 
       case VCODE_OP_MOD:
          eval_op_mod(i, state);
@@ -2101,6 +2251,22 @@ static void eval_vcode(eval_state_t *state)
          fatal("cannot evaluate vcode op %s", vcode_op_string(vcode_get_op(i)));
       }
    }
+
+   return false;
+}
+
+static void eval_vcode(eval_state_t *state)
+{
+   // Branches are followed in this loop rather than by recursion so
+   // long running loops do not exhaust the stack
+   do {
+      if (++(state->iterations) >= ITER_LIMIT) {
+         EVAL_WARN(state->fcall, "iteration limit reached while "
+                   "evaluating %s", istr(tree_ident(state->fcall)));
+         state->failed = true;
+         return;
+      }
+   } while (eval_block(state) && !(state->failed));
 }
 
 static tree_t eval_value_to_tree(value_t *value, type_t type, const loc_t *loc)
@@ -15,9 +15,11 @@
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+
 #include "util.h"
 #include "fbuf.h"
 #include "fastlz.h"
+#include "lz4.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -27,26 +29,254 @@
 #include <fcntl.h>
 #include <unistd.h>
 
-#define SPILL_SIZE 65536
-#define BLOCK_SIZE (SPILL_SIZE - (SPILL_SIZE / 16))
+#if defined HAVE_PTHREAD && !defined __MINGW32__
+#define FBUF_THREADS 1
+#include <pthread.h>
+#else
+#define FBUF_THREADS 0
+#endif
+
+#define SPILL_SIZE   65536
+#define BLOCK_SIZE   (SPILL_SIZE - (SPILL_SIZE / 16))
+#define HEADER_SIZE  4
+#define MAX_INFLIGHT 4
+#define MAX_THREADS  3
+
+typedef enum {
+   JOB_IDLE, JOB_QUEUED, JOB_RUNNING, JOB_DONE
+} job_state_t;
+
+typedef struct fbuf_job fbuf_job_t;
+
+// A block to be compressed or decompressed by the worker threads
+struct fbuf_job {
+   fbuf_codec_t   codec;
+   bool           compress;
+   const uint8_t *in;
+   size_t         inlen;
+   uint8_t       *out;
+   size_t         outmax;
+   int            result;
+   job_state_t    state;
+   fbuf_job_t    *next;
+};
 
 struct fbuf {
-   fbuf_mode_t  mode;
-   char        *fname;
-   FILE        *file;
-   uint8_t     *wbuf;
-   size_t       wpend;
-   uint8_t     *rbuf;
-   size_t       rptr;
-   size_t       ravail;
-   size_t       roff;
-   uint8_t     *rmap;
-   size_t       maplen;
-   fbuf_t      *next;
-   fbuf_t      *prev;
+   fbuf_mode_t   mode;
+   fbuf_codec_t  codec;
+   char         *fname;
+   FILE         *file;
+   uint8_t      *wbuf;
+   size_t        wpend;
+   size_t        wblk;
+   uint64_t      footer;
+   fbuf_job_t    wjobs[MAX_INFLIGHT];
+   unsigned      whead;
+   unsigned      wcount;
+   const uint8_t *rbuf;
+   uint8_t      *rown;
+   size_t        rptr;
+   size_t        ravail;
+   size_t        roff;
+   size_t        rbase;
+   size_t        rblk;
+   size_t        rnext;
+   size_t        rprevlen;
+   size_t       *rblocks;
+   size_t        n_rblocks;
+   size_t        rblocks_alloc;
+   fbuf_job_t    ahead;
+   size_t        ahead_off;
+   uint8_t      *rmap;
+   size_t        maplen;
+   fbuf_t       *next;
+   fbuf_t       *prev;
 };
 
-static fbuf_t *open_list = NULL;
+static const uint8_t fbuf_magic[HEADER_SIZE - 1] = { 'N', 'V', 'Z' };
+
+static fbuf_t       *open_list = NULL;
+static fbuf_codec_t  default_codec = FBUF_CODEC_LZ4;
+
+#if FBUF_THREADS
+static pthread_mutex_t  pool_lock;
+static pthread_cond_t   pool_cond;
+static pthread_cond_t   pool_done_cond;
+static fbuf_job_t      *pool_head = NULL;
+static fbuf_job_t      *pool_tail = NULL;
+static pid_t            pool_pid = 0;
+#endif
+
+void fbuf_set_codec(fbuf_codec_t codec)
+{
+   default_codec = codec;
+}
+
+static int fbuf_compress(fbuf_codec_t codec, const uint8_t *in, size_t len,
+                         uint8_t *out, size_t outmax)
+{
+   switch (codec) {
+   case FBUF_CODEC_NONE:
+      if (len > outmax)
+         return 0;
+      memcpy(out, in, len);
+      return len;
+
+   case FBUF_CODEC_FASTLZ:
+      return fastlz_compress_level(2, in, len, out);
+
+   case FBUF_CODEC_LZ4:
+      return LZ4_compress_default((const char *)in, (char *)out, len, outmax);
+   }
+
+   return 0;
+}
+
+static int fbuf_decompress(fbuf_codec_t codec, const uint8_t *in, size_t len,
+                           uint8_t *out, size_t outmax)
+{
+   switch (codec) {
+   case FBUF_CODEC_NONE:
+      if (len > outmax)
+         return 0;
+      memcpy(out, in, len);
+      return len;
+
+   case FBUF_CODEC_FASTLZ:
+      return fastlz_decompress(in, len, out, outmax);
+
+   case FBUF_CODEC_LZ4:
+      {
+         const int ret = LZ4_decompress_safe((const char *)in, (char *)out,
+                                             len, outmax);
+         return ret < 0 ? 0 : ret;
+      }
+   }
+
+   return 0;
+}
+
+static void fbuf_run_job(fbuf_job_t *job)
+{
+   if (job->compress)
+      job->result = fbuf_compress(job->codec, job->in, job->inlen,
+                                  job->out, job->outmax);
+   else
+      job->result = fbuf_decompress(job->codec, job->in, job->inlen,
+                                    job->out, job->outmax);
+}
+
+#if FBUF_THREADS
+static void *fbuf_worker_thread(void *arg)
+{
+   pthread_mutex_lock(&pool_lock);
+
+   for (;;) {
+      while (pool_head == NULL)
+         pthread_cond_wait(&pool_cond, &pool_lock);
+
+      fbuf_job_t *job = pool_head;
+      if ((pool_head = job->next) == NULL)
+         pool_tail = NULL;
+
+      job->state = JOB_RUNNING;
+      pthread_mutex_unlock(&pool_lock);
+
+      fbuf_run_job(job);
+
+      pthread_mutex_lock(&pool_lock);
+      job->state = JOB_DONE;
+      pthread_cond_broadcast(&pool_done_cond);
+   }
+
+   return NULL;
+}
+
+static void fbuf_pool_start(void)
+{
+   // Also restarts the pool in a child process created by fork as the
+   // worker threads are not copied
+   if (pool_pid == getpid())
+      return;
+
+   pool_pid  = getpid();
+   pool_head = pool_tail = NULL;
+
+   pthread_mutex_init(&pool_lock, NULL);
+   pthread_cond_init(&pool_cond, NULL);
+   pthread_cond_init(&pool_done_cond, NULL);
+
+   const long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+   const int nthreads = MIN(nprocs - 1, MAX_THREADS);
+
+   // With no workers jobs still complete when they are waited for
+   for (int i = 0; i < nthreads; i++) {
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, fbuf_worker_thread, NULL) != 0)
+         break;
+      pthread_detach(thread);
+   }
+}
+#endif  // FBUF_THREADS
+
+static void fbuf_submit(fbuf_job_t *job)
+{
+#if FBUF_THREADS
+   fbuf_pool_start();
+
+   pthread_mutex_lock(&pool_lock);
+
+   job->state = JOB_QUEUED;
+   job->next  = NULL;
+
+   if (pool_tail == NULL)
+      pool_head = pool_tail = job;
+   else
+      pool_tail = pool_tail->next = job;
+
+   pthread_cond_signal(&pool_cond);
+   pthread_mutex_unlock(&pool_lock);
+#else
+   job->state = JOB_QUEUED;
+#endif
+}
+
+static void fbuf_wait(fbuf_job_t *job)
+{
+   if (job->state == JOB_IDLE)
+      return;
+
+#if FBUF_THREADS
+   pthread_mutex_lock(&pool_lock);
+
+   if (job->state == JOB_QUEUED) {
+      // Not yet picked up by a worker so run it on this thread
+      fbuf_job_t **it;
+      for (it = &pool_head; *it != job; it = &((*it)->next))
+         assert(*it != NULL);
+
+      if ((*it = job->next) == NULL) {
+         pool_tail = NULL;
+         for (fbuf_job_t *j = pool_head; j != NULL; j = j->next)
+            pool_tail = j;
+      }
+
+      job->state = JOB_RUNNING;
+      pthread_mutex_unlock(&pool_lock);
+
+      fbuf_run_job(job);
+   }
+   else {
+      while (job->state != JOB_DONE)
+         pthread_cond_wait(&pool_done_cond, &pool_lock);
+      pthread_mutex_unlock(&pool_lock);
+   }
+#else
+   fbuf_run_job(job);
+#endif
+
+   job->state = JOB_IDLE;
+}
 
 void fbuf_cleanup(void)
 {
@@ -69,13 +299,19 @@ fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode)
          if (h == NULL)
             return NULL;
 
-         f = xmalloc(sizeof(struct fbuf));
+         f = xcalloc(sizeof(struct fbuf));
+
+         f->file   = h;
+         f->codec  = default_codec;
+         f->wbuf   = xmalloc(SPILL_SIZE);
+         f->footer = UINT64_MAX;
+
+         uint8_t header[HEADER_SIZE];
+         memcpy(header, fbuf_magic, sizeof(fbuf_magic));
+         header[HEADER_SIZE - 1] = f->codec;
 
-         f->file  = h;
-         f->rmap  = NULL;
-         f->rbuf  = NULL;
-         f->wbuf  = xmalloc(SPILL_SIZE);
-         f->wpend = 0;
+         if (fwrite(header, HEADER_SIZE, 1, f->file) != 1)
+            fatal("fwrite failed");
       }
       break;
 
@@ -93,16 +329,27 @@ fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode)
 
          close(fd);
 
-         f = xmalloc(sizeof(struct fbuf));
+         f = xcalloc(sizeof(struct fbuf));
 
-         f->file   = NULL;
-         f->rmap   = rmap;
-         f->rbuf   = xmalloc(SPILL_SIZE);
-         f->rptr   = 0;
-         f->roff   = 0;
-         f->ravail = 0;
-         f->maplen = buf.st_size;
-         f->wbuf   = NULL;
+         f->rmap      = rmap;
+         f->maplen    = buf.st_size;
+         f->rown      = xmalloc(SPILL_SIZE);
+         f->rbuf      = f->rown;
+         f->roff      = HEADER_SIZE;
+         f->ahead_off = SIZE_MAX;
+
+         if (f->maplen < HEADER_SIZE
+             || memcmp(f->rmap, fbuf_magic, sizeof(fbuf_magic)) != 0
+             || f->rmap[HEADER_SIZE - 1] > FBUF_CODEC_LZ4)
+            fatal("file %s was not written by this version of "
+                  PACKAGE_NAME " and should be regenerated", file);
+
+         f->codec = f->rmap[HEADER_SIZE - 1];
+
+         f->rblocks_alloc = 16;
+         f->rblocks       = xmalloc(f->rblocks_alloc * sizeof(size_t));
+         f->rblocks[0]    = HEADER_SIZE;
+         f->n_rblocks     = 1;
       }
       break;
    }
@@ -123,85 +370,300 @@ const char *fbuf_file_name(fbuf_t *f)
    return f->fname;
 }
 
+static void fbuf_write_block(fbuf_t *f, fbuf_job_t *job)
+{
+   fbuf_wait(job);
+
+   const int ret = job->result;
+   if (ret <= 0 || ret > SPILL_SIZE)
+      fatal("failed to compress block of %s", f->fname);
+
+   const uint8_t blksz[4] = {
+      (ret >> 24) & 0xff,
+      (ret >> 16) & 0xff,
+      (ret >> 8) & 0xff,
+      ret & 0xff
+   };
+
+   if (fwrite(blksz, 4, 1, f->file) != 1)
+      fatal("fwrite failed");
+
+   if (fwrite(job->out, ret, 1, f->file) != 1)
+      fatal("fwrite failed");
+}
+
 static void fbuf_maybe_flush(fbuf_t *f, size_t more, bool finish)
 {
    assert(more <= BLOCK_SIZE);
    if (f->wpend + more > BLOCK_SIZE) {
-      if (f->wpend < 16) {
+      if (f->wpend < 16 && f->codec == FBUF_CODEC_FASTLZ) {
          // Write dummy bytes at end to meet fastlz block size requirement
          assert(finish);
          f->wpend = 16;
       }
 
-      uint8_t out[SPILL_SIZE];
-      const int ret = fastlz_compress_level(2, f->wbuf, f->wpend, out);
+      if (f->wcount == MAX_INFLIGHT) {
+         // Blocks are written to the file in order
+         fbuf_write_block(f, &(f->wjobs[f->whead]));
+         f->whead = (f->whead + 1) % MAX_INFLIGHT;
+         f->wcount--;
+      }
 
-      assert((ret > 0) && (ret < SPILL_SIZE));
+      fbuf_job_t *job = &(f->wjobs[(f->whead + f->wcount++) % MAX_INFLIGHT]);
 
-      const uint8_t blksz[4] = {
-         (ret >> 24) & 0xff,
-         (ret >> 16) & 0xff,
-         (ret >> 8) & 0xff,
-         ret & 0xff
-      };
+      // Hand the full buffer to the job and keep filling its old one
+      uint8_t *spare = (uint8_t *)job->in;
 
-      if (fwrite(blksz, 4, 1, f->file) != 1)
-         fatal("fwrite failed");
+      job->codec    = f->codec;
+      job->compress = true;
+      job->in       = f->wbuf;
+      job->inlen    = f->wpend;
+      job->outmax   = SPILL_SIZE;
 
-      if (fwrite(out, ret, 1, f->file) != 1)
-         fatal("fwrite failed");
+      if (job->out == NULL)
+         job->out = xmalloc(SPILL_SIZE);
 
+      fbuf_submit(job);
+
+      f->wbuf  = spare ? spare : xmalloc(SPILL_SIZE);
       f->wpend = 0;
+      f->wblk++;
    }
 }
 
+static const uint8_t *fbuf_block_header(fbuf_t *f, size_t off, uint32_t *size)
+{
+   if (off + sizeof(uint32_t) > f->maplen)
+      fatal_trace("read past end of compressed file %s", f->fname);
+
+   const uint8_t *blksz_raw = f->rmap + off;
+
+   const uint32_t blksz =
+      (uint32_t)(blksz_raw[0] << 24)
+      | (uint32_t)(blksz_raw[1] << 16)
+      | (uint32_t)(blksz_raw[2] << 8)
+      | (uint32_t)blksz_raw[3];
+
+   if (blksz > SPILL_SIZE)
+      fatal("file %s has invalid compression format", f->fname);
+
+   if (off + sizeof(uint32_t) + blksz > f->maplen)
+      fatal_trace("read past end of compressed file %s", f->fname);
+
+   *size = blksz;
+   return blksz_raw + sizeof(uint32_t);
+}
+
+static void fbuf_read_ahead(fbuf_t *f)
+{
+   // Decompress the following block in the background while this one
+   // is consumed
+   if (f->roff + sizeof(uint32_t) > f->maplen)
+      return;
+
+   uint32_t blksz;
+   const uint8_t *data = fbuf_block_header(f, f->roff, &blksz);
+   if (blksz == 0)
+      return;   // End marker
+   else if (f->codec == FBUF_CODEC_NONE)
+      return;   // Read directly from the mapping
+
+   if (f->ahead.out == NULL)
+      f->ahead.out = xmalloc(SPILL_SIZE);
+
+   f->ahead.codec    = f->codec;
+   f->ahead.compress = false;
+   f->ahead.in       = data;
+   f->ahead.inlen    = blksz;
+   f->ahead.outmax   = SPILL_SIZE;
+
+   f->ahead_off = f->roff;
+   fbuf_submit(&(f->ahead));
+}
+
+static void fbuf_read_block(fbuf_t *f, size_t overlap)
+{
+   uint32_t blksz;
+   const uint8_t *data = fbuf_block_header(f, f->roff, &blksz);
+   if (blksz == 0)
+      fatal_trace("read past end of compressed file %s", f->fname);
+
+   int ret;
+   if (f->ahead_off == f->roff) {
+      fbuf_wait(&(f->ahead));
+      if ((ret = f->ahead.result) > SPILL_SIZE - overlap)
+         ret = 0;
+      else if (overlap == 0) {
+         uint8_t *tmp = f->rown;
+         f->rown = f->ahead.out;
+         f->ahead.out = tmp;
+      }
+      else if (ret > 0)
+         memcpy(f->rown + overlap, f->ahead.out, ret);
+      f->rbuf = f->rown;
+   }
+   else if (f->codec == FBUF_CODEC_NONE && overlap == 0) {
+      // Uncompressed blocks are used in place so the pages are shared
+      // with every other process reading the same library file
+      f->rbuf = data;
+      ret = blksz;
+   }
+   else {
+      fbuf_wait(&(f->ahead));
+      ret = fbuf_decompress(f->codec, data, blksz, f->rown + overlap,
+                            SPILL_SIZE - overlap);
+      f->rbuf = f->rown;
+   }
+
+   f->ahead_off = SIZE_MAX;
+
+   if (ret == 0)
+      fatal("file %s has invalid compression format", f->fname);
+
+   if (f->rnext + 1 == f->n_rblocks) {
+      ARRAY_APPEND(f->rblocks, f->roff + sizeof(uint32_t) + blksz,
+                   f->n_rblocks, f->rblocks_alloc);
+   }
+
+   f->rprevlen = f->ravail - f->rbase;
+   f->rblk     = f->rnext++;
+   f->rbase    = overlap;
+   f->roff    += sizeof(uint32_t) + blksz;
+   f->ravail   = overlap + ret;
+   f->rptr     = 0;
+
+   fbuf_read_ahead(f);
+}
+
 static void fbuf_maybe_read(fbuf_t *f, size_t more)
 {
    assert(more <= BLOCK_SIZE);
    if (f->rptr + more > f->ravail) {
       const size_t overlap = f->ravail - f->rptr;
-      memcpy(f->rbuf, f->rbuf + f->rptr, overlap);
-
-      const uint8_t *blksz_raw = f->rmap + f->roff;
-
-      const uint32_t blksz =
-         (uint32_t)(blksz_raw[0] << 24)
-         | (uint32_t)(blksz_raw[1] << 16)
-         | (uint32_t)(blksz_raw[2] << 8)
-         | (uint32_t)blksz_raw[3];
+      memmove(f->rown, f->rbuf + f->rptr, overlap);
+      fbuf_read_block(f, overlap);
+   }
+}
 
-      if (blksz > SPILL_SIZE)
-         fatal("file %s has invalid compression format", f->fname);
+uint64_t fbuf_tell(fbuf_t *f)
+{
+   // Positions are the index of a block in the upper bits and the
+   // offset within the uncompressed data in the low 16 bits which
+   // does not depend on the compressed size of earlier blocks
 
-      f->roff += sizeof(uint32_t);
+   switch (f->mode) {
+   case FBUF_OUT:
+      return ((uint64_t)f->wblk << 16) | f->wpend;
 
-      if (f->roff + blksz > f->maplen)
-         fatal_trace("read past end of compressed file %s", f->fname);
+   case FBUF_IN:
+      if (f->rptr >= f->rbase)
+         return ((uint64_t)f->rblk << 16) | (f->rptr - f->rbase);
+      else {
+         // Still reading bytes carried over from the previous block
+         assert(f->rblk > 0);
+         assert(f->rbase - f->rptr <= f->rprevlen);
+         return ((uint64_t)(f->rblk - 1) << 16)
+            | (f->rprevlen - (f->rbase - f->rptr));
+      }
+   }
 
-      const int ret = fastlz_decompress(f->rmap + f->roff,
-                                        blksz,
-                                        f->rbuf + overlap,
-                                        SPILL_SIZE - overlap);
+   return 0;
+}
 
-      if (ret == 0)
-         fatal("file %s has invalid compression format", f->fname);
+void fbuf_seek(fbuf_t *f, uint64_t pos)
+{
+   assert(f->mode == FBUF_IN);
+
+   const size_t blk = pos >> 16;
+   const size_t off = pos & 0xffff;
+
+   if (blk != f->rblk || f->rnext != f->rblk + 1) {
+      // Find the offset of the block by stepping over the headers
+      while (f->n_rblocks <= blk) {
+         uint32_t blksz;
+         const size_t last = f->rblocks[f->n_rblocks - 1];
+         (void)fbuf_block_header(f, last, &blksz);
+         if (blksz == 0)
+            fatal("file %s has invalid seek position", f->fname);
+
+         ARRAY_APPEND(f->rblocks, last + sizeof(uint32_t) + blksz,
+                      f->n_rblocks, f->rblocks_alloc);
+      }
 
-      f->roff  += blksz;
-      f->ravail = overlap + ret;
+      f->roff   = f->rblocks[blk];
+      f->rnext  = blk;
       f->rptr   = 0;
+      f->ravail = 0;
+      f->rbase  = 0;
+      fbuf_read_block(f, 0);
    }
+
+   if (f->rbase + off > f->ravail)
+      fatal("file %s has invalid seek position", f->fname);
+
+   f->rptr = f->rbase + off;
+}
+
+void fbuf_set_footer(fbuf_t *f, uint64_t value)
+{
+   assert(f->mode == FBUF_OUT);
+   f->footer = value;
+}
+
+uint64_t fbuf_footer(fbuf_t *f)
+{
+   assert(f->mode == FBUF_IN);
+
+   if (f->maplen < HEADER_SIZE + sizeof(uint64_t))
+      fatal("file %s is missing footer", f->fname);
+
+   const uint8_t *raw = f->rmap + f->maplen - sizeof(uint64_t);
+
+   uint64_t value = 0;
+   for (int i = 0; i < sizeof(uint64_t); i++)
+      value |= (uint64_t)raw[i] << (i * 8);
+   return value;
 }
 
 void fbuf_close(fbuf_t *f)
 {
    if (f->rmap != NULL) {
+      fbuf_wait(&(f->ahead));
       unmap_file((void *)f->rmap, f->maplen);
-      free(f->rbuf);
+      free(f->rown);
+      free(f->ahead.out);
+      free(f->rblocks);
    }
 
    if (f->wbuf != NULL) {
       fbuf_maybe_flush(f, BLOCK_SIZE, true);
+
+      for (; f->wcount > 0; f->wcount--) {
+         fbuf_write_block(f, &(f->wjobs[f->whead]));
+         f->whead = (f->whead + 1) % MAX_INFLIGHT;
+      }
+
+      for (int i = 0; i < MAX_INFLIGHT; i++) {
+         free((uint8_t *)f->wjobs[i].in);
+         free(f->wjobs[i].out);
+      }
+
       free(f->wbuf);
+
+      // Zero length block marks the end of the data
+      const uint8_t end[4] = { 0, 0, 0, 0 };
+      if (fwrite(end, sizeof(end), 1, f->file) != 1)
+         fatal("fwrite failed");
+
+      if (f->footer != UINT64_MAX) {
+         // Written uncompressed after the last block
+         uint8_t raw[sizeof(uint64_t)];
+         for (int i = 0; i < sizeof(uint64_t); i++)
+            raw[i] = (f->footer >> (i * 8)) & 0xff;
+
+         if (fwrite(raw, sizeof(raw), 1, f->file) != 1)
+            fatal("fwrite failed");
+      }
    }
 
    if (f->file != NULL)
@@ -222,7 +684,6 @@ void fbuf_close(fbuf_t *f)
    free(f->fname);
    free(f);
 }
-
 void write_u32(uint32_t u, fbuf_t *f)
 {
    fbuf_maybe_flush(f, 4, false);
@@ -31,10 +31,22 @@ typedef enum {
    FBUF_OUT,
 } fbuf_mode_t;
 
+// Stored in the file header so a reader handles any of these
+typedef enum {
+   FBUF_CODEC_NONE,
+   FBUF_CODEC_FASTLZ,
+   FBUF_CODEC_LZ4
+} fbuf_codec_t;
+
 fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode);
 void fbuf_close(fbuf_t *f);
 void fbuf_cleanup(void);
+void fbuf_set_codec(fbuf_codec_t codec);
 const char *fbuf_file_name(fbuf_t *f);
+uint64_t fbuf_tell(fbuf_t *f);
+void fbuf_seek(fbuf_t *f, uint64_t pos);
+void fbuf_set_footer(fbuf_t *f, uint64_t value);
+uint64_t fbuf_footer(fbuf_t *f);
 
 void write_u32(uint32_t u, fbuf_t *f);
 void write_u16(uint16_t s, fbuf_t *f);
@@ -24,16 +24,100 @@
 #include <assert.h>
 #include <stdlib.h>
 
+// Groups are kept in a treap ordered by first net so that finding the
+// group overlapping a range and splitting it take logarithmic time
+// and memory does not depend on the number of nets
+
 typedef struct {
    group_t   *groups;
    group_t   *free_list;
    groupid_t  next_gid;
-   group_t  **lookup;
+   group_t   *tree;
+   uint32_t   seed;
    int        nnets;
 } group_nets_ctx_t;
 
 static void group_target(tree_t t, group_nets_ctx_t *ctx);
 
+static group_t *group_tree_merge(group_t *a, group_t *b)
+{
+   // All groups in A start before those in B
+   if (a == NULL)
+      return b;
+   else if (b == NULL)
+      return a;
+   else if (a->priority > b->priority) {
+      a->right = group_tree_merge(a->right, b);
+      return a;
+   }
+   else {
+      b->left = group_tree_merge(a, b->left);
+      return b;
+   }
+}
+
+static void group_tree_split(group_t *t, netid_t key,
+                             group_t **less, group_t **rest)
+{
+   // Split into groups starting before KEY and the remainder
+   if (t == NULL)
+      *less = *rest = NULL;
+   else if (t->first < key) {
+      group_tree_split(t->right, key, &(t->right), rest);
+      *less = t;
+   }
+   else {
+      group_tree_split(t->left, key, less, &(t->left));
+      *rest = t;
+   }
+}
+
+static void group_tree_insert(group_nets_ctx_t *ctx, group_t *g)
+{
+   ctx->seed = ctx->seed * 1103515245 + 12345;
+
+   g->left     = NULL;
+   g->right    = NULL;
+   g->priority = ctx->seed;
+
+   group_t *less, *rest;
+   group_tree_split(ctx->tree, g->first, &less, &rest);
+   ctx->tree = group_tree_merge(group_tree_merge(less, g), rest);
+}
+
+static void group_tree_remove(group_nets_ctx_t *ctx, group_t *g)
+{
+   group_t *less, *rest, *match, *more;
+   group_tree_split(ctx->tree, g->first, &less, &rest);
+   group_tree_split(rest, g->first + 1, &match, &more);
+   assert(match == g);
+   ctx->tree = group_tree_merge(less, more);
+}
+
+static group_t *group_tree_find(group_nets_ctx_t *ctx, netid_t first,
+                                unsigned length)
+{
+   // Return the group with the lowest first net overlapping the range
+   group_t *below = NULL, *above = NULL;
+   for (group_t *it = ctx->tree; it != NULL;) {
+      if (it->first <= first) {
+         below = it;
+         it = it->right;
+      }
+      else {
+         above = it;
+         it = it->left;
+      }
+   }
+
+   if (below != NULL && below->first + below->length > first)
+      return below;
+   else if (above != NULL && above->first < first + length)
+      return above;
+   else
+      return NULL;
+}
+
 static groupid_t group_alloc(group_nets_ctx_t *ctx,
                              netid_t first, unsigned length)
 {
@@ -46,14 +130,16 @@ static groupid_t group_alloc(group_nets_ctx_t *ctx,
       g = xmalloc(sizeof(group_t));
 
    g->next   = ctx->groups;
+   g->prev   = NULL;
    g->gid    = ctx->next_gid++;
    g->first  = first;
    g->length = length;
 
+   if (ctx->groups != NULL)
+      ctx->groups->prev = g;
    ctx->groups = g;
 
-   for (netid_t i = first; i < first + length; i++)
-      ctx->lookup[i] = g;
+   group_tree_insert(ctx, g);
 
    return g->gid;
 }
@@ -62,17 +148,15 @@ static void group_unlink(group_nets_ctx_t *ctx, group_t *where)
 {
    where->gid = GROUPID_INVALID;
 
-   if (where == ctx->groups)
+   group_tree_remove(ctx, where);
+
+   if (where->prev != NULL)
+      where->prev->next = where->next;
+   else
       ctx->groups = where->next;
-   else {
-      for (group_t *it = ctx->groups; it != NULL; it = it->next) {
-         if (it->next == where) {
-            it->next = where->next;
-            return;
-         }
-      }
-      fatal_trace("unlink group not in list");
-   }
+
+   if (where->next != NULL)
+      where->next->prev = where->prev;
 }
 
 static void group_reuse(group_nets_ctx_t *ctx, group_t *group)
@@ -87,21 +171,12 @@ static groupid_t group_add(group_nets_ctx_t *ctx, netid_t first, int length)
    assert(first < ctx->nnets);
    assert(first + length <= ctx->nnets);
 
-   for (netid_t i = first; i < first + length; i++) {
-      group_t *it = ctx->lookup[i];
-      if (it == NULL || it->gid == GROUPID_INVALID)
-         continue;
-
+   group_t *it = group_tree_find(ctx, first, length);
+   if (it != NULL) {
       if ((it->first == first) && (it->length == length)) {
          // Exactly matches
          return it->gid;
       }
-      else if (it->first >= first + length) {
-         // Disjoint, to the right
-      }
-      else if (first >= it->first + it->length) {
-         // Disjoint, to the left
-      }
       else if ((first == it->first) && (length > it->length)) {
          // Overlaps on left
          group_add(ctx, first + it->length, length - it->length);
@@ -487,24 +562,87 @@ static void group_nets_visit_fn(tree_t t, void *_ctx)
    }
 }
 
+static int group_cmp_first(const void *a, const void *b)
+{
+   const group_t *ga = *(const group_t **)a;
+   const group_t *gb = *(const group_t **)b;
+
+   return (ga->first > gb->first) - (ga->first < gb->first);
+}
+
+static void group_write_array(FILE *f, const uint32_t *data, size_t count)
+{
+   if (count > 0 && fwrite(data, sizeof(uint32_t), count, f) != count)
+      fatal_errno("failed writing net database");
+}
+
 static void group_write_netdb(tree_t top, group_nets_ctx_t *ctx)
 {
-   char *name = xasprintf("_%s.netdb", istr(tree_ident(top)));
+   char *name LOCAL = xasprintf("_%s.netdb", istr(tree_ident(top)));
 
-   fbuf_t *f = lib_fbuf_open(lib_work(), name, FBUF_OUT);
-   if (f == NULL)
-      fatal("failed to create net database file %s", name);
+   // Written uncompressed in the layout described in netdb.h so the
+   // runtime can map the file rather than reading and expanding it
+
+   unsigned ngroups = 0;
+   for (group_t *it = ctx->groups; it != NULL; it = it->next)
+      ngroups++;
+
+   group_t **sorted = xmalloc(MAX(ngroups, 1) * sizeof(group_t *));
+   unsigned n = 0;
+   for (group_t *it = ctx->groups; it != NULL; it = it->next)
+      sorted[n++] = it;
 
-   free(name);
+   qsort(sorted, ngroups, sizeof(group_t *), group_cmp_first);
 
-   for (group_t *it = ctx->groups; it != NULL; it = it->next) {
-      write_u32(it->gid, f);
-      write_u32(it->first, f);
-      write_u32(it->length, f);
+   groupid_t max = 0;
+   netid_t nnets = 0;
+   for (unsigned i = 0; i < ngroups; i++) {
+      max   = MAX(max, sorted[i]->gid);
+      nnets = MAX(nnets, sorted[i]->first + sorted[i]->length);
    }
-   write_u32(GROUPID_INVALID, f);
 
-   fbuf_close(f);
+   const size_t npages = (nnets + NETDB_PAGE_SIZE - 1) >> NETDB_PAGE_BITS;
+
+   uint32_t *data = xmalloc((MAX(ngroups, npages) + 1) * sizeof(uint32_t));
+
+   FILE *f = lib_fopen(lib_work(), name, "wb");
+   if (f == NULL)
+      fatal_errno("failed to create net database file %s", name);
+
+   const uint32_t header[NETDB_HEADER_SZ] = {
+      NETDB_MAGIC, nnets, ngroups, max
+   };
+   group_write_array(f, header, NETDB_HEADER_SZ);
+
+   for (unsigned i = 0; i < ngroups; i++)
+      data[i] = sorted[i]->first;
+   group_write_array(f, data, ngroups);
+
+   for (unsigned i = 0; i < ngroups; i++)
+      data[i] = sorted[i]->length;
+   group_write_array(f, data, ngroups);
+
+   for (unsigned i = 0; i < ngroups; i++)
+      data[i] = sorted[i]->gid;
+   group_write_array(f, data, ngroups);
+
+   // Index of the last group starting at or before each page with a
+   // final entry so the lookup can bound its search by the next page
+   unsigned g = 0;
+   for (size_t p = 0; p < npages; p++) {
+      const netid_t start = p << NETDB_PAGE_BITS;
+      while (g + 1 < ngroups && sorted[g + 1]->first <= start)
+         g++;
+      data[p] = g;
+   }
+   data[npages] = (ngroups > 0) ? ngroups - 1 : 0;
+   group_write_array(f, data, npages + 1);
+
+   if (fclose(f) != 0)
+      fatal_errno("failed writing net database file %s", name);
+
+   free(data);
+   free(sorted);
 }
 
 static void group_free_list(group_t *list)
@@ -520,7 +658,8 @@ static void group_init_context(group_nets_ctx_t *ctx, int nnets)
 {
    ctx->groups    = NULL;
    ctx->next_gid  = 0;
-   ctx->lookup    = xcalloc(nnets * sizeof(group_t *));
+   ctx->tree      = NULL;
+   ctx->seed      = 1;
    ctx->nnets     = nnets;
    ctx->free_list = NULL;
 }
@@ -529,9 +668,13 @@ void group_nets(tree_t top)
 {
    const int nnets = tree_attr_int(top, nnets_i, 0);
 
+   static const tree_kind_t kinds[] = {
+      T_SIGNAL_ASSIGN, T_WAIT, T_PCALL, T_SIGNAL_DECL
+   };
+
    group_nets_ctx_t ctx;
    group_init_context(&ctx, nnets);
-   tree_visit(top, group_nets_visit_fn, &ctx);
+   tree_visit_kinds(top, group_nets_visit_fn, &ctx, kinds, ARRAY_LEN(kinds));
 
    group_write_netdb(top, &ctx);
 
@@ -546,5 +689,4 @@ void group_nets(tree_t top)
 
    group_free_list(ctx.groups);
    group_free_list(ctx.free_list);
-   free(ctx.lookup);
 }
@@ -21,15 +21,52 @@
 #include <string.h>
 #include <assert.h>
 
+#define MIN_SIZE   8
+#define ARENA_SIZE 4096
+
+// Robin Hood hashing with linear probing: an entry being inserted
+// takes the slot of any entry closer to its home slot, which keeps
+// probe sequences short even at high load and lets deletion shift
+// following entries back rather than leaving tombstones
+
+typedef enum {
+   KEY_PTR, KEY_INT, KEY_STR
+} key_kind_t;
+
+typedef struct {
+   uint64_t  key;
+   void     *value;
+   uint32_t  hash;
+   uint32_t  dist;   // Probe distance plus one or zero if empty
+} hash_slot_t;
+
 struct hash {
    unsigned     size;
    unsigned     members;
    bool         replace;
-   void       **values;
-   const void **keys;
+   key_kind_t   kind;
+   hash_slot_t *slots;
+};
+
+typedef struct arena arena_t;
+
+struct arena {
+   arena_t *next;
+   size_t   used;
+   size_t   alloc;
+   char     data[0];
 };
 
-static inline int hash_slot(hash_t *h, const void *key)
+struct shash {
+   struct hash  core;
+   arena_t     *arena;
+};
+
+struct ihash {
+   struct hash  core;
+};
+
+static uint32_t hash_ptr(const void *key)
 {
    assert(key != NULL);
 
@@ -48,100 +85,216 @@ static inline int hash_slot(hash_t *h, const void *key)
    a = a * UINT32_C(0x27d4eb2d);
    a = a ^ (a >> 15);
 
-   return a & (h->size - 1);
+   return a;
 }
 
-hash_t *hash_new(int size, bool replace)
+static uint32_t hash_int(uint64_t key)
 {
-   struct hash *h = xmalloc(sizeof(struct hash));
-   h->size    = next_power_of_2(size);
-   h->members = 0;
-   h->replace = replace;
+   // Finaliser from SplitMix64
+   key = (key ^ (key >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+   key = (key ^ (key >> 27)) * UINT64_C(0x94d049bb133111eb);
+   key = key ^ (key >> 31);
 
-   char *mem = xcalloc(h->size * 2 * sizeof(void *));
-   h->values = (void **)mem;
-   h->keys   = (const void **)(mem + (h->size * sizeof(void *)));
+   return (uint32_t)key;
+}
 
-   return h;
+static uint32_t hash_str(const char *key)
+{
+   // FNV-1a
+   uint32_t hash = UINT32_C(2166136261);
+   for (; *key != '\0'; key++) {
+      hash ^= (unsigned char)*key;
+      hash *= UINT32_C(16777619);
+   }
+
+   return hash;
 }
 
-void hash_free(hash_t *h)
+static inline bool hash_key_eq(hash_t *h, const hash_slot_t *slot,
+                               uint64_t key, uint32_t hash)
 {
-   free(h->values);
-   free(h);
+   if (slot->hash != hash)
+      return false;
+   else if (h->kind == KEY_STR)
+      return strcmp((const char *)(uintptr_t)slot->key,
+                    (const char *)(uintptr_t)key) == 0;
+   else
+      return slot->key == key;
 }
 
-bool hash_put(hash_t *h, const void *key, void *value)
+static void hash_init(hash_t *h, int size, bool replace, key_kind_t kind)
 {
-   if (unlikely(h->members >= h->size / 2)) {
-      // Rebuild the hash table with a larger size
-      // This is expensive so a conservative initial size should be chosen
+   h->size    = MAX(next_power_of_2(size), MIN_SIZE);
+   h->members = 0;
+   h->replace = replace;
+   h->kind    = kind;
+   h->slots   = xcalloc(h->size * sizeof(hash_slot_t));
+}
 
-      const int old_size = h->size;
-      h->size *= 2;
+static void hash_insert(hash_t *h, hash_slot_t entry)
+{
+   // Entries with equal keys must stay in insertion order for
+   // hash_get_nth so an entry already displaced from its slot is
+   // swapped in ahead of later duplicates at the same distance
+   bool displaced = false;
+   const unsigned mask = h->size - 1;
 
-      const void **old_keys = h->keys;
-      void **old_values = h->values;
+   entry.dist = 1;
+   for (unsigned slot = entry.hash & mask; ; slot = (slot + 1) & mask) {
+      hash_slot_t *s = &(h->slots[slot]);
+      if (s->dist == 0) {
+         *s = entry;
+         h->members++;
+         return;
+      }
+      else if (s->dist < entry.dist
+               || (displaced && s->dist == entry.dist
+                   && hash_key_eq(h, s, entry.key, entry.hash))) {
+         hash_slot_t tmp = *s;
+         *s = entry;
+         entry = tmp;
+         displaced = true;
+      }
 
-      char *mem = xcalloc(h->size * 2 * sizeof(void *));
-      h->values = (void **)mem;
-      h->keys   = (const void **)(mem + (h->size * sizeof(void *)));
+      entry.dist++;
+   }
+}
 
-      h->members = 0;
+static void hash_resize(hash_t *h, unsigned size)
+{
+   assert(size > h->members);
 
-      for (int i = 0; i < old_size; i++) {
-         if (old_keys[i] != NULL)
-            hash_put(h, old_keys[i], old_values[i]);
-      }
+   const unsigned old_size = h->size;
+   hash_slot_t *old_slots = h->slots;
 
-      free(old_values);
-   }
+   h->size    = size;
+   h->members = 0;
+   h->slots   = xcalloc(size * sizeof(hash_slot_t));
 
-   int slot = hash_slot(h, key);
+   // Start from an empty slot so runs of equal keys that wrap around
+   // the end of the table are reinserted in order
+   unsigned start = 0;
+   while (old_slots[start].dist != 0)
+      start++;
 
-   for (; ; slot = (slot + 1) & (h->size - 1)) {
-      if ((h->keys[slot] == key) && h->replace) {
-         h->values[slot] = value;
-         return true;
-      }
-      else if (h->keys[slot] == NULL) {
-         h->values[slot] = value;
-         h->keys[slot] = key;
-         h->members++;
-         break;
-      }
+   for (unsigned i = 0; i < old_size; i++) {
+      const hash_slot_t *s = &(old_slots[(start + i) & (old_size - 1)]);
+      if (s->dist != 0)
+         hash_insert(h, *s);
    }
 
-   return false;
+   free(old_slots);
 }
 
-void *hash_get_nth(hash_t *h, const void *key, int *n)
+static int hash_find(hash_t *h, uint64_t key, uint32_t hash, int *n)
 {
-   int slot = hash_slot(h, key);
+   const unsigned mask = h->size - 1;
 
-   for (; ; slot = (slot + 1) & (h->size - 1)) {
-      if (h->keys[slot] == key) {
+   uint32_t dist = 1;
+   for (unsigned slot = hash & mask; ; slot = (slot + 1) & mask, dist++) {
+      const hash_slot_t *s = &(h->slots[slot]);
+      if (s->dist < dist)
+         return -1;   // Empty or would have displaced this slot
+      else if (hash_key_eq(h, s, key, hash)) {
          if (*n == 0)
-            return h->values[slot];
+            return slot;
          else
             --(*n);
       }
-      else if (h->keys[slot] == NULL)
-         return NULL;
    }
 }
 
+static bool hash_put_core(hash_t *h, uint64_t key, uint32_t hash,
+                          void *value)
+{
+   if (h->replace) {
+      int n = 0;
+      const int slot = hash_find(h, key, hash, &n);
+      if (slot >= 0) {
+         h->slots[slot].value = value;
+         return true;
+      }
+   }
+
+   if (unlikely((h->members + 1) * 4 > h->size * 3))
+      hash_resize(h, h->size * 2);
+
+   const hash_slot_t entry = { .key = key, .value = value, .hash = hash };
+   hash_insert(h, entry);
+   return false;
+}
+
+static bool hash_delete_core(hash_t *h, uint64_t key, uint32_t hash)
+{
+   int n = 0;
+   int slot = hash_find(h, key, hash, &n);
+   if (slot < 0)
+      return false;
+
+   // Shift the following entries back towards their home slots
+   const unsigned mask = h->size - 1;
+   for (unsigned next = (slot + 1) & mask;
+        h->slots[next].dist > 1;
+        slot = next, next = (next + 1) & mask) {
+      h->slots[slot] = h->slots[next];
+      h->slots[slot].dist--;
+   }
+
+   h->slots[slot].dist = 0;
+   h->members--;
+   return true;
+}
+
+static void hash_reserve_core(hash_t *h, unsigned n)
+{
+   unsigned size = h->size;
+   while (n * 4 > size * 3)
+      size *= 2;
+
+   if (size != h->size)
+      hash_resize(h, size);
+}
+
+hash_t *hash_new(int size, bool replace)
+{
+   struct hash *h = xmalloc(sizeof(struct hash));
+   hash_init(h, size, replace, KEY_PTR);
+   return h;
+}
+
+void hash_free(hash_t *h)
+{
+   free(h->slots);
+   free(h);
+}
+
+bool hash_put(hash_t *h, const void *key, void *value)
+{
+   return hash_put_core(h, (uintptr_t)key, hash_ptr(key), value);
+}
+
+void *hash_get_nth(hash_t *h, const void *key, int *n)
+{
+   const int slot = hash_find(h, (uintptr_t)key, hash_ptr(key), n);
+   return slot < 0 ? NULL : h->slots[slot].value;
+}
+
 void *hash_get(hash_t *h, const void *key)
 {
    int n = 0;
    return hash_get_nth(h, key, &n);
 }
 
+bool hash_delete(hash_t *h, const void *key)
+{
+   return hash_delete_core(h, (uintptr_t)key, hash_ptr(key));
+}
+
 void hash_replace(hash_t *h, void *value, void *with)
 {
-   for (int i = 0; i < h->size; i++) {
-      if (h->values[i] == value)
-         h->values[i] = with;
+   for (unsigned i = 0; i < h->size; i++) {
+      if (h->slots[i].dist != 0 && h->slots[i].value == value)
+         h->slots[i].value = with;
    }
 }
 
@@ -151,9 +304,9 @@ bool hash_iter(hash_t *h, hash_iter_t *now, const void **key, void **value)
 
    while (*now < h->size) {
       const unsigned old = (*now)++;
-      if (h->keys[old] != NULL) {
-         *key   = h->keys[old];
-         *value = h->values[old];
+      if (h->slots[old].dist != 0) {
+         *key   = (const void *)(uintptr_t)h->slots[old].key;
+         *value = h->slots[old].value;
          return true;
       }
    }
@@ -166,3 +319,137 @@ unsigned hash_members(hash_t *h)
 {
    return h->members;
 }
+
+void hash_reserve(hash_t *h, unsigned n)
+{
+   hash_reserve_core(h, n);
+}
+
+void hash_shrink(hash_t *h)
+{
+   unsigned size = MIN_SIZE;
+   while ((h->members + 1) * 4 > size * 3)
+      size *= 2;
+
+   if (size < h->size)
+      hash_resize(h, size);
+}
+
+static const char *shash_copy_key(shash_t *h, const char *key)
+{
+   // Keys are copied into blocks owned by the table and freed
+   // all at once
+   const size_t len = strlen(key) + 1;
+
+   arena_t *a = h->arena;
+   if (a == NULL || a->used + len > a->alloc) {
+      const size_t alloc = MAX(len, ARENA_SIZE);
+      a = xmalloc(sizeof(arena_t) + alloc);
+      a->next  = h->arena;
+      a->used  = 0;
+      a->alloc = alloc;
+
+      h->arena = a;
+   }
+
+   char *copy = a->data + a->used;
+   memcpy(copy, key, len);
+   a->used += len;
+
+   return copy;
+}
+
+shash_t *shash_new(int size)
+{
+   struct shash *h = xmalloc(sizeof(struct shash));
+   hash_init(&(h->core), size, true, KEY_STR);
+   h->arena = NULL;
+   return h;
+}
+
+void shash_free(shash_t *h)
+{
+   for (arena_t *it = h->arena, *tmp; it != NULL; it = tmp) {
+      tmp = it->next;
+      free(it);
+   }
+
+   free(h->core.slots);
+   free(h);
+}
+
+void shash_put(shash_t *h, const char *key, void *value)
+{
+   const uint32_t hash = hash_str(key);
+
+   int n = 0;
+   const int slot = hash_find(&(h->core), (uintptr_t)key, hash, &n);
+   if (slot >= 0)
+      h->core.slots[slot].value = value;
+   else {
+      const char *copy = shash_copy_key(h, key);
+      hash_put_core(&(h->core), (uintptr_t)copy, hash, value);
+   }
+}
+
+void *shash_get(shash_t *h, const char *key)
+{
+   int n = 0;
+   const int slot = hash_find(&(h->core), (uintptr_t)key, hash_str(key), &n);
+   return slot < 0 ? NULL : h->core.slots[slot].value;
+}
+
+bool shash_delete(shash_t *h, const char *key)
+{
+   return hash_delete_core(&(h->core), (uintptr_t)key, hash_str(key));
+}
+
+unsigned shash_members(shash_t *h)
+{
+   return h->core.members;
+}
+
+void shash_reserve(shash_t *h, unsigned n)
+{
+   hash_reserve_core(&(h->core), n);
+}
+
+ihash_t *ihash_new(int size)
+{
+   struct ihash *h = xmalloc(sizeof(struct ihash));
+   hash_init(&(h->core), size, true, KEY_INT);
+   return h;
+}
+
+void ihash_free(ihash_t *h)
+{
+   free(h->core.slots);
+   free(h);
+}
+
+void ihash_put(ihash_t *h, uint64_t key, void *value)
+{
+   hash_put_core(&(h->core), key, hash_int(key), value);
+}
+
+void *ihash_get(ihash_t *h, uint64_t key)
+{
+   int n = 0;
+   const int slot = hash_find(&(h->core), key, hash_int(key), &n);
+   return slot < 0 ? NULL : h->core.slots[slot].value;
+}
+
+bool ihash_delete(ihash_t *h, uint64_t key)
+{
+   return hash_delete_core(&(h->core), key, hash_int(key));
+}
+
+unsigned ihash_members(ihash_t *h)
+{
+   return h->core.members;
+}
+
+void ihash_reserve(ihash_t *h, unsigned n)
+{
+   hash_reserve_core(&(h->core), n);
+}
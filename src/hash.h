@@ -34,8 +34,33 @@ void hash_free(hash_t *h);
 bool hash_put(hash_t *h, const void *key, void *value);
 void *hash_get(hash_t *h, const void *key);
 void *hash_get_nth(hash_t *h, const void *key, int *n);
+bool hash_delete(hash_t *h, const void *key);
 void hash_replace(hash_t *h, void *value, void *with);
 bool hash_iter(hash_t *h, hash_iter_t *now, const void **key, void **value);
 unsigned hash_members(hash_t *h);
+void hash_reserve(hash_t *h, unsigned n);
+void hash_shrink(hash_t *h);
+
+// Tables keyed on strings which are copied and owned by the table
+typedef struct shash shash_t;
+
+shash_t *shash_new(int size);
+void shash_free(shash_t *h);
+void shash_put(shash_t *h, const char *key, void *value);
+void *shash_get(shash_t *h, const char *key);
+bool shash_delete(shash_t *h, const char *key);
+unsigned shash_members(shash_t *h);
+void shash_reserve(shash_t *h, unsigned n);
+
+// Tables keyed on 64-bit integers
+typedef struct ihash ihash_t;
+
+ihash_t *ihash_new(int size);
+void ihash_free(ihash_t *h);
+void ihash_put(ihash_t *h, uint64_t key, void *value);
+void *ihash_get(ihash_t *h, uint64_t key);
+bool ihash_delete(ihash_t *h, uint64_t key);
+unsigned ihash_members(ihash_t *h);
+void ihash_reserve(ihash_t *h, unsigned n);
 
 #endif  // _HASH_H
@@ -17,6 +17,7 @@
 
 #include "util.h"
 #include "fbuf.h"
+#include "hash.h"
 #include "ident.h"
 
 #include <assert.h>
@@ -25,145 +26,196 @@
 #include <string.h>
 #include <stdint.h>
 #include <ctype.h>
-
-#define MAP_DEPTH 3
-
-typedef struct clist clist_t;
-typedef struct trie  trie_t;
-
-struct clist {
-   char     value;
-   trie_t  *down;
-   clist_t *left;
-   clist_t *right;
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define ARENA_SIZE   65536
+#define INITIAL_SIZE 4096
+#define HASH_INIT    UINT32_C(2166136261)
+#define TABLE_REF    UINT32_C(0x80000000)
+
+// Identifiers are interned in an open addressing hash table and the
+// characters are stored inline after the header so istr and ident_len
+// are constant time
+
+struct ident {
+   uint32_t  hash;
+   uint32_t  length;
+   uint32_t  write_gen;
+   uint32_t  write_index;
+   ident_t   parent;
+   char      parent_sep;
+   char      bytes[0];
 };
 
-struct trie {
-   char      value;
-   uint16_t  write_gen;
-   uint16_t  depth;
-   uint32_t  write_index;
-   trie_t   *up;
-   clist_t  *list;
-   trie_t   *map[0];
+// Strings shared by every file in a library are kept in a separate
+// file which is only ever appended to. Each record is a 32-bit length
+// followed by the characters and is referenced by its position in the
+// file so any process can add new strings while holding the lock.
+
+struct ident_table {
+   char     *path;
+   char     *data;
+   size_t    size;
+   size_t    alloc;
+   uint32_t *offsets;
+   ident_t  *idents;
+   unsigned  count;
+   unsigned  max;
+   unsigned  hashed;
+   hash_t   *ids;
+   int       fd;
+   size_t    flushed;
+   unsigned  writers;
 };
 
 struct ident_rd_ctx {
-   fbuf_t  *file;
-   size_t   cache_sz;
-   size_t   cache_alloc;
-   ident_t *cache;
+   fbuf_t        *file;
+   ident_table_t *table;
+   size_t         cache_sz;
+   size_t         cache_alloc;
+   ident_t       *cache;
+   char          *buf;
+   size_t         bufsz;
 };
 
 struct ident_wr_ctx {
-   fbuf_t   *file;
-   uint32_t  next_index;
-   uint16_t  generation;
+   fbuf_t        *file;
+   ident_table_t *table;
+   uint32_t       next_index;
+   uint32_t       generation;
 };
 
-typedef struct {
-   trie_t  trie;
-   trie_t *map[256];
-} root_t;
-
-static root_t root = {
-   {
-      .value       = '\0',
-      .write_gen   = 0,
-      .write_index = 0,
-      .depth       = 1,
-      .up          = NULL
-   }
+static struct ident empty = {
+   .hash   = HASH_INIT,
+   .length = 0,
 };
 
-static trie_t *alloc_node(char ch, trie_t *prev)
+static ident_t  *table = NULL;
+static size_t    table_sz = 0;
+static size_t    table_used = 0;
+static char     *arena_ptr = NULL;
+static size_t    arena_left = 0;
+
+static uint32_t ident_hash(uint32_t hash, const char *str, size_t len)
 {
-   const size_t mapsz = (prev->depth < MAP_DEPTH) ? 256 * sizeof(trie_t *) : 0;
+   // FNV-1a which can be continued from the hash of a prefix
+   for (size_t i = 0; i < len; i++) {
+      hash ^= (unsigned char)str[i];
+      hash *= UINT32_C(16777619);
+   }
 
-   trie_t *t = xmalloc(sizeof(trie_t) + mapsz);
-   t->value     = ch;
-   t->depth     = prev->depth + 1;
-   t->up        = prev;
-   t->write_gen = 0;
-   t->list      = NULL;
+   return hash;
+}
 
-   if (mapsz > 0)
-      memset(t->map, '\0', mapsz);
+static ident_t ident_alloc(const char *s1, size_t len1, char sep,
+                           const char *s2, size_t len2, uint32_t hash)
+{
+   const size_t len = len1 + (sep != '\0') + len2;
+
+   const size_t align = sizeof(void *);
+   const size_t size =
+      (sizeof(struct ident) + len + 1 + align - 1) & ~(align - 1);
 
-   if (prev->depth <= MAP_DEPTH)
-      prev->map[(unsigned char)ch] = t;
+   char *mem;
+   if (size > ARENA_SIZE / 4)
+      mem = xmalloc(size);
    else {
-      clist_t *c = xmalloc(sizeof(clist_t));
-      c->value    = ch;
-      c->down     = t;
-      c->left     = NULL;
-      c->right    = NULL;
-
-      clist_t *it, **where;
-      for (it = prev->list, where = &(prev->list);
-           it != NULL;
-           where = (ch < it->value ? &(it->left) : &(it->right)),
-              it = *where)
-         ;
+      if (size > arena_left) {
+         arena_ptr  = xmalloc(ARENA_SIZE);
+         arena_left = ARENA_SIZE;
+      }
 
-      *where = c;
+      mem = arena_ptr;
+      arena_ptr  += size;
+      arena_left -= size;
    }
 
-   return t;
+   struct ident *i = (struct ident *)mem;
+   i->hash        = hash;
+   i->length      = len;
+   i->write_gen   = 0;
+   i->write_index = 0;
+   i->parent      = NULL;
+   i->parent_sep  = '\0';
+
+   char *p = i->bytes;
+   memcpy(p, s1, len1);
+   p += len1;
+   if (sep != '\0')
+      *p++ = sep;
+   if (len2 > 0)
+      memcpy(p, s2, len2);
+   i->bytes[len] = '\0';
+
+   return i;
 }
 
-static void build_trie(const char *str, trie_t *prev, trie_t **end)
+static void ident_grow_table(void)
 {
-   assert(*str != '\0');
-   assert(prev != NULL);
+   const size_t new_sz = (table_sz == 0) ? INITIAL_SIZE : table_sz * 2;
+   ident_t *new_table = xcalloc(new_sz * sizeof(ident_t));
 
-   trie_t *t = alloc_node(*str, prev);
+   for (size_t i = 0; i < table_sz; i++) {
+      if (table[i] == NULL)
+         continue;
 
-   if (*(++str) == '\0')
-      *end = t;
-   else
-      build_trie(str, t, end);
-}
-
-static clist_t *search_node(trie_t *t, char ch)
-{
-   clist_t *it;
-   for (it = t->list;
-        (it != NULL) && (it->value != ch);
-        it = (ch < it->value ? it->left : it->right))
-      ;
+      size_t slot = table[i]->hash & (new_sz - 1);
+      while (new_table[slot] != NULL)
+         slot = (slot + 1) & (new_sz - 1);
+      new_table[slot] = table[i];
+   }
 
-   return it;
+   free(table);
+   table    = new_table;
+   table_sz = new_sz;
 }
 
-static bool search_trie(const char **str, trie_t *t, trie_t **end)
+static ident_t ident_lookup_parts(const char *s1, size_t len1, char sep,
+                                  const char *s2, size_t len2,
+                                  uint32_t hash, bool insert)
 {
-   assert(**str != '\0');
-   assert(t != NULL);
+   // Find or insert the concatenation of s1, sep, and s2 without
+   // building the whole string first
+   const size_t len = len1 + (sep != '\0') + len2;
+   if (len == 0)
+      return &empty;
 
-   trie_t *next = NULL;
-
-   if (t->depth <= MAP_DEPTH)
-      next = t->map[(unsigned char)**str];
-   else {
-      clist_t *it = search_node(t, **str);
-      next = (it != NULL) ? it->down : NULL;
+   if (table_used * 2 >= table_sz) {
+      if (!insert && table_sz == 0)
+         return NULL;
+      ident_grow_table();
    }
 
-   if (next == NULL) {
-      *end = t;
-      return false;
+   size_t slot = hash & (table_sz - 1);
+   for (; table[slot] != NULL; slot = (slot + 1) & (table_sz - 1)) {
+      ident_t i = table[slot];
+      if (i->hash != hash || i->length != len)
+         continue;
+      else if (memcmp(i->bytes, s1, len1) != 0)
+         continue;
+      else if (sep != '\0' && i->bytes[len1] != sep)
+         continue;
+      else if (len2 == 0 || memcmp(i->bytes + len - len2, s2, len2) == 0)
+         return i;
    }
-   else {
-      (*str)++;
 
-      if (**str == '\0') {
-         *end = next;
-         return true;
-      }
-      else
-         return search_trie(str, next, end);
-   }
+   if (!insert)
+      return NULL;
+
+   table_used++;
+   return (table[slot] = ident_alloc(s1, len1, sep, s2, len2, hash));
+}
+
+static ident_t ident_lookup(const char *str, size_t len, bool insert)
+{
+   const uint32_t hash = ident_hash(HASH_INIT, str, len);
+   return ident_lookup_parts(str, len, '\0', NULL, 0, hash, insert);
 }
 
 ident_t ident_new(const char *str)
@@ -171,11 +223,15 @@ ident_t ident_new(const char *str)
    assert(str != NULL);
    assert(*str != '\0');
 
-   trie_t *result;
-   if (!search_trie(&str, &(root.trie), &result))
-      build_trie(str, result, &result);
+   return ident_lookup(str, strlen(str), true);
+}
 
-   return result;
+ident_t ident_new_n(const char *str, size_t len)
+{
+   assert(str != NULL);
+   assert(len > 0);
+
+   return ident_lookup(str, len, true);
 }
 
 bool ident_interned(const char *str)
@@ -183,54 +239,233 @@ bool ident_interned(const char *str)
    assert(str != NULL);
    assert(*str != '\0');
 
-   trie_t *result;
-   return search_trie(&str, &(root.trie), &result);
+   return ident_lookup(str, strlen(str), false) != NULL;
 }
 
 const char *istr(ident_t ident)
 {
    if (ident == NULL)
       return NULL;
+   else
+      return ident->bytes;
+}
 
-   char *p = get_fmt_buf(ident->depth) + ident->depth - 1;
-   *p = '\0';
+ident_table_t *ident_table_new(const char *path)
+{
+   ident_table_t *t = xcalloc(sizeof(ident_table_t));
+   t->path = xstrdup(path);
+   t->fd   = -1;
 
-   trie_t *it;
-   for (it = ident; it->value != '\0'; it = it->up)
-      *(--p) = it->value;
+   return t;
+}
+
+static void ident_table_sync(ident_table_t *t, int fd)
+{
+   // Read any records added to the file by other processes since it
+   // was last seen
 
-   return p;
+   assert(t->flushed == t->size);
+
+   struct stat st;
+   if (fstat(fd, &st) < 0)
+      fatal_errno("%s", t->path);
+
+   if (st.st_size <= t->size)
+      return;
+
+   const size_t want = st.st_size - t->size;
+   if (t->size + want > t->alloc) {
+      t->alloc = MAX(t->alloc * 2, t->size + want);
+      t->data  = xrealloc(t->data, t->alloc);
+   }
+
+   if (lseek(fd, t->size, SEEK_SET) < 0)
+      fatal_errno("%s", t->path);
+
+   size_t got = 0;
+   while (got < want) {
+      const ssize_t n = read(fd, t->data + t->size + got, want - got);
+      if (n < 0)
+         fatal_errno("%s", t->path);
+      else if (n == 0)
+         break;
+      got += n;
+   }
+
+   // A record being written by another process may be incomplete
+   size_t pos = t->size;
+   while (pos + sizeof(uint32_t) <= t->size + got) {
+      uint32_t len;
+      memcpy(&len, t->data + pos, sizeof(uint32_t));
+      if (pos + sizeof(uint32_t) + len > t->size + got)
+         break;
+
+      if (t->count == t->max) {
+         t->max     = MAX(t->max * 2, 256);
+         t->offsets = xrealloc(t->offsets, t->max * sizeof(uint32_t));
+         t->idents  = xrealloc(t->idents, t->max * sizeof(ident_t));
+      }
+
+      t->offsets[t->count] = pos;
+      t->idents[t->count]  = NULL;
+      t->count++;
+
+      pos += sizeof(uint32_t) + len;
+   }
+
+   t->size = t->flushed = pos;
 }
 
-ident_wr_ctx_t ident_write_begin(fbuf_t *f)
+static ident_t ident_table_get(ident_table_t *t, uint32_t id)
 {
-   static uint16_t ident_wr_gen = 1;
+   if (unlikely(id >= t->count)) {
+      const int fd = open(t->path, O_RDONLY | O_BINARY);
+      if (fd >= 0) {
+         ident_table_sync(t, fd);
+         close(fd);
+      }
+
+      if (id >= t->count)
+         fatal("identifier table %s is corrupt: id=%u count=%u",
+               t->path, id, t->count);
+   }
+
+   if (t->idents[id] == NULL) {
+      uint32_t len;
+      memcpy(&len, t->data + t->offsets[id], sizeof(uint32_t));
+
+      const char *str = t->data + t->offsets[id] + sizeof(uint32_t);
+      t->idents[id] = ident_lookup(str, len, true);
+   }
+
+   return t->idents[id];
+}
+
+static void ident_table_lock(ident_table_t *t)
+{
+   if (t->writers++ > 0)
+      return;
+
+   // Each process opens the file itself as a lock taken with flock is
+   // shared with any children forked while it is held
+   t->fd = open(t->path, O_RDWR | O_CREAT | O_BINARY, 0644);
+   if (t->fd < 0)
+      fatal_errno("%s", t->path);
+
+   file_write_lock(t->fd);
+   ident_table_sync(t, t->fd);
+
+   if (t->ids == NULL)
+      t->ids = hash_new(MAX(t->count * 2, 256), true);
+
+   for (; t->hashed < t->count; t->hashed++) {
+      ident_t i = ident_table_get(t, t->hashed);
+      hash_put(t->ids, i, (void *)(uintptr_t)(t->hashed + 1));
+   }
+}
+
+static void ident_table_unlock(ident_table_t *t)
+{
+   assert(t->writers > 0);
+   if (--(t->writers) > 0)
+      return;
+
+   if (t->size > t->flushed) {
+      // Any partial record left by a process that crashed while
+      // appending is overwritten here
+      if (lseek(t->fd, t->flushed, SEEK_SET) < 0)
+         fatal_errno("%s", t->path);
+
+      size_t done = 0;
+      while (done < t->size - t->flushed) {
+         const ssize_t n = write(t->fd, t->data + t->flushed + done,
+                                 t->size - t->flushed - done);
+         if (n < 0)
+            fatal_errno("failed to write %s", t->path);
+         done += n;
+      }
+
+      t->flushed = t->size;
+   }
+
+   file_unlock(t->fd);
+   close(t->fd);
+   t->fd = -1;
+}
+
+static uint32_t ident_table_id(ident_table_t *t, ident_t ident)
+{
+   void *value = hash_get(t->ids, ident);
+   if (value != NULL)
+      return (uintptr_t)value - 1;
+
+   const uint32_t len = ident->length;
+   const size_t need = sizeof(uint32_t) + len;
+   if (t->size + need > t->alloc) {
+      t->alloc = MAX(t->alloc * 2, t->size + need + 4096);
+      t->data  = xrealloc(t->data, t->alloc);
+   }
+
+   if (t->count == t->max) {
+      t->max     = MAX(t->max * 2, 256);
+      t->offsets = xrealloc(t->offsets, t->max * sizeof(uint32_t));
+      t->idents  = xrealloc(t->idents, t->max * sizeof(ident_t));
+   }
+
+   memcpy(t->data + t->size, &len, sizeof(uint32_t));
+   memcpy(t->data + t->size + sizeof(uint32_t), ident->bytes, len);
+
+   const uint32_t id = t->count++;
+   t->offsets[id] = t->size;
+   t->idents[id]  = ident;
+   t->size += need;
+   t->hashed = t->count;
+
+   if (id >= TABLE_REF - 1)
+      fatal("too many identifiers in %s", t->path);
+
+   hash_put(t->ids, ident, (void *)(uintptr_t)(id + 1));
+   return id;
+}
+
+ident_wr_ctx_t ident_write_begin(fbuf_t *f, ident_table_t *table)
+{
+   static uint32_t ident_wr_gen = 1;
    assert(ident_wr_gen > 0);
 
    struct ident_wr_ctx *ctx = xmalloc(sizeof(struct ident_wr_ctx));
    ctx->file       = f;
+   ctx->table      = table;
    ctx->generation = ident_wr_gen++;
    ctx->next_index = 0;
 
+   if (table != NULL)
+      ident_table_lock(table);
+
    return ctx;
 }
 
 void ident_write_end(ident_wr_ctx_t ctx)
 {
+   if (ctx->table != NULL)
+      ident_table_unlock(ctx->table);
+
    free(ctx);
 }
 
 void ident_write(ident_t ident, ident_wr_ctx_t ctx)
 {
-   if (ident == NULL) {
+   if (ident == NULL || ident == &empty) {
       write_u32(UINT32_MAX, ctx->file);
       write_u8(0, ctx->file);
    }
+   else if (ctx->table != NULL)
+      write_u32(ident_table_id(ctx->table, ident) | TABLE_REF, ctx->file);
    else if (ident->write_gen == ctx->generation)
       write_u32(ident->write_index, ctx->file);
    else {
       write_u32(UINT32_MAX, ctx->file);
-      write_raw(istr(ident), ident->depth, ctx->file);
+      write_raw(ident->bytes, ident->length + 1, ctx->file);
 
       ident->write_gen   = ctx->generation;
       ident->write_index = ctx->next_index++;
@@ -239,13 +474,16 @@ void ident_write(ident_t ident, ident_wr_ctx_t ctx)
    }
 }
 
-ident_rd_ctx_t ident_read_begin(fbuf_t *f)
+ident_rd_ctx_t ident_read_begin(fbuf_t *f, ident_table_t *table)
 {
    struct ident_rd_ctx *ctx = xmalloc(sizeof(struct ident_rd_ctx));
    ctx->file        = f;
+   ctx->table       = table;
    ctx->cache_alloc = 256;
    ctx->cache_sz    = 0;
    ctx->cache       = xmalloc(ctx->cache_alloc * sizeof(ident_t));
+   ctx->bufsz       = 128;
+   ctx->buf         = xmalloc(ctx->bufsz);
 
    return ctx;
 }
@@ -253,6 +491,7 @@ ident_rd_ctx_t ident_read_begin(fbuf_t *f)
 void ident_read_end(ident_rd_ctx_t ctx)
 {
    free(ctx->cache);
+   free(ctx->buf);
    free(ctx);
 }
 
@@ -265,30 +504,31 @@ ident_t ident_read(ident_rd_ctx_t ctx)
          ctx->cache = xrealloc(ctx->cache, ctx->cache_alloc * sizeof(ident_t));
       }
 
-      trie_t *p = &(root.trie);
+      size_t len = 0;
       char ch;
       while ((ch = read_u8(ctx->file)) != '\0') {
-         trie_t *next = NULL;
-         if (p->depth <= MAP_DEPTH)
-            next = p->map[(unsigned char)ch];
-         else {
-            clist_t *it = search_node(p, ch);
-            next = (it != NULL) ? it->down : NULL;
+         if (len == ctx->bufsz) {
+            ctx->bufsz *= 2;
+            ctx->buf = xrealloc(ctx->buf, ctx->bufsz);
          }
-
-         if (next != NULL)
-            p = next;
-         else
-            p = alloc_node(ch, p);
+         ctx->buf[len++] = ch;
       }
 
-      if (p == &(root.trie))
+      if (len == 0)
          return NULL;
       else {
-         ctx->cache[ctx->cache_sz++] = p;
-         return p;
+         ident_t i = ident_lookup(ctx->buf, len, true);
+         ctx->cache[ctx->cache_sz++] = i;
+         return i;
       }
    }
+   else if (index & TABLE_REF) {
+      if (unlikely(ctx->table == NULL))
+         fatal("%s refers to a library identifier table",
+               fbuf_file_name(ctx->file));
+
+      return ident_table_get(ctx->table, index & ~TABLE_REF);
+   }
    else if (likely(index < ctx->cache_sz))
       return ctx->cache[index];
    else
@@ -300,20 +540,15 @@ ident_t ident_uniq(const char *prefix)
 {
    static int counter = 0;
 
-   const char *start = prefix;
-   trie_t *end;
-   if (search_trie(&start, &(root.trie), &end)) {
+   if (ident_interned(prefix)) {
       const size_t len = strlen(prefix) + 16;
       char buf[len];
       snprintf(buf, len, "%s%d", prefix, counter++);
 
       return ident_new(buf);
    }
-   else {
-      trie_t *result;
-      build_trie(start, end, &result);
-      return result;
-   }
+   else
+      return ident_new(prefix);
 }
 
 ident_t ident_prefix(ident_t a, ident_t b, char sep)
@@ -323,22 +558,21 @@ ident_t ident_prefix(ident_t a, ident_t b, char sep)
    else if (b == NULL)
       return a;
 
-   trie_t *result;
+   uint32_t hash = a->hash;
+   if (sep != '\0')
+      hash = ident_hash(hash, &sep, 1);
+   hash = ident_hash(hash, b->bytes, b->length);
 
-   if (sep != '\0') {
-      // Append separator
-      const char sep_str[] = { sep, '\0' };
-      const char *p_sep_str = sep_str;
-      if (!search_trie(&p_sep_str, a, &result))
-         build_trie(p_sep_str, result, &result);
-   }
-   else
-      result = a;
+   ident_t result = ident_lookup_parts(a->bytes, a->length, sep, b->bytes,
+                                       b->length, hash, true);
 
-   // Append b
-   const char *bstr = istr(b);
-   if (!search_trie(&bstr, result, &result))
-      build_trie(bstr, result, &result);
+   // Remember the prefix so walking back up a hierarchical name with
+   // ident_runtil does not need to search the table
+   if (sep != '\0' && result->parent == NULL
+       && memchr(b->bytes, sep, b->length) == NULL) {
+      result->parent     = a;
+      result->parent_sep = sep;
+   }
 
    return result;
 }
@@ -348,47 +582,59 @@ ident_t ident_strip(ident_t a, ident_t b)
    assert(a != NULL);
    assert(b != NULL);
 
-   while (a->value == b->value && b->value != '\0') {
-      a = a->up;
-      b = b->up;
-   }
+   if (b->length > a->length)
+      return NULL;
+
+   const size_t len = a->length - b->length;
+   if (memcmp(a->bytes + len, b->bytes, b->length) != 0)
+      return NULL;
 
-   return (b->value == '\0' ? a : NULL);
+   return ident_lookup(a->bytes, len, true);
 }
 
 char ident_char(ident_t i, unsigned n)
 {
-   if (i == NULL)
+   if (i == NULL || n >= i->length)
       return '\0';
-   else if (n == 0)
-      return i->value;
    else
-      return ident_char(i->up, n - 1);
+      return i->bytes[i->length - 1 - n];
 }
 
 size_t ident_len(ident_t i)
 {
-   if (i == NULL || i->value == '\0')
-      return 0;
-   else
-      return ident_len(i->up) + 1;
+   return (i == NULL) ? 0 : i->length;
 }
 
 ident_t ident_suffix_until(ident_t i, char c, ident_t shared, char escape)
 {
    assert(i != NULL);
 
+   // Only consider characters after the shared prefix and its separator
+   size_t stop = 0;
+   if (shared != NULL && shared->length < i->length
+       && memcmp(i->bytes, shared->bytes, shared->length) == 0)
+      stop = shared->length + 1;
+
+   size_t r = i->length;
+
+   if (escape == '\0') {
+      // No escaping so the first separator after the prefix is wanted
+      const char *p = memchr(i->bytes + stop, c, i->length - stop);
+      if (p != NULL)
+         r = p - i->bytes;
+      return (r == i->length) ? i : ident_lookup(i->bytes, r, true);
+   }
+
    bool escaping = false;
-   ident_t r = i;
-   while (i->value != '\0' && i->up != shared) {
-      if (!escaping && i->value == c)
-         r = i->up;
-      else if (i->value == escape)
+   for (size_t k = i->length; k > stop; k--) {
+      const char ch = i->bytes[k - 1];
+      if (!escaping && ch == c)
+         r = k - 1;
+      else if (ch == escape)
          escaping = !escaping;
-      i = i->up;
    }
 
-   return r;
+   return (r == i->length) ? i : ident_lookup(i->bytes, r, true);
 }
 
 ident_t ident_until(ident_t i, char c)
@@ -400,9 +646,18 @@ ident_t ident_runtil(ident_t i, char c)
 {
    assert(i != NULL);
 
-   for (ident_t r = i; r->value != '\0'; r = r->up) {
-      if (r->value == c)
-         return r->up;
+   if (i->parent != NULL && i->parent_sep == c)
+      return i->parent;
+
+   for (size_t k = i->length; k > 0; k--) {
+      if (i->bytes[k - 1] == c) {
+         ident_t r = ident_lookup(i->bytes, k - 1, true);
+         if (i->parent == NULL) {
+            i->parent     = r;
+            i->parent_sep = c;
+         }
+         return r;
+      }
    }
 
    return i;
@@ -412,34 +667,21 @@ ident_t ident_from(ident_t i, char c)
 {
    assert(i != NULL);
 
-   char buf[i->depth + 1];
-   char *p = buf + i->depth;
-   *p-- = '\0';
-
-   char *from = NULL;
-   while (i->value != '\0') {
-      if (i->value == c)
-         from = p + 1;
-      *p-- = i->value;
-      i = i->up;
-   }
+   const char *from = memchr(i->bytes, c, i->length);
+   if (from == NULL)
+      return NULL;
 
-   return (from == NULL) ? NULL : ident_new(from);
+   from++;
+   return ident_lookup(from, i->length - (from - i->bytes), true);
 }
 
 ident_t ident_rfrom(ident_t i, char c)
 {
    assert(i != NULL);
 
-   char buf[i->depth + 1];
-   char *p = buf + i->depth;
-   *p-- = '\0';
-
-   while (i->value != '\0') {
-      if (i->value == c)
-         return ident_new(p + 1);
-      *p-- = i->value;
-      i = i->up;
+   for (size_t k = i->length; k > 0; k--) {
+      if (i->bytes[k - 1] == c)
+         return ident_lookup(i->bytes + k, i->length - k, true);
    }
 
    return NULL;
@@ -449,25 +691,22 @@ bool icmp(ident_t i, const char *s)
 {
    assert(i != NULL);
 
-   trie_t *result;
-   if (!search_trie(&s, &(root.trie), &result))
-      return false;
-   else
-      return result == i;
+   return strcmp(i->bytes, s) == 0;
 }
 
-static bool ident_glob_walk(const trie_t *i, const char *g,
+static bool ident_glob_walk(ident_t i, size_t pos, const char *g,
                             const char *const end)
 {
-   if (i->value == '\0')
+   // Matches backwards from the character before pos
+   if (pos == 0)
       return (g < end);
    else if (g < end)
       return false;
    else if (*g == '*')
-      return ident_glob_walk(i->up, g, end)
-         || ident_glob_walk(i->up, g - 1, end);
-   else if (i->value == *g)
-      return ident_glob_walk(i->up, g - 1, end);
+      return ident_glob_walk(i, pos - 1, g, end)
+         || ident_glob_walk(i, pos - 1, g - 1, end);
+   else if (i->bytes[pos - 1] == *g)
+      return ident_glob_walk(i, pos - 1, g - 1, end);
    else
       return false;
 }
@@ -479,38 +718,26 @@ bool ident_glob(ident_t i, const char *glob, int length)
    if (length < 0)
       length = strlen(glob);
 
-   return ident_glob_walk(i, glob + length - 1, glob);
+   return ident_glob_walk(i, i->length, glob + length - 1, glob);
 }
 
 bool ident_contains(ident_t i, const char *search)
 {
    assert(i != NULL);
 
-   for (ident_t r = i; r->value != '\0'; r = r->up) {
-      for (const char *p = search; *p != '\0'; p++) {
-         if (r->value == *p)
-            return true;
-      }
-   }
-
-   return false;
+   return strpbrk(i->bytes, search) != NULL;
 }
 
 ident_t ident_downcase(ident_t i)
 {
-   // TODO: this could be implemented more efficiently
-
    if (i == NULL)
       return NULL;
 
-   char *p = get_fmt_buf(i->depth) + i->depth - 1;
-   *p = '\0';
-
-   trie_t *it;
-   for (it = i; it->value != '\0'; it = it->up)
-      *(--p) = tolower((int)it->value);
+   char buf[i->length + 1];
+   for (size_t k = 0; k < i->length; k++)
+      buf[k] = tolower((int)i->bytes[k]);
 
-   return ident_new(p);
+   return ident_lookup(buf, i->length, true);
 }
 
 void ident_list_add(ident_list_t **list, ident_t i)
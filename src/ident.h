@@ -28,6 +28,9 @@ typedef struct ident_rd_ctx *ident_rd_ctx_t;
 // Intern a string as an identifier.
 ident_t ident_new(const char *str);
 
+// Intern the first len characters of str as an identifier.
+ident_t ident_new_n(const char *str, size_t len);
+
 // True if the given string was already interned.
 bool ident_interned(const char *str);
 
@@ -82,11 +85,17 @@ ident_t ident_downcase(ident_t i);
 // for printing.
 const char *istr(ident_t ident);
 
-ident_wr_ctx_t ident_write_begin(fbuf_t *f);
+// Open the table of identifiers shared by files in a library. The
+// file at path is created when the first identifier is written.
+ident_table_t *ident_table_new(const char *path);
+
+// The table may be NULL in which case identifiers are stored in the
+// file the first time they are written
+ident_wr_ctx_t ident_write_begin(fbuf_t *f, ident_table_t *table);
 void ident_write(ident_t ident, ident_wr_ctx_t ctx);
 void ident_write_end(ident_wr_ctx_t ctx);
 
-ident_rd_ctx_t ident_read_begin(fbuf_t *f);
+ident_rd_ctx_t ident_read_begin(fbuf_t *f, ident_table_t *table);
 ident_t ident_read(ident_rd_ctx_t ctx);
 void ident_read_end(ident_rd_ctx_t ctx);
 
@@ -19,6 +19,7 @@
 #include "lib.h"
 #include "tree.h"
 #include "common.h"
+#include "hash.h"
 
 #include <assert.h>
 #include <limits.h>
@@ -34,6 +35,10 @@
 #include <sys/types.h>
 #include <sys/time.h>
 
+#ifndef __MINGW32__
+#include <sys/wait.h>
+#endif
+
 typedef struct search_path search_path_t;
 typedef struct lib_unit    lib_unit_t;
 typedef struct lib_index   lib_index_t;
@@ -45,23 +50,44 @@ struct lib_unit {
    tree_kind_t   kind;
    tree_rd_ctx_t read_ctx;
    bool          dirty;
+   bool          checked;
    lib_mtime_t   mtime;
 };
 
 struct lib_index {
    ident_t      name;
    tree_kind_t  kind;
+   bool         dirty;
+   lib_mtime_t  mtime;
+   ident_t      source;
    lib_index_t *next;
 };
 
+typedef struct {
+   bool        exists;
+   lib_mtime_t mtime;
+} lib_source_t;
+
 struct lib {
-   char         path[PATH_MAX];
-   ident_t      name;
-   unsigned     n_units;
-   unsigned     units_alloc;
-   lib_unit_t  *units;
-   lib_index_t *index;
-   int          lock_fd;
+   char          path[PATH_MAX];
+   ident_t       name;
+   unsigned      n_units;
+   unsigned      units_alloc;
+   lib_unit_t  **units;
+   hash_t       *lookup;
+   lib_index_t  *index;
+   hash_t       *index_lookup;
+   unsigned      index_sz;
+   uint32_t      index_epoch;
+   long          index_off;
+   unsigned      index_records;
+   int           lock_fd;
+   ident_table_t *idents;
+   ident_t      *save_names;
+   char        **save_tmp;
+   unsigned      n_save_tmp;
+   pid_t        *save_pids;
+   unsigned      n_save_pids;
 };
 
 struct lib_list {
@@ -78,7 +104,19 @@ static lib_t          work = NULL;
 static lib_list_t    *loaded = NULL;
 static search_path_t *search_paths = NULL;
 
+// The index on disk is a header followed by records which are only
+// ever appended until the file is rewritten with a new epoch
+static const uint8_t index_magic[4] = { 'N', 'V', 'I', '2' };
+
+#define INDEX_HEADER_SZ 8
+#define MAX_SAVE_WRITERS 8
+
+// Modification times of source files are only checked once per
+// invocation however many units they contain
+static hash_t *source_cache = NULL;
+
 static const char *lib_file_path(lib_t lib, const char *name);
+static lib_mtime_t lib_stat_mtime(struct stat *st);
 
 static const char *standard_suffix(vhdl_standard_t std)
 {
@@ -112,14 +150,227 @@ static ident_t upcase_name(const char * name)
    return i;
 }
 
+static lib_index_t *lib_find_in_index(lib_t lib, ident_t name)
+{
+   return hash_get(lib->index_lookup, name);
+}
+
+static lib_index_t *lib_add_to_index(lib_t lib, ident_t name,
+                                     tree_kind_t kind, bool dirty)
+{
+   lib_index_t *in = xmalloc(sizeof(lib_index_t));
+   in->name   = name;
+   in->kind   = kind;
+   in->dirty  = dirty;
+   in->mtime  = 0;
+   in->source = NULL;
+   in->next   = lib->index;
+
+   lib->index = in;
+   lib->index_sz++;
+
+   hash_put(lib->index_lookup, name, in);
+
+   return in;
+}
+
+static bool lib_source_mtime(ident_t file, lib_mtime_t *mt)
+{
+   if (source_cache == NULL)
+      source_cache = hash_new(64, true);
+
+   lib_source_t *src = hash_get(source_cache, file);
+   if (src == NULL) {
+      src = xmalloc(sizeof(lib_source_t));
+
+      struct stat st;
+      if ((src->exists = (stat(istr(file), &st) == 0)))
+         src->mtime = lib_stat_mtime(&st);
+      else
+         src->mtime = 0;
+
+      hash_put(source_cache, file, src);
+   }
+
+   *mt = src->mtime;
+   return src->exists;
+}
+
+static bool lib_read_index_str(FILE *f, char *buf, size_t len)
+{
+   size_t pos = 0;
+   int ch;
+   while ((ch = fgetc(f)) != EOF && ch != '\0') {
+      if (pos + 1 < len)
+         buf[pos++] = ch;
+   }
+
+   buf[pos] = '\0';
+   return ch != EOF;
+}
+
+static void lib_read_index(lib_t lib)
+{
+   // Merge entries from the index on disk which may have been written
+   // by another process since the index was last read
+
+   if (lib->path[0] == '\0')
+      return;
+
+   FILE *f = lib_fopen(lib, "_index", "rb");
+   if (f == NULL)
+      return;
+
+   uint8_t header[INDEX_HEADER_SZ];
+   if (fread(header, INDEX_HEADER_SZ, 1, f) != 1
+       || memcmp(header, index_magic, sizeof(index_magic)) != 0)
+      fatal("library %s index was written by an earlier version of "
+            PACKAGE_NAME " and the library should be deleted and "
+            "reanalysed", istr(lib->name));
+
+   const uint32_t epoch =
+      header[4] | (header[5] << 8) | (header[6] << 16)
+      | ((uint32_t)header[7] << 24);
+
+   if (epoch != lib->index_epoch) {
+      // Rewritten since we last looked so start again from the top
+      lib->index_epoch   = epoch;
+      lib->index_off     = INDEX_HEADER_SZ;
+      lib->index_records = 0;
+   }
+
+   if (fseek(f, lib->index_off, SEEK_SET) != 0)
+      fatal_errno("fseek");
+
+   // Each record is a two byte kind and eight byte analysis time
+   // followed by the NUL terminated unit name and source file name
+   char name[PATH_MAX], source[PATH_MAX];
+   uint8_t fixed[10];
+   while (fread(fixed, sizeof(fixed), 1, f) == 1) {
+      if (!lib_read_index_str(f, name, sizeof(name))
+          || !lib_read_index_str(f, source, sizeof(source)))
+         break;   // Truncated by a writer that did not finish
+
+      const tree_kind_t kind = fixed[0] | (fixed[1] << 8);
+      if (kind >= T_LAST_TREE_KIND)
+         fatal("library %s index is corrupt", istr(lib->name));
+
+      lib_mtime_t mtime = 0;
+      for (int i = 0; i < 8; i++)
+         mtime |= (lib_mtime_t)fixed[2 + i] << (i * 8);
+
+      lib->index_off = ftell(f);
+      lib->index_records++;
+
+      ident_t i = ident_new(name);
+      lib_index_t *in = lib_find_in_index(lib, i);
+      if (in == NULL)
+         in = lib_add_to_index(lib, i, kind, false);
+      else if (in->dirty)
+         continue;
+
+      in->kind   = kind;
+      in->mtime  = mtime;
+      in->source = (source[0] == '\0') ? NULL : ident_new(source);
+   }
+
+   fclose(f);
+}
+
+static void lib_write_index_record(lib_index_t *in, FILE *f)
+{
+   const char *str = istr(in->name);
+   const char *source = (in->source == NULL) ? "" : istr(in->source);
+
+   uint8_t fixed[10] = { in->kind & 0xff, (in->kind >> 8) & 0xff };
+   for (int i = 0; i < 8; i++)
+      fixed[2 + i] = (in->mtime >> (i * 8)) & 0xff;
+
+   if (fwrite(fixed, sizeof(fixed), 1, f) != 1
+       || fwrite(str, strlen(str) + 1, 1, f) != 1
+       || fwrite(source, strlen(source) + 1, 1, f) != 1)
+      fatal_errno("failed to write library index");
+
+   in->dirty = false;
+}
+
+static void lib_rewrite_index(lib_t lib)
+{
+   char *tmp LOCAL = xasprintf("_index.%d.tmp", getpid());
+   FILE *f = lib_fopen(lib, tmp, "wb");
+   if (f == NULL)
+      fatal_errno("failed to create library %s index", istr(lib->name));
+
+   const uint32_t epoch = lib->index_epoch + 1;
+
+   uint8_t header[INDEX_HEADER_SZ];
+   memcpy(header, index_magic, sizeof(index_magic));
+   header[4] = epoch & 0xff;
+   header[5] = (epoch >> 8) & 0xff;
+   header[6] = (epoch >> 16) & 0xff;
+   header[7] = (epoch >> 24) & 0xff;
+
+   if (fwrite(header, INDEX_HEADER_SZ, 1, f) != 1)
+      fatal_errno("failed to write library index");
+
+   for (lib_index_t *it = lib->index; it != NULL; it = it->next)
+      lib_write_index_record(it, f);
+
+   lib->index_off     = ftell(f);
+   lib->index_records = lib->index_sz;
+   lib->index_epoch   = epoch;
+
+   fclose(f);
+
+   char *tmp_path LOCAL = xstrdup(lib_file_path(lib, tmp));
+#ifdef __MINGW32__
+   (void)remove(lib_file_path(lib, "_index"));
+#endif
+   if (rename(tmp_path, lib_file_path(lib, "_index")) != 0)
+      fatal_errno("failed to rename %s", tmp_path);
+}
+
+static void lib_write_index(lib_t lib)
+{
+   // Merge in changes from other processes first so the compaction
+   // below does not lose their entries
+   lib_read_index(lib);
+
+   if (lib->index_epoch == 0
+       || lib->index_records > 2 * lib->index_sz + 64) {
+      // No index yet or mostly superseded records
+      lib_rewrite_index(lib);
+      return;
+   }
+
+   FILE *f = NULL;
+   for (lib_index_t *it = lib->index; it != NULL; it = it->next) {
+      if (!it->dirty)
+         continue;
+
+      if (f == NULL && (f = lib_fopen(lib, "_index", "ab")) == NULL)
+         fatal_errno("failed to open library %s index", istr(lib->name));
+
+      lib_write_index_record(it, f);
+      lib->index_records++;
+   }
+
+   if (f != NULL) {
+      lib->index_off = ftell(f);
+      fclose(f);
+   }
+}
+
 static lib_t lib_init(const char *name, const char *rpath, int lock_fd)
 {
-   struct lib *l = xmalloc(sizeof(struct lib));
-   l->n_units = 0;
-   l->units   = NULL;
-   l->name    = upcase_name(name);
-   l->index   = NULL;
-   l->lock_fd = lock_fd;
+   struct lib *l = xcalloc(sizeof(struct lib));
+   l->n_units      = 0;
+   l->units        = NULL;
+   l->lookup       = hash_new(64, true);
+   l->name         = upcase_name(name);
+   l->index        = NULL;
+   l->index_lookup = hash_new(64, true);
+   l->lock_fd      = lock_fd;
 
    if (rpath == NULL)
       l->path[0] = '\0';
@@ -139,27 +390,7 @@ static lib_t lib_init(const char *name, const char *rpath, int lock_fd)
       file_read_lock(l->lock_fd);
    }
 
-   fbuf_t *f = lib_fbuf_open(l, "_index", FBUF_IN);
-   if (f != NULL) {
-      ident_rd_ctx_t ictx = ident_read_begin(f);
-
-      const int entries = read_u32(f);
-      for (int i = 0; i < entries; i++) {
-         ident_t name = ident_read(ictx);
-         tree_kind_t kind = read_u16(f);
-         assert(kind < T_LAST_TREE_KIND);
-
-         lib_index_t *in = xmalloc(sizeof(lib_index_t));
-         in->name = name;
-         in->kind = kind;
-         in->next = l->index;
-
-         l->index = in;
-      }
-
-      ident_read_end(ictx);
-      fbuf_close(f);
-   }
+   lib_read_index(l);
 
    if (l->lock_fd != -1)
       file_unlock(l->lock_fd);
@@ -167,17 +398,6 @@ static lib_t lib_init(const char *name, const char *rpath, int lock_fd)
    return l;
 }
 
-static lib_index_t *lib_find_in_index(lib_t lib, ident_t name)
-{
-   lib_index_t *it;
-   for (it = lib->index;
-        (it != NULL) && (it->name != name);
-        it = it->next)
-      ;
-
-   return it;
-}
-
 static lib_unit_t *lib_put_aux(lib_t lib, tree_t unit,
                                tree_rd_ctx_t ctx, bool dirty,
                                lib_mtime_t mtime)
@@ -185,45 +405,43 @@ static lib_unit_t *lib_put_aux(lib_t lib, tree_t unit,
    assert(lib != NULL);
    assert(unit != NULL);
 
-   lib_unit_t *where = NULL;
    ident_t name = tree_ident(unit);
-
-   for (unsigned i = 0; (where == NULL) && (i < lib->n_units); i++) {
-      if (tree_ident(lib->units[i].top) == tree_ident(unit))
-         where = &(lib->units[i]);
-   }
+   lib_unit_t *where = hash_get(lib->lookup, name);
 
    if (where == NULL) {
       if (lib->n_units == 0) {
          lib->units_alloc = 16;
-         lib->units = xmalloc(sizeof(lib_unit_t) * lib->units_alloc);
+         lib->units = xmalloc(sizeof(lib_unit_t *) * lib->units_alloc);
       }
       else if (lib->n_units == lib->units_alloc) {
          lib->units_alloc *= 2;
          lib->units = xrealloc(lib->units,
-                               sizeof(lib_unit_t) * lib->units_alloc);
+                               sizeof(lib_unit_t *) * lib->units_alloc);
       }
 
-      where = &(lib->units[lib->n_units++]);
+      where = xmalloc(sizeof(lib_unit_t));
+      lib->units[lib->n_units++] = where;
+      hash_put(lib->lookup, name, where);
    }
 
    where->top      = unit;
    where->read_ctx = ctx;
    where->dirty    = dirty;
+   where->checked  = false;
    where->mtime    = mtime;
    where->kind     = tree_kind(unit);
 
    lib_index_t *it = lib_find_in_index(lib, name);
-   if (it == NULL) {
-      lib_index_t *new = xmalloc(sizeof(lib_index_t));
-      new->name = name;
-      new->kind = tree_kind(unit);
-      new->next = lib->index;
-
-      lib->index = new;
+   if (it == NULL)
+      it = lib_add_to_index(lib, name, tree_kind(unit), true);
+   else if (it->kind != tree_kind(unit) || dirty)
+      it->dirty = true;
+
+   if (it->dirty) {
+      it->kind   = tree_kind(unit);
+      it->mtime  = mtime;
+      it->source = tree_loc(unit)->file;
    }
-   else
-      it->kind = tree_kind(unit);
 
    return where;
 }
@@ -423,6 +641,16 @@ const char *lib_enum_search_paths(void **token)
    }
 }
 
+lib_t lib_enum_loaded(void **token)
+{
+   lib_list_t *it = (*token == NULL) ? loaded : *token;
+   if (it == NULL || it == (void *)-1)
+      return NULL;
+
+   *token = (it->next == NULL) ? (void *)-1 : it->next;
+   return it->item;
+}
+
 void lib_add_search_path(const char *path)
 {
    lib_default_search_paths();
@@ -500,11 +728,37 @@ void lib_free(lib_t lib)
       }
    }
 
+   for (unsigned i = 0; i < lib->n_units; i++)
+      free(lib->units[i]);
    if (lib->units != NULL)
       free(lib->units);
+
+   for (lib_index_t *it = lib->index, *tmp; it != NULL; it = tmp) {
+      tmp = it->next;
+      free(it);
+   }
+
+   hash_free(lib->lookup);
+   hash_free(lib->index_lookup);
    free(lib);
 }
 
+void lib_reopen_lock(lib_t lib)
+{
+   // A lock taken with flock belongs to the open file description which
+   // is shared with the parent after fork so each worker process needs
+   // its own to exclude the others
+
+   if (lib->lock_fd == -1)
+      return;
+
+   close(lib->lock_fd);
+
+   const char *lock_path = lib_file_path(lib, "_NVC_LIB");
+   if ((lib->lock_fd = open(lock_path, O_RDONLY)) < 0)
+      fatal_errno("lib_reopen_lock: %s", lock_path);
+}
+
 void lib_destroy(lib_t lib)
 {
    // This is convenience function for testing: remove all
@@ -537,6 +791,19 @@ void lib_destroy(lib_t lib)
       perror("rmdir");
 }
 
+ident_table_t *lib_ident_table(lib_t lib)
+{
+   // Identifiers in unit and vcode files refer to a table shared by
+   // the whole library which is not freed as lazily read units may
+   // still need it
+   if (lib->path[0] == '\0')
+      return NULL;
+   else if (lib->idents == NULL)
+      lib->idents = ident_table_new(lib_file_path(lib, "_NVC_IDENTS"));
+
+   return lib->idents;
+}
+
 lib_t lib_work(void)
 {
    assert(work != NULL);
@@ -592,11 +859,10 @@ static lib_unit_t *lib_get_aux(lib_t lib, ident_t ident)
          ident = ident_prefix(lib->name, uname, '.');
    }
 
-   // Search in the list of already loaded units
-   for (unsigned n = 0; n < lib->n_units; n++) {
-      if (tree_ident(lib->units[n].top) == ident)
-         return &(lib->units[n]);
-   }
+   // Search in the table of already loaded units
+   lib_unit_t *lu = hash_get(lib->lookup, ident);
+   if (lu != NULL)
+      return lu;
 
    if (*(lib->path) == '\0')   // Temporary library
       return NULL;
@@ -604,33 +870,32 @@ static lib_unit_t *lib_get_aux(lib_t lib, ident_t ident)
    assert(lib->lock_fd != -1);   // Should not be called in unit tests
    file_read_lock(lib->lock_fd);
 
-   // Otherwise search in the filesystem
-   DIR *d = opendir(lib->path);
-   if (d == NULL)
-      fatal("%s: %s", lib->path, strerror(errno));
-
+   // Otherwise open the unit file directly by name
    lib_unit_t *unit = NULL;
-   const char *search = istr(ident);
-   struct dirent *e;
-   while ((e = readdir(d))) {
-      if (strcmp(e->d_name, search) == 0) {
-         fbuf_t *f = lib_fbuf_open(lib, e->d_name, FBUF_IN);
-         tree_rd_ctx_t ctx = tree_read_begin(f, lib_file_path(lib, e->d_name));
-         tree_t top = tree_read(ctx);
-         fbuf_close(f);
-
+   const char *name = istr(ident);
+   fbuf_t *f = lib_fbuf_open(lib, name, FBUF_IN);
+   if (f != NULL) {
+      tree_rd_ctx_t ctx = tree_read_begin(f, lib_file_path(lib, name),
+                                          lib_ident_table(lib));
+      tree_t top = tree_read(ctx);
+
+      // The index records when the unit was analysed which saves
+      // another round trip to the file system
+      lib_index_t *in = lib_find_in_index(lib, ident);
+      lib_mtime_t mt;
+      if (in != NULL && in->mtime != 0)
+         mt = in->mtime;
+      else {
          struct stat st;
-         if (stat(lib_file_path(lib, e->d_name), &st) < 0)
-            fatal_errno("%s", e->d_name);
-
-         lib_mtime_t mt = lib_stat_mtime(&st);
+         if (stat(lib_file_path(lib, name), &st) < 0)
+            fatal_errno("%s", name);
 
-         unit = lib_put_aux(lib, top, ctx, false, mt);
-         break;
+         mt = lib_stat_mtime(&st);
       }
+
+      unit = lib_put_aux(lib, top, ctx, false, mt);
    }
 
-   closedir(d);
    file_unlock(lib->lock_fd);
 
    if (unit == NULL && lib_find_in_index(lib, ident) != NULL)
@@ -642,6 +907,13 @@ static lib_unit_t *lib_get_aux(lib_t lib, ident_t ident)
 
 lib_mtime_t lib_mtime(lib_t lib, ident_t ident)
 {
+   // Avoid reading the unit just to find when it was analysed
+   if (hash_get(lib->lookup, ident) == NULL) {
+      lib_index_t *in = lib_find_in_index(lib, ident);
+      if (in != NULL && in->mtime != 0)
+         return in->mtime;
+   }
+
    lib_unit_t *lu = lib_get_aux(lib, ident);
    assert(lu != NULL);
    return lu->mtime;
@@ -682,14 +954,17 @@ tree_t lib_get_check_stale(lib_t lib, ident_t ident)
          lu->read_ctx = NULL;
       }
 
-      if (!opt_get_int("ignore-time")) {
+      if (!lu->checked && !opt_get_int("ignore-time")) {
          const loc_t *loc = tree_loc(lu->top);
 
-         struct stat st;
-         if (stat(istr(loc->file), &st) == 0 && lu->mtime < lib_stat_mtime(&st))
+         lib_mtime_t mt;
+         if (loc->file != NULL && lib_source_mtime(loc->file, &mt)
+             && lu->mtime < mt)
             fatal("design unit %s is older than its source file %s and must "
                   "be reanalysed\n(You can use the --ignore-time option to "
                   "skip this check)", istr(ident), istr(loc->file));
+
+         lu->checked = true;
       }
 
       return lu->top;
@@ -698,67 +973,198 @@ tree_t lib_get_check_stale(lib_t lib, ident_t ident)
       return NULL;
 }
 
+void lib_refresh(lib_t lib)
+{
+   // Forget units which another process has reanalysed since they
+   // were read and load any new ones so that a long running process
+   // sees the same library contents as a fresh one would
+
+   assert(lib != NULL);
+
+   if (*(lib->path) == '\0')   // Temporary library
+      return;
+
+   file_read_lock(lib->lock_fd);
+   lib_read_index(lib);
+   file_unlock(lib->lock_fd);
+
+   unsigned keep = 0;
+   for (unsigned i = 0; i < lib->n_units; i++) {
+      lib_unit_t *lu = lib->units[i];
+      ident_t name = tree_ident(lu->top);
+
+      lib_index_t *in = lib_find_in_index(lib, name);
+      if (lu->dirty || in == NULL || in->mtime <= lu->mtime) {
+         lib->units[keep++] = lu;
+         continue;
+      }
+
+      if (lu->read_ctx != NULL)
+         tree_read_end(lu->read_ctx);
+
+      hash_delete(lib->lookup, name);
+      free(lu);
+   }
+   lib->n_units = keep;
+
+   for (lib_index_t *it = lib->index; it != NULL; it = it->next) {
+      if (hash_get(lib->lookup, it->name) == NULL
+          && lib_stat(lib, istr(it->name), NULL))
+         (void)lib_get(lib, it->name);
+   }
+}
+
 ident_t lib_name(lib_t lib)
 {
    assert(lib != NULL);
    return lib->name;
 }
 
-void lib_save(lib_t lib)
+static void lib_write_unit(lib_t lib, lib_unit_t *lu, const char *tmp)
 {
-   assert(lib != NULL);
+   fbuf_t *f = lib_fbuf_open(lib, tmp, FBUF_OUT);
+   if (f == NULL)
+      fatal("failed to create %s in library %s",
+            istr(tree_ident(lu->top)), istr(lib->name));
+   tree_wr_ctx_t ctx = tree_write_begin(f, lib_ident_table(lib));
+   tree_write(lu->top, ctx);
+   tree_write_end(ctx);
+   fbuf_close(f);
+}
 
-   assert(lib->lock_fd != -1);   // Should not be called in unit tests
-   file_write_lock(lib->lock_fd);
+static void lib_save_start(lib_t lib, bool background)
+{
+   assert(lib != NULL);
+   assert(lib->save_tmp == NULL);
 
+   lib_unit_t **dirty LOCAL = xmalloc(sizeof(lib_unit_t *) * lib->n_units);
+   unsigned n_dirty = 0;
    for (unsigned n = 0; n < lib->n_units; n++) {
-      if (lib->units[n].dirty) {
-         const char *name = istr(tree_ident(lib->units[n].top));
-         fbuf_t *f = lib_fbuf_open(lib, name, FBUF_OUT);
-         if (f == NULL)
-            fatal("failed to create %s in library %s", name, istr(lib->name));
-         tree_wr_ctx_t ctx = tree_write_begin(f);
-         tree_write(lib->units[n].top, ctx);
-         tree_write_end(ctx);
-         fbuf_close(f);
-
-         lib->units[n].dirty = false;
+      if (lib->units[n]->dirty)
+         dirty[n_dirty++] = lib->units[n];
+   }
+
+   if (n_dirty == 0)
+      return;
+
+   // Each unit is written to a temporary file which is renamed into
+   // place by lib_save_end under the library lock so that any existing
+   // mapping of the old file by a lazy reader remains valid
+   lib->save_names = xmalloc(sizeof(ident_t) * n_dirty);
+   lib->save_tmp   = xmalloc(sizeof(char *) * n_dirty);
+   lib->n_save_tmp = n_dirty;
+   for (unsigned i = 0; i < n_dirty; i++) {
+      lib->save_names[i] = tree_ident(dirty[i]->top);
+      lib->save_tmp[i] = xasprintf("%s.%d.tmp", istr(lib->save_names[i]),
+                                   getpid());
+   }
+
+#ifndef __MINGW32__
+   if (background) {
+      // Tree serialisation is not thread safe so the units are written
+      // by forked children which see a snapshot of the trees at this
+      // point and the caller can carry on with code generation
+      const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+      unsigned nwriters = MIN(n_dirty, MAX_SAVE_WRITERS);
+      if (ncpu > 0 && (unsigned)ncpu < nwriters)
+         nwriters = ncpu;
+
+      lib->save_pids = xmalloc(sizeof(pid_t) * nwriters);
+
+      fflush(stdout);
+      fflush(stderr);
+
+      for (unsigned k = 0; k < nwriters; k++) {
+         const pid_t pid = fork();
+         if (pid == 0) {
+            for (unsigned i = k; i < n_dirty; i += nwriters)
+               lib_write_unit(lib, dirty[i], lib->save_tmp[i]);
+            _exit(EXIT_SUCCESS);
+         }
+         else if (pid < 0)
+            fatal_errno("fork");
+
+         lib->save_pids[lib->n_save_pids++] = pid;
       }
    }
+   else
+#endif  // __MINGW32__
+   {
+      for (unsigned i = 0; i < n_dirty; i++)
+         lib_write_unit(lib, dirty[i], lib->save_tmp[i]);
+   }
 
-   lib_index_t *it;
-   int index_sz = 0;
-   for (it = lib->index; it != NULL; it = it->next, ++index_sz)
-      ;
+   for (unsigned i = 0; i < n_dirty; i++)
+      dirty[i]->dirty = false;
+}
 
-   fbuf_t *f = lib_fbuf_open(lib, "_index", FBUF_OUT);
-   if (f == NULL)
-      fatal("failed to create library %s index", istr(lib->name));
+void lib_save_begin(lib_t lib)
+{
+   lib_save_start(lib, true);
+}
 
-   ident_wr_ctx_t ictx = ident_write_begin(f);
+void lib_save_end(lib_t lib)
+{
+   assert(lib != NULL);
+
+#ifndef __MINGW32__
+   bool failed = false;
+   for (unsigned i = 0; i < lib->n_save_pids; i++) {
+      int status;
+      while (waitpid(lib->save_pids[i], &status, 0) < 0) {
+         if (errno != EINTR)
+            fatal_errno("waitpid");
+      }
 
-   write_u32(index_sz, f);
-   for (it = lib->index; it != NULL; it = it->next) {
-      ident_write(it->name, ictx);
-      write_u16(it->kind, f);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+         failed = true;
    }
 
-   ident_write_end(ictx);
-   fbuf_close(f);
+   free(lib->save_pids);
+   lib->save_pids = NULL;
+   lib->n_save_pids = 0;
+
+   if (failed)
+      fatal("failed to write units to library %s", istr(lib->name));
+#endif  // __MINGW32__
+
+   assert(lib->lock_fd != -1);   // Should not be called in unit tests
+   file_write_lock(lib->lock_fd);
+
+   for (unsigned i = 0; i < lib->n_save_tmp; i++) {
+      char *tmp_path LOCAL = xstrdup(lib_file_path(lib, lib->save_tmp[i]));
+      const char *path = lib_file_path(lib, istr(lib->save_names[i]));
+#ifdef __MINGW32__
+      (void)remove(path);
+#endif
+      if (rename(tmp_path, path) != 0)
+         fatal_errno("failed to rename %s", tmp_path);
+
+      free(lib->save_tmp[i]);
+   }
+
+   free(lib->save_tmp);
+   free(lib->save_names);
+   lib->save_tmp = NULL;
+   lib->save_names = NULL;
+   lib->n_save_tmp = 0;
+
+   lib_write_index(lib);
    file_unlock(lib->lock_fd);
 }
 
+void lib_save(lib_t lib)
+{
+   lib_save_start(lib, false);
+   lib_save_end(lib);
+}
+
 int lib_index_kind(lib_t lib, ident_t ident)
 {
    assert(lib != NULL);
 
-   lib_index_t *it;
-   for (it = lib->index; it != NULL; it = it->next) {
-      if (it->name == ident)
-         return it->kind;
-   }
-
-   return T_LAST_TREE_KIND;
+   lib_index_t *it = lib_find_in_index(lib, ident);
+   return it == NULL ? T_LAST_TREE_KIND : it->kind;
 }
 
 void lib_walk_index(lib_t lib, lib_index_fn_t fn, void *context)
@@ -774,11 +1180,7 @@ unsigned lib_index_size(lib_t lib)
 {
    assert(lib != NULL);
 
-   unsigned n = 0;
-   for (lib_index_t *it = lib->index; it != NULL; it = it->next)
-      n++;
-
-   return n;
+   return lib->index_sz;
 }
 
 void lib_realpath(lib_t lib, const char *name, char *buf, size_t buflen)
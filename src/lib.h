@@ -36,13 +36,19 @@ lib_t lib_tmp(const char *name);
 void lib_free(lib_t lib);
 FILE *lib_fopen(lib_t lib, const char *name, const char *mode);
 fbuf_t *lib_fbuf_open(lib_t lib, const char *name, fbuf_mode_t mode);
+ident_table_t *lib_ident_table(lib_t lib);
 const char *lib_path(lib_t lib);
 void lib_realpath(lib_t lib, const char *name, char *buf, size_t buflen);
 void lib_destroy(lib_t lib);
 ident_t lib_name(lib_t lib);
 void lib_save(lib_t lib);
+void lib_save_begin(lib_t lib);
+void lib_save_end(lib_t lib);
+void lib_reopen_lock(lib_t lib);
+void lib_refresh(lib_t lib);
 void lib_mkdir(lib_t lib, const char *name);
 const char *lib_enum_search_paths(void **token);
+lib_t lib_enum_loaded(void **token);
 void lib_add_search_path(const char *path);
 bool lib_stat(lib_t lib, const char *name, lib_mtime_t *mt);
 void lib_add_map(const char *name, const char *path);
@@ -38,7 +38,8 @@ typedef enum {
    INSTANCE_NAME
 } name_attr_t;
 
-#define MAX_CASE_ARCS 32
+#define MAX_CASE_ARCS  32
+#define CONST_DATA_MIN 64
 
 typedef struct case_arc   case_arc_t;
 typedef struct case_state case_state_t;
@@ -80,6 +81,7 @@ static const char  *verbose = NULL;
 static bool         tmp_alloc_used = false;
 static lower_mode_t mode = LOWER_NORMAL;
 static hash_t      *vcode_objs = NULL;
+static tree_t       top_proc = NULL;
 
 static vcode_reg_t lower_expr(tree_t expr, expr_ctx_t ctx);
 static vcode_reg_t lower_reify_expr(tree_t expr);
@@ -1407,13 +1409,24 @@ static vcode_reg_t *lower_string_literal_chars(tree_t lit, int *nchars)
 
 static vcode_reg_t lower_string_literal(tree_t lit, bool allocate)
 {
-   int nchars;
-   vcode_reg_t *tmp LOCAL = lower_string_literal_chars(lit, &nchars);
-
    type_t type = tree_type(lit);
+
+   int nchars = tree_chars(lit);
+   vcode_reg_t *tmp LOCAL = NULL;
+   int64_t *chars LOCAL = NULL;
+   if (nchars >= CONST_DATA_MIN) {
+      chars = xmalloc(nchars * sizeof(int64_t));
+      for (int i = 0; i < nchars; i++)
+         chars[i] = tree_pos(tree_ref(tree_char(lit, i)));
+   }
+   else
+      tmp = lower_string_literal_chars(lit, &nchars);
+
    if (type_is_array(type) && !lower_const_bounds(type)) {
       vcode_type_t base = vtype_pointer(lower_type(type_elem(type)));
-      vcode_reg_t data = emit_const_array(base, tmp, nchars, allocate);
+      vcode_reg_t data = chars
+         ? emit_const_data(base, chars, nchars, allocate)
+         : emit_const_array(base, tmp, nchars, allocate);
       if (type_is_unconstrained(type)) {
          // Will occur with overridden generic strings
          vcode_dim_t dim0 = {
@@ -1426,6 +1439,8 @@ static vcode_reg_t lower_string_literal(tree_t lit, bool allocate)
       else
          return lower_wrap(type, data);
    }
+   else if (chars != NULL)
+      return emit_const_data(lower_type(type), chars, nchars, allocate);
    else
       return emit_const_array(lower_type(type), tmp, nchars, allocate);
 }
@@ -2050,6 +2065,151 @@ static vcode_reg_t *lower_const_array_aggregate(tree_t t, type_t type,
    return vals;
 }
 
+static bool lower_const_scalar(tree_t value, int64_t *result)
+{
+   switch (tree_kind(value)) {
+   case T_LITERAL:
+      if (tree_subkind(value) != L_INT)
+         return false;
+      *result = tree_ival(value);
+      return true;
+
+   case T_REF:
+      {
+         tree_t decl = tree_ref(value);
+         if (tree_kind(decl) != T_ENUM_LIT)
+            return false;
+         *result = tree_pos(decl);
+         return true;
+      }
+
+   default:
+      return false;
+   }
+}
+
+static int64_t *lower_const_array_data(tree_t t, type_t type, int *n_elems)
+{
+   // Fold an aggregate of integer or enumeration literals directly to
+   // values without creating a register for each element. Follows
+   // the same rules as lower_const_array_aggregate and returns NULL if
+   // any element is not a simple literal.
+
+   if ((*n_elems = lower_array_const_size(type)) == 0)
+      return NULL;
+
+   int64_t *vals = xmalloc(*n_elems * sizeof(int64_t));
+   bool *set LOCAL = xcalloc(*n_elems * sizeof(bool));
+
+   range_t r = range_of(type, 0);
+   const int64_t left = assume_int(r.left);
+   const bool is_downto = (r.kind == RANGE_DOWNTO);
+
+   const int nassocs = tree_assocs(t);
+   for (int i = 0; i < nassocs; i++) {
+      tree_t a = tree_assoc(t, i);
+      tree_t value = tree_value(a);
+
+      int64_t tmp;
+      int64_t *sub = &tmp;
+      int nsub = 1;
+      bool ok = true;
+      switch (tree_kind(value)) {
+      case T_AGGREGATE:
+         {
+            type_t sub_type = tree_type(value);
+            if (!type_is_array(sub_type)
+                || !(sub = lower_const_array_data(value, sub_type, &nsub)))
+               ok = false;
+         }
+         break;
+
+      case T_LITERAL:
+         if (tree_subkind(value) == L_STRING) {
+            nsub = tree_chars(value);
+            sub = xmalloc(MAX(nsub, 1) * sizeof(int64_t));
+            for (int j = 0; j < nsub; j++)
+               sub[j] = tree_pos(tree_ref(tree_char(value, j)));
+         }
+         else
+            ok = lower_const_scalar(value, &tmp);
+         break;
+
+      default:
+         ok = lower_const_scalar(value, &tmp);
+         break;
+      }
+
+      if (!ok) {
+         free(vals);
+         return NULL;
+      }
+
+      switch (tree_subkind(a)) {
+      case A_POS:
+         memcpy(vals + (i * nsub), sub, nsub * sizeof(int64_t));
+         memset(set + (i * nsub), true, nsub);
+         break;
+
+      case A_NAMED:
+         {
+            const int64_t name = assume_int(tree_name(a));
+            const int64_t off  = is_downto ? left - name : name - left;
+            memcpy(vals + (off * nsub), sub, nsub * sizeof(int64_t));
+            memset(set + (off * nsub), true, nsub);
+         }
+         break;
+
+      case A_OTHERS:
+         assert((*n_elems % nsub) == 0);
+         for (int j = 0; j < (*n_elems / nsub); j++) {
+            if (!set[j * nsub]) {
+               memcpy(vals + (j * nsub), sub, nsub * sizeof(int64_t));
+               memset(set + (j * nsub), true, nsub);
+            }
+         }
+         break;
+
+      case A_RANGE:
+         {
+            int64_t r_low, r_high;
+            range_bounds(tree_range(a, 0), &r_low, &r_high);
+
+            for (int64_t j = r_low; j <= r_high; j++) {
+               const int64_t off = is_downto ? left - j : j - left;
+               memcpy(vals + (off * nsub), sub, nsub * sizeof(int64_t));
+               memset(set + (off * nsub), true, nsub);
+            }
+         }
+         break;
+      }
+
+      if (sub != &tmp)
+         free(sub);
+   }
+
+   for (int i = 0; i < *n_elems; i++)
+      assert(set[i]);
+
+   return vals;
+}
+
+static vcode_reg_t lower_const_array(tree_t expr, type_t type, bool allocate)
+{
+   // Large tables such as ROM contents are emitted as raw data
+
+   int nvals;
+   if (lower_array_const_size(type) >= CONST_DATA_MIN) {
+      int64_t *data LOCAL = lower_const_array_data(expr, type, &nvals);
+      if (data != NULL)
+         return emit_const_data(lower_type(type), data, nvals, allocate);
+   }
+
+   vcode_reg_t *values LOCAL =
+      lower_const_array_aggregate(expr, type, 0, &nvals);
+   return emit_const_array(lower_type(type), values, nvals, allocate);
+}
+
 static int lower_bit_width(type_t type)
 {
    switch (type_kind(type)) {
@@ -2342,12 +2502,8 @@ static vcode_reg_t lower_record_aggregate(tree_t expr, bool nest,
             v = lower_string_literal(value, false);
          else if (mode == LOWER_THUNK && !lower_const_bounds(value_type))
             v = emit_undefined(lower_type(value_type));
-         else {
-            int nvals;
-            vcode_reg_t *values LOCAL =
-               lower_const_array_aggregate(value, value_type, 0, &nvals);
-            v = emit_const_array(lower_type(value_type), values, nvals, false);
-         }
+         else
+            v = lower_const_array(value, value_type, false);
       }
       else if (type_is_record(value_type) && is_const)
          v = lower_record_aggregate(value, true, true, ctx);
@@ -2425,13 +2581,8 @@ static vcode_reg_t lower_aggregate(tree_t expr, expr_ctx_t ctx)
 
    assert(type_is_array(type));
 
-   if (lower_const_bounds(type) && lower_is_const(expr)) {
-      int nvals;
-      vcode_reg_t *values LOCAL =
-         lower_const_array_aggregate(expr, type, 0, &nvals);
-
-      return emit_const_array(lower_type(type), values, nvals, true);
-   }
+   if (lower_const_bounds(type) && lower_is_const(expr))
+      return lower_const_array(expr, type, true);
    else
       return lower_dyn_aggregate(expr, type);
 }
@@ -3025,7 +3176,120 @@ static bool lower_signal_sequential_nets(tree_t decl)
    return (i == nnets) && (nnets > 0);
 }
 
-static void lower_sched_event(tree_t on, bool is_static)
+static bool lower_is_ref_to(tree_t expr, tree_t decl)
+{
+   return tree_kind(expr) == T_REF && tree_ref(expr) == decl;
+}
+
+static uint32_t lower_edge_mask(tree_t expr, tree_t decl)
+{
+   // Set of enumeration positions the new value of scalar signal decl
+   // must be in for expr to be true or all ones if this is not known
+
+   if (tree_kind(expr) != T_FCALL)
+      return UINT32_MAX;
+
+   tree_t fdecl = tree_ref(expr);
+   const int nparams = tree_params(expr);
+   ident_t builtin = tree_attr_str(fdecl, builtin_i);
+
+   if (builtin != NULL && nparams == 2) {
+      tree_t left  = tree_value(tree_param(expr, 0));
+      tree_t right = tree_value(tree_param(expr, 1));
+
+      unsigned pos;
+      if (icmp(builtin, "and"))
+         return lower_edge_mask(left, decl) & lower_edge_mask(right, decl);
+      else if (!icmp(builtin, "eq"))
+         return UINT32_MAX;
+      else if (lower_is_ref_to(left, decl) && folded_enum(right, &pos))
+         return (pos < 32) ? (1u << pos) : UINT32_MAX;
+      else if (lower_is_ref_to(right, decl) && folded_enum(left, &pos))
+         return (pos < 32) ? (1u << pos) : UINT32_MAX;
+      else
+         return UINT32_MAX;
+   }
+   else if (builtin == NULL && nparams == 1) {
+      if (!lower_is_ref_to(tree_value(tree_param(expr, 0)), decl))
+         return UINT32_MAX;
+
+      ident_t name = tree_ident(fdecl);
+      ident_t tname = type_ident(type_base_recur(tree_type(decl)));
+
+      if (tname == std_ulogic_i) {
+         if (icmp(name, "IEEE.STD_LOGIC_1164.RISING_EDGE"))
+            return (1 << 3) | (1 << 7);   // '1' or 'H'
+         else if (icmp(name, "IEEE.STD_LOGIC_1164.FALLING_EDGE"))
+            return (1 << 2) | (1 << 6);   // '0' or 'L'
+      }
+      else if (tname == std_bit_i) {
+         if (icmp(name, "IEEE.NUMERIC_BIT.RISING_EDGE"))
+            return 1 << 1;
+         else if (icmp(name, "IEEE.NUMERIC_BIT.FALLING_EDGE"))
+            return 1 << 0;
+      }
+   }
+
+   return UINT32_MAX;
+}
+
+static void lower_impure_call_fn(tree_t t, void *ctx)
+{
+   if (tree_flags(tree_ref(t)) & TREE_F_IMPURE)
+      *(bool *)ctx = true;
+}
+
+static uint32_t lower_cond_edge_mask(tree_t cond, tree_t decl)
+{
+   // Skipping the evaluation of an impure call would lose its effects
+   bool impure = false;
+   tree_visit_only(cond, lower_impure_call_fn, &impure, T_FCALL);
+
+   const uint32_t mask = impure ? UINT32_MAX : lower_edge_mask(cond, decl);
+   return (mask == 0) ? UINT32_MAX : mask;
+}
+
+static uint32_t lower_wait_edge_mask(tree_t wait, bool is_static)
+{
+   // A wait on a single scalar signal whose condition can only be true
+   // for some values of that signal need not wake the process for the
+   // other values. A process made of one if statement without an else
+   // followed by the wait for its sensitivity list is treated the same.
+
+   if (tree_triggers(wait) != 1)
+      return UINT32_MAX;
+
+   tree_t trigger = tree_trigger(wait, 0);
+   if (tree_kind(trigger) != T_REF)
+      return UINT32_MAX;
+
+   tree_t decl = tree_ref(trigger);
+   const tree_kind_t kind = tree_kind(decl);
+   if (kind != T_SIGNAL_DECL && kind != T_PORT_DECL)
+      return UINT32_MAX;
+
+   type_t base = type_base_recur(tree_type(decl));
+   if (type_kind(base) != T_ENUM
+       || type_enum_literals(base) > 32 - SCHED_QUAL_SHIFT)
+      return UINT32_MAX;
+
+   if (tree_has_value(wait))
+      return lower_cond_edge_mask(tree_value(wait), decl);
+   else if (!is_static || top_proc == NULL || tree_stmts(top_proc) != 2
+            || tree_stmt(top_proc, 1) != wait)
+      return UINT32_MAX;
+
+   tree_t body = tree_stmt(top_proc, 0);
+   if (tree_kind(body) != T_IF || tree_else_stmts(body) > 0)
+      return UINT32_MAX;
+   else if (tree_attr_int(body, stmt_tag_i, -1) != -1
+            || tree_attr_int(tree_value(body), cond_tag_i, -1) != -1)
+      return UINT32_MAX;   // Coverage must see the condition evaluated
+
+   return lower_cond_edge_mask(tree_value(body), decl);
+}
+
+static void lower_sched_event(tree_t on, bool is_static, uint32_t mask)
 {
    tree_t ref = on, decl = NULL;
    while (decl == NULL) {
@@ -3049,7 +3313,7 @@ static void lower_sched_event(tree_t on, bool is_static)
 
    tree_kind_t kind = tree_kind(decl);
    if (kind == T_ALIAS) {
-      lower_sched_event(tree_value(decl), is_static);
+      lower_sched_event(tree_value(decl), is_static, UINT32_MAX);
       return;
    }
    else if (kind != T_SIGNAL_DECL && kind != T_PORT_DECL) {
@@ -3110,10 +3374,13 @@ static void lower_sched_event(tree_t on, bool is_static)
          n_elems = emit_const(vtype_offset(),1);
    }
 
-   const int flags =
+   int flags =
       (sequential ? SCHED_SEQUENTIAL : 0)
       | (is_static ? SCHED_STATIC : 0);
 
+   if (mask != UINT32_MAX && !array)
+      flags |= SCHED_QUALIFIED | (mask << SCHED_QUAL_SHIFT);
+
    emit_sched_event(nets, n_elems, flags);
 }
 
@@ -3129,9 +3396,11 @@ static void lower_wait(tree_t wait)
       vcode_select_block(0);
    }
 
+   const uint32_t mask = lower_wait_edge_mask(wait, is_static);
+
    const int ntriggers = tree_triggers(wait);
    for (int i = 0; i < ntriggers; i++)
-      lower_sched_event(tree_trigger(wait, i), is_static);
+      lower_sched_event(tree_trigger(wait, i), is_static, mask);
 
    if (is_static)
       vcode_select_block(active_bb);
@@ -3191,7 +3460,7 @@ static void lower_wait(tree_t wait)
       if (!is_static) {
          const int ntriggers = tree_triggers(wait);
          for (int i = 0; i < ntriggers; i++)
-            lower_sched_event(tree_trigger(wait, i), is_static);
+            lower_sched_event(tree_trigger(wait, i), is_static, mask);
       }
 
       emit_wait(resume, timeout_reg);
@@ -4918,7 +5187,7 @@ static void lower_driver_fn(tree_t t, void *_ctx)
    }
 }
 
-static void lower_process(tree_t proc, vcode_unit_t context)
+static vcode_unit_t lower_process(tree_t proc, vcode_unit_t context)
 {
    vcode_unit_t vu = emit_process(tree_ident(proc), context);
    emit_debug_info(tree_loc(proc));
@@ -4931,10 +5200,14 @@ static void lower_process(tree_t proc, vcode_unit_t context)
    vcode_block_t start_bb = emit_block();
    vcode_select_block(start_bb);
 
+   top_proc = proc;
+
    const int nstmts = tree_stmts(proc);
    for (int i = 0; i < nstmts; i++)
       lower_stmt(tree_stmt(proc, i), NULL);
 
+   top_proc = NULL;
+
    if (!vcode_block_finished())
       emit_jump(start_bb);
 
@@ -4942,9 +5215,10 @@ static void lower_process(tree_t proc, vcode_unit_t context)
    emit_return(VCODE_INVALID_REG);
 
    lower_finished();
+   return vu;
 }
 
-static vcode_unit_t lower_elab(tree_t unit)
+static vcode_unit_t lower_elab_context(tree_t unit)
 {
    vcode_unit_t context = emit_context(tree_ident(unit));
    emit_debug_info(tree_loc(unit));
@@ -4954,6 +5228,12 @@ static vcode_unit_t lower_elab(tree_t unit)
    emit_return(VCODE_INVALID_REG);
 
    lower_finished();
+   return context;
+}
+
+static vcode_unit_t lower_elab(tree_t unit)
+{
+   vcode_unit_t context = lower_elab_context(unit);
 
    const int nstmts = tree_stmts(unit);
    for (int i = 0; i < nstmts; i++) {
@@ -5033,6 +5313,41 @@ vcode_unit_t lower_unit(tree_t unit)
    return context;
 }
 
+vcode_unit_t lower_elab_begin(tree_t unit)
+{
+   assert(tree_kind(unit) == T_ELAB);
+
+   lower_set_verbose();
+
+   vcode_objs = hash_new(4096, true);
+   mode = LOWER_NORMAL;
+   tmp_alloc_used = false;
+
+   vcode_unit_t context = lower_elab_context(unit);
+   vcode_close();
+
+   return context;
+}
+
+vcode_unit_t lower_elab_process(tree_t proc, vcode_unit_t context)
+{
+   assert(vcode_objs != NULL);
+   assert(tree_kind(proc) == T_PROCESS);
+
+   vcode_unit_t vu = lower_process(proc, context);
+   vcode_close();
+
+   return vu;
+}
+
+void lower_elab_end(void)
+{
+   assert(vcode_objs != NULL);
+
+   hash_free(vcode_objs);
+   vcode_objs = NULL;
+}
+
 vcode_unit_t lower_thunk(tree_t expr)
 {
    lower_set_verbose();
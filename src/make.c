@@ -18,6 +18,7 @@
 #include "common.h"
 #include "phase.h"
 #include "util.h"
+#include "hash.h"
 
 #include <limits.h>
 #include <unistd.h>
@@ -29,6 +30,10 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifndef __MINGW32__
+#include <sys/wait.h>
+#endif
+
 typedef enum {
    MAKE_TREE,
    MAKE_LIB,
@@ -53,18 +58,18 @@ struct rule {
    ident_t       source;
 };
 
-static ident_t make_tag_i;
+static ident_t       make_tag_i;
+static ident_list_t *make_missing_libs;
 
 static lib_t make_get_lib(ident_t name)
 {
    return lib_find(ident_until(name, '.'), true);
 }
 
-static const char *make_product(tree_t t, make_product_t product)
+static const char *make_product_name(ident_t name, make_product_t product)
 {
    char *buf = get_fmt_buf(PATH_MAX);
 
-   ident_t name = tree_ident(t);
    lib_t lib = make_get_lib(name);
 
    const char *path = lib_path(lib);
@@ -101,6 +106,11 @@ static const char *make_product(tree_t t, make_product_t product)
    return buf;
 }
 
+static const char *make_product(tree_t t, make_product_t product)
+{
+   return make_product_name(tree_ident(t), product);
+}
+
 static void make_rule_add_input(rule_t *r, const char *input)
 {
    ident_t ident = ident_new(input);
@@ -425,3 +435,469 @@ void make(tree_t *targets, int count, FILE *out)
 
    free(targets);
 }
+
+static bool make_scan_have_lib(ident_t name)
+{
+   if (ident_list_find(make_missing_libs, name))
+      return false;
+   else if (lib_find(name, false) == NULL) {
+      // Only report each missing library once
+      ident_list_push(&make_missing_libs, name);
+      return false;
+   }
+   else
+      return true;
+}
+
+static ident_t make_scan_qualify(ident_t name)
+{
+   // Map names from a use clause onto library names as analysis would
+   // and drop those which do not denote a unit in a library we can find
+
+   ident_t lname = ident_until(name, '.');
+   if (lname == name)
+      return NULL;
+   else if (lname == work_i)
+      return ident_prefix(lib_name(lib_work()), ident_from(name, '.'), '.');
+   else if (lname == lib_name(lib_work()))
+      return name;
+   else if (!make_scan_have_lib(lname))
+      return NULL;
+   else
+      return name;
+}
+
+static void make_scan_rule(tree_t t, rule_t **rules)
+{
+   const char *file = istr(tree_loc(t)->file);
+   rule_t *r = make_rule_for_source(rules, RULE_ANALYSE, file);
+   make_rule_add_input(r, file);
+   make_rule_add_output(r, make_product(t, MAKE_TREE));
+
+   const tree_kind_t kind = tree_kind(t);
+   ident_t work_name = lib_name(lib_work());
+
+   if (kind == T_ARCH || kind == T_CONFIGURATION) {
+      ident_t entity = ident_prefix(work_name, tree_ident2(t), '.');
+      make_rule_add_input(r, make_product_name(entity, MAKE_TREE));
+   }
+   else if (kind == T_PACK_BODY) {
+      ident_t pack = ident_until(tree_ident(t), '-');
+      make_rule_add_input(r, make_product_name(pack, MAKE_TREE));
+   }
+
+   if (kind != T_CONFIGURATION) {
+      const int nctx = tree_contexts(t);
+      for (int i = 0; i < nctx; i++) {
+         ident_t name = make_scan_qualify(tree_ident(tree_context(t, i)));
+         if (name != NULL)
+            make_rule_add_input(r, make_product_name(name, MAKE_TREE));
+      }
+   }
+
+   if (kind == T_ARCH) {
+      const int nstmts = tree_stmts(t);
+      for (int i = 0; i < nstmts; i++) {
+         ident_t name = make_scan_qualify(tree_ident2(tree_stmt(t, i)));
+         if (name != NULL)
+            make_rule_add_input(r, make_product_name(name, MAKE_TREE));
+      }
+   }
+
+   if (make_scan_have_lib(std_i))
+      make_rule_add_input(r, make_product_name(std_standard_i, MAKE_TREE));
+}
+
+static void make_scan_name(tree_t t)
+{
+   // Give the unit the name analysis would store it under
+
+   ident_t work_name = lib_name(lib_work());
+   ident_t name = tree_ident(t);
+
+   switch (tree_kind(t)) {
+   case T_ARCH:
+      {
+         ident_t entity = ident_prefix(work_name, tree_ident2(t), '.');
+         tree_set_ident(t, ident_prefix(entity, name, '-'));
+      }
+      break;
+
+   case T_PACK_BODY:
+      {
+         ident_t pack = ident_prefix(work_name, name, '.');
+         tree_set_ident(t, ident_prefix(pack, ident_new("body"), '-'));
+      }
+      break;
+
+   default:
+      tree_set_ident(t, ident_prefix(work_name, name, '.'));
+      break;
+   }
+}
+
+static tree_t *make_scan_files(const char **files, int count, int *nunits)
+{
+   int n = 0, maxunits = 16;
+   tree_t *units = xmalloc(maxunits * sizeof(tree_t));
+
+   for (int i = 0; i < count; i++) {
+      input_from_file(files[i]);
+
+      tree_t unit;
+      while ((unit = scan_unit())) {
+         make_scan_name(unit);
+         ARRAY_APPEND(units, unit, n, maxunits);
+      }
+   }
+
+   if (n == 0)
+      fatal("no design units found");
+
+   *nunits = n;
+   return units;
+}
+
+void make_scan(const char **files, int count, FILE *out)
+{
+   int nunits;
+   tree_t *units = make_scan_files(files, count, &nunits);
+
+   make_header(units, nunits, out);
+
+   rule_t *rules = NULL;
+   for (int i = 0; i < nunits; i++)
+      make_scan_rule(units[i], &rules);
+
+   make_print_rules(rules, out);
+   make_free_rules(rules);
+
+   if (!opt_get_int("make-deps-only"))
+      make_clean(units[0], out);
+
+   if (!opt_get_int("make-posix"))
+      fprintf(out, "\n-include local.mk\n");
+   else {
+      struct stat dummy;
+      if (stat("local.mk", &dummy) == 0)
+         fprintf(out, "\ninclude local.mk\n");
+   }
+
+   ident_list_free(make_missing_libs);
+   make_missing_libs = NULL;
+
+   free(units);
+}
+
+typedef struct build_job build_job_t;
+
+struct build_job {
+   rule_t       *rule;
+   build_job_t **waiters;
+   int           n_waiters;
+   int           max_waiters;
+   int           pending;
+   uint64_t      cost;
+   uint64_t      priority;
+   bool          visited;
+   bool          queued;
+   bool          rebuild;
+   bool          failed;
+   pid_t         pid;
+};
+
+static lib_mtime_t make_build_mtime(ident_t path, bool *exists)
+{
+   struct stat st;
+   if (stat(istr(path), &st) != 0) {
+      *exists = false;
+      return 0;
+   }
+
+   *exists = true;
+
+   lib_mtime_t mt = (lib_mtime_t)st.st_mtime * 1000 * 1000;
+#if defined HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC
+   mt += st.st_mtimespec.tv_nsec / 1000;
+#elif defined HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+   mt += st.st_mtim.tv_nsec / 1000;
+#endif
+   return mt;
+}
+
+static bool make_build_up_to_date(build_job_t *job)
+{
+   // A file needs analysing again if any unit it defines is missing
+   // from the library or older than one of its inputs
+
+   if (job->rebuild)
+      return false;
+
+   bool exists;
+   lib_mtime_t oldest = UINT64_MAX;
+   for (ident_list_t *it = job->rule->outputs; it != NULL; it = it->next) {
+      const lib_mtime_t mt = make_build_mtime(it->ident, &exists);
+      if (!exists)
+         return false;
+      oldest = MIN(oldest, mt);
+   }
+
+   for (ident_list_t *it = job->rule->inputs; it != NULL; it = it->next) {
+      if (make_build_mtime(it->ident, &exists) > oldest)
+         return false;
+   }
+
+   return true;
+}
+
+static uint64_t make_build_priority(build_job_t *job)
+{
+   // Length of the longest chain of dependent files weighted by their
+   // size which is a cheap estimate of the time to analyse them
+
+   if (job->visited)
+      return job->priority;
+
+   job->visited = true;
+
+   uint64_t longest = 0;
+   for (int i = 0; i < job->n_waiters; i++)
+      longest = MAX(longest, make_build_priority(job->waiters[i]));
+
+   return (job->priority = job->cost + longest);
+}
+
+static void make_build_preload(tree_t *units, int nunits)
+{
+   // Read the units used from other libraries before starting any
+   // jobs so each worker shares them rather than loading its own copy
+
+   lib_t work = lib_work();
+
+   for (int i = 0; i < nunits; i++) {
+      if (tree_kind(units[i]) == T_CONFIGURATION)
+         continue;
+
+      const int nctx = tree_contexts(units[i]);
+      for (int j = 0; j < nctx; j++) {
+         ident_t name = make_scan_qualify(tree_ident(tree_context(units[i], j)));
+         if (name == NULL)
+            continue;
+
+         lib_t lib = make_get_lib(name);
+         if (lib != work)
+            (void)lib_get(lib, name);
+      }
+   }
+
+   if (make_scan_have_lib(std_i))
+      (void)lib_get(lib_find(std_i, true), std_standard_i);
+}
+
+#ifndef __MINGW32__
+
+static void make_build_start(build_job_t *job, make_build_fn_t fn)
+{
+   fflush(stdout);
+   fflush(stderr);
+
+   const pid_t pid = fork();
+   if (pid == 0) {
+      lib_reopen_lock(lib_work());
+
+      const bool ok = (*fn)(istr(job->rule->source));
+
+      fflush(stdout);
+      fflush(stderr);
+      _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+   }
+   else if (pid < 0)
+      fatal_errno("fork");
+
+   job->pid = pid;
+}
+
+#endif  // __MINGW32__
+
+bool make_build(const char **files, int count, int max_jobs,
+                make_build_fn_t fn)
+{
+   int nunits;
+   tree_t *units = make_scan_files(files, count, &nunits);
+
+   if (parse_errors() > 0) {
+      free(units);
+      return false;
+   }
+
+   rule_t *rules = NULL;
+   for (int i = 0; i < nunits; i++)
+      make_scan_rule(units[i], &rules);
+
+   int njobs = 0;
+   for (rule_t *r = rules; r != NULL; r = r->next)
+      njobs++;
+
+   build_job_t *jobs = xcalloc(njobs * sizeof(build_job_t));
+   hash_t *producer = hash_new(njobs * 4, true);
+
+   // Rules are prepended as they are created so walk them backwards to
+   // give the jobs the order the files were given in
+   int n = njobs;
+   for (rule_t *r = rules; r != NULL; r = r->next) {
+      build_job_t *job = &(jobs[--n]);
+      job->rule        = r;
+      job->max_waiters = 4;
+      job->waiters     = xmalloc(job->max_waiters * sizeof(build_job_t *));
+
+      struct stat st;
+      job->cost = (stat(istr(r->source), &st) == 0) ? st.st_size : 1;
+
+      for (ident_list_t *it = r->outputs; it != NULL; it = it->next)
+         hash_put(producer, it->ident, job);
+   }
+
+   for (int i = 0; i < njobs; i++) {
+      build_job_t *job = &(jobs[i]);
+      for (ident_list_t *it = job->rule->inputs; it != NULL; it = it->next) {
+         build_job_t *dep = hash_get(producer, it->ident);
+         if (dep == NULL || dep == job)
+            continue;
+
+         bool duplicate = false;
+         for (int j = 0; j < dep->n_waiters && !duplicate; j++)
+            duplicate = (dep->waiters[j] == job);
+
+         if (!duplicate) {
+            ARRAY_APPEND(dep->waiters, job, dep->n_waiters, dep->max_waiters);
+            job->pending++;
+         }
+      }
+   }
+
+   for (int i = 0; i < njobs; i++)
+      make_build_priority(&(jobs[i]));
+
+   make_build_preload(units, nunits);
+
+#ifdef __MINGW32__
+   if (max_jobs > 1) {
+      warnf("parallel builds are not supported on this platform");
+      max_jobs = 1;
+   }
+#endif
+
+   build_job_t **ready = xmalloc(njobs * sizeof(build_job_t *));
+   build_job_t **running = xmalloc(max_jobs * sizeof(build_job_t *));
+   int n_ready = 0, n_running = 0, n_done = 0;
+
+   for (int i = 0; i < njobs; i++) {
+      if (jobs[i].pending == 0) {
+         jobs[i].queued = true;
+         ready[n_ready++] = &(jobs[i]);
+      }
+   }
+
+   bool ok = true;
+   while (n_done < njobs) {
+      if (n_ready == 0 && n_running == 0) {
+         // The remaining files depend on each other so analyse them in
+         // the order given
+         for (int i = 0; i < njobs && n_ready == 0; i++) {
+            if (!jobs[i].queued) {
+               jobs[i].queued = true;
+               ready[n_ready++] = &(jobs[i]);
+            }
+         }
+      }
+
+      while (n_ready > 0 && n_running < max_jobs) {
+         // Start whichever ready file heads the longest remaining chain
+         int best = 0;
+         for (int i = 1; i < n_ready; i++) {
+            if (ready[i]->priority > ready[best]->priority)
+               best = i;
+         }
+
+         build_job_t *job = ready[best];
+         ready[best] = ready[--n_ready];
+
+         // Anything depending on a file that failed is skipped
+         job->pid = 0;
+         if (!job->failed && !make_build_up_to_date(job)) {
+            job->rebuild = true;
+#ifndef __MINGW32__
+            if (max_jobs > 1)
+               make_build_start(job, fn);
+            else
+#endif
+            job->failed = !(*fn)(istr(job->rule->source));
+         }
+
+         running[n_running++] = job;
+      }
+
+      int index = -1;
+      for (int i = 0; i < n_running && index == -1; i++) {
+         if (running[i]->pid == 0)
+            index = i;
+      }
+
+#ifndef __MINGW32__
+      if (index == -1) {
+         int status;
+         const pid_t pid = wait(&status);
+         if (pid < 0)
+            fatal_errno("wait");
+
+         for (int i = 0; i < n_running && index == -1; i++) {
+            if (running[i]->pid == pid)
+               index = i;
+         }
+
+         if (index == -1)
+            continue;
+
+         if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            running[index]->failed = true;
+      }
+#endif
+
+      build_job_t *job = running[index];
+      running[index] = running[--n_running];
+      n_done++;
+
+      if (job->failed)
+         ok = false;
+
+      for (int i = 0; i < job->n_waiters; i++) {
+         build_job_t *w = job->waiters[i];
+         w->failed  = w->failed || job->failed;
+         w->rebuild = w->rebuild || job->rebuild;
+         if (--(w->pending) == 0 && !w->queued) {
+            w->queued = true;
+            ready[n_ready++] = w;
+         }
+      }
+   }
+
+   // Units saved by worker processes are not in the index read when
+   // the library was opened
+   if (max_jobs > 1)
+      lib_refresh(lib_work());
+
+   for (int i = 0; i < njobs; i++)
+      free(jobs[i].waiters);
+
+   free(ready);
+   free(running);
+   free(jobs);
+   hash_free(producer);
+   make_free_rules(rules);
+   free(units);
+
+   ident_list_free(make_missing_libs);
+   make_missing_libs = NULL;
+
+   return ok;
+}
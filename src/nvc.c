@@ -19,7 +19,9 @@
 #include "phase.h"
 #include "common.h"
 #include "vcode.h"
+#include "hash.h"
 #include "rt/rt.h"
+#include "rt/cover.h"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -28,6 +30,16 @@
 #include <ctype.h>
 #include <assert.h>
 
+#ifndef __MINGW32__
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#endif
+
 const char *copy_string =
    "Copyright (C) 2011-2018  Nick Gasson\n"
    "This program comes with ABSOLUTELY NO WARRANTY. This is free software, "
@@ -88,7 +100,8 @@ static unsigned parse_relax(const char *str)
 static int scan_cmd(int start, int argc, char **argv)
 {
    const char *commands[] = {
-      "-a", "-e", "-r", "--codegen", "--dump", "--make", "--syntax", "--list"
+      "-a", "-e", "-r", "--codegen", "--dump", "--make", "--syntax", "--list",
+      "--build", "--server", "--cover-merge"
    };
 
    for (int i = start; i < argc; i++) {
@@ -101,20 +114,347 @@ static int scan_cmd(int start, int argc, char **argv)
    return argc;
 }
 
+static int parse_int(const char *str)
+{
+   char *eptr = NULL;
+   int n = strtol(str, &eptr, 0);
+   if ((eptr == NULL) || (*eptr != '\0'))
+      fatal("invalid integer: %s", str);
+   return n;
+}
+
+static bool analyse_units(tree_t *units, int n_units)
+{
+   for (int i = 0; i < n_units; i++) {
+      // Delete any stale vcode to prevent problems in constant folding
+      char *vcode LOCAL = vcode_file_name(tree_ident(units[i]));
+      lib_delete(lib_work(), vcode);
+
+      simplify_check(units[i], 0);
+   }
+
+   if (parse_errors() + sem_errors() + bounds_errors() > 0)
+      return false;
+
+   // Units are written out in the background while code is generated
+   lib_save_begin(lib_work());
+
+   for (int i = 0; i < n_units; i++) {
+      const tree_kind_t kind = tree_kind(units[i]);
+      const bool need_cgen = kind == T_PACK_BODY
+         || (kind == T_PACKAGE && pack_needs_cgen(units[i]));
+      if (need_cgen) {
+         vcode_unit_t vu = lower_unit(units[i]);
+         char *name LOCAL = vcode_file_name(tree_ident(units[i]));
+         fbuf_t *fbuf = lib_fbuf_open(lib_work(), name, FBUF_OUT);
+         vcode_write(vu, fbuf, lib_ident_table(lib_work()));
+         fbuf_close(fbuf);
+         cgen(units[i], vu);
+      }
+   }
+
+   lib_save_end(lib_work());
+   return true;
+}
+
+static bool analyse_serial(char **files, int n_files)
+{
+   size_t unit_list_sz = 32;
+   tree_t *units LOCAL = xmalloc(sizeof(tree_t) * unit_list_sz);
+   int n_units = 0;
+
+   for (int i = 0; i < n_files; i++) {
+      input_from_file(files[i]);
+
+      tree_t unit;
+      while ((unit = parse()) && sem_check(unit))
+         ARRAY_APPEND(units, unit, n_units, unit_list_sz);
+   }
+
+   return analyse_units(units, n_units);
+}
+
+#ifndef __MINGW32__
+
+typedef struct analyse_job analyse_job_t;
+
+struct analyse_job {
+   const char     *file;
+   tree_t         *units;
+   int             n_units;
+   int             max_units;
+   analyse_job_t **waiters;
+   int             n_waiters;
+   int             max_waiters;
+   int             pending;
+   bool            queued;
+   bool            failed;
+   pid_t           pid;
+};
+
+typedef struct {
+   analyse_job_t *job;
+   hash_t        *defined;
+} analyse_dep_ctx_t;
+
+static ident_t analyse_work_unit(ident_t name)
+{
+   // Return the primary unit named by a selected name such as WORK.PKG
+   // or WORK.ENT-ARCH if it refers to the work library
+
+   ident_t uname = ident_from(name, '.');
+   if (uname == NULL)
+      return NULL;
+
+   ident_t lname = ident_until(name, '.');
+   if (lname != work_i && lname != lib_name(lib_work()))
+      return NULL;
+
+   return ident_until(ident_until(uname, '.'), '-');
+}
+
+static void analyse_add_dep(analyse_dep_ctx_t *ctx, ident_t name)
+{
+   // Units not defined by one of the files in this run must already be
+   // in a library and do not need to be waited for
+
+   analyse_job_t *dep = hash_get(ctx->defined, name);
+   if (dep == NULL || dep == ctx->job)
+      return;
+   else if (dep->n_waiters > 0 && dep->waiters[dep->n_waiters - 1] == ctx->job)
+      return;
+
+   ARRAY_APPEND(dep->waiters, ctx->job, dep->n_waiters, dep->max_waiters);
+   ctx->job->pending++;
+}
+
+static void analyse_instance_dep(tree_t t, void *context)
+{
+   const class_t class = tree_class(t);
+   if (class == C_ENTITY || class == C_CONFIGURATION) {
+      ident_t name = analyse_work_unit(tree_ident2(t));
+      if (name != NULL)
+         analyse_add_dep(context, name);
+   }
+}
+
+static void analyse_unit_deps(analyse_dep_ctx_t *ctx, tree_t unit)
+{
+   const int ncontexts = tree_contexts(unit);
+   for (int i = 0; i < ncontexts; i++) {
+      tree_t c = tree_context(unit, i);
+      const tree_kind_t kind = tree_kind(c);
+      if (kind == T_USE || kind == T_CTXREF) {
+         ident_t name = analyse_work_unit(tree_ident(c));
+         if (name != NULL)
+            analyse_add_dep(ctx, name);
+      }
+   }
+
+   switch (tree_kind(unit)) {
+   case T_ARCH:
+      analyse_add_dep(ctx, tree_ident2(unit));
+      tree_visit_only(unit, analyse_instance_dep, ctx, T_INSTANCE);
+      break;
+   case T_CONFIGURATION:
+      analyse_add_dep(ctx, tree_ident2(unit));
+      break;
+   case T_PACK_BODY:
+      analyse_add_dep(ctx, tree_ident(unit));
+      break;
+   default:
+      break;
+   }
+}
+
+static void analyse_start_job(analyse_job_t *job)
+{
+   fflush(stdout);
+   fflush(stderr);
+
+   const pid_t pid = fork();
+   if (pid == 0) {
+      lib_reopen_lock(lib_work());
+
+      int n_ok = 0;
+      while (n_ok < job->n_units && sem_check(job->units[n_ok]))
+         n_ok++;
+
+      const bool ok = analyse_units(job->units, n_ok);
+
+      fflush(stdout);
+      fflush(stderr);
+      _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+   }
+   else if (pid < 0)
+      fatal_errno("fork");
+
+   job->pid = pid;
+}
+
+static bool analyse_parallel(char **files, int n_files, int max_jobs)
+{
+   // Files are parsed up front to find the dependencies between them
+   // and then each is checked and saved by a separate worker process
+   // once all the files defining units it depends on are finished
+
+   analyse_job_t *jobs LOCAL = xcalloc(n_files * sizeof(analyse_job_t));
+   hash_t *defined = hash_new(n_files * 4, true);
+
+   for (int i = 0; i < n_files; i++) {
+      analyse_job_t *job = &(jobs[i]);
+      job->file        = files[i];
+      job->max_units   = 4;
+      job->units       = xmalloc(job->max_units * sizeof(tree_t));
+      job->max_waiters = 4;
+      job->waiters     = xmalloc(job->max_waiters * sizeof(analyse_job_t *));
+
+      input_from_file(files[i]);
+
+      tree_t unit;
+      while ((unit = parse())) {
+         ARRAY_APPEND(job->units, unit, job->n_units, job->max_units);
+
+         switch (tree_kind(unit)) {
+         case T_ENTITY:
+         case T_PACKAGE:
+         case T_CONFIGURATION:
+         case T_CONTEXT:
+            hash_put(defined, tree_ident(unit), job);
+            break;
+         default:
+            break;
+         }
+      }
+   }
+
+   if (parse_errors() > 0) {
+      hash_free(defined);
+      return false;
+   }
+
+   analyse_job_t **ready LOCAL = xmalloc(n_files * sizeof(analyse_job_t *));
+   analyse_job_t **running LOCAL = xmalloc(max_jobs * sizeof(analyse_job_t *));
+   int n_ready = 0, n_running = 0, n_done = 0;
+
+   for (int i = 0; i < n_files; i++) {
+      analyse_dep_ctx_t ctx = { &(jobs[i]), defined };
+      for (int j = 0; j < jobs[i].n_units; j++)
+         analyse_unit_deps(&ctx, jobs[i].units[j]);
+   }
+
+   // Queue in reverse so files without dependencies start in the order
+   // they were given
+   for (int i = n_files - 1; i >= 0; i--) {
+      if (jobs[i].pending == 0) {
+         jobs[i].queued = true;
+         ready[n_ready++] = &(jobs[i]);
+      }
+   }
+
+   bool ok = true;
+   while (n_done < n_files) {
+      if (n_ready == 0 && n_running == 0) {
+         // The remaining files depend on each other: fall back to
+         // analysing them in the order given as a serial run would
+         for (int i = 0; i < n_files && n_ready == 0; i++) {
+            if (!jobs[i].queued) {
+               jobs[i].queued = true;
+               ready[n_ready++] = &(jobs[i]);
+            }
+         }
+      }
+
+      while (n_ready > 0 && n_running < max_jobs) {
+         // Anything depending on a file that failed is skipped
+         analyse_job_t *job = ready[--n_ready];
+         if (!job->failed)
+            analyse_start_job(job);
+         running[n_running++] = job;
+      }
+
+      int index = -1;
+      for (int i = 0; i < n_running && index == -1; i++) {
+         if (running[i]->pid == 0)
+            index = i;
+      }
+
+      if (index == -1) {
+         int status;
+         const pid_t pid = wait(&status);
+         if (pid < 0)
+            fatal_errno("wait");
+
+         for (int i = 0; i < n_running && index == -1; i++) {
+            if (running[i]->pid == pid)
+               index = i;
+         }
+
+         if (index == -1)
+            continue;
+
+         if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            running[index]->failed = true;
+      }
+
+      analyse_job_t *job = running[index];
+      running[index] = running[--n_running];
+      n_done++;
+
+      if (job->failed)
+         ok = false;
+
+      for (int i = 0; i < job->n_waiters; i++) {
+         analyse_job_t *w = job->waiters[i];
+         w->failed = w->failed || job->failed;
+         if (--(w->pending) == 0 && !w->queued) {
+            w->queued = true;
+            ready[n_ready++] = w;
+         }
+      }
+   }
+
+   for (int i = 0; i < n_files; i++) {
+      free(jobs[i].units);
+      free(jobs[i].waiters);
+   }
+
+   hash_free(defined);
+
+   // The units were saved by the workers so the index must be read
+   // again before a following command can find them
+   lib_refresh(lib_work());
+
+   return ok;
+}
+
+#else  // __MINGW32__
+
+static bool analyse_parallel(char **files, int n_files, int max_jobs)
+{
+   warnf("parallel analysis is not supported on this platform");
+   return analyse_serial(files, n_files);
+}
+
+#endif  // __MINGW32__
+
 static int analyse(int argc, char **argv)
 {
    static struct option long_options[] = {
       { "bootstrap",       no_argument,       0, 'b' },
       { "dump-llvm",       no_argument,       0, 'D' },
       { "dump-vcode",      optional_argument, 0, 'v' },
+      { "jobs",            required_argument, 0, 'j' },
       { "prefer-explicit", no_argument,       0, 'p' },   // DEPRECATED
       { "relax",           required_argument, 0, 'R' },
       { 0, 0, 0, 0 }
    };
 
+   int jobs = 1;
+
    const int next_cmd = scan_cmd(2, argc, argv);
    int c, index = 0;
-   const char *spec = "";
+   const char *spec = "j:";
    while ((c = getopt_long(next_cmd, argv, spec, long_options, &index)) != -1) {
       switch (c) {
       case 0:
@@ -131,6 +471,10 @@ static int analyse(int argc, char **argv)
       case 'v':
          opt_set_str("dump-vcode", optarg ?: "");
          break;
+      case 'j':
+         if ((jobs = parse_int(optarg)) < 1)
+            fatal("invalid number of jobs: %s", optarg);
+         break;
       case 'p':
          warnf("the --prefer-explict option is deprecated: use "
                "--relax=prefer-explict instead");
@@ -144,46 +488,17 @@ static int analyse(int argc, char **argv)
       }
    }
 
-   size_t unit_list_sz = 32;
-   tree_t *units LOCAL = xmalloc(sizeof(tree_t) * unit_list_sz);
-   int n_units = 0;
-
-   for (int i = optind; i < next_cmd; i++) {
-      input_from_file(argv[i]);
-
-      tree_t unit;
-      while ((unit = parse()) && sem_check(unit))
-         ARRAY_APPEND(units, unit, n_units, unit_list_sz);
-   }
-
-   for (int i = 0; i < n_units; i++) {
-      // Delete any stale vcode to prevent problems in constant folding
-      char *vcode LOCAL = vcode_file_name(tree_ident(units[i]));
-      lib_delete(lib_work(), vcode);
+   const int n_files = next_cmd - optind;
 
-      simplify(units[i], 0);
-      bounds_check(units[i]);
-   }
+   bool ok;
+   if (jobs > 1 && n_files > 1)
+      ok = analyse_parallel(argv + optind, n_files, jobs);
+   else
+      ok = analyse_serial(argv + optind, n_files);
 
-   if (parse_errors() + sem_errors() + bounds_errors() > 0)
+   if (!ok)
       return EXIT_FAILURE;
 
-   lib_save(lib_work());
-
-   for (int i = 0; i < n_units; i++) {
-      const tree_kind_t kind = tree_kind(units[i]);
-      const bool need_cgen = kind == T_PACK_BODY
-         || (kind == T_PACKAGE && pack_needs_cgen(units[i]));
-      if (need_cgen) {
-         vcode_unit_t vu = lower_unit(units[i]);
-         char *name LOCAL = vcode_file_name(tree_ident(units[i]));
-         fbuf_t *fbuf = lib_fbuf_open(lib_work(), name, FBUF_OUT);
-         vcode_write(vu, fbuf);
-         fbuf_close(fbuf);
-         cgen(units[i], vu);
-      }
-   }
-
    argc -= next_cmd - 1;
    argv += next_cmd - 1;
 
@@ -244,15 +559,25 @@ static int elaborate(int argc, char **argv)
       { "dump-llvm",   no_argument,       0, 'd' },
       { "dump-vcode",  optional_argument, 0, 'v' },
       { "native",      no_argument,       0, 'n' },    // DEPRECATED
-      { "cover",       no_argument,       0, 'c' },
+      { "cover",       optional_argument, 0, 'c' },
+      { "cache",       no_argument,       0, 'C' },
+      { "jobs",        required_argument, 0, 'j' },
+      { "jit",         no_argument,       0, 'J' },
+      { "keep",        required_argument, 0, 'k' },
+      { "profile-use", required_argument, 0, 'u' },
+      { "prune",       no_argument,       0, 'p' },
+      { "tiered",      no_argument,       0, 'T' },
       { "verbose",     no_argument,       0, 'V' },
       { 0, 0, 0, 0 }
    };
 
+   // Keep patterns from an earlier command in a batch do not apply
+   prune_reset_keep();
+
    const int next_cmd = scan_cmd(2, argc, argv);
    bool verbose = false;
    int c, index = 0;
-   const char *spec = "Vg:O:";
+   const char *spec = "Vg:O:j:";
    while ((c = getopt_long(next_cmd, argv, spec, long_options, &index)) != -1) {
       switch (c) {
       case 'o':
@@ -278,7 +603,34 @@ static int elaborate(int argc, char **argv)
          warnf("--native is now a global option: place before the -e command");
          break;
       case 'c':
-         opt_set_int("cover", 1);
+         if (optarg == NULL || strcmp(optarg, "count") == 0)
+            opt_set_int("cover", COVER_COUNT);
+         else if (strcmp(optarg, "once") == 0)
+            opt_set_int("cover", COVER_ONCE);
+         else if (strcmp(optarg, "sample") == 0)
+            opt_set_int("cover", COVER_SAMPLE);
+         else
+            fatal("invalid coverage mode: %s (allowed count, once, sample)",
+                  optarg);
+         break;
+      case 'C':
+         opt_set_int("cgen-cache", 1);
+         break;
+      case 'J':
+         opt_set_int("jit", 1);
+         break;
+      case 'u':
+         opt_set_str("profile-use", optarg);
+         break;
+      case 'p':
+         opt_set_int("elab-prune", 1);
+         break;
+      case 'k':
+         prune_keep_glob(optarg);
+         break;
+      case 'T':
+         opt_set_int("jit", 1);
+         opt_set_int("jit-tiered", 1);
          break;
       case 'V':
          verbose = true;
@@ -287,6 +639,14 @@ static int elaborate(int argc, char **argv)
       case 'g':
          parse_generic(optarg);
          break;
+      case 'j':
+         {
+            const int jobs = parse_int(optarg);
+            if (jobs < 1)
+               fatal("invalid number of jobs: %s", optarg);
+            opt_set_int("cgen-jobs", jobs);
+         }
+         break;
       case 0:
          // Set a flag
          break;
@@ -299,6 +659,15 @@ static int elaborate(int argc, char **argv)
 
    set_top_level(argv, next_cmd);
 
+   if (opt_get_int("elab-prune")) {
+      if (opt_get_int("cover") != COVER_OFF) {
+         warnf("--prune has no effect with --cover");
+         opt_set_int("elab-prune", 0);
+      }
+      else
+         prune_keep_file(top_level_orig);
+   }
+
    elab_verbose(verbose, "initialising");
 
    tree_t unit = lib_get(lib_work(), top_level);
@@ -308,25 +677,59 @@ static int elaborate(int argc, char **argv)
 
    elab_verbose(verbose, "loading top-level unit");
 
+   if (opt_get_int("cgen-cache") && elab_up_to_date(unit)) {
+      elab_verbose(verbose, "reusing up to date design");
+
+      argc -= next_cmd - 1;
+      argv += next_cmd - 1;
+
+      return argc > 1 ? process_command(argc, argv) : EXIT_SUCCESS;
+   }
+
+   // Objects created during elaboration live until the process exits
+   // so allocate them from an arena rather than individually
+   tree_arena_t *arena = tree_arena_new();
+   tree_arena_push(arena);
+
    tree_t e = elab(unit);
-   if (e == NULL)
+   if (e == NULL) {
+      tree_arena_pop();
       return EXIT_FAILURE;
+   }
 
    elab_verbose(verbose, "elaborating design");
 
+   if (opt_get_int("elab-prune")) {
+      prune_design(e);
+      prune_reset_keep();
+      elab_verbose(verbose, "pruning unused signals");
+   }
+
    group_nets(e);
    elab_verbose(verbose, "grouping nets");
 
    // Save the library now so the code generator can attach temporary
-   // meta data to trees
-   lib_save(lib_work());
+   // meta data to trees: the writers see a snapshot taken at this point
+   // and run in the background while intermediate code is generated
+   lib_save_begin(lib_work());
+
+   // Each process is lowered and compiled in turn and its intermediate
+   // code freed before the next so only the top-level declarations are
+   // kept for the whole of code generation
+   const unsigned elided = vcode_checks_elided();
+   vcode_unit_t vu = lower_elab_begin(e);
+   cgen_streamed(e, vu);
+   lower_elab_end();
+   elab_verbose(verbose, "generating code (%u checks elided)",
+                vcode_checks_elided() - elided);
+
+   lib_save_end(lib_work());
    elab_verbose(verbose, "saving library");
 
-   vcode_unit_t vu = lower_unit(e);
-   elab_verbose(verbose, "generating intermediate code");
+   if (opt_get_int("cgen-cache"))
+      elab_save_deps(e);
 
-   cgen(e, vu);
-   elab_verbose(verbose, "generating LLVM");
+   tree_arena_pop();
 
    argc -= next_cmd - 1;
    argv += next_cmd - 1;
@@ -404,15 +807,6 @@ static uint64_t parse_time(const char *str)
    return base * mult;
 }
 
-static int parse_int(const char *str)
-{
-   char *eptr = NULL;
-   int n = strtol(str, &eptr, 0);
-   if ((eptr == NULL) || (*eptr != '\0'))
-      fatal("invalid integer: %s", str);
-   return n;
-}
-
 static rt_severity_t parse_severity(const char *str)
 {
    if (strcasecmp(str, "note") == 0)
@@ -427,19 +821,295 @@ static rt_severity_t parse_severity(const char *str)
       fatal("invalid severity level: %s", str);
 }
 
+#ifndef __MINGW32__
+
+typedef struct {
+   char      *name;
+   uint64_t   stop_time;
+   char      *plugins;
+   char     **forces;
+   int        n_forces;
+   int        max_forces;
+   pid_t      pid;
+   uint64_t   start_us;
+} batch_entry_t;
+
+static tree_t batch_find_signal(tree_t e, const char *name)
+{
+   // Names without a path are relative to the top-level entity
+
+   char *path LOCAL = NULL;
+   if (name[0] == ':')
+      path = xstrdup(name);
+   else
+      path = xasprintf("%s:%s", istr(tree_attr_str(e, simple_name_i)), name);
+
+   for (char *p = path; *p != '\0'; p++)
+      *p = tolower((int)*p);
+
+   ident_t id = ident_new(path);
+
+   const int ndecls = tree_decls(e);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(e, i);
+      if (tree_kind(d) == T_SIGNAL_DECL && tree_ident(d) == id)
+         return d;
+   }
+
+   fatal("no top-level signal %s", path);
+}
+
+static bool batch_enum_value(type_t type, const char *str, uint64_t *value)
+{
+   type_t base = type_base_recur(type);
+   if (!type_is_enum(base))
+      return false;
+
+   const int nlits = type_enum_literals(base);
+   for (int i = 0; i < nlits; i++) {
+      if (strcasecmp(istr(tree_ident(type_enum_literal(base, i))), str) == 0) {
+         *value = i;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static void batch_force(tree_t e, const char *force)
+{
+   char *name LOCAL = xstrdup(force);
+   char *str = strchr(name, '=');
+   *str++ = '\0';
+
+   tree_t s = batch_find_signal(e, name);
+   type_t type = tree_type(s);
+   const int nnets = tree_nets(s);
+
+   uint64_t *buf LOCAL = xcalloc(nnets * sizeof(uint64_t));
+
+   char *eptr = NULL;
+   if (type_is_scalar(type)) {
+      // An integer or enumeration literal such as TRUE or '1'
+      if (!batch_enum_value(type, str, &(buf[0]))) {
+         buf[0] = strtoll(str, &eptr, 0);
+         if (*str == '\0' || *eptr != '\0')
+            fatal("invalid value %s for signal %s", str, name);
+      }
+   }
+   else if (type_is_array(type) && (int)strlen(str) == nnets) {
+      // A string of character literals such as 0110 for a vector
+      type_t elem = type_elem(type);
+      for (int i = 0; i < nnets; i++) {
+         char lit[] = { '\'', str[i], '\'', '\0' };
+         if (!batch_enum_value(elem, lit, &(buf[i])))
+            fatal("invalid value %s for signal %s", str, name);
+      }
+   }
+   else
+      fatal("cannot force signal %s of type %s to %s", name,
+            type_pp(type), str);
+
+   if (!rt_force_signal(s, buf, nnets, true))
+      fatal("cannot force signal %s", name);
+}
+
+static void batch_start_entry(tree_t e, batch_entry_t *entry)
+{
+   fflush(stdout);
+   fflush(stderr);
+
+   entry->start_us = get_timestamp_us();
+
+   const pid_t pid = fork();
+   if (pid == 0) {
+      // The child shares the design set up by the parent copy-on-write
+      // and only has to apply the differences for this entry
+
+      char *log LOCAL = xasprintf("%s.log", entry->name);
+      if (freopen(log, "w", stdout) == NULL)
+         fatal_errno("failed to create %s", log);
+      dup2(fileno(stdout), STDERR_FILENO);
+
+      char *covdb LOCAL = xasprintf("%s.covdb", entry->name);
+      opt_set_str("cover-file", covdb);
+
+      if (entry->plugins != NULL)
+         vhpi_load_plugins(e, entry->plugins);
+
+      for (int i = 0; i < entry->n_forces; i++)
+         batch_force(e, entry->forces[i]);
+
+      rt_run_sim(entry->stop_time);
+      rt_end_of_tool(e);
+
+      fflush(stdout);
+      fflush(stderr);
+      _exit(EXIT_SUCCESS);
+   }
+   else if (pid < 0)
+      fatal_errno("fork");
+
+   entry->pid = pid;
+}
+
+static batch_entry_t *batch_parse(const char *file, uint64_t stop_time,
+                                  const char *plugins, int *n_entries)
+{
+   // Each line is an entry name followed by any of stop-time=T,
+   // load=PLUGINS, and SIGNAL=VALUE
+
+   FILE *f = fopen(file, "r");
+   if (f == NULL)
+      fatal_errno("failed to open %s", file);
+
+   int count = 0, max_entries = 16;
+   batch_entry_t *entries = xmalloc(max_entries * sizeof(batch_entry_t));
+
+   char line[4096];
+   for (int lineno = 1; fgets(line, sizeof(line), f) != NULL; lineno++) {
+      char *tok = strtok(line, " \t\r\n");
+      if (tok == NULL || *tok == '#')
+         continue;
+
+      batch_entry_t entry = {
+         .name       = xstrdup(tok),
+         .stop_time  = stop_time,
+         .plugins    = plugins ? xstrdup(plugins) : NULL,
+         .max_forces = 4,
+         .forces     = xmalloc(4 * sizeof(char *))
+      };
+
+      while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+         if (strncmp(tok, "stop-time=", 10) == 0)
+            entry.stop_time = parse_time(tok + 10);
+         else if (strncmp(tok, "load=", 5) == 0) {
+            char *all = plugins ? xasprintf("%s,%s", plugins, tok + 5)
+               : xstrdup(tok + 5);
+            free(entry.plugins);
+            entry.plugins = all;
+         }
+         else if (strchr(tok, '=') != NULL && *tok != '=') {
+            ARRAY_APPEND(entry.forces, xstrdup(tok), entry.n_forces,
+                         entry.max_forces);
+         }
+         else
+            fatal("%s:%d: invalid batch option %s", file, lineno, tok);
+      }
+
+      ARRAY_APPEND(entries, entry, count, max_entries);
+   }
+
+   fclose(f);
+
+   if (count == 0)
+      fatal("no entries in batch file %s", file);
+
+   *n_entries = count;
+   return entries;
+}
+
+static int batch_run(tree_t e, const char *file, int max_jobs,
+                     uint64_t stop_time, const char *plugins)
+{
+   // The design is set up and initialised once and then each entry is
+   // simulated in a forked child which inherits all of that state
+
+   int n_entries;
+   batch_entry_t *entries = batch_parse(file, stop_time, plugins, &n_entries);
+
+   batch_entry_t **running LOCAL =
+      xmalloc(max_jobs * sizeof(batch_entry_t *));
+   int n_running = 0, next = 0, n_failed = 0;
+
+   while (next < n_entries || n_running > 0) {
+      while (next < n_entries && n_running < max_jobs) {
+         batch_start_entry(e, &(entries[next]));
+         running[n_running++] = &(entries[next++]);
+      }
+
+      int status;
+      const pid_t pid = wait(&status);
+      if (pid < 0)
+         fatal_errno("wait");
+
+      int index = -1;
+      for (int i = 0; i < n_running && index == -1; i++) {
+         if (running[i]->pid == pid)
+            index = i;
+      }
+
+      if (index == -1)
+         continue;
+
+      batch_entry_t *entry = running[index];
+      running[index] = running[--n_running];
+
+      const unsigned ms = (get_timestamp_us() - entry->start_us) / 1000;
+
+      if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)
+         notef("%s passed [%ums]", entry->name, ms);
+      else {
+         notef("%s failed [%ums] see %s.log", entry->name, ms, entry->name);
+         n_failed++;
+      }
+   }
+
+   notef("%d of %d batch entries passed", n_entries - n_failed, n_entries);
+
+   for (int i = 0; i < n_entries; i++) {
+      for (int j = 0; j < entries[i].n_forces; j++)
+         free(entries[i].forces[j]);
+      free(entries[i].forces);
+      free(entries[i].plugins);
+      free(entries[i].name);
+   }
+   free(entries);
+
+   return n_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else  // __MINGW32__
+
+static int batch_run(tree_t e, const char *file, int max_jobs,
+                     uint64_t stop_time, const char *plugins)
+{
+   fatal("--batch is not supported on this platform");
+}
+
+#endif  // __MINGW32__
+
 static int run(int argc, char **argv)
 {
    static struct option long_options[] = {
       { "trace",         no_argument,       0, 't' },
-      { "profile",       no_argument,       0, 'p' },
+      { "profile",       optional_argument, 0, 'p' },
+      { "profile-out",   required_argument, 0, 'F' },
       { "stop-time",     required_argument, 0, 's' },
-      { "stats",         no_argument,       0, 'S' },
+      { "stats",         optional_argument, 0, 'S' },
       { "wave",          optional_argument, 0, 'w' },
       { "stop-delta",    required_argument, 0, 'd' },
       { "format",        required_argument, 0, 'f' },
       { "include",       required_argument, 0, 'i' },
       { "exclude",       required_argument, 0, 'e' },
       { "exit-severity", required_argument, 0, 'x' },
+      { "event-queue",   required_argument, 0, 'Q' },
+      { "threads",       required_argument, 0, 'j' },
+      { "batch",         required_argument, 0, 'B' },
+      { "jobs",          required_argument, 0, 'J' },
+      { "checkpoint",    required_argument, 0, 'K' },
+      { "restore",       required_argument, 0, 'R' },
+      { "wave-threads",  required_argument, 0, 'W' },
+      { "wave-compress", required_argument, 0, 'Z' },
+      { "wave-start",    required_argument, 0, 'b' },
+      { "wave-stop",     required_argument, 0, 'E' },
+      { "wave-depth",    required_argument, 0, 'D' },
+      { "cover-file",    required_argument, 0, 'C' },
+      { "perf-map",      no_argument,       0, 'P' },
+      { "huge-pages",    no_argument,       0, 'H' },
+      { "numa",          required_argument, 0, 'N' },
+      { "run-order",     required_argument, 0, 'O' },
+      { "partitions",    required_argument, 0, 'X' },
 #if ENABLE_VHPI
       { "load",          required_argument, 0, 'l' },
       { "vhpi-trace",    no_argument,       0, 'T' },
@@ -447,11 +1117,15 @@ static int run(int argc, char **argv)
       { 0, 0, 0, 0 }
    };
 
-   enum { LXT, FST, VCD} wave_fmt = FST;
+   enum { LXT, FST, VCD, NTR } wave_fmt = FST;
 
    uint64_t stop_time = UINT64_MAX;
+   uint64_t wave_start = 0, wave_stop = UINT64_MAX;
    const char *wave_fname = NULL;
    const char *vhpi_plugins = NULL;
+   const char *restore_fname = NULL;
+   const char *batch_fname = NULL;
+   int batch_jobs = 1;
 
    static bool have_run = false;
    if (have_run)
@@ -475,6 +1149,11 @@ static int run(int argc, char **argv)
          break;
       case 'p':
          opt_set_int("rt_profile", 1);
+         if (optarg != NULL)
+            opt_set_str("rt-profile-file", optarg);
+         break;
+      case 'F':
+         opt_set_str("rt-profile-out", optarg);
          break;
       case 'T':
          opt_set_int("vhpi_trace_en", 1);
@@ -489,11 +1168,19 @@ static int run(int argc, char **argv)
             wave_fmt = FST;
          else if (strcmp(optarg, "lxt") == 0)
             wave_fmt = LXT;
+         else if (strcmp(optarg, "ntr") == 0)
+            wave_fmt = NTR;
          else
             fatal("invalid waveform format: %s", optarg);
          break;
       case 'S':
          opt_set_int("rt-stats", 1);
+         if (optarg != NULL) {
+            if (strncmp(optarg, "json:", 5) != 0 || optarg[5] == '\0')
+               fatal("invalid statistics output: %s (expected json:FILE)",
+                     optarg);
+            opt_set_str("rt-stats-file", optarg + 5);
+         }
          break;
       case 'w':
          if (optarg == NULL)
@@ -516,11 +1203,126 @@ static int run(int argc, char **argv)
       case 'x':
          rt_set_exit_severity(parse_severity(optarg));
          break;
+      case 'Q':
+         if (strcmp(optarg, "wheel") == 0)
+            opt_set_int("rt-event-wheel", 1);
+         else if (strcmp(optarg, "heap") == 0)
+            opt_set_int("rt-event-wheel", 0);
+         else
+            fatal("invalid event queue: %s (allowed wheel, heap)", optarg);
+         break;
+      case 'j':
+         {
+            const int threads = parse_int(optarg);
+            if (threads < 1)
+               fatal("invalid number of threads: %s", optarg);
+            opt_set_int("rt-threads", threads);
+         }
+         break;
+      case 'B':
+         batch_fname = optarg;
+         break;
+      case 'J':
+         if ((batch_jobs = parse_int(optarg)) < 1)
+            fatal("invalid number of jobs: %s", optarg);
+         break;
+      case 'K':
+         {
+            char *tmp LOCAL = xstrdup(optarg);
+            char *sep = strchr(tmp, ':');
+            if (sep == NULL || *(sep + 1) == '\0')
+               fatal("checkpoint must be specified as TIME:FILE");
+
+            *sep = '\0';
+            rt_set_checkpoint(parse_time(tmp), sep + 1);
+         }
+         break;
+      case 'R':
+         restore_fname = optarg;
+         break;
+      case 'W':
+         {
+            const int threads = parse_int(optarg);
+            if (threads < 1)
+               fatal("invalid number of wave threads: %s", optarg);
+            opt_set_int("wave-threads", threads);
+         }
+         break;
+      case 'Z':
+         if (strcmp(optarg, "zlib") != 0 && strcmp(optarg, "fastlz") != 0
+             && strcmp(optarg, "lz4") != 0)
+            fatal("invalid wave compression: %s (allowed zlib, fastlz, lz4)",
+                  optarg);
+         opt_set_str("wave-compress", optarg);
+         break;
+      case 'b':
+         wave_start = parse_time(optarg);
+         break;
+      case 'E':
+         wave_stop = parse_time(optarg);
+         break;
+      case 'D':
+         {
+            const int depth = parse_int(optarg);
+            if (depth < 0)
+               fatal("invalid wave depth: %s", optarg);
+            wave_set_depth(depth);
+         }
+         break;
+      case 'C':
+         opt_set_str("cover-file", optarg);
+         break;
+      case 'P':
+         opt_set_int("perf-map", 1);
+         break;
+      case 'H':
+         opt_set_int("rt-huge-pages", 1);
+         break;
+      case 'N':
+         if (strcmp(optarg, "interleave") != 0) {
+            const int node = parse_int(optarg);
+            if (node < 0 || node >= 256)
+               fatal("invalid NUMA policy: %s (allowed interleave or a "
+                     "node number)", optarg);
+         }
+         opt_set_str("rt-numa", optarg);
+         break;
+      case 'O':
+         if (strcmp(optarg, "sorted") == 0)
+            opt_set_int("rt-sort-run-queue", 1);
+         else if (strcmp(optarg, "fifo") == 0)
+            opt_set_int("rt-sort-run-queue", 0);
+         else
+            fatal("invalid run order: %s (allowed fifo, sorted)", optarg);
+         break;
+      case 'X':
+         {
+            const int parts = parse_int(optarg);
+            if (parts < 1 || parts > 64)
+               fatal("invalid number of partitions: %s (allowed 1 to 64)",
+                     optarg);
+            opt_set_int("rt-partitions", parts);
+         }
+         break;
       default:
          abort();
       }
    }
 
+   if (opt_get_int("jit") && opt_get_int("rt-threads") > 1) {
+      warnf("--threads cannot be used with code compiled by --jit");
+      opt_set_int("rt-threads", 1);
+   }
+
+   if (batch_fname != NULL) {
+      if (wave_fname != NULL)
+         fatal("--wave cannot be used with --batch");
+      else if (opt_get_int("rt-threads") > 1) {
+         warnf("--threads cannot be used with --batch");
+         opt_set_int("rt-threads", 1);
+      }
+   }
+
    set_top_level(argv, next_cmd);
 
    ident_t ename = ident_prefix(top_level, ident_new("elab"), '.');
@@ -531,8 +1333,8 @@ static int run(int argc, char **argv)
       fatal("%s not suitable top level", istr(top_level));
 
    if (wave_fname != NULL) {
-      const char *name_map[] = { "LXT", "FST", "VCD" };
-      const char *ext_map[]  = { "lxt", "fst", "vcd" };
+      const char *name_map[] = { "LXT", "FST", "VCD", "native trace" };
+      const char *ext_map[]  = { "lxt", "fst", "vcd", "ntr" };
       char *tmp LOCAL = NULL;
 
       if (*wave_fname == '\0') {
@@ -553,17 +1355,38 @@ static int run(int argc, char **argv)
       case FST:
          fst_init(wave_fname, e);
          break;
+      case NTR:
+         ntr_init(wave_fname, e);
+         break;
       }
+
+      if (wave_stop <= wave_start)
+         fatal("wave stop time must be after the start time");
+
+      rt_set_wave_window(wave_start, wave_stop);
    }
 
    rt_start_of_tool(e);
 
-   if (vhpi_plugins != NULL)
+   // Plugins are loaded separately by each batch entry
+   if (vhpi_plugins != NULL && batch_fname == NULL)
       vhpi_load_plugins(e, vhpi_plugins);
 
-   rt_restart(e);
-   rt_run_sim(stop_time);
-   rt_end_of_tool(e);
+   if (restore_fname != NULL)
+      rt_restart_from(e, restore_fname);
+   else
+      rt_restart(e);
+
+   if (batch_fname != NULL) {
+      const int status =
+         batch_run(e, batch_fname, batch_jobs, stop_time, vhpi_plugins);
+      if (status != EXIT_SUCCESS)
+         return status;
+   }
+   else {
+      rt_run_sim(stop_time);
+      rt_end_of_tool(e);
+   }
 
    argc -= next_cmd - 1;
    argv += next_cmd - 1;
@@ -576,9 +1399,12 @@ static int make_cmd(int argc, char **argv)
    static struct option long_options[] = {
       { "deps-only", no_argument, 0, 'd' },
       { "posix",     no_argument, 0, 'p' },
+      { "scan",      no_argument, 0, 's' },
       { 0, 0, 0, 0 }
    };
 
+   bool scan = false;
+
    const int next_cmd = scan_cmd(2, argc, argv);
    int c, index = 0;
    const char *spec = "";
@@ -595,12 +1421,27 @@ static int make_cmd(int argc, char **argv)
       case 'p':
          opt_set_int("make-posix", 1);
          break;
+      case 's':
+         scan = true;
+         break;
       default:
          abort();
       }
    }
 
    const int count = next_cmd - optind;
+
+   if (scan) {
+      if (count == 0)
+         fatal("missing source files to scan");
+
+      make_scan((const char **)(argv + optind), count, stdout);
+
+      argc -= next_cmd - 1;
+      argv += next_cmd - 1;
+
+      return argc > 1 ? process_command(argc, argv) : EXIT_SUCCESS;
+   }
    tree_t *targets = xmalloc(count * sizeof(tree_t));
 
    lib_t work = lib_work();
@@ -667,6 +1508,92 @@ static int list_cmd(int argc, char **argv)
    return argc > 1 ? process_command(argc, argv) : EXIT_SUCCESS;
 }
 
+static bool build_file(const char *file)
+{
+   char *files[] = { (char *)file };
+   return analyse_serial(files, 1);
+}
+
+static int build_cmd(int argc, char **argv)
+{
+   static struct option long_options[] = {
+      { "jobs", required_argument, 0, 'j' },
+      { 0, 0, 0, 0 }
+   };
+
+   int jobs = 1;
+
+   const int next_cmd = scan_cmd(2, argc, argv);
+   int c, index = 0;
+   const char *spec = "j:";
+   while ((c = getopt_long(next_cmd, argv, spec, long_options, &index)) != -1) {
+      switch (c) {
+      case 0:
+         // Set a flag
+         break;
+      case '?':
+         fatal("unrecognised build option %s", argv[optind - 1]);
+      case 'j':
+         if ((jobs = parse_int(optarg)) < 1)
+            fatal("invalid number of jobs: %s", optarg);
+         break;
+      default:
+         abort();
+      }
+   }
+
+   const int count = next_cmd - optind;
+   if (count == 0)
+      fatal("missing source files to build");
+
+   if (!make_build((const char **)(argv + optind), count, jobs, build_file))
+      return EXIT_FAILURE;
+
+   argc -= next_cmd - 1;
+   argv += next_cmd - 1;
+
+   return argc > 1 ? process_command(argc, argv) : EXIT_SUCCESS;
+}
+
+static int cover_merge_cmd(int argc, char **argv)
+{
+   static struct option long_options[] = {
+      { "output", required_argument, 0, 'o' },
+      { 0, 0, 0, 0 }
+   };
+
+   const char *output = NULL;
+
+   const int next_cmd = scan_cmd(2, argc, argv);
+   int c, index = 0;
+   const char *spec = "o:";
+   while ((c = getopt_long(next_cmd, argv, spec, long_options, &index)) != -1) {
+      switch (c) {
+      case 0:
+         // Set a flag
+         break;
+      case '?':
+         fatal("unrecognised cover-merge option %s", argv[optind - 1]);
+      case 'o':
+         output = optarg;
+         break;
+      default:
+         abort();
+      }
+   }
+
+   const int count = next_cmd - optind;
+   if (count == 0)
+      fatal("missing coverage databases to merge");
+
+   cover_merge((const char **)(argv + optind), count, output);
+
+   argc -= next_cmd - 1;
+   argv += next_cmd - 1;
+
+   return argc > 1 ? process_command(argc, argv) : EXIT_SUCCESS;
+}
+
 static int syntax_cmd(int argc, char **argv)
 {
    static struct option long_options[] = {
@@ -756,15 +1683,369 @@ static int dump_cmd(int argc, char **argv)
    return argc > 1 ? process_command(argc, argv) : EXIT_SUCCESS;
 }
 
+static int    server_n_global;
+static char **server_global;
+
+#ifndef __MINGW32__
+
+// Each request is this header followed by the NUL terminated working
+// directory, global options and command arguments of the client
+typedef struct {
+   uint32_t n_global;
+   uint32_t n_args;
+   uint32_t length;
+} server_req_t;
+
+#define SERVER_DECLINED -1
+
+static bool server_address(const char *work_path, struct sockaddr_un *addr)
+{
+   memset(addr, '\0', sizeof(struct sockaddr_un));
+   addr->sun_family = AF_UNIX;
+
+   const int len = snprintf(addr->sun_path, sizeof(addr->sun_path),
+                            "%s" PATH_SEP "_server", work_path);
+   return len < (int)sizeof(addr->sun_path);
+}
+
+static bool server_forwardable(int next_cmd, int argc, char **argv)
+{
+   // Only commands which read and write libraries are sent to the
+   // server as the simulation needs the client's terminal and signals
+
+   if (getenv("NVC_NO_SERVER") != NULL || next_cmd == argc)
+      return false;
+
+   for (int i = next_cmd; i < argc; i = scan_cmd(i + 1, argc, argv)) {
+      if (strcmp(argv[i], "-a") != 0 && strcmp(argv[i], "-e") != 0
+          && strcmp(argv[i], "--syntax") != 0)
+         return false;
+   }
+
+   return true;
+}
+
+static bool server_write_all(int fd, const void *buf, size_t len)
+{
+   for (const char *p = buf; len > 0; ) {
+      const ssize_t n = write(fd, p, len);
+      if (n < 0 && errno == EINTR)
+         continue;
+      else if (n <= 0)
+         return false;
+      p += n;
+      len -= n;
+   }
+
+   return true;
+}
+
+static bool server_read_all(int fd, void *buf, size_t len)
+{
+   for (char *p = buf; len > 0; ) {
+      const ssize_t n = read(fd, p, len);
+      if (n < 0 && errno == EINTR)
+         continue;
+      else if (n <= 0)
+         return false;
+      p += n;
+      len -= n;
+   }
+
+   return true;
+}
+
+static bool server_forward(const char *work_path, int next_cmd,
+                           int argc, char **argv, int *status)
+{
+   if (!server_forwardable(next_cmd, argc, argv))
+      return false;
+
+   struct sockaddr_un addr;
+   if (!server_address(work_path, &addr))
+      return false;
+
+   const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd < 0)
+      return false;
+
+   // No server running is the common case and not an error
+   if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      close(fd);
+      return false;
+   }
+
+   char cwd[PATH_MAX];
+   if (getcwd(cwd, sizeof(cwd)) == NULL)
+      fatal_errno("getcwd");
+
+   server_req_t req = {
+      .n_global = next_cmd - 1,
+      .n_args   = argc - next_cmd,
+      .length   = strlen(cwd) + 1
+   };
+
+   for (int i = 1; i < argc; i++)
+      req.length += strlen(argv[i]) + 1;
+
+   char *buf LOCAL = xmalloc(req.length);
+   char *p = buf;
+   p = stpcpy(p, cwd) + 1;
+   for (int i = 1; i < argc; i++)
+      p = stpcpy(p, argv[i]) + 1;
+
+   // Output from the command goes straight to our own stdout and
+   // stderr which are passed to the server along with the request
+   const int fds[] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+   char control[CMSG_SPACE(sizeof(fds))];
+   memset(control, '\0', sizeof(control));
+
+   struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+   struct msghdr msg = {
+      .msg_iov        = &iov,
+      .msg_iovlen     = 1,
+      .msg_control    = control,
+      .msg_controllen = sizeof(control)
+   };
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type  = SCM_RIGHTS;
+   cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+   memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+   if (sendmsg(fd, &msg, 0) != sizeof(req)
+       || !server_write_all(fd, buf, req.length)) {
+      close(fd);
+      return false;
+   }
+
+   int32_t reply;
+   if (!server_read_all(fd, &reply, sizeof(reply)))
+      fatal("lost connection to compilation server");
+
+   close(fd);
+
+   if (reply == SERVER_DECLINED)
+      return false;
+
+   *status = reply;
+   return true;
+}
+
+static int32_t server_run(int conn, int argc, char **argv, const int *fds)
+{
+   // Run the command in a child of this handler so fatal errors which
+   // call exit still allow the status to be reported to the client
+
+   signal(SIGCHLD, SIG_DFL);
+
+   pid_t pid = fork();
+   if (pid < 0)
+      fatal_errno("fork");
+   else if (pid == 0) {
+      close(conn);
+
+      for (int i = 0; i < 3; i++) {
+         if (dup2(fds[i], i) < 0)
+            fatal_errno("dup2");
+         close(fds[i]);
+      }
+
+      term_init();
+
+      void *token = NULL;
+      lib_t lib;
+      while ((lib = lib_enum_loaded(&token)))
+         lib_reopen_lock(lib);
+
+      exit(process_command(argc, argv));
+   }
+
+   int status;
+   while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR)
+         fatal_errno("waitpid");
+   }
+
+   if (WIFEXITED(status))
+      return WEXITSTATUS(status);
+   else
+      return EXIT_FAILURE;
+}
+
+static void server_handle(int conn)
+{
+   server_req_t req;
+   int fds[3];
+   char control[CMSG_SPACE(sizeof(fds))];
+
+   struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+   struct msghdr msg = {
+      .msg_iov        = &iov,
+      .msg_iovlen     = 1,
+      .msg_control    = control,
+      .msg_controllen = sizeof(control)
+   };
+
+   if (recvmsg(conn, &msg, 0) != sizeof(req))
+      return;
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS
+       || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+      return;
+
+   memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+   if (req.length > 1 << 20)
+      return;
+
+   char *buf LOCAL = xmalloc(req.length);
+   if (!server_read_all(conn, buf, req.length) || buf[req.length - 1] != '\0')
+      return;
+
+   const int nstrs = 1 + req.n_global + req.n_args;
+   char **strs LOCAL = xmalloc(nstrs * sizeof(char *));
+   char *p = buf;
+   for (int i = 0; i < nstrs; i++) {
+      if (p >= buf + req.length)
+         return;
+      strs[i] = p;
+      p += strlen(p) + 1;
+   }
+
+   // The libraries held by the server were found using its own global
+   // options and working directory so other clients must run locally
+   char cwd[PATH_MAX];
+   bool match = getcwd(cwd, sizeof(cwd)) != NULL && strcmp(cwd, strs[0]) == 0
+      && req.n_global == server_n_global && req.n_args > 0;
+   for (int i = 0; match && i < server_n_global; i++)
+      match = strcmp(strs[1 + i], server_global[i]) == 0;
+
+   int32_t reply = SERVER_DECLINED;
+   if (match) {
+      char **argv = strs + req.n_global;
+      argv[0] = PACKAGE;
+      reply = server_run(conn, req.n_args + 1, argv, fds);
+   }
+
+   (void)server_write_all(conn, &reply, sizeof(reply));
+}
+
+static int server_cmd(int argc, char **argv)
+{
+   static struct option long_options[] = {
+      { 0, 0, 0, 0 }
+   };
+
+   const int next_cmd = scan_cmd(2, argc, argv);
+   int c, index = 0;
+   const char *spec = "";
+   while ((c = getopt_long(next_cmd, argv, spec, long_options, &index)) != -1) {
+      switch (c) {
+      case 0:
+         // Set a flag
+         break;
+      case '?':
+         fatal("unrecognised server option %s", argv[optind - 1]);
+      default:
+         abort();
+      }
+   }
+
+   if (next_cmd != argc)
+      fatal("the --server command cannot be followed by other commands");
+
+   struct sockaddr_un addr;
+   if (!server_address(lib_path(lib_work()), &addr))
+      fatal("work library path %s is too long for a socket",
+            lib_path(lib_work()));
+
+   // Loading the standard libraries up front is the point of running
+   // a server so each request starts with them already in memory
+   lib_find(std_i, true);
+   lib_find(ident_new("IEEE"), false);
+
+   const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sock < 0)
+      fatal_errno("socket");
+
+   // A socket left behind by a server that was killed would make bind
+   // fail with EADDRINUSE
+   (void)unlink(addr.sun_path);
+
+   if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+      fatal_errno("bind: %s", addr.sun_path);
+
+   if (listen(sock, 16) < 0)
+      fatal_errno("listen");
+
+   // Handlers are reaped automatically
+   signal(SIGCHLD, SIG_IGN);
+
+   printf("Listening on %s\n", addr.sun_path);
+   fflush(stdout);
+
+   for (;;) {
+      const int conn = accept(sock, NULL, NULL);
+      if (conn < 0) {
+         if (errno == EINTR)
+            continue;
+         fatal_errno("accept");
+      }
+
+      void *token = NULL;
+      lib_t lib;
+      while ((lib = lib_enum_loaded(&token)))
+         lib_refresh(lib);
+
+      fflush(NULL);
+
+      pid_t pid = fork();
+      if (pid < 0)
+         fatal_errno("fork");
+      else if (pid == 0) {
+         close(sock);
+         server_handle(conn);
+         _exit(EXIT_SUCCESS);
+      }
+
+      close(conn);
+   }
+}
+
+#else  // __MINGW32__
+
+static bool server_forward(const char *work_path, int next_cmd,
+                           int argc, char **argv, int *status)
+{
+   return false;
+}
+
+static int server_cmd(int argc, char **argv)
+{
+   fatal("the --server command is not supported on this platform");
+}
+
+#endif  // __MINGW32__
+
 static void set_default_opts(void)
 {
    opt_set_int("rt-stats", 0);
+   opt_set_str("rt-stats-file", NULL);
+   opt_set_str("cover-file", NULL);
    opt_set_int("rt_trace_en", 0);
    opt_set_int("vhpi_trace_en", 0);
    opt_set_int("dump-llvm", 0);
    opt_set_int("optimise", 2);
+   opt_set_int("cgen-jobs", 1);
+   opt_set_int("cgen-cache", 0);
+   opt_set_int("elab-prune", 0);
+   opt_set_int("jit", 0);
+   opt_set_int("jit-tiered", 0);
    opt_set_int("bootstrap", 0);
-   opt_set_int("cover", 0);
+   opt_set_int("cover", COVER_OFF);
    opt_set_int("stop-delta", 1000);
    opt_set_int("unit-test", 0);
    opt_set_int("make-deps-only", 0);
@@ -775,6 +2056,18 @@ static void set_default_opts(void)
    opt_set_int("force-init", 0);
    opt_set_int("verbose", 0);
    opt_set_int("rt_profile", 0);
+   opt_set_str("rt-profile-file", NULL);
+   opt_set_str("rt-profile-out", NULL);
+   opt_set_str("profile-use", NULL);
+   opt_set_int("rt-event-wheel", 1);
+   opt_set_int("rt-threads", 1);
+   opt_set_int("wave-threads", 1);
+   opt_set_str("wave-compress", "zlib");
+   opt_set_int("perf-map", 0);
+   opt_set_int("rt-huge-pages", 0);
+   opt_set_str("rt-numa", NULL);
+   opt_set_int("rt-sort-run-queue", 0);
+   opt_set_int("rt-partitions", 0);
 }
 
 static void usage(void)
@@ -785,12 +2078,17 @@ static void usage(void)
           " -a [OPTION]... FILE...\t\tAnalyse FILEs into work library\n"
           " -e [OPTION]... UNIT\t\tElaborate and generate code for UNIT\n"
           " -r [OPTION]... UNIT\t\tExecute previously elaborated UNIT\n"
+          " --build [OPTION]... FILE...\tAnalyse out of date FILEs in order\n"
+          " --cover-merge [OPTION]... FILE...\n"
+          "\t\t\t\tMerge coverage databases into one report\n"
           " --dump [OPTION]... UNIT\tPrint out previously analysed UNIT\n"
           " --list\t\t\t\tPrint all units in the library\n"
           " --make [OPTION]... [UNIT]...\tGenerate makefile to rebuild UNITs\n"
+          " --server\t\t\tKeep libraries loaded to serve other commands\n"
           " --syntax FILE...\t\tCheck FILEs for syntax errors only\n"
           "\n"
           "Global options may be placed before COMMAND:\n"
+          "     --codec=C\t\tLibrary file compression: none, fastlz, lz4\n"
           "     --force-init\tCreate a library in an existing directory\n"
           " -h, --help\t\tDisplay this message and exit\n"
           "     --ignore-time\tSkip source file timestamp check\n"
@@ -804,33 +2102,59 @@ static void usage(void)
           "\n"
           "Analyse options:\n"
           "     --bootstrap\tAllow compilation of STANDARD package\n"
+          " -j, --jobs=N\t\tAnalyse up to N files in parallel\n"
           "     --relax=RULES\tDisable certain pedantic rule checks\n"
           "\n"
           "Elaborate options:\n"
-          "     --cover\t\tEnable code coverage reporting\n"
+          "     --cache\t\tReuse object code for unchanged processes\n"
+          "     --cover[=MODE]\tEnable code coverage: count, once, sample\n"
           "     --dump-llvm\tPrint generated LLVM IR\n"
           "     --dump-vcode\tPrint generated intermediate code\n"
           " -g NAME=VALUE\t\tSet top level generic NAME to VALUE\n"
+          " -j, --jobs=N\t\tGenerate code on N threads\n"
+          "     --jit\t\tCompile in memory when first run\n"
+          "     --keep=GLOB\tDo not prune signals matching GLOB\n"
           " -O0, -O1, -O2, -O3\tSet optimisation level (default is -O2)\n"
+          "     --profile-use=FILE\tOptimise using counts from --profile-out\n"
+          "     --prune\t\tRemove signals and processes with no effect\n"
+          "     --tiered\t\tLike --jit but optimise busy processes later\n"
           " -V, --verbose\t\tPrint resource usage at each step\n"
           "\n"
           "Run options:\n"
+          "     --batch=FILE\tRun each test in FILE from one loaded design\n"
+          "     --checkpoint=T:FILE\tSave simulation state at time T to FILE\n"
+          "     --cover-file=FILE\tWrite coverage database to FILE\n"
+          "     --event-queue=Q\tUse timing wheel or heap for future events\n"
           "     --exclude=GLOB\tExclude signals matching GLOB from wave dump\n"
           "     --exit-severity=S\tExit after assertion failure of severity S\n"
-          "     --format=FMT\tWaveform format is either fst or vcd\n"
+          "     --format=FMT\tWaveform format is one of fst, vcd, or ntr\n"
+          "     --huge-pages\tBack signal values with huge pages\n"
           "     --include=GLOB\tInclude signals matching GLOB in wave dump\n"
+          "     --jobs=N\t\tRun up to N batch entries in parallel\n"
 #ifdef ENABLE_VHPI
           "     --load=PLUGIN\tLoad VHPI plugin at startup\n"
 #endif
-          "     --profile\t\tColect profiling data during run\n"
-          "     --stats\t\tPrint statistics at end of run\n"
+          "     --numa=P\t\tInterleave signal values or bind to node P\n"
+          "     --partitions=N\tReport a plan to split the design N ways\n"
+          "     --perf-map\t\tWrite /tmp/perf-PID.map for perf\n"
+          "     --profile[=FILE]\tCollect profiling data and write to FILE\n"
+          "     --profile-out=FILE\tWrite process counts for --profile-use\n"
+          "     --restore=FILE\tResume simulation from checkpoint FILE\n"
+          "     --run-order=O\tRun events in fifo or sorted order\n"
+          "     --stats[=json:FILE]\tPrint statistics at end of run\n"
           "     --stop-delta=N\tStop after N delta cycles (default %d)\n"
           "     --stop-time=T\tStop after simulation time T (e.g. 5ns)\n"
+          "     --threads=N\tRun processes in parallel on N threads\n"
           "     --trace\t\tTrace simulation events\n"
 #ifdef ENABLE_VHPI
           "     --vhpi-trace\tTrace VHPI calls and events\n"
 #endif
           " -w, --wave=FILE\tWrite waveform data; file name is optional\n"
+          "     --wave-compress=C\tFST compression: zlib, fastlz, lz4\n"
+          "     --wave-depth=N\tOnly dump signals up to N levels below top\n"
+          "     --wave-start=T\tStart writing waveform data at time T\n"
+          "     --wave-stop=T\tStop writing waveform data after time T\n"
+          "     --wave-threads=N\tCompress FST blocks on a thread if N > 1\n"
           "\n"
           "Dump options:\n"
           " -e, --elab\t\tDump an elaborated unit\n"
@@ -840,6 +2164,13 @@ static void usage(void)
           "Make options:\n"
           "     --deps-only\tOutput dependencies without actions\n"
           "     --posix\t\tStrictly POSIX compliant makefile\n"
+          "     --scan\t\tScan source FILEs instead of analysed units\n"
+          "\n"
+          "Build options:\n"
+          " -j, --jobs=N\t\tAnalyse up to N files in parallel\n"
+          "\n"
+          "Coverage merge options:\n"
+          " -o, --output=FILE\tAlso write the merged database to FILE\n"
           "\n",
           PACKAGE,
           opt_get_int("stop-delta"));
@@ -890,6 +2221,18 @@ static message_style_t parse_message_style(const char *str)
    fatal("invalid message style '%s' (allowed are 'full' and 'compact')", str);
 }
 
+static fbuf_codec_t parse_codec(const char *str)
+{
+   if (strcmp(str, "none") == 0)
+      return FBUF_CODEC_NONE;
+   else if (strcmp(str, "fastlz") == 0)
+      return FBUF_CODEC_FASTLZ;
+   else if (strcmp(str, "lz4") == 0)
+      return FBUF_CODEC_LZ4;
+
+   fatal("invalid codec '%s' (allowed are 'none', 'fastlz' and 'lz4')", str);
+}
+
 static void parse_library_map(char *str)
 {
    char *split = strchr(str, ':');
@@ -924,6 +2267,9 @@ static int process_command(int argc, char **argv)
       { "make",    no_argument, 0, 'm' },
       { "syntax",  no_argument, 0, 's' },
       { "list",    no_argument, 0, 'l' },
+      { "build",   no_argument, 0, 'b' },
+      { "server",  no_argument, 0, 'S' },
+      { "cover-merge", no_argument, 0, 'M' },
       { 0, 0, 0, 0 }
    };
 
@@ -949,6 +2295,12 @@ static int process_command(int argc, char **argv)
       return syntax_cmd(argc, argv);
    case 'l':
       return list_cmd(argc, argv);
+   case 'b':
+      return build_cmd(argc, argv);
+   case 'S':
+      return server_cmd(argc, argv);
+   case 'M':
+      return cover_merge_cmd(argc, argv);
    default:
       fatal("missing command, try %s --help for usage", PACKAGE);
       return EXIT_FAILURE;
@@ -981,6 +2333,7 @@ int main(int argc, char **argv)
       { "map",         required_argument, 0, 'p' },
       { "ignore-time", no_argument,       0, 'i' },
       { "force-init",  no_argument,       0, 'f' },
+      { "codec",       required_argument, 0, 'c' },
       { 0, 0, 0, 0 }
    };
 
@@ -1025,6 +2378,9 @@ int main(int argc, char **argv)
       case 'f':
          opt_set_int("force-init", 1);
          break;
+      case 'c':
+         fbuf_set_codec(parse_codec(optarg));
+         break;
       case 'n':
          warnf("the --native option is deprecated and has no effect");
          break;
@@ -1035,6 +2391,13 @@ int main(int argc, char **argv)
       }
    }
 
+   int status;
+   if (server_forward(work_path, next_cmd, argc, argv, &status))
+      return status;
+
+   server_n_global = next_cmd - 1;
+   server_global   = argv + 1;
+
    work = lib_new(work_name, work_path);
    lib_set_work(work);
 
@@ -21,11 +21,6 @@
 #include <string.h>
 #include <stdlib.h>
 
-DEFINE_ARRAY(tree);
-DEFINE_ARRAY(netid);
-DEFINE_ARRAY(type);
-DEFINE_ARRAY(range);
-
 static const char *item_text_map[] = {
    "I_IDENT",    "I_VALUE",     "I_SEVERITY", "I_MESSAGE",    "I_TARGET",
    "I_LITERAL",  "I_IDENT2",    "I_DECLS",    "I_STMTS",      "I_PORTS",
@@ -45,6 +40,42 @@ static generation_t    next_generation = 1;
 static object_t      **all_objects = NULL;
 static size_t          max_objects = 256;   // Grows at runtime
 static size_t          n_objects_alloc = 0;
+static object_rd_ctx_t *lazy_readers = NULL;
+static object_arena_t  *arena_stack = NULL;
+static object_arena_t  *live_arenas = NULL;
+
+#define ARENA_CHUNK_MIN (64 * 1024)
+#define ARENA_CHUNK_MAX (1024 * 1024)
+
+#define ITEM_ARRAY_BASE_SZ 4
+#define ITEM_BLOCK_FIXED   (UINT32_C(1) << 31)
+
+typedef struct arena_chunk arena_chunk_t;
+
+struct arena_chunk {
+   arena_chunk_t *next;
+   size_t         size;
+   char           data[0];
+};
+
+// Common header of the item array blocks declared in object.h
+typedef struct {
+   uint32_t count;
+   uint32_t max;
+   char     items[0];
+} item_block_t;
+
+struct object_arena {
+   arena_chunk_t   *chunks;
+   char            *next_free;
+   size_t           avail;
+   object_t       **objects;
+   size_t           n_objects;
+   size_t           max_objects;
+   object_arena_t  *parent;
+   object_arena_t  *live_next;
+   bool             pushed;
+};
 
 void object_lookup_failed(const char *name, const char **kind_text_map,
                           int kind, imask_t mask)
@@ -177,7 +208,7 @@ void object_one_time_init(void)
 
       // Increment this each time a incompatible change is made to the
       // on-disk format not expressed in the tree and type items table
-      const uint32_t format_fudge = 12;
+      const uint32_t format_fudge = 14;
 
       format_digest += format_fudge * UINT32_C(2654435761);
 
@@ -185,6 +216,154 @@ void object_one_time_init(void)
    }
 }
 
+static void *object_arena_alloc(object_arena_t *arena, size_t size)
+{
+   size = (size + sizeof(double) - 1) & ~(sizeof(double) - 1);
+
+   if (unlikely(size > arena->avail)) {
+      // Chunks double in size up to a limit so small arenas stay small
+      size_t chunksz = ARENA_CHUNK_MIN;
+      if (arena->chunks != NULL)
+         chunksz = MIN(arena->chunks->size * 2, ARENA_CHUNK_MAX);
+      chunksz = MAX(chunksz, size);
+
+      arena_chunk_t *c = xmalloc(sizeof(arena_chunk_t) + chunksz);
+      c->next = arena->chunks;
+      c->size = chunksz;
+
+      arena->chunks    = c;
+      arena->next_free = c->data;
+      arena->avail     = chunksz;
+   }
+
+   void *mem = arena->next_free;
+   arena->next_free += size;
+   arena->avail     -= size;
+
+   memset(mem, '\0', size);
+   return mem;
+}
+
+object_arena_t *object_arena_new(void)
+{
+   object_arena_t *arena = xcalloc(sizeof(object_arena_t));
+   arena->max_objects = 256;
+   arena->objects     = xmalloc(arena->max_objects * sizeof(object_t *));
+   arena->live_next   = live_arenas;
+   live_arenas = arena;
+
+   return arena;
+}
+
+void object_arena_push(object_arena_t *arena)
+{
+   assert(!arena->pushed);
+
+   arena->parent = arena_stack;
+   arena->pushed = true;
+   arena_stack = arena;
+}
+
+void object_arena_pop(void)
+{
+   assert(arena_stack != NULL);
+
+   object_arena_t *arena = arena_stack;
+   arena_stack = arena->parent;
+   arena->parent = NULL;
+   arena->pushed = false;
+}
+
+static void *item_block_resize(void *block, size_t elemsz, uint32_t max,
+                               bool packed)
+{
+   // Blocks whose size is known up front are packed into the current
+   // arena next to their object and copied to the heap if they grow
+
+   item_block_t *old = block, *new;
+   const size_t bytes = sizeof(item_block_t) + max * elemsz;
+
+   if (old != NULL && !(old->max & ITEM_BLOCK_FIXED)) {
+      new = xrealloc(old, bytes);
+      new->max = max;
+      return new;
+   }
+   else if (packed && arena_stack != NULL) {
+      new = object_arena_alloc(arena_stack, bytes);
+      new->max = max | ITEM_BLOCK_FIXED;
+   }
+   else {
+      new = xmalloc(bytes);
+      new->max = max;
+   }
+
+   if (old != NULL) {
+      new->count = MIN(old->count, max);
+      memcpy(new->items, old->items, new->count * elemsz);
+   }
+   else
+      new->count = 0;
+
+   return new;
+}
+
+static void item_block_free(void *block)
+{
+   item_block_t *b = block;
+   if (b != NULL && !(b->max & ITEM_BLOCK_FIXED))
+      free(b);
+}
+
+#define DEFINE_ITEM_ARRAY(what)                                         \
+   void what##_array_add(what##_array_t *a, what##_t t)                 \
+   {                                                                    \
+      what##_block_t *b = a->block;                                     \
+      if (b == NULL)                                                    \
+         b = item_block_resize(NULL, sizeof(what##_t),                  \
+                               ITEM_ARRAY_BASE_SZ, false);              \
+      else if (b->count == (b->max & ~ITEM_BLOCK_FIXED))                \
+         b = item_block_resize(b, sizeof(what##_t), b->count * 2,       \
+                               false);                                  \
+                                                                        \
+      b->items[b->count++] = t;                                         \
+      a->block = b;                                                     \
+   }                                                                    \
+                                                                        \
+   void what##_array_resize(what##_array_t *a, size_t n,                \
+                            uint8_t fill, bool packed)                  \
+   {                                                                    \
+      what##_block_t *b = a->block;                                     \
+      if (n == 0) {                                                     \
+         if (b != NULL)                                                 \
+            b->count = 0;                                               \
+         return;                                                        \
+      }                                                                 \
+                                                                        \
+      if (b == NULL)                                                    \
+         b = item_block_resize(NULL, sizeof(what##_t), n, packed);      \
+      else if (n > (b->max & ~ITEM_BLOCK_FIXED))                        \
+         b = item_block_resize(b, sizeof(what##_t),                     \
+                               next_power_of_2(n), packed);             \
+                                                                        \
+      if (n > b->count)                                                 \
+         memset(b->items + b->count, fill,                              \
+                (n - b->count) * sizeof(what##_t));                     \
+                                                                        \
+      b->count = n;                                                     \
+      a->block = b;                                                     \
+   }                                                                    \
+                                                                        \
+   void what##_array_free(what##_array_t *a)                            \
+   {                                                                    \
+      item_block_free(a->block);                                        \
+      a->block = NULL;                                                  \
+   }
+
+DEFINE_ITEM_ARRAY(tree);
+DEFINE_ITEM_ARRAY(netid);
+DEFINE_ITEM_ARRAY(type);
+DEFINE_ITEM_ARRAY(range);
+
 object_t *object_new(const object_class_t *class, int kind)
 {
    if (unlikely(kind >= class->last_kind))
@@ -192,21 +371,43 @@ object_t *object_new(const object_class_t *class, int kind)
 
    object_one_time_init();
 
-   object_t *object = xcalloc(class->object_size[kind]);
+   object_t *object;
+   if (arena_stack != NULL) {
+      object = object_arena_alloc(arena_stack, class->object_size[kind]);
+      ARRAY_APPEND(arena_stack->objects, object, arena_stack->n_objects,
+                   arena_stack->max_objects);
+   }
+   else {
+      object = xcalloc(class->object_size[kind]);
+
+      if (unlikely(all_objects == NULL))
+         all_objects = xmalloc(sizeof(object_t *) * max_objects);
+
+      ARRAY_APPEND(all_objects, object, n_objects_alloc, max_objects);
+   }
 
    object->kind  = kind;
    object->tag   = class->tag;
    object->index = UINT32_MAX;
 
-   if (unlikely(all_objects == NULL))
-      all_objects = xmalloc(sizeof(object_t *) * max_objects);
+   return object;
+}
 
-   ARRAY_APPEND(all_objects, object, n_objects_alloc, max_objects);
+static void object_force_array(tree_array_t *a)
+{
+   const unsigned count = tree_array_count(a);
+   for (unsigned i = 0; i < count; i++) {
+      if (unlikely(OBJECT_LAZY(a->block->items[i])))
+         object_force(&(a->block->items[i]));
+   }
+}
 
-   return object;
+static object_seg_t *object_lazy_seg(tree_t t)
+{
+   return (object_seg_t *)((uintptr_t)t & ~(uintptr_t)1);
 }
 
-static void object_sweep(object_t *object)
+static void object_free_items(object_t *object)
 {
    const object_class_t *class = classes[object->tag];
 
@@ -216,15 +417,15 @@ static void object_sweep(object_t *object)
    for (int n = 0; n < nitems; mask <<= 1) {
       if (has & mask) {
          if (ITEM_TREE_ARRAY & mask)
-            free(object->items[n].tree_array.items);
+            tree_array_free(&(object->items[n].tree_array));
          else if (ITEM_TYPE_ARRAY & mask)
-            free(object->items[n].type_array.items);
+            type_array_free(&(object->items[n].type_array));
          else if (ITEM_NETID_ARRAY & mask)
-            free(object->items[n].netid_array.items);
+            netid_array_free(&(object->items[n].netid_array));
          else if (ITEM_ATTRS & mask)
-            free(object->items[n].attrs.table);
+            free(object->items[n].attrs);
          else if (ITEM_RANGE_ARRAY & mask)
-            free(object->items[n].range_array.items);
+            range_array_free(&(object->items[n].range_array));
          else if (ITEM_TEXT_BUF & mask) {
             if (object->items[n].text_buf != NULL)
                tb_free(object->items[n].text_buf);
@@ -232,10 +433,37 @@ static void object_sweep(object_t *object)
          n++;
       }
    }
+}
 
+static void object_sweep(object_t *object)
+{
+   object_free_items(object);
    free(object);
 }
 
+void object_arena_free(object_arena_t *arena)
+{
+   // Every object in the arena is freed at once so nothing outside
+   // the arena may still refer to them
+   assert(!arena->pushed);
+
+   for (size_t i = 0; i < arena->n_objects; i++)
+      object_free_items(arena->objects[i]);
+
+   for (arena_chunk_t *it = arena->chunks, *tmp; it != NULL; it = tmp) {
+      tmp = it->next;
+      free(it);
+   }
+
+   object_arena_t **p;
+   for (p = &live_arenas; *p != arena; p = &((*p)->live_next))
+      assert(*p != NULL);
+   *p = arena->live_next;
+
+   free(arena->objects);
+   free(arena);
+}
+
 void object_gc(void)
 {
    // Generation will be updated by tree_visit
@@ -261,13 +489,50 @@ void object_gc(void)
             .context    = NULL,
             .kind       = T_LAST_TREE_KIND,
             .generation = next_generation++,
-            .deep       = true
+            .deep       = true,
+            .lazy       = true
          };
 
          object_visit(all_objects[i], &ctx);
       }
    }
 
+   // Objects in arenas are only freed in bulk so anything they refer
+   // to must be kept alive
+   for (object_arena_t *it = live_arenas; it != NULL; it = it->live_next) {
+      object_visit_ctx_t ctx = {
+         .count      = 0,
+         .postorder  = NULL,
+         .preorder   = NULL,
+         .context    = NULL,
+         .kind       = T_LAST_TREE_KIND,
+         .generation = next_generation++,
+         .deep       = true,
+         .lazy       = true
+      };
+
+      for (size_t i = 0; i < it->n_objects; i++)
+         object_visit(it->objects[i], &ctx);
+   }
+
+   // Objects read from a partially loaded unit may still be the target
+   // of back references from declarations not yet read
+   for (object_rd_ctx_t *it = lazy_readers; it != NULL; it = it->next) {
+      object_visit_ctx_t ctx = {
+         .count      = 0,
+         .postorder  = NULL,
+         .preorder   = NULL,
+         .context    = NULL,
+         .kind       = T_LAST_TREE_KIND,
+         .generation = next_generation++,
+         .deep       = true,
+         .lazy       = true
+      };
+
+      for (unsigned i = 0; i < it->store_sz; i++)
+         object_visit(it->store[i], &ctx);
+   }
+
    // Sweep
    for (unsigned i = 0; i < n_objects_alloc; i++) {
       object_t *object = all_objects[i];
@@ -323,13 +588,24 @@ void object_visit(object_t *object, object_visit_ctx_t *ctx)
             object_visit((object_t *)object->items[i].tree, ctx);
          else if (ITEM_TREE_ARRAY & mask) {
             tree_array_t *a = &(object->items[i].tree_array);
-            for (unsigned j = 0; j < a->count; j++)
-               object_visit((object_t *)a->items[j], ctx);
+            const unsigned count = tree_array_count(a);
+            for (unsigned j = 0; j < count; j++) {
+               tree_t *slot = &(a->block->items[j]);
+               if (!OBJECT_LAZY(*slot))
+                  object_visit((object_t *)*slot, ctx);
+               else if (ctx->lazy)
+                  object_visit(object_lazy_seg(*slot)->object, ctx);
+               else {
+                  object_force(slot);
+                  object_visit((object_t *)*slot, ctx);
+               }
+            }
          }
          else if (ITEM_TYPE_ARRAY & mask) {
             type_array_t *a = &(object->items[i].type_array);
-            for (unsigned j = 0; j < a->count; j++)
-               object_visit((object_t *)a->items[j], ctx);
+            const unsigned count = type_array_count(a);
+            for (unsigned j = 0; j < count; j++)
+               object_visit((object_t *)a->block->items[j], ctx);
          }
          else if (ITEM_TYPE & mask)
             object_visit((object_t *)object->items[i].type, ctx);
@@ -341,9 +617,10 @@ void object_visit(object_t *object, object_visit_ctx_t *ctx)
             ;
          else if (ITEM_RANGE_ARRAY & mask) {
             range_array_t *a = &(object->items[i].range_array);
-            for (unsigned j = 0; j < a->count; j++) {
-               object_visit((object_t *)a->items[j].left, ctx);
-               object_visit((object_t *)a->items[j].right, ctx);
+            const unsigned count = range_array_count(a);
+            for (unsigned j = 0; j < count; j++) {
+               object_visit((object_t *)a->block->items[j].left, ctx);
+               object_visit((object_t *)a->block->items[j].right, ctx);
             }
          }
          else if (ITEM_NETID_ARRAY & mask)
@@ -351,8 +628,9 @@ void object_visit(object_t *object, object_visit_ctx_t *ctx)
          else if (ITEM_TEXT_BUF & mask)
             ;
          else if (ITEM_ATTRS & mask) {
-            attr_tab_t *attrs = &(object->items[i].attrs);
-            for (unsigned j = 0; j < attrs->num; j++) {
+            attr_tab_t *attrs = object->items[i].attrs;
+            const unsigned num = (attrs == NULL) ? 0 : attrs->num;
+            for (unsigned j = 0; j < num; j++) {
                switch (attrs->table[j].kind) {
                case A_TREE:
                   object_visit((object_t *)attrs->table[j].tval, ctx);
@@ -378,6 +656,15 @@ void object_visit(object_t *object, object_visit_ctx_t *ctx)
    }
 }
 
+static size_t object_count_live(void)
+{
+   // Objects allocated on the heap and from every arena not yet freed
+   size_t count = n_objects_alloc;
+   for (object_arena_t *it = live_arenas; it != NULL; it = it->live_next)
+      count += it->n_objects;
+   return count;
+}
+
 object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx)
 {
    if (object == NULL)
@@ -405,18 +692,24 @@ object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx)
                (tree_t)object_rewrite((object_t *)object->items[n].tree, ctx);
          else if (ITEM_TREE_ARRAY & mask) {
             tree_array_t *a = &(object->items[n].tree_array);
-
-            for (size_t i = 0; i < a->count; i++)
-               a->items[i] =
-                  (tree_t)object_rewrite((object_t *)a->items[i], ctx);
+            object_force_array(a);
+
+            // The rewrite function may append to this array and so
+            // also move the block
+            for (size_t i = 0; i < tree_array_count(a); i++) {
+               tree_t new = (tree_t)
+                  object_rewrite((object_t *)a->block->items[i], ctx);
+               a->block->items[i] = new;
+            }
 
             // If an item was rewritten to NULL then delete it
+            const unsigned count = tree_array_count(a);
             size_t n = 0;
-            for (size_t i = 0; i < a->count; i++) {
-               if (a->items[i] != NULL)
-                  a->items[n++] = a->items[i];
+            for (size_t i = 0; i < count; i++) {
+               if (a->block->items[i] != NULL)
+                  a->block->items[n++] = a->block->items[i];
             }
-            a->count = n;
+            tree_array_resize(a, n, 0, false);
          }
          else if (ITEM_TYPE & mask)
             type_item = n;
@@ -428,18 +721,21 @@ object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx)
             ;
          else if (ITEM_TYPE_ARRAY & mask) {
             type_array_t *a = &(object->items[n].type_array);
-            for (unsigned i = 0; i < a->count; i++)
-               (void)object_rewrite((object_t *)a->items[i], ctx);
+            const unsigned count = type_array_count(a);
+            ctx->in_type++;
+            for (unsigned i = 0; i < count; i++)
+               (void)object_rewrite((object_t *)a->block->items[i], ctx);
+            ctx->in_type--;
          }
          else if (ITEM_RANGE_ARRAY & mask) {
             range_array_t *a = &(object->items[n].range_array);
-            for (unsigned i = 0; i < a->count; i++) {
-               a->items[i].left =
-                  (tree_t)object_rewrite((object_t *)a->items[i].left, ctx);
-               a->items[i].right =
-                  (tree_t)object_rewrite((object_t *)a->items[i].right, ctx);
-               assert(a->items[i].left);
-               assert(a->items[i].right);
+            const unsigned count = range_array_count(a);
+            for (unsigned i = 0; i < count; i++) {
+               range_t *r = &(a->block->items[i]);
+               r->left  = (tree_t)object_rewrite((object_t *)r->left, ctx);
+               r->right = (tree_t)object_rewrite((object_t *)r->right, ctx);
+               assert(r->left);
+               assert(r->right);
             }
          }
          else if (ITEM_TEXT_BUF & mask)
@@ -453,11 +749,11 @@ object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx)
    }
 
    if (unlikely(ctx->cache == NULL)) {
-      ctx->cache_size = MIN(4096, n_objects_alloc);
+      ctx->cache_size = MIN(4096, object_count_live());
       ctx->cache = xcalloc(sizeof(object_t *) * ctx->cache_size);
    }
    else if (unlikely(ctx->index >= ctx->cache_size)) {
-      assert(ctx->index < n_objects_alloc);
+      assert(ctx->index < object_count_live());
       while (ctx->index >= ctx->cache_size) {
          const size_t newsz = (ctx->cache_size * 3) / 2;
          ctx->cache = xrealloc(ctx->cache, newsz * sizeof(object_t *));
@@ -476,6 +772,15 @@ object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx)
       // Rewrite this tree before we rewrite the type as there may
       // be a circular reference
       object_t *new = (object_t *)(*ctx->fn)((tree_t)object, ctx->context);
+
+      // Trees only reachable through a type or replaced by one of their
+      // own children which was visited already are not visited again
+      const bool visit = ctx->visit != NULL && ctx->in_type == 0
+         && new != NULL
+         && (new == object || new->generation != ctx->generation);
+      if (visit)
+         (*ctx->visit)((tree_t)new, ctx->context);
+
       if (new != NULL && object != new) {
          new->generation = ctx->generation;
          new->index      = object->index;
@@ -485,13 +790,16 @@ object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx)
    else
       ctx->cache[object->index] = object;
 
-   if (type_item != -1)
+   if (type_item != -1) {
+      ctx->in_type++;
       (void)object_rewrite((object_t *)object->items[type_item].type, ctx);
+      ctx->in_type--;
+   }
 
    return ctx->cache[object->index];
 }
 
-void object_write(object_t *object, object_wr_ctx_t *ctx)
+static void object_write_aux(object_t *object, object_wr_ctx_t *ctx)
 {
    if (object == NULL) {
       write_u16(UINT16_C(0xffff), ctx->file);  // Null marker
@@ -523,20 +831,33 @@ void object_write(object_t *object, object_wr_ctx_t *ctx)
          if (ITEM_IDENT & mask)
             ident_write(object->items[n].ident, ctx->ident_ctx);
          else if (ITEM_TREE & mask)
-            object_write((object_t *)object->items[n].tree, ctx);
+            object_write_aux((object_t *)object->items[n].tree, ctx);
          else if (ITEM_TYPE & mask)
-            object_write((object_t *)object->items[n].type, ctx);
+            object_write_aux((object_t *)object->items[n].type, ctx);
          else if (ITEM_TREE_ARRAY & mask) {
-            const tree_array_t *a = &(object->items[n].tree_array);
-            write_u32(a->count, ctx->file);
-            for (unsigned i = 0; i < a->count; i++)
-               object_write((object_t *)a->items[i], ctx);
+            tree_array_t *a = &(object->items[n].tree_array);
+            object_force_array(a);
+            const unsigned count = tree_array_count(a);
+            write_u32(count, ctx->file);
+            if (object->index == 0 && (mask & I_DECLS)) {
+               // Declarations of the unit itself are deferred until
+               // after the rest of the unit has been written
+               ctx->n_segs = count;
+               ctx->segs   = xmalloc(sizeof(object_seg_t) * MAX(count, 1));
+               for (unsigned i = 0; i < count; i++)
+                  ctx->segs[i].object = (object_t *)a->block->items[i];
+            }
+            else {
+               for (unsigned i = 0; i < count; i++)
+                  object_write_aux((object_t *)a->block->items[i], ctx);
+            }
          }
          else if (ITEM_TYPE_ARRAY & mask) {
             const type_array_t *a = &(object->items[n].type_array);
-            write_u16(a->count, ctx->file);
-            for (unsigned i = 0; i < a->count; i++)
-               object_write((object_t *)a->items[i], ctx);
+            const unsigned count = type_array_count(a);
+            write_u16(count, ctx->file);
+            for (unsigned i = 0; i < count; i++)
+               object_write_aux((object_t *)a->block->items[i], ctx);
          }
          else if (ITEM_INT64 & mask)
             write_u64(object->items[n].ival, ctx->file);
@@ -544,16 +865,18 @@ void object_write(object_t *object, object_wr_ctx_t *ctx)
             write_u32(object->items[n].ival, ctx->file);
          else if (ITEM_NETID_ARRAY & mask) {
             const netid_array_t *a = &(object->items[n].netid_array);
-            write_u32(a->count, ctx->file);
-            for (unsigned i = 0; i < a->count; i++)
-               write_u32(a->items[i], ctx->file);
+            const unsigned count = netid_array_count(a);
+            write_u32(count, ctx->file);
+            for (unsigned i = 0; i < count; i++)
+               write_u32(a->block->items[i], ctx->file);
          }
          else if (ITEM_DOUBLE & mask)
             write_double(object->items[n].dval, ctx->file);
          else if (ITEM_ATTRS & mask) {
-            const attr_tab_t *attrs = &(object->items[n].attrs);
-            write_u16(attrs->num, ctx->file);
-            for (unsigned i = 0; i < attrs->num; i++) {
+            const attr_tab_t *attrs = object->items[n].attrs;
+            const unsigned num = (attrs == NULL) ? 0 : attrs->num;
+            write_u16(num, ctx->file);
+            for (unsigned i = 0; i < num; i++) {
                write_u16(attrs->table[i].kind, ctx->file);
                ident_write(attrs->table[i].name, ctx->ident_ctx);
 
@@ -567,7 +890,7 @@ void object_write(object_t *object, object_wr_ctx_t *ctx)
                   break;
 
                case A_TREE:
-                  object_write((object_t *)attrs->table[i].tval, ctx);
+                  object_write_aux((object_t *)attrs->table[i].tval, ctx);
                   break;
 
                case A_PTR:
@@ -577,11 +900,12 @@ void object_write(object_t *object, object_wr_ctx_t *ctx)
          }
          else if (ITEM_RANGE_ARRAY & mask) {
             range_array_t *a = &(object->items[n].range_array);
-            write_u16(a->count, ctx->file);
-            for (unsigned i = 0; i < a->count; i++) {
-               write_u8(a->items[i].kind, ctx->file);
-               object_write((object_t *)a->items[i].left, ctx);
-               object_write((object_t *)a->items[i].right, ctx);
+            const unsigned count = range_array_count(a);
+            write_u16(count, ctx->file);
+            for (unsigned i = 0; i < count; i++) {
+               write_u8(a->block->items[i].kind, ctx->file);
+               object_write_aux((object_t *)a->block->items[i].left, ctx);
+               object_write_aux((object_t *)a->block->items[i].right, ctx);
             }
          }
          else if (ITEM_TEXT_BUF & mask)
@@ -593,7 +917,27 @@ void object_write(object_t *object, object_wr_ctx_t *ctx)
    }
 }
 
-object_wr_ctx_t *object_write_begin(fbuf_t *f)
+void object_write(object_t *root, object_wr_ctx_t *ctx)
+{
+   object_write_aux(root, ctx);
+
+   // Each top-level declaration has its own identifier table so it can
+   // be read independently of the others
+   for (unsigned i = 0; i < ctx->n_segs; i++) {
+      // Begin the new context first so a shared identifier table stays
+      // locked for the whole unit
+      ident_wr_ctx_t next = ident_write_begin(ctx->file, ctx->ident_table);
+      ident_write_end(ctx->ident_ctx);
+      ctx->ident_ctx = next;
+
+      ctx->segs[i].pos   = fbuf_tell(ctx->file);
+      ctx->segs[i].first = ctx->n_objects;
+
+      object_write_aux(ctx->segs[i].object, ctx);
+   }
+}
+
+object_wr_ctx_t *object_write_begin(fbuf_t *f, ident_table_t *idents)
 {
    write_u32(format_digest, f);
    write_u8(standard(), f);
@@ -602,7 +946,10 @@ object_wr_ctx_t *object_write_begin(fbuf_t *f)
    ctx->file       = f;
    ctx->generation = next_generation++;
    ctx->n_objects  = 0;
-   ctx->ident_ctx  = ident_write_begin(f);
+   ctx->ident_ctx  = ident_write_begin(f, idents);
+   ctx->ident_table = idents;
+   ctx->segs       = NULL;
+   ctx->n_segs     = 0;
 
    return ctx;
 }
@@ -610,19 +957,121 @@ object_wr_ctx_t *object_write_begin(fbuf_t *f)
 void object_write_end(object_wr_ctx_t *ctx)
 {
    ident_write_end(ctx->ident_ctx);
+
+   // The segment table follows the last object and the footer records
+   // where it starts
+   const uint64_t table = fbuf_tell(ctx->file);
+
+   write_u32(ctx->n_objects, ctx->file);
+   write_u32(ctx->n_segs, ctx->file);
+   for (unsigned i = 0; i < ctx->n_segs; i++) {
+      write_u64(ctx->segs[i].pos, ctx->file);
+      write_u32(ctx->segs[i].first, ctx->file);
+   }
+
+   fbuf_set_footer(ctx->file, table);
+
+   free(ctx->segs);
    free(ctx);
 }
 
-object_t *object_read(object_rd_ctx_t *ctx, int tag)
+static void object_read_release(object_rd_ctx_t *ctx)
+{
+   fbuf_close(ctx->file);
+   free(ctx->store);
+   free(ctx->db_fname);
+
+   ctx->file  = NULL;
+   ctx->store = NULL;
+
+   for (object_rd_ctx_t **it = &lazy_readers; *it != NULL;
+        it = &((*it)->next)) {
+      if (*it == ctx) {
+         *it = ctx->next;
+         break;
+      }
+   }
+
+   // Otherwise the segments must remain as there may still be lazy
+   // array items pointing at them
+   if (ctx->n_segs == 0)
+      free(ctx);
+}
+
+static object_t *object_read_aux(object_rd_ctx_t *ctx, int tag);
+
+static object_t *object_read_seg(object_seg_t *seg)
+{
+   if (seg->object != NULL)
+      return seg->object;
+
+   object_rd_ctx_t *ctx = seg->reader;
+
+   // May be called while reading another segment
+   const bool nested = (ctx->ident_ctx != NULL);
+   const uint64_t pos = nested ? fbuf_tell(ctx->file) : 0;
+   const unsigned n_objects = ctx->n_objects;
+   ident_rd_ctx_t ident_ctx = ctx->ident_ctx;
+
+   fbuf_seek(ctx->file, seg->pos);
+   ctx->n_objects = seg->first;
+   ctx->ident_ctx = ident_read_begin(ctx->file, ctx->ident_table);
+
+   object_t *object = seg->object = object_read_aux(ctx, OBJECT_TAG_TREE);
+
+   ident_read_end(ctx->ident_ctx);
+   ctx->ident_ctx = ident_ctx;
+   ctx->n_objects = n_objects;
+
+   if (nested)
+      fbuf_seek(ctx->file, pos);
+
+   if (--(ctx->n_pending) == 0 && ctx->ended)
+      object_read_release(ctx);
+
+   return object;
+}
+
+static object_t *object_read_back_ref(object_rd_ctx_t *ctx, index_t index)
+{
+   if (unlikely(index >= ctx->store_sz))
+      fatal("%s: back reference to object %u out of range",
+            ctx->db_fname, index);
+
+   if (ctx->store[index] == NULL) {
+      // Read the last segment starting at or before this index
+      assert(ctx->n_segs > 0);
+      int low = 0, high = ctx->n_segs - 1;
+      while (low < high) {
+         const int mid = (low + high + 1) / 2;
+         if (ctx->segs[mid].first <= index)
+            low = mid;
+         else
+            high = mid - 1;
+      }
+
+      assert(ctx->segs[low].first <= index);
+      (void)object_read_seg(&(ctx->segs[low]));
+      assert(ctx->store[index] != NULL);
+   }
+
+   return ctx->store[index];
+}
+
+void object_force(tree_t *slot)
+{
+   assert(OBJECT_LAZY(*slot));
+   *slot = (tree_t)object_read_seg(object_lazy_seg(*slot));
+}
+
+static object_t *object_read_aux(object_rd_ctx_t *ctx, int tag)
 {
    uint16_t marker = read_u16(ctx->file);
    if (marker == UINT16_C(0xffff))
       return NULL;    // Null marker
    else if (marker == UINT16_C(0xfffe)) {
       // Back reference marker
-      index_t index = read_u32(ctx->file);
-      assert(index < ctx->n_objects);
-      return ctx->store[index];
+      return object_read_back_ref(ctx, read_u32(ctx->file));
    }
 
    const object_class_t *class = classes[tag];
@@ -638,10 +1087,8 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
    // This must be done early as a child node of this type may
    // reference upwards
    object->index = ctx->n_objects++;
-   if (ctx->n_objects == ctx->store_sz) {
-      ctx->store_sz *= 2;
-      ctx->store = xrealloc(ctx->store, ctx->store_sz * sizeof(tree_t));
-   }
+   if (unlikely(object->index >= ctx->store_sz))
+      fatal("%s: too many objects", ctx->db_fname);
    ctx->store[object->index] = object;
 
    const imask_t has = class->has_map[object->kind];
@@ -652,20 +1099,38 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
          if (ITEM_IDENT & mask)
             object->items[n].ident = ident_read(ctx->ident_ctx);
          else if (ITEM_TREE & mask)
-            object->items[n].tree = (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+            object->items[n].tree =
+               (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
          else if (ITEM_TYPE & mask)
-            object->items[n].tree = (tree_t)object_read(ctx, OBJECT_TAG_TYPE);
+            object->items[n].tree =
+               (tree_t)object_read_aux(ctx, OBJECT_TAG_TYPE);
          else if (ITEM_TREE_ARRAY & mask) {
             tree_array_t *a = &(object->items[n].tree_array);
-            tree_array_resize(a, read_u32(ctx->file), 0);
-            for (unsigned i = 0; i < a->count; i++)
-               a->items[i] = (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+            const unsigned count = read_u32(ctx->file);
+            tree_array_resize(a, count, 0, true);
+            if (object->index == 0 && (mask & I_DECLS)) {
+               // Declarations of the unit itself are read on demand
+               if (count != ctx->n_segs)
+                  fatal("%s: expected %u declaration segments but have %u",
+                        ctx->db_fname, count, ctx->n_segs);
+               for (unsigned i = 0; i < count; i++)
+                  a->block->items[i] =
+                     (tree_t)((uintptr_t)&(ctx->segs[i]) | 1);
+               ctx->n_pending = count;
+            }
+            else {
+               for (unsigned i = 0; i < count; i++)
+                  a->block->items[i] =
+                     (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
+            }
          }
          else if (ITEM_TYPE_ARRAY & mask) {
             type_array_t *a = &(object->items[n].type_array);
-            type_array_resize(a, read_u16(ctx->file), 0);
-            for (unsigned i = 0; i < a->count; i++)
-               a->items[i] = (type_t)object_read(ctx, OBJECT_TAG_TYPE);
+            const unsigned count = read_u16(ctx->file);
+            type_array_resize(a, count, 0, true);
+            for (unsigned i = 0; i < count; i++)
+               a->block->items[i] =
+                  (type_t)object_read_aux(ctx, OBJECT_TAG_TYPE);
          }
          else if (ITEM_INT64 & mask)
             object->items[n].ival = read_u64(ctx->file);
@@ -673,36 +1138,41 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
             object->items[n].ival = read_u32(ctx->file);
          else if (ITEM_RANGE_ARRAY & mask) {
             range_array_t *a = &(object->items[n].range_array);
-            range_array_resize(a, read_u16(ctx->file), 0);
-
-            for (unsigned i = 0; i < a->count; i++) {
-               a->items[i].kind  = read_u8(ctx->file);
-               a->items[i].left  =
-                  (tree_t)object_read(ctx, OBJECT_TAG_TREE);
-               a->items[i].right =
-                  (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+            const unsigned count = read_u16(ctx->file);
+            range_array_resize(a, count, 0, true);
+
+            for (unsigned i = 0; i < count; i++) {
+               a->block->items[i].kind  = read_u8(ctx->file);
+               a->block->items[i].left  =
+                  (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
+               a->block->items[i].right =
+                  (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
             }
          }
          else if (ITEM_TEXT_BUF & mask)
             ;
          else if (ITEM_NETID_ARRAY & mask) {
             netid_array_t *a = &(object->items[n].netid_array);
-            netid_array_resize(a, read_u32(ctx->file), 0xff);
-            for (unsigned i = 0; i < a->count; i++)
-               a->items[i] = read_u32(ctx->file);
+            const unsigned count = read_u32(ctx->file);
+            netid_array_resize(a, count, 0xff, true);
+            for (unsigned i = 0; i < count; i++)
+               a->block->items[i] = read_u32(ctx->file);
          }
          else if (ITEM_DOUBLE & mask)
             object->items[n].dval = read_double(ctx->file);
          else if (ITEM_ATTRS & mask) {
-            attr_tab_t *attrs = &(object->items[n].attrs);
-
-            attrs->num = read_u16(ctx->file);
-            if (attrs->num > 0) {
-               attrs->alloc = next_power_of_2(attrs->num);
-               attrs->table = xmalloc(sizeof(attr_t) * attrs->alloc);
+            const unsigned num = read_u16(ctx->file);
+            attr_tab_t *attrs = NULL;
+            if (num > 0) {
+               const unsigned alloc = next_power_of_2(num);
+               attrs = xmalloc(sizeof(attr_tab_t) + sizeof(attr_t) * alloc);
+               attrs->num   = num;
+               attrs->alloc = alloc;
             }
 
-            for (unsigned i = 0; i < attrs->num; i++) {
+            object->items[n].attrs = attrs;
+
+            for (unsigned i = 0; i < num; i++) {
                attrs->table[i].kind = read_u16(ctx->file);
                attrs->table[i].name = ident_read(ctx->ident_ctx);
 
@@ -717,7 +1187,7 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
 
                case A_TREE:
                   attrs->table[i].tval =
-                     (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+                     (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
                   break;
 
                default:
@@ -734,7 +1204,19 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
    return object;
 }
 
-object_rd_ctx_t *object_read_begin(fbuf_t *f, const char *fname)
+object_t *object_read(object_rd_ctx_t *ctx, int tag)
+{
+   object_t *root = object_read_aux(ctx, tag);
+
+   // Each declaration segment has its own identifier table
+   ident_read_end(ctx->ident_ctx);
+   ctx->ident_ctx = NULL;
+
+   return root;
+}
+
+object_rd_ctx_t *object_read_begin(fbuf_t *f, const char *fname,
+                                   ident_table_t *idents)
 {
    object_one_time_init();
 
@@ -753,22 +1235,47 @@ object_rd_ctx_t *object_read_begin(fbuf_t *f, const char *fname)
 
    object_rd_ctx_t *ctx = xcalloc(sizeof(object_rd_ctx_t));
    ctx->file      = f;
-   ctx->ident_ctx = ident_read_begin(f);
-   ctx->store_sz  = 256;
-   ctx->store     = xmalloc(ctx->store_sz * sizeof(object_t *));
    ctx->n_objects = 0;
    ctx->db_fname  = xstrdup(fname);
 
+   // Read the segment table from the end of the file
+   const uint64_t start = fbuf_tell(f);
+   fbuf_seek(f, fbuf_footer(f));
+
+   ctx->store_sz = read_u32(f);
+   ctx->n_segs   = read_u32(f);
+   ctx->segs     = xmalloc(sizeof(object_seg_t) * MAX(ctx->n_segs, 1));
+
+   for (unsigned i = 0; i < ctx->n_segs; i++) {
+      ctx->segs[i].pos    = read_u64(f);
+      ctx->segs[i].first  = read_u32(f);
+      ctx->segs[i].object = NULL;
+      ctx->segs[i].reader = ctx;
+   }
+
+   fbuf_seek(f, start);
+
+   ctx->store     = xcalloc(sizeof(object_t *) * MAX(ctx->store_sz, 1));
+   ctx->ident_table = idents;
+   ctx->ident_ctx   = ident_read_begin(f, idents);
+
+   ctx->next = lazy_readers;
+   lazy_readers = ctx;
+
    return ctx;
 }
 
 void object_read_end(object_rd_ctx_t *ctx)
 {
-   if (ctx->ident_ctx != NULL)
+   if (ctx->ident_ctx != NULL) {
       ident_read_end(ctx->ident_ctx);
-   free(ctx->store);
-   free(ctx->db_fname);
-   free(ctx);
+      ctx->ident_ctx = NULL;
+   }
+
+   // The file is kept open until every declaration has been read
+   ctx->ended = true;
+   if (ctx->n_pending == 0)
+      object_read_release(ctx);
 }
 
 unsigned object_next_generation(void)
@@ -810,14 +1317,17 @@ bool object_copy_mark(object_t *object, object_copy_ctx_t *ctx)
             ;
          else if (ITEM_TREE_ARRAY & mask) {
             tree_array_t *a = &(object->items[n].tree_array);
-            for (unsigned i = 0; i < a->count; i++)
-               marked = object_copy_mark((object_t *)a->items[i], ctx)
+            object_force_array(a);
+            const unsigned count = tree_array_count(a);
+            for (unsigned i = 0; i < count; i++)
+               marked = object_copy_mark((object_t *)a->block->items[i], ctx)
                   || marked;
          }
          else if (ITEM_TYPE_ARRAY & mask) {
             type_array_t *a = &(object->items[n].type_array);
-            for (unsigned i = 0; i < a->count; i++)
-               marked = object_copy_mark((object_t *)a->items[i], ctx)
+            const unsigned count = type_array_count(a);
+            for (unsigned i = 0; i < count; i++)
+               marked = object_copy_mark((object_t *)a->block->items[i], ctx)
                   || marked;
          }
          else if (ITEM_TYPE & mask)
@@ -828,11 +1338,11 @@ bool object_copy_mark(object_t *object, object_copy_ctx_t *ctx)
             ;
          else if (ITEM_RANGE_ARRAY & mask) {
             range_array_t *a = &(object->items[n].range_array);
-            for (unsigned i = 0; i < a->count; i++) {
-               marked = object_copy_mark((object_t *)a->items[i].left, ctx)
-                  || marked;
-               marked = object_copy_mark((object_t *)a->items[i].right, ctx)
-                  || marked;
+            const unsigned count = range_array_count(a);
+            for (unsigned i = 0; i < count; i++) {
+               range_t *r = &(a->block->items[i]);
+               marked = object_copy_mark((object_t *)r->left, ctx) || marked;
+               marked = object_copy_mark((object_t *)r->right, ctx) || marked;
             }
          }
          else if (ITEM_NETID_ARRAY & mask)
@@ -898,11 +1408,12 @@ object_t *object_copy_sweep(object_t *object, object_copy_ctx_t *ctx)
             const tree_array_t *from = &(object->items[n].tree_array);
             tree_array_t *to = &(copy->items[n].tree_array);
 
-            tree_array_resize(to, from->count, 0);
+            const unsigned count = tree_array_count(from);
+            tree_array_resize(to, count, 0, true);
 
-            for (size_t i = 0; i < from->count; i++)
-               to->items[i] = (tree_t)
-                  object_copy_sweep((object_t *)from->items[i], ctx);
+            for (size_t i = 0; i < count; i++)
+               to->block->items[i] = (tree_t)
+                  object_copy_sweep((object_t *)from->block->items[i], ctx);
          }
          else if (ITEM_TYPE & mask)
             copy->items[n].type = (type_t)
@@ -913,43 +1424,52 @@ object_t *object_copy_sweep(object_t *object, object_copy_ctx_t *ctx)
             const netid_array_t *from = &(object->items[n].netid_array);
             netid_array_t *to = &(copy->items[n].netid_array);
 
-            netid_array_resize(to, from->count, 0xff);
+            const unsigned count = netid_array_count(from);
+            netid_array_resize(to, count, 0xff, true);
 
-            for (unsigned i = 0; i < from->count; i++)
-               to->items[i] = from->items[i];
+            if (count > 0)
+               memcpy(to->block->items, from->block->items,
+                      count * sizeof(netid_t));
          }
          else if (ITEM_ATTRS & mask) {
-            if ((copy->items[n].attrs.num = object->items[n].attrs.num) > 0) {
-               copy->items[n].attrs.alloc = object->items[n].attrs.alloc;
-               copy->items[n].attrs.table =
-                  xmalloc(sizeof(attr_t) * copy->items[n].attrs.alloc);
-               for (unsigned i = 0; i < object->items[n].attrs.num; i++)
-                  copy->items[n].attrs.table[i] =
-                     object->items[n].attrs.table[i];
+            const attr_tab_t *from = object->items[n].attrs;
+            if (from != NULL && from->num > 0) {
+               const size_t size =
+                  sizeof(attr_tab_t) + sizeof(attr_t) * from->alloc;
+               attr_tab_t *to = xmalloc(size);
+               to->num   = from->num;
+               to->alloc = from->alloc;
+               memcpy(to->table, from->table, sizeof(attr_t) * from->num);
+
+               copy->items[n].attrs = to;
             }
          }
          else if (ITEM_RANGE_ARRAY & mask) {
             const range_array_t *from = &(object->items[n].range_array);
             range_array_t *to = &(copy->items[n].range_array);
-            range_array_resize(to, from->count, 0);
-
-            for (unsigned i = 0; i < from->count; i++) {
-               to->items[i].kind = from->items[i].kind;
-               to->items[i].left = (tree_t)
-                  object_copy_sweep((object_t *)from->items[i].left, ctx);
-               to->items[i].right = (tree_t)
-                  object_copy_sweep((object_t *)from->items[i].right, ctx);
+            const unsigned count = range_array_count(from);
+            range_array_resize(to, count, 0, true);
+
+            for (unsigned i = 0; i < count; i++) {
+               const range_t *fr = &(from->block->items[i]);
+               range_t *tr = &(to->block->items[i]);
+               tr->kind  = fr->kind;
+               tr->left  =
+                  (tree_t)object_copy_sweep((object_t *)fr->left, ctx);
+               tr->right =
+                  (tree_t)object_copy_sweep((object_t *)fr->right, ctx);
             }
          }
          else if (ITEM_TYPE_ARRAY & mask) {
             const type_array_t *from = &(object->items[n].type_array);
             type_array_t *to = &(copy->items[n].type_array);
 
-            type_array_resize(to, from->count, 0);
+            const unsigned count = type_array_count(from);
+            type_array_resize(to, count, 0, true);
 
-            for (unsigned i = 0; i < from->count; i++)
-               to->items[i] = (type_t)
-                  object_copy_sweep((object_t *)from->items[i], ctx);
+            for (unsigned i = 0; i < count; i++)
+               to->block->items[i] = (type_t)
+                  object_copy_sweep((object_t *)from->block->items[i], ctx);
          }
          else if (ITEM_TEXT_BUF & mask)
             ;
@@ -977,32 +1497,36 @@ void object_replace(object_t *t, object_t *a)
             const type_array_t *from = &(a->items[n].type_array);
             type_array_t *to = &(t->items[n].type_array);
 
-            type_array_resize(to, from->count, 0);
+            const unsigned count = type_array_count(from);
+            type_array_resize(to, count, 0, false);
 
-            for (unsigned i = 0; i < from->count; i++)
-               to->items[i] = from->items[i];
+            for (unsigned i = 0; i < count; i++)
+               to->block->items[i] = from->block->items[i];
          }
          else if (ITEM_TYPE & mask)
             t->items[n].type = a->items[n].type;
          else if (ITEM_TREE & mask)
             t->items[n].tree = a->items[n].tree;
          else if (ITEM_TREE_ARRAY & mask) {
-            const tree_array_t *from = &(a->items[n].tree_array);
+            tree_array_t *from = &(a->items[n].tree_array);
             tree_array_t *to = &(t->items[n].tree_array);
 
-            tree_array_resize(to, from->count, 0);
+            object_force_array(from);
+            const unsigned count = tree_array_count(from);
+            tree_array_resize(to, count, 0, false);
 
-            for (size_t i = 0; i < from->count; i++)
-               to->items[i] = from->items[i];
+            for (size_t i = 0; i < count; i++)
+               to->block->items[i] = from->block->items[i];
          }
          else if (ITEM_RANGE_ARRAY & mask) {
             const range_array_t *from = &(a->items[n].range_array);
             range_array_t *to = &(t->items[n].range_array);
 
-            range_array_resize(to, from->count, 0);
+            const unsigned count = range_array_count(from);
+            range_array_resize(to, count, 0, false);
 
-            for (unsigned i = 0; i < from->count; i++)
-               to->items[i] = from->items[i];
+            for (unsigned i = 0; i < count; i++)
+               to->block->items[i] = from->block->items[i];
          }
          else if (ITEM_TEXT_BUF & mask)
             ;
@@ -19,10 +19,10 @@
 #define _OBJECT_H
 
 #include "util.h"
-#include "array.h"
 #include "tree.h"
 #include "type.h"
 
+#include <assert.h>
 #include <stdint.h>
 
 //
@@ -106,11 +106,54 @@ typedef uint64_t imask_t;
 #define OBJECT_TAG_TREE  0
 #define OBJECT_TAG_TYPE  1
 
-DECLARE_ARRAY(netid);
-DECLARE_ARRAY(range);
-DECLARE_ARRAY(tree);
-DECLARE_ARRAY(type);
-DECLARE_ARRAY(ident);
+//
+// Arrays held in object items are a single pointer to a block with the
+// count and capacity followed by the elements so that every item fits
+// in eight bytes and an empty array needs no storage at all
+//
+
+#define DECLARE_ITEM_ARRAY(what)                                      \
+   typedef struct {                                                   \
+      uint32_t  count;                                                \
+      uint32_t  max;                                                  \
+      what##_t  items[0];                                             \
+   } what##_block_t;                                                  \
+                                                                      \
+   typedef struct {                                                   \
+      what##_block_t *block;                                          \
+   } what##_array_t;                                                  \
+                                                                      \
+   void what##_array_add(what##_array_t *a, what##_t t);              \
+   void what##_array_resize(what##_array_t *a, size_t n,              \
+                            uint8_t fill, bool packed);               \
+   void what##_array_free(what##_array_t *a);                         \
+                                                                      \
+   __attribute__ ((unused))                                           \
+   static inline unsigned what##_array_count(const what##_array_t *a) \
+   {                                                                  \
+      return a->block == NULL ? 0 : a->block->count;                  \
+   }                                                                  \
+                                                                      \
+   __attribute__ ((unused))                                           \
+   static inline what##_t *what##_array_nth_ptr(                      \
+      what##_array_t *a, unsigned n)                                  \
+   {                                                                  \
+      assert(n < what##_array_count(a));                              \
+      return &(a->block->items[n]);                                   \
+   }                                                                  \
+                                                                      \
+   __attribute__ ((unused))                                           \
+   static inline what##_t what##_array_nth(what##_array_t *a,         \
+                                           unsigned n)                \
+   {                                                                  \
+      assert(n < what##_array_count(a));                              \
+      return a->block->items[n];                                      \
+   }
+
+DECLARE_ITEM_ARRAY(netid);
+DECLARE_ITEM_ARRAY(range);
+DECLARE_ITEM_ARRAY(tree);
+DECLARE_ITEM_ARRAY(type);
 
 #define lookup_item(class, t, mask) ({                                  \
          assert((t) != NULL);                                           \
@@ -148,9 +191,9 @@ typedef struct {
 } attr_t;
 
 typedef struct {
-   uint16_t  alloc;
-   uint16_t  num;
-   attr_t   *table;
+   uint32_t num;
+   uint32_t alloc;
+   attr_t   table[0];
 } attr_tab_t;
 
 typedef union {
@@ -166,8 +209,7 @@ typedef union {
    range_array_t  range_array;
    text_buf_t    *text_buf;
    type_array_t   type_array;
-   attr_tab_t     attrs;
-   ident_array_t  ident_array;
+   attr_tab_t    *attrs;
 } item_t;
 
 typedef struct {
@@ -192,8 +234,10 @@ typedef struct {
    index_t           index;
    generation_t      generation;
    tree_rewrite_fn_t fn;
+   tree_visit_fn_t   visit;
    void             *context;
    size_t            cache_size;
+   unsigned          in_type;
 } object_rewrite_ctx_t;
 
 typedef struct {
@@ -204,6 +248,7 @@ typedef struct {
    tree_kind_t      kind;
    unsigned         generation;
    bool             deep;
+   bool             lazy;
 } object_visit_ctx_t;
 
 typedef int change_allowed_t[2];
@@ -222,21 +267,45 @@ typedef struct {
    int                    *item_lookup;
 } object_class_t;
 
+typedef struct object_rd_ctx object_rd_ctx_t;
+typedef struct object_arena object_arena_t;
+
+// The top-level declarations of a unit are each written as a separate
+// segment which is only read when the declaration is first accessed
+typedef struct {
+   uint64_t         pos;
+   index_t          first;
+   object_t        *object;
+   object_rd_ctx_t *reader;
+} object_seg_t;
+
 typedef struct {
    fbuf_t         *file;
    ident_wr_ctx_t  ident_ctx;
+   ident_table_t  *ident_table;
    unsigned        generation;
    unsigned        n_objects;
+   object_seg_t   *segs;
+   unsigned        n_segs;
 } object_wr_ctx_t;
 
-typedef struct {
-   fbuf_t         *file;
-   ident_rd_ctx_t  ident_ctx;
-   unsigned        n_objects;
-   object_t      **store;
-   unsigned        store_sz;
-   char           *db_fname;
-} object_rd_ctx_t;
+struct object_rd_ctx {
+   fbuf_t          *file;
+   ident_rd_ctx_t   ident_ctx;
+   ident_table_t   *ident_table;
+   unsigned         n_objects;
+   object_t       **store;
+   unsigned         store_sz;
+   char            *db_fname;
+   object_seg_t    *segs;
+   unsigned         n_segs;
+   unsigned         n_pending;
+   bool             ended;
+   object_rd_ctx_t *next;
+};
+
+// Array items not yet read from disk have the low bit set
+#define OBJECT_LAZY(p) ((uintptr_t)(p) & 1)
 
 __attribute__((noreturn))
 void object_lookup_failed(const char *name, const char **kind_text_map,
@@ -256,12 +325,19 @@ object_t *object_copy_sweep(object_t *object, object_copy_ctx_t *ctx);
 bool object_copy_mark(object_t *object, object_copy_ctx_t *ctx);
 void object_replace(object_t *t, object_t *a);
 
+object_arena_t *object_arena_new(void);
+void object_arena_push(object_arena_t *arena);
+void object_arena_pop(void);
+void object_arena_free(object_arena_t *arena);
+
 void object_write(object_t *object, object_wr_ctx_t *ctx);
-object_wr_ctx_t *object_write_begin(fbuf_t *f);
+object_wr_ctx_t *object_write_begin(fbuf_t *f, ident_table_t *idents);
 void object_write_end(object_wr_ctx_t *ctx);
 
-object_rd_ctx_t *object_read_begin(fbuf_t *f, const char *fname);
+object_rd_ctx_t *object_read_begin(fbuf_t *f, const char *fname,
+                                   ident_table_t *idents);
 void object_read_end(object_rd_ctx_t *ctx);
 object_t *object_read(object_rd_ctx_t *ctx, int tag);
+void object_force(tree_t *slot);
 
 #endif   // _OBJECT_H
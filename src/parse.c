@@ -59,7 +59,6 @@ static const char   *perm_linebuf = NULL;
 static ident_t       perm_file_name = NULL;
 static int           n_token_next_start = 0;
 static int           n_row = 0;
-static bool          last_was_newline = true;
 static loc_t         start_loc;
 static loc_t         last_loc;
 static const char   *read_ptr;
@@ -721,7 +720,7 @@ static bool p_cond_analysis_relation(void)
 
    case tID:
       {
-         char *name = last_lval.s;
+         const char *name = istr(last_lval.id);
          token_t rel = one_of(tEQ, tNEQ, tLT, tLE, tGT, tGE);
 
          if (consume(tSTRING)) {
@@ -759,8 +758,6 @@ static bool p_cond_analysis_relation(void)
 
             free(last_lval.s);
          }
-
-         free(name);
       }
       break;
    }
@@ -802,12 +799,8 @@ static ident_t p_identifier(void)
 {
    // basic_identifier | extended_identifier
 
-   if (consume(tID)) {
-      char *s = last_lval.s;
-      ident_t i = ident_new(s);
-      free(s);
-      return i;
-   }
+   if (consume(tID))
+      return last_lval.id;
    else
       return ident_new("error");
 }
@@ -5789,18 +5782,38 @@ static tree_t p_design_unit(void)
    return unit;
 }
 
-void begin_token(char *tok)
+static void next_line(void)
+{
+   // A newline at the very end of the file does not start a new row
+   const char *end = file_start + file_sz;
+   const char *nl = memchr(perm_linebuf, '\n', end - perm_linebuf);
+   if (nl != NULL && nl + 1 < end) {
+      perm_linebuf = nl + 1;
+      n_row++;
+   }
+}
+
+void begin_token(const char *tok, int length)
 {
-   const char *newline = strrchr(tok, '\n');
+   // Rows are counted from the newlines inside each token rather than
+   // as characters are read so the lexer can take its input in blocks
+   const char *newline = NULL;
+   for (const char *p = tok;
+        (p = memchr(p, '\n', tok + length - p)) != NULL;
+        p++) {
+      newline = p;
+      next_line();
+   }
+
    int n_token_start, n_token_length;
    if (newline != NULL) {
       n_token_start = 0;
-      n_token_length = strlen(tok) - (newline - tok);
+      n_token_length = length - (newline - tok);
       n_token_next_start = n_token_length - 1;
    }
    else {
       n_token_start = n_token_next_start;
-      n_token_length = strlen(tok);
+      n_token_length = length;
       n_token_next_start += n_token_length;
    }
 
@@ -5814,27 +5827,30 @@ void begin_token(char *tok)
    yylloc.linebuf      = perm_linebuf;
 }
 
-int get_next_char(char *b, int max_buffer)
+void rewind_token(int count)
 {
-   if (last_was_newline) {
-      n_row += 1;
-      perm_linebuf = read_ptr;
-      last_was_newline = false;
-   }
+   // The lexer has pushed back the last count characters of the token
+   // which never contain a newline
+   n_token_next_start -= count;
+   yylloc.last_column = MIN(n_token_next_start - 1, COLUMN_INVALID);
+}
 
-   const bool eof = read_ptr >= file_start + file_sz;
-   if (eof)
+int get_next_char(char *b, int max_buffer)
+{
+   const char *end = file_start + file_sz;
+   size_t n = MIN(end - read_ptr, max_buffer);
+   if (n == 0)
       return 0;
-   else
-      *b = *read_ptr++;
 
-   if (perm_linebuf == NULL)
-      perm_linebuf = read_ptr;
+   // A NUL character ends the input early
+   const char *nul = memchr(read_ptr, '\0', n);
+   if (nul != NULL)
+      n = nul - read_ptr;
 
-   if (*b == '\n')
-      last_was_newline = true;
+   memcpy(b, read_ptr, n);
+   read_ptr = (nul != NULL) ? end : read_ptr + n;
 
-   return *b == 0 ? 0 : 1;
+   return n;
 }
 
 void input_from_file(const char *file)
@@ -5858,9 +5874,9 @@ void input_from_file(const char *file)
       file_start = NULL;
 
    read_ptr           = file_start;
-   last_was_newline   = true;
+   perm_linebuf       = file_start;
    perm_file_name     = ident_new(file);
-   n_row              = 0;
+   n_row              = 1;
    n_token_next_start = 0;
 
    if (tokenq == NULL) {
@@ -5893,6 +5909,321 @@ tree_t parse(void)
       return unit;
 }
 
+static token_t scan_drop(void)
+{
+   // Discard the next token along with any string it carries
+
+   const token_t tok = peek();
+   drop_token();
+
+   switch (tok) {
+   case tSTRING:
+   case tBITSTRING:
+      free(last_lval.s);
+      break;
+   default:
+      break;
+   }
+
+   return tok;
+}
+
+static void scan_past(token_t tok)
+{
+   while (not_at_token(tok))
+      scan_drop();
+
+   if (peek() == tok)
+      scan_drop();
+}
+
+static ident_t scan_identifier(void)
+{
+   if (peek() != tID)
+      return NULL;
+
+   drop_token();
+   return last_lval.id;
+}
+
+static ident_t scan_selected_name(void)
+{
+   ident_t id = scan_identifier();
+   while (id != NULL && peek() == tDOT && peek_nth(2) == tID) {
+      scan_drop();
+      id = ident_prefix(id, scan_identifier(), '.');
+   }
+
+   return id;
+}
+
+static void scan_use_clause(tree_t unit, token_t kind)
+{
+   // Only the library and unit parts of each selected name matter for
+   // dependencies: anything naming an item inside the unit is skipped
+
+   scan_drop();
+
+   while (peek() == tID) {
+      ident_t lname = scan_identifier();
+
+      if (peek() == tDOT && peek_nth(2) == tID) {
+         scan_drop();
+
+         tree_t u = tree_new(kind == tUSE ? T_USE : T_CTXREF);
+         tree_set_ident(u, ident_prefix(lname, scan_identifier(), '.'));
+         tree_add_context(unit, u);
+      }
+
+      while (not_at_token(tCOMMA, tSEMI))
+         scan_drop();
+
+      if (peek() == tCOMMA)
+         scan_drop();
+   }
+
+   scan_past(tSEMI);
+}
+
+static void scan_context_clause(tree_t unit)
+{
+   for (;;) {
+      switch (peek()) {
+      case tLIBRARY:
+         scan_past(tSEMI);
+         break;
+
+      case tCONTEXT:
+         if (peek_nth(3) == tIS)
+            return;
+         // Fall-through
+      case tUSE:
+         scan_use_clause(unit, peek());
+         break;
+
+      default:
+         return;
+      }
+   }
+}
+
+static bool scan_subprogram_body(void)
+{
+   // Look past the subprogram specification to decide whether this is
+   // a body which will be closed by a matching end
+
+   int parens = 0;
+   for (int n = 2; ; n++) {
+      switch (peek_nth(n)) {
+      case tEOF:
+         return false;
+      case tLPAREN:
+         parens++;
+         break;
+      case tRPAREN:
+         parens--;
+         break;
+      case tSEMI:
+         if (parens == 0)
+            return false;
+         break;
+      case tIS:
+         if (parens == 0)
+            return peek_nth(n + 1) != tNEW;
+         break;
+      default:
+         break;
+      }
+   }
+}
+
+static void scan_unit_body(tree_t unit)
+{
+   // Skip to the end of the unit tracking only enough structure to
+   // find its final end and any entities instantiated by name: every
+   // nested construct other than a subprogram body must be closed by
+   // end followed by its keyword
+
+   const bool is_arch = (tree_kind(unit) == T_ARCH);
+
+   int nest = 0, parens = 0;
+   token_t last = tEOF;
+   for (;;) {
+      const token_t tok = peek();
+      switch (tok) {
+      case tEOF:
+         return;
+
+      case tLPAREN:
+         parens++;
+         break;
+
+      case tRPAREN:
+         parens--;
+         break;
+
+      case tFUNCTION:
+      case tPROCEDURE:
+         if (parens == 0 && last != tCOLON && scan_subprogram_body())
+            nest++;
+         break;
+
+      case tENTITY:
+         if (last == tCOLON || last == tUSE) {
+            scan_drop();
+
+            ident_t name = scan_selected_name();
+            if (name != NULL && is_arch) {
+               tree_t inst = tree_new(T_INSTANCE);
+               tree_set_class(inst, C_ENTITY);
+               tree_set_ident2(inst, name);
+               tree_add_stmt(unit, inst);
+            }
+
+            last = tID;
+            continue;
+         }
+         break;
+
+      case tEND:
+         scan_drop();
+
+         switch (peek()) {
+         case tIF:
+         case tCASE:
+         case tLOOP:
+         case tPROCESS:
+         case tPOSTPONED:
+         case tBLOCK:
+         case tGENERATE:
+         case tCOMPONENT:
+         case tRECORD:
+         case tUNITS:
+         case tPROTECTED:
+         case tFOR:
+            break;
+
+         case tFUNCTION:
+         case tPROCEDURE:
+            nest--;
+            break;
+
+         case tENTITY:
+         case tARCHITECTURE:
+         case tPACKAGE:
+         case tCONFIGURATION:
+         case tCONTEXT:
+            scan_past(tSEMI);
+            return;
+
+         default:
+            if (nest == 0) {
+               scan_past(tSEMI);
+               return;
+            }
+            else
+               nest--;
+         }
+
+         scan_past(tSEMI);
+         last = tSEMI;
+         continue;
+
+      default:
+         break;
+      }
+
+      last = scan_drop();
+   }
+}
+
+tree_t scan_unit(void)
+{
+   BEGIN("design unit");
+
+   tree_t unit = NULL;
+   while (unit == NULL) {
+      tree_t t = tree_new(T_DESIGN_UNIT);
+      scan_context_clause(t);
+
+      switch (peek()) {
+      case tEOF:
+         return NULL;
+
+      case tENTITY:
+         scan_drop();
+         tree_change_kind(t, T_ENTITY);
+         break;
+
+      case tARCHITECTURE:
+         scan_drop();
+         tree_change_kind(t, T_ARCH);
+         break;
+
+      case tPACKAGE:
+         scan_drop();
+         if (peek() == tBODY) {
+            scan_drop();
+            tree_change_kind(t, T_PACK_BODY);
+         }
+         else
+            tree_change_kind(t, T_PACKAGE);
+         break;
+
+      case tCONFIGURATION:
+         scan_drop();
+         tree_change_kind(t, T_CONFIGURATION);
+         break;
+
+      case tCONTEXT:
+         scan_drop();
+         tree_change_kind(t, T_CONTEXT);
+         break;
+
+      default:
+         // Not the start of a library unit so resynchronise at the
+         // next statement boundary
+         scan_past(tSEMI);
+         continue;
+      }
+
+      ident_t name = scan_identifier();
+      if (name == NULL) {
+         scan_unit_body(t);
+         continue;
+      }
+
+      tree_set_ident(t, name);
+
+      switch (tree_kind(t)) {
+      case T_ARCH:
+      case T_CONFIGURATION:
+         if (peek() == tOF) {
+            scan_drop();
+            tree_set_ident2(t, scan_identifier() ?: ident_new("error"));
+         }
+         else
+            tree_set_ident2(t, ident_new("error"));
+         break;
+
+      case T_CONTEXT:
+         scan_past(tIS);
+         scan_context_clause(t);
+         break;
+
+      default:
+         break;
+      }
+
+      scan_unit_body(t);
+
+      tree_set_loc(t, CURRENT_LOC);
+      unit = t;
+   }
+
+   return unit;
+}
+
 int parse_errors(void)
 {
    return n_errors;
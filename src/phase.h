@@ -45,9 +45,19 @@ void reset_eval_errors(void);
 // Rewrite to simpler forms
 void simplify(tree_t top, eval_flags_t flags);
 
+// Rewrite to simpler forms and perform static bounds checking on the
+// result in a single traversal
+void simplify_check(tree_t top, eval_flags_t flags);
+
 // Perform static bounds checking
 void bounds_check(tree_t top);
 
+// Bounds check a single tree which has already been simplified
+void bounds_check_tree(tree_t t);
+
+// True if bounds_check_tree has any checks for this kind of tree
+bool bounds_check_kind(tree_kind_t kind);
+
 // Number of errors found during bounds checking
 int bounds_errors(void);
 void reset_bounds_errors(void);
@@ -61,9 +71,20 @@ tree_t elab(tree_t top);
 // Set the value of a top-level generic
 void elab_set_generic(const char *name, const char *value);
 
+// True if the elaborated design and generated code for a top level
+// unit were built from the same design units, generics, and options
+bool elab_up_to_date(tree_t top);
+
+// Record the design units used by the last elaboration
+void elab_save_deps(tree_t e);
+
 // Generate LLVM bitcode for a design unit
 void cgen(tree_t top, vcode_unit_t vu);
 
+// Generate LLVM bitcode for an elaborated design lowering each process
+// only when it is needed and freeing its vcode straight afterwards
+void cgen_streamed(tree_t top, vcode_unit_t context);
+
 // Dump out a VHDL representation of the given unit
 void dump(tree_t top);
 
@@ -73,15 +94,39 @@ void dump_nets(tree_t top);
 // Groups nets which never have sub-elements assigned.
 void group_nets(tree_t top);
 
+// Remove signals which are never read and processes which only drive
+// them from an elaborated design
+void prune_design(tree_t top);
+
+// Always keep signals matching a glob or listed in BASE.include
+void prune_keep_glob(const char *glob);
+void prune_keep_file(const char *base);
+
+// Discard all patterns added by prune_keep_glob and prune_keep_file
+void prune_reset_keep(void);
+
 // Generate a makefile for the givein unit
 void make(tree_t *targets, int count, FILE *out);
 
+// Generate a makefile by scanning source files without analysing them
+void make_scan(const char **files, int count, FILE *out);
+
+// Analyse any of the given source files which are out of date running
+// up to max_jobs at once in dependency order
+typedef bool (*make_build_fn_t)(const char *file);
+bool make_build(const char **files, int count, int max_jobs,
+                make_build_fn_t fn);
+
 // Set parser input file
 void input_from_file(const char *file);
 
 // Read the next unit from the input file
 tree_t parse(void);
 
+// Skim the next unit from the input file for its name, context clause,
+// and directly instantiated entities without parsing it fully
+tree_t scan_unit(void);
+
 // Number of errors found while parsing last unit
 int parse_errors(void);
 void reset_parse_errors(void);
@@ -89,6 +134,13 @@ void reset_parse_errors(void);
 // Generate vcode for a design unit
 vcode_unit_t lower_unit(tree_t unit);
 
+// Generate vcode for the top-level declarations of an elaborated design
+// and then for each of its processes in turn so the caller can free
+// the code for one process before lowering the next
+vcode_unit_t lower_elab_begin(tree_t unit);
+vcode_unit_t lower_elab_process(tree_t proc, vcode_unit_t context);
+void lower_elab_end(void);
+
 // Generate vcode for an isolated function call
 vcode_unit_t lower_thunk(tree_t fcall);
 
@@ -0,0 +1,471 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "tree.h"
+#include "phase.h"
+#include "common.h"
+#include "hash.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Signals which are never read and the processes which only drive them
+// are removed from the elaborated design before nets are grouped. A
+// signal is live if it is read by a live process, shares a net with a
+// live signal, or is a root: a top-level port, a package signal, a
+// signal named by a keep pattern, or one referenced outside a process.
+// A process is live if it has an effect other than driving signals or
+// drives a live signal.
+
+typedef struct {
+   unsigned first;
+   unsigned count;
+} prune_span_t;
+
+typedef struct {
+   unsigned sig;
+   unsigned proc;
+} prune_edge_t;
+
+typedef struct {
+   hash_t       *index;
+   tree_t       *sigs;
+   unsigned      nsigs;
+   bool         *sig_live;
+   unsigned     *read_stamp;
+   unsigned     *drive_stamp;
+   unsigned     *refs;
+   unsigned      nrefs;
+   unsigned      maxrefs;
+   prune_edge_t *drives;
+   unsigned      ndrives;
+   unsigned      maxdrives;
+   prune_span_t *proc_refs;
+   bool         *proc_live;
+   unsigned      proc;
+   bool          effect;
+   unsigned     *stack;
+   unsigned      nstack;
+} prune_ctx_t;
+
+static char **keep_globs = NULL;
+static unsigned n_keep_globs = 0;
+
+void prune_keep_glob(const char *glob)
+{
+   keep_globs = xrealloc(keep_globs, (n_keep_globs + 1) * sizeof(char *));
+   keep_globs[n_keep_globs++] = xstrdup(glob);
+}
+
+void prune_reset_keep(void)
+{
+   for (unsigned i = 0; i < n_keep_globs; i++)
+      free(keep_globs[i]);
+   free(keep_globs);
+
+   keep_globs   = NULL;
+   n_keep_globs = 0;
+}
+
+void prune_keep_file(const char *base)
+{
+   // Signals included in a waveform dump at run time must be kept
+
+   char *name LOCAL = xasprintf("%s.include", base);
+
+   FILE *f = fopen(name, "r");
+   if (f == NULL)
+      return;
+
+   char line[1024];
+   while (fgets(line, sizeof(line), f) != NULL) {
+      char *hash = strchr(line, '#');
+      if (hash != NULL)
+         *hash = '\0';
+
+      char glob[1024];
+      if (sscanf(line, " %1023s ", glob) == 1)
+         prune_keep_glob(glob);
+   }
+
+   fclose(f);
+}
+
+static bool prune_glob_match(const char *glob, const char *str)
+{
+   while (*glob != '\0') {
+      if (*glob == '*') {
+         while (*glob == '*')
+            glob++;
+         if (*glob == '\0')
+            return true;
+
+         for (; *str != '\0'; str++) {
+            if (prune_glob_match(glob, str))
+               return true;
+         }
+         return false;
+      }
+      else if (*glob++ != *str++)
+         return false;
+   }
+
+   return *str == '\0';
+}
+
+static bool prune_is_root(tree_t decl)
+{
+   if (tree_flags(decl) & TREE_F_PACKAGE_SIGNAL)
+      return true;
+
+   const char *name = istr(tree_ident(decl));
+
+   // Ports of the top-level entity can be driven from VHPI
+   if (tree_attr_int(decl, fst_dir_i, -1) != -1) {
+      int depth = 0;
+      for (const char *p = name; *p != '\0'; p++)
+         depth += (*p == ':');
+      if (depth <= 2)
+         return true;
+   }
+
+   for (unsigned i = 0; i < n_keep_globs; i++) {
+      if (prune_glob_match(keep_globs[i], name))
+         return true;
+   }
+
+   return false;
+}
+
+static int prune_signal_index(tree_t ref, prune_ctx_t *ctx)
+{
+   tree_t decl = tree_ref(ref);
+   if (tree_kind(decl) != T_SIGNAL_DECL)
+      return -1;
+
+   return (uintptr_t)hash_get(ctx->index, decl) - 1;
+}
+
+static void prune_mark_signal(unsigned sig, prune_ctx_t *ctx)
+{
+   if (!ctx->sig_live[sig]) {
+      ctx->sig_live[sig] = true;
+      ctx->stack[ctx->nstack++] = sig;
+   }
+}
+
+static void prune_add_ref(unsigned sig, prune_ctx_t *ctx)
+{
+   if (ctx->read_stamp[sig] != ctx->proc + 1) {
+      ctx->read_stamp[sig] = ctx->proc + 1;
+      ARRAY_APPEND(ctx->refs, sig, ctx->nrefs, ctx->maxrefs);
+   }
+}
+
+static void prune_add_drive(unsigned sig, prune_ctx_t *ctx)
+{
+   if (ctx->drive_stamp[sig] != ctx->proc + 1) {
+      ctx->drive_stamp[sig] = ctx->proc + 1;
+      const prune_edge_t edge = { sig, ctx->proc };
+      ARRAY_APPEND(ctx->drives, edge, ctx->ndrives, ctx->maxdrives);
+   }
+}
+
+static void prune_target(tree_t target, prune_ctx_t *ctx)
+{
+   switch (tree_kind(target)) {
+   case T_REF:
+      {
+         tree_t decl = tree_ref(target);
+         if (tree_kind(decl) == T_ALIAS)
+            prune_target(tree_value(decl), ctx);
+         else {
+            const int sig = prune_signal_index(target, ctx);
+            if (sig >= 0)
+               prune_add_drive(sig, ctx);
+         }
+      }
+      break;
+   case T_ARRAY_REF:
+   case T_ARRAY_SLICE:
+   case T_RECORD_REF:
+      prune_target(tree_value(target), ctx);
+      break;
+   case T_AGGREGATE:
+      {
+         const int nassocs = tree_assocs(target);
+         for (int i = 0; i < nassocs; i++)
+            prune_target(tree_value(tree_assoc(target, i)), ctx);
+      }
+      break;
+   default:
+      // Anything else cannot be attributed to a signal
+      ctx->effect = true;
+      break;
+   }
+}
+
+static bool prune_local_var(tree_t target)
+{
+   switch (tree_kind(target)) {
+   case T_REF:
+      {
+         tree_t decl = tree_ref(target);
+         return tree_kind(decl) == T_VAR_DECL
+            && !(tree_flags(decl) & TREE_F_SHARED);
+      }
+   case T_ARRAY_REF:
+   case T_ARRAY_SLICE:
+   case T_RECORD_REF:
+      return prune_local_var(tree_value(target));
+   default:
+      return false;
+   }
+}
+
+static void prune_visit_fn(tree_t t, void *context)
+{
+   prune_ctx_t *ctx = context;
+
+   switch (tree_kind(t)) {
+   case T_REF:
+      {
+         const int sig = prune_signal_index(t, ctx);
+         if (sig >= 0)
+            prune_add_ref(sig, ctx);
+      }
+      break;
+   case T_SIGNAL_ASSIGN:
+      prune_target(tree_target(t), ctx);
+      break;
+   case T_VAR_ASSIGN:
+      if (!prune_local_var(tree_target(t)))
+         ctx->effect = true;
+      break;
+   case T_FCALL:
+      if (tree_flags(tree_ref(t)) & TREE_F_IMPURE)
+         ctx->effect = true;
+      break;
+   case T_ASSERT:
+   case T_PCALL:
+   case T_FILE_DECL:
+      ctx->effect = true;
+      break;
+   default:
+      break;
+   }
+}
+
+static bool prune_keep_decl(tree_t t, void *context)
+{
+   prune_ctx_t *ctx = context;
+
+   if (tree_kind(t) != T_SIGNAL_DECL)
+      return true;
+
+   const unsigned sig = (uintptr_t)hash_get(ctx->index, t) - 1;
+   return ctx->sig_live[sig];
+}
+
+static bool prune_keep_stmt(tree_t t, void *context)
+{
+   prune_ctx_t *ctx = context;
+   return ctx->proc_live[ctx->proc++];
+}
+
+void prune_design(tree_t top)
+{
+   assert(tree_kind(top) == T_ELAB);
+
+   const int nnets = tree_attr_int(top, nnets_i, 0);
+   const int ndecls = tree_decls(top);
+   const int nstmts = tree_stmts(top);
+
+   prune_ctx_t ctx;
+   memset(&ctx, '\0', sizeof(ctx));
+
+   ctx.index = hash_new(ndecls * 2, true);
+   ctx.sigs  = xmalloc(MAX(ndecls, 1) * sizeof(tree_t));
+
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) == T_SIGNAL_DECL) {
+         hash_put(ctx.index, d, (void *)(uintptr_t)(ctx.nsigs + 1));
+         ctx.sigs[ctx.nsigs++] = d;
+      }
+   }
+
+   const unsigned nsigs = MAX(ctx.nsigs, 1);
+   ctx.sig_live    = xcalloc(nsigs * sizeof(bool));
+   ctx.read_stamp  = xcalloc(nsigs * sizeof(unsigned));
+   ctx.drive_stamp = xcalloc(nsigs * sizeof(unsigned));
+   ctx.stack       = xmalloc(nsigs * sizeof(unsigned));
+   ctx.maxrefs     = 64;
+   ctx.refs        = xmalloc(ctx.maxrefs * sizeof(unsigned));
+   ctx.maxdrives   = 64;
+   ctx.drives      = xmalloc(ctx.maxdrives * sizeof(prune_edge_t));
+   ctx.proc_refs   = xmalloc(MAX(nstmts, 1) * sizeof(prune_span_t));
+   ctx.proc_live   = xcalloc(MAX(nstmts, 1) * sizeof(bool));
+
+   // Signals referenced from subprograms, aliases, and other
+   // declarations outside a process are always kept
+   ctx.proc = nstmts;
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) != T_SIGNAL_DECL)
+         tree_visit(d, prune_visit_fn, &ctx);
+   }
+
+   for (unsigned i = 0; i < ctx.nrefs; i++)
+      prune_mark_signal(ctx.refs[i], &ctx);
+   ctx.nrefs = ctx.ndrives = 0;
+
+   for (unsigned i = 0; i < ctx.nsigs; i++) {
+      if (prune_is_root(ctx.sigs[i]))
+         prune_mark_signal(i, &ctx);
+   }
+
+   for (int i = 0; i < nstmts; i++) {
+      tree_t p = tree_stmt(top, i);
+      assert(tree_kind(p) == T_PROCESS);
+
+      ctx.proc   = i;
+      ctx.effect = false;
+      ctx.proc_refs[i].first = ctx.nrefs;
+
+      tree_visit(p, prune_visit_fn, &ctx);
+
+      ctx.proc_refs[i].count = ctx.nrefs - ctx.proc_refs[i].first;
+      ctx.proc_live[i] = ctx.effect;
+   }
+
+   // Compressed lists of the processes driving each signal and of the
+   // signals sharing each net
+
+   prune_span_t *drivers = xcalloc(nsigs * sizeof(prune_span_t));
+   unsigned *driver_procs = xmalloc(MAX(ctx.ndrives, 1) * sizeof(unsigned));
+
+   for (unsigned i = 0; i < ctx.ndrives; i++)
+      drivers[ctx.drives[i].sig].count++;
+   for (unsigned i = 0, first = 0; i < ctx.nsigs; i++) {
+      drivers[i].first = first;
+      first += drivers[i].count;
+      drivers[i].count = 0;
+   }
+   for (unsigned i = 0; i < ctx.ndrives; i++) {
+      prune_span_t *s = &(drivers[ctx.drives[i].sig]);
+      driver_procs[s->first + s->count++] = ctx.drives[i].proc;
+   }
+
+   prune_span_t *owners = xcalloc(MAX(nnets, 1) * sizeof(prune_span_t));
+   unsigned total_nets = 0;
+
+   for (unsigned i = 0; i < ctx.nsigs; i++) {
+      const int count = tree_nets(ctx.sigs[i]);
+      for (int j = 0; j < count; j++)
+         owners[tree_net(ctx.sigs[i], j)].count++;
+      total_nets += count;
+
+      // A signal without any nets costs nothing at run time
+      if (count == 0)
+         prune_mark_signal(i, &ctx);
+   }
+
+   unsigned *owner_sigs = xmalloc(MAX(total_nets, 1) * sizeof(unsigned));
+
+   for (int i = 0, first = 0; i < nnets; i++) {
+      owners[i].first = first;
+      first += owners[i].count;
+      owners[i].count = 0;
+   }
+   for (unsigned i = 0; i < ctx.nsigs; i++) {
+      const int count = tree_nets(ctx.sigs[i]);
+      for (int j = 0; j < count; j++) {
+         prune_span_t *s = &(owners[tree_net(ctx.sigs[i], j)]);
+         owner_sigs[s->first + s->count++] = i;
+      }
+   }
+
+   // Propagate liveness from the roots and effectful processes: every
+   // signal is pushed on the stack at most once
+
+   for (int i = 0; i < nstmts; i++) {
+      if (ctx.proc_live[i]) {
+         const prune_span_t *r = &(ctx.proc_refs[i]);
+         for (unsigned j = 0; j < r->count; j++)
+            prune_mark_signal(ctx.refs[r->first + j], &ctx);
+      }
+   }
+
+   while (ctx.nstack > 0) {
+      const unsigned sig = ctx.stack[--ctx.nstack];
+
+      const int count = tree_nets(ctx.sigs[sig]);
+      for (int i = 0; i < count; i++) {
+         const prune_span_t *s = &(owners[tree_net(ctx.sigs[sig], i)]);
+         for (unsigned j = 0; j < s->count; j++)
+            prune_mark_signal(owner_sigs[s->first + j], &ctx);
+      }
+
+      const prune_span_t *d = &(drivers[sig]);
+      for (unsigned i = 0; i < d->count; i++) {
+         const unsigned proc = driver_procs[d->first + i];
+         if (!ctx.proc_live[proc]) {
+            ctx.proc_live[proc] = true;
+
+            const prune_span_t *r = &(ctx.proc_refs[proc]);
+            for (unsigned j = 0; j < r->count; j++)
+               prune_mark_signal(ctx.refs[r->first + j], &ctx);
+         }
+      }
+   }
+
+   unsigned dead_sigs = 0, dead_procs = 0;
+   for (unsigned i = 0; i < ctx.nsigs; i++)
+      dead_sigs += !ctx.sig_live[i];
+   for (int i = 0; i < nstmts; i++)
+      dead_procs += !ctx.proc_live[i];
+
+   if (dead_sigs > 0)
+      tree_filter_decls(top, prune_keep_decl, &ctx);
+
+   if (dead_procs > 0) {
+      ctx.proc = 0;
+      tree_filter_stmts(top, prune_keep_stmt, &ctx);
+   }
+
+   if (opt_get_int("verbose"))
+      notef("removed %u of %u signals and %d of %d processes", dead_sigs,
+            ctx.nsigs, dead_procs, nstmts);
+
+   hash_free(ctx.index);
+   free(ctx.sigs);
+   free(ctx.sig_live);
+   free(ctx.read_stamp);
+   free(ctx.drive_stamp);
+   free(ctx.stack);
+   free(ctx.refs);
+   free(ctx.drives);
+   free(ctx.proc_refs);
+   free(ctx.proc_live);
+   free(drivers);
+   free(driver_procs);
+   free(owners);
+   free(owner_sigs);
+}
@@ -0,0 +1,290 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "access.h"
+#include "rt.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if RT_MULTITHREAD
+#include <pthread.h>
+#endif
+
+// Objects created with VHDL allocators are typically small records such
+// as list nodes and scoreboard entries which are freed and allocated
+// again at a high rate. Small objects come from per-thread free lists
+// for a set of size classes and are carved out of larger slabs so the
+// common case never calls malloc. Objects freed on a different thread
+// join the free list of that thread.
+
+#define SLAB_SIZE  (64 * 1024)
+#define HEADER_SZ  16
+#define LARGE      UINT32_MAX
+
+typedef struct slab slab_t;
+typedef struct large large_t;
+typedef struct cache cache_t;
+
+struct slab {
+   slab_t *next;
+};
+
+// Objects larger than the biggest class come from malloc and are kept
+// on a single list so they can be released together
+struct large {
+   large_t  *prev;
+   large_t  *next;
+   uint64_t  size;
+   uint32_t  pad;
+   uint32_t  class;
+};
+
+// Header placed before each small object: the class is in the same
+// place relative to the object as for a large block
+typedef struct {
+   uint32_t pad[3];
+   uint32_t class;
+} header_t;
+
+STATIC_ASSERT(sizeof(header_t) == HEADER_SZ);
+STATIC_ASSERT(sizeof(large_t) % 8 == 0);
+
+static const uint32_t class_size[] = {
+   16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+#define NCLASSES ARRAY_LEN(class_size)
+
+struct cache {
+   void     *free[NCLASSES];
+   uint8_t  *bump;
+   size_t    bump_left;
+   slab_t   *slabs;
+   cache_t  *next;
+   uint64_t  allocs;
+   uint64_t  frees;
+   size_t    slab_bytes;
+};
+
+static RT_TLS cache_t *cache = NULL;
+static cache_t        *all_caches = NULL;
+static large_t        *large_list = NULL;
+static uint64_t        large_count = 0;
+static size_t          large_bytes = 0;
+#if RT_MULTITHREAD
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static cache_t *access_cache(void)
+{
+   if (likely(cache != NULL))
+      return cache;
+
+   cache = xcalloc(sizeof(cache_t));
+
+#if RT_MULTITHREAD
+   pthread_mutex_lock(&cache_lock);
+#endif
+   cache->next = all_caches;
+   all_caches = cache;
+#if RT_MULTITHREAD
+   pthread_mutex_unlock(&cache_lock);
+#endif
+
+   return cache;
+}
+
+static unsigned access_size_class(size_t size)
+{
+   unsigned low = 0, high = NCLASSES - 1;
+   while (low < high) {
+      const unsigned mid = (low + high) / 2;
+      if (class_size[mid] < size)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+
+   return low;
+}
+
+static void *access_alloc_large(size_t size)
+{
+   large_t *l = xmalloc(sizeof(large_t) + size);
+   l->prev  = NULL;
+   l->size  = size;
+   l->class = LARGE;
+
+#if RT_MULTITHREAD
+   pthread_mutex_lock(&cache_lock);
+#endif
+   l->next = large_list;
+   if (large_list != NULL)
+      large_list->prev = l;
+   large_list = l;
+
+   large_count++;
+   large_bytes += size;
+#if RT_MULTITHREAD
+   pthread_mutex_unlock(&cache_lock);
+#endif
+
+   return l + 1;
+}
+
+static void access_free_large(large_t *l)
+{
+#if RT_MULTITHREAD
+   pthread_mutex_lock(&cache_lock);
+#endif
+   if (l->prev != NULL)
+      l->prev->next = l->next;
+   else
+      large_list = l->next;
+   if (l->next != NULL)
+      l->next->prev = l->prev;
+
+   large_bytes -= l->size;
+#if RT_MULTITHREAD
+   pthread_mutex_unlock(&cache_lock);
+#endif
+
+   free(l);
+}
+
+static void *access_carve(cache_t *c, unsigned class)
+{
+   const size_t need = HEADER_SZ + class_size[class];
+
+   if (need > c->bump_left) {
+      slab_t *s = xmalloc(SLAB_SIZE);
+      s->next = c->slabs;
+      c->slabs = s;
+      c->slab_bytes += SLAB_SIZE;
+
+      // The remainder of the old slab is lost which is at most the
+      // size of the largest class
+      c->bump      = (uint8_t *)s + HEADER_SZ;
+      c->bump_left = SLAB_SIZE - HEADER_SZ;
+   }
+
+   header_t *h = (header_t *)c->bump;
+   h->class = class;
+   c->bump      += need;
+   c->bump_left -= need;
+
+   return h + 1;
+}
+
+void *access_alloc(size_t size)
+{
+   cache_t *c = access_cache();
+   c->allocs++;
+
+   if (unlikely(size > class_size[NCLASSES - 1]))
+      return access_alloc_large(size);
+
+   const unsigned class = access_size_class(MAX(size, 1));
+
+   void *ptr = c->free[class];
+   if (likely(ptr != NULL))
+      c->free[class] = *(void **)ptr;
+   else
+      ptr = access_carve(c, class);
+
+   return ptr;
+}
+
+void access_free(void *ptr)
+{
+   if (ptr == NULL)
+      return;
+
+   cache_t *c = access_cache();
+   c->frees++;
+
+   // The class field of a large block header is in the same place
+   const uint32_t class = ((header_t *)ptr - 1)->class;
+   if (unlikely(class == LARGE))
+      access_free_large((large_t *)ptr - 1);
+   else {
+      assert(class < NCLASSES);
+      *(void **)ptr = c->free[class];
+      c->free[class] = ptr;
+   }
+}
+
+void access_release_all(void)
+{
+   // Called at the end of the simulation when no generated code can
+   // hold a reference to an object any more
+
+#if RT_MULTITHREAD
+   pthread_mutex_lock(&cache_lock);
+#endif
+
+   for (cache_t *c = all_caches; c != NULL; c = c->next) {
+      for (slab_t *s = c->slabs, *next; s != NULL; s = next) {
+         next = s->next;
+         free(s);
+      }
+
+      memset(c->free, '\0', sizeof(c->free));
+      c->slabs      = NULL;
+      c->bump       = NULL;
+      c->bump_left  = 0;
+      c->slab_bytes = 0;
+   }
+
+   for (large_t *l = large_list, *next; l != NULL; l = next) {
+      next = l->next;
+      free(l);
+   }
+
+   large_list  = NULL;
+   large_bytes = 0;
+
+#if RT_MULTITHREAD
+   pthread_mutex_unlock(&cache_lock);
+#endif
+}
+
+void access_stats(access_stats_t *stats)
+{
+   memset(stats, '\0', sizeof(access_stats_t));
+
+#if RT_MULTITHREAD
+   pthread_mutex_lock(&cache_lock);
+#endif
+
+   for (cache_t *c = all_caches; c != NULL; c = c->next) {
+      stats->allocs     += c->allocs;
+      stats->frees      += c->frees;
+      stats->slab_bytes += c->slab_bytes;
+      stats->threads++;
+   }
+
+   stats->large       = large_count;
+   stats->large_bytes = large_bytes;
+
+#if RT_MULTITHREAD
+   pthread_mutex_unlock(&cache_lock);
+#endif
+}
@@ -0,0 +1,38 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _ACCESS_H
+#define _ACCESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+   uint64_t allocs;
+   uint64_t frees;
+   uint64_t large;
+   size_t   slab_bytes;
+   size_t   large_bytes;
+   unsigned threads;
+} access_stats_t;
+
+void *access_alloc(size_t size);
+void access_free(void *ptr);
+void access_release_all(void);
+void access_stats(access_stats_t *stats);
+
+#endif  // _ACCESS_H
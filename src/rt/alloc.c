@@ -19,6 +19,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 // Profiling shows a large proportion of simulation time is spent in
 // malloc and free. These routines provide a stack-based fixed-size
@@ -28,20 +29,25 @@
 
 struct rt_chunk {
    void       *ptr;
+   size_t      nitems;
+   size_t      nfree;
    rt_chunk_t *next;
 };
 
 static void rt_alloc_add_objects(rt_alloc_stack_t s, size_t n)
 {
    rt_chunk_t *c = xmalloc(sizeof(rt_chunk_t));
-   c->next = s->chunks;
-   c->ptr  = xmalloc(n * s->item_sz);
+   c->next   = s->chunks;
+   c->ptr    = xmalloc(n * s->item_sz);
+   c->nitems = n;
 
    char *p = c->ptr;
    for (int i = 0; i < n; i++, p += s->item_sz)
       rt_free(s, p);
 
    s->chunks = c;
+   s->n_chunks++;
+   s->peak_sz = MAX(s->peak_sz, s->stack_sz);
 }
 
 rt_alloc_stack_t rt_alloc_stack_new(size_t size, const char *name)
@@ -53,6 +59,9 @@ rt_alloc_stack_t rt_alloc_stack_new(size_t size, const char *name)
    s->item_sz   = size;
    s->name      = name;
    s->chunks    = NULL;
+   s->n_chunks  = 0;
+   s->peak_sz   = 0;
+   s->released  = 0;
 
    rt_alloc_add_objects(s, INIT_ITEMS);
 
@@ -87,3 +96,88 @@ void *rt_alloc_slow(rt_alloc_stack_t s)
 
    return s->stack[--s->stack_top];
 }
+
+static int rt_chunk_cmp(const void *a, const void *b)
+{
+   const uintptr_t pa = (uintptr_t)(*(rt_chunk_t * const *)a)->ptr;
+   const uintptr_t pb = (uintptr_t)(*(rt_chunk_t * const *)b)->ptr;
+   return (pa > pb) - (pa < pb);
+}
+
+static rt_chunk_t *rt_chunk_find(rt_chunk_t **sorted, size_t n,
+                                 size_t item_sz, const void *ptr)
+{
+   size_t low = 0, high = n;
+   while (low < high) {
+      const size_t mid = (low + high) / 2;
+      const char *base = sorted[mid]->ptr;
+      if ((const char *)ptr < base)
+         high = mid;
+      else if ((const char *)ptr >= base + sorted[mid]->nitems * item_sz)
+         low = mid + 1;
+      else
+         return sorted[mid];
+   }
+
+   return NULL;
+}
+
+size_t rt_alloc_stack_trim(rt_alloc_stack_t s)
+{
+   // Return chunks where every item is free to the system once more
+   // than three quarters of the items are unused. The first chunk is
+   // always kept so the stack is never empty.
+
+   if (s->n_chunks < 2 || s->stack_top * 4 <= s->stack_sz * 3)
+      return 0;
+
+   rt_chunk_t **sorted = xmalloc(s->n_chunks * sizeof(rt_chunk_t *));
+   size_t n = 0;
+   for (rt_chunk_t *c = s->chunks; c != NULL; c = c->next) {
+      c->nfree = 0;
+      sorted[n++] = c;
+   }
+
+   qsort(sorted, n, sizeof(rt_chunk_t *), rt_chunk_cmp);
+
+   for (size_t i = 0; i < s->stack_top; i++)
+      rt_chunk_find(sorted, n, s->item_sz, s->stack[i])->nfree++;
+
+   // The last chunk in the list is the one allocated first
+   size_t nitems = 0;
+   for (rt_chunk_t *c = s->chunks; c != NULL; c = c->next) {
+      if (c->next != NULL && c->nfree == c->nitems)
+         nitems += c->nitems;
+      else
+         c->nfree = 0;
+   }
+
+   if (nitems > 0) {
+      size_t top = 0;
+      for (size_t i = 0; i < s->stack_top; i++) {
+         rt_chunk_t *c = rt_chunk_find(sorted, n, s->item_sz, s->stack[i]);
+         if (c->nfree != c->nitems)
+            s->stack[top++] = s->stack[i];
+      }
+      s->stack_top = top;
+
+      for (rt_chunk_t **p = &(s->chunks); (*p)->next != NULL; ) {
+         rt_chunk_t *c = *p;
+         if (c->nfree == c->nitems) {
+            *p = c->next;
+            free(c->ptr);
+            free(c);
+            s->n_chunks--;
+         }
+         else
+            p = &(c->next);
+      }
+
+      s->stack_sz -= nitems;
+      s->stack = xrealloc(s->stack, sizeof(void *) * s->stack_sz);
+      s->released += nitems * s->item_sz;
+   }
+
+   free(sorted);
+   return nitems * s->item_sz;
+}
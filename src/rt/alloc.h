@@ -31,6 +31,9 @@ struct rt_alloc_stack {
    size_t      item_sz;
    const char *name;
    rt_chunk_t *chunks;
+   size_t      n_chunks;
+   size_t      peak_sz;
+   size_t      released;
 };
 
 typedef struct rt_alloc_stack *rt_alloc_stack_t;
@@ -38,6 +41,7 @@ typedef struct rt_alloc_stack *rt_alloc_stack_t;
 rt_alloc_stack_t rt_alloc_stack_new(size_t size, const char *name);
 void rt_alloc_stack_destroy(rt_alloc_stack_t stack);
 void *rt_alloc_slow(rt_alloc_stack_t stack);
+size_t rt_alloc_stack_trim(rt_alloc_stack_t stack);
 
 static inline void *rt_alloc(rt_alloc_stack_t s)
 {
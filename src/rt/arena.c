@@ -0,0 +1,185 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+// Signal values are carved sequentially out of large chunks so signals
+// allocated one after another share pages. Chunks are a multiple of the
+// usual huge page size so they can be backed by transparent huge pages.
+
+#define CHUNK_SIZE (2 * 1024 * 1024)
+#define ALIGN      16
+
+#define ALIGN_UP(x, n) (((x) + (n) - 1) & ~((size_t)(n) - 1))
+
+#define MPOL_BIND       2
+#define MPOL_INTERLEAVE 3
+
+typedef struct chunk chunk_t;
+
+struct chunk {
+   chunk_t *next;
+   size_t   size;
+   size_t   used;
+   uint8_t *base;
+};
+
+struct arena {
+   chunk_t *chunks;
+   unsigned flags;
+   int      node;
+   bool     warned;
+};
+
+arena_t arena_new(unsigned flags, int node)
+{
+   struct arena *a = xcalloc(sizeof(struct arena));
+   a->flags = flags;
+   a->node  = node;
+   return a;
+}
+
+static void arena_advise(arena_t a, void *ptr, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+   if ((a->flags & ARENA_HUGE_PAGES) && madvise(ptr, size, MADV_HUGEPAGE)
+       && !a->warned) {
+      warnf("cannot use huge pages for signal memory: %s", strerror(errno));
+      a->warned = true;
+   }
+#endif
+
+#if defined __linux__ && defined SYS_mbind
+   if (a->flags & (ARENA_INTERLEAVE | ARENA_BIND_NODE)) {
+      unsigned long mask[4];
+      int mode;
+      if (a->flags & ARENA_INTERLEAVE) {
+         memset(mask, 0xff, sizeof(mask));
+         mode = MPOL_INTERLEAVE;
+      }
+      else {
+         memset(mask, 0, sizeof(mask));
+         mask[a->node / (8 * sizeof(long))] |=
+            1ul << (a->node % (8 * sizeof(long)));
+         mode = MPOL_BIND;
+      }
+
+      if (syscall(SYS_mbind, ptr, size, mode, mask,
+                  8 * sizeof(mask) + 1, 0) && !a->warned) {
+         warnf("cannot set NUMA policy for signal memory: %s",
+               strerror(errno));
+         a->warned = true;
+      }
+   }
+#endif
+}
+
+static chunk_t *arena_new_chunk(arena_t a, size_t min)
+{
+   const size_t size = ALIGN_UP(MAX(min, CHUNK_SIZE), CHUNK_SIZE);
+
+   chunk_t *c = xmalloc(sizeof(chunk_t));
+   c->size = size;
+   c->used = 0;
+   c->next = a->chunks;
+
+#ifndef __MINGW32__
+   void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (ptr == MAP_FAILED)
+      fatal_errno("mmap");
+   c->base = ptr;
+#else
+   c->base = xmalloc(size);
+#endif
+
+   arena_advise(a, c->base, size);
+
+   return (a->chunks = c);
+}
+
+static void arena_free_chunk(chunk_t *c)
+{
+#ifndef __MINGW32__
+   munmap(c->base, c->size);
+#else
+   free(c->base);
+#endif
+   free(c);
+}
+
+void *arena_alloc(arena_t a, size_t size)
+{
+   size = ALIGN_UP(MAX(size, 1), ALIGN);
+
+   chunk_t *c = a->chunks;
+   if (c == NULL || c->size - c->used < size)
+      c = arena_new_chunk(a, size);
+
+   void *ptr = c->base + c->used;
+   c->used += size;
+   return ptr;
+}
+
+void arena_reset(arena_t a)
+{
+   // Keep the oldest chunk and discard the rest
+
+   while (a->chunks != NULL && a->chunks->next != NULL) {
+      chunk_t *next = a->chunks->next;
+      arena_free_chunk(a->chunks);
+      a->chunks = next;
+   }
+
+   if (a->chunks != NULL)
+      a->chunks->used = 0;
+}
+
+void arena_free(arena_t a)
+{
+   while (a->chunks != NULL) {
+      chunk_t *next = a->chunks->next;
+      arena_free_chunk(a->chunks);
+      a->chunks = next;
+   }
+
+   free(a);
+}
+
+size_t arena_size(arena_t a, unsigned *chunks)
+{
+   size_t total = 0;
+   *chunks = 0;
+   for (chunk_t *c = a->chunks; c != NULL; c = c->next, (*chunks)++)
+      total += c->used;
+   return total;
+}
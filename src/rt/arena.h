@@ -0,0 +1,37 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena *arena_t;
+
+typedef enum {
+   ARENA_HUGE_PAGES = (1 << 0),
+   ARENA_INTERLEAVE = (1 << 1),
+   ARENA_BIND_NODE  = (1 << 2)
+} arena_flags_t;
+
+arena_t arena_new(unsigned flags, int node);
+void arena_free(arena_t a);
+void *arena_alloc(arena_t a, size_t size);
+void arena_reset(arena_t a);
+size_t arena_size(arena_t a, unsigned *chunks);
+
+#endif  // _ARENA_H
@@ -0,0 +1,283 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "util.h"
+#include "rt.h"
+#include "bitvec.h"
+
+#include <string.h>
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#define BITVEC_X86 1
+#include <immintrin.h>
+#elif defined __aarch64__ && defined __ARM_NEON
+#define BITVEC_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Every operator is one of AND, OR or XOR of the two inputs followed by
+// an XOR with an inversion mask of zero or one. NOT is the inverted OR
+// of the left input with itself.
+
+typedef enum { BV_AND, BV_OR, BV_XOR } bv_base_t;
+
+typedef void (*bitvec_fn_t)(bv_base_t, uint8_t, const uint8_t *,
+                            const uint8_t *, uint8_t *, size_t);
+
+static void bitvec_select(bv_base_t, uint8_t, const uint8_t *,
+                          const uint8_t *, uint8_t *, size_t);
+
+static bitvec_fn_t bitvec_fn = bitvec_select;
+
+static void bitvec_scalar(bv_base_t base, uint8_t inv, const uint8_t *a,
+                          const uint8_t *b, uint8_t *out, size_t n)
+{
+   switch (base) {
+   case BV_AND:
+      for (size_t i = 0; i < n; i++)
+         out[i] = (a[i] & b[i]) ^ inv;
+      break;
+   case BV_OR:
+      for (size_t i = 0; i < n; i++)
+         out[i] = (a[i] | b[i]) ^ inv;
+      break;
+   case BV_XOR:
+      for (size_t i = 0; i < n; i++)
+         out[i] = (a[i] ^ b[i]) ^ inv;
+      break;
+   }
+}
+
+#if BITVEC_X86
+
+__attribute__((target("sse2")))
+static void bitvec_sse2(bv_base_t base, uint8_t inv, const uint8_t *a,
+                        const uint8_t *b, uint8_t *out, size_t n)
+{
+   const __m128i mask = _mm_set1_epi8(inv);
+
+   size_t i = 0;
+   for (; i + 16 <= n; i += 16) {
+      const __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+      const __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+
+      __m128i r;
+      switch (base) {
+      case BV_AND: r = _mm_and_si128(x, y); break;
+      case BV_OR:  r = _mm_or_si128(x, y); break;
+      default:     r = _mm_xor_si128(x, y); break;
+      }
+
+      _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(r, mask));
+   }
+
+   bitvec_scalar(base, inv, a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void bitvec_avx2(bv_base_t base, uint8_t inv, const uint8_t *a,
+                        const uint8_t *b, uint8_t *out, size_t n)
+{
+   const __m256i mask = _mm256_set1_epi8(inv);
+
+   size_t i = 0;
+   for (; i + 32 <= n; i += 32) {
+      const __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+      const __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+
+      __m256i r;
+      switch (base) {
+      case BV_AND: r = _mm256_and_si256(x, y); break;
+      case BV_OR:  r = _mm256_or_si256(x, y); break;
+      default:     r = _mm256_xor_si256(x, y); break;
+      }
+
+      _mm256_storeu_si256((__m256i *)(out + i), _mm256_xor_si256(r, mask));
+   }
+
+   bitvec_sse2(base, inv, a + i, b + i, out + i, n - i);
+}
+
+#elif BITVEC_NEON
+
+static void bitvec_neon(bv_base_t base, uint8_t inv, const uint8_t *a,
+                        const uint8_t *b, uint8_t *out, size_t n)
+{
+   const uint8x16_t mask = vdupq_n_u8(inv);
+
+   size_t i = 0;
+   for (; i + 16 <= n; i += 16) {
+      const uint8x16_t x = vld1q_u8(a + i);
+      const uint8x16_t y = vld1q_u8(b + i);
+
+      uint8x16_t r;
+      switch (base) {
+      case BV_AND: r = vandq_u8(x, y); break;
+      case BV_OR:  r = vorrq_u8(x, y); break;
+      default:     r = veorq_u8(x, y); break;
+      }
+
+      vst1q_u8(out + i, veorq_u8(r, mask));
+   }
+
+   bitvec_scalar(base, inv, a + i, b + i, out + i, n - i);
+}
+
+#endif
+
+static void bitvec_select(bv_base_t base, uint8_t inv, const uint8_t *a,
+                          const uint8_t *b, uint8_t *out, size_t n)
+{
+#if BITVEC_X86
+   __builtin_cpu_init();
+
+   if (__builtin_cpu_supports("avx2"))
+      bitvec_fn = bitvec_avx2;
+   else if (__builtin_cpu_supports("sse2"))
+      bitvec_fn = bitvec_sse2;
+   else
+      bitvec_fn = bitvec_scalar;
+#elif BITVEC_NEON
+   bitvec_fn = bitvec_neon;
+#else
+   bitvec_fn = bitvec_scalar;
+#endif
+
+   (*bitvec_fn)(base, inv, a, b, out, n);
+}
+
+void bitvec_op(int kind, const uint8_t *left, const uint8_t *right,
+               uint8_t *out, size_t n)
+{
+   switch (kind) {
+   case BIT_VEC_NOT:
+      (*bitvec_fn)(BV_OR, 1, left, left, out, n);
+      break;
+   case BIT_VEC_AND:
+      (*bitvec_fn)(BV_AND, 0, left, right, out, n);
+      break;
+   case BIT_VEC_OR:
+      (*bitvec_fn)(BV_OR, 0, left, right, out, n);
+      break;
+   case BIT_VEC_XOR:
+      (*bitvec_fn)(BV_XOR, 0, left, right, out, n);
+      break;
+   case BIT_VEC_XNOR:
+      (*bitvec_fn)(BV_XOR, 1, left, right, out, n);
+      break;
+   case BIT_VEC_NAND:
+      (*bitvec_fn)(BV_AND, 1, left, right, out, n);
+      break;
+   case BIT_VEC_NOR:
+      (*bitvec_fn)(BV_OR, 1, left, right, out, n);
+      break;
+   }
+}
+
+void bitvec_shift(int kind, const uint8_t *data, uint8_t *out, size_t len,
+                  size_t shift)
+{
+   // Element zero is the leftmost so a left shift moves data towards
+   // lower indices. Each case is at most two block copies or fills.
+
+   const size_t keep = len - shift;
+
+   switch (kind) {
+   case BIT_SHIFT_SLL:
+      memcpy(out, data + shift, keep);
+      memset(out + keep, 0, shift);
+      break;
+   case BIT_SHIFT_SRL:
+      memset(out, 0, shift);
+      memcpy(out + shift, data, keep);
+      break;
+   case BIT_SHIFT_SLA:
+      memcpy(out, data + shift, keep);
+      memset(out + keep, data[len - 1], shift);
+      break;
+   case BIT_SHIFT_SRA:
+      memset(out, data[0], shift);
+      memcpy(out + shift, data, keep);
+      break;
+   case BIT_SHIFT_ROL:
+      memcpy(out, data + shift, keep);
+      memcpy(out + keep, data, shift);
+      break;
+   case BIT_SHIFT_ROR:
+      memcpy(out, data + keep, shift);
+      memcpy(out + shift, data, keep);
+      break;
+   }
+}
+
+int bitvec_pack_bits(const uint8_t *in, size_t n, int bits)
+{
+   // Widen bits as required to hold every value in the input
+   uint8_t mask = 0;
+   for (size_t i = 0; i < n; i++)
+      mask |= in[i];
+
+   if (mask > 0xf)
+      return 8;
+   else if (mask > 1 || bits > 1)
+      return MAX(bits, 4);
+   else
+      return 1;
+}
+
+size_t bitvec_packed_size(size_t n, int bits)
+{
+   return (n * bits + 7) / 8;
+}
+
+void bitvec_pack(const uint8_t *in, uint8_t *out, size_t n, int bits)
+{
+   switch (bits) {
+   case 1:
+      memset(out, 0, bitvec_packed_size(n, 1));
+      for (size_t i = 0; i < n; i++)
+         out[i / 8] |= in[i] << (i % 8);
+      break;
+   case 4:
+      for (size_t i = 0; i + 1 < n; i += 2)
+         out[i / 2] = in[i] | (in[i + 1] << 4);
+      if (n % 2 == 1)
+         out[n / 2] = in[n - 1];
+      break;
+   default:
+      memcpy(out, in, n);
+      break;
+   }
+}
+
+void bitvec_unpack(const uint8_t *in, uint8_t *out, size_t n, int bits)
+{
+   switch (bits) {
+   case 1:
+      for (size_t i = 0; i < n; i++)
+         out[i] = (in[i / 8] >> (i % 8)) & 1;
+      break;
+   case 4:
+      for (size_t i = 0; i < n; i++)
+         out[i] = (in[i / 2] >> ((i % 2) * 4)) & 0xf;
+      break;
+   default:
+      memcpy(out, in, n);
+      break;
+   }
+}
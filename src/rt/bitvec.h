@@ -0,0 +1,42 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _BITVEC_H
+#define _BITVEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernels for operators on bit_vector data where each element is a
+// byte holding zero or one. The kind arguments are bit_vec_op_kind_t
+// and bit_shift_kind_t from rt.h. The output must not alias the inputs.
+
+void bitvec_op(int kind, const uint8_t *left, const uint8_t *right,
+               uint8_t *out, size_t n);
+void bitvec_shift(int kind, const uint8_t *data, uint8_t *out, size_t len,
+                  size_t shift);
+
+// Pack n byte values into one or four bits each, or unpack them again.
+// bitvec_pack_bits returns the narrowest of 1, 4 or 8 that holds every
+// value and bitvec_packed_size the number of bytes packed data needs.
+
+int bitvec_pack_bits(const uint8_t *in, size_t n, int bits);
+size_t bitvec_packed_size(size_t n, int bits);
+void bitvec_pack(const uint8_t *in, uint8_t *out, size_t n, int bits);
+void bitvec_unpack(const uint8_t *in, uint8_t *out, size_t n, int bits);
+
+#endif  // _BITVEC_H
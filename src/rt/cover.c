@@ -17,11 +17,22 @@
 
 #include "util.h"
 #include "cover.h"
+#include "lib.h"
+#include "fbuf.h"
+#include "hash.h"
+#include "rt.h"
 
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if RT_MULTITHREAD
+#include <pthread.h>
+#endif
 
 #if 0
 #define CSS_DIR "/home/nick/nvc/data/"
@@ -32,6 +43,8 @@
 #define PERCENT_RED    50.0f
 #define PERCENT_ORANGE 90.0f
 
+#define COVER_DB_MAGIC 0x4e564356   // NVCV
+
 typedef struct cover_hl cover_hl_t;
 typedef struct cover_file cover_file_t;
 
@@ -48,22 +61,31 @@ struct cover_hl {
    const char *help;
 };
 
+// Only lines with a statement or condition are recorded here: the
+// source text is streamed from a mapping when the report is written
 typedef struct {
-   char       *text;
-   size_t      len;
    int         hits;
    cover_hl_t *hl;
 } cover_line_t;
 
 struct cover_file {
    ident_t       name;
+   char         *path;
+   char         *url;
    cover_line_t *lines;
    unsigned      n_lines;
    unsigned      alloc_lines;
-   bool          valid;
    cover_file_t *next;
 };
 
+typedef struct {
+   cover_file_t **files;
+   int            count;
+   int            next;
+   const char    *dir;
+   const char    *nav;
+} cover_queue_t;
+
 typedef struct {
    int next_stmt_tag;
    int next_cond_tag;
@@ -90,6 +112,7 @@ static ident_t       sub_cond_i;
 static ident_t       builtin_i;
 static ident_t       std_bool_i;
 static cover_file_t *files;
+static hash_t       *file_map;
 static cover_stats_t stats;
 
 static void cover_tag_conditions(tree_t t, cover_tag_ctx_t *ctx, int branch)
@@ -131,6 +154,11 @@ static bool cover_has_conditions(tree_t t)
    }
 }
 
+static const tree_kind_t stmt_kinds[] = {
+   T_IF, T_WHILE, T_NEXT, T_EXIT, T_SIGNAL_ASSIGN, T_ASSERT, T_VAR_ASSIGN,
+   T_WAIT, T_RETURN, T_CASE
+};
+
 static bool cover_is_stmt(tree_t t)
 {
    switch (tree_kind(t)) {
@@ -165,7 +193,7 @@ static void cover_tag_visit_fn(tree_t t, void *context)
    }
 }
 
-void cover_tag(tree_t top)
+void cover_tag(tree_t top, cover_mode_t mode)
 {
    stmt_tag_i = ident_new("stmt_tag");
    cond_tag_i = ident_new("cond_tag");
@@ -178,24 +206,22 @@ void cover_tag(tree_t top)
       .next_cond_tag = 0
    };
 
-   tree_visit(top, cover_tag_visit_fn, &ctx);
+   tree_visit_kinds(top, cover_tag_visit_fn, &ctx,
+                    stmt_kinds, ARRAY_LEN(stmt_kinds));
 
    tree_add_attr_int(top, ident_new("stmt_tags"), ctx.next_stmt_tag);
    tree_add_attr_int(top, ident_new("cond_tags"), ctx.next_cond_tag);
+   tree_add_attr_int(top, ident_new("cover_mode"), mode);
 }
 
-static void cover_append_line(cover_file_t *f, const char *buf)
+static char *cover_file_url(ident_t name)
 {
-   if (f->n_lines == f->alloc_lines) {
-      f->alloc_lines *= 2;
-      f->lines = xrealloc(f->lines, f->alloc_lines * sizeof(cover_line_t));
+   char *url = xasprintf("report_%s.html", istr(name));
+   for (char *p = url; *(p + 5) != '\0'; p++) {
+      if (*p == PATH_SEP[0] || *p == '.')
+         *p = '_';
    }
-
-   cover_line_t *l = &(f->lines[(f->n_lines)++]);
-   l->text = xstrdup(buf);
-   l->len  = strlen(buf);
-   l->hits = -1;
-   l->hl   = NULL;
+   return url;
 }
 
 static cover_file_t *cover_file(const loc_t *loc)
@@ -203,49 +229,58 @@ static cover_file_t *cover_file(const loc_t *loc)
    if (loc->file == NULL)
       return NULL;
 
-   cover_file_t *f;
-   for (f = files; f != NULL; f = f->next) {
-      // Comparing pointers directly here is OK since only one copy
-      // of the file name string will be created by tree_read
-      if (f->name == loc->file)
-         return f->valid ? f : NULL;
-   }
+   if (file_map == NULL)
+      file_map = hash_new(64, true);
 
-   f = xmalloc(sizeof(cover_file_t));
-   f->name        = loc->file;
-   f->n_lines     = 0;
-   f->alloc_lines = 1024;
-   f->lines       = xmalloc(sizeof(cover_line_t) * f->alloc_lines);
-   f->next        = files;
+   // Hashing the pointer is OK since only one copy of the file name
+   // string will be created by tree_read
+   cover_file_t *f = hash_get(file_map, loc->file);
+   if (f != NULL)
+      return f->path != NULL ? f : NULL;
 
-   FILE *fp = fopen(istr(loc->file), "r");
+   f = xcalloc(sizeof(cover_file_t));
+   f->name = loc->file;
 
-   if (fp == NULL) {
+   if (access(istr(loc->file), R_OK) == 0)
+      f->path = xstrdup(istr(loc->file));
+   else {
       // Guess the path is relative to the work library
-      char *path LOCAL =
+      char *path =
          xasprintf("%s/../%s", lib_path(lib_work()), istr(loc->file));
-      fp = fopen(path, "r");
+      if (access(path, R_OK) == 0)
+         f->path = path;
+      else
+         free(path);
    }
 
-   if (fp == NULL) {
+   hash_put(file_map, loc->file, f);
+
+   if (f->path == NULL) {
       warnf("failed to open %s for coverage report", istr(loc->file));
-      f->valid = false;
+      return NULL;
    }
-   else {
-      f->valid = true;
-
-      while (!feof(fp)) {
-         char buf[1024];
-         if (fgets(buf, sizeof(buf), fp) != NULL)
-            cover_append_line(f, buf);
-         else if (ferror(fp))
-            fatal("error reading %s", istr(loc->file));
-      }
 
-      fclose(fp);
+   f->url  = cover_file_url(f->name);
+   f->next = files;
+   return (files = f);
+}
+
+static cover_line_t *cover_line(cover_file_t *f, unsigned line)
+{
+   assert(line > 0);
+
+   if (line > f->alloc_lines) {
+      const unsigned new_size = MAX(line, MAX(f->alloc_lines * 2, 256));
+      f->lines = xrealloc(f->lines, new_size * sizeof(cover_line_t));
+      f->alloc_lines = new_size;
    }
 
-   return (files = f);
+   for (; f->n_lines < line; f->n_lines++) {
+      f->lines[f->n_lines].hits = -1;
+      f->lines[f->n_lines].hl   = NULL;
+   }
+
+   return &(f->lines[line - 1]);
 }
 
 static void cover_report_conds(tree_t t, report_ctx_t *ctx)
@@ -258,16 +293,16 @@ static void cover_report_conds(tree_t t, report_ctx_t *ctx)
 
    const loc_t *loc = tree_loc(t);
    cover_file_t *file = cover_file(loc);
-   if ((file == NULL) || !file->valid)
+   if (file == NULL)
       return;
 
-   assert(loc->first_line < file->n_lines);
-
-   cover_line_t *l = &(file->lines[loc->first_line - 1]);
+   cover_line_t *l = cover_line(file, loc->first_line);
 
    const int start = loc->first_column;
+   // Highlights spanning several lines are closed at the end of the
+   // first line when the report is written
    const int end = (loc->last_line == loc->first_line)
-      ? loc->last_column : l->len;
+      ? loc->last_column : INT_MAX;
 
    const int sub_cond = tree_attr_int(t, sub_cond_i, 0);
    const int mask = (masks[tag] >> (sub_cond * 2)) & 3;
@@ -325,12 +360,10 @@ static void cover_report_fn(tree_t t, void *context)
 
    const loc_t *loc = tree_loc(t);
    cover_file_t *file = cover_file(loc);
-   if ((file == NULL) || !file->valid)
+   if (file == NULL)
       return;
 
-   assert(loc->first_line < file->n_lines);
-
-   cover_line_t *l = &(file->lines[loc->first_line - 1]);
+   cover_line_t *l = cover_line(file, loc->first_line);
    l->hits = MAX(counts[tag], l->hits);
 
    if (counts[tag] > 0)
@@ -339,11 +372,12 @@ static void cover_report_fn(tree_t t, void *context)
    stats.total_stmts++;
 }
 
-static void cover_report_line(FILE *fp, cover_line_t *l)
+static void cover_report_line(FILE *fp, const cover_line_t *l,
+                              const char *text, size_t len)
 {
    fprintf(fp, "<tr>");
 
-   if (l->hits != -1) {
+   if (l != NULL && l->hits != -1) {
       fprintf(fp, "<td>%d</td>", l->hits);
       fprintf(fp, "<td class=\"%s\">", (l->hits > 0) ? "hit" : "miss");
    }
@@ -352,69 +386,89 @@ static void cover_report_line(FILE *fp, cover_line_t *l)
       fprintf(fp, "<td>");
    }
 
+   cover_hl_t *hl = (l != NULL) ? l->hl : NULL;
+   int nopen = 0;
+
    int col = 0;
-   for (const char *p = l->text; *p != '\0'; p++, col++) {
-      for (cover_hl_t *it = l->hl; it != NULL; it = it->next) {
+   for (const char *p = text; p < text + len; p++, col++) {
+      for (cover_hl_t *it = hl; it != NULL; it = it->next) {
          if (it->start == col) {
             fprintf(fp, "<span class=\"hl_%s\"",
                     (it->kind == HL_HIT) ? "hit" : "miss");
             if (it->help != NULL)
                fprintf(fp, " title=\"%s\"", it->help);
             fprintf(fp, ">");
+            nopen++;
          }
       }
 
       switch (*p) {
       case ' ':
-         fprintf(fp, "&nbsp;");
+         fputs("&nbsp;", fp);
          break;
       case '\t':
          {
-            int col = (p - l->text);
+            int col = (p - text);
             while (++col % 8)
-               fprintf(fp, "&nbsp;");
+               fputs("&nbsp;", fp);
          }
          break;
       case '<':
-         fprintf(fp, "&lt;");
+         fputs("&lt;", fp);
          break;
       case '>':
-         fprintf(fp, "&gt;");
+         fputs("&gt;", fp);
+         break;
+      case '&':
+         fputs("&amp;", fp);
          break;
       default:
          fputc(*p, fp);
          break;
       }
 
-      for (cover_hl_t *it = l->hl; it != NULL; it = it->next) {
-         if (it->end == col)
-            fprintf(fp, "</span>");
+      for (cover_hl_t *it = hl; it != NULL; it = it->next) {
+         if (it->end == col && it->start <= col && nopen > 0) {
+            fputs("</span>", fp);
+            nopen--;
+         }
       }
    }
 
-   switch (*(l->text)) {
-   case '\n':
-   case '\r':
-   case '\0':
-      fprintf(fp, "&nbsp;");   // Equal height for empty lines
-      break;
-   }
+   for (; nopen > 0; nopen--)
+      fputs("</span>", fp);
+
+   if (len == 0 || *text == '\r')
+      fputs("&nbsp;", fp);   // Equal height for empty lines
 
-   fprintf(fp, "</td></tr>\n");
+   fputs("</td></tr>\n", fp);
 }
 
-static const char *cover_file_url(cover_file_t *f)
+static char *cover_html_nav(void)
 {
-   static char buf[256];
-   checked_sprintf(buf, sizeof(buf) - 6, "report_%s.html", istr(f->name));
-   for (char *p = buf; *(p + 5) != '\0'; p++) {
-      if (*p == PATH_SEP[0] || *p == '.')
-         *p = '_';
-   }
-   return buf;
+   // The navigation bar is identical on every page so is only
+   // formatted once
+   text_buf_t *tb = tb_new();
+   tb_printf(tb, "<div class=\"nav\">\n");
+   tb_printf(tb, "<h3>Reports</h3>\n");
+   tb_printf(tb, "<ul>\n");
+   tb_printf(tb, "  <li><a href=\"index.html\">Index</a></li>\n");
+   tb_printf(tb, "</ul>\n");
+   tb_printf(tb, "<h3>Files</h3>\n");
+   tb_printf(tb, "<ul class=\"nav\">\n");
+   for (cover_file_t *f = files; f != NULL; f = f->next)
+      tb_printf(tb, "  <li><a href=\"%s\">%s</a></li>\n",
+                f->url, istr(f->name));
+   tb_printf(tb, "</ul>\n");
+   tb_printf(tb, "</div>\n");
+
+   char *nav = xstrdup(tb_get(tb));
+   tb_free(tb);
+   return nav;
 }
 
-static void cover_html_header(FILE *fp, const char *title, ...)
+static void cover_html_header(FILE *fp, const char *nav,
+                              const char *title, ...)
 {
     fprintf(fp,
             "<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01//EN\">\n"
@@ -435,19 +489,7 @@ static void cover_html_header(FILE *fp, const char *title, ...)
             "</head>\n"
             "<body>\n");
 
-    fprintf(fp, "<div class=\"nav\">\n");
-    fprintf(fp, "<h3>Reports</h3>\n");
-    fprintf(fp, "<ul>\n");
-    fprintf(fp, "  <li><a href=\"index.html\">Index</a></li>\n");
-    fprintf(fp, "</ul>\n");
-    fprintf(fp, "<h3>Files</h3>\n");
-    fprintf(fp, "<ul class=\"nav\">\n");
-    for (cover_file_t *f = files; f != NULL; f = f->next)
-      fprintf(fp, "  <li><a href=\"%s\">%s</a></li>\n",
-              cover_file_url(f), istr(f->name));
-    fprintf(fp, "</ul>\n");
-    fprintf(fp, "</div>\n");
-
+    fputs(nav, fp);
 
     fprintf(fp, "<div id=\"body\">\n");
 }
@@ -457,25 +499,123 @@ static void cover_html_footer(FILE *fp)
    fprintf(fp, "</div></body>\n</html>\n");
 }
 
-static void cover_report_file(cover_file_t *f, const char *dir)
+static void cover_free_lines(cover_file_t *f)
+{
+   for (unsigned i = 0; i < f->n_lines; i++) {
+      for (cover_hl_t *it = f->lines[i].hl, *next; it != NULL; it = next) {
+         next = it->next;
+         free(it);
+      }
+   }
+
+   free(f->lines);
+   f->lines = NULL;
+   f->n_lines = f->alloc_lines = 0;
+}
+
+static void cover_report_file(cover_file_t *f, const char *dir,
+                              const char *nav)
 {
-   char *buf LOCAL = xasprintf("%s" PATH_SEP "%s", dir, cover_file_url(f));
+   char *buf LOCAL = xasprintf("%s" PATH_SEP "%s", dir, f->url);
    FILE *fp = lib_fopen(lib_work(), buf, "w");
    if (fp == NULL)
       fatal("failed to create %s", buf);
 
-   cover_html_header(fp, "Coverage report for %s", f->name);
+   cover_html_header(fp, nav, "Coverage report for %s", istr(f->name));
 
    fprintf(fp, "<table class=\"code\">\n");
-   for (int i = 0; i < f->n_lines; i++) {
-      cover_line_t *l = &(f->lines[i]);
-      cover_report_line(fp, l);
+
+   // Stream the source from a mapping rather than holding the text
+   // of every file in memory for the whole report
+   const int fd = open(f->path, O_RDONLY);
+   if (fd < 0)
+      fatal_errno("failed to open %s", f->path);
+
+   struct stat st;
+   if (fstat(fd, &st) != 0)
+      fatal_errno("fstat");
+
+   if (st.st_size > 0) {
+      const char *map = map_file(fd, st.st_size);
+      const char *end = map + st.st_size;
+
+      unsigned line = 0;
+      for (const char *p = map; p < end; line++) {
+         const char *nl = memchr(p, '\n', end - p);
+         const size_t len = (nl ? nl : end) - p;
+
+         const cover_line_t *l = (line < f->n_lines) ? &(f->lines[line]) : NULL;
+         cover_report_line(fp, l, p, len);
+
+         p += len + 1;
+      }
+
+      unmap_file((void *)map, st.st_size);
    }
+
+   close(fd);
+
    fprintf(fp, "</table>\n");
 
    cover_html_footer(fp);
 
    fclose(fp);
+
+   cover_free_lines(f);
+}
+
+#if RT_MULTITHREAD
+static void *cover_report_thread(void *arg)
+{
+   cover_queue_t *queue = arg;
+
+   int next;
+   while ((next = __atomic_fetch_add(&(queue->next), 1, __ATOMIC_RELAXED))
+          < queue->count)
+      cover_report_file(queue->files[next], queue->dir, queue->nav);
+
+   return NULL;
+}
+#endif
+
+static void cover_report_files(const char *dir, const char *nav)
+{
+   int nfiles = 0;
+   for (cover_file_t *f = files; f != NULL; f = f->next)
+      nfiles++;
+
+#if RT_MULTITHREAD
+   const long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+   const int nthreads = MIN(nprocs, nfiles);
+   if (nthreads > 1) {
+      cover_file_t **all = xmalloc(nfiles * sizeof(cover_file_t *));
+      int n = 0;
+      for (cover_file_t *f = files; f != NULL; f = f->next)
+         all[n++] = f;
+
+      cover_queue_t queue = {
+         .files = all,
+         .count = nfiles,
+         .next  = 0,
+         .dir   = dir,
+         .nav   = nav
+      };
+
+      pthread_t threads[nthreads];
+      for (int i = 0; i < nthreads; i++) {
+         if (pthread_create(&(threads[i]), NULL, cover_report_thread, &queue))
+            fatal_errno("pthread_create");
+      }
+
+      for (int i = 0; i < nthreads; i++)
+         pthread_join(threads[i], NULL);
+
+      free(all);
+   }
+   else
+#endif
+   for (cover_file_t *f = files; f != NULL; f = f->next)
+      cover_report_file(f, dir, nav);
 }
 
 static const char *cover_percent(unsigned x, unsigned y)
@@ -500,7 +640,7 @@ static void cover_stat_line(FILE *fp, const char *text,
    }
 }
 
-static void cover_index(ident_t name, const char *dir)
+static void cover_index(ident_t name, const char *dir, const char *nav)
 {
    char *buf = xasprintf("%s/index.html", dir);
    FILE *fp = lib_fopen(lib_work(), buf, "w");
@@ -508,7 +648,7 @@ static void cover_index(ident_t name, const char *dir)
       fatal("failed to create %s", buf);
    free(buf);
 
-   cover_html_header(fp, "Coverage report for %s", istr(name));
+   cover_html_header(fp, nav, "Coverage report for %s", istr(name));
 
    fprintf(fp, "<h1>Coverage report for %s</h1>\n", istr(name));
    fprintf(fp, "<div class=\"help\"><p>Select a file from the sidebar to see "
@@ -547,7 +687,8 @@ void cover_report(tree_t top, const int32_t *stmts, const int32_t *conds)
       .conds = conds
    };
 
-   tree_visit(top, cover_report_fn, &report_ctx);
+   tree_visit_kinds(top, cover_report_fn, &report_ctx,
+                    stmt_kinds, ARRAY_LEN(stmt_kinds));
 
    ident_t name = ident_strip(tree_ident(top), ident_new(".elab"));
 
@@ -556,10 +697,11 @@ void cover_report(tree_t top, const int32_t *stmts, const int32_t *conds)
    lib_t work = lib_work();
    lib_mkdir(work, dir);
 
-   for (cover_file_t *f = files; f != NULL; f = f->next)
-      cover_report_file(f, dir);
+   char *nav LOCAL = cover_html_nav();
 
-   cover_index(name, dir);
+   // The index is written last once all the statistics are complete
+   cover_report_files(dir, nav);
+   cover_index(name, dir, nav);
 
    char output[PATH_MAX];
    lib_realpath(work, dir, output, sizeof(output));
@@ -575,3 +717,152 @@ void cover_report(tree_t top, const int32_t *stmts, const int32_t *conds)
             stats.hit_conds, stats.total_conds);
    notef("%s", buf);
 }
+
+static void cover_fingerprint_fn(tree_t t, void *context)
+{
+   uint32_t *hash = context;
+
+   if (!cover_is_stmt(t))
+      return;
+
+   const int tag = tree_attr_int(t, stmt_tag_i, -1);
+   if (tag == -1)
+      return;
+
+   const loc_t *loc = tree_loc(t);
+   const uint32_t key[] = { tag, loc->first_line, loc->first_column };
+   for (int i = 0; i < ARRAY_LEN(key); i++)
+      *hash = (*hash ^ key[i]) * 16777619;
+}
+
+static uint32_t cover_fingerprint(tree_t top)
+{
+   // Hash of the source location of every statement tag so counters
+   // from a different elaboration of the design are not merged
+
+   stmt_tag_i = ident_new("stmt_tag");
+
+   uint32_t hash = 2166136261;
+   tree_visit_kinds(top, cover_fingerprint_fn, &hash,
+                    stmt_kinds, ARRAY_LEN(stmt_kinds));
+   return hash;
+}
+
+void cover_write(tree_t top, const int32_t *stmts, const int32_t *conds,
+                 const char *file)
+{
+   const int n_stmts = tree_attr_int(top, ident_new("stmt_tags"), 0);
+   const int n_conds =
+      (conds != NULL) ? tree_attr_int(top, ident_new("cond_tags"), 0) : 0;
+
+   fbuf_t *f = fbuf_open(file, FBUF_OUT);
+   if (f == NULL)
+      fatal_errno("failed to create coverage database %s", file);
+
+   const char *name = istr(tree_ident(top));
+   const size_t namelen = strlen(name);
+
+   write_u32(COVER_DB_MAGIC, f);
+   write_u32(namelen, f);
+   write_raw(name, namelen, f);
+   write_u32(cover_fingerprint(top), f);
+   write_u32(n_stmts, f);
+   write_u32(n_conds, f);
+   write_raw(stmts, n_stmts * sizeof(int32_t), f);
+   write_raw(conds, n_conds * sizeof(int32_t), f);
+
+   fbuf_close(f);
+}
+
+static void cover_merge_counts(int32_t *restrict acc,
+                               const int32_t *restrict in, size_t n)
+{
+   // Saturating addition written so the compiler can vectorise it
+   for (size_t i = 0; i < n; i++) {
+      const uint32_t sum = (uint32_t)acc[i] + (uint32_t)in[i];
+      acc[i] = MIN(sum, INT32_MAX);
+   }
+}
+
+static void cover_merge_masks(int32_t *restrict acc,
+                              const int32_t *restrict in, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      acc[i] |= in[i];
+}
+
+void cover_merge(const char **files, int nfiles, const char *output)
+{
+   char *name = NULL;
+   uint32_t fingerprint = 0, n_stmts = 0, n_conds = 0;
+   int32_t *stmts = NULL, *conds = NULL, *buf = NULL;
+
+   for (int i = 0; i < nfiles; i++) {
+      fbuf_t *f = fbuf_open(files[i], FBUF_IN);
+      if (f == NULL)
+         fatal_errno("failed to open coverage database %s", files[i]);
+
+      if (read_u32(f) != COVER_DB_MAGIC)
+         fatal("%s is not a coverage database or was created by a "
+               "different version of " PACKAGE, files[i]);
+
+      const size_t namelen = read_u32(f);
+      char *fname LOCAL = xmalloc(namelen + 1);
+      read_raw(fname, namelen, f);
+      fname[namelen] = '\0';
+
+      const uint32_t fp = read_u32(f);
+      const uint32_t ns = read_u32(f);
+      const uint32_t nc = read_u32(f);
+
+      if (name == NULL) {
+         name        = xstrdup(fname);
+         fingerprint = fp;
+         n_stmts     = ns;
+         n_conds     = nc;
+
+         stmts = xcalloc(MAX(n_stmts, 1) * sizeof(int32_t));
+         conds = xcalloc(MAX(n_conds, 1) * sizeof(int32_t));
+         buf   = xmalloc(MAX(MAX(n_stmts, n_conds), 1) * sizeof(int32_t));
+      }
+      else if (strcmp(name, fname) != 0)
+         fatal("coverage database %s is for design %s not %s",
+               files[i], fname, name);
+      else if (fp != fingerprint || ns != n_stmts || nc != n_conds)
+         fatal("coverage database %s was created by a different "
+               "elaboration of %s", files[i], name);
+
+      read_raw(buf, n_stmts * sizeof(int32_t), f);
+      cover_merge_counts(stmts, buf, n_stmts);
+
+      read_raw(buf, n_conds * sizeof(int32_t), f);
+      cover_merge_masks(conds, buf, n_conds);
+
+      fbuf_close(f);
+   }
+
+   tree_t top = lib_get(lib_work(), ident_new(name));
+   if (top == NULL)
+      fatal("design %s not found in library %s", name,
+            istr(lib_name(lib_work())));
+
+   // Find the statements once rather than walking the whole design for
+   // each of the passes below
+   tree_index_begin(top);
+
+   if (cover_fingerprint(top) != fingerprint)
+      fatal("design %s has been elaborated again since the coverage "
+            "databases were written", name);
+
+   if (output != NULL)
+      cover_write(top, stmts, n_conds > 0 ? conds : NULL, output);
+
+   cover_report(top, stmts, conds);
+
+   tree_index_end();
+
+   free(name);
+   free(stmts);
+   free(conds);
+   free(buf);
+}
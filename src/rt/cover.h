@@ -21,7 +21,21 @@
 #include "util.h"
 #include "tree.h"
 
-void cover_tag(tree_t top);
+typedef enum {
+   COVER_OFF,
+   COVER_COUNT,
+   COVER_ONCE,
+   COVER_SAMPLE
+} cover_mode_t;
+
+// In sampling mode statements are only counted once every this many
+// simulation cycles
+#define COVER_SAMPLE_PERIOD 16
+
+void cover_tag(tree_t top, cover_mode_t mode);
 void cover_report(tree_t top, const int32_t *stmts, const int32_t *conds);
+void cover_write(tree_t top, const int32_t *stmts, const int32_t *conds,
+                 const char *file);
+void cover_merge(const char **files, int nfiles, const char *output);
 
 #endif  // _COVER_H
@@ -22,6 +22,7 @@
 #include "fstapi.h"
 
 #include <assert.h>
+#include <string.h>
 
 static tree_t   fst_top;
 static void    *fst_ctx;
@@ -37,8 +38,9 @@ typedef struct {
 } fst_unit_t;
 
 typedef union {
-   const char *map;
-   fst_unit_t *units;
+   const char  *map;
+   fst_unit_t  *units;
+   const char **literals;
 } fst_type_t;
 
 struct fst_data {
@@ -48,6 +50,7 @@ struct fst_data {
    fst_type_t    type;
    size_t        size;
    watch_t      *watch;
+   char         *chars;
 };
 
 static void fst_close(void)
@@ -89,13 +92,34 @@ static void fst_fmt_physical(tree_t decl, watch_t *w, fst_data_t *data)
 static void fst_fmt_chars(tree_t decl, watch_t *w, fst_data_t *data)
 {
    const int nvals = data->size;
-   char buf[nvals + 1];
-   rt_watch_string(w, data->type.map, buf, nvals + 1);
+
+   size_t first, count;
+   rt_watch_changed(w, &first, &count);
+
+   // The previous string is kept so only the elements which changed
+   // are read and converted for wide vectors
+   if (data->chars == NULL || count >= nvals) {
+      if (data->chars == NULL)
+         data->chars = xmalloc(nvals + 1);
+      rt_watch_string(w, data->type.map, data->chars, nvals + 1);
+   }
+   else {
+      const char *map = data->type.map;
+      while (count > 0) {
+         uint64_t vals[64];
+         const size_t n = rt_watch_range(w, vals, first, MIN(count, 64));
+         for (size_t i = 0; i < n; i++)
+            data->chars[first + i] = map ? map[vals[i]] : vals[i];
+         first += n;
+         count -= n;
+      }
+   }
+
    if (likely(data->type.map != NULL))
-      fstWriterEmitValueChange(fst_ctx, data->handle, buf);
+      fstWriterEmitValueChange(fst_ctx, data->handle, data->chars);
    else
       fstWriterEmitVariableLengthValueChange(
-         fst_ctx, data->handle, buf, data->size);
+         fst_ctx, data->handle, data->chars, data->size);
 }
 
 static void fst_fmt_enum(tree_t decl, watch_t *w, fst_data_t *data)
@@ -103,8 +127,9 @@ static void fst_fmt_enum(tree_t decl, watch_t *w, fst_data_t *data)
    uint64_t val;
    rt_watch_value(w, &val, 1, false);
 
-   tree_t lit = type_enum_literal(tree_type(decl), val);
-   const char *str = istr(tree_ident(lit));
+   // The literal names were looked up when the signal was registered
+   // as this may run on the writer thread
+   const char *str = data->type.literals[val];
 
    fstWriterEmitVariableLengthValueChange(
       fst_ctx, data->handle, str, strlen(str));
@@ -138,6 +163,19 @@ static fst_unit_t *fst_make_unit_map(type_t type)
    return map;
 }
 
+static const char **fst_make_literal_map(type_t type)
+{
+   type_t base = type_base_recur(type);
+
+   const int nlits = type_enum_literals(base);
+
+   const char **map = xmalloc(nlits * sizeof(const char *));
+   for (int i = 0; i < nlits; i++)
+      map[i] = istr(tree_ident(type_enum_literal(base, i)));
+
+   return map;
+}
+
 static bool fst_can_fmt_chars(type_t type, fst_data_t *data,
                               enum fstVarType *vt,
                               enum fstSupplementalDataType *sdt)
@@ -252,6 +290,7 @@ static void fst_process_signal(tree_t d)
 
             vt = FST_VT_GEN_STRING;
             data->size = 0;
+            data->type.literals = fst_make_literal_map(type);
             data->fmt  = fst_fmt_enum;
          }
          else
@@ -306,6 +345,7 @@ static void fst_process_signal(tree_t d)
    tree_add_attr_ptr(d, fst_data_i, data);
 
    data->watch = rt_set_event_cb(d, fst_event_cb, data, true);
+   rt_watch_async(data->watch);
 }
 
 static void fst_process_hier(tree_t h)
@@ -365,7 +405,7 @@ void fst_restart(void)
       if (tree_kind(d) == T_SIGNAL_DECL) {
          fst_data_t *data = tree_attr_ptr(d, fst_data_i);
          if (likely(data != NULL))
-            fst_event_cb(0, d, data->watch, data);
+            fst_event_cb(rt_now(NULL), d, data->watch, data);
       }
    }
 }
@@ -378,9 +418,25 @@ void fst_init(const char *file, tree_t top)
    fstWriterSetFileType(fst_ctx, FST_FT_VHDL);
    fstWriterSetTimescale(fst_ctx, -15);
    fstWriterSetVersion(fst_ctx, PACKAGE_STRING);
-   fstWriterSetPackType(fst_ctx, 0);
    fstWriterSetRepackOnClose(fst_ctx, 1);
-   fstWriterSetParallelMode(fst_ctx, 0);
+
+   const char *compress = opt_get_str("wave-compress");
+   if (strcmp(compress, "lz4") == 0)
+      fstWriterSetPackType(fst_ctx, FST_WR_PT_LZ4);
+   else if (strcmp(compress, "fastlz") == 0)
+      fstWriterSetPackType(fst_ctx, FST_WR_PT_FASTLZ);
+   else
+      fstWriterSetPackType(fst_ctx, FST_WR_PT_ZLIB);
+
+   // Blocks are compressed and written on a separate thread by the
+   // writer library in parallel mode
+   const int threads = opt_get_int("wave-threads");
+#ifndef FST_WRITER_PARALLEL
+   if (threads > 1)
+      warnf("--wave-threads has no effect as nvc was built without "
+            "--enable-fst-pthread");
+#endif
+   fstWriterSetParallelMode(fst_ctx, threads > 1);
 
    atexit(fst_close);
 
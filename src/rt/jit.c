@@ -31,6 +31,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <inttypes.h>
 
 #ifdef HAVE_EXECINFO_H
 #include <execinfo.h>
@@ -43,7 +44,12 @@
 #include <dlfcn.h>
 #endif
 
-#define TRACE_MAX 10
+#ifdef __GLIBC__
+#include <link.h>
+#endif
+
+#define TRACE_MAX     10
+#define PERF_MAP_SIZE 4096
 
 #ifdef __MINGW32__
 #ifdef _WIN64
@@ -58,7 +64,46 @@ static size_t nmodules = 0, max_modules = 0;
 
 #endif
 
+static jit_lookup_fn_t jit_lookup = NULL;
+static jit_tier_fn_t   jit_tier = NULL;
+
+void jit_set_lookup(jit_lookup_fn_t fn)
+{
+   // Code for the top-level unit is held in memory rather than in a
+   // shared library and symbols are found through this callback
+   jit_lookup = fn;
+}
+
+void jit_set_tier_up(jit_tier_fn_t fn)
+{
+   jit_tier = fn;
+}
+
+bool jit_can_tier_up(void)
+{
+   return jit_tier != NULL;
+}
+
+void jit_tier_up(const char *name, void **result)
+{
+   // The address of the recompiled function is stored in result at
+   // some later point by another thread
+   assert(jit_tier != NULL);
+   (*jit_tier)(safe_symbol(name), result);
+}
+
 void *jit_find_symbol(const char *name, bool required)
+{
+   if (jit_lookup != NULL) {
+      void *sym = (*jit_lookup)(safe_symbol(name));
+      if (sym != NULL)
+         return sym;
+   }
+
+   return jit_find_native_symbol(name, required);
+}
+
+void *jit_find_native_symbol(const char *name, bool required)
 {
 #if (defined __MINGW32__ || defined __CYGWIN__) && !defined _WIN64
    if (*name == '_')
@@ -161,7 +206,8 @@ void jit_init(tree_t top)
          jit_load_module(tree_ident(c));
    }
 
-   jit_load_module(tree_ident(top));
+   if (jit_lookup == NULL)
+      jit_load_module(tree_ident(top));
 }
 
 void jit_shutdown(void)
@@ -257,3 +303,67 @@ void jit_trace(jit_trace_t **trace, size_t *count)
    *trace = NULL;
 #endif
 }
+
+static int jit_perf_sym_cmp(const void *a, const void *b)
+{
+   const uintptr_t aa = (uintptr_t)((const jit_perf_sym_t *)a)->addr;
+   const uintptr_t ba = (uintptr_t)((const jit_perf_sym_t *)b)->addr;
+   return (aa > ba) - (aa < ba);
+}
+
+static size_t jit_symbol_size(void *addr)
+{
+#ifdef __GLIBC__
+   Dl_info info;
+   const ElfW(Sym) *sym = NULL;
+   if (dladdr1(addr, &info, (void **)&sym, RTLD_DL_SYMENT)
+       && sym != NULL && info.dli_saddr == addr)
+      return sym->st_size;
+#endif
+
+   return 0;
+}
+
+void jit_write_perf_map(jit_perf_sym_t *syms, size_t count)
+{
+   // perf looks up addresses in anonymous memory such as JIT compiled
+   // code in /tmp/perf-PID.map which lists the start, size, and name
+   // of each function in hex
+
+#ifndef __MINGW32__
+   char *path LOCAL = xasprintf("/tmp/perf-%d.map", getpid());
+   FILE *f = fopen(path, "w");
+   if (f == NULL) {
+      warnf("cannot create %s: %s", path, strerror(errno));
+      return;
+   }
+
+   qsort(syms, count, sizeof(jit_perf_sym_t), jit_perf_sym_cmp);
+
+   for (size_t i = 0; i < count; i++) {
+      const uintptr_t addr = (uintptr_t)syms[i].addr;
+      if (addr == 0 || (i > 0 && syms[i - 1].addr == syms[i].addr))
+         continue;
+
+      // Code compiled by the JIT has no symbol table entry so assume
+      // each function extends to the start of the next
+      size_t size = jit_symbol_size(syms[i].addr);
+      for (size_t j = i + 1; size == 0 && j < count; j++) {
+         if ((uintptr_t)syms[j].addr > addr)
+            size = MIN((uintptr_t)syms[j].addr - addr, PERF_MAP_SIZE);
+      }
+
+      if (size == 0)
+         size = PERF_MAP_SIZE;
+
+      fprintf(f, "%" PRIxPTR " %zx %s", addr, size, syms[i].name);
+      if (syms[i].loc.file != NULL
+          && syms[i].loc.first_line != LINE_INVALID)
+         fprintf(f, " [%s:%u]", istr(syms[i].loc.file),
+                 syms[i].loc.first_line);
+      fputc('\n', f);
+   }
+
+   fclose(f);
+#endif  // __MINGW32__
+}
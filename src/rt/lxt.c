@@ -38,6 +38,7 @@ struct lxt_data {
    lxt_fmt_fn_t      fmt;
    range_kind_t      dir;
    const char       *map;
+   const char      **literals;
 };
 
 static struct lt_trace *trace = NULL;
@@ -70,8 +71,8 @@ static void lxt_fmt_enum(tree_t decl, watch_t *w, lxt_data_t *data)
    uint64_t val;
    rt_watch_value(w, &val, 1, false);
 
-   tree_t lit = type_enum_literal(tree_type(decl), val);
-   lt_emit_value_string(trace, data->sym, 0, (char *)istr(tree_ident(lit)));
+   // Do not touch the tree here: this is called from the writer thread
+   lt_emit_value_string(trace, data->sym, 0, (char *)data->literals[val]);
 }
 
 static void lxt_fmt_chars(tree_t decl, watch_t *w, lxt_data_t *data)
@@ -105,6 +106,17 @@ static char *lxt_fmt_name(tree_t decl)
    return s;
 }
 
+static const char **lxt_make_literal_map(type_t type)
+{
+   const int nlits = type_enum_literals(type);
+
+   const char **map = xmalloc(nlits * sizeof(const char *));
+   for (int i = 0; i < nlits; i++)
+      map[i] = istr(tree_ident(type_enum_literal(type, i)));
+
+   return map;
+}
+
 static bool lxt_can_fmt_enum_chars(type_t type, lxt_data_t *data, int *flags)
 {
    ident_t name = type_ident(type);
@@ -139,6 +151,10 @@ void lxt_restart(void)
    lt_symbol_bracket_stripping(trace, 0);
    lt_set_clock_compress(trace);
 
+   const uint64_t start = rt_now(NULL);
+   if (start > 0)
+      lt_set_time64(trace, start);
+
    const int ndecls = tree_decls(lxt_top);
    for (int i = 0; i < ndecls; i++) {
       tree_t d = tree_decl(lxt_top, i);
@@ -195,6 +211,7 @@ void lxt_restart(void)
 
          case T_ENUM:
             if (!lxt_can_fmt_enum_chars(base, data, &flags)) {
+               data->literals = lxt_make_literal_map(base);
                data->fmt = lxt_fmt_enum;
                flags = LT_SYM_F_STRING;
             }
@@ -215,6 +232,7 @@ void lxt_restart(void)
       tree_add_attr_ptr(d, lxt_data_i, data);
 
       watch_t *w = rt_set_event_cb(d, lxt_event_cb, data, true);
+      rt_watch_async(w);
 
       (*data->fmt)(d, w, data);
    }
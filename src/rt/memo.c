@@ -0,0 +1,237 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "memo.h"
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#define MEMO_X86 1
+#include <immintrin.h>
+#elif defined __aarch64__ && defined __ARM_NEON
+#define MEMO_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Each literal of an enumerated type with at most 16 values fits in
+// the four bits used as a shuffle index so a single-driver lookup is
+// one byte shuffle of tab1. For two drivers the row of tab2 selected by
+// the first driver is shuffled with the second driver's values once
+// per literal and merged under a mask of the lanes where the first
+// driver has that value.
+
+typedef void (*resolve1_fn_t)(const int8_t *, const int8_t *, int8_t *,
+                              size_t);
+typedef void (*resolve2_fn_t)(const int8_t (*)[16], int, const int8_t *,
+                              const int8_t *, int8_t *, size_t);
+
+static void resolve1_select(const int8_t *, const int8_t *, int8_t *, size_t);
+static void resolve2_select(const int8_t (*)[16], int, const int8_t *,
+                            const int8_t *, int8_t *, size_t);
+
+static resolve1_fn_t resolve1_fn = resolve1_select;
+static resolve2_fn_t resolve2_fn = resolve2_select;
+
+static void resolve1_scalar(const int8_t *tab1, const int8_t *in,
+                            int8_t *out, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      out[i] = tab1[(int)in[i]];
+}
+
+static void resolve2_scalar(const int8_t (*tab2)[16], int nlits,
+                            const int8_t *a, const int8_t *b, int8_t *out,
+                            size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      out[i] = tab2[(int)a[i]][(int)b[i]];
+}
+
+#if MEMO_X86
+
+__attribute__((target("ssse3")))
+static void resolve1_ssse3(const int8_t *tab1, const int8_t *in,
+                           int8_t *out, size_t n)
+{
+   const __m128i tab = _mm_loadu_si128((const __m128i *)tab1);
+
+   size_t i = 0;
+   for (; i + 16 <= n; i += 16) {
+      const __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+      _mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(tab, x));
+   }
+
+   resolve1_scalar(tab1, in + i, out + i, n - i);
+}
+
+__attribute__((target("ssse3")))
+static void resolve2_ssse3(const int8_t (*tab2)[16], int nlits,
+                           const int8_t *a, const int8_t *b, int8_t *out,
+                           size_t n)
+{
+   size_t i = 0;
+   for (; i + 16 <= n; i += 16) {
+      const __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+      const __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+
+      __m128i r = _mm_setzero_si128();
+      for (int j = 0; j < nlits; j++) {
+         const __m128i row = _mm_loadu_si128((const __m128i *)tab2[j]);
+         const __m128i mask = _mm_cmpeq_epi8(x, _mm_set1_epi8(j));
+         r = _mm_or_si128(r, _mm_and_si128(mask, _mm_shuffle_epi8(row, y)));
+      }
+
+      _mm_storeu_si128((__m128i *)(out + i), r);
+   }
+
+   resolve2_scalar(tab2, nlits, a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void resolve1_avx2(const int8_t *tab1, const int8_t *in,
+                          int8_t *out, size_t n)
+{
+   // The shuffle works within each 128-bit lane so the table is
+   // duplicated into both halves
+   const __m256i tab =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tab1));
+
+   size_t i = 0;
+   for (; i + 32 <= n; i += 32) {
+      const __m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+      _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(tab, x));
+   }
+
+   resolve1_ssse3(tab1, in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void resolve2_avx2(const int8_t (*tab2)[16], int nlits,
+                          const int8_t *a, const int8_t *b, int8_t *out,
+                          size_t n)
+{
+   size_t i = 0;
+   for (; i + 32 <= n; i += 32) {
+      const __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+      const __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+
+      __m256i r = _mm256_setzero_si256();
+      for (int j = 0; j < nlits; j++) {
+         const __m256i row = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)tab2[j]));
+         const __m256i mask = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(j));
+         r = _mm256_or_si256(
+            r, _mm256_and_si256(mask, _mm256_shuffle_epi8(row, y)));
+      }
+
+      _mm256_storeu_si256((__m256i *)(out + i), r);
+   }
+
+   resolve2_ssse3(tab2, nlits, a + i, b + i, out + i, n - i);
+}
+
+#elif MEMO_NEON
+
+static void resolve1_neon(const int8_t *tab1, const int8_t *in,
+                          int8_t *out, size_t n)
+{
+   const uint8x16_t tab = vld1q_u8((const uint8_t *)tab1);
+
+   size_t i = 0;
+   for (; i + 16 <= n; i += 16) {
+      const uint8x16_t x = vld1q_u8((const uint8_t *)(in + i));
+      vst1q_u8((uint8_t *)(out + i), vqtbl1q_u8(tab, x));
+   }
+
+   resolve1_scalar(tab1, in + i, out + i, n - i);
+}
+
+static void resolve2_neon(const int8_t (*tab2)[16], int nlits,
+                          const int8_t *a, const int8_t *b, int8_t *out,
+                          size_t n)
+{
+   size_t i = 0;
+   for (; i + 16 <= n; i += 16) {
+      const uint8x16_t x = vld1q_u8((const uint8_t *)(a + i));
+      const uint8x16_t y = vld1q_u8((const uint8_t *)(b + i));
+
+      uint8x16_t r = vdupq_n_u8(0);
+      for (int j = 0; j < nlits; j++) {
+         const uint8x16_t row = vld1q_u8((const uint8_t *)tab2[j]);
+         const uint8x16_t mask = vceqq_u8(x, vdupq_n_u8(j));
+         r = vorrq_u8(r, vandq_u8(mask, vqtbl1q_u8(row, y)));
+      }
+
+      vst1q_u8((uint8_t *)(out + i), r);
+   }
+
+   resolve2_scalar(tab2, nlits, a + i, b + i, out + i, n - i);
+}
+
+#endif
+
+static void memo_select_kernels(void)
+{
+#if MEMO_X86
+   __builtin_cpu_init();
+
+   if (__builtin_cpu_supports("avx2")) {
+      resolve1_fn = resolve1_avx2;
+      resolve2_fn = resolve2_avx2;
+   }
+   else if (__builtin_cpu_supports("ssse3")) {
+      resolve1_fn = resolve1_ssse3;
+      resolve2_fn = resolve2_ssse3;
+   }
+   else {
+      resolve1_fn = resolve1_scalar;
+      resolve2_fn = resolve2_scalar;
+   }
+#elif MEMO_NEON
+   resolve1_fn = resolve1_neon;
+   resolve2_fn = resolve2_neon;
+#else
+   resolve1_fn = resolve1_scalar;
+   resolve2_fn = resolve2_scalar;
+#endif
+}
+
+static void resolve1_select(const int8_t *tab1, const int8_t *in,
+                            int8_t *out, size_t n)
+{
+   memo_select_kernels();
+   (*resolve1_fn)(tab1, in, out, n);
+}
+
+static void resolve2_select(const int8_t (*tab2)[16], int nlits,
+                            const int8_t *a, const int8_t *b, int8_t *out,
+                            size_t n)
+{
+   memo_select_kernels();
+   (*resolve2_fn)(tab2, nlits, a, b, out, n);
+}
+
+void memo_resolve1(const int8_t tab1[16], const int8_t *in, int8_t *out,
+                   size_t n)
+{
+   (*resolve1_fn)(tab1, in, out, n);
+}
+
+void memo_resolve2(const int8_t tab2[16][16], int nlits, const int8_t *a,
+                   const int8_t *b, int8_t *out, size_t n)
+{
+   (*resolve2_fn)(tab2, nlits, a, b, out, n);
+}
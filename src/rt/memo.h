@@ -0,0 +1,32 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _MEMO_H
+#define _MEMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Table lookup kernels for memoised resolution functions of enumerated
+// types with at most 16 literals. The output may alias either input.
+
+void memo_resolve1(const int8_t tab1[16], const int8_t *in, int8_t *out,
+                   size_t n);
+void memo_resolve2(const int8_t tab2[16][16], int nlits, const int8_t *a,
+                   const int8_t *b, int8_t *out, size_t n);
+
+#endif  // _MEMO_H
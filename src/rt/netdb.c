@@ -17,59 +17,65 @@
 
 #include "netdb.h"
 #include "util.h"
+#include "lib.h"
 
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 netdb_t *netdb_open(tree_t top)
 {
-   char *name = xasprintf("_%s.netdb", istr(tree_ident(top)));
-   fbuf_t *f = lib_fbuf_open(lib_work(), name, FBUF_IN);
-   if (f == NULL)
+   char *name LOCAL = xasprintf("_%s.netdb", istr(tree_ident(top)));
+
+   char path[PATH_MAX];
+   lib_realpath(lib_work(), name, path, sizeof(path));
+
+   const int fd = open(path, O_RDONLY);
+   if (fd < 0)
       fatal("failed to open net database file %s", name);
-   free(name);
+
+   struct stat st;
+   if (fstat(fd, &st) != 0)
+      fatal_errno("fstat");
+
+   if (st.st_size < NETDB_HEADER_SZ * sizeof(uint32_t))
+      fatal("net database file %s is truncated", name);
 
    netdb_t *db = xmalloc(sizeof(struct netdb));
-   db->groups = NULL;
-   db->max    = 0;
-   db->nnets  = 0;
-
-   groupid_t gid;
-   while ((gid = read_u32(f)) != GROUPID_INVALID) {
-      group_t *g = xmalloc(sizeof(struct group));
-      g->next   = db->groups;
-      g->gid    = gid;
-      g->first  = read_u32(f);
-      g->length = read_u32(f);
-
-      db->groups = g;
-      db->max    = MAX(db->max, gid);
-      db->nnets  = MAX(db->nnets, g->first + g->length);
-   }
-
-   fbuf_close(f);
-
-   db->map = xmalloc(sizeof(groupid_t) * db->nnets);
-   for (netid_t i = 0; i < db->nnets; i++)
-      db->map[i] = GROUPID_INVALID;
-
-   for (group_t *it = db->groups; it != NULL; it = it->next) {
-      for (netid_t i = it->first; i < it->first + it->length; i++)
-         db->map[i] = it->gid;
-   }
+   db->mapsz = st.st_size;
+   db->map   = map_file(fd, db->mapsz);
+   close(fd);
+
+   const uint32_t *header = db->map;
+   if (header[0] != NETDB_MAGIC)
+      fatal("net database file %s was written by a different version "
+            "of " PACKAGE_NAME " and the design should be elaborated "
+            "again", name);
+
+   db->nnets   = header[1];
+   db->ngroups = header[2];
+   db->max     = header[3];
+
+   const size_t npages = (db->nnets + NETDB_PAGE_SIZE - 1) >> NETDB_PAGE_BITS;
+   const size_t expect = (NETDB_HEADER_SZ + db->ngroups * 3 + npages + 1)
+      * sizeof(uint32_t);
+   if (db->mapsz != expect)
+      fatal("net database file %s is corrupt", name);
+
+   db->first  = header + NETDB_HEADER_SZ;
+   db->length = db->first + db->ngroups;
+   db->gids   = db->length + db->ngroups;
+   db->pages  = db->gids + db->ngroups;
 
    return db;
 }
 
 void netdb_close(netdb_t *db)
 {
-   while (db->groups != NULL) {
-      group_t *next = db->groups->next;
-      free(db->groups);
-      db->groups = next;
-   }
-
-   free(db->map);
+   unmap_file(db->map, db->mapsz);
    free(db);
 }
 
@@ -78,8 +84,13 @@ unsigned netdb_size(netdb_t *db)
    return db->max + 1;
 }
 
+netid_t netdb_nets(netdb_t *db)
+{
+   return db->nnets;
+}
+
 void netdb_walk(netdb_t *db, netdb_walk_fn_t fn)
 {
-   for (group_t *it = db->groups; it != NULL; it = it->next)
-      (*fn)(it->gid, it->first, it->length);
+   for (unsigned i = 0; i < db->ngroups; i++)
+      (*fn)(db->gids[i], db->first[i], db->length[i]);
 }
@@ -35,35 +35,63 @@ typedef void (*netdb_walk_fn_t)(groupid_t, netid_t, unsigned);
 
 struct group {
    group_t  *next;
+   group_t  *prev;
+   group_t  *left;
+   group_t  *right;
+   uint32_t  priority;
    groupid_t gid;
    netid_t   first;
    unsigned  length;
 };
 
+// The database file is mapped directly: a header followed by the first
+// net, length, and group ID of each group sorted by first net, then a
+// page table giving the index of the group which contains the first
+// net of each page of NETDB_PAGE_SIZE nets
+#define NETDB_MAGIC      0x4e564e32   // NVN2
+#define NETDB_PAGE_BITS  6
+#define NETDB_PAGE_SIZE  (1 << NETDB_PAGE_BITS)
+#define NETDB_HEADER_SZ  4
+
 struct netdb {
-   group_t   *groups;
-   groupid_t *map;
-   netid_t    nnets;
-   unsigned   max;
+   const uint32_t  *first;
+   const uint32_t  *length;
+   const groupid_t *gids;
+   const uint32_t  *pages;
+   void            *map;
+   size_t           mapsz;
+   unsigned         ngroups;
+   netid_t          nnets;
+   unsigned         max;
 };
 
 netdb_t *netdb_open(tree_t top);
 void netdb_close(netdb_t *db);
 unsigned netdb_size(netdb_t *db);
+netid_t netdb_nets(netdb_t *db);
 void netdb_walk(netdb_t *db, netdb_walk_fn_t fn);
 
 static inline groupid_t netdb_lookup(const netdb_t *db, netid_t nid)
 {
+   // Most pages lie within a single group so the search below is
+   // usually skipped
+   const netid_t page = nid >> NETDB_PAGE_BITS;
+   unsigned lo = db->pages[page], hi = db->pages[page + 1];
+   while (lo < hi) {
+      const unsigned mid = (lo + hi + 1) / 2;
+      if (db->first[mid] <= nid)
+         lo = mid;
+      else
+         hi = mid - 1;
+   }
+
 #if NETDB_DEBUG
    assert(nid < db->nnets);
-   groupid_t gid = db->map[nid];
-   if (likely(gid != GROUPID_INVALID))
-      return gid;
-   else
+   if (unlikely(nid < db->first[lo] || nid >= db->first[lo] + db->length[lo]))
       fatal_trace("net %d not in database", nid);
-#else
-   return db->map[nid];
 #endif
+
+   return db->gids[lo];
 }
 
 #endif  // _NETDB_H
@@ -0,0 +1,164 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "rt.h"
+#include "tree.h"
+#include "common.h"
+#include "ntr.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+   int       sig;
+   unsigned  width;
+   watch_t  *watch;
+   uint64_t *values;
+} ntr_data_t;
+
+static ntr_writer_t *ntr_writer;
+static tree_t        ntr_top;
+static ident_t       ntr_data_i;
+
+static void ntr_finish(void)
+{
+   ntr_writer_close(ntr_writer, rt_now(NULL));
+}
+
+static void ntr_event_cb(uint64_t now, tree_t decl, watch_t *w, void *user)
+{
+   ntr_data_t *data = user;
+
+   // Each signal keeps its last value so only the elements which
+   // changed need to be read
+   size_t first, count;
+   rt_watch_changed(w, &first, &count);
+   rt_watch_range(w, data->values + first, first, count);
+
+   ntr_writer_emit(ntr_writer, data->sig, now, data->values);
+}
+
+static bool ntr_char_map(type_t type, text_buf_t *tb)
+{
+   const int nlits = type_enum_literals(type);
+   if (nlits > 256)
+      return false;
+
+   for (int i = 0; i < nlits; i++) {
+      const char *str = istr(tree_ident(type_enum_literal(type, i)));
+      if (str[0] != '\'')
+         return false;
+      tb_append(tb, str[1]);
+   }
+
+   return true;
+}
+
+static void ntr_process_signal(tree_t d)
+{
+   type_t type = tree_type(d);
+   type_t elem = type_is_array(type) ? type_elem(type) : type;
+   type_t base = type_base_recur(elem);
+
+   ntr_kind_t kind = NTR_RAW;
+   unsigned esize = sizeof(uint64_t);
+
+   LOCAL_TEXT_BUF tb = tb_new();
+   size_t maplen = 0;
+
+   switch (type_kind(base)) {
+   case T_ENUM:
+      {
+         const int nlits = type_enum_literals(base);
+         if (nlits <= 256)
+            esize = 1;
+
+         if (type_ident(base) == std_char_i && type_is_array(type))
+            kind = NTR_STRING;
+         else if (ntr_char_map(base, tb)) {
+            kind   = NTR_CHARS;
+            maplen = nlits;
+         }
+         else if (!type_is_array(type)) {
+            // Literal names are separated by NUL characters
+            for (int i = 0; i < nlits; i++) {
+               const char *str = istr(tree_ident(type_enum_literal(base, i)));
+               tb_printf(tb, "%s", str);
+               tb_append(tb, '\0');
+               maplen += strlen(str) + 1;
+            }
+
+            kind = NTR_ENUM;
+         }
+      }
+      break;
+
+   case T_INTEGER:
+   case T_PHYSICAL:
+      if (!type_is_array(type))
+         kind = NTR_INT;
+      break;
+
+   default:
+      break;
+   }
+
+   ntr_data_t *data = xmalloc(sizeof(ntr_data_t));
+   data->width  = tree_nets(d);
+   data->sig    = ntr_writer_add(ntr_writer, istr(tree_ident(d)), kind,
+                                 data->width, esize, tb_get(tb), maplen);
+   data->values = xcalloc(data->width * sizeof(uint64_t));
+
+   tree_add_attr_ptr(d, ntr_data_i, data);
+
+   data->watch = rt_set_event_cb(d, ntr_event_cb, data, true);
+   rt_watch_async(data->watch);
+}
+
+void ntr_restart(void)
+{
+   if (ntr_writer == NULL)
+      return;
+
+   const int ndecls = tree_decls(ntr_top);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(ntr_top, i);
+      if (tree_kind(d) == T_SIGNAL_DECL && wave_should_dump(d))
+         ntr_process_signal(d);
+   }
+
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(ntr_top, i);
+      if (tree_kind(d) == T_SIGNAL_DECL) {
+         ntr_data_t *data = tree_attr_ptr(d, ntr_data_i);
+         if (likely(data != NULL))
+            ntr_event_cb(rt_now(NULL), d, data->watch, data);
+      }
+   }
+}
+
+void ntr_init(const char *file, tree_t top)
+{
+   ntr_data_i = ident_new("ntr_data");
+
+   ntr_writer = ntr_writer_new(file);
+   ntr_top    = top;
+
+   atexit(ntr_finish);
+}
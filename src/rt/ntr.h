@@ -0,0 +1,61 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _NTR_H
+#define _NTR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Native trace files hold the raw values of each signal in chunks
+// appended as the simulation runs followed by an index of the chunks
+// for each signal which allows random access to the value at any time
+
+typedef enum {
+   NTR_RAW,      // Uninterpreted element values
+   NTR_CHARS,    // Each element is an index into the character map
+   NTR_STRING,   // Each element is a character code
+   NTR_INT,      // Scalar integer or physical value
+   NTR_ENUM      // Scalar enumeration with NUL separated literals as map
+} ntr_kind_t;
+
+typedef struct ntr_writer ntr_writer_t;
+typedef struct ntr_file ntr_file_t;
+
+ntr_writer_t *ntr_writer_new(const char *file);
+int ntr_writer_add(ntr_writer_t *w, const char *name, ntr_kind_t kind,
+                   unsigned width, unsigned esize, const char *map,
+                   size_t maplen);
+void ntr_writer_emit(ntr_writer_t *w, int sig, uint64_t when,
+                     const uint64_t *values);
+void ntr_writer_close(ntr_writer_t *w, uint64_t end_time);
+
+ntr_file_t *ntr_open(const char *file);
+void ntr_close(ntr_file_t *f);
+unsigned ntr_signals(ntr_file_t *f);
+int ntr_find(ntr_file_t *f, const char *name);
+const char *ntr_name(ntr_file_t *f, int sig);
+ntr_kind_t ntr_kind(ntr_file_t *f, int sig);
+unsigned ntr_width(ntr_file_t *f, int sig);
+const char *ntr_map(ntr_file_t *f, int sig, size_t *len);
+uint64_t ntr_end_time(ntr_file_t *f);
+size_t ntr_changes(ntr_file_t *f, int sig);
+bool ntr_value_at(ntr_file_t *f, int sig, uint64_t when, uint64_t *values);
+void ntr_export_fst(ntr_file_t *f, const char *file);
+
+#endif  // _NTR_H
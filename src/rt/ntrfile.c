@@ -0,0 +1,731 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "ntr.h"
+#include "heap.h"
+#include "fstapi.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// File layout, all fields in host byte order and aligned to their size:
+//
+//   header   magic[8] version:u32 bom:u32 timescale:i32 pad:u32
+//   chunk    sig:u32 count:u32 first:u64 last:u64 record[count]...
+//   index    nsigs:u32 pad:u32 signal[nsigs]...
+//   trailer  index:u64 end_time:u64 magic[8]
+//
+// Each record is an eight byte time followed by the element values of
+// the signal padded to a multiple of eight bytes. A signal in the index
+// is six u32 fields (kind, width, esize, name length, map length, and
+// number of chunks) followed by the padded name and map and the table
+// of chunks in time order.
+
+#define NTR_MAGIC      "NVCTRACE"
+#define NTR_IDX_MAGIC  "NVCTRIDX"
+#define NTR_VERSION    1
+#define NTR_BOM        0x01020304
+#define NTR_CHUNK_SZ   8192
+#define NTR_HEADER_SZ  24
+#define NTR_TRAILER_SZ 24
+
+#define NTR_PAD(n) (((n) + 7) & ~7)
+
+#define FOR_ALL_SIZES(size, macro) do {                 \
+      switch (size) {                                   \
+      case 1:                                           \
+         macro(uint8_t); break;                         \
+      case 2:                                           \
+         macro(uint16_t); break;                        \
+      case 4:                                           \
+         macro(uint32_t); break;                        \
+      case 8:                                           \
+         macro(uint64_t); break;                        \
+      }                                                 \
+   } while (0)
+
+typedef struct {
+   uint64_t offset;
+   uint64_t first;
+   uint64_t last;
+   uint32_t count;
+   uint32_t pad;
+} ntr_chunk_t;
+
+typedef struct {
+   uint32_t sig;
+   uint32_t count;
+   uint64_t first;
+   uint64_t last;
+} ntr_chunk_hdr_t;
+
+typedef struct {
+   uint32_t kind;
+   uint32_t width;
+   uint32_t esize;
+   uint32_t namelen;
+   uint32_t maplen;
+   uint32_t nchunks;
+} ntr_sig_hdr_t;
+
+typedef struct {
+   char        *name;
+   ntr_kind_t   kind;
+   unsigned     width;
+   unsigned     esize;
+   size_t       recsz;
+   char        *map;
+   size_t       maplen;
+   uint8_t     *buf;
+   size_t       buflen;
+   size_t       bufalloc;
+   ntr_chunk_t *chunks;
+   unsigned     nchunks;
+   unsigned     chunkalloc;
+} ntr_wsig_t;
+
+struct ntr_writer {
+   FILE       *file;
+   char       *path;
+   uint64_t    offset;
+   ntr_wsig_t *sigs;
+   unsigned    nsigs;
+   unsigned    sigalloc;
+};
+
+typedef struct {
+   const char        *name;
+   ntr_kind_t         kind;
+   unsigned           width;
+   unsigned           esize;
+   size_t             recsz;
+   const char        *map;
+   size_t             maplen;
+   const ntr_chunk_t *chunks;
+   unsigned           nchunks;
+} ntr_rsig_t;
+
+struct ntr_file {
+   char       *path;
+   uint8_t    *data;
+   size_t      size;
+   ntr_rsig_t *sigs;
+   unsigned    nsigs;
+   uint64_t    end_time;
+};
+
+static void ntr_write(ntr_writer_t *w, const void *data, size_t len)
+{
+   if (len > 0 && fwrite(data, len, 1, w->file) != 1)
+      fatal_errno("writing %s", w->path);
+
+   w->offset += len;
+}
+
+static void ntr_write_pad(ntr_writer_t *w, const void *data, size_t len)
+{
+   static const uint8_t zero[8] = { 0 };
+
+   ntr_write(w, data, len);
+   ntr_write(w, zero, NTR_PAD(len) - len);
+}
+
+ntr_writer_t *ntr_writer_new(const char *file)
+{
+   ntr_writer_t *w = xcalloc(sizeof(ntr_writer_t));
+   w->path = xstrdup(file);
+
+   if ((w->file = fopen(file, "wb")) == NULL)
+      fatal_errno("failed to create %s", file);
+
+   const uint32_t header[] = { NTR_VERSION, NTR_BOM, (uint32_t)-15, 0 };
+   ntr_write(w, NTR_MAGIC, 8);
+   ntr_write(w, header, sizeof(header));
+
+   return w;
+}
+
+int ntr_writer_add(ntr_writer_t *w, const char *name, ntr_kind_t kind,
+                   unsigned width, unsigned esize, const char *map,
+                   size_t maplen)
+{
+   assert(esize == 1 || esize == 2 || esize == 4 || esize == 8);
+
+   if (w->nsigs == w->sigalloc) {
+      w->sigalloc = MAX(w->sigalloc * 2, 256);
+      w->sigs = xrealloc(w->sigs, w->sigalloc * sizeof(ntr_wsig_t));
+   }
+
+   ntr_wsig_t *s = &(w->sigs[w->nsigs]);
+   memset(s, '\0', sizeof(ntr_wsig_t));
+
+   s->name   = xstrdup(name);
+   s->kind   = kind;
+   s->width  = width;
+   s->esize  = esize;
+   s->recsz  = sizeof(uint64_t) + NTR_PAD(width * esize);
+   s->maplen = maplen;
+
+   if (maplen > 0) {
+      s->map = xmalloc(maplen);
+      memcpy(s->map, map, maplen);
+   }
+
+   return w->nsigs++;
+}
+
+static void ntr_writer_flush(ntr_writer_t *w, int sig)
+{
+   ntr_wsig_t *s = &(w->sigs[sig]);
+   if (s->buflen == 0)
+      return;
+
+   if (s->nchunks == s->chunkalloc) {
+      s->chunkalloc = MAX(s->chunkalloc * 2, 4);
+      s->chunks = xrealloc(s->chunks, s->chunkalloc * sizeof(ntr_chunk_t));
+   }
+
+   const unsigned count = s->buflen / s->recsz;
+
+   ntr_chunk_t *c = &(s->chunks[s->nchunks++]);
+   c->offset = w->offset;
+   c->count  = count;
+   c->pad    = 0;
+   memcpy(&(c->first), s->buf, sizeof(uint64_t));
+   memcpy(&(c->last), s->buf + (count - 1) * s->recsz, sizeof(uint64_t));
+
+   const ntr_chunk_hdr_t hdr = { sig, count, c->first, c->last };
+   ntr_write(w, &hdr, sizeof(hdr));
+   ntr_write(w, s->buf, s->buflen);
+
+   s->buflen = 0;
+}
+
+void ntr_writer_emit(ntr_writer_t *w, int sig, uint64_t when,
+                     const uint64_t *values)
+{
+   ntr_wsig_t *s = &(w->sigs[sig]);
+
+   if (s->buflen + s->recsz > s->bufalloc) {
+      // Buffers start small as most signals change rarely and grow up
+      // to the chunk size before being written out
+      const size_t limit = MAX(NTR_CHUNK_SZ, s->recsz);
+      if (s->bufalloc >= limit)
+         ntr_writer_flush(w, sig);
+      else {
+         s->bufalloc = MIN(MAX(s->bufalloc * 2, s->recsz * 4), limit);
+         s->bufalloc -= s->bufalloc % s->recsz;
+         s->buf = xrealloc(s->buf, s->bufalloc);
+      }
+   }
+
+   uint8_t *p = s->buf + s->buflen;
+   memcpy(p, &when, sizeof(uint64_t));
+   p += sizeof(uint64_t);
+
+#define NTR_NARROW(type) do {                              \
+      type *dp = (type *)p;                                \
+      for (unsigned i = 0; i < s->width; i++)              \
+         dp[i] = values[i];                                \
+   } while (0)
+
+   FOR_ALL_SIZES(s->esize, NTR_NARROW);
+
+   memset(p + s->width * s->esize, '\0',
+          s->recsz - sizeof(uint64_t) - s->width * s->esize);
+
+   s->buflen += s->recsz;
+}
+
+void ntr_writer_close(ntr_writer_t *w, uint64_t end_time)
+{
+   for (unsigned i = 0; i < w->nsigs; i++)
+      ntr_writer_flush(w, i);
+
+   const uint64_t index = w->offset;
+
+   const uint32_t nsigs[] = { w->nsigs, 0 };
+   ntr_write(w, nsigs, sizeof(nsigs));
+
+   for (unsigned i = 0; i < w->nsigs; i++) {
+      ntr_wsig_t *s = &(w->sigs[i]);
+
+      const ntr_sig_hdr_t hdr = {
+         .kind    = s->kind,
+         .width   = s->width,
+         .esize   = s->esize,
+         .namelen = strlen(s->name) + 1,
+         .maplen  = s->maplen,
+         .nchunks = s->nchunks
+      };
+      ntr_write(w, &hdr, sizeof(hdr));
+      ntr_write_pad(w, s->name, hdr.namelen);
+      ntr_write_pad(w, s->map, s->maplen);
+      ntr_write(w, s->chunks, s->nchunks * sizeof(ntr_chunk_t));
+
+      free(s->name);
+      free(s->map);
+      free(s->buf);
+      free(s->chunks);
+   }
+
+   const uint64_t trailer[] = { index, end_time };
+   ntr_write(w, trailer, sizeof(trailer));
+   ntr_write(w, NTR_IDX_MAGIC, 8);
+
+   if (fclose(w->file) != 0)
+      fatal_errno("closing %s", w->path);
+
+   free(w->sigs);
+   free(w->path);
+   free(w);
+}
+
+static const void *ntr_read_at(ntr_file_t *f, uint64_t *pos, size_t len)
+{
+   if (*pos + len > f->size - NTR_TRAILER_SZ)
+      fatal("%s: trace index is corrupt", f->path);
+
+   const void *p = f->data + *pos;
+   *pos += NTR_PAD(len);
+   return p;
+}
+
+ntr_file_t *ntr_open(const char *file)
+{
+   int fd = open(file, O_RDONLY);
+   if (fd < 0)
+      fatal_errno("failed to open %s", file);
+
+   struct stat buf;
+   if (fstat(fd, &buf) != 0)
+      fatal_errno("fstat");
+
+   if (buf.st_size < NTR_HEADER_SZ + NTR_TRAILER_SZ)
+      fatal("%s is not a native trace file", file);
+
+   ntr_file_t *f = xcalloc(sizeof(ntr_file_t));
+   f->path = xstrdup(file);
+   f->size = buf.st_size;
+   f->data = map_file(fd, f->size);
+
+   close(fd);
+
+   const uint8_t *trailer = f->data + f->size - NTR_TRAILER_SZ;
+   if (memcmp(f->data, NTR_MAGIC, 8) != 0
+       || memcmp(trailer + 16, NTR_IDX_MAGIC, 8) != 0)
+      fatal("%s is not a native trace file or was not closed", file);
+
+   uint32_t header[4];
+   memcpy(header, f->data + 8, sizeof(header));
+   if (header[0] != NTR_VERSION)
+      fatal("%s: unsupported trace version %u", file, header[0]);
+   else if (header[1] != NTR_BOM)
+      fatal("%s: trace was written with a different byte order", file);
+
+   uint64_t pos;
+   memcpy(&pos, trailer, sizeof(uint64_t));
+   memcpy(&(f->end_time), trailer + 8, sizeof(uint64_t));
+
+   const uint32_t *nsigs = ntr_read_at(f, &pos, 2 * sizeof(uint32_t));
+   f->nsigs = nsigs[0];
+   f->sigs  = xmalloc(MAX(f->nsigs, 1) * sizeof(ntr_rsig_t));
+
+   for (unsigned i = 0; i < f->nsigs; i++) {
+      const ntr_sig_hdr_t *hdr = ntr_read_at(f, &pos, sizeof(ntr_sig_hdr_t));
+
+      ntr_rsig_t *s = &(f->sigs[i]);
+      s->kind    = hdr->kind;
+      s->width   = hdr->width;
+      s->esize   = hdr->esize;
+      s->recsz   = sizeof(uint64_t) + NTR_PAD(hdr->width * hdr->esize);
+      s->maplen  = hdr->maplen;
+      s->nchunks = hdr->nchunks;
+      s->name    = ntr_read_at(f, &pos, hdr->namelen);
+      s->map     = ntr_read_at(f, &pos, hdr->maplen);
+      s->chunks  = ntr_read_at(f, &pos, hdr->nchunks * sizeof(ntr_chunk_t));
+
+      if (hdr->namelen == 0 || s->name[hdr->namelen - 1] != '\0')
+         fatal("%s: trace index is corrupt", file);
+
+      for (unsigned j = 0; j < s->nchunks; j++) {
+         const uint64_t end = s->chunks[j].offset + sizeof(ntr_chunk_hdr_t)
+            + s->chunks[j].count * s->recsz;
+         if (end > f->size)
+            fatal("%s: trace index is corrupt", file);
+      }
+   }
+
+   return f;
+}
+
+void ntr_close(ntr_file_t *f)
+{
+   unmap_file(f->data, f->size);
+   free(f->sigs);
+   free(f->path);
+   free(f);
+}
+
+unsigned ntr_signals(ntr_file_t *f)
+{
+   return f->nsigs;
+}
+
+int ntr_find(ntr_file_t *f, const char *name)
+{
+   for (unsigned i = 0; i < f->nsigs; i++) {
+      if (strcmp(f->sigs[i].name, name) == 0)
+         return i;
+   }
+
+   return -1;
+}
+
+const char *ntr_name(ntr_file_t *f, int sig)
+{
+   assert(sig >= 0 && sig < f->nsigs);
+   return f->sigs[sig].name;
+}
+
+ntr_kind_t ntr_kind(ntr_file_t *f, int sig)
+{
+   assert(sig >= 0 && sig < f->nsigs);
+   return f->sigs[sig].kind;
+}
+
+unsigned ntr_width(ntr_file_t *f, int sig)
+{
+   assert(sig >= 0 && sig < f->nsigs);
+   return f->sigs[sig].width;
+}
+
+const char *ntr_map(ntr_file_t *f, int sig, size_t *len)
+{
+   assert(sig >= 0 && sig < f->nsigs);
+   *len = f->sigs[sig].maplen;
+   return f->sigs[sig].map;
+}
+
+uint64_t ntr_end_time(ntr_file_t *f)
+{
+   return f->end_time;
+}
+
+size_t ntr_changes(ntr_file_t *f, int sig)
+{
+   assert(sig >= 0 && sig < f->nsigs);
+
+   const ntr_rsig_t *s = &(f->sigs[sig]);
+
+   size_t count = 0;
+   for (unsigned i = 0; i < s->nchunks; i++)
+      count += s->chunks[i].count;
+
+   return count;
+}
+
+static inline const uint8_t *ntr_record(ntr_file_t *f, const ntr_rsig_t *s,
+                                        unsigned chunk, unsigned index)
+{
+   return f->data + s->chunks[chunk].offset + sizeof(ntr_chunk_hdr_t)
+      + index * s->recsz;
+}
+
+static inline uint64_t ntr_record_time(const uint8_t *rec)
+{
+   uint64_t when;
+   memcpy(&when, rec, sizeof(uint64_t));
+   return when;
+}
+
+static void ntr_record_values(const ntr_rsig_t *s, const uint8_t *rec,
+                              uint64_t *values)
+{
+   const uint8_t *p = rec + sizeof(uint64_t);
+
+#define NTR_WIDEN(type) do {                               \
+      const type *sp = (const type *)p;                    \
+      for (unsigned i = 0; i < s->width; i++)              \
+         values[i] = sp[i];                                \
+   } while (0)
+
+   FOR_ALL_SIZES(s->esize, NTR_WIDEN);
+}
+
+bool ntr_value_at(ntr_file_t *f, int sig, uint64_t when, uint64_t *values)
+{
+   assert(sig >= 0 && sig < f->nsigs);
+
+   const ntr_rsig_t *s = &(f->sigs[sig]);
+
+   // Find the last chunk starting at or before the requested time
+   int low = 0, high = s->nchunks - 1, chunk = -1;
+   while (low <= high) {
+      const int mid = (low + high) / 2;
+      if (s->chunks[mid].first <= when) {
+         chunk = mid;
+         low = mid + 1;
+      }
+      else
+         high = mid - 1;
+   }
+
+   if (chunk == -1)
+      return false;
+
+   // Then the last record in that chunk at or before the time
+   int index = 0;
+   low = 0;
+   high = s->chunks[chunk].count - 1;
+   while (low <= high) {
+      const int mid = (low + high) / 2;
+      if (ntr_record_time(ntr_record(f, s, chunk, mid)) <= when) {
+         index = mid;
+         low = mid + 1;
+      }
+      else
+         high = mid - 1;
+   }
+
+   ntr_record_values(s, ntr_record(f, s, chunk, index), values);
+   return true;
+}
+
+typedef struct {
+   const ntr_rsig_t  *sig;
+   fstHandle          handle;
+   unsigned           chunk;
+   unsigned           index;
+   const char       **literals;
+   unsigned           nliterals;
+} ntr_cursor_t;
+
+static void ntr_export_scope(void *ctx, char **scope, const char *name)
+{
+   // Move from the current scope to the one containing name by closing
+   // and opening scopes after the last component they have in common
+
+   const char *base = strrchr(name, ':');
+   const size_t len = (base == NULL) ? 0 : base - name;
+   const char *cur = *scope;
+
+   size_t common = 0;
+   for (size_t i = 0; ; i++) {
+      const char a = cur[i], b = (i < len) ? name[i] : '\0';
+      if ((a == ':' || a == '\0') && (b == ':' || b == '\0'))
+         common = i;
+      if (a != b || a == '\0')
+         break;
+   }
+
+   for (const char *p = cur + common; *p != '\0'; p++) {
+      if (*p == ':')
+         fstWriterSetUpscope(ctx);
+   }
+
+   for (size_t i = common + 1; i <= len; ) {
+      const char *end = memchr(name + i, ':', len - i);
+      const size_t n = ((end == NULL) ? name + len : end) - (name + i);
+
+      char part[n + 1];
+      memcpy(part, name + i, n);
+      part[n] = '\0';
+      fstWriterSetScope(ctx, FST_ST_VHDL_ARCHITECTURE, part, NULL);
+
+      i += n + 1;
+   }
+
+   free(*scope);
+   *scope = xmalloc(len + 1);
+   memcpy(*scope, name, len);
+   (*scope)[len] = '\0';
+}
+
+static void ntr_export_value(void *ctx, ntr_cursor_t *c, const uint8_t *rec)
+{
+   const ntr_rsig_t *s = c->sig;
+
+   uint64_t values[s->width];
+   ntr_record_values(s, rec, values);
+
+   switch (s->kind) {
+   case NTR_CHARS:
+      {
+         char buf[s->width + 1];
+         for (unsigned i = 0; i < s->width; i++)
+            buf[i] = (values[i] < s->maplen) ? s->map[values[i]] : 'X';
+         buf[s->width] = '\0';
+         fstWriterEmitValueChange(ctx, c->handle, buf);
+      }
+      break;
+
+   case NTR_STRING:
+      {
+         char buf[s->width];
+         for (unsigned i = 0; i < s->width; i++)
+            buf[i] = values[i];
+         fstWriterEmitVariableLengthValueChange(ctx, c->handle, buf,
+                                                s->width);
+      }
+      break;
+
+   case NTR_INT:
+      {
+         char buf[65];
+         for (int i = 0; i < 64; i++)
+            buf[63 - i] = (values[0] & (UINT64_C(1) << i)) ? '1' : '0';
+         buf[64] = '\0';
+         fstWriterEmitValueChange(ctx, c->handle, buf);
+      }
+      break;
+
+   case NTR_ENUM:
+      {
+         const char *str =
+            (values[0] < c->nliterals) ? c->literals[values[0]] : "?";
+         fstWriterEmitVariableLengthValueChange(ctx, c->handle, str,
+                                                strlen(str));
+      }
+      break;
+
+   case NTR_RAW:
+      break;
+   }
+}
+
+void ntr_export_fst(ntr_file_t *f, const char *file)
+{
+   void *ctx = fstWriterCreate(file, 1);
+   if (ctx == NULL)
+      fatal("fstWriterCreate failed");
+
+   fstWriterSetFileType(ctx, FST_FT_VHDL);
+   fstWriterSetTimescale(ctx, -15);
+   fstWriterSetVersion(ctx, PACKAGE_STRING);
+   fstWriterSetPackType(ctx, FST_WR_PT_ZLIB);
+   fstWriterSetRepackOnClose(ctx, 1);
+
+   ntr_cursor_t *cursors = xcalloc(MAX(f->nsigs, 1) * sizeof(ntr_cursor_t));
+   heap_t heap = heap_new(MAX(f->nsigs, 1));
+   char *scope = xstrdup("");
+   unsigned skipped = 0;
+
+   for (unsigned i = 0; i < f->nsigs; i++) {
+      const ntr_rsig_t *s = &(f->sigs[i]);
+      ntr_cursor_t *c = &(cursors[i]);
+      c->sig = s;
+
+      enum fstVarType vt;
+      unsigned len;
+      switch (s->kind) {
+      case NTR_CHARS:
+         vt  = FST_VT_SV_LOGIC;
+         len = s->width;
+         break;
+      case NTR_STRING:
+         vt  = FST_VT_GEN_STRING;
+         len = s->width;
+         break;
+      case NTR_INT:
+         vt  = FST_VT_VCD_INTEGER;
+         len = 64;
+         break;
+      case NTR_ENUM:
+         {
+            vt  = FST_VT_GEN_STRING;
+            len = 0;
+
+            // Index the NUL separated literal names
+            for (size_t j = 0; j < s->maplen; j++)
+               c->nliterals += (s->map[j] == '\0');
+
+            c->literals = xmalloc(MAX(c->nliterals, 1) * sizeof(char *));
+            const char *p = s->map;
+            for (unsigned j = 0; j < c->nliterals; j++, p += strlen(p) + 1)
+               c->literals[j] = p;
+         }
+         break;
+      default:
+         skipped++;
+         continue;
+      }
+
+      ntr_export_scope(ctx, &scope, s->name);
+
+      const char *base = strrchr(s->name, ':');
+      c->handle = fstWriterCreateVar(ctx, vt, FST_VD_IMPLICIT, len,
+                                     base ? base + 1 : s->name, 0);
+
+      if (s->nchunks > 0)
+         heap_insert(heap, ntr_record_time(ntr_record(f, s, 0, 0)), c);
+   }
+
+   for (const char *p = scope; *p != '\0'; p++) {
+      if (*p == ':')
+         fstWriterSetUpscope(ctx);
+   }
+
+   // Merge the changes of all signals in time order
+
+   uint64_t last_time = UINT64_MAX;
+   while (heap_size(heap) > 0) {
+      ntr_cursor_t *c = heap_extract_min(heap);
+      const ntr_rsig_t *s = c->sig;
+
+      const uint8_t *rec = ntr_record(f, s, c->chunk, c->index);
+      const uint64_t when = ntr_record_time(rec);
+      if (when != last_time) {
+         fstWriterEmitTimeChange(ctx, when);
+         last_time = when;
+      }
+
+      ntr_export_value(ctx, c, rec);
+
+      if (++(c->index) == s->chunks[c->chunk].count) {
+         c->index = 0;
+         c->chunk++;
+      }
+
+      if (c->chunk < s->nchunks)
+         heap_insert(heap, ntr_record_time(ntr_record(f, s, c->chunk,
+                                                      c->index)), c);
+   }
+
+   if (f->end_time != last_time)
+      fstWriterEmitTimeChange(ctx, f->end_time);
+
+   fstWriterClose(ctx);
+
+   if (skipped > 0)
+      warnf("%u signals in %s cannot be represented in FST format",
+            skipped, f->path);
+
+   for (unsigned i = 0; i < f->nsigs; i++)
+      free(cursors[i].literals);
+
+   free(cursors);
+   free(scope);
+   heap_free(heap);
+}
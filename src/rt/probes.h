@@ -0,0 +1,46 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _PROBES_H
+#define _PROBES_H
+
+// Static probes in the simulation kernel for tools such as perf,
+// bpftrace, and SystemTap. Each probe is a single NOP instruction plus
+// a note section entry so the cost when nothing is attached is close to
+// zero. Without --enable-usdt they expand to nothing.
+//
+//   cycle__begin   (now, iteration)
+//   cycle__end     (now, iteration)
+//   proc__run      (index, entry point, reset)
+//   driver__update (first net, driver, length)
+//   event__cb      (now, watch, postponed)
+
+#if ENABLE_USDT
+
+#include <sys/sdt.h>
+
+#define RT_PROBE2(name, a, b) DTRACE_PROBE2(nvc, name, a, b)
+#define RT_PROBE3(name, a, b, c) DTRACE_PROBE3(nvc, name, a, b, c)
+
+#else  // ENABLE_USDT
+
+#define RT_PROBE2(name, a, b)
+#define RT_PROBE3(name, a, b, c)
+
+#endif  // ENABLE_USDT
+
+#endif  // _PROBES_H
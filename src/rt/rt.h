@@ -23,6 +23,16 @@
 
 #include <stdint.h>
 
+// The temporary stack pointer shared with generated code is thread local
+// when the kernel can execute processes on multiple threads
+#if defined HAVE_PTHREAD && !defined __MINGW32__
+#define RT_MULTITHREAD 1
+#define RT_TLS __thread
+#else
+#define RT_MULTITHREAD 0
+#define RT_TLS
+#endif
+
 typedef struct watch watch_t;
 
 typedef void (*sig_event_fn_t)(uint64_t now, tree_t, watch_t *, void *user);
@@ -71,6 +81,7 @@ typedef enum {
    R_IDENT    = (1 << 1),
    R_RECORD   = (1 << 2),
    R_BOUNDARY = (1 << 3),
+   R_FOLD     = (1 << 4),
 } res_flags_t;
 
 typedef enum {
@@ -81,13 +92,20 @@ typedef enum {
    NET_F_GLOBAL     = (1 << 4),
    NET_F_LAST_VALUE = (1 << 5),
    NET_F_BOUNDARY   = (1 << 6),
+   NET_F_WATCHED    = (1 << 7),
+   NET_F_PENDING    = (1 << 8),
 } net_flags_t;
 
 typedef enum {
    SCHED_SEQUENTIAL = (1 << 0),
-   SCHED_STATIC     = (1 << 1)
+   SCHED_STATIC     = (1 << 1),
+   SCHED_QUALIFIED  = (1 << 2)
 } sched_flags_t;
 
+// With SCHED_QUALIFIED the bits above this hold the set of enumeration
+// positions of a scalar signal value which can resume the process
+#define SCHED_QUAL_SHIFT 8
+
 typedef enum {
    RT_START_OF_SIMULATION,
    RT_END_OF_SIMULATION,
@@ -115,14 +133,21 @@ void rt_end_of_tool(tree_t top);
 void rt_run_sim(uint64_t stop_time);
 void rt_run_interactive(uint64_t stop_time);
 void rt_restart(tree_t top);
+void rt_restart_from(tree_t top, const char *checkpoint);
+void rt_set_checkpoint(uint64_t when, const char *file);
+void rt_set_wave_window(uint64_t start, uint64_t stop);
 void rt_set_timeout_cb(uint64_t when, timeout_fn_t fn, void *user);
 watch_t *rt_set_event_cb(tree_t s, sig_event_fn_t fn, void *user,
                          bool postponed);
+void rt_watch_async(watch_t *w);
 void rt_set_global_cb(rt_event_t event, rt_event_fn_t fn, void *user);
 size_t rt_watch_value(watch_t *w, uint64_t *buf, size_t max, bool last);
 size_t rt_watch_string(watch_t *w, const char *map, char *buf, size_t max);
+void rt_watch_changed(watch_t *w, size_t *first, size_t *count);
+size_t rt_watch_range(watch_t *w, uint64_t *buf, size_t first, size_t count);
 size_t rt_signal_value(tree_t s, uint64_t *buf, size_t max);
 size_t rt_signal_string(tree_t s, const char *map, char *buf, size_t max);
+const void *rt_signal_map(tree_t s, size_t *size, size_t *count);
 bool rt_force_signal(tree_t s, const uint64_t *buf, size_t count,
                      bool propagate);
 bool rt_can_create_delta(void);
@@ -130,10 +155,25 @@ uint64_t rt_now(unsigned *deltas);
 void rt_stop(void);
 void rt_set_exit_severity(rt_severity_t severity);
 
+typedef struct {
+   void       *addr;
+   const char *name;
+   loc_t       loc;
+} jit_perf_sym_t;
+
+typedef void *(*jit_lookup_fn_t)(const char *name);
+typedef void (*jit_tier_fn_t)(const char *name, void **result);
+
 void jit_init(tree_t top);
 void jit_shutdown(void);
 void *jit_find_symbol(const char *name, bool required);
+void *jit_find_native_symbol(const char *name, bool required);
+void jit_set_lookup(jit_lookup_fn_t fn);
+void jit_set_tier_up(jit_tier_fn_t fn);
+bool jit_can_tier_up(void);
+void jit_tier_up(const char *name, void **result);
 void jit_trace(jit_trace_t **trace, size_t *count);
+void jit_write_perf_map(jit_perf_sym_t *syms, size_t count);
 
 text_buf_t *pprint(struct tree *t, const uint64_t *values, size_t len);
 
@@ -146,9 +186,13 @@ void lxt_restart(void);
 void fst_init(const char *file, tree_t top);
 void fst_restart(void);
 
+void ntr_init(const char *file, tree_t top);
+void ntr_restart(void);
+
 void wave_include_glob(const char *glob);
 void wave_exclude_glob(const char *glob);
 void wave_include_file(const char *base);
+void wave_set_depth(int depth);
 bool wave_should_dump(tree_t decl);
 
 #ifdef ENABLE_VHPI
@@ -21,10 +21,17 @@
 #include "util.h"
 #include "alloc.h"
 #include "heap.h"
+#include "wheel.h"
+#include "memo.h"
+#include "bitvec.h"
 #include "common.h"
 #include "netdb.h"
 #include "cover.h"
 #include "hash.h"
+#include "fbuf.h"
+#include "probes.h"
+#include "arena.h"
+#include "access.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -40,11 +47,18 @@
 #include <float.h>
 #include <ctype.h>
 #include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #ifdef HAVE_ALLOCA_H
 #include <alloca.h>
 #endif
 
+#if RT_MULTITHREAD
+#include <pthread.h>
+#endif
+
 #ifdef __MINGW32__
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -59,10 +73,10 @@ typedef void (*proc_fn_t)(int32_t reset);
 typedef uint64_t (*resolution_fn_t)(void *vals, int32_t n);
 
 typedef struct netgroup   netgroup_t;
+typedef struct netgroup_cold netgroup_cold_t;
 typedef struct driver     driver_t;
 typedef struct rt_proc    rt_proc_t;
 typedef struct event      event_t;
-typedef struct waveform   waveform_t;
 typedef struct sens_list  sens_list_t;
 typedef struct value      value_t;
 typedef struct watch_list watch_list_t;
@@ -71,24 +85,127 @@ typedef struct callback   callback_t;
 typedef struct image_map  image_map_t;
 typedef struct rt_loc     rt_loc_t;
 typedef struct size_list  size_list_t;
+typedef struct txn        txn_t;
+typedef struct txn_log    txn_log_t;
+typedef struct batch      batch_t;
+typedef struct drv_slot   drv_slot_t;
+typedef struct rt_file    rt_file_t;
+typedef struct rec_span   rec_span_t;
+
+struct drv_slot {
+   groupid_t gid;
+   uint32_t  driver;
+};
+
+// Regular files opened for reading are mapped into memory and writes
+// to them are collected in a private buffer. Buffered data is written
+// when the buffer is full, when the file is closed either explicitly or
+// by a reset, and when the simulation exits.
+struct rt_file {
+   FILE          *fp;
+   const uint8_t *map;
+   size_t         mapsz;
+   size_t         pos;
+   uint8_t       *wbuf;
+   size_t         wlen;
+   rt_file_t     *next;
+};
 
 struct rt_proc {
-   tree_t    source;
-   proc_fn_t proc_fn;
-   uint32_t  wakeup_gen;
-   void     *tmp_stack;
-   uint32_t  tmp_alloc;
-   bool      postponed;
-   bool      pending;
-   uint64_t  usage;
+   tree_t      source;
+   proc_fn_t   proc_fn;
+   uint32_t    wakeup_gen;
+   void       *tmp_stack;
+   uint32_t    tmp_alloc;
+   uint32_t    tmp_peak;
+   uint32_t    tmp_commit;
+   bool        postponed;
+   bool        pending;
+   bool        parallel;
+   uint64_t    usage;
+   uint64_t    wakeups;
+   drv_slot_t *slots;
+   uint32_t    n_slots;
+   uint32_t    slot_mask;
+   sens_list_t **sens;
+   uint32_t    n_sens;
+   uint32_t    sens_mask;
+   const uint8_t *clock_map;
+   netgroup_t *clock_group;
+   uint64_t    clock_period;
+   uint32_t    runs;
+   bool        tier_requested;
+   void       *tier_fn;
 };
 
+typedef struct {
+   uint64_t updates;
+   uint64_t update_ticks;
+   uint64_t resolve_ticks;
+} group_prof_t;
+
+typedef struct {
+   const char *name;
+   size_t      item_sz;
+   size_t      items;
+   size_t      live;
+   size_t      peak;
+   size_t      chunks;
+   size_t      released;
+} pool_stats_t;
+
+typedef struct {
+   uint64_t wakeups;
+   uint64_t proc_ticks;
+   uint64_t updates;
+   uint64_t update_ticks;
+   uint64_t resolve_ticks;
+} inst_prof_t;
+
+typedef enum {
+   WAVE_PENDING,
+   WAVE_ACTIVE,
+   WAVE_DONE
+} wave_state_t;
+
 typedef enum {
    E_TIMEOUT,
    E_DRIVER,
-   E_PROCESS
+   E_PROCESS,
+   E_CLOCK
 } event_kind_t;
 
+#define DELTA_HIST_SIZE 33
+
+typedef struct {
+   uint64_t time_steps;
+   uint64_t delta_cycles;
+   uint64_t delta_hist[DELTA_HIST_SIZE];
+   uint64_t events[E_CLOCK + 1];
+   uint64_t txns_scheduled;
+   uint64_t txns_rejected;
+   uint64_t txns_coalesced;
+   uint64_t static_wakeups;
+   uint64_t dynamic_wakeups;
+   uint64_t sens_rearmed;
+   uint64_t filtered_wakeups;
+   size_t   max_eventq;
+   size_t   max_run_queue;
+   unsigned max_active_groups;
+   uint64_t async_records;
+   uint64_t async_stalls;
+   uint64_t sorted_events;
+   uint64_t page_switches;
+   uint64_t tiered_up;
+} rt_stats_t;
+
+typedef struct {
+   uintptr_t key;
+   uint32_t  minor;
+   uint32_t  seq;
+   event_t  *event;
+} run_key_t;
+
 struct event {
    uint64_t      when;
    event_kind_t  kind;
@@ -96,28 +213,45 @@ struct event {
    event_t      *delta_chain;
    rt_proc_t    *proc;
    netgroup_t   *group;
+   int32_t       driver;
    timeout_fn_t  timeout_fn;
    void         *timeout_user;
 };
 
-struct waveform {
-   uint64_t    when;
-   waveform_t *next;
-   value_t    *values;
-};
-
 struct sens_list {
    rt_proc_t    *proc;
    sens_list_t  *next;
    sens_list_t **reenq;
+   sens_list_t **key;
    uint32_t      wakeup_gen;
+   uint32_t      accept;
    netid_t       first;
    netid_t       last;
+   bool          owned;
+   bool          linked;
 };
 
+#define RANGE_MIN_BITS 4
+#define RANGE_LEVELS   (33 - RANGE_MIN_BITS)
+
+// Processes sensitive to a slice spanning several groups are indexed
+// by net range: an entry covering N nets is placed on the lowest level
+// whose buckets are at least N nets wide, in the bucket containing its
+// first net. It can then only overlap an event on that bucket or the
+// next one, so an event visits a handful of buckets per level rather
+// than every entry.
+typedef struct {
+   netid_t       nbuckets;
+   sens_list_t **buckets;
+} range_level_t;
+
 struct driver {
-   rt_proc_t  *proc;
-   waveform_t *waveforms;
+   rt_proc_t *proc;
+   uint32_t   head;
+   uint32_t   count;
+   uint32_t   capacity;
+   uint64_t  *when;
+   uint8_t   *values;
 };
 
 struct value {
@@ -128,22 +262,42 @@ struct value {
    };
 } __attribute__((aligned(8)));
 
+// Fields touched on every update are kept in the netgroup itself and
+// the rest in a parallel array indexed by group ID so that more groups
+// fit in each cache line
 struct netgroup {
    netid_t       first;
    uint32_t      length;
    net_flags_t   flags;
-   void         *resolved;
-   void         *last_value;
-   value_t      *forcing;
    uint16_t      size;
    uint16_t      n_drivers;
+   void         *resolved;
    driver_t     *drivers;
    res_memo_t   *resolution;
+   sens_list_t  *pending;
    uint64_t      last_event;
+};
+
+struct netgroup_cold {
    tree_t        sig_decl;
-   value_t      *free_values;
-   sens_list_t  *pending;
+   void         *last_value;
+   value_t      *forcing;
    watch_list_t *watching;
+   rec_span_t   *span;
+   uint32_t      span_off;
+};
+
+// The groups making up one element of a signal with a resolved record
+// type. The current value of each driver of the whole record is kept
+// here contiguously in the layout the resolution function expects and
+// updated in place when a driver changes.
+struct rec_span {
+   uint32_t   n_groups;
+   uint16_t   n_drivers;
+   bool       valid;
+   size_t     size;
+   uint8_t   *inputs;
+   groupid_t  gids[0];
 };
 
 struct uarray {
@@ -156,9 +310,11 @@ struct uarray {
 };
 
 struct run_queue {
-   event_t **queue;
-   size_t    wr, rd;
-   size_t    alloc;
+   event_t  **queue;
+   size_t     wr, rd;
+   size_t     alloc;
+   run_key_t *keys;
+   size_t     keys_alloc;
 };
 
 struct watch {
@@ -173,16 +329,22 @@ struct watch {
    range_kind_t   dir;
    size_t         length;
    bool           postponed;
+   bool           async;
+   bool           wave;
+   uint32_t       changed_first;
+   uint32_t       changed_last;
 };
 
 struct watch_list {
    watch_t      *watch;
    watch_list_t *next;
+   uint32_t      offset;
 };
 
 struct res_memo {
    resolution_fn_t fn;
    res_flags_t     flags;
+   int             nlits;
    int8_t          tab2[16][16];
    int8_t          tab1[16];
 };
@@ -222,11 +384,63 @@ struct size_list {
    uint32_t flags;
 };
 
+typedef enum {
+   TXN_WAVEFORM,
+   TXN_WAVEFORM_S,
+   TXN_PROCESS,
+   TXN_EVENT,
+   TXN_REPORT
+} txn_kind_t;
+
+struct txn {
+   txn_kind_t      kind;
+   int32_t         n;
+   int32_t         flags;
+   int64_t         after;
+   int64_t         reject;
+   size_t          nids;
+   size_t          data;
+   const rt_loc_t *where;
+};
+
+struct txn_log {
+   txn_t   *txns;
+   size_t   n_txns;
+   size_t   txn_alloc;
+   uint8_t *buf;
+   size_t   buf_used;
+   size_t   buf_alloc;
+};
+
+typedef struct {
+   rt_proc_t *proc;
+   txn_log_t *log;
+   size_t     first;
+   size_t     count;
+} batch_item_t;
+
+struct batch {
+   batch_item_t *items;
+   size_t        count;
+   size_t        alloc;
+};
+
 static struct rt_proc   *procs = NULL;
-static struct rt_proc   *active_proc = NULL;
 static struct run_queue  run_queue;
+static struct batch      batch;
+
+static RT_TLS struct rt_proc *active_proc = NULL;
+static RT_TLS txn_log_t      *txn_log = NULL;
+static RT_TLS void           *proc_tmp_stack = NULL;
+static RT_TLS uint32_t        proc_tmp_commit = 0;
+static RT_TLS struct rt_proc *tmp_owner = NULL;
+static RT_TLS uint32_t        tmp_stack_size = 0;
+static RT_TLS uint32_t       *tmp_commit = NULL;
+static RT_TLS hash_t         *image_cache = NULL;
 
 static heap_t        eventq_heap = NULL;
+static wheel_t       eventq_wheel = NULL;
+static bool          use_wheel = true;
 static size_t        n_procs = 0;
 static uint64_t      now = 0;
 static int           iteration = -1;
@@ -236,7 +450,9 @@ static jmp_buf       fatal_jmp;
 static bool          aborted = false;
 static netdb_t      *netdb = NULL;
 static netgroup_t   *groups = NULL;
-static sens_list_t  *pending = NULL;
+static netgroup_cold_t *groups_cold = NULL;
+static unsigned      n_groups = 0;
+static range_level_t range_index[RANGE_LEVELS];
 static sens_list_t  *resume = NULL;
 static sens_list_t  *postponed = NULL;
 static watch_t      *watches = NULL;
@@ -244,42 +460,113 @@ static watch_t      *callbacks = NULL;
 static event_t      *delta_proc = NULL;
 static event_t      *delta_driver = NULL;
 static void         *global_tmp_stack = NULL;
-static void         *proc_tmp_stack = NULL;
 static uint32_t      global_tmp_alloc;
+static uint32_t      global_tmp_commit;
 static hash_t       *res_memo_hash = NULL;
 static side_effect_t init_side_effect = SIDE_EFFECT_ALLOW;
 static bool          force_stop;
 static bool          can_create_delta;
 static callback_t   *global_cbs[RT_LAST_EVENT];
 static rt_severity_t exit_severity = SEVERITY_ERROR;
-static hash_t       *decl_hash = NULL;
+static shash_t      *decl_hash = NULL;
+static tree_t        top_tree = NULL;
 static bool          profiling = false;
+static group_prof_t *group_prof = NULL;
+static bool          stats_on = false;
+static rt_stats_t    stats;
+static pool_stats_t  pool_stats[4];
+static uint64_t      profile_start_ticks;
+static uint64_t      profile_start_us;
+static int           n_threads = 1;
+static bool          perf_map = false;
+static bool          sort_run_queue = false;
+static int           n_partitions = 0;
+static bool          tiered = false;
+static unsigned      tier_wanted = 0;
+static rt_proc_t   **tier_pending = NULL;
+static size_t        n_tier_pending = 0;
+static size_t        max_tier_pending = 0;
+static arena_t       signal_arena = NULL;
+static unsigned      arena_flags = 0;
+static int           arena_node = -1;
+static size_t        arena_bytes = 0;
+static unsigned      arena_chunks = 0;
+static access_stats_t access_stats_end;
+static char         *checkpoint_file = NULL;
+static uint64_t      checkpoint_time = UINT64_MAX;
+static fbuf_t       *checkpoint_fbuf = NULL;
+static uint64_t      wave_start = 0;
+static rt_file_t    *open_files = NULL;
+static int32_t      *cover_sample = NULL;
+static unsigned      cover_cycles = 0;
+static uint64_t      wave_stop = UINT64_MAX;
+static wave_state_t  wave_state = WAVE_PENDING;
 
 static rt_alloc_stack_t event_stack = NULL;
-static rt_alloc_stack_t waveform_stack = NULL;
 static rt_alloc_stack_t sens_list_stack = NULL;
 static rt_alloc_stack_t watch_stack = NULL;
 static rt_alloc_stack_t callback_stack = NULL;
 
+static inline netgroup_cold_t *rt_group_cold(const netgroup_t *g)
+{
+   return &(groups_cold[g - groups]);
+}
+
 static netgroup_t **active_groups;
 static unsigned     n_active_groups = 0;
 static unsigned     n_active_alloc = 0;
+static netgroup_t **pending_groups;
+static unsigned     n_pending_groups = 0;
+static unsigned     n_pending_alloc = 0;
+
+// Memory held by the kernel is checked every TRIM_PERIOD cycles and
+// anything more than a few times the peak usage since the last check
+// is returned to the system
+static drv_slot_t  *grown_drivers = NULL;
+static unsigned     n_grown_drivers = 0;
+static unsigned     n_grown_alloc = 0;
+static unsigned     active_peak = 0;
+static unsigned     pending_peak = 0;
+static size_t       run_queue_peak = 0;
+static uint64_t     trim_cycles = 0;
+static uint64_t     trim_count = 0;
+static size_t       trim_drivers = 0;
+static size_t       trim_bytes = 0;
 
 static void deltaq_insert_proc(uint64_t delta, rt_proc_t *wake);
 static void deltaq_insert_driver(uint64_t delta, netgroup_t *group,
-                                 rt_proc_t *driver);
-static bool rt_sched_driver(netgroup_t *group, uint64_t after,
-                            uint64_t reject, value_t *values);
+                                 rt_proc_t *proc, int driver);
+static bool rt_sched_driver(netgroup_t *group, int driver, uint64_t after,
+                            uint64_t reject, const void *values);
+static int rt_driver_slot(const netgroup_t *group, const rt_proc_t *proc);
+static bool rt_sched_delta(netgroup_t *group, const void *values);
 static void rt_sched_event(sens_list_t **list, netid_t first, netid_t last,
-                           rt_proc_t *proc, bool is_static);
+                           rt_proc_t *proc, bool is_static, uint32_t accept);
+static sens_list_t **rt_range_bucket(netid_t first, netid_t last);
+static void rt_record_span_free(rec_span_t *span);
 static void *rt_tmp_alloc(size_t sz);
+static void rt_select_tmp_stack(void *stack, uint32_t alloc, rt_proc_t *owner);
+static void rt_async_flush(void);
 static value_t *rt_alloc_value(netgroup_t *g);
+static void rt_driver_init(const netgroup_t *g, driver_t *d, const void *init);
 static tree_t rt_recall_decl(const char *name);
 static res_memo_t *rt_memo_resolution_fn(type_t type, resolution_fn_t fn);
+static void rt_partition_plan(void);
 static void _tracef(const char *fmt, ...);
 
-#define GLOBAL_TMP_STACK_SZ (1024 * 1024)
-#define PROC_TMP_STACK_SZ   (64 * 1024)
+#define GLOBAL_TMP_STACK_SZ (64 * 1024 * 1024)
+#define DRIVER_INIT_TXNS    4
+#define PROC_TMP_STACK_SZ   (16 * 1024 * 1024)
+#define TMP_COMMIT_SZ       (64 * 1024)
+#define MIN_PARALLEL_BATCH  8
+#define CHECKPOINT_MAGIC    0x4e564b33   // NVK3
+#define ASYNC_RING_SZ       (8 * 1024 * 1024)
+#define IMAGE_HASH_MIN      8
+#define FILE_BUF_SZ         (64 * 1024)
+#define TRIM_PERIOD         (1 << 16)
+#define TRIM_MIN_ITEMS      128
+#define SENS_SLOTS_MAX      256
+#define TIER_THRESHOLD      1000
 
 #if RT_DEBUG
 #define RT_ASSERT(x) assert((x))
@@ -287,6 +574,10 @@ static void _tracef(const char *fmt, ...);
 #define RT_ASSERT(x)
 #endif
 
+#define RT_STAT(...) do {                               \
+      if (unlikely(stats_on)) { __VA_ARGS__; }          \
+   } while (0)
+
 #define TRACE(...) do {                                 \
       if (unlikely(trace_on)) _tracef(__VA_ARGS__);     \
    } while (0)
@@ -315,14 +606,16 @@ static const char *fmt_group(const netgroup_t *g)
    const char *eptr = buf + BUF_LEN;
    char *p = buf;
 
-   p += checked_sprintf(p, eptr - p, "%s", istr(tree_ident(g->sig_decl)));
+   tree_t decl = rt_group_cold(g)->sig_decl;
 
-   groupid_t sig_group0 = netdb_lookup(netdb, tree_net(g->sig_decl, 0));
+   p += checked_sprintf(p, eptr - p, "%s", istr(tree_ident(decl)));
+
+   groupid_t sig_group0 = netdb_lookup(netdb, tree_net(decl, 0));
    netid_t sig_net0 = groups[sig_group0].first;
    int offset = g->first - sig_net0;
 
    const int length = g->length;
-   type_t type = tree_type(g->sig_decl);
+   type_t type = tree_type(decl);
    while (type_is_array(type)) {
       const int stride = type_width(type_elem(type));
       const int ndims = array_dimension(type);
@@ -379,6 +672,128 @@ static inline uint64_t heap_key(uint64_t when, event_kind_t kind)
    return (when << 2) | (kind & 3);
 }
 
+static inline uint64_t rt_profile_clock(void)
+{
+   // Read the cycle counter directly where possible as this is much
+   // cheaper than a system call for each process run
+#if defined __x86_64__ || defined __i386__
+   return __builtin_ia32_rdtsc();
+#elif defined __aarch64__
+   uint64_t cnt;
+   __asm__ volatile ("mrs %0, cntvct_el0" : "=r" (cnt));
+   return cnt;
+#else
+   return get_timestamp_us();
+#endif
+}
+
+static inline size_t eventq_size(void);
+
+static inline void eventq_insert(event_t *e)
+{
+   const uint64_t key = heap_key(e->when, e->kind);
+   if (likely(use_wheel))
+      wheel_insert(eventq_wheel, key, e);
+   else
+      heap_insert(eventq_heap, key, e);
+
+   RT_STAT(stats.max_eventq = MAX(stats.max_eventq, eventq_size()));
+}
+
+static inline size_t eventq_size(void)
+{
+   if (likely(use_wheel))
+      return wheel_size(eventq_wheel);
+   else
+      return heap_size(eventq_heap);
+}
+
+static inline event_t *eventq_min(void)
+{
+   if (likely(use_wheel))
+      return wheel_min(eventq_wheel);
+   else
+      return heap_min(eventq_heap);
+}
+
+static inline event_t *eventq_extract_min(void)
+{
+   if (likely(use_wheel))
+      return wheel_extract_min(eventq_wheel);
+   else
+      return heap_extract_min(eventq_heap);
+}
+
+static void eventq_reset(void)
+{
+   if (eventq_heap != NULL)
+      heap_free(eventq_heap);
+   if (eventq_wheel != NULL)
+      wheel_free(eventq_wheel);
+
+   eventq_heap  = use_wheel ? NULL : heap_new(512);
+   eventq_wheel = use_wheel ? wheel_new() : NULL;
+}
+
+static inline uint32_t rt_slot_hash(groupid_t gid)
+{
+   return gid * UINT32_C(2654435761);
+}
+
+static int rt_proc_find_slot(const rt_proc_t *proc, groupid_t gid)
+{
+   // Each process has a small open addressing hash table mapping the
+   // groups it drives to its driver index in that group
+
+   if (proc->slots == NULL)
+      return -1;
+
+   for (uint32_t h = rt_slot_hash(gid); ; h++) {
+      const drv_slot_t *s = &(proc->slots[h & proc->slot_mask]);
+      if (s->gid == gid)
+         return s->driver;
+      else if (s->gid == GROUPID_INVALID)
+         return -1;
+   }
+}
+
+static void rt_proc_insert_slot(rt_proc_t *proc, groupid_t gid, int driver)
+{
+   for (uint32_t h = rt_slot_hash(gid); ; h++) {
+      drv_slot_t *s = &(proc->slots[h & proc->slot_mask]);
+      if (s->gid == GROUPID_INVALID) {
+         s->gid    = gid;
+         s->driver = driver;
+         return;
+      }
+   }
+}
+
+static void rt_proc_add_slot(rt_proc_t *proc, groupid_t gid, int driver)
+{
+   const uint32_t size = proc->slot_mask + 1;
+
+   if (proc->slots == NULL || (proc->n_slots + 1) * 2 > size) {
+      drv_slot_t *old = proc->slots;
+      const uint32_t old_size = (old == NULL) ? 0 : size;
+      const uint32_t new_size = MAX(old_size * 2, 8);
+
+      proc->slots     = xmalloc(new_size * sizeof(drv_slot_t));
+      proc->slot_mask = new_size - 1;
+      memset(proc->slots, 0xff, new_size * sizeof(drv_slot_t));
+
+      for (uint32_t i = 0; i < old_size; i++) {
+         if (old[i].gid != GROUPID_INVALID)
+            rt_proc_insert_slot(proc, old[i].gid, old[i].driver);
+      }
+
+      free(old);
+   }
+
+   rt_proc_insert_slot(proc, gid, driver);
+   proc->n_slots++;
+}
+
 static void from_rt_loc(const rt_loc_t *rt, loc_t *loc)
 {
    // This function can be expensive: only call it when loc_t is required
@@ -403,15 +818,126 @@ static void rt_show_trace(void)
    free(trace);
 }
 
+static void rt_worker_fatal(void)
+{
+#if RT_MULTITHREAD
+   // Only allow one thread at a time to report a fatal error as the
+   // message formatting code is not thread safe: the lock is never
+   // released as the process exits afterwards
+   static pthread_mutex_t fatal_lock = PTHREAD_MUTEX_INITIALIZER;
+   if (txn_log != NULL)
+      pthread_mutex_lock(&fatal_lock);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Transaction logs
+//
+// While processes execute in parallel any call that modifies the kernel
+// state is recorded in a log private to the thread instead. The logs are
+// replayed on the main thread in the order the processes would have run
+// sequentially.
+
+static size_t txn_log_copy(txn_log_t *log, const void *data, size_t len)
+{
+   const size_t offset = log->buf_used;
+   const size_t aligned = (len + 7) & ~7;
+
+   if (unlikely(offset + aligned > log->buf_alloc)) {
+      log->buf_alloc = MAX(log->buf_alloc * 2, offset + aligned);
+      log->buf = xrealloc(log->buf, log->buf_alloc);
+   }
+
+   memcpy(log->buf + offset, data, len);
+   log->buf_used += aligned;
+   return offset;
+}
+
+static txn_t *txn_log_add(txn_log_t *log, txn_kind_t kind)
+{
+   if (unlikely(log->n_txns == log->txn_alloc)) {
+      log->txn_alloc = MAX(log->txn_alloc * 2, 64);
+      log->txns = xrealloc(log->txns, log->txn_alloc * sizeof(txn_t));
+   }
+
+   txn_t *t = &(log->txns[(log->n_txns)++]);
+   t->kind = kind;
+   return t;
+}
+
+static void txn_log_reset(txn_log_t *log)
+{
+   log->n_txns   = 0;
+   log->buf_used = 0;
+}
+
+static size_t rt_nets_bytes(const int32_t *nids, int32_t n)
+{
+   size_t bytes = 0;
+   int offset = 0;
+   while (offset < n) {
+      const netid_t nid = nids[offset];
+      if (likely(nid != NETID_INVALID)) {
+         const netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
+         bytes += g->size * g->length;
+         offset += g->length;
+      }
+      else
+         offset++;
+   }
+
+   return bytes;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Runtime support functions
 
-DLLEXPORT void     *_tmp_stack;
-DLLEXPORT uint32_t  _tmp_alloc;
+DLLEXPORT RT_TLS void     *_tmp_stack;
+DLLEXPORT RT_TLS uint32_t  _tmp_alloc;
+DLLEXPORT RT_TLS uint32_t  _tmp_limit;
+
+// The JIT cannot relocate references to thread-local variables so
+// generated code finds them through these functions instead
+
+DLLEXPORT
+void **_tmp_stack_ptr(void)
+{
+   return &_tmp_stack;
+}
+
+DLLEXPORT
+uint32_t *_tmp_alloc_ptr(void)
+{
+   return &_tmp_alloc;
+}
+
+DLLEXPORT
+uint32_t *_tmp_limit_ptr(void)
+{
+   return &_tmp_limit;
+}
+
+DLLEXPORT
+void *_access_new(int64_t bytes)
+{
+   return access_alloc(bytes);
+}
+
+DLLEXPORT
+void _access_free(void *ptr)
+{
+   access_free(ptr);
+}
 
 DLLEXPORT
 void _sched_process(int64_t delay)
 {
+   if (unlikely(txn_log != NULL)) {
+      txn_t *t = txn_log_add(txn_log, TXN_PROCESS);
+      t->after = delay;
+      return;
+   }
+
    TRACE("_sched_process delay=%s", fmt_time(delay));
    deltaq_insert_proc(delay, active_proc);
 }
@@ -422,6 +948,18 @@ void _sched_waveform_s(void *_nids, uint64_t scalar,
 {
    const int32_t *nids = _nids;
 
+   if (unlikely(txn_log != NULL)) {
+      const size_t nids_off = txn_log_copy(txn_log, nids, sizeof(int32_t));
+      const size_t data_off = txn_log_copy(txn_log, &scalar, sizeof(uint64_t));
+
+      txn_t *t = txn_log_add(txn_log, TXN_WAVEFORM_S);
+      t->nids   = nids_off;
+      t->data   = data_off;
+      t->after  = after;
+      t->reject = reject;
+      return;
+   }
+
    TRACE("_sched_waveform_s %s value=%08x after=%s reject=%s",
          fmt_net(nids[0]), scalar, fmt_time(after), fmt_time(reject));
 
@@ -433,11 +971,12 @@ void _sched_waveform_s(void *_nids, uint64_t scalar,
    if (likely(nid != NETID_INVALID)) {
       netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
 
-      value_t *values_copy = rt_alloc_value(g);
-      values_copy->qwords[0] = scalar;
+      if (after == 0 && reject == 0 && rt_sched_delta(g, &scalar))
+         return;
 
-      if (!rt_sched_driver(g, after, reject, values_copy))
-         deltaq_insert_driver(after, g, active_proc);
+      const int driver = rt_driver_slot(g, active_proc);
+      if (!rt_sched_driver(g, driver, after, reject, &scalar))
+         deltaq_insert_driver(after, g, active_proc, driver);
    }
 }
 
@@ -447,6 +986,20 @@ void _sched_waveform(void *_nids, void *values, int32_t n,
 {
    const int32_t *nids = _nids;
 
+   if (unlikely(txn_log != NULL)) {
+      const size_t nids_off = txn_log_copy(txn_log, nids, n * sizeof(int32_t));
+      const size_t data_off =
+         txn_log_copy(txn_log, values, rt_nets_bytes(nids, n));
+
+      txn_t *t = txn_log_add(txn_log, TXN_WAVEFORM);
+      t->nids   = nids_off;
+      t->data   = data_off;
+      t->n      = n;
+      t->after  = after;
+      t->reject = reject;
+      return;
+   }
+
    TRACE("_sched_waveform %s values=%s n=%d after=%s reject=%s",
          fmt_net(nids[0]),
          fmt_values(values, n * groups[netdb_lookup(netdb, nids[0])].size),
@@ -463,11 +1016,15 @@ void _sched_waveform(void *_nids, void *values, int32_t n,
       if (likely(nid != NETID_INVALID)) {
          netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
 
-         value_t *values_copy = rt_alloc_value(g);
-         memcpy(values_copy->data, vp, g->size * g->length);
+         if (after == 0 && reject == 0 && rt_sched_delta(g, vp)) {
+            vp += g->size * g->length;
+            offset += g->length;
+            continue;
+         }
 
-         if (!rt_sched_driver(g, after, reject, values_copy))
-            deltaq_insert_driver(after, g, active_proc);
+         const int driver = rt_driver_slot(g, active_proc);
+         if (!rt_sched_driver(g, driver, after, reject, vp))
+            deltaq_insert_driver(after, g, active_proc, driver);
 
          vp += g->size * g->length;
          offset += g->length;
@@ -484,21 +1041,37 @@ void _sched_event(void *_nids, int32_t n, int32_t flags)
 {
    const int32_t *nids = _nids;
 
+   if (unlikely(txn_log != NULL)) {
+      const size_t nids_off = txn_log_copy(txn_log, nids, n * sizeof(int32_t));
+
+      txn_t *t = txn_log_add(txn_log, TXN_EVENT);
+      t->nids  = nids_off;
+      t->n     = n;
+      t->flags = flags;
+      return;
+   }
+
    TRACE("_sched_event %s n=%d flags=%d proc %s", fmt_net(nids[0]), n,
          flags, istr(tree_ident(active_proc->source)));
 
    netgroup_t *g0 = &(groups[netdb_lookup(netdb, nids[0])]);
 
    if (g0->length == n) {
+      // Only a single enumeration value can be checked when the group
+      // has an event
+      uint32_t accept = 0;
+      if ((flags & SCHED_QUALIFIED) && n == 1 && g0->size == 1)
+         accept = (uint32_t)flags >> SCHED_QUAL_SHIFT;
+
       rt_sched_event(&(g0->pending), NETID_INVALID, NETID_INVALID,
-                     active_proc, flags & SCHED_STATIC);
+                     active_proc, flags & SCHED_STATIC, accept);
    }
    else {
       const bool global = !!(flags & SCHED_SEQUENTIAL);
       if (global) {
          // Place on the global pending list
-         rt_sched_event(&pending, nids[0], nids[n - 1], active_proc,
-                        flags & SCHED_STATIC);
+         rt_sched_event(rt_range_bucket(nids[0], nids[n - 1]), nids[0],
+                        nids[n - 1], active_proc, flags & SCHED_STATIC, 0);
       }
 
       int offset = 0;
@@ -509,7 +1082,7 @@ void _sched_event(void *_nids, int32_t n, int32_t flags)
          else {
             // Place on the net group's pending list
             rt_sched_event(&(g->pending), NETID_INVALID, NETID_INVALID,
-                           active_proc, flags & SCHED_STATIC);
+                           active_proc, flags & SCHED_STATIC, 0);
          }
 
          offset += g->length;
@@ -533,28 +1106,30 @@ void _alloc_driver(const int32_t *all_nets, int32_t all_length,
 
    int offset = 0;
    while (offset < driven_length) {
-      netgroup_t *g = &(groups[netdb_lookup(netdb, driven_nets[offset])]);
+      const groupid_t gid = netdb_lookup(netdb, driven_nets[offset]);
+      netgroup_t *g = &(groups[gid]);
       offset += g->length;
 
-      // Try to find this process in the list of existing drivers
-      int driver;
-      for (driver = 0; driver < g->n_drivers; driver++) {
-         if (likely(g->drivers[driver].proc == active_proc))
-            break;
-      }
-
       // Allocate memory for drivers on demand
-      if (driver == g->n_drivers) {
+      if (rt_proc_find_slot(active_proc, gid) < 0) {
+         const int driver = g->n_drivers;
+
          if ((g->n_drivers == 1) && (g->resolution == NULL))
-            fatal_at(tree_loc(g->sig_decl), "group %s has multiple drivers "
-                     "but no resolution function", fmt_group(g));
+            fatal_at(tree_loc(rt_group_cold(g)->sig_decl), "group %s has "
+                     "multiple drivers but no resolution function",
+                     fmt_group(g));
+
+         // The record buffer has one slot per driver
+         if (unlikely(rt_group_cold(g)->span != NULL))
+            rt_record_span_free(rt_group_cold(g)->span);
 
          const size_t driver_sz = sizeof(struct driver);
          g->drivers = xrealloc(g->drivers, (driver + 1) * driver_sz);
-         memset(&g->drivers[g->n_drivers], '\0',
-                (driver + 1 - g->n_drivers) * driver_sz);
+         memset(&g->drivers[driver], '\0', driver_sz);
          g->n_drivers = driver + 1;
 
+         rt_proc_add_slot(active_proc, gid, driver);
+
          TRACE("allocate driver %s %d %s", fmt_group(g), driver,
                istr(tree_ident(active_proc->source)));
 
@@ -564,13 +1139,7 @@ void _alloc_driver(const int32_t *all_nets, int32_t all_length,
          const void *src = (init == NULL) ? g->resolved : initp;
 
          // Assign the initial value of the driver
-         waveform_t *dummy = rt_alloc(waveform_stack);
-         dummy->when   = 0;
-         dummy->next   = NULL;
-         dummy->values = rt_alloc_value(g);
-         memcpy(dummy->values->data, src, g->length * g->size);
-
-         d->waveforms = dummy;
+         rt_driver_init(g, d, src);
       }
 
       initp += g->length * g->size;
@@ -584,15 +1153,51 @@ void _private_stack(void)
          active_proc->tmp_alloc, _tmp_alloc);
 
    if (active_proc->tmp_stack == NULL && _tmp_alloc > 0) {
-      active_proc->tmp_stack = _tmp_stack;
+      active_proc->tmp_stack  = _tmp_stack;
+      active_proc->tmp_commit = proc_tmp_commit;
+      tmp_commit = &(active_proc->tmp_commit);
 
       proc_tmp_stack = mmap_guarded(PROC_TMP_STACK_SZ,
                                     istr(tree_ident(active_proc->source)));
+      proc_tmp_commit = 0;
    }
 
    active_proc->tmp_alloc = _tmp_alloc;
 }
 
+DLLEXPORT
+void _tmp_stack_grow(uint32_t want)
+{
+   // Called when an allocation moves past _tmp_limit which is either
+   // the high water mark of the owning process or the end of the
+   // committed part of the stack
+
+   if (unlikely(want > tmp_stack_size)) {
+      if (tmp_owner != NULL)
+         fatal_at(tree_loc(tmp_owner->source), "process %s exceeded the "
+                  "%u byte limit of its temporary stack",
+                  istr(tree_ident(tmp_owner->source)), tmp_stack_size);
+      else
+         fatal("initialisation exceeded the %u byte limit of the global "
+               "temporary stack", tmp_stack_size);
+   }
+
+   if (want > *tmp_commit) {
+      // Commit whole chunks up to the end of the stack
+      const uint32_t chunks = (want + TMP_COMMIT_SZ - 1) / TMP_COMMIT_SZ;
+      const uint32_t commit = MIN(chunks * TMP_COMMIT_SZ, tmp_stack_size);
+      mmap_commit((uint8_t *)_tmp_stack + *tmp_commit, commit - *tmp_commit);
+      *tmp_commit = commit;
+   }
+
+   if (tmp_owner != NULL) {
+      tmp_owner->tmp_peak = MAX(tmp_owner->tmp_peak, want);
+      _tmp_limit = MIN(tmp_owner->tmp_peak, *tmp_commit);
+   }
+   else
+      _tmp_limit = *tmp_commit;
+}
+
 DLLEXPORT
 void *_resolved_address(int32_t nid)
 {
@@ -619,9 +1224,12 @@ void _needs_last_value(const int32_t *nids, int32_t n)
 DLLEXPORT
 void _set_initial(int32_t nid, const uint8_t *values,
                   const size_list_t *size_list, int32_t nparts,
-                  const char *name)
+                  int32_t index, const char *name)
 {
-   tree_t decl = rt_recall_decl(name);
+   // The index of the declaration in the elaborated design is only
+   // known when the signal was generated as part of the top level
+   tree_t decl = index >= 0 ? tree_decl(top_tree, index)
+      : rt_recall_decl(name);
    RT_ASSERT(tree_kind(decl) == T_SIGNAL_DECL);
 
    TRACE("_set_initial %s values=%s nparts=%d", name,
@@ -631,7 +1239,9 @@ void _set_initial(int32_t nid, const uint8_t *values,
    for (int i = 0; i < nparts; i++)
       total_size += size_list[i].size * size_list[i].count;
 
-   uint8_t *res_mem  = xmalloc(total_size * 2);
+   // Values are taken from the arena in the order the signals are
+   // initialised which follows the order of net IDs
+   uint8_t *res_mem  = arena_alloc(signal_arena, total_size * 2);
    uint8_t *last_mem = res_mem + total_size;
 
    type_t type = tree_type(decl);
@@ -641,10 +1251,11 @@ void _set_initial(int32_t nid, const uint8_t *values,
    while (part < nparts) {
       groupid_t gid = netdb_lookup(netdb, nid + offset);
       netgroup_t *g = &(groups[gid]);
+      netgroup_cold_t *gc = &(groups_cold[gid]);
 
       const int size = size_list[part].size;
 
-      RT_ASSERT(g->sig_decl == NULL);
+      RT_ASSERT(gc->sig_decl == NULL);
       RT_ASSERT(remain >= g->length);
 
       res_memo_t *memo = NULL;
@@ -656,11 +1267,11 @@ void _set_initial(int32_t nid, const uint8_t *values,
             g->flags |= NET_F_BOUNDARY;
       }
 
-      g->sig_decl   = decl;
-      g->resolution = memo;
-      g->size       = size;
-      g->resolved   = res_mem;
-      g->last_value = last_mem;
+      g->resolution  = memo;
+      g->size        = size;
+      g->resolved    = res_mem;
+      gc->sig_decl   = decl;
+      gc->last_value = last_mem;
 
       if (offset == 0)
          g->flags |= NET_F_OWNS_MEM;
@@ -671,7 +1282,7 @@ void _set_initial(int32_t nid, const uint8_t *values,
       last_mem += nbytes;
 
       memcpy(g->resolved, src, nbytes);
-      memcpy(g->last_value, src, nbytes);
+      memcpy(gc->last_value, src, nbytes);
 
       offset += g->length;
       src    += nbytes;
@@ -686,7 +1297,8 @@ void _set_initial(int32_t nid, const uint8_t *values,
 
 DLLEXPORT
 void _set_initial_1(int32_t nid, const uint8_t *values, uint32_t size,
-                    uint32_t count, void *resolution, const char *name)
+                    uint32_t count, void *resolution, int32_t index,
+                    const char *name)
 {
    const size_list_t size_list = {
       .size       = size,
@@ -695,12 +1307,11 @@ void _set_initial_1(int32_t nid, const uint8_t *values, uint32_t size,
       .flags      = 0
    };
 
-   _set_initial(nid, values, &size_list, 1, name);
+   _set_initial(nid, values, &size_list, 1, index, name);
 }
 
-DLLEXPORT
-void _assert_fail(const uint8_t *msg, int32_t msg_len, int8_t severity,
-                  int8_t is_report, const rt_loc_t *where)
+static void rt_report(const uint8_t *msg, int32_t msg_len, int8_t severity,
+                      int8_t is_report, const rt_loc_t *where, bool backtrace)
 {
    // LRM 93 section 8.2
    // The error message consists of at least
@@ -715,12 +1326,8 @@ void _assert_fail(const uint8_t *msg, int32_t msg_len, int8_t severity,
       "Note", "Warning", "Error", "Failure"
    };
 
-   if (init_side_effect != SIDE_EFFECT_ALLOW) {
-      init_side_effect = SIDE_EFFECT_OCCURRED;
-      return;
-   }
-
-   rt_show_trace();
+   if (backtrace)
+      rt_show_trace();
 
    loc_t loc;
    from_rt_loc(where, &loc);
@@ -746,10 +1353,36 @@ void _assert_fail(const uint8_t *msg, int32_t msg_len, int8_t severity,
           : istr(tree_ident(active_proc->source))));
 }
 
+DLLEXPORT
+void _assert_fail(const uint8_t *msg, int32_t msg_len, int8_t severity,
+                  int8_t is_report, const rt_loc_t *where)
+{
+   if (init_side_effect != SIDE_EFFECT_ALLOW) {
+      init_side_effect = SIDE_EFFECT_OCCURRED;
+      return;
+   }
+
+   if (unlikely(txn_log != NULL)) {
+      // The backtrace cannot be captured from a worker thread so it
+      // is not printed for reports from processes run in parallel
+      const size_t data_off = txn_log_copy(txn_log, msg, msg_len);
+
+      txn_t *t = txn_log_add(txn_log, TXN_REPORT);
+      t->data  = data_off;
+      t->n     = msg_len;
+      t->flags = (severity << 1) | (is_report ? 1 : 0);
+      t->where = where;
+      return;
+   }
+
+   rt_report(msg, msg_len, severity, is_report, where, true);
+}
+
 DLLEXPORT
 void _bounds_fail(int32_t value, int32_t min, int32_t max, int32_t kind,
                   rt_loc_t *where, const char *hint)
 {
+   rt_worker_fatal();
    rt_show_trace();
 
    loc_t loc;
@@ -807,6 +1440,73 @@ void _bounds_fail(int32_t value, int32_t min, int32_t max, int32_t kind,
    }
 }
 
+static shash_t *rt_image_literals(const image_map_t *map)
+{
+   // Hash table from the lower case name of each enumeration literal to
+   // its position plus one, built once per map for each thread so no
+   // locking is required
+
+   if (image_cache == NULL)
+      image_cache = hash_new(64, true);
+
+   shash_t *h = hash_get(image_cache, map->elems);
+   if (h == NULL) {
+      h = shash_new(map->count * 2);
+
+      char key[map->stride];
+      for (int i = 0; i < map->count; i++) {
+         const char *elem = map->elems + (i * map->stride);
+         for (int j = 0; j < map->stride; j++)
+            key[j] = (elem[0] == '\'') ? elem[j] : tolower((int)elem[j]);
+
+         shash_put(h, key, (void *)(intptr_t)(i + 1));
+      }
+
+      hash_put(image_cache, map->elems, h);
+   }
+
+   return h;
+}
+
+static int64_t rt_image_lookup(const char **p, const char *endp,
+                               const image_map_t *map)
+{
+   // Find the enumeration literal at the start of the string without
+   // comparing against every literal in turn: extended identifiers and
+   // anything else unusual return -1 and use the general search
+
+   char key[map->stride];
+   int len = 0;
+
+   const char *s = *p;
+   if (s + 2 < endp && s[0] == '\'' && s[2] == '\'') {
+      if (map->stride < 4)
+         return -1;
+      memcpy(key, s, 3);
+      len = 3;
+   }
+   else {
+      while (s + len < endp && (isalnum((int)s[len]) || s[len] == '_')) {
+         if (len + 1 >= map->stride)
+            return -1;
+         key[len] = tolower((int)s[len]);
+         len++;
+      }
+   }
+
+   if (len == 0)
+      return -1;
+
+   key[len] = '\0';
+
+   const intptr_t pos = (intptr_t)shash_get(rt_image_literals(map), key);
+   if (pos == 0)
+      return -1;
+
+   *p += len;
+   return pos - 1;
+}
+
 DLLEXPORT
 int64_t _value_attr(const uint8_t *raw_str, int32_t str_len,
                     image_map_t *map, const rt_loc_t *where)
@@ -825,6 +1525,7 @@ int64_t _value_attr(const uint8_t *raw_str, int32_t str_len,
       {
          bool is_negative = p < endp && *p == '-';
          int num_digits = 0;
+         value = 0;
 
          if (is_negative) {
             ++p;
@@ -842,6 +1543,7 @@ int64_t _value_attr(const uint8_t *raw_str, int32_t str_len,
          }
 
          if (num_digits == 0) {
+            rt_worker_fatal();
             from_rt_loc(where, &loc);
             fatal_at(&loc, "invalid integer value "
                      "\"%.*s\"", str_len, (const char *)raw_str);
@@ -850,16 +1552,21 @@ int64_t _value_attr(const uint8_t *raw_str, int32_t str_len,
       break;
 
    case IMAGE_REAL:
+      rt_worker_fatal();
       from_rt_loc(where, &loc);
       fatal_at(&loc, "real values not yet supported in 'VALUE");
       break;
 
    case IMAGE_PHYSICAL:
+      rt_worker_fatal();
       from_rt_loc(where, &loc);
       fatal_at(&loc, "physical values not yet supported in 'VALUE");
       break;
 
    case IMAGE_ENUM:
+      if (map->count >= IMAGE_HASH_MIN)
+         value = rt_image_lookup(&p, endp, map);
+
       for (int i = 0; value < 0 && i < map->count; i++) {
          const char *elem = map->elems + (i * map->stride);
          bool match_case = false;
@@ -878,6 +1585,7 @@ int64_t _value_attr(const uint8_t *raw_str, int32_t str_len,
       }
 
       if (value < 0) {
+         rt_worker_fatal();
          from_rt_loc(where, &loc);
          fatal_at(&loc, "\"%.*s\" is not a valid enumeration value",
                   str_len, (const char *)raw_str);
@@ -887,6 +1595,7 @@ int64_t _value_attr(const uint8_t *raw_str, int32_t str_len,
 
    while (p < endp && *p != '\0') {
       if (!isspace((int)*p)) {
+         rt_worker_fatal();
          from_rt_loc(where, &loc);
          fatal_at(&loc, "found invalid characters \"%.*s\" after value "
                   "\"%.*s\"", (int)(endp - p), p, str_len,
@@ -901,6 +1610,8 @@ int64_t _value_attr(const uint8_t *raw_str, int32_t str_len,
 DLLEXPORT
 void _div_zero(const rt_loc_t *where)
 {
+   rt_worker_fatal();
+
    loc_t loc;
    from_rt_loc(where, &loc);
    fatal_at(&loc, "division by zero");
@@ -909,6 +1620,8 @@ void _div_zero(const rt_loc_t *where)
 DLLEXPORT
 void _null_deref(const rt_loc_t *where)
 {
+   rt_worker_fatal();
+
    loc_t loc;
    from_rt_loc(where, &loc);
    fatal_at(&loc, "null access dereference");
@@ -946,24 +1659,45 @@ void *_vec_load(const int32_t *nids, void *where,
 
    RT_ASSERT((g->flags & NET_F_LAST_VALUE) || !last);
 
+   const uint8_t *base =
+      unlikely(last) ? rt_group_cold(g)->last_value : g->resolved;
+   base += skip * g->size;
+
    if (offset + g->length - skip > high) {
       // If the signal data is already contiguous return a pointer to
       // that rather than copying into the user buffer
-      void *r = unlikely(last) ? g->last_value : g->resolved;
-      return (uint8_t *)r + (skip * g->size);
+      return (void *)base;
    }
 
-   uint8_t *p = where;
+   // The groups of a signal share one buffer so a slice that spans
+   // several groups of the same signal can still be returned without
+   // copying: only start gathering into the user buffer at the first
+   // group that does not follow on from the previous one
+
+   const uint8_t *expect = base;
+   uint8_t *p = NULL;
    for (;;) {
       const int to_copy = MIN(high - offset + 1, g->length - skip);
       const int bytes   = to_copy * g->size;
 
-      const void *src = unlikely(last) ? g->last_value : g->resolved;
+      const uint8_t *src =
+         unlikely(last) ? rt_group_cold(g)->last_value : g->resolved;
+      src += skip * g->size;
 
-      memcpy(p, (uint8_t *)src + (skip * g->size), bytes);
+      if (p == NULL && src != expect) {
+         p = where;
+         memcpy(p, base, expect - base);
+         p += expect - base;
+      }
+
+      if (p != NULL) {
+         memcpy(p, src, bytes);
+         p += bytes;
+      }
+      else
+         expect += bytes;
 
       offset += g->length - skip;
-      p += bytes;
 
       if (offset > high)
          break;
@@ -973,10 +1707,33 @@ void *_vec_load(const int32_t *nids, void *where,
       skip = nids[offset] - g->first;
    }
 
+   if (p == NULL)
+      return (void *)base;
+
    // Signal data was non-contiguous so return the user buffer
    return where;
 }
 
+static size_t rt_image_int(char *buf, int64_t val)
+{
+   // Equivalent to printing with "%"PRIi64 without the printf overhead
+   char digits[20];
+   int ndigits = 0;
+   uint64_t mag = (val < 0) ? -(uint64_t)val : val;
+   do {
+      digits[ndigits++] = '0' + (mag % 10);
+      mag /= 10;
+   } while (mag > 0);
+
+   size_t len = 0;
+   if (val < 0)
+      buf[len++] = '-';
+   while (ndigits > 0)
+      buf[len++] = digits[--ndigits];
+
+   return len;
+}
+
 DLLEXPORT
 void _image(int64_t val, image_map_t *map, struct uarray *u)
 {
@@ -985,14 +1742,15 @@ void _image(int64_t val, image_map_t *map, struct uarray *u)
 
    switch (map->kind) {
    case IMAGE_INTEGER:
-      buf = rt_tmp_alloc(16);
-      len = checked_sprintf(buf, 16, "%"PRIi64, val);
+      buf = rt_tmp_alloc(24);
+      len = rt_image_int(buf, val);
       break;
 
    case IMAGE_ENUM:
-      buf = rt_tmp_alloc(map->stride);
-      strncpy(buf, map->elems + (val * map->stride), map->stride);
-      len = strlen(buf);
+      // The literal names are constant so return a pointer to the map
+      // rather than copying
+      buf = (char *)map->elems + (val * map->stride);
+      len = strnlen(buf, map->stride);
       break;
 
    case IMAGE_REAL:
@@ -1001,15 +1759,32 @@ void _image(int64_t val, image_map_t *map, struct uarray *u)
             double  d;
             int64_t i;
          } u = { .i = val };
-         buf = rt_tmp_alloc(32);
-         len = checked_sprintf(buf, 32, "%.*g", 17, u.d);
+
+         // "%.17g" prints whole numbers of fewer than 17 digits without
+         // a decimal point or exponent
+         if (fabs(u.d) < 1e15 && u.d == (double)(int64_t)u.d
+             && !(u.d == 0.0 && signbit(u.d))) {
+            buf = rt_tmp_alloc(24);
+            len = rt_image_int(buf, (int64_t)u.d);
+         }
+         else {
+            buf = rt_tmp_alloc(32);
+            len = checked_sprintf(buf, 32, "%.*g", 17, u.d);
+         }
       }
       break;
 
    case IMAGE_PHYSICAL:
-      buf = rt_tmp_alloc(16 + map->stride);
-      len = checked_sprintf(buf, 16 + map->stride, "%"PRIi64" %s",
-                            val, map->elems + (0 * map->stride));
+      {
+         const char *unit = map->elems + (0 * map->stride);
+         const size_t unitlen = strnlen(unit, map->stride);
+
+         buf = rt_tmp_alloc(24 + unitlen);
+         len = rt_image_int(buf, val);
+         buf[len++] = ' ';
+         memcpy(buf + len, unit, unitlen);
+         len += unitlen;
+      }
       break;
    }
 
@@ -1031,29 +1806,7 @@ void _bit_shift(int32_t kind, const uint8_t *data, int32_t len,
    shift %= len;
 
    uint8_t *buf = rt_tmp_alloc(len);
-
-   for (int i = 0; i < len; i++) {
-      switch (kind) {
-      case BIT_SHIFT_SLL:
-         buf[i] = (i < len - shift) ? data[i + shift] : 0;
-         break;
-      case BIT_SHIFT_SRL:
-         buf[i] = (i >= shift) ? data[i - shift] : 0;
-         break;
-      case BIT_SHIFT_SLA:
-         buf[i] = (i < len - shift) ? data[i + shift] : data[len - 1];
-         break;
-      case BIT_SHIFT_SRA:
-         buf[i] = (i >= shift) ? data[i - shift] : data[0];
-         break;
-      case BIT_SHIFT_ROL:
-         buf[i] = (i < len - shift) ? data[i + shift] : data[(i + shift) % len];
-         break;
-      case BIT_SHIFT_ROR:
-         buf[i] = (i >= shift) ? data[i - shift] : data[len + i - shift];
-         break;
-      }
-   }
+   bitvec_shift(kind, data, buf, len, shift);
 
    u->ptr = buf;
    u->dims[0].left  = (dir == RANGE_TO) ? 0 : len - 1;
@@ -1066,47 +1819,13 @@ void _bit_vec_op(int32_t kind, const uint8_t *left, int32_t left_len,
                  int8_t left_dir, const uint8_t *right, int32_t right_len,
                  int8_t right_dir, struct uarray *u)
 {
-   if ((kind != BIT_VEC_NOT) && (left_len != right_len))
+   if ((kind != BIT_VEC_NOT) && (left_len != right_len)) {
+      rt_worker_fatal();
       fatal("arguments to bit vector operation are not the same length");
+   }
 
    uint8_t *buf = rt_tmp_alloc(left_len);
-
-   switch (kind) {
-   case BIT_VEC_NOT:
-      for (int i = 0; i < left_len; i++)
-         buf[i] = !left[i];
-      break;
-
-   case BIT_VEC_AND:
-      for (int i = 0; i < left_len; i++)
-         buf[i] = left[i] && right[i];
-      break;
-
-   case BIT_VEC_OR:
-      for (int i = 0; i < left_len; i++)
-         buf[i] = left[i] || right[i];
-      break;
-
-   case BIT_VEC_XOR:
-      for (int i = 0; i < left_len; i++)
-         buf[i] = left[i] ^ right[i];
-      break;
-
-   case BIT_VEC_XNOR:
-      for (int i = 0; i < left_len; i++)
-         buf[i] = !(left[i] ^ right[i]);
-      break;
-
-   case BIT_VEC_NAND:
-      for (int i = 0; i < left_len; i++)
-         buf[i] = !(left[i] && right[i]);
-      break;
-
-   case BIT_VEC_NOR:
-      for (int i = 0; i < left_len; i++)
-         buf[i] = !(left[i] || right[i]);
-      break;
-   }
+   bitvec_op(kind, left, right, buf, left_len);
 
    u->ptr = buf;
    u->dims[0].left  = (left_dir == RANGE_TO) ? 0 : left_len - 1;
@@ -1169,20 +1888,56 @@ int32_t _test_net_flag(const int32_t *nids, int32_t n, int32_t flag)
    return 0;
 }
 
+static void rt_file_flush(rt_file_t *f)
+{
+   if (f->wlen > 0) {
+      fwrite(f->wbuf, 1, f->wlen, f->fp);
+      f->wlen = 0;
+   }
+}
+
+static void rt_file_flush_all(void)
+{
+   for (rt_file_t *it = open_files; it != NULL; it = it->next)
+      rt_file_flush(it);
+}
+
+static void rt_file_close(rt_file_t *f)
+{
+   rt_file_flush(f);
+
+   if (f->map != NULL)
+      unmap_file((void *)f->map, f->mapsz);
+
+   fclose(f->fp);
+   free(f->wbuf);
+
+   for (rt_file_t **it = &open_files; *it != NULL; it = &((*it)->next)) {
+      if (*it == f) {
+         *it = f->next;
+         break;
+      }
+   }
+
+   free(f);
+}
+
 DLLEXPORT
 void _file_open(int8_t *status, void **_fp, uint8_t *name_bytes,
                 int32_t name_len, int8_t mode)
 {
-   FILE **fp = (FILE **)_fp;
+   rt_file_t **fp = (rt_file_t **)_fp;
    if (*fp != NULL) {
       if (status != NULL) {
          *status = 1;   // STATUS_ERROR
          return;
       }
-      else
+      else {
          // This is to support closing a file implicitly when the
          // design is reset
-         fclose(*fp);
+         rt_file_close(*fp);
+         *fp = NULL;
+      }
    }
 
    char *fname = xmalloc(name_len + 1);
@@ -1199,14 +1954,20 @@ void _file_open(int8_t *status, void **_fp, uint8_t *name_bytes,
    if (status != NULL)
       *status = 0;   // OPEN_OK
 
+   // The standard streams are shared with report output so are not
+   // given a private buffer
+   bool std_stream = true;
+   FILE *stream;
    if (strcmp(fname, "STD_INPUT") == 0)
-      *fp = stdin;
+      stream = stdin;
    else if (strcmp(fname, "STD_OUTPUT") == 0)
-      *fp = stdout;
-   else
-      *fp = fopen(fname, mode_str[mode]);
+      stream = stdout;
+   else {
+      stream = fopen(fname, mode_str[mode]);
+      std_stream = false;
+   }
 
-   if (*fp == NULL) {
+   if (stream == NULL) {
       if (status == NULL)
          fatal_errno("failed to open %s", fname);
       else {
@@ -1221,35 +1982,79 @@ void _file_open(int8_t *status, void **_fp, uint8_t *name_bytes,
             fatal_errno("%s", fname);
          }
       }
+
+      free(fname);
+      return;
+   }
+
+   rt_file_t *f = xcalloc(sizeof(rt_file_t));
+   f->fp = stream;
+
+   if (!std_stream && mode == 0) {
+      struct stat st;
+      if (fstat(fileno(stream), &st) == 0 && S_ISREG(st.st_mode)
+          && st.st_size > 0) {
+         f->mapsz = st.st_size;
+         f->map   = map_file(fileno(stream), f->mapsz);
+      }
    }
+   else if (!std_stream)
+      f->wbuf = xmalloc(FILE_BUF_SZ);
 
+   if (open_files == NULL)
+      atexit(rt_file_flush_all);
+
+   f->next = open_files;
+   open_files = f;
+
+   *fp = f;
    free(fname);
 }
 
 DLLEXPORT
 void _file_write(void **_fp, uint8_t *data, int32_t len)
 {
-   FILE **fp = (FILE **)_fp;
+   rt_file_t *f = *(rt_file_t **)_fp;
 
-   TRACE("_file_write fp=%p data=%p len=%d", fp, data, len);
+   TRACE("_file_write fp=%p data=%p len=%d", _fp, data, len);
 
-   if (*fp == NULL)
+   if (f == NULL)
       fatal("write to closed file");
 
-   fwrite(data, 1, len, *fp);
+   if (f->wbuf == NULL)
+      fwrite(data, 1, len, f->fp);
+   else {
+      if (f->wlen + len > FILE_BUF_SZ)
+         rt_file_flush(f);
+
+      if (len >= FILE_BUF_SZ)
+         fwrite(data, 1, len, f->fp);
+      else {
+         memcpy(f->wbuf + f->wlen, data, len);
+         f->wlen += len;
+      }
+   }
 }
 
 DLLEXPORT
 void _file_read(void **_fp, uint8_t *data, int32_t len, int32_t *out)
 {
-   FILE **fp = (FILE **)_fp;
+   rt_file_t *f = *(rt_file_t **)_fp;
 
-   TRACE("_file_read fp=%p data=%p len=%d", fp, data, len);
+   TRACE("_file_read fp=%p data=%p len=%d", _fp, data, len);
 
-   if (*fp == NULL)
+   if (f == NULL)
       fatal("read from closed file");
 
-   size_t n = fread(data, 1, len, *fp);
+   size_t n;
+   if (f->map != NULL) {
+      n = MIN(len, f->mapsz - f->pos);
+      memcpy(data, f->map + f->pos, n);
+      f->pos += n;
+   }
+   else
+      n = fread(data, 1, len, f->fp);
+
    if (out != NULL)
       *out = n;
 }
@@ -1257,30 +2062,33 @@ void _file_read(void **_fp, uint8_t *data, int32_t len, int32_t *out)
 DLLEXPORT
 void _file_close(void **_fp)
 {
-   FILE **fp = (FILE **)_fp;
+   rt_file_t **fp = (rt_file_t **)_fp;
 
    TRACE("_file_close fp=%p", fp);
 
    if (*fp == NULL)
       fatal("attempt to close already closed file");
 
-   fclose(*fp);
+   rt_file_close(*fp);
    *fp = NULL;
 }
 
 DLLEXPORT
 int8_t _endfile(void *_f)
 {
-   FILE *f = _f;
+   rt_file_t *f = _f;
 
    if (f == NULL)
       fatal("ENDFILE called on closed file");
 
-   int c = fgetc(f);
+   if (f->map != NULL)
+      return f->pos == f->mapsz;
+
+   int c = fgetc(f->fp);
    if (c == EOF)
       return 1;
    else {
-      ungetc(c, f);
+      ungetc(c, f->fp);
       return 0;
    }
 }
@@ -1315,7 +2123,7 @@ static void deltaq_insert(event_t *e)
    }
    else {
       e->delta_chain = NULL;
-      heap_insert(eventq_heap, heap_key(e->when, e->kind), e);
+      eventq_insert(e);
    }
 }
 
@@ -1331,13 +2139,14 @@ static void deltaq_insert_proc(uint64_t delta, rt_proc_t *wake)
 }
 
 static void deltaq_insert_driver(uint64_t delta, netgroup_t *group,
-                                 rt_proc_t *driver)
+                                 rt_proc_t *proc, int driver)
 {
    event_t *e = rt_alloc(event_stack);
    e->when       = now + delta;
    e->kind       = E_DRIVER;
    e->group      = group;
-   e->proc       = driver;
+   e->proc       = proc;
+   e->driver     = driver;
    e->wakeup_gen = UINT32_MAX;
 
    deltaq_insert(e);
@@ -1360,6 +2169,9 @@ static void deltaq_walk(uint64_t key, void *user, void *context)
    case E_TIMEOUT:
       fprintf(stderr, "timeout\t %p %p\n", e->timeout_fn, e->timeout_user);
       break;
+   case E_CLOCK:
+      fprintf(stderr, "clock\t %s\n", fmt_group(e->proc->clock_group));
+      break;
    }
 }
 
@@ -1373,7 +2185,10 @@ static void deltaq_dump(void)
               istr(tree_ident(e->proc->source)),
               (e->wakeup_gen == e->proc->wakeup_gen) ? "" : " (stale)");
 
-   heap_walk(eventq_heap, deltaq_walk, NULL);
+   if (use_wheel)
+      wheel_walk(eventq_wheel, deltaq_walk, NULL);
+   else
+      heap_walk(eventq_heap, deltaq_walk, NULL);
 }
 #endif
 
@@ -1437,10 +2252,27 @@ static res_memo_t *rt_memo_resolution_fn(type_t type, resolution_fn_t fn)
       identity = identity && (memo->tab1[i] == i);
    }
 
+   // If the function agrees with folding the two value table over
+   // three drivers then assume it can be applied pairwise for any
+   // number of drivers
+
+   bool fold = true;
+   for (int i = 0; fold && i < nlits; i++) {
+      for (int j = 0; fold && j < nlits; j++) {
+         for (int k = 0; fold && k < nlits; k++) {
+            int8_t args[3] = { i, j, k };
+            fold = ((*fn)(args, 3) == memo->tab2[memo->tab2[i][j]][k]);
+         }
+      }
+   }
+
    if (init_side_effect != SIDE_EFFECT_OCCURRED) {
+      memo->nlits  = nlits;
       memo->flags |= R_MEMO;
       if (identity)
          memo->flags |= R_IDENT;
+      if (fold)
+         memo->flags |= R_FOLD;
    }
 
    return memo;
@@ -1463,25 +2295,88 @@ static void rt_global_event(rt_event_t kind)
 
 static value_t *rt_alloc_value(netgroup_t *g)
 {
-   if (g->free_values == NULL) {
-      const size_t size = MAX(sizeof(uint64_t), g->size * g->length);
-      value_t *v = xmalloc(sizeof(struct value) + size);
-      v->next = NULL;
-      return v;
+   const size_t size = MAX(sizeof(uint64_t), g->size * g->length);
+   value_t *v = arena_alloc(signal_arena, sizeof(struct value) + size);
+   v->next = NULL;
+   return v;
+}
+
+static void rt_driver_alloc(const netgroup_t *g, driver_t *d,
+                            uint32_t capacity)
+{
+   // The transaction times and values for a driver are kept in a single
+   // ring buffer sized to a power of two
+
+   const size_t valuesz = g->size * g->length;
+   d->capacity = capacity;
+   d->when     = xmalloc(capacity * (sizeof(uint64_t) + valuesz));
+   d->values   = (uint8_t *)(d->when + capacity);
+}
+
+static inline uint32_t rt_driver_init_capacity(const netgroup_t *g)
+{
+   return (g->size * g->length > 64) ? 2 : DRIVER_INIT_TXNS;
+}
+
+static void rt_driver_init(const netgroup_t *g, driver_t *d, const void *init)
+{
+   const size_t valuesz = g->size * g->length;
+   rt_driver_alloc(g, d, rt_driver_init_capacity(g));
+
+   d->head    = 0;
+   d->count   = 1;
+   d->when[0] = 0;
+   memcpy(d->values, init, valuesz);
+}
+
+static void rt_driver_resize(const netgroup_t *g, driver_t *d,
+                             uint32_t capacity)
+{
+   const size_t valuesz = g->size * g->length;
+   const uint32_t old_mask = d->capacity - 1;
+
+   RT_ASSERT(d->count <= capacity);
+
+   driver_t old = *d;
+   rt_driver_alloc(g, d, capacity);
+
+   for (uint32_t i = 0; i < old.count; i++) {
+      const uint32_t slot = (old.head + i) & old_mask;
+      d->when[i] = old.when[slot];
+      memcpy(d->values + i * valuesz, old.values + slot * valuesz, valuesz);
    }
-   else {
-      value_t *v = g->free_values;
-      g->free_values = v->next;
-      v->next = NULL;
-      return v;
+
+   d->head = 0;
+   free(old.when);
+}
+
+static void rt_driver_grow(const netgroup_t *g, driver_t *d)
+{
+   // Only long transport delay waveforms should need to grow the queue
+   rt_driver_resize(g, d, d->capacity * 2);
+
+   // Remember the driver so the queue can shrink again when the long
+   // waveform has been consumed
+   if (d->capacity == rt_driver_init_capacity(g) * 2) {
+      if (n_grown_drivers == n_grown_alloc) {
+         n_grown_alloc = MAX(n_grown_alloc * 2, 16);
+         grown_drivers = xrealloc(grown_drivers,
+                                  n_grown_alloc * sizeof(drv_slot_t));
+      }
+
+      drv_slot_t *slot = &(grown_drivers[n_grown_drivers++]);
+      slot->gid    = g - groups;
+      slot->driver = d - g->drivers;
    }
 }
 
-static void rt_free_value(netgroup_t *g, value_t *v)
+static inline void *rt_driver_value(const netgroup_t *g, const driver_t *d,
+                                    uint32_t n)
 {
-   RT_ASSERT(v->next == NULL);
-   v->next = g->free_values;
-   g->free_values = v;
+   // Return the nth value in the driver queue where zero is the current
+   // driving value
+   const uint32_t slot = (d->head + n) & (d->capacity - 1);
+   return d->values + slot * g->size * g->length;
 }
 
 static void *rt_tmp_alloc(size_t sz)
@@ -1490,12 +2385,148 @@ static void *rt_tmp_alloc(size_t sz)
 
    uint8_t *ptr = (uint8_t *)_tmp_stack + _tmp_alloc;
    _tmp_alloc += sz;
+
+   if (unlikely(_tmp_alloc > _tmp_limit))
+      _tmp_stack_grow(_tmp_alloc);
+
    return ptr;
 }
 
+static void rt_select_tmp_stack(void *stack, uint32_t alloc, rt_proc_t *owner)
+{
+   // The temporary stacks are reserved but only committed in chunks by
+   // _tmp_stack_grow so the reservation can be generous and a process
+   // suspending in a wait releases everything it allocated by resetting
+   // the offset
+
+   _tmp_stack = stack;
+   _tmp_alloc = alloc;
+
+   if ((tmp_owner = owner) != NULL) {
+      tmp_stack_size = PROC_TMP_STACK_SZ;
+      if (stack == owner->tmp_stack)
+         tmp_commit = &(owner->tmp_commit);
+      else
+         tmp_commit = &proc_tmp_commit;
+      _tmp_limit = MIN(MAX(owner->tmp_peak, alloc), *tmp_commit);
+   }
+   else {
+      tmp_stack_size = GLOBAL_TMP_STACK_SZ;
+      tmp_commit = &global_tmp_commit;
+      _tmp_limit = global_tmp_commit;
+   }
+}
+
+static inline uint32_t rt_sens_hash(sens_list_t **list)
+{
+   return (uint32_t)((uintptr_t)list >> 3) * UINT32_C(2654435761);
+}
+
+static void rt_proc_insert_sens(rt_proc_t *proc, sens_list_t *sl)
+{
+   for (uint32_t h = rt_sens_hash(sl->key); ; h++) {
+      sens_list_t **s = &(proc->sens[h & proc->sens_mask]);
+      if (*s == NULL) {
+         *s = sl;
+         return;
+      }
+   }
+}
+
+static sens_list_t *rt_proc_sens_slot(rt_proc_t *proc, sens_list_t **list)
+{
+   // Each process owns one sensitivity list entry for every list it has
+   // waited on before, found through a small open addressing hash table
+   // keyed by the list. Executing the same wait statement again re-arms
+   // these entries in place rather than searching the list for a stale
+   // entry or allocating a new one.
+
+   if (proc->sens != NULL) {
+      for (uint32_t h = rt_sens_hash(list); ; h++) {
+         sens_list_t *sl = proc->sens[h & proc->sens_mask];
+         if (sl == NULL)
+            break;
+         else if (sl->key == list)
+            return sl;
+      }
+   }
+
+   if (proc->n_sens == SENS_SLOTS_MAX)
+      return NULL;
+
+   const uint32_t size = proc->sens_mask + 1;
+
+   if (proc->sens == NULL || (proc->n_sens + 1) * 2 > size) {
+      sens_list_t **old = proc->sens;
+      const uint32_t old_size = (old == NULL) ? 0 : size;
+      const uint32_t new_size = MAX(old_size * 2, 8);
+
+      proc->sens      = xcalloc(new_size * sizeof(sens_list_t *));
+      proc->sens_mask = new_size - 1;
+
+      for (uint32_t i = 0; i < old_size; i++) {
+         if (old[i] != NULL)
+            rt_proc_insert_sens(proc, old[i]);
+      }
+
+      free(old);
+   }
+
+   sens_list_t *sl = xcalloc(sizeof(sens_list_t));
+   sl->proc  = proc;
+   sl->key   = list;
+   sl->owned = true;
+
+   rt_proc_insert_sens(proc, sl);
+   proc->n_sens++;
+
+   return sl;
+}
+
+static void rt_proc_free_sens(rt_proc_t *proc)
+{
+   for (uint32_t i = 0; proc->sens != NULL && i <= proc->sens_mask; i++)
+      free(proc->sens[i]);
+
+   free(proc->sens);
+   proc->sens      = NULL;
+   proc->n_sens    = 0;
+   proc->sens_mask = 0;
+}
+
+static void rt_sens_release(sens_list_t *sl)
+{
+   // Entries owned by a process stay allocated until the process is
+   // reset and are only marked as no longer being on any list
+   if (sl->owned)
+      sl->linked = false;
+   else
+      rt_free(sens_list_stack, sl);
+}
+
 static void rt_sched_event(sens_list_t **list, netid_t first, netid_t last,
-                           rt_proc_t *proc, bool is_static)
+                           rt_proc_t *proc, bool is_static, uint32_t accept)
 {
+   sens_list_t *sl = is_static ? NULL : rt_proc_sens_slot(proc, list);
+   if (likely(sl != NULL)) {
+      if (!sl->linked) {
+         sl->next   = *list;
+         sl->linked = true;
+         *list = sl;
+      }
+      else if (sl->wakeup_gen == proc->wakeup_gen)
+         sl = NULL;   // Already armed by this wait for another range
+   }
+
+   if (likely(sl != NULL)) {
+      RT_STAT(stats.sens_rearmed++);
+      sl->wakeup_gen = proc->wakeup_gen;
+      sl->first      = first;
+      sl->last       = last;
+      sl->accept     = accept;
+      return;
+   }
+
    // See if there is already a stale entry in the pending
    // list for this process
    sens_list_t *it = *list;
@@ -1514,6 +2545,10 @@ static void rt_sched_event(sens_list_t **list, netid_t first, netid_t last,
       node->first      = first;
       node->last       = last;
       node->reenq      = (is_static ? list : NULL);
+      node->accept     = accept;
+      node->key        = NULL;
+      node->owned      = false;
+      node->linked     = true;
 
       *list = node;
    }
@@ -1523,16 +2558,67 @@ static void rt_sched_event(sens_list_t **list, netid_t first, netid_t last,
       it->wakeup_gen = proc->wakeup_gen;
       it->first      = first;
       it->last       = last;
+      it->accept     = accept;
+   }
+}
+
+static sens_list_t **rt_range_bucket(netid_t first, netid_t last)
+{
+   RT_ASSERT(last >= first);
+
+   const uint64_t length = (uint64_t)last - first + 1;
+
+   int level = 0;
+   while (length > (UINT64_C(1) << (RANGE_MIN_BITS + level)))
+      level++;
+
+   const int shift = RANGE_MIN_BITS + level;
+   range_level_t *rl = &(range_index[level]);
+
+   if (rl->buckets == NULL) {
+      // The bucket array is never resized as static sensitivity list
+      // entries point back at the bucket they are re-queued on
+      rl->nbuckets = (netdb_nets(netdb) >> shift) + 1;
+      rl->buckets  = xcalloc(rl->nbuckets * sizeof(sens_list_t *));
+   }
+
+   RT_ASSERT((first >> shift) < rl->nbuckets);
+   return &(rl->buckets[first >> shift]);
+}
+
+static void rt_free_range_index(bool free_buckets)
+{
+   for (int level = 0; level < RANGE_LEVELS; level++) {
+      range_level_t *rl = &(range_index[level]);
+      for (netid_t b = 0; rl->buckets && b < rl->nbuckets; b++) {
+         while (rl->buckets[b] != NULL) {
+            sens_list_t *next = rl->buckets[b]->next;
+            rt_sens_release(rl->buckets[b]);
+            rl->buckets[b] = next;
+         }
+      }
+
+      if (free_buckets) {
+         free(rl->buckets);
+         rl->buckets  = NULL;
+         rl->nbuckets = 0;
+      }
    }
 }
 
 #if TRACE_PENDING
 static void rt_dump_pending(void)
 {
-   for (struct sens_list *it = pending; it != NULL; it = it->next) {
-      printf("%d..%d\t%s%s\n", it->first, it->last,
-             istr(tree_ident(it->proc->source)),
-             (it->wakeup_gen == it->proc->wakeup_gen) ? "" : " (stale)");
+   for (int level = 0; level < RANGE_LEVELS; level++) {
+      const range_level_t *rl = &(range_index[level]);
+      for (netid_t b = 0; rl->buckets && b < rl->nbuckets; b++) {
+         for (sens_list_t *it = rl->buckets[b]; it != NULL; it = it->next) {
+            printf("%d..%d\t%s%s\n", it->first, it->last,
+                   istr(tree_ident(it->proc->source)),
+                   (it->wakeup_gen == it->proc->wakeup_gen)
+                   ? "" : " (stale)");
+         }
+      }
    }
 }
 #endif  // TRACE_PENDING
@@ -1541,6 +2627,7 @@ static void rt_reset_group(groupid_t gid, netid_t first, unsigned length)
 {
    netgroup_t *g = &(groups[gid]);
    memset(g, '\0', sizeof(netgroup_t));
+   memset(&(groups_cold[gid]), '\0', sizeof(netgroup_cold_t));
    g->first       = first;
    g->length      = length;
    g->last_event  = INT64_MAX;
@@ -1555,840 +2642,3077 @@ static void rt_free_delta_events(event_t *e)
    }
 }
 
-static void rt_setup(tree_t top)
-{
-   now = 0;
-   iteration = -1;
-   active_proc = NULL;
-   force_stop = false;
-   can_create_delta = true;
+typedef struct {
+   bool     safe;
+   hash_t  *visited;
+   tree_t  *bodies;
+   unsigned n_bodies;
+   unsigned max_bodies;
+} par_check_t;
 
-   RT_ASSERT(resume == NULL);
+static void rt_parallel_check_body(tree_t body, par_check_t *pc)
+{
+   // Subprogram bodies are checked after the current tree walk as
+   // visits cannot be nested
+   if (hash_get(pc->visited, body) == NULL) {
+      hash_put(pc->visited, body, body);
+      ARRAY_APPEND(pc->bodies, body, pc->n_bodies, pc->max_bodies);
+   }
+}
 
-   rt_free_delta_events(delta_proc);
-   rt_free_delta_events(delta_driver);
+static void rt_parallel_check(tree_t t, void *context)
+{
+   // A process can only run in parallel if it has no side effects
+   // other than through the kernel entry points that are logged
+
+   par_check_t *pc = context;
+
+   switch (tree_kind(t)) {
+   case T_REF:
+      if (tree_has_ref(t)) {
+         tree_t decl = tree_ref(t);
+         const tree_kind_t kind = tree_kind(decl);
+         if (kind == T_FILE_DECL)
+            pc->safe = false;
+         else if (kind == T_VAR_DECL && (tree_flags(decl) & TREE_F_SHARED))
+            pc->safe = false;
+      }
+      break;
 
-   if (eventq_heap != NULL)
-      heap_free(eventq_heap);
-   eventq_heap = heap_new(512);
+   case T_FCALL:
+   case T_PCALL:
+      {
+         tree_t decl = tree_ref(t);
+         const tree_kind_t kind = tree_kind(decl);
 
-   if (netdb == NULL) {
-      netdb = netdb_open(top);
-      groups = xmalloc(sizeof(struct netgroup) * netdb_size(netdb));
-   }
+         if (tree_attr_str(decl, builtin_i) != NULL)
+            break;
+         else if (tree_attr_tree(decl, foreign_i) != NULL)
+            pc->safe = false;
+         else if (tree_attr_int(decl, impure_io_i, 0) != 0)
+            pc->safe = false;
+         else if (kind == T_FUNC_DECL || kind == T_FUNC_BODY) {
+            if (!(tree_flags(decl) & TREE_F_IMPURE))
+               break;
+            else if (kind == T_FUNC_DECL)
+               pc->safe = false;   // Body in another unit is not visible
+            else
+               rt_parallel_check_body(decl, pc);
+         }
+         else if (kind == T_PROC_DECL)
+            pc->safe = false;
+         else if (kind == T_PROC_BODY)
+            rt_parallel_check_body(decl, pc);
+      }
+      break;
 
-   if (procs == NULL) {
-      n_procs = tree_stmts(top);
-      procs   = xmalloc(sizeof(struct rt_proc) * n_procs);
+   default:
+      break;
    }
+}
 
-   const int ndecls = tree_decls(top);
-   decl_hash = hash_new(next_power_of_2(ndecls * 2), true);
-   for (int i = 0; i < ndecls; i++) {
-      tree_t d = tree_decl(top, i);
-      hash_put(decl_hash, tree_ident(d), d);
-   }
+static bool rt_parallel_safe(tree_t proc)
+{
+   par_check_t pc = {
+      .safe       = true,
+      .visited    = hash_new(64, true),
+      .bodies     = xmalloc(sizeof(tree_t) * 16),
+      .n_bodies   = 0,
+      .max_bodies = 16
+   };
 
-   res_memo_hash = hash_new(128, true);
+   rt_parallel_check_body(proc, &pc);
 
-   netdb_walk(netdb, rt_reset_group);
+   for (unsigned i = 0; pc.safe && i < pc.n_bodies; i++)
+      tree_visit(pc.bodies[i], rt_parallel_check, &pc);
 
-   const int nstmts = tree_stmts(top);
-   for (int i = 0; i < nstmts; i++) {
-      tree_t p = tree_stmt(top, i);
-      RT_ASSERT(tree_kind(p) == T_PROCESS);
+   hash_free(pc.visited);
+   free(pc.bodies);
 
-      procs[i].source     = p;
-      procs[i].proc_fn    = jit_find_symbol(istr(tree_ident(p)), true);
-      procs[i].wakeup_gen = 0;
-      procs[i].postponed  = !!(tree_flags(p) & TREE_F_POSTPONED);
-      procs[i].tmp_stack  = NULL;
-      procs[i].tmp_alloc  = 0;
-      procs[i].pending    = false;
-      procs[i].usage      = 0;
-   }
+   return pc.safe;
 }
 
-static void rt_run(struct rt_proc *proc, bool reset)
+static const uint8_t *rt_clock_pattern(tree_t proc, uint64_t *period)
 {
-   TRACE("%s process %s", reset ? "reset" : "run",
-         istr(tree_ident(proc->source)));
+   // Recognise the common clock generator "clk <= not clk after T"
+   // which can be toggled by the kernel without running the process
 
-   uint64_t start_clock = 0;
-   if (profiling)
-      start_clock = get_timestamp_us();
+   static const uint8_t bit_not[] = { 1, 0 };
+   static const uint8_t std_ulogic_not[] = {
+      0 /* U */, 1 /* X */, 3 /* 0 */, 2 /* 1 */, 1 /* Z */,
+      1 /* W */, 3 /* L */, 2 /* H */, 1 /* - */
+   };
 
-   if (reset) {
-      _tmp_stack = global_tmp_stack;
-      _tmp_alloc = global_tmp_alloc;
-   }
-   else if (proc->tmp_stack != NULL) {
-      TRACE("using private stack at %p %d", proc->tmp_stack, proc->tmp_alloc);
-      _tmp_stack = proc->tmp_stack;
-      _tmp_alloc = proc->tmp_alloc;
+   if ((tree_flags(proc) & TREE_F_POSTPONED) || tree_decls(proc) > 0
+       || tree_stmts(proc) != 2)
+      return NULL;
 
-      // Will be updated by _private_stack if suspending in procedure otherwise
-      // clear stack when process suspends
-      proc->tmp_alloc = 0;
-   }
-   else {
-      _tmp_stack = proc_tmp_stack;
-      _tmp_alloc = 0;
-   }
+   tree_t assign = tree_stmt(proc, 0);
+   tree_t wait   = tree_stmt(proc, 1);
 
-   active_proc = proc;
-   (*proc->proc_fn)(reset ? 1 : 0);
+   if (tree_kind(assign) != T_SIGNAL_ASSIGN || tree_kind(wait) != T_WAIT)
+      return NULL;
 
-   if (reset)
-      global_tmp_alloc = _tmp_alloc;
+   tree_t target = tree_target(assign);
+   if (tree_kind(target) != T_REF || tree_waveforms(assign) != 1)
+      return NULL;
 
-   if (start_clock != 0)
-      proc->usage += get_timestamp_us() - start_clock;
-}
+   tree_t decl = tree_ref(target);
+   if (tree_kind(decl) != T_SIGNAL_DECL || tree_nets(decl) != 1)
+      return NULL;
 
-static void rt_call_module_reset(ident_t name)
-{
-   char *buf LOCAL = xasprintf("%s_reset", istr(name));
+   tree_t wave = tree_waveform(assign, 0);
+   int64_t delay;
+   if (!tree_has_delay(wave) || !folded_int(tree_delay(wave), &delay)
+       || delay <= 0)
+      return NULL;
 
-   _tmp_stack = global_tmp_stack;
-   _tmp_alloc = global_tmp_alloc;
+   tree_t value = tree_value(wave);
+   if (tree_kind(value) != T_FCALL || tree_params(value) != 1)
+      return NULL;
 
-   void (*reset_fn)(void) = jit_find_symbol(buf, false);
-   if (reset_fn != NULL) {
-      TRACE("reset module %s", istr(name));
-      (*reset_fn)();
-   }
+   tree_t arg = tree_value(tree_param(value, 0));
+   if (tree_kind(arg) != T_REF || tree_ref(arg) != decl)
+      return NULL;
 
-   global_tmp_alloc = _tmp_alloc;
-}
+   if (tree_has_delay(wait) || tree_has_value(wait) || tree_triggers(wait) != 1)
+      return NULL;
 
-static int32_t rt_resolve_group(netgroup_t *group, int driver, void *values)
+   tree_t trigger = tree_trigger(wait, 0);
+   if (tree_kind(trigger) != T_REF || tree_ref(trigger) != decl)
+      return NULL;
+
+   tree_t fdecl = tree_ref(value);
+   ident_t tname = type_ident(type_base_recur(tree_type(decl)));
+   ident_t builtin = tree_attr_str(fdecl, builtin_i);
+
+   const uint8_t *map = NULL;
+   if (builtin != NULL && icmp(builtin, "not")
+       && (icmp(tname, "STD.STANDARD.BIT")
+           || icmp(tname, "STD.STANDARD.BOOLEAN")))
+      map = bit_not;
+   else if (icmp(tname, "IEEE.STD_LOGIC_1164.STD_ULOGIC")
+            && icmp(tree_ident(fdecl), "IEEE.STD_LOGIC_1164.\"not\""))
+      map = std_ulogic_not;
+   else
+      return NULL;
+
+   *period = delay;
+   return map;
+}
+
+static void rt_start_clock(rt_proc_t *proc)
+{
+   // The clock process only needs its driver from the reset code. Drop
+   // the transaction and wakeup it scheduled and let the kernel drive
+   // every edge from now on
+
+   tree_t decl = tree_ref(tree_target(tree_stmt(proc->source, 0)));
+   const groupid_t gid = netdb_lookup(netdb, tree_net(decl, 0));
+   netgroup_t *g = &(groups[gid]);
+
+   if (g->n_drivers != 1 || g->length != 1 || g->size != 1
+       || rt_proc_find_slot(proc, gid) != 0) {
+      proc->clock_map = NULL;
+      return;
+   }
+
+   TRACE("native clock %s period %s", fmt_group(g),
+         fmt_time(proc->clock_period));
+
+   proc->clock_group = g;
+   ++(proc->wakeup_gen);
+
+   // The driver event already in the queue is a no-op once the
+   // projected waveform only holds the current value
+   g->drivers[0].count = 1;
+
+   sens_list_t **prev = &(g->pending);
+   for (sens_list_t *it = g->pending, *next; it != NULL; it = next) {
+      next = it->next;
+      if (it->proc == proc) {
+         *prev = next;
+         rt_sens_release(it);
+      }
+      else
+         prev = &(it->next);
+   }
+
+   event_t *e = rt_alloc(event_stack);
+   e->when       = now + proc->clock_period;
+   e->kind       = E_CLOCK;
+   e->proc       = proc;
+   e->group      = g;
+   e->driver     = 0;
+   e->wakeup_gen = UINT32_MAX;
+
+   deltaq_insert(e);
+}
+
+static void rt_write_perf_map(void)
+{
+   // Name each process entry point after its instance path and source
+   // line so perf can attribute samples in generated code
+
+   jit_perf_sym_t *syms = xmalloc(sizeof(jit_perf_sym_t) * n_procs);
+   for (size_t i = 0; i < n_procs; i++) {
+      syms[i].addr = (void *)(uintptr_t)procs[i].proc_fn;
+      syms[i].name = istr(tree_ident(procs[i].source));
+      syms[i].loc  = *tree_loc(procs[i].source);
+   }
+
+   jit_write_perf_map(syms, n_procs);
+   free(syms);
+}
+
+static void rt_setup(tree_t top)
+{
+   now = 0;
+   iteration = -1;
+   active_proc = NULL;
+   force_stop = false;
+   can_create_delta = true;
+
+   RT_ASSERT(resume == NULL);
+
+   rt_async_flush();
+
+   rt_free_delta_events(delta_proc);
+   rt_free_delta_events(delta_driver);
+
+   eventq_reset();
+
+   if (netdb == NULL) {
+      netdb = netdb_open(top);
+
+      n_groups    = netdb_size(netdb);
+      groups      = xmalloc(sizeof(struct netgroup) * n_groups);
+      groups_cold = xmalloc(sizeof(struct netgroup_cold) * n_groups);
+
+      if (profiling)
+         group_prof = xmalloc(sizeof(group_prof_t) * n_groups);
+   }
+
+   if (group_prof != NULL)
+      memset(group_prof, '\0', sizeof(group_prof_t) * n_groups);
+
+   if (procs == NULL) {
+      n_procs = tree_stmts(top);
+      procs   = xcalloc(sizeof(struct rt_proc) * n_procs);
+   }
+
+   top_tree = top;
+
+   if (signal_arena == NULL)
+      signal_arena = arena_new(arena_flags, arena_node);
+   else
+      arena_reset(signal_arena);
+
+   res_memo_hash = hash_new(128, true);
+
+   netdb_walk(netdb, rt_reset_group);
+
+   // The code generator exports a table with the entry point of each
+   // process in statement order so they can be bound with one lookup
+   char *table_name LOCAL = xasprintf("%s_processes", istr(tree_ident(top)));
+   proc_fn_t *table = jit_find_symbol(table_name, false);
+
+   const int nstmts = tree_stmts(top);
+   for (int i = 0; i < nstmts; i++) {
+      tree_t p = tree_stmt(top, i);
+      RT_ASSERT(tree_kind(p) == T_PROCESS);
+
+      procs[i].source     = p;
+      procs[i].proc_fn    = table ? table[i]
+         : jit_find_symbol(istr(tree_ident(p)), true);
+      procs[i].wakeup_gen = 0;
+      procs[i].postponed  = !!(tree_flags(p) & TREE_F_POSTPONED);
+      procs[i].tmp_stack  = NULL;
+      procs[i].tmp_alloc  = 0;
+      procs[i].tmp_peak   = 0;
+      procs[i].tmp_commit = 0;
+      procs[i].pending    = false;
+      procs[i].parallel   = (n_threads > 1) && rt_parallel_safe(p);
+      procs[i].clock_map  = rt_clock_pattern(p, &(procs[i].clock_period));
+      procs[i].clock_group = NULL;
+      procs[i].usage      = 0;
+      procs[i].wakeups    = 0;
+      procs[i].runs       = 0;
+      procs[i].tier_requested = false;
+      procs[i].tier_fn    = NULL;
+
+      free(procs[i].slots);
+      procs[i].slots     = NULL;
+      procs[i].n_slots   = 0;
+      procs[i].slot_mask = 0;
+
+      rt_proc_free_sens(&(procs[i]));
+   }
+
+   n_grown_drivers = 0;
+   trim_cycles     = 0;
+   tier_wanted     = 0;
+   n_tier_pending  = 0;
+
+   if (perf_map)
+      rt_write_perf_map();
+}
+
+static void rt_run(struct rt_proc *proc, bool reset)
+{
+   TRACE("%s process %s", reset ? "reset" : "run",
+         istr(tree_ident(proc->source)));
+
+   uint64_t start_clock = 0;
+   if (unlikely(profiling))
+      start_clock = rt_profile_clock();
+
+   if (reset)
+      rt_select_tmp_stack(global_tmp_stack, global_tmp_alloc, NULL);
+   else if (proc->tmp_stack != NULL) {
+      TRACE("using private stack at %p %d", proc->tmp_stack, proc->tmp_alloc);
+      rt_select_tmp_stack(proc->tmp_stack, proc->tmp_alloc, proc);
+
+      // Will be updated by _private_stack if suspending in procedure otherwise
+      // clear stack when process suspends
+      proc->tmp_alloc = 0;
+   }
+   else
+      rt_select_tmp_stack(proc_tmp_stack, 0, proc);
+
+   active_proc = proc;
+   RT_PROBE3(proc__run, proc - procs, (void *)proc->proc_fn, reset);
+   (*proc->proc_fn)(reset ? 1 : 0);
+
+   if (reset)
+      global_tmp_alloc = _tmp_alloc;
+
+   if (unlikely(profiling)) {
+      proc->usage += rt_profile_clock() - start_clock;
+      proc->wakeups++;
+   }
+
+   // The request to recompile is made at the start of the next cycle
+   // rather than while the JIT may be compiling a lazy stub
+   if (unlikely(tiered) && ++(proc->runs) == TIER_THRESHOLD)
+      __atomic_add_fetch(&tier_wanted, 1, __ATOMIC_RELAXED);
+}
+
+static void rt_tier_poll(void)
+{
+   // Ask for processes that have run often enough to be recompiled with
+   // full optimisation and switch over to the new code once it is ready
+
+   if (tier_wanted > 0) {
+      for (size_t i = 0; i < n_procs; i++) {
+         rt_proc_t *p = &(procs[i]);
+         if (p->runs >= TIER_THRESHOLD && !p->tier_requested) {
+            TRACE("tier up process %s", istr(tree_ident(p->source)));
+            p->tier_requested = true;
+            jit_tier_up(istr(tree_ident(p->source)), &(p->tier_fn));
+            ARRAY_APPEND(tier_pending, p, n_tier_pending, max_tier_pending);
+         }
+      }
+
+      tier_wanted = 0;
+   }
+
+   for (size_t i = 0; i < n_tier_pending; ) {
+      rt_proc_t *p = tier_pending[i];
+      void *fn = __atomic_load_n(&(p->tier_fn), __ATOMIC_ACQUIRE);
+      if (fn != NULL) {
+         p->proc_fn = (proc_fn_t)(uintptr_t)fn;
+         RT_STAT(stats.tiered_up++);
+         tier_pending[i] = tier_pending[--n_tier_pending];
+      }
+      else
+         i++;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parallel process execution
+
+#if RT_MULTITHREAD
+
+typedef struct {
+   pthread_t thread;
+   txn_log_t log;
+} rt_worker_t;
+
+static rt_worker_t     *workers = NULL;
+static pthread_mutex_t  pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned         pool_gen = 0;
+static unsigned         pool_busy = 0;
+static bool             pool_quit = false;
+static size_t           pool_next = 0;
+
+static void rt_batch_work(txn_log_t *log)
+{
+   // Processes are claimed from the batch one at a time so threads that
+   // finish early continue with the remaining work
+
+   txn_log = log;
+
+   for (;;) {
+      const size_t next = __atomic_fetch_add(&pool_next, 1, __ATOMIC_RELAXED);
+      if (next >= batch.count)
+         break;
+
+      batch_item_t *item = &(batch.items[next]);
+      if (!item->proc->parallel)
+         continue;
+
+      item->log   = log;
+      item->first = log->n_txns;
+      rt_run(item->proc, false /* reset */);
+      item->count = log->n_txns - item->first;
+   }
+
+   txn_log = NULL;
+}
+
+static void *rt_worker_thread(void *arg)
+{
+   rt_worker_t *w = arg;
+
+   proc_tmp_stack = mmap_guarded(PROC_TMP_STACK_SZ, "process temp stack");
+   proc_tmp_commit = 0;
+
+   unsigned gen = 0;
+   for (;;) {
+      pthread_mutex_lock(&pool_lock);
+      while (pool_gen == gen)
+         pthread_cond_wait(&pool_start, &pool_lock);
+      gen = pool_gen;
+      const bool quit = pool_quit;
+      pthread_mutex_unlock(&pool_lock);
+
+      if (quit)
+         break;
+
+      rt_batch_work(&(w->log));
+
+      pthread_mutex_lock(&pool_lock);
+      if (--pool_busy == 0)
+         pthread_cond_signal(&pool_done);
+      pthread_mutex_unlock(&pool_lock);
+   }
+
+   return NULL;
+}
+
+static void rt_start_workers(void)
+{
+   // The main thread is worker zero and also executes processes
+   workers = xcalloc(sizeof(rt_worker_t) * n_threads);
+
+   for (int i = 1; i < n_threads; i++) {
+      if (pthread_create(&(workers[i].thread), NULL,
+                         rt_worker_thread, &(workers[i])) != 0)
+         fatal_errno("pthread_create");
+   }
+}
+
+static void rt_stop_workers(void)
+{
+   if (workers == NULL)
+      return;
+
+   pthread_mutex_lock(&pool_lock);
+   pool_quit = true;
+   pool_gen++;
+   pthread_cond_broadcast(&pool_start);
+   pthread_mutex_unlock(&pool_lock);
+
+   for (int i = 0; i < n_threads; i++) {
+      if (i > 0)
+         pthread_join(workers[i].thread, NULL);
+      free(workers[i].log.txns);
+      free(workers[i].log.buf);
+   }
+
+   free(workers);
+   workers = NULL;
+}
+
+static void rt_batch_execute(void)
+{
+   if (batch.count < MIN_PARALLEL_BATCH)
+      return;   // Not worth waking up the other threads
+
+   pool_next = 0;
+
+   pthread_mutex_lock(&pool_lock);
+   pool_busy = n_threads - 1;
+   pool_gen++;
+   pthread_cond_broadcast(&pool_start);
+   pthread_mutex_unlock(&pool_lock);
+
+   rt_batch_work(&(workers[0].log));
+
+   pthread_mutex_lock(&pool_lock);
+   while (pool_busy > 0)
+      pthread_cond_wait(&pool_done, &pool_lock);
+   pthread_mutex_unlock(&pool_lock);
+}
+
+static void rt_batch_reset(void)
+{
+   for (int i = 0; i < n_threads; i++)
+      txn_log_reset(&(workers[i].log));
+
+   batch.count = 0;
+}
+
+#else  // RT_MULTITHREAD
+
+static void rt_batch_execute(void)
+{
+}
+
+static void rt_batch_reset(void)
+{
+   batch.count = 0;
+}
+
+#endif  // RT_MULTITHREAD
+
+////////////////////////////////////////////////////////////////////////////////
+// Asynchronous event callbacks
+
+#if RT_MULTITHREAD
+
+// Callbacks for waveform dumping are run on a background thread. The
+// simulation thread copies the raw value of the signal into a single
+// producer, single consumer ring buffer and the writer thread replays
+// the callback with rt_watch_value, rt_watch_string, and rt_now reading
+// from that snapshot. The ring has a fixed size and the simulation
+// blocks when it is full.
+
+typedef struct {
+   uint64_t  when;
+   watch_t  *watch;
+   uint32_t  nbytes;
+   uint32_t  skip;
+   uint32_t  changed_first;
+   uint32_t  changed_last;
+} async_rec_t;
+
+static uint8_t         *async_ring = NULL;
+static uint64_t         async_head = 0;
+static uint64_t         async_tail = 0;
+static unsigned         async_waiters = 0;
+static bool             async_quit = false;
+static pthread_t        async_thread;
+static pthread_mutex_t  async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   async_cond = PTHREAD_COND_INITIALIZER;
+
+static RT_TLS const async_rec_t *async_rec = NULL;
+
+static void rt_async_wait(uint64_t *pos, uint64_t value)
+{
+   // Sleep until another thread moves *pos away from value
+
+   pthread_mutex_lock(&async_lock);
+   __atomic_add_fetch(&async_waiters, 1, __ATOMIC_SEQ_CST);
+   while (__atomic_load_n(pos, __ATOMIC_SEQ_CST) == value && !async_quit)
+      pthread_cond_wait(&async_cond, &async_lock);
+   __atomic_sub_fetch(&async_waiters, 1, __ATOMIC_SEQ_CST);
+   pthread_mutex_unlock(&async_lock);
+}
+
+static void rt_async_notify(void)
+{
+   if (__atomic_load_n(&async_waiters, __ATOMIC_SEQ_CST) > 0) {
+      pthread_mutex_lock(&async_lock);
+      pthread_cond_broadcast(&async_cond);
+      pthread_mutex_unlock(&async_lock);
+   }
+}
+
+static void *rt_async_thread(void *arg)
+{
+   uint64_t head = async_head;
+   for (;;) {
+      const uint64_t tail = __atomic_load_n(&async_tail, __ATOMIC_SEQ_CST);
+      if (head == tail) {
+         if (__atomic_load_n(&async_quit, __ATOMIC_SEQ_CST))
+            break;
+
+         rt_async_wait(&async_tail, tail);
+         continue;
+      }
+
+      const size_t offset = head & (ASYNC_RING_SZ - 1);
+      if (ASYNC_RING_SZ - offset < sizeof(async_rec_t))
+         head += ASYNC_RING_SZ - offset;
+      else {
+         const async_rec_t *rec = (const async_rec_t *)(async_ring + offset);
+         if (rec->watch != NULL) {
+            async_rec = rec;
+            watch_t *w = rec->watch;
+            (*w->fn)(rec->when, w->signal, w, w->user_data);
+            async_rec = NULL;
+         }
+
+         head += rec->skip;
+      }
+
+      __atomic_store_n(&async_head, head, __ATOMIC_SEQ_CST);
+      rt_async_notify();
+   }
+
+   return NULL;
+}
+
+static void rt_async_flush(void)
+{
+   // Wait for the writer thread to process everything in the ring
+
+   if (async_ring == NULL)
+      return;
+
+   uint64_t head;
+   while ((head = __atomic_load_n(&async_head, __ATOMIC_SEQ_CST)) != async_tail)
+      rt_async_wait(&async_head, head);
+}
+
+static void rt_async_stop(void)
+{
+   if (async_ring == NULL || pthread_equal(pthread_self(), async_thread))
+      return;
+
+   rt_async_flush();
+
+   pthread_mutex_lock(&async_lock);
+   __atomic_store_n(&async_quit, true, __ATOMIC_SEQ_CST);
+   pthread_cond_broadcast(&async_cond);
+   pthread_mutex_unlock(&async_lock);
+
+   pthread_join(async_thread, NULL);
+
+   free(async_ring);
+   async_ring = NULL;
+   async_quit = false;
+}
+
+static void rt_async_start(void)
+{
+   async_ring = xmalloc(ASYNC_RING_SZ);
+   async_head = async_tail = 0;
+
+   if (pthread_create(&async_thread, NULL, rt_async_thread, NULL) != 0)
+      fatal_errno("pthread_create");
+
+   // Waveform writers close their files from atexit handlers which
+   // must not run until the ring is drained
+   static bool registered = false;
+   if (!registered) {
+      atexit(rt_async_stop);
+      registered = true;
+   }
+}
+
+static void rt_async_push(watch_t *w)
+{
+   size_t nbytes = 0;
+   for (int i = 0; i < w->n_groups; i++)
+      nbytes += w->groups[i]->size * w->groups[i]->length;
+
+   const size_t need = (sizeof(async_rec_t) + nbytes + 7) & ~7;
+   if (unlikely(need > ASYNC_RING_SZ / 4)) {
+      // Too large to buffer so run the callback here once the writer
+      // thread has caught up
+      rt_async_flush();
+      (*w->fn)(now, w->signal, w, w->user_data);
+      return;
+   }
+
+   uint64_t tail = async_tail;
+   size_t offset = tail & (ASYNC_RING_SZ - 1);
+   size_t pad = 0;
+   if (ASYNC_RING_SZ - offset < need)
+      pad = ASYNC_RING_SZ - offset;
+
+   uint64_t head;
+   while (tail + pad + need
+          - (head = __atomic_load_n(&async_head, __ATOMIC_SEQ_CST))
+          > ASYNC_RING_SZ) {
+      RT_STAT(stats.async_stalls++);
+      rt_async_wait(&async_head, head);
+   }
+
+   if (pad > 0) {
+      if (pad >= sizeof(async_rec_t)) {
+         async_rec_t *skip = (async_rec_t *)(async_ring + offset);
+         skip->watch = NULL;
+         skip->skip  = pad;
+      }
+
+      tail += pad;
+      offset = 0;
+   }
+
+   async_rec_t *rec = (async_rec_t *)(async_ring + offset);
+   rec->when   = now;
+   rec->watch  = w;
+   rec->nbytes = nbytes;
+   rec->skip   = need;
+
+   rec->changed_first = w->changed_first;
+   rec->changed_last  = w->changed_last;
+
+   uint8_t *p = (uint8_t *)(rec + 1);
+   for (int i = 0; i < w->n_groups; i++) {
+      const size_t bytes = w->groups[i]->size * w->groups[i]->length;
+      memcpy(p, w->groups[i]->resolved, bytes);
+      p += bytes;
+   }
+
+   RT_STAT(stats.async_records++);
+
+   __atomic_store_n(&async_tail, tail + need, __ATOMIC_SEQ_CST);
+   rt_async_notify();
+}
+
+static inline const uint8_t *rt_async_snapshot(void)
+{
+   return async_rec ? (const uint8_t *)(async_rec + 1) : NULL;
+}
+
+#else   // RT_MULTITHREAD
+
+static void rt_async_flush(void)
+{
+}
+
+static void rt_async_stop(void)
+{
+}
+
+static inline const uint8_t *rt_async_snapshot(void)
+{
+   return NULL;
+}
+
+#endif  // RT_MULTITHREAD
+
+static void rt_batch_add(rt_proc_t *proc)
+{
+   if (unlikely(batch.count == batch.alloc)) {
+      batch.alloc = MAX(batch.alloc * 2, 128);
+      batch.items = xrealloc(batch.items, batch.alloc * sizeof(batch_item_t));
+   }
+
+   batch_item_t *item = &(batch.items[(batch.count)++]);
+   item->proc  = proc;
+   item->log   = NULL;
+   item->first = 0;
+   item->count = 0;
+}
+
+static void rt_batch_commit(const batch_item_t *item)
+{
+   // Apply the effects of a process that ran in parallel or run it now
+   // if it could not be executed in parallel
+
+   if (item->log == NULL) {
+      rt_run(item->proc, false /* reset */);
+      return;
+   }
+
+   active_proc = item->proc;
+
+   const txn_log_t *log = item->log;
+   for (size_t i = 0; i < item->count; i++) {
+      const txn_t *t = &(log->txns[item->first + i]);
+      void *nids = log->buf + t->nids;
+
+      switch (t->kind) {
+      case TXN_WAVEFORM:
+         _sched_waveform(nids, log->buf + t->data, t->n, t->after, t->reject);
+         break;
+
+      case TXN_WAVEFORM_S:
+         {
+            uint64_t scalar;
+            memcpy(&scalar, log->buf + t->data, sizeof(uint64_t));
+            _sched_waveform_s(nids, scalar, t->after, t->reject);
+         }
+         break;
+
+      case TXN_PROCESS:
+         _sched_process(t->after);
+         break;
+
+      case TXN_EVENT:
+         _sched_event(nids, t->n, t->flags);
+         break;
+
+      case TXN_REPORT:
+         rt_report(log->buf + t->data, t->n, t->flags >> 1, t->flags & 1,
+                   t->where, false);
+         break;
+      }
+   }
+}
+
+static void rt_call_module_reset(ident_t name)
+{
+   char *buf LOCAL = xasprintf("%s_reset", istr(name));
+
+   rt_select_tmp_stack(global_tmp_stack, global_tmp_alloc, NULL);
+
+   void (*reset_fn)(void) = jit_find_symbol(buf, false);
+   if (reset_fn != NULL) {
+      TRACE("reset module %s", istr(name));
+      (*reset_fn)();
+   }
+
+   global_tmp_alloc = _tmp_alloc;
+}
+
+static bool rt_update_values(uint8_t *restrict current, uint8_t *restrict last,
+                             const uint8_t *restrict values, size_t n)
+{
+   // Compare the new values against the current values and if they
+   // differ copy the current values to the optional LAST_VALUE buffer
+   // while storing the new ones, in a single pass over the data. The
+   // bytes before the first difference are equal so only need to be
+   // copied to LAST_VALUE. Returns true if there was an event.
+
+   size_t i = 0;
+   for (; i + 8 <= n; i += 8) {
+      uint64_t a, b;
+      memcpy(&a, current + i, 8);
+      memcpy(&b, values + i, 8);
+      if (a != b)
+         break;
+   }
+
+   while (i < n && current[i] == values[i])
+      i++;
+
+   if (i == n)
+      return false;
+
+   if (last == NULL) {
+      memcpy(current + i, values + i, n - i);
+      return true;
+   }
+
+   memcpy(last, current, i);
+
+   for (; i + 8 <= n; i += 8) {
+      uint64_t a, b;
+      memcpy(&a, current + i, 8);
+      memcpy(&b, values + i, 8);
+      memcpy(last + i, &a, 8);
+      memcpy(current + i, &b, 8);
+   }
+
+   for (; i < n; i++) {
+      last[i]    = current[i];
+      current[i] = values[i];
+   }
+
+   return true;
+}
+
+static rec_span_t *rt_record_span(netgroup_t *group)
+{
+   // Find the extent of the record element containing this group once
+   // and share it between all its groups
+
+   const res_memo_t *memo = group->resolution;
+
+   const netgroup_t *head = group;
+   while (!(head->flags & (NET_F_BOUNDARY | NET_F_OWNS_MEM))
+          && head->first > 0) {
+      const netgroup_t *prev = &(groups[netdb_lookup(netdb, head->first - 1)]);
+      if (prev->resolution != memo)
+         break;
+      head = prev;
+   }
+
+   unsigned n_groups = 1;
+   const netgroup_t *tail = head;
+   while (tail->first + tail->length < netdb_size(netdb)) {
+      const netgroup_t *next =
+         &(groups[netdb_lookup(netdb, tail->first + tail->length)]);
+      if (next->resolution != memo
+          || (next->flags & (NET_F_BOUNDARY | NET_F_OWNS_MEM)))
+         break;
+      tail = next;
+      n_groups++;
+   }
+
+   rec_span_t *span =
+      xmalloc(sizeof(rec_span_t) + n_groups * sizeof(groupid_t));
+   span->n_groups  = n_groups;
+   span->n_drivers = group->n_drivers;
+   span->valid     = false;
+   span->size      = 0;
+
+   netid_t nid = head->first;
+   for (unsigned i = 0; i < n_groups; i++) {
+      const groupid_t gid = netdb_lookup(netdb, nid);
+      const netgroup_t *g = &(groups[gid]);
+      RT_ASSERT(g->n_drivers == group->n_drivers);
+
+      span->gids[i] = gid;
+      groups_cold[gid].span     = span;
+      groups_cold[gid].span_off = span->size;
+
+      span->size += g->size * g->length;
+      nid += g->length;
+   }
+
+   span->inputs = xmalloc(span->size * span->n_drivers);
+   return span;
+}
+
+static void rt_record_gather(rec_span_t *span)
+{
+   // Fill the buffer from the driver queues after the span is created
+   // or the driver values were replaced by a checkpoint
+   for (unsigned i = 0; i < span->n_groups; i++) {
+      const netgroup_t *g = &(groups[span->gids[i]]);
+      const uint32_t offset = groups_cold[span->gids[i]].span_off;
+      for (int j = 0; j < span->n_drivers; j++)
+         memcpy(span->inputs + (j * span->size) + offset,
+                rt_driver_value(g, &(g->drivers[j]), 0),
+                g->size * g->length);
+   }
+
+   span->valid = true;
+}
+
+static void rt_record_sync(const netgroup_t *group, int driver)
+{
+   const netgroup_cold_t *gc = rt_group_cold(group);
+   rec_span_t *span = gc->span;
+   if (span != NULL && span->valid)
+      memcpy(span->inputs + (driver * span->size) + gc->span_off,
+             rt_driver_value(group, &(group->drivers[driver]), 0),
+             group->size * group->length);
+}
+
+static void rt_record_span_free(rec_span_t *span)
+{
+   for (unsigned i = 0; i < span->n_groups; i++)
+      groups_cold[span->gids[i]].span = NULL;
+
+   free(span->inputs);
+   free(span);
+}
+
+static int32_t rt_resolve_group(netgroup_t *group, int driver, void *values)
+{
+   // Set driver to -1 for initial call to resolution function
+
+   const size_t valuesz = group->size * group->length;
+
+   void *resolved = NULL;
+   if (unlikely(group->flags & NET_F_FORCED)) {
+      resolved = rt_group_cold(group)->forcing->data;
+   }
+   else if (group->resolution == NULL) {
+      resolved = values;
+   }
+   else if ((group->resolution->flags & R_IDENT) && (group->n_drivers == 1)) {
+      // Resolution function behaves like identity for a single driver
+      resolved = values;
+   }
+   else if ((group->resolution->flags & R_MEMO) && (group->n_drivers == 1)) {
+      // Resolution function has been memoised so do a table lookup
+
+      resolved = alloca(valuesz);
+      memo_resolve1(group->resolution->tab1, values, resolved,
+                    group->length);
+   }
+   else if ((group->resolution->flags & R_MEMO)
+            && ((group->n_drivers == 2)
+                || ((group->resolution->flags & R_FOLD)
+                    && (group->n_drivers > 2)))) {
+      // Resolution function has been memoised so do a table lookup,
+      // reducing pairwise from the first driver if there are more
+      // than two
+
+      resolved = alloca(valuesz);
+
+      const int8_t *inputs[group->n_drivers];
+      for (int i = 0; i < group->n_drivers; i++) {
+         if (i == driver)
+            inputs[i] = values;
+         else
+            inputs[i] = rt_driver_value(group, &(group->drivers[i]), 0);
+      }
+
+      const res_memo_t *memo = group->resolution;
+      memo_resolve2(memo->tab2, memo->nlits, inputs[0], inputs[1],
+                    resolved, group->length);
+
+      for (int i = 2; i < group->n_drivers; i++)
+         memo_resolve2(memo->tab2, memo->nlits, resolved, inputs[i],
+                       resolved, group->length);
+   }
+   else if (group->resolution->flags & R_RECORD) {
+      // Call resolution function for resolved record
+      netgroup_cold_t *gc = rt_group_cold(group);
+      rec_span_t *span = gc->span ?: rt_record_span(group);
+
+      if (!span->valid)
+         rt_record_gather(span);
+
+      uint8_t *input = span->inputs + gc->span_off;
+      if (driver >= 0)
+         memcpy(input + (driver * span->size), values, valuesz);
+
+      uint8_t *result =
+         (uint8_t *)(*group->resolution->fn)(span->inputs, group->n_drivers);
+      resolved = result + gc->span_off;
+   }
+   else {
+      // Must actually call resolution function in general case
+
+      resolved = alloca(valuesz);
+
+      for (int j = 0; j < group->length; j++) {
+#define CALL_RESOLUTION_FN(type) do {                                   \
+            type vals[group->n_drivers];                                \
+            for (int i = 0; i < group->n_drivers; i++) {                \
+               const driver_t *d = &(group->drivers[i]);                \
+               vals[i] = ((const type *)rt_driver_value(group, d, 0))[j]; \
+            }                                                           \
+            if (likely(driver >= 0))                                    \
+               vals[driver] = ((const type *)values)[j];                \
+            type *r = (type *)resolved;                                 \
+            r[j] = (*group->resolution->fn)(vals, group->n_drivers);    \
+         } while (0)
+
+         FOR_ALL_SIZES(group->size, CALL_RESOLUTION_FN);
+      }
+   }
+
+   // LAST_VALUE is the same as the initial value when
+   // there have been no events on the signal otherwise
+   // only update it when there is an event
+   void *last = NULL;
+   if (group->flags & NET_F_LAST_VALUE)
+      last = rt_group_cold(group)->last_value;
+
+   int32_t new_flags = NET_F_ACTIVE;
+   if (rt_update_values(group->resolved, last, resolved, valuesz)) {
+      new_flags |= NET_F_EVENT;
+      group->last_event = now;
+   }
+
+   return new_flags;
+}
+
+static void rt_group_inital(groupid_t gid, netid_t first, unsigned length)
+{
+   netgroup_t *g = &(groups[gid]);
+   if ((g->n_drivers == 1) && (g->resolution == NULL))
+      rt_resolve_group(g, -1, rt_driver_value(g, &(g->drivers[0]), 0));
+   else if (g->n_drivers > 0)
+      rt_resolve_group(g, -1, g->resolved);
+}
+
+static void rt_initial(tree_t top)
+{
+   // Initialisation is described in LRM 93 section 12.6.4
+
+   const int ncontext = tree_contexts(top);
+   for (int i = 0; i < ncontext; i++) {
+      tree_t c = tree_context(top, i);
+      ident_t unit_name = tree_ident(c);
+      rt_call_module_reset(unit_name);
+   }
+
+   rt_call_module_reset(tree_ident(top));
+
+   for (size_t i = 0; i < n_procs; i++)
+      rt_run(&procs[i], true /* reset */);
+
+   TRACE("calculate initial driver values");
+
+   init_side_effect = SIDE_EFFECT_ALLOW;
+   netdb_walk(netdb, rt_group_inital);
+
+   for (size_t i = 0; i < n_procs; i++) {
+      if (procs[i].clock_map != NULL)
+         rt_start_clock(&procs[i]);
+   }
+
+   if (n_partitions > 0)
+      rt_partition_plan();
+
+   TRACE("used %d bytes of global temporary stack", global_tmp_alloc);
+}
+
+static void rt_watch_signal(watch_t *w)
+{
+   const int nnets = tree_nets(w->signal);
+   int offset = 0;
+   while (offset < nnets) {
+      netid_t nid = tree_net(w->signal, offset);
+      netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
+      netgroup_cold_t *gc = rt_group_cold(g);
+
+      watch_list_t *link = xmalloc(sizeof(watch_list_t));
+      link->next   = gc->watching;
+      link->watch  = w;
+      link->offset = offset;
+
+      gc->watching = link;
+      g->flags |= NET_F_WATCHED;
+
+      offset += g->length;
+      (w->n_groups)++;
+   }
+
+   w->groups = xmalloc(sizeof(netgroup_t *) * w->n_groups);
+
+   int ptr = 0;
+   offset = 0;
+   while (offset < nnets) {
+      netid_t nid = tree_net(w->signal, offset);
+      netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
+      w->groups[ptr++] = g;
+      w->length += g->length;
+      offset += g->length;
+   }
+
+   w->changed_first = 0;
+   w->changed_last  = w->length - 1;
+}
+
+static void rt_wakeup(sens_list_t *sl)
+{
+   // To avoid having each process keep a list of the signals it is
+   // sensitive to, each process has a "wakeup generation" number which
+   // is incremented after each wait statement and stored in the signal
+   // sensitivity list. We then ignore any sensitivity list elements
+   // where the generation doesn't match the current process wakeup
+   // generation: these correspond to stale "wait on" statements that
+   // have already resumed.
+
+   if (sl->wakeup_gen == sl->proc->wakeup_gen || sl->reenq != NULL) {
+      if (unlikely(stats_on)) {
+         if (sl->reenq != NULL)
+            stats.static_wakeups++;
+         else
+            stats.dynamic_wakeups++;
+      }
+
+      TRACE("wakeup process %s%s", istr(tree_ident(sl->proc->source)),
+            sl->proc->postponed ? " [postponed]" : "");
+      ++(sl->proc->wakeup_gen);
+
+      if (unlikely(sl->proc->postponed)) {
+         sl->next  = postponed;
+         postponed = sl;
+      }
+      else {
+         sl->next = resume;
+         resume = sl;
+      }
+
+      sl->proc->pending = true;
+   }
+   else
+      rt_sens_release(sl);
+}
+
+static void rt_wakeup_range(sens_list_t **list, netid_t first, netid_t last)
 {
-   // Set driver to -1 for initial call to resolution function
+   sens_list_t *it, *prev = NULL, *next = NULL;
+   for (it = *list; it != NULL; it = next) {
+      next = it->next;
+
+      const bool hit = (first <= it->last) && (it->first <= last);
+
+      if (hit) {
+         rt_wakeup(it);
+         if (prev == NULL)
+            *list = next;
+         else
+            prev->next = next;
+      }
+      else
+         prev = it;
+   }
+}
+
+static void rt_wakeup_global(netid_t first, netid_t last)
+{
+   for (int level = 0; level < RANGE_LEVELS; level++) {
+      range_level_t *rl = &(range_index[level]);
+      if (rl->buckets == NULL)
+         continue;
+
+      // Entries in the bucket before the one containing the first net
+      // may extend into it
+      const int shift = RANGE_MIN_BITS + level;
+      const netid_t low  = MAX(first >> shift, 1) - 1;
+      const netid_t high = MIN(last >> shift, rl->nbuckets - 1);
+
+      for (netid_t b = low; b <= high; b++) {
+         if (rl->buckets[b] != NULL)
+            rt_wakeup_range(&(rl->buckets[b]), first, last);
+      }
+   }
+}
+
+static int rt_driver_slot(const netgroup_t *group, const rt_proc_t *proc)
+{
+   if (likely(group->n_drivers == 1))
+      return 0;
+
+   const int driver = rt_proc_find_slot(proc, group - groups);
+   RT_ASSERT(driver >= 0 && driver < group->n_drivers);
+   RT_ASSERT(group->drivers[driver].proc == proc);
+   return driver;
+}
+
+static bool rt_sched_delta(netgroup_t *group, const void *values)
+{
+   // Fast path for a delta delayed assignment to a signal with a single
+   // driver where at most one transaction for this delta is already
+   // pending: no pulse rejection or queue compaction is needed
+
+   if (unlikely(group->n_drivers != 1))
+      return false;
+
+   driver_t *d = &(group->drivers[0]);
+
+   const size_t valuesz = group->size * group->length;
+   const uint32_t slot = (d->head + 1) & (d->capacity - 1);
+
+   if (likely(d->count == 1)) {
+      RT_ASSERT(d->capacity > 1);
+
+      d->when[slot] = now;
+      memcpy(d->values + slot * valuesz, values, valuesz);
+      d->count = 2;
+
+      RT_STAT(stats.txns_scheduled++);
+
+      deltaq_insert_driver(0, group, active_proc, 0);
+      return true;
+   }
+   else if (d->count == 2 && d->when[slot] == now) {
+      // Overwrite the transaction from an earlier assignment in the
+      // same cycle which already has an event in the delta queue
+      memcpy(d->values + slot * valuesz, values, valuesz);
+
+      RT_STAT(stats.txns_scheduled++; stats.txns_rejected++);
+      return true;
+   }
+   else
+      return false;
+}
+
+static bool rt_sched_driver(netgroup_t *group, int driver, uint64_t after,
+                            uint64_t reject, const void *values)
+{
+   if (unlikely(reject > after))
+      fatal("signal %s pulse reject limit %s is greater than "
+            "delay %s", fmt_group(group), fmt_time(reject), fmt_time(after));
+
+   driver_t *d = &(group->drivers[driver]);
+
+   const size_t valuesz = group->size * group->length;
+   const uint64_t when = now + after;
+   const uint32_t mask = d->capacity - 1;
+
+   // The first entry is the current driving value and the remainder are
+   // the projected transactions in time order. Compact the transactions
+   // that survive pulse rejection towards the front of the queue.
+   uint32_t keep = 1, i;
+   for (i = 1; i < d->count; i++) {
+      const uint32_t slot = (d->head + i) & mask;
+      if (d->when[slot] >= when)
+         break;
+
+      // If the current transaction is within the pulse rejection interval
+      // and the value is different to that of the new transaction then
+      // delete the current transaction
+      if ((d->when[slot] >= when - reject)
+          && (memcmp(d->values + slot * valuesz, values, valuesz) != 0))
+         continue;
+
+      if (keep != i) {
+         const uint32_t to = (d->head + keep) & mask;
+         d->when[to] = d->when[slot];
+         memcpy(d->values + to * valuesz, d->values + slot * valuesz, valuesz);
+      }
+
+      keep++;
+   }
+
+   // Delete all transactions later than this
+   // We could remove this transaction from the deltaq as well but the
+   // overhead of doing so is probably higher than the cost of waking
+   // up for the empty event
+   bool already_scheduled = false;
+   for (; i < d->count; i++) {
+      if (d->when[(d->head + i) & mask] == when)
+         already_scheduled = true;
+   }
+
+   RT_STAT(stats.txns_scheduled++; stats.txns_rejected += d->count - keep);
+
+   d->count = keep;
+
+   if (unlikely(d->count == d->capacity))
+      rt_driver_grow(group, d);
+
+   const uint32_t slot = (d->head + d->count) & (d->capacity - 1);
+   d->when[slot] = when;
+   memcpy(d->values + slot * valuesz, values, valuesz);
+   d->count++;
+
+   return already_scheduled;
+}
+
+static void rt_update_group(netgroup_t *group, int driver, void *values)
+{
+   const size_t valuesz = group->size * group->length;
+
+   TRACE("update group %s values=%s driver=%d",
+         fmt_group(group), fmt_values(values, valuesz), driver);
+   RT_PROBE3(driver__update, group->first, driver, group->length);
+
+   uint64_t start_clock = 0;
+   if (unlikely(profiling))
+      start_clock = rt_profile_clock();
+
+   const int32_t new_flags = rt_resolve_group(group, driver, values);
+   group->flags |= new_flags;
+
+   group_prof_t *prof = NULL;
+   if (unlikely(profiling)) {
+      prof = &(group_prof[group - groups]);
+      prof->resolve_ticks += rt_profile_clock() - start_clock;
+      prof->updates++;
+   }
+
+   if (unlikely(n_active_groups == n_active_alloc)) {
+      n_active_alloc *= 2;
+      const size_t newsz = n_active_alloc * sizeof(struct netgroup *);
+      active_groups = xrealloc(active_groups, newsz);
+   }
+   active_groups[n_active_groups++] = group;
+
+   RT_STAT(stats.max_active_groups =
+           MAX(stats.max_active_groups, n_active_groups));
+
+   // Wake up any processes sensitive to this group
+   if (new_flags & NET_F_EVENT) {
+      // First wakeup everything on the group specific pending list
+      // except waits qualified by a value the group did not change to.
+      // A filtered entry whose wait has since resumed by other means is
+      // stale and is passed to rt_wakeup to be released
+      const uint8_t *value = group->resolved;
+      sens_list_t **prev = &(group->pending);
+      for (sens_list_t *it = group->pending, *next; it != NULL; it = next) {
+         next = it->next;
+         if (unlikely(it->accept != 0) && !(it->accept & (1u << *value))
+             && (it->wakeup_gen == it->proc->wakeup_gen
+                 || it->reenq != NULL)) {
+            RT_STAT(stats.filtered_wakeups++);
+            prev = &(it->next);
+         }
+         else {
+            *prev = next;
+            rt_wakeup(it);
+         }
+      }
+
+      // Now check the global pending list
+      if (group->flags & NET_F_GLOBAL)
+         rt_wakeup_global(group->first, group->first + group->length - 1);
+
+      // Schedule any callbacks to run
+      watch_list_t *wl = NULL;
+      if (unlikely(group->flags & NET_F_WATCHED))
+         wl = rt_group_cold(group)->watching;
+
+      // Each watch accumulates the range of elements which changed
+      // so callbacks on wide signals can read only that part
+      const uint32_t length = group->length;
+      for (; wl != NULL; wl = wl->next) {
+         watch_t *w = wl->watch;
+         if (!w->pending) {
+            w->chain_pending = callbacks;
+            w->pending = true;
+            w->changed_first = wl->offset;
+            w->changed_last  = wl->offset + length - 1;
+            callbacks = w;
+         }
+         else {
+            w->changed_first = MIN(w->changed_first, wl->offset);
+            w->changed_last  = MAX(w->changed_last, wl->offset + length - 1);
+         }
+      }
+   }
+
+   if (unlikely(prof != NULL))
+      prof->update_ticks += rt_profile_clock() - start_clock;
+}
+
+static void rt_update_pending_groups(void)
+{
+   // Resolve each group with multiple drivers once using the new values
+   // of all drivers that became active since the last flush
+
+   pending_peak = MAX(pending_peak, n_pending_groups);
+
+   for (unsigned i = 0; i < n_pending_groups; i++) {
+      netgroup_t *g = pending_groups[i];
+      g->flags &= ~NET_F_PENDING;
+      rt_update_group(g, -1, rt_driver_value(g, &(g->drivers[0]), 0));
+   }
+   n_pending_groups = 0;
+}
+
+static void rt_update_driver(netgroup_t *group, int driver)
+{
+   if (likely(driver >= 0)) {
+      RT_ASSERT(driver < group->n_drivers);
+
+      driver_t *d = &(group->drivers[driver]);
+      const uint32_t next = (d->head + 1) & (d->capacity - 1);
+
+      if (likely((d->count > 1) && (d->when[next] == now))) {
+         if (likely(group->n_drivers == 1)) {
+            rt_update_group(group, driver, rt_driver_value(group, d, 1));
+            d->head = next;
+            d->count--;
+            return;
+         }
+
+         // Make the new value current and defer resolution until all
+         // the driver events for this cycle have been processed
+         d->head = next;
+         d->count--;
+
+         if (unlikely(group->resolution->flags & R_RECORD))
+            rt_record_sync(group, driver);
+
+         if (group->flags & NET_F_PENDING) {
+            RT_STAT(stats.txns_coalesced++);
+            return;
+         }
+
+         if (unlikely(n_pending_groups == n_pending_alloc)) {
+            n_pending_alloc = MAX(n_pending_alloc * 2, 128);
+            const size_t newsz = n_pending_alloc * sizeof(struct netgroup *);
+            pending_groups = xrealloc(pending_groups, newsz);
+         }
+         pending_groups[n_pending_groups++] = group;
+
+         group->flags |= NET_F_PENDING;
+      }
+   }
+   else if (group->flags & NET_F_FORCED)
+      rt_update_group(group, -1, rt_group_cold(group)->forcing->data);
+}
+
+static void rt_clock_tick(event_t *e)
+{
+   // Toggle the driver directly and reuse the event for the next edge
+
+   rt_proc_t *proc = e->proc;
+   netgroup_t *g = proc->clock_group;
+
+   uint8_t *value = rt_driver_value(g, &(g->drivers[0]), 0);
+   *value = proc->clock_map[*(const uint8_t *)g->resolved];
+
+   rt_update_group(g, 0, value);
+
+   e->when += proc->clock_period;
+   eventq_insert(e);
+}
+
+static bool rt_stale_event(event_t *e)
+{
+   return (e->kind == E_PROCESS) && (e->wakeup_gen != e->proc->wakeup_gen);
+}
+
+static event_t *rt_peek_event(void)
+{
+   // Discard stale process wakeups at the head of the queue so they
+   // cannot cause an empty cycle at a later time
+   while (eventq_size() > 0) {
+      event_t *peek = eventq_min();
+      if (likely(!rt_stale_event(peek)))
+         return peek;
+
+      rt_free(event_stack, eventq_extract_min());
+   }
+
+   return NULL;
+}
+
+static void rt_push_run_queue(event_t *e)
+{
+   if (unlikely(run_queue.wr == run_queue.alloc)) {
+      if (run_queue.alloc == 0) {
+         run_queue.alloc = 128;
+         run_queue.queue = xmalloc(sizeof(event_t *) * run_queue.alloc);
+      }
+      else {
+         run_queue.alloc *= 2;
+         run_queue.queue = realloc(run_queue.queue,
+                                   sizeof(event_t *) * run_queue.alloc);
+      }
+   }
+
+   if (unlikely(rt_stale_event(e)))
+      rt_free(event_stack, e);
+   else {
+      run_queue.queue[(run_queue.wr)++] = e;
+      if (e->kind == E_PROCESS)
+         ++(e->proc->wakeup_gen);
+
+      RT_STAT(stats.max_run_queue =
+              MAX(stats.max_run_queue, run_queue.wr - run_queue.rd));
+   }
+}
+
+static event_t *rt_pop_run_queue(void)
+{
+   if (run_queue.wr == run_queue.rd) {
+      run_queue_peak = MAX(run_queue_peak, run_queue.wr);
+      run_queue.wr = 0;
+      run_queue.rd = 0;
+      return NULL;
+   }
+   else
+      return run_queue.queue[(run_queue.rd)++];
+}
+
+static int rt_run_key_cmp(const void *a, const void *b)
+{
+   const run_key_t *ka = a, *kb = b;
+
+   if (ka->key != kb->key)
+      return ka->key < kb->key ? -1 : 1;
+   else if (ka->minor != kb->minor)
+      return ka->minor < kb->minor ? -1 : 1;
+   else
+      return ka->seq < kb->seq ? -1 : 1;
+}
+
+static void rt_sort_run_segment(size_t first, size_t last)
+{
+   // Driver updates are ordered by the address of the group and process
+   // wakeups by the position of the process so consecutive events touch
+   // nearby memory and code
+
+   const size_t count = last - first;
+   if (count < 2)
+      return;
+
+   if (count > run_queue.keys_alloc) {
+      run_queue.keys_alloc = MAX(count, run_queue.keys_alloc * 2);
+      run_queue.keys = xrealloc(run_queue.keys,
+                                run_queue.keys_alloc * sizeof(run_key_t));
+   }
+
+   for (size_t i = 0; i < count; i++) {
+      event_t *e = run_queue.queue[first + i];
+      run_key_t *k = &(run_queue.keys[i]);
+      if (e->kind == E_DRIVER) {
+         k->key   = (uintptr_t)e->group;
+         k->minor = e->driver;
+      }
+      else {
+         k->key   = e->proc - procs;
+         k->minor = 0;
+      }
+      k->seq   = i;
+      k->event = e;
+   }
+
+   qsort(run_queue.keys, count, sizeof(run_key_t), rt_run_key_cmp);
+
+   for (size_t i = 0; i < count; i++)
+      run_queue.queue[first + i] = run_queue.keys[i].event;
+
+   RT_STAT(stats.sorted_events += count);
+}
+
+static void rt_sort_run_queue(void)
+{
+   // Only runs of consecutive driver or process events are reordered so
+   // updates and wakeups still happen in the same order relative to
+   // each other and to timeouts and clock events
+
+   if (run_queue.wr - run_queue.rd < 2)
+      return;
+
+   size_t first = run_queue.rd;
+   for (size_t i = run_queue.rd; i <= run_queue.wr; i++) {
+      if (i == run_queue.wr
+          || run_queue.queue[i]->kind != run_queue.queue[first]->kind) {
+         const event_kind_t kind = run_queue.queue[first]->kind;
+         if (kind == E_DRIVER || kind == E_PROCESS)
+            rt_sort_run_segment(first, i);
+         first = i;
+      }
+   }
+}
+
+static void rt_stats_locality(const event_t *event)
+{
+   // Count changes of memory page between consecutive driver updates and
+   // of code page between consecutive process wakeups
+   static uintptr_t last_data = 0, last_code = 0;
+
+   if (event->kind == E_DRIVER) {
+      const uintptr_t page = (uintptr_t)event->group >> 12;
+      stats.page_switches += (page != last_data);
+      last_data = page;
+   }
+   else if (event->kind == E_PROCESS) {
+      const uintptr_t page = (uintptr_t)event->proc->proc_fn >> 12;
+      stats.page_switches += (page != last_code);
+      last_code = page;
+   }
+}
+
+static void rt_iteration_limit(void)
+{
+   text_buf_t *buf = tb_new();
+   tb_printf(buf, "Iteration limit of %d delta cycles reached. "
+             "The following processes are active:\n",
+             opt_get_int("stop-delta"));
+
+   for (sens_list_t *it = resume; it != NULL; it = it->next) {
+      tree_t p = it->proc->source;
+      const loc_t *l = tree_loc(p);
+      tb_printf(buf, "  %-30s %s line %d\n", istr(tree_ident(p)),
+                istr(l->file), l->first_line);
+   }
+
+   tb_printf(buf, "You can increase this limit with --stop-delta");
+
+   fatal("%s", tb_get(buf));
+}
+
+static void rt_resume_processes(sens_list_t **list, bool parallel)
+{
+   size_t next_item = 0;
+   if (parallel) {
+      // Collect each pending process once in list order then commit
+      // them below in the same position they would have run
+      for (sens_list_t *it = *list; it != NULL; it = it->next) {
+         if (it->proc->pending) {
+            rt_batch_add(it->proc);
+            it->proc->pending = false;
+         }
+      }
+
+      rt_batch_execute();
+   }
+
+   sens_list_t *it = *list;
+   while (it != NULL) {
+      sens_list_t *next = it->next;
+      rt_proc_t *proc = it->proc;
+
+      // Release a dynamic entry before the process runs so the wait
+      // statement it executes next can re-arm the same entry
+      sens_list_t **reenq = it->reenq;
+      if (reenq == NULL)
+         rt_sens_release(it);
+
+      if (next_item < batch.count
+          && batch.items[next_item].proc == proc)
+         rt_batch_commit(&(batch.items[next_item++]));
+      else if (proc->pending) {
+         rt_run(proc, false /* reset */);
+         proc->pending = false;
+      }
 
-   const size_t valuesz = group->size * group->length;
+      if (reenq != NULL) {
+         it->next = *reenq;
+         *reenq = it;
+      }
 
-   void *resolved = NULL;
-   if (unlikely(group->flags & NET_F_FORCED)) {
-      resolved = group->forcing->data;
+      it = next;
    }
-   else if (group->resolution == NULL) {
-      resolved = values;
+
+   *list = NULL;
+
+   if (parallel)
+      rt_batch_reset();
+}
+
+static void rt_unwatch_signal(watch_t *w)
+{
+   RT_ASSERT(!w->pending);
+
+   for (int i = 0; i < w->n_groups; i++) {
+      netgroup_t *g = w->groups[i];
+      netgroup_cold_t *gc = rt_group_cold(g);
+
+      for (watch_list_t **it = &(gc->watching); *it != NULL;) {
+         if ((*it)->watch == w) {
+            watch_list_t *tmp = *it;
+            *it = tmp->next;
+            free(tmp);
+         }
+         else
+            it = &((*it)->next);
+      }
+
+      if (gc->watching == NULL)
+         g->flags &= ~NET_F_WATCHED;
    }
-   else if ((group->resolution->flags & R_IDENT) && (group->n_drivers == 1)) {
-      // Resolution function behaves like identity for a single driver
-      resolved = values;
+}
+
+static void rt_wave_start(void)
+{
+   rt_async_flush();
+   vcd_restart();
+   lxt_restart();
+   fst_restart();
+   ntr_restart();
+
+   wave_state = WAVE_ACTIVE;
+}
+
+static void rt_wave_stop(void)
+{
+   rt_async_flush();
+
+   for (watch_t *it = watches; it != NULL; it = it->chain_all) {
+      if (it->wave)
+         rt_unwatch_signal(it);
    }
-   else if ((group->resolution->flags & R_MEMO) && (group->n_drivers == 1)) {
-      // Resolution function has been memoised so do a table lookup
 
-      resolved = alloca(valuesz);
+   wave_state = WAVE_DONE;
+}
 
-      for (int j = 0; j < group->length; j++) {
-         const int index = { ((const char *)values)[j] };
-         const int8_t r = group->resolution->tab1[index];
-         ((int8_t *)resolved)[j] = r;
+static void rt_event_callback(bool postponed)
+{
+   watch_t **last = &callbacks;
+   watch_t *next = NULL, *it;
+   for (it = callbacks; it != NULL; it = next) {
+      next = it->chain_pending;
+      if (it->postponed == postponed) {
+#if RT_MULTITHREAD
+         if (it->async && async_ring != NULL)
+            rt_async_push(it);
+         else
+#endif
+         {
+            RT_PROBE3(event__cb, now, it, postponed);
+            (*it->fn)(now, it->signal, it, it->user_data);
+         }
+         it->pending = false;
+
+         // Calls outside of an event callback see the whole signal
+         it->changed_first = 0;
+         it->changed_last  = it->length - 1;
+
+         *last = it->chain_pending;
+         it->chain_pending = NULL;
       }
+      else
+         last = &(it->chain_pending);
    }
-   else if ((group->resolution->flags & R_MEMO) && (group->n_drivers == 2)) {
-      // Resolution function has been memoised so do a table lookup
+}
 
-      resolved = alloca(valuesz);
+static inline bool rt_next_cycle_is_delta(void)
+{
+   return (delta_driver != NULL) || (delta_proc != NULL);
+}
+
+static void rt_stats_time_step(void)
+{
+   // Record the number of delta cycles after the first cycle of the
+   // time step that just finished in a power of two histogram
+   if (iteration >= 0) {
+      int bucket = 0;
+      for (unsigned n = iteration; n > 0; n >>= 1)
+         bucket++;
+
+      stats.delta_hist[bucket]++;
+      stats.time_steps++;
+   }
+}
 
-      const char *p0 = group->drivers[0].waveforms->values->data;
-      const char *p1 = group->drivers[1].waveforms->values->data;
+static size_t rt_trim_capacity(size_t alloc, size_t peak)
+{
+   // Shrink an array to twice its recent peak once it is more than
+   // eight times larger than that
+   if (alloc <= TRIM_MIN_ITEMS || peak * 8 > alloc)
+      return alloc;
+
+   size_t want = TRIM_MIN_ITEMS;
+   while (want < peak * 2)
+      want *= 2;
+   return want;
+}
 
-      for (int j = 0; j < group->length; j++) {
-         int driving[2] = { p0[j], p1[j] };
-         if (likely(driver >= 0))
-            driving[driver] = ((const char *)values)[j];
+static void rt_trim_memory(void)
+{
+   trim_count++;
+
+   trim_bytes += rt_alloc_stack_trim(event_stack);
+   trim_bytes += rt_alloc_stack_trim(sens_list_stack);
+   trim_bytes += rt_alloc_stack_trim(watch_stack);
+   trim_bytes += rt_alloc_stack_trim(callback_stack);
+
+   const unsigned active_alloc = rt_trim_capacity(n_active_alloc, active_peak);
+   if (active_alloc < n_active_alloc) {
+      trim_bytes += (n_active_alloc - active_alloc) * sizeof(netgroup_t *);
+      n_active_alloc = active_alloc;
+      active_groups = xrealloc(active_groups,
+                               n_active_alloc * sizeof(netgroup_t *));
+   }
+
+   const unsigned pending_alloc =
+      rt_trim_capacity(n_pending_alloc, pending_peak);
+   if (pending_alloc < n_pending_alloc) {
+      trim_bytes += (n_pending_alloc - pending_alloc) * sizeof(netgroup_t *);
+      n_pending_alloc = pending_alloc;
+      pending_groups = xrealloc(pending_groups,
+                                n_pending_alloc * sizeof(netgroup_t *));
+   }
 
-         const int8_t r = group->resolution->tab2[driving[0]][driving[1]];
-         ((int8_t *)resolved)[j] = r;
+   const size_t run_queue_alloc =
+      rt_trim_capacity(run_queue.alloc, run_queue_peak);
+   if (run_queue_alloc < run_queue.alloc) {
+      RT_ASSERT(run_queue.wr == 0);
+      trim_bytes += (run_queue.alloc - run_queue_alloc) * sizeof(event_t *);
+      run_queue.alloc = run_queue_alloc;
+      run_queue.queue = xrealloc(run_queue.queue,
+                                 run_queue.alloc * sizeof(event_t *));
+   }
+
+   // Driver queues that grew for a long waveform shrink back towards
+   // their initial size once most of the transactions have been applied
+   for (unsigned i = 0; i < n_grown_drivers; ) {
+      netgroup_t *g = &(groups[grown_drivers[i].gid]);
+      driver_t *d = &(g->drivers[grown_drivers[i].driver]);
+
+      const uint32_t init = rt_driver_init_capacity(g);
+      uint32_t want = init;
+      while (want < d->count * 2)
+         want *= 2;
+
+      if (want < d->capacity && d->count * 4 <= d->capacity) {
+         const size_t valuesz = g->size * g->length;
+         trim_bytes += (d->capacity - want) * (sizeof(uint64_t) + valuesz);
+         trim_drivers++;
+         rt_driver_resize(g, d, want);
       }
+
+      if (d->capacity == init)
+         grown_drivers[i] = grown_drivers[--n_grown_drivers];
+      else
+         i++;
    }
-   else if (group->resolution->flags & R_RECORD) {
-      // Call resolution function for resolved record
 
-      netid_t first = group->first, last = group->first + group->length - 1;
-
-      for (const netgroup_t *it = group;
-           it->resolution == group->resolution && it->first > 0
-              && !(it->flags & NET_F_BOUNDARY);
-           it = &(groups[netdb_lookup(netdb, it->first - 1)]),
-              first = it->first)
-         ;
-
-      for (const netgroup_t *it = group;
-           it->resolution == group->resolution
-              && it->first + it->length < netdb_size(netdb)
-              && (it == group
-                  || !(it->flags & (NET_F_BOUNDARY | NET_F_OWNS_MEM)));
-           it = &(groups[netdb_lookup(netdb, it->first + it->length)]),
-              last = it->first + it->length - 1)
-         ;
-
-      size_t size = 0, group_off = 0;
-      for (int offset = first; offset <= last;) {
-         netgroup_t *g = &(groups[netdb_lookup(netdb, offset)]);
-         size += g->size * g->length;
-         if (offset < group->first)
-            group_off = size;
-         assert(g->n_drivers == group->n_drivers);
+   trim_cycles    = 0;
+   active_peak    = 0;
+   pending_peak   = 0;
+   run_queue_peak = 0;
+}
 
-         offset += g->length;
+static void rt_cycle(int stop_delta)
+{
+   // Simulation cycle is described in LRM 93 section 12.6.4
+
+   const bool is_delta_cycle = (delta_driver != NULL) || (delta_proc != NULL);
+
+   if (unlikely(cover_sample != NULL))
+      *cover_sample = (++cover_cycles % COVER_SAMPLE_PERIOD) == 0;
+
+   if (is_delta_cycle) {
+      iteration = iteration + 1;
+      RT_STAT(stats.delta_cycles += (iteration > 0));
+   }
+   else {
+      event_t *peek = rt_peek_event();
+      if (peek == NULL)
+         return;
+      RT_STAT(rt_stats_time_step());
+      now = peek->when;
+      iteration = 0;
+
+      // Take the initial snapshot before any signal changes in the
+      // first time step inside the window
+      if (unlikely(wave_state == WAVE_PENDING && wave_start > 0)
+          && now >= wave_start)
+         rt_wave_start();
+   }
+
+   TRACE("begin cycle");
+   RT_PROBE2(cycle__begin, now, iteration);
+
+   if (unlikely(tiered) && (tier_wanted > 0 || n_tier_pending > 0))
+      rt_tier_poll();
+
+#if TRACE_DELTAQ > 0
+   if (trace_on)
+      deltaq_dump();
+#endif
+#if TRACE_PENDING > 0
+   if (trace_on)
+      rt_dump_pending();
+#endif
+
+   if (is_delta_cycle) {
+      for (event_t *e = delta_driver; e != NULL; e = e->delta_chain)
+         rt_push_run_queue(e);
+
+      for (event_t *e = delta_proc; e != NULL; e = e->delta_chain)
+         rt_push_run_queue(e);
+
+      delta_driver = NULL;
+      delta_proc = NULL;
+   }
+   else {
+      rt_global_event(RT_NEXT_TIME_STEP);
+
+      for (;;) {
+         rt_push_run_queue(eventq_extract_min());
+
+         if (eventq_size() == 0)
+            break;
+
+         event_t *peek = eventq_min();
+         if (peek->when > now)
+            break;
       }
+   }
 
-      uint8_t *inputs = alloca(size * group->n_drivers);
+   if (sort_run_queue)
+      rt_sort_run_queue();
 
-      size_t ptr = 0;
-      for (int offset = first; offset <= last;) {
-         netgroup_t *p = &(groups[netdb_lookup(netdb, offset)]);
+   event_t *event;
+   while ((event = rt_pop_run_queue())) {
+      RT_STAT(stats.events[event->kind]++; rt_stats_locality(event));
 
-         for (int i = 0; i < p->n_drivers; i++) {
-            void *src = NULL;
-            if (i == driver && p == group)
-               src = p->drivers[i].waveforms->next->values->data;
-            else
-               src = p->drivers[i].waveforms->values->data;
-            memcpy(inputs + ptr + (i * size),
-                   src,
-                   p->size * p->length);
-         }
-         ptr += p->size * p->length;
+      if (event->kind != E_DRIVER && n_pending_groups > 0)
+         rt_update_pending_groups();
 
-         offset += p->length;
+      switch (event->kind) {
+      case E_PROCESS:
+         if (n_threads > 1)
+            rt_batch_add(event->proc);
+         else
+            rt_run(event->proc, false /* reset */);
+         break;
+      case E_DRIVER:
+         RT_ASSERT(batch.count == 0);
+         rt_update_driver(event->group, event->driver);
+         break;
+      case E_TIMEOUT:
+         RT_ASSERT(batch.count == 0);
+         (*event->timeout_fn)(now, event->timeout_user);
+         break;
+      case E_CLOCK:
+         rt_clock_tick(event);
+         continue;
       }
 
-      uint8_t *result =
-         (uint8_t *)(*group->resolution->fn)(inputs, group->n_drivers);
-      resolved = result + group_off;
+      rt_free(event_stack, event);
    }
-   else {
-      // Must actually call resolution function in general case
 
-      resolved = alloca(valuesz);
+   rt_update_pending_groups();
 
-      for (int j = 0; j < group->length; j++) {
-#define CALL_RESOLUTION_FN(type) do {                                   \
-            type vals[group->n_drivers];                                \
-            for (int i = 0; i < group->n_drivers; i++) {                \
-               const value_t *v = group->drivers[i].waveforms->values;  \
-               vals[i] = ((const type *)v->data)[j];                    \
-            }                                                           \
-            if (likely(driver >= 0))                                    \
-               vals[driver] = ((const type *)values)[j];                \
-            type *r = (type *)resolved;                                 \
-            r[j] = (*group->resolution->fn)(vals, group->n_drivers);    \
-         } while (0)
+   if (batch.count > 0) {
+      rt_batch_execute();
+      for (size_t i = 0; i < batch.count; i++)
+         rt_batch_commit(&(batch.items[i]));
+      rt_batch_reset();
+   }
 
-         FOR_ALL_SIZES(group->size, CALL_RESOLUTION_FN);
+   if (unlikely(now == 0 && iteration == 0 && wave_start == 0))
+      rt_wave_start();
+   else if (unlikely((stop_delta > 0) && (iteration == stop_delta)))
+      rt_iteration_limit();
+
+   // Run all non-postponed event callbacks
+   rt_event_callback(false);
+
+   // Run all processes that resumed because of signal events
+   rt_resume_processes(&resume, n_threads > 1);
+   rt_global_event(RT_END_OF_PROCESSES);
+
+   for (unsigned i = 0; i < n_active_groups; i++) {
+      netgroup_t *g = active_groups[i];
+      g->flags &= ~(NET_F_ACTIVE | NET_F_EVENT);
+   }
+   active_peak = MAX(active_peak, n_active_groups);
+   n_active_groups = 0;
+
+   if (!rt_next_cycle_is_delta()) {
+      can_create_delta = false;
+      rt_global_event(RT_LAST_KNOWN_DELTA_CYCLE);
+
+      // Run any postponed processes
+      rt_resume_processes(&postponed, false);
+
+      // Execute all postponed event callbacks
+      rt_event_callback(true);
+
+      can_create_delta = true;
+   }
+
+   if (unlikely(++trim_cycles == TRIM_PERIOD))
+      rt_trim_memory();
+
+   RT_PROBE2(cycle__end, now, iteration);
+}
+
+static tree_t rt_recall_decl(const char *name)
+{
+   if (decl_hash == NULL) {
+      // Only needed for signals declared in packages so built on
+      // first use
+      const int ndecls = tree_decls(top_tree);
+      decl_hash = shash_new(16);
+      shash_reserve(decl_hash, ndecls);
+      for (int i = 0; i < ndecls; i++) {
+         tree_t d = tree_decl(top_tree, i);
+         shash_put(decl_hash, istr(tree_ident(d)), d);
       }
    }
 
-   int32_t new_flags = NET_F_ACTIVE;
-   if (memcmp(group->resolved, resolved, valuesz) != 0)
-      new_flags |= NET_F_EVENT;
+   tree_t decl = shash_get(decl_hash, name);
+   if (decl != NULL)
+      return decl;
+   else
+      fatal("cannot find name %s in elaborated design", name);
+}
 
-   // LAST_VALUE is the same as the initial value when
-   // there have been no events on the signal otherwise
-   // only update it when there is an event
-   if (new_flags & NET_F_EVENT) {
-      if (group->flags & NET_F_LAST_VALUE)
-         memcpy(group->last_value, group->resolved, valuesz);
-      memcpy(group->resolved, resolved, valuesz);
+static void rt_cleanup_group(groupid_t gid, netid_t first, unsigned length)
+{
+   netgroup_t *g = &(groups[gid]);
+   netgroup_cold_t *gc = &(groups_cold[gid]);
 
-      group->last_event = now;
+   RT_ASSERT(g->first == first);
+   RT_ASSERT(g->length == length);
+
+   for (int j = 0; j < g->n_drivers; j++)
+      free(g->drivers[j].when);
+   free(g->drivers);
+
+   while (g->pending != NULL) {
+      sens_list_t *next = g->pending->next;
+      rt_sens_release(g->pending);
+      g->pending = next;
+   }
+
+   while (gc->watching != NULL) {
+      watch_list_t *next = gc->watching->next;
+      free(gc->watching);
+      gc->watching = next;
+   }
+
+   if (gc->span != NULL)
+      rt_record_span_free(gc->span);
+}
+
+static void rt_cleanup(tree_t top)
+{
+   RT_ASSERT(resume == NULL);
+
+   while (eventq_size() > 0)
+      rt_free(event_stack, eventq_extract_min());
+
+   rt_free_delta_events(delta_proc);
+   rt_free_delta_events(delta_driver);
+
+   if (eventq_heap != NULL)
+      heap_free(eventq_heap);
+   if (eventq_wheel != NULL)
+      wheel_free(eventq_wheel);
+
+   eventq_heap  = NULL;
+   eventq_wheel = NULL;
+
+   netdb_walk(netdb, rt_cleanup_group);
+   netdb_close(netdb);
+
+   arena_free(signal_arena);
+   signal_arena = NULL;
+
+   access_release_all();
+
+   if (decl_hash != NULL)
+      shash_free(decl_hash);
+   decl_hash = NULL;
+   top_tree  = NULL;
+
+   while (watches != NULL) {
+      watch_t *next = watches->chain_all;
+      rt_free(watch_stack, watches);
+      free(watches->groups);
+      watches = next;
+   }
+
+   rt_free_range_index(true);
+
+   for (int i = 0; i < RT_LAST_EVENT; i++) {
+      while (global_cbs[i] != NULL) {
+         callback_t *tmp = global_cbs[i]->next;
+         rt_free(callback_stack, global_cbs[i]);
+         global_cbs[i] = tmp;
+      }
    }
 
-   return new_flags;
-}
+   rt_alloc_stack_destroy(event_stack);
+   rt_alloc_stack_destroy(sens_list_stack);
+   rt_alloc_stack_destroy(watch_stack);
+   rt_alloc_stack_destroy(callback_stack);
+
+   hash_free(res_memo_hash);
 
-static void rt_group_inital(groupid_t gid, netid_t first, unsigned length)
-{
-   netgroup_t *g = &(groups[gid]);
-   if ((g->n_drivers == 1) && (g->resolution == NULL))
-      rt_resolve_group(g, -1, g->drivers[0].waveforms->values->data);
-   else if (g->n_drivers > 0)
-      rt_resolve_group(g, -1, g->resolved);
+   free(batch.items);
+   batch.items = NULL;
+   batch.alloc = 0;
 }
 
-static void rt_initial(tree_t top)
+static bool rt_stop_now(uint64_t stop_time)
 {
-   // Initialisation is described in LRM 93 section 12.6.4
+   if ((delta_driver != NULL) || (delta_proc != NULL))
+      return false;
+   else if (force_stop)
+      return true;
 
-   const int ncontext = tree_contexts(top);
-   for (int i = 0; i < ncontext; i++) {
-      tree_t c = tree_context(top, i);
-      ident_t unit_name = tree_ident(c);
-      rt_call_module_reset(unit_name);
-   }
+   event_t *peek = rt_peek_event();
+   if (peek == NULL)
+      return true;
+   else if (stop_time == UINT64_MAX)
+      return false;
+   else
+      return peek->when > stop_time;
+}
 
-   rt_call_module_reset(tree_ident(top));
+////////////////////////////////////////////////////////////////////////////////
+// Partition planning
 
-   for (size_t i = 0; i < n_procs; i++)
-      rt_run(&procs[i], true /* reset */);
+#define MAX_PARTITIONS 64
 
-   TRACE("calculate initial driver values");
+typedef struct {
+   ident_t  name;
+   unsigned nprocs;
+   int      part;
+} part_unit_t;
 
-   init_side_effect = SIDE_EFFECT_ALLOW;
-   netdb_walk(netdb, rt_group_inital);
+typedef struct {
+   uint64_t *masks;
+   int      *proc_part;
+   int64_t   lookahead;
+} part_plan_t;
 
-   TRACE("used %d bytes of global temporary stack", global_tmp_alloc);
+static ident_t rt_partition_unit(tree_t proc)
+{
+   // Processes are grouped by the instance directly below the top
+   // level, or the top level itself for its own processes
+   const char *name = istr(tree_ident(proc));
+   const char *p = strchr(name + 1, ':');
+   if (p == NULL || strchr(p + 1, ':') == NULL)
+      return ident_runtil(tree_ident(proc), ':');
+
+   const char *end = strchr(p + 1, ':');
+   char *tmp LOCAL = xstrdup(name);
+   tmp[end - name] = '\0';
+   return ident_new(tmp);
 }
 
-static void rt_watch_signal(watch_t *w)
+static int rt_part_unit_cmp(const void *a, const void *b)
 {
-   const int nnets = tree_nets(w->signal);
-   int offset = 0;
-   while (offset < nnets) {
-      netid_t nid = tree_net(w->signal, offset);
-      netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
-
-      watch_list_t *link = xmalloc(sizeof(watch_list_t));
-      link->next  = g->watching;
-      link->watch = w;
-
-      g->watching = link;
-
-      offset += g->length;
-      (w->n_groups)++;
-   }
+   const part_unit_t *ua = a, *ub = b;
+   if (ua->nprocs != ub->nprocs)
+      return ua->nprocs > ub->nprocs ? -1 : 1;
+   else
+      return strcmp(istr(ua->name), istr(ub->name));
+}
 
-   w->groups = xmalloc(sizeof(netgroup_t *) * w->n_groups);
+static void rt_partition_mark(part_plan_t *plan, netid_t nid, int part)
+{
+   plan->masks[netdb_lookup(netdb, nid)] |= UINT64_C(1) << part;
+}
 
-   int ptr = 0;
-   offset = 0;
-   while (offset < nnets) {
-      netid_t nid = tree_net(w->signal, offset);
-      netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
-      w->groups[ptr++] = g;
-      w->length += g->length;
-      offset += g->length;
+static tree_t rt_partition_target(tree_t target)
+{
+   for (;;) {
+      switch (tree_kind(target)) {
+      case T_ARRAY_REF:
+      case T_ARRAY_SLICE:
+      case T_RECORD_REF:
+         target = tree_value(target);
+         break;
+      case T_REF:
+         return tree_ref(target);
+      default:
+         return NULL;
+      }
    }
 }
 
-static void rt_wakeup(sens_list_t *sl)
+static void rt_partition_assign(tree_t t, void *context)
 {
-   // To avoid having each process keep a list of the signals it is
-   // sensitive to, each process has a "wakeup generation" number which
-   // is incremented after each wait statement and stored in the signal
-   // sensitivity list. We then ignore any sensitivity list elements
-   // where the generation doesn't match the current process wakeup
-   // generation: these correspond to stale "wait on" statements that
-   // have already resumed.
+   // The lookahead of a partition is the smallest delay on any
+   // assignment to a signal shared with another partition
 
-   if (sl->wakeup_gen == sl->proc->wakeup_gen || sl->reenq != NULL) {
-      TRACE("wakeup process %s%s", istr(tree_ident(sl->proc->source)),
-            sl->proc->postponed ? " [postponed]" : "");
-      ++(sl->proc->wakeup_gen);
+   part_plan_t *plan = context;
 
-      if (unlikely(sl->proc->postponed)) {
-         sl->next  = postponed;
-         postponed = sl;
-      }
-      else {
-         sl->next = resume;
-         resume = sl;
-      }
+   tree_t decl = rt_partition_target(tree_target(t));
+   if (decl == NULL || tree_kind(decl) != T_SIGNAL_DECL
+       || tree_nets(decl) == 0)
+      return;
 
-      sl->proc->pending = true;
+   const uint64_t mask =
+      plan->masks[netdb_lookup(netdb, tree_net(decl, 0))];
+   if ((mask & (mask - 1)) == 0)
+      return;
+
+   const int nwaveforms = tree_waveforms(t);
+   for (int i = 0; i < nwaveforms; i++) {
+      tree_t w = tree_waveform(t, i);
+      int64_t delay = 0;
+      if (tree_has_delay(w) && !folded_int(tree_delay(w), &delay))
+         delay = 0;
+
+      plan->lookahead = MIN(plan->lookahead, delay);
    }
-   else
-      rt_free(sens_list_stack, sl);
 }
 
-static bool rt_sched_driver(netgroup_t *group, uint64_t after,
-                            uint64_t reject, value_t *values)
+static void rt_partition_plan(void)
 {
-   if (unlikely(reject > after))
-      fatal("signal %s pulse reject limit %s is greater than "
-            "delay %s", fmt_group(group), fmt_time(reject), fmt_time(after));
+   // Split the design into partitions along the instances below the top
+   // level and report the signals that would have to be exchanged
+   // between them and the time each partition could safely run ahead
+
+   const int nparts = MIN(n_partitions, MAX_PARTITIONS);
+
+   hash_t *unit_map = hash_new(64, true);
+   part_unit_t *units = xmalloc(n_procs * sizeof(part_unit_t));
+   unsigned n_units = 0;
+
+   int *proc_unit = xmalloc(n_procs * sizeof(int));
+   for (size_t i = 0; i < n_procs; i++) {
+      ident_t name = rt_partition_unit(procs[i].source);
+      const intptr_t index = (intptr_t)hash_get(unit_map, name);
+      if (index == 0) {
+         units[n_units].name   = name;
+         units[n_units].nprocs = 0;
+         units[n_units].part   = -1;
+         hash_put(unit_map, name, (void *)(intptr_t)++n_units);
+      }
+      proc_unit[i] = (index ?: n_units) - 1;
+      units[proc_unit[i]].nprocs++;
+   }
 
-   int driver = 0;
-   if (unlikely(group->n_drivers != 1)) {
-      // Try to find this process in the list of existing drivers
-      for (driver = 0; driver < group->n_drivers; driver++) {
-         if (likely(group->drivers[driver].proc == active_proc))
-            break;
+   // Place the largest remaining instance in the partition with the
+   // fewest processes so far
+   part_unit_t *sorted = xmalloc(n_units * sizeof(part_unit_t));
+   memcpy(sorted, units, n_units * sizeof(part_unit_t));
+   qsort(sorted, n_units, sizeof(part_unit_t), rt_part_unit_cmp);
+
+   unsigned load[MAX_PARTITIONS] = { 0 }, nunits[MAX_PARTITIONS] = { 0 };
+   for (unsigned i = 0; i < n_units; i++) {
+      int best = 0;
+      for (int j = 1; j < nparts; j++) {
+         if (load[j] < load[best])
+            best = j;
       }
 
-      RT_ASSERT(driver != group->n_drivers);
-   }
+      load[best] += sorted[i].nprocs;
+      nunits[best]++;
 
-   driver_t *d = &(group->drivers[driver]);
+      const intptr_t index = (intptr_t)hash_get(unit_map, sorted[i].name);
+      units[index - 1].part = best;
+   }
 
-   const size_t valuesz = group->size * group->length;
+   part_plan_t plan = {
+      .masks     = xcalloc(n_groups * sizeof(uint64_t)),
+      .proc_part = xmalloc(n_procs * sizeof(int)),
+      .lookahead = INT64_MAX
+   };
 
-   waveform_t *w = rt_alloc(waveform_stack);
-   w->when   = now + after;
-   w->next   = NULL;
-   w->values = values;
+   for (size_t i = 0; i < n_procs; i++)
+      plan.proc_part[i] = units[proc_unit[i]].part;
+
+   // A group belongs to every partition with a process that drives it
+   // or is waiting on it after initialisation
+   for (groupid_t gid = 0; gid < n_groups; gid++) {
+      const netgroup_t *g = &(groups[gid]);
+      for (int i = 0; i < g->n_drivers; i++)
+         plan.masks[gid] |= UINT64_C(1) << plan.proc_part[g->drivers[i].proc
+                                                          - procs];
+      for (sens_list_t *it = g->pending; it != NULL; it = it->next)
+         plan.masks[gid] |= UINT64_C(1) << plan.proc_part[it->proc - procs];
+   }
 
-   waveform_t *last = d->waveforms;
-   waveform_t *it   = last->next;
-   while ((it != NULL) && (it->when < w->when)) {
-      // If the current transaction is within the pulse rejection interval
-      // and the value is different to that of the new transaction then
-      // delete the current transaction
-      if ((it->when >= w->when - reject)
-          && (memcmp(it->values->data, w->values->data, valuesz) != 0)) {
-         waveform_t *next = it->next;
-         last->next = next;
-         rt_free_value(group, it->values);
-         rt_free(waveform_stack, it);
-         it = next;
+   for (int level = 0; level < RANGE_LEVELS; level++) {
+      const range_level_t *rl = &(range_index[level]);
+      for (netid_t b = 0; rl->buckets && b < rl->nbuckets; b++) {
+         for (sens_list_t *it = rl->buckets[b]; it != NULL; it = it->next)
+            rt_partition_mark(&plan, it->first,
+                              plan.proc_part[it->proc - procs]);
       }
-      else {
-         last = it;
-         it = it->next;
+   }
+
+   unsigned n_shared = 0;
+   uint64_t shared_nets = 0, shared_bytes = 0;
+   for (groupid_t gid = 0; gid < n_groups; gid++) {
+      const uint64_t mask = plan.masks[gid];
+      if (mask & (mask - 1)) {
+         n_shared++;
+         shared_nets  += groups[gid].length;
+         shared_bytes += groups[gid].length * groups[gid].size;
       }
    }
-   w->next = NULL;
-   last->next = w;
 
-   // Delete all transactions later than this
-   // We could remove this transaction from the deltaq as well but the
-   // overhead of doing so is probably higher than the cost of waking
-   // up for the empty event
-   bool already_scheduled = false;
-   while (it != NULL) {
-      rt_free_value(group, it->values);
+   for (size_t i = 0; i < n_procs; i++)
+      tree_visit_only(procs[i].source, rt_partition_assign, &plan,
+                      T_SIGNAL_ASSIGN);
 
-      if (it->when == w->when)
-         already_scheduled = true;
+   notef("partition plan: %d partitions, %u instances, %u shared groups "
+         "with %"PRIu64" nets and %"PRIu64" bytes", nparts, n_units,
+         n_shared, shared_nets, shared_bytes);
 
-      waveform_t *next = it->next;
-      rt_free(waveform_stack, it);
-      it = next;
-   }
+   for (int i = 0; i < nparts; i++)
+      notef("partition %d: %u instances, %u processes", i, nunits[i],
+            load[i]);
+
+   if (plan.lookahead == INT64_MAX)
+      notef("partitions share no driven signals and can run independently");
+   else if (plan.lookahead == 0)
+      notef("a shared signal is assigned with zero delay so partitions "
+            "must synchronise every delta cycle");
+   else
+      notef("partitions can run %s ahead of each other",
+            fmt_time(plan.lookahead));
+
+   free(plan.masks);
+   free(plan.proc_part);
+   free(sorted);
+   free(proc_unit);
+   free(units);
+   hash_free(unit_map);
+}
 
-   return already_scheduled;
+////////////////////////////////////////////////////////////////////////////////
+// Checkpointing
+
+static void rt_checkpoint_str(const char *str, fbuf_t *f)
+{
+   const size_t len = strlen(str);
+   write_u32(len, f);
+   write_raw(str, len, f);
 }
 
-static void rt_update_group(netgroup_t *group, int driver, void *values)
+static void rt_restore_check_str(const char *expect, fbuf_t *f)
 {
-   const size_t valuesz = group->size * group->length;
+   const size_t len = read_u32(f);
+   char *str LOCAL = xmalloc(len + 1);
+   read_raw(str, len, f);
+   str[len] = '\0';
+
+   if (strcmp(str, expect) != 0)
+      fatal("checkpoint %s does not match this design: expected %s but "
+            "found %s", fbuf_file_name(f), expect, str);
+}
 
-   TRACE("update group %s values=%s driver=%d",
-         fmt_group(group), fmt_values(values, valuesz), driver);
+static void *rt_proc_state(rt_proc_t *proc, int32_t *size)
+{
+   // The code generator exports the state of each process along with
+   // its size, or -1 if it contains pointers which cannot be saved
 
-   const int32_t new_flags = rt_resolve_group(group, driver, values);
-   group->flags |= new_flags;
+   const char *name = istr(tree_ident(proc->source));
 
-   if (unlikely(n_active_groups == n_active_alloc)) {
-      n_active_alloc *= 2;
-      const size_t newsz = n_active_alloc * sizeof(struct netgroup *);
-      active_groups = xrealloc(active_groups, newsz);
-   }
-   active_groups[n_active_groups++] = group;
+   char *state_name LOCAL = xasprintf("%s__state", name);
+   char *size_name LOCAL = xasprintf("%s__state_size", name);
 
-   // Wake up any processes sensitive to this group
-   if (new_flags & NET_F_EVENT) {
-      sens_list_t *it, *last = NULL, *next = NULL;
+   void *state = jit_find_symbol(state_name, false);
+   const int32_t *sizep = jit_find_symbol(size_name, false);
 
-      // First wakeup everything on the group specific pending list
-      for (it = group->pending; it != NULL; it = next) {
-         next = it->next;
-         rt_wakeup(it);
-         group->pending = next;
-      }
+   if (state == NULL || sizep == NULL)
+      fatal("process %s has no saved state: the design must be "
+            "re-elaborated to use checkpoints", name);
 
-      // Now check the global pending list
-      if (group->flags & NET_F_GLOBAL) {
-         for (it = pending; it != NULL; it = next) {
-            next = it->next;
-
-            const netid_t x = group->first;
-            const netid_t y = group->first + group->length - 1;
-            const netid_t a = it->first;
-            const netid_t b = it->last;
-
-            const bool hit = (x <= b) && (a <= y);
-
-            if (hit) {
-               rt_wakeup(it);
-               if (last == NULL)
-                  pending = next;
-               else
-                  last->next = next;
-            }
-            else
-               last = it;
-         }
-      }
+   *size = *sizep;
+   return state;
+}
 
-      // Schedule any callbacks to run
-      for (watch_list_t *wl = group->watching; wl != NULL; wl = wl->next) {
-         if (!wl->watch->pending) {
-            wl->watch->chain_pending = callbacks;
-            wl->watch->pending = true;
-            callbacks = wl->watch;
-         }
-      }
-   }
+static void rt_checkpoint_sens(const sens_list_t *sl, fbuf_t *f)
+{
+   write_u32(sl->proc - procs, f);
+   write_u32(sl->wakeup_gen, f);
+   write_u32(sl->first, f);
+   write_u32(sl->last, f);
+   write_u32(sl->accept, f);
+   write_u8(sl->reenq != NULL, f);
 }
 
-static void rt_update_driver(netgroup_t *group, rt_proc_t *proc)
+static void rt_restore_sens(sens_list_t **list, fbuf_t *f)
 {
-   if (likely(proc != NULL)) {
-      // Find the driver owned by proc
-      int driver;
-      for (driver = 0; driver < group->n_drivers; driver++) {
-         if (likely(group->drivers[driver].proc == proc))
-            break;
-      }
-      RT_ASSERT(driver != group->n_drivers);
+   sens_list_t *sl = rt_alloc(sens_list_stack);
+   sl->proc       = &(procs[read_u32(f)]);
+   sl->wakeup_gen = read_u32(f);
+   sl->first      = read_u32(f);
+   sl->last       = read_u32(f);
+   sl->accept     = read_u32(f);
+   sl->next       = NULL;
+   sl->key        = NULL;
+   sl->owned      = false;
+   sl->linked     = true;
+
+   if (list == NULL)
+      list = rt_range_bucket(sl->first, sl->last);
+
+   sl->reenq = read_u8(f) ? list : NULL;
+
+   // Keep the original order so processes resume in the same sequence
+   sens_list_t **tail = list;
+   while (*tail != NULL)
+      tail = &((*tail)->next);
+   *tail = sl;
+}
 
-      waveform_t *w_now  = group->drivers[driver].waveforms;
-      waveform_t *w_next = w_now->next;
+static int rt_checkpoint_bits(const netgroup_t *g, const netgroup_cold_t *gc)
+{
+   // Signals of bit, std_ulogic and other small enumeration types are
+   // saved with one or four bits per element which makes checkpoints of
+   // large memories several times smaller
 
-      if (likely((w_next != NULL) && (w_next->when == now))) {
-         rt_update_group(group, driver, w_next->values->data);
-         group->drivers[driver].waveforms = w_next;
-         rt_free_value(group, w_now->values);
-         rt_free(waveform_stack, w_now);
-      }
-      else
-         RT_ASSERT(w_now != NULL);
+   if (g->size != 1)
+      return 8;
+
+   int bits = bitvec_pack_bits(g->resolved, g->length, 1);
+
+   if (g->flags & NET_F_LAST_VALUE)
+      bits = bitvec_pack_bits(gc->last_value, g->length, bits);
+   if (g->flags & NET_F_FORCED)
+      bits = bitvec_pack_bits((uint8_t *)gc->forcing->data, g->length, bits);
+
+   for (int i = 0; i < g->n_drivers && bits < 8; i++) {
+      const driver_t *d = &(g->drivers[i]);
+      for (uint32_t j = 0; j < d->count; j++)
+         bits = bitvec_pack_bits(rt_driver_value(g, d, j), g->length, bits);
    }
-   else if (group->flags & NET_F_FORCED)
-      rt_update_group(group, -1, group->forcing->data);
-}
 
-static bool rt_stale_event(event_t *e)
-{
-   return (e->kind == E_PROCESS) && (e->wakeup_gen != e->proc->wakeup_gen);
+   return bits;
 }
 
-static void rt_push_run_queue(event_t *e)
+static void rt_checkpoint_values(const void *values, size_t valuesz,
+                                 int bits, fbuf_t *f)
 {
-   if (unlikely(run_queue.wr == run_queue.alloc)) {
-      if (run_queue.alloc == 0) {
-         run_queue.alloc = 128;
-         run_queue.queue = xmalloc(sizeof(event_t *) * run_queue.alloc);
-      }
-      else {
-         run_queue.alloc *= 2;
-         run_queue.queue = realloc(run_queue.queue,
-                                   sizeof(event_t *) * run_queue.alloc);
-      }
+   if (bits == 8)
+      write_raw(values, valuesz, f);
+   else {
+      const size_t packedsz = bitvec_packed_size(valuesz, bits);
+      uint8_t *packed LOCAL = xmalloc(packedsz);
+      bitvec_pack(values, packed, valuesz, bits);
+      write_raw(packed, packedsz, f);
    }
+}
 
-   if (unlikely(rt_stale_event(e)))
-      rt_free(event_stack, e);
+static void rt_restore_values(void *values, size_t valuesz, int bits,
+                              fbuf_t *f)
+{
+   if (bits == 8)
+      read_raw(values, valuesz, f);
    else {
-      run_queue.queue[(run_queue.wr)++] = e;
-      if (e->kind == E_PROCESS)
-         ++(e->proc->wakeup_gen);
+      const size_t packedsz = bitvec_packed_size(valuesz, bits);
+      uint8_t *packed LOCAL = xmalloc(packedsz);
+      read_raw(packed, packedsz, f);
+      bitvec_unpack(packed, values, valuesz, bits);
    }
 }
 
-static event_t *rt_pop_run_queue(void)
+static void rt_checkpoint_group(groupid_t gid, netid_t first, unsigned length)
 {
-   if (run_queue.wr == run_queue.rd) {
-      run_queue.wr = 0;
-      run_queue.rd = 0;
-      return NULL;
+   fbuf_t *f = checkpoint_fbuf;
+   const netgroup_t *g = &(groups[gid]);
+   const netgroup_cold_t *gc = &(groups_cold[gid]);
+   const size_t valuesz = g->size * g->length;
+
+   const int bits = rt_checkpoint_bits(g, gc);
+
+   write_u32(gid, f);
+   write_u32(g->flags & (NET_F_FORCED | NET_F_LAST_VALUE), f);
+   write_u64(g->last_event, f);
+   write_u8(bits, f);
+   rt_checkpoint_values(g->resolved, valuesz, bits, f);
+
+   if (g->flags & NET_F_LAST_VALUE)
+      rt_checkpoint_values(gc->last_value, valuesz, bits, f);
+   if (g->flags & NET_F_FORCED)
+      rt_checkpoint_values(gc->forcing->data, valuesz, bits, f);
+
+   write_u16(g->n_drivers, f);
+   for (int i = 0; i < g->n_drivers; i++) {
+      const driver_t *d = &(g->drivers[i]);
+      write_u32(d->proc - procs, f);
+      write_u32(d->count, f);
+
+      for (uint32_t j = 0; j < d->count; j++) {
+         write_u64(d->when[(d->head + j) & (d->capacity - 1)], f);
+         rt_checkpoint_values(rt_driver_value(g, d, j), valuesz, bits, f);
+      }
    }
-   else
-      return run_queue.queue[(run_queue.rd)++];
+
+   unsigned npending = 0;
+   for (const sens_list_t *it = g->pending; it != NULL; it = it->next)
+      npending++;
+
+   write_u32(npending, f);
+   for (const sens_list_t *it = g->pending; it != NULL; it = it->next)
+      rt_checkpoint_sens(it, f);
 }
 
-static void rt_iteration_limit(void)
+static void rt_restore_group(groupid_t gid, netid_t first, unsigned length)
 {
-   text_buf_t *buf = tb_new();
-   tb_printf(buf, "Iteration limit of %d delta cycles reached. "
-             "The following processes are active:\n",
-             opt_get_int("stop-delta"));
+   fbuf_t *f = checkpoint_fbuf;
+   netgroup_t *g = &(groups[gid]);
+   netgroup_cold_t *gc = &(groups_cold[gid]);
+   const size_t valuesz = g->size * g->length;
 
-   for (sens_list_t *it = resume; it != NULL; it = it->next) {
-      tree_t p = it->proc->source;
-      const loc_t *l = tree_loc(p);
-      tb_printf(buf, "  %-30s %s line %d\n", istr(tree_ident(p)),
-                istr(l->file), l->first_line);
+   if (read_u32(f) != gid)
+      fatal("checkpoint %s does not match this design", fbuf_file_name(f));
+
+   const uint32_t flags = read_u32(f);
+   if ((flags & NET_F_LAST_VALUE) != (g->flags & NET_F_LAST_VALUE))
+      fatal("checkpoint %s does not match this design", fbuf_file_name(f));
+
+   g->flags &= ~(NET_F_FORCED | NET_F_ACTIVE | NET_F_EVENT);
+   g->flags |= (flags & NET_F_FORCED);
+   g->last_event = read_u64(f);
+
+   const int bits = read_u8(f);
+   if ((bits != 1 && bits != 4 && bits != 8) || (bits < 8 && g->size != 1))
+      fatal("checkpoint %s does not match this design", fbuf_file_name(f));
+
+   rt_restore_values(g->resolved, valuesz, bits, f);
+
+   if (g->flags & NET_F_LAST_VALUE)
+      rt_restore_values(gc->last_value, valuesz, bits, f);
+
+   if (g->flags & NET_F_FORCED) {
+      if (gc->forcing == NULL)
+         gc->forcing = rt_alloc_value(g);
+      rt_restore_values(gc->forcing->data, valuesz, bits, f);
    }
 
-   tb_printf(buf, "You can increase this limit with --stop-delta");
+   if (read_u16(f) != g->n_drivers)
+      fatal("checkpoint %s has a different number of drivers for %s",
+            fbuf_file_name(f), fmt_group(g));
 
-   fatal("%s", tb_get(buf));
-}
+   if (gc->span != NULL)
+      gc->span->valid = false;
 
-static void rt_resume_processes(sens_list_t **list)
-{
-   sens_list_t *it = *list;
-   while (it != NULL) {
-      if (it->proc->pending) {
-         rt_run(it->proc, false /* reset */);
-         it->proc->pending = false;
-      }
+   for (int i = 0; i < g->n_drivers; i++) {
+      driver_t *d = &(g->drivers[i]);
+      if (&(procs[read_u32(f)]) != d->proc)
+         fatal("checkpoint %s has a different driver for %s",
+               fbuf_file_name(f), fmt_group(g));
 
-      sens_list_t *next = it->next;
+      const uint32_t count = read_u32(f);
+      while (d->capacity < count)
+         rt_driver_grow(g, d);
 
-      if (it->reenq == NULL)
-         rt_free(sens_list_stack, it);
-      else {
-         it->next = *(it->reenq);
-         *(it->reenq) = it;
+      d->head  = 0;
+      d->count = count;
+
+      for (uint32_t j = 0; j < count; j++) {
+         d->when[j] = read_u64(f);
+         rt_restore_values(rt_driver_value(g, d, j), valuesz, bits, f);
       }
+   }
 
-      it = next;
+   while (g->pending != NULL) {
+      sens_list_t *next = g->pending->next;
+      rt_sens_release(g->pending);
+      g->pending = next;
    }
 
-   *list = NULL;
+   const unsigned npending = read_u32(f);
+   for (unsigned i = 0; i < npending; i++)
+      rt_restore_sens(&(g->pending), f);
 }
 
-static void rt_event_callback(bool postponed)
+static void rt_checkpoint(const char *file)
 {
-   watch_t **last = &callbacks;
-   watch_t *next = NULL, *it;
-   for (it = callbacks; it != NULL; it = next) {
-      next = it->chain_pending;
-      if (it->postponed == postponed) {
-         (*it->fn)(now, it->signal, it, it->user_data);
-         it->pending = false;
+   RT_ASSERT(delta_proc == NULL && delta_driver == NULL);
+
+   fbuf_t *f = fbuf_open(file, FBUF_OUT);
+   if (f == NULL)
+      fatal_errno("failed to create checkpoint %s", file);
+
+   write_u32(CHECKPOINT_MAGIC, f);
+   write_u32(n_procs, f);
+   write_u32(n_groups, f);
+   write_u64(now, f);
+   write_u32(iteration, f);
+
+   for (size_t i = 0; i < n_procs; i++) {
+      rt_proc_t *p = &(procs[i]);
+      const char *name = istr(tree_ident(p->source));
+
+      int32_t size;
+      void *state = rt_proc_state(p, &size);
+
+      // The second field of the state is the pointer to the state of
+      // the procedure the process is suspended in, if any
+      if (p->tmp_stack != NULL || ((void **)state)[1] != NULL)
+         fatal("cannot checkpoint process %s while it is suspended in "
+               "a procedure", name);
+      else if (size < 0)
+         fatal("cannot checkpoint process %s as it has variables of "
+               "access, file, or unconstrained array type", name);
+
+      rt_checkpoint_str(name, f);
+      write_u32(p->wakeup_gen, f);
+      write_u32(size, f);
+      write_raw(state, size, f);
+   }
+
+   checkpoint_fbuf = f;
+   netdb_walk(netdb, rt_checkpoint_group);
+   checkpoint_fbuf = NULL;
+
+   unsigned nglobal = 0;
+   for (int level = 0; level < RANGE_LEVELS; level++) {
+      const range_level_t *rl = &(range_index[level]);
+      for (netid_t b = 0; rl->buckets && b < rl->nbuckets; b++) {
+         for (sens_list_t *it = rl->buckets[b]; it != NULL; it = it->next)
+            nglobal++;
+      }
+   }
+
+   write_u32(nglobal, f);
+   for (int level = 0; level < RANGE_LEVELS; level++) {
+      const range_level_t *rl = &(range_index[level]);
+      for (netid_t b = 0; rl->buckets && b < rl->nbuckets; b++) {
+         for (sens_list_t *it = rl->buckets[b]; it != NULL; it = it->next)
+            rt_checkpoint_sens(it, f);
+      }
+   }
 
-         *last = it->chain_pending;
-         it->chain_pending = NULL;
+   // Drain the event queue in order and then put everything back
+   const size_t nevents = eventq_size();
+   event_t **events = xmalloc(nevents * sizeof(event_t *));
+   for (size_t i = 0; i < nevents; i++)
+      events[i] = eventq_extract_min();
+
+   write_u32(nevents, f);
+   for (size_t i = 0; i < nevents; i++) {
+      event_t *e = events[i];
+
+      write_u8(e->kind, f);
+      write_u64(e->when, f);
+
+      switch (e->kind) {
+      case E_PROCESS:
+         write_u32(e->proc - procs, f);
+         write_u32(e->wakeup_gen, f);
+         break;
+      case E_DRIVER:
+         write_u32(e->group - groups, f);
+         write_u32(e->driver, f);
+         write_u32(e->proc ? e->proc - procs : UINT32_MAX, f);
+         break;
+      case E_TIMEOUT:
+         fatal("cannot checkpoint with pending timeout callbacks");
+      case E_CLOCK:
+         write_u32(e->proc - procs, f);
+         break;
       }
-      else
-         last = &(it->chain_pending);
+
+      eventq_insert(e);
    }
-}
 
-static inline bool rt_next_cycle_is_delta(void)
-{
-   return (delta_driver != NULL) || (delta_proc != NULL);
+   free(events);
+   fbuf_close(f);
+
+   notef("wrote checkpoint at %s to %s", fmt_time(now), file);
 }
 
-static void rt_cycle(int stop_delta)
+static void rt_restore(const char *file)
 {
-   // Simulation cycle is described in LRM 93 section 12.6.4
+   fbuf_t *f = fbuf_open(file, FBUF_IN);
+   if (f == NULL)
+      fatal_errno("failed to open checkpoint %s", file);
 
-   const bool is_delta_cycle = (delta_driver != NULL) || (delta_proc != NULL);
+   if (read_u32(f) != CHECKPOINT_MAGIC)
+      fatal("%s is not a checkpoint file or was created by a different "
+            "version of " PACKAGE, file);
 
-   if (is_delta_cycle)
-      iteration = iteration + 1;
-   else {
-      event_t *peek = heap_min(eventq_heap);
-      while (unlikely(rt_stale_event(peek))) {
-         // Discard stale events
-         rt_free(event_stack, heap_extract_min(eventq_heap));
-         if (heap_size(eventq_heap) == 0)
-            return;
-         else
-            peek = heap_min(eventq_heap);
-      }
-      now = peek->when;
-      iteration = 0;
-   }
+   if (read_u32(f) != n_procs || read_u32(f) != n_groups)
+      fatal("checkpoint %s does not match this design", file);
 
-   TRACE("begin cycle");
+   now       = read_u64(f);
+   iteration = read_u32(f);
 
-#if TRACE_DELTAQ > 0
-   if (trace_on)
-      deltaq_dump();
-#endif
-#if TRACE_PENDING > 0
-   if (trace_on)
-      rt_dump_pending();
-#endif
+   // Discard the events and sensitivity created by initialisation
+   rt_free_delta_events(delta_proc);
+   rt_free_delta_events(delta_driver);
+   delta_proc = delta_driver = NULL;
 
-   if (is_delta_cycle) {
-      for (event_t *e = delta_driver; e != NULL; e = e->delta_chain)
-         rt_push_run_queue(e);
+   while (eventq_size() > 0)
+      rt_free(event_stack, eventq_extract_min());
 
-      for (event_t *e = delta_proc; e != NULL; e = e->delta_chain)
-         rt_push_run_queue(e);
+   rt_free_range_index(false);
 
-      delta_driver = NULL;
-      delta_proc = NULL;
-   }
-   else {
-      rt_global_event(RT_NEXT_TIME_STEP);
+   for (size_t i = 0; i < n_procs; i++) {
+      rt_proc_t *p = &(procs[i]);
+      rt_restore_check_str(istr(tree_ident(p->source)), f);
 
-      for (;;) {
-         rt_push_run_queue(heap_extract_min(eventq_heap));
+      p->wakeup_gen = read_u32(f);
 
-         if (heap_size(eventq_heap) == 0)
-            break;
+      int32_t size;
+      void *state = rt_proc_state(p, &size);
+      if (read_u32(f) != size)
+         fatal("checkpoint %s does not match this design", file);
 
-         event_t *peek = heap_min(eventq_heap);
-         if (peek->when > now)
-            break;
-      }
+      read_raw(state, size, f);
    }
 
-   event_t *event;
-   while ((event = rt_pop_run_queue())) {
-      switch (event->kind) {
+   checkpoint_fbuf = f;
+   netdb_walk(netdb, rt_restore_group);
+   checkpoint_fbuf = NULL;
+
+   const unsigned nglobal = read_u32(f);
+   for (unsigned i = 0; i < nglobal; i++)
+      rt_restore_sens(NULL, f);
+
+   const unsigned nevents = read_u32(f);
+   for (unsigned i = 0; i < nevents; i++) {
+      event_t *e = rt_alloc(event_stack);
+      e->kind         = read_u8(f);
+      e->when         = read_u64(f);
+      e->delta_chain  = NULL;
+      e->proc         = NULL;
+      e->group        = NULL;
+      e->driver       = -1;
+      e->wakeup_gen   = UINT32_MAX;
+      e->timeout_fn   = NULL;
+      e->timeout_user = NULL;
+
+      switch (e->kind) {
       case E_PROCESS:
-         rt_run(event->proc, false /* reset */);
+         e->proc       = &(procs[read_u32(f)]);
+         e->wakeup_gen = read_u32(f);
          break;
       case E_DRIVER:
-         rt_update_driver(event->group, event->proc);
+         {
+            e->group  = &(groups[read_u32(f)]);
+            e->driver = read_u32(f);
+
+            const uint32_t proc = read_u32(f);
+            if (proc != UINT32_MAX)
+               e->proc = &(procs[proc]);
+         }
          break;
-      case E_TIMEOUT:
-         (*event->timeout_fn)(now, event->timeout_user);
+      case E_CLOCK:
+         e->proc = &(procs[read_u32(f)]);
+         if (e->proc->clock_group == NULL)
+            fatal("checkpoint %s is corrupt", file);
+         e->group = e->proc->clock_group;
          break;
+      default:
+         fatal("checkpoint %s is corrupt", file);
       }
 
-      rt_free(event_stack, event);
-   }
-
-   if (unlikely(now == 0 && iteration == 0)) {
-      vcd_restart();
-      lxt_restart();
-      fst_restart();
+      eventq_insert(e);
    }
-   else if (unlikely((stop_delta > 0) && (iteration == stop_delta)))
-      rt_iteration_limit();
 
-   // Run all non-postponed event callbacks
-   rt_event_callback(false);
+   fbuf_close(f);
 
-   // Run all processes that resumed because of signal events
-   rt_resume_processes(&resume);
-   rt_global_event(RT_END_OF_PROCESSES);
+   notef("restored checkpoint at %s from %s", fmt_time(now), file);
+}
 
-   for (unsigned i = 0; i < n_active_groups; i++) {
-      netgroup_t *g = active_groups[i];
-      g->flags &= ~(NET_F_ACTIVE | NET_F_EVENT);
-   }
-   n_active_groups = 0;
+static int rt_proc_usage_cmp(const void *lhs, const void *rhs)
+{
+   const uint64_t l = ((const rt_proc_t *)lhs)->usage;
+   const uint64_t r = ((const rt_proc_t *)rhs)->usage;
+   return (l < r) - (l > r);
+}
 
-   if (!rt_next_cycle_is_delta()) {
-      can_create_delta = false;
-      rt_global_event(RT_LAST_KNOWN_DELTA_CYCLE);
+////////////////////////////////////////////////////////////////////////////////
+// Profiling
 
-      // Run any postponed processes
-      rt_resume_processes(&postponed);
+static double rt_profile_tick_us(void)
+{
+   // Calibrate the cycle counter against the wall clock over the
+   // whole run
+   const uint64_t ticks = rt_profile_clock() - profile_start_ticks;
+   const uint64_t us = get_timestamp_us() - profile_start_us;
 
-      // Execute all postponed event callbacks
-      rt_event_callback(true);
+   return ticks > 0 ? (double)us / ticks : 0.0;
+}
 
-      can_create_delta = true;
+static void rt_json_string(FILE *f, const char *str)
+{
+   fputc('"', f);
+   for (const char *p = str; *p != '\0'; p++) {
+      if (*p == '"' || *p == '\\')
+         fprintf(f, "\\%c", *p);
+      else if ((unsigned char)*p < 0x20)
+         fprintf(f, "\\u%04x", *p);
+      else
+         fputc(*p, f);
    }
+   fputc('"', f);
 }
 
-static tree_t rt_recall_decl(const char *name)
+static inst_prof_t *rt_profile_instance(hash_t *h, ident_t path,
+                                        ident_t **order, size_t *n_order)
 {
-   tree_t decl = hash_get(decl_hash, ident_new(name));
-   if (decl != NULL)
-      return decl;
-   else
-      fatal("cannot find name %s in elaborated design", name);
+   inst_prof_t *ip = hash_get(h, path);
+   if (ip == NULL) {
+      ip = xcalloc(sizeof(inst_prof_t));
+      hash_put(h, path, ip);
+
+      *order = xrealloc(*order, (*n_order + 1) * sizeof(ident_t));
+      (*order)[(*n_order)++] = path;
+   }
+
+   return ip;
 }
 
-static void rt_cleanup_group(groupid_t gid, netid_t first, unsigned length)
+static void rt_profile_feedback(const char *file)
 {
-   netgroup_t *g = &(groups[gid]);
+   // Process counts for the code generator to read with --profile-use:
+   // the name is last on each line as it may contain spaces
 
-   RT_ASSERT(g->first == first);
-   RT_ASSERT(g->length == length);
-
-   if (g->flags & NET_F_OWNS_MEM)
-      free(g->resolved);
+   FILE *f = fopen(file, "w");
+   if (f == NULL)
+      fatal_errno("failed to open %s", file);
 
-   free(g->forcing);
+   fprintf(f, "# nvc profile 1\n");
 
-   for (int j = 0; j < g->n_drivers; j++) {
-      while (g->drivers[j].waveforms != NULL) {
-         waveform_t *next = g->drivers[j].waveforms->next;
-         rt_free_value(g, g->drivers[j].waveforms->values);
-         rt_free(waveform_stack, g->drivers[j].waveforms);
-         g->drivers[j].waveforms = next;
-      }
+   for (size_t i = 0; i < n_procs; i++) {
+      const rt_proc_t *p = &(procs[i]);
+      fprintf(f, "%"PRIu64" %"PRIu64" %s\n", p->wakeups, p->usage,
+              istr(tree_ident(p->source)));
    }
-   free(g->drivers);
 
-   while (g->free_values != NULL) {
-      value_t *next = g->free_values->next;
-      free(g->free_values);
-      g->free_values = next;
-   }
+   fclose(f);
+}
 
-   while (g->pending != NULL) {
-      sens_list_t *next = g->pending->next;
-      rt_free(sens_list_stack, g->pending);
-      g->pending = next;
+static void rt_profile_write(const char *file)
+{
+   FILE *f = fopen(file, "w");
+   if (f == NULL)
+      fatal_errno("failed to open %s", file);
+
+   const double tick_us = rt_profile_tick_us();
+
+   // Totals for each instance include everything beneath it in the
+   // design hierarchy
+   hash_t *inst_hash = hash_new(256, true);
+   ident_t *order = NULL;
+   size_t n_order = 0;
+
+   fprintf(f, "{\n  \"tick_us\": %g,\n  \"processes\": [", tick_us);
+
+   for (size_t i = 0; i < n_procs; i++) {
+      const rt_proc_t *p = &(procs[i]);
+      ident_t name = tree_ident(p->source);
+
+      fprintf(f, "%s\n    { \"name\": ", i > 0 ? "," : "");
+      rt_json_string(f, istr(name));
+      fprintf(f, ", \"wakeups\": %"PRIu64", \"ticks\": %"PRIu64" }",
+              p->wakeups, p->usage);
+
+      for (ident_t it = ident_runtil(name, ':'), prev = name;
+           it != prev && *istr(it) != '\0';
+           prev = it, it = ident_runtil(it, ':')) {
+         inst_prof_t *ip = rt_profile_instance(inst_hash, it, &order,
+                                               &n_order);
+         ip->wakeups    += p->wakeups;
+         ip->proc_ticks += p->usage;
+      }
    }
 
-   while (g->watching != NULL) {
-      watch_list_t *next = g->watching->next;
-      free(g->watching);
-      g->watching = next;
+   fprintf(f, "\n  ],\n  \"signals\": [");
+
+   bool first = true;
+   for (groupid_t gid = 0; gid < n_groups; gid++) {
+      const group_prof_t *gp = &(group_prof[gid]);
+      if (gp->updates == 0)
+         continue;
+
+      fprintf(f, "%s\n    { \"name\": ", first ? "" : ",");
+      rt_json_string(f, fmt_group(&(groups[gid])));
+      fprintf(f, ", \"updates\": %"PRIu64", \"update_ticks\": %"PRIu64
+              ", \"resolution_ticks\": %"PRIu64" }",
+              gp->updates, gp->update_ticks, gp->resolve_ticks);
+      first = false;
+
+      ident_t name = tree_ident(groups_cold[gid].sig_decl);
+      for (ident_t it = ident_runtil(name, ':'), prev = name;
+           it != prev && *istr(it) != '\0';
+           prev = it, it = ident_runtil(it, ':')) {
+         inst_prof_t *ip = rt_profile_instance(inst_hash, it, &order,
+                                               &n_order);
+         ip->updates       += gp->updates;
+         ip->update_ticks  += gp->update_ticks;
+         ip->resolve_ticks += gp->resolve_ticks;
+      }
    }
-}
 
-static void rt_cleanup(tree_t top)
-{
-   RT_ASSERT(resume == NULL);
+   fprintf(f, "\n  ],\n  \"instances\": [");
 
-   while (heap_size(eventq_heap) > 0)
-      rt_free(event_stack, heap_extract_min(eventq_heap));
+   for (size_t i = 0; i < n_order; i++) {
+      inst_prof_t *ip = hash_get(inst_hash, order[i]);
 
-   rt_free_delta_events(delta_proc);
-   rt_free_delta_events(delta_driver);
+      fprintf(f, "%s\n    { \"path\": ", i > 0 ? "," : "");
+      rt_json_string(f, istr(order[i]));
+      fprintf(f, ", \"wakeups\": %"PRIu64", \"process_ticks\": %"PRIu64
+              ", \"updates\": %"PRIu64", \"update_ticks\": %"PRIu64
+              ", \"resolution_ticks\": %"PRIu64" }",
+              ip->wakeups, ip->proc_ticks, ip->updates, ip->update_ticks,
+              ip->resolve_ticks);
 
-   heap_free(eventq_heap);
-   eventq_heap = NULL;
+      free(ip);
+   }
 
-   netdb_walk(netdb, rt_cleanup_group);
-   netdb_close(netdb);
+   fprintf(f, "\n  ]\n}\n");
+   fclose(f);
 
-   hash_free(decl_hash);
-   decl_hash = NULL;
+   hash_free(inst_hash);
+   free(order);
 
-   while (watches != NULL) {
-      watch_t *next = watches->chain_all;
-      rt_free(watch_stack, watches);
-      free(watches->groups);
-      watches = next;
-   }
+   notef("wrote profile data to %s", file);
+}
 
-   while (pending != NULL) {
-      sens_list_t *next = pending->next;
-      rt_free(sens_list_stack, pending);
-      pending = next;
-   }
+static void rt_stats_pools(void)
+{
+   // Taken before the pools are destroyed at the end of the run
+   rt_alloc_stack_t pools[] = {
+      event_stack, sens_list_stack, watch_stack, callback_stack
+   };
 
-   for (int i = 0; i < RT_LAST_EVENT; i++) {
-      while (global_cbs[i] != NULL) {
-         callback_t *tmp = global_cbs[i]->next;
-         rt_free(callback_stack, global_cbs[i]);
-         global_cbs[i] = tmp;
-      }
+   for (size_t i = 0; i < ARRAY_LEN(pools); i++) {
+      pool_stats[i].name     = pools[i]->name;
+      pool_stats[i].item_sz  = pools[i]->item_sz;
+      pool_stats[i].items    = pools[i]->stack_sz;
+      pool_stats[i].live     = pools[i]->stack_sz - pools[i]->stack_top;
+      pool_stats[i].peak     = pools[i]->peak_sz;
+      pool_stats[i].chunks   = pools[i]->n_chunks;
+      pool_stats[i].released = pools[i]->released;
    }
 
-   rt_alloc_stack_destroy(event_stack);
-   rt_alloc_stack_destroy(waveform_stack);
-   rt_alloc_stack_destroy(sens_list_stack);
-   rt_alloc_stack_destroy(watch_stack);
-   rt_alloc_stack_destroy(callback_stack);
+   if (signal_arena != NULL)
+      arena_bytes = arena_size(signal_arena, &arena_chunks);
 
-   hash_free(res_memo_hash);
+   access_stats(&access_stats_end);
 }
 
-static bool rt_stop_now(uint64_t stop_time)
+static void rt_stats_write(const char *file, const nvc_rusage_t *ru)
 {
-   if ((delta_driver != NULL) || (delta_proc != NULL))
-      return false;
-   else if (heap_size(eventq_heap) == 0)
-      return true;
-   else if (force_stop)
-      return true;
-   else if (stop_time == UINT64_MAX)
-      return false;
-   else {
-      event_t *peek = heap_min(eventq_heap);
-      return peek->when > stop_time;
+   FILE *f = fopen(file, "w");
+   if (f == NULL)
+      fatal_errno("failed to open %s", file);
+
+   // Include the final time step which has not been recorded yet
+   rt_stats_time_step();
+
+   fprintf(f, "{\n");
+   fprintf(f, "  \"setup_ms\": %u,\n", ready_rusage.ms);
+   fprintf(f, "  \"run_ms\": %u,\n", ru->ms);
+   fprintf(f, "  \"maxrss_kb\": %u,\n", ru->rss);
+   fprintf(f, "  \"time_steps\": %"PRIu64",\n", stats.time_steps);
+   fprintf(f, "  \"delta_cycles\": %"PRIu64",\n", stats.delta_cycles);
+
+   fprintf(f, "  \"deltas_per_step\": [");
+   bool first = true;
+   for (int i = 0; i < DELTA_HIST_SIZE; i++) {
+      if (stats.delta_hist[i] == 0)
+         continue;
+
+      const uint64_t low  = (i == 0) ? 0 : UINT64_C(1) << (i - 1);
+      const uint64_t high = (i == 0) ? 0 : (UINT64_C(1) << i) - 1;
+
+      fprintf(f, "%s\n    { \"min\": %"PRIu64", \"max\": %"PRIu64
+              ", \"count\": %"PRIu64" }", first ? "" : ",",
+              low, high, stats.delta_hist[i]);
+      first = false;
    }
-}
+   fprintf(f, "\n  ],\n");
+
+   fprintf(f, "  \"events\": { \"timeout\": %"PRIu64", \"driver\": %"PRIu64
+           ", \"process\": %"PRIu64", \"clock\": %"PRIu64" },\n",
+           stats.events[E_TIMEOUT], stats.events[E_DRIVER],
+           stats.events[E_PROCESS], stats.events[E_CLOCK]);
+   fprintf(f, "  \"transactions\": { \"scheduled\": %"PRIu64
+           ", \"rejected\": %"PRIu64", \"coalesced\": %"PRIu64" },\n",
+           stats.txns_scheduled, stats.txns_rejected, stats.txns_coalesced);
+   fprintf(f, "  \"wakeups\": { \"static\": %"PRIu64", \"dynamic\": %"
+           PRIu64", \"rearmed\": %"PRIu64", \"filtered\": %"PRIu64" },\n",
+           stats.static_wakeups, stats.dynamic_wakeups, stats.sens_rearmed,
+           stats.filtered_wakeups);
+   fprintf(f, "  \"peak\": { \"event_queue\": %zu, \"run_queue\": %zu"
+           ", \"active_groups\": %u },\n", stats.max_eventq,
+           stats.max_run_queue, stats.max_active_groups);
+   fprintf(f, "  \"locality\": { \"sorted_events\": %"PRIu64
+           ", \"page_switches\": %"PRIu64" },\n", stats.sorted_events,
+           stats.page_switches);
+   fprintf(f, "  \"async_callbacks\": { \"records\": %"PRIu64
+           ", \"stalls\": %"PRIu64" },\n", stats.async_records,
+           stats.async_stalls);
+   fprintf(f, "  \"tiered_up\": %"PRIu64",\n", stats.tiered_up);
+
+   fprintf(f, "  \"pools\": [");
+   for (size_t i = 0; i < ARRAY_LEN(pool_stats); i++) {
+      const pool_stats_t *p = &(pool_stats[i]);
+      fprintf(f, "%s\n    { \"name\": \"%s\", \"item_size\": %zu"
+              ", \"items\": %zu, \"live\": %zu, \"peak\": %zu"
+              ", \"chunks\": %zu, \"released_bytes\": %zu }",
+              i == 0 ? "" : ",", p->name, p->item_sz, p->items, p->live,
+              p->peak, p->chunks, p->released);
+   }
+   fprintf(f, "\n  ],\n");
+   fprintf(f, "  \"signal_arena\": { \"bytes\": %zu, \"chunks\": %u },\n",
+           arena_bytes, arena_chunks);
+   fprintf(f, "  \"access\": { \"allocs\": %"PRIu64", \"frees\": %"PRIu64
+           ", \"large\": %"PRIu64", \"slab_bytes\": %zu, \"large_bytes\": %zu"
+           ", \"threads\": %u },\n", access_stats_end.allocs,
+           access_stats_end.frees, access_stats_end.large,
+           access_stats_end.slab_bytes, access_stats_end.large_bytes,
+           access_stats_end.threads);
+   fprintf(f, "  \"trim\": { \"passes\": %"PRIu64", \"released_bytes\": %zu"
+           ", \"driver_queues\": %zu },\n", trim_count, trim_bytes,
+           trim_drivers);
+
+   fprintf(f, "  \"tmp_stack\": [");
+   first = true;
+   for (size_t i = 0; i < n_procs; i++) {
+      if (procs[i].tmp_peak == 0)
+         continue;
+
+      fprintf(f, "%s\n    { \"process\": ", first ? "" : ",");
+      rt_json_string(f, istr(tree_ident(procs[i].source)));
+      fprintf(f, ", \"peak\": %u, \"private\": %s }", procs[i].tmp_peak,
+              procs[i].tmp_stack != NULL ? "true" : "false");
+      first = false;
+   }
+   fprintf(f, "\n  ]\n");
+   fprintf(f, "}\n");
 
-static int rt_proc_usage_cmp(const void *lhs, const void *rhs)
-{
-   return ((const rt_proc_t *)rhs)->usage - ((const rt_proc_t *)lhs)->usage;
+   fclose(f);
 }
 
 static void rt_stats_print(void)
@@ -2402,16 +5726,60 @@ static void rt_stats_print(void)
       qsort(procs, n_procs, sizeof(rt_proc_t), rt_proc_usage_cmp);
 
       const uint64_t ru_us = ru.ms * 1000;
+      const double tick_us = rt_profile_tick_us();
 
-      color_printf("$white$%10s %5s %s$$\n", "us", "%", "process");
+      color_printf("$white$%10s %5s %10s %s$$\n", "us", "%", "wakeups",
+                   "process");
       for (size_t i = 0; i < MIN(n_procs, 10); i++) {
-         const double pc = ((double)procs[i].usage / ru_us) * 100.0;
-         printf("%10"PRIu64" %5.1f %s\n", procs[i].usage, pc,
+         const double us = procs[i].usage * tick_us;
+         const double pc = (us / ru_us) * 100.0;
+         printf("%10.0f %5.1f %10"PRIu64" %s\n", us, pc, procs[i].wakeups,
                 istr(tree_ident(procs[i].source)));
       }
    }
 
    notef("setup:%ums run:%ums maxrss:%ukB", ready_rusage.ms, ru.ms, ru.rss);
+   notef("groups:%u bytes per group:%zu hot + %zu cold", n_groups,
+         sizeof(struct netgroup), sizeof(struct netgroup_cold));
+
+   const rt_proc_t *max_tmp = NULL;
+   unsigned n_private = 0;
+   uint64_t total_tmp = 0;
+   for (size_t i = 0; i < n_procs; i++) {
+      if (max_tmp == NULL || procs[i].tmp_peak > max_tmp->tmp_peak)
+         max_tmp = &(procs[i]);
+      if (procs[i].tmp_stack != NULL)
+         n_private++;
+      total_tmp += procs[i].tmp_peak;
+   }
+
+   if (max_tmp != NULL)
+      notef("temp stack peak:%u bytes in %s total:%"PRIu64" bytes "
+            "private stacks:%u", max_tmp->tmp_peak,
+            istr(tree_ident(max_tmp->source)), total_tmp, n_private);
+
+   for (size_t i = 0; i < ARRAY_LEN(pool_stats); i++) {
+      const pool_stats_t *p = &(pool_stats[i]);
+      notef("%s pool items:%zu live:%zu peak:%zu chunks:%zu "
+            "released:%zukB", p->name, p->items, p->live, p->peak,
+            p->chunks, p->released / 1024);
+   }
+
+   notef("signal arena:%zukB in %u chunks", arena_bytes / 1024,
+         arena_chunks);
+
+   if (access_stats_end.allocs > 0)
+      notef("access allocs:%"PRIu64" frees:%"PRIu64" large:%"PRIu64
+            " slabs:%zukB", access_stats_end.allocs, access_stats_end.frees,
+            access_stats_end.large, access_stats_end.slab_bytes / 1024);
+
+   if (trim_bytes > 0)
+      notef("trimmed %zukB in %"PRIu64" passes including %zu driver queues",
+            trim_bytes / 1024, trim_count, trim_drivers);
+
+   const char *stats_file = opt_get_str("rt-stats-file");
+   if (stats_file != NULL)
+      rt_stats_write(stats_file, &ru);
 }
 
 static void rt_reset_coverage(tree_t top)
@@ -2427,14 +5795,31 @@ static void rt_reset_coverage(tree_t top)
       const int ntags = tree_attr_int(top, ident_new("cond_tags"), 0);
       memset(cover_conds, '\0', sizeof(int32_t) * ntags);
    }
+
+   cover_sample = jit_find_symbol("cover_sample", false);
+   cover_cycles = 0;
 }
 
 static void rt_emit_coverage(tree_t top)
 {
    const int32_t *cover_stmts = jit_find_symbol("cover_stmts", false);
    const int32_t *cover_conds = jit_find_symbol("cover_conds", false);
-   if (cover_stmts != NULL)
-      cover_report(top, cover_stmts, cover_conds);
+   if (cover_stmts == NULL)
+      return;
+
+   const char *file = opt_get_str("cover-file");
+   char path[PATH_MAX];
+   if (file == NULL) {
+      ident_t name = ident_strip(tree_ident(top), ident_new(".elab"));
+      char *base LOCAL = xasprintf("%s.covdb", istr(name));
+      lib_realpath(lib_work(), base, path, sizeof(path));
+      file = path;
+   }
+
+   tree_index_begin(top);
+   cover_write(top, cover_stmts, cover_conds, file);
+   cover_report(top, cover_stmts, cover_conds);
+   tree_index_end();
 }
 
 static void rt_interrupt(void)
@@ -2482,10 +5867,52 @@ void rt_start_of_tool(tree_t top)
 #endif
 
    trace_on = opt_get_int("rt_trace_en");
-   profiling = opt_get_int("rt_profile");
+   profiling = opt_get_int("rt_profile")
+      || opt_get_str("rt-profile-out") != NULL;
+   stats_on = opt_get_str("rt-stats-file") != NULL;
+
+   memset(&stats, '\0', sizeof(stats));
+
+   if (profiling) {
+      profile_start_ticks = rt_profile_clock();
+      profile_start_us    = get_timestamp_us();
+   }
+   use_wheel = opt_get_int("rt-event-wheel");
+   n_threads = opt_get_int("rt-threads");
+   perf_map  = opt_get_int("perf-map");
+   sort_run_queue = opt_get_int("rt-sort-run-queue");
+   n_partitions   = opt_get_int("rt-partitions");
+   tiered         = jit_can_tier_up();
+
+   arena_flags = opt_get_int("rt-huge-pages") ? ARENA_HUGE_PAGES : 0;
+
+   const char *numa = opt_get_str("rt-numa");
+   if (numa == NULL)
+      arena_node = -1;
+   else if (strcmp(numa, "interleave") == 0)
+      arena_flags |= ARENA_INTERLEAVE;
+   else {
+      arena_flags |= ARENA_BIND_NODE;
+      arena_node = atoi(numa);
+   }
+
+   if (n_threads > 1) {
+#if RT_MULTITHREAD
+      if (trace_on) {
+         warnf("--threads has no effect with --trace");
+         n_threads = 1;
+      }
+      else if (jit_find_symbol("cover_stmts", false) != NULL) {
+         warnf("--threads has no effect when coverage is enabled");
+         n_threads = 1;
+      }
+#else
+      warnf("--threads is not supported on this platform");
+      n_threads = 1;
+#endif
+   }
 
    event_stack     = rt_alloc_stack_new(sizeof(event_t), "event");
-   waveform_stack  = rt_alloc_stack_new(sizeof(waveform_t), "waveform");
    sens_list_stack = rt_alloc_stack_new(sizeof(sens_list_t), "sens_list");
    watch_stack     = rt_alloc_stack_new(sizeof(watch_t), "watch");
    callback_stack  = rt_alloc_stack_new(sizeof(callback_t), "callback");
@@ -2496,7 +5923,14 @@ void rt_start_of_tool(tree_t top)
    global_tmp_stack = mmap_guarded(GLOBAL_TMP_STACK_SZ, "global temp stack");
    proc_tmp_stack   = mmap_guarded(PROC_TMP_STACK_SZ, "process temp stack");
 
-   global_tmp_alloc = 0;
+   global_tmp_alloc  = 0;
+   global_tmp_commit = 0;
+   proc_tmp_commit   = 0;
+
+#if RT_MULTITHREAD
+   if (n_threads > 1)
+      rt_start_workers();
+#endif
 
    rt_reset_coverage(top);
 
@@ -2505,12 +5939,26 @@ void rt_start_of_tool(tree_t top)
 
 void rt_end_of_tool(tree_t top)
 {
+#if RT_MULTITHREAD
+   rt_stop_workers();
+#endif
+   rt_async_stop();
+
+   const char *profile_file = opt_get_str("rt-profile-file");
+   if (profiling && profile_file != NULL)
+      rt_profile_write(profile_file);
+
+   const char *feedback_file = opt_get_str("rt-profile-out");
+   if (feedback_file != NULL)
+      rt_profile_feedback(feedback_file);
+
+   rt_stats_pools();
    rt_cleanup(top);
    rt_emit_coverage(top);
 
    jit_shutdown();
 
-   if (opt_get_int("rt-stats") || profiling)
+   if (opt_get_int("rt-stats") || opt_get_int("rt_profile"))
       rt_stats_print();
 }
 
@@ -2519,9 +5967,37 @@ void rt_run_sim(uint64_t stop_time)
    const int stop_delta = opt_get_int("stop-delta");
 
    rt_global_event(RT_START_OF_SIMULATION);
-   while (!rt_stop_now(stop_time))
+   while (!rt_stop_now(stop_time)) {
+      if (unlikely(checkpoint_file != NULL) && rt_stop_now(checkpoint_time)) {
+         rt_checkpoint(checkpoint_file);
+         free(checkpoint_file);
+         checkpoint_file = NULL;
+      }
+
+      if (unlikely(wave_state == WAVE_ACTIVE && wave_stop < UINT64_MAX)
+          && rt_stop_now(wave_stop))
+         rt_wave_stop();
+
       rt_cycle(stop_delta);
+   }
    rt_global_event(RT_END_OF_SIMULATION);
+
+   if (checkpoint_file != NULL && !force_stop)
+      warnf("simulation finished before checkpoint time %s",
+            fmt_time(checkpoint_time));
+}
+
+void rt_set_checkpoint(uint64_t when, const char *file)
+{
+   free(checkpoint_file);
+   checkpoint_file = xstrdup(file);
+   checkpoint_time = when;
+}
+
+void rt_set_wave_window(uint64_t start, uint64_t stop)
+{
+   wave_start = start;
+   wave_stop  = stop;
 }
 
 static void rt_interactive_fatal(void)
@@ -2534,14 +6010,20 @@ void rt_run_interactive(uint64_t stop_time)
 {
    if (aborted)
       errorf("simulation has aborted and must be restarted");
-   else if ((heap_size(eventq_heap) == 0) && (delta_proc == NULL))
+   else if ((eventq_size() == 0) && (delta_proc == NULL))
       warnf("no future simulation events");
    else {
       set_fatal_fn(rt_interactive_fatal);
 
+      // Errors are recovered with longjmp which must happen on the
+      // main thread so processes are never run in parallel here
+      const int save_threads = n_threads;
+      n_threads = 1;
+
       if (setjmp(fatal_jmp) == 0)
          rt_run_sim(stop_time);
 
+      n_threads = save_threads;
       set_fatal_fn(NULL);
    }
 }
@@ -2553,6 +6035,12 @@ void rt_restart(tree_t top)
    aborted = false;
 }
 
+void rt_restart_from(tree_t top, const char *checkpoint)
+{
+   rt_restart(top);
+   rt_restore(checkpoint);
+}
+
 void rt_set_timeout_cb(uint64_t when, timeout_fn_t fn, void *user)
 {
    event_t *e = rt_alloc(event_stack);
@@ -2596,6 +6084,8 @@ watch_t *rt_set_event_cb(tree_t s, sig_event_fn_t fn, void *user,
       w->user_data     = user;
       w->length        = 0;
       w->postponed     = postponed;
+      w->async         = false;
+      w->wave          = false;
 
       type_t type = tree_type(s);
       if (type_is_array(type))
@@ -2610,6 +6100,19 @@ watch_t *rt_set_event_cb(tree_t s, sig_event_fn_t fn, void *user,
    }
 }
 
+void rt_watch_async(watch_t *w)
+{
+   // Only waveform writers mark their watches as asynchronous and these
+   // are also removed at the end of the --wave-stop window
+   w->wave = true;
+
+#if RT_MULTITHREAD
+   if (async_ring == NULL)
+      rt_async_start();
+   w->async = true;
+#endif
+}
+
 void rt_set_global_cb(rt_event_t event, rt_event_fn_t fn, void *user)
 {
    RT_ASSERT(event < RT_LAST_EVENT);
@@ -2624,12 +6127,20 @@ void rt_set_global_cb(rt_event_t event, rt_event_fn_t fn, void *user)
 
 size_t rt_watch_value(watch_t *w, uint64_t *buf, size_t max, bool last)
 {
+   const uint8_t *snap = rt_async_snapshot();
+   RT_ASSERT(snap == NULL || !last);
+
    int offset = 0;
    for (int i = 0; (i < w->n_groups) && (offset < max); i++) {
       netgroup_t *g = w->groups[i];
+      const void *src = last ? rt_group_cold(g)->last_value : g->resolved;
+      if (snap != NULL) {
+         src = snap;
+         snap += g->size * g->length;
+      }
 
 #define SIGNAL_VALUE_EXPAND_U64(type) do {                              \
-         const type *sp = (type *)(last ? g->last_value : g->resolved); \
+         const type *sp = (const type *)src;                            \
          for (int j = 0; (j < g->length) && (offset + j < max); j++)    \
             buf[offset + j] = sp[j];                                    \
       } while (0)
@@ -2642,11 +6153,56 @@ size_t rt_watch_value(watch_t *w, uint64_t *buf, size_t max, bool last)
    return offset;
 }
 
-static size_t rt_group_string(netgroup_t *group, const char *map,
-                              char *buf, const char *end1)
+void rt_watch_changed(watch_t *w, size_t *first, size_t *count)
+{
+#if RT_MULTITHREAD
+   const async_rec_t *rec = async_rec;
+   if (rec != NULL && rec->watch == w) {
+      *first = rec->changed_first;
+      *count = rec->changed_last - rec->changed_first + 1;
+      return;
+   }
+#endif
+
+   *first = w->changed_first;
+   *count = w->changed_last - w->changed_first + 1;
+}
+
+size_t rt_watch_range(watch_t *w, uint64_t *buf, size_t first, size_t count)
+{
+   const uint8_t *snap = rt_async_snapshot();
+   const size_t end = MIN(first + count, w->length);
+
+   size_t offset = 0, copied = 0;
+   for (int i = 0; (i < w->n_groups) && (offset < end); i++) {
+      netgroup_t *g = w->groups[i];
+      const uint8_t *src = snap ? snap : g->resolved;
+      if (snap != NULL)
+         snap += g->size * g->length;
+
+      if (offset + g->length > first) {
+         const size_t from = (offset < first) ? first - offset : 0;
+         const size_t to = MIN(g->length, end - offset);
+
+#define SIGNAL_RANGE_EXPAND_U64(type) do {                              \
+            const type *sp = (const type *)src;                         \
+            for (size_t j = from; j < to; j++)                          \
+               buf[copied++] = sp[j];                                   \
+         } while (0)
+
+         FOR_ALL_SIZES(g->size, SIGNAL_RANGE_EXPAND_U64);
+      }
+
+      offset += g->length;
+   }
+
+   return copied;
+}
+
+static size_t rt_group_string(netgroup_t *group, const char *vals,
+                              const char *map, char *buf, const char *end1)
 {
    char *bp = buf;
-   const char *vals = group->resolved;
 
    if (likely(map != NULL)) {
       for (int j = 0; j < group->length; j++) {
@@ -2669,12 +6225,17 @@ static size_t rt_group_string(netgroup_t *group, const char *map,
 
 size_t rt_watch_string(watch_t *w, const char *map, char *buf, size_t max)
 {
+   const uint8_t *snap = rt_async_snapshot();
+
    char *bp = buf;
    size_t offset = 0;
    for (int i = 0; i < w->n_groups; i++) {
       netgroup_t *g = w->groups[i];
-      bp += rt_group_string(g, map, bp, buf + max);
+      const char *vals = snap ? (const char *)snap : g->resolved;
+      bp += rt_group_string(g, vals, map, bp, buf + max);
       offset += g->length;
+      if (snap != NULL)
+         snap += g->size * g->length;
    }
 
    return offset + 1;
@@ -2688,7 +6249,7 @@ size_t rt_signal_string(tree_t s, const char *map, char *buf, size_t max)
    while (offset < nnets) {
       netid_t nid = tree_net(s, offset);
       netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
-      bp += rt_group_string(g, map, bp, buf + max);
+      bp += rt_group_string(g, g->resolved, map, bp, buf + max);
       offset += g->length;
    }
 
@@ -2717,6 +6278,34 @@ size_t rt_signal_value(tree_t s, uint64_t *buf, size_t max)
    return offset;
 }
 
+const void *rt_signal_map(tree_t s, size_t *size, size_t *count)
+{
+   // The resolved values of all groups in a signal are allocated in
+   // one block so can be read in place when every element is the
+   // same size
+   const int nnets = tree_nets(s);
+   if (nnets == 0)
+      return NULL;
+
+   netgroup_t *first = &(groups[netdb_lookup(netdb, tree_net(s, 0))]);
+   if (first->first != tree_net(s, 0))
+      return NULL;
+
+   int offset = first->length;
+   while (offset < nnets) {
+      netid_t nid = tree_net(s, offset);
+      netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
+      if (g->size != first->size)
+         return NULL;
+
+      offset += g->length;
+   }
+
+   *size  = first->size;
+   *count = nnets;
+   return first->resolved;
+}
+
 bool rt_force_signal(tree_t s, const uint64_t *buf, size_t count,
                      bool propagate)
 {
@@ -2730,14 +6319,15 @@ bool rt_force_signal(tree_t s, const uint64_t *buf, size_t count,
    while (offset < nnets) {
       netid_t nid = tree_net(s, offset);
       netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
+      netgroup_cold_t *gc = rt_group_cold(g);
 
       g->flags |= NET_F_FORCED;
 
-      if (g->forcing == NULL)
-         g->forcing = rt_alloc_value(g);
+      if (gc->forcing == NULL)
+         gc->forcing = rt_alloc_value(g);
 
 #define SIGNAL_FORCE_EXPAND_U64(type) do {                              \
-         type *dp = (type *)g->forcing->data;                           \
+         type *dp = (type *)gc->forcing->data;                          \
          for (int i = 0; (i < g->length) && (offset + i < count); i++)  \
             dp[i] = buf[offset + i];                                    \
       } while (0)
@@ -2745,7 +6335,7 @@ bool rt_force_signal(tree_t s, const uint64_t *buf, size_t count,
       FOR_ALL_SIZES(g->size, SIGNAL_FORCE_EXPAND_U64);
 
       if (propagate)
-         deltaq_insert_driver(0, g, NULL);
+         deltaq_insert_driver(0, g, NULL, -1);
 
       offset += g->length;
    }
@@ -2760,6 +6350,15 @@ bool rt_can_create_delta(void)
 
 uint64_t rt_now(unsigned *deltas)
 {
+#if RT_MULTITHREAD
+   if (async_rec != NULL) {
+      // Called from a callback on the waveform writer thread
+      if (deltas != NULL)
+         *deltas = 0;
+      return async_rec->when;
+   }
+#endif
+
    if (deltas != NULL)
       *deltas = MAX(iteration, 0);
    return now;
@@ -25,13 +25,25 @@
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <zlib.h>
+
+#if RT_MULTITHREAD
+#include <pthread.h>
+#endif
+
+// Value changes are formatted directly into a large buffer which is
+// written out when full. If the file name ends in .gz the output is
+// compressed on a separate thread while the next buffer is filled.
+
+#define VCD_BUF_SZ (1024 * 1024)
 
 typedef struct vcd_data vcd_data_t;
 
 typedef void (*vcd_fmt_fn_t)(tree_t, watch_t *, vcd_data_t *);
 
 struct vcd_data {
-   char          key[64];
+   char          key[8];
+   size_t        key_len;
    vcd_fmt_fn_t  fmt;
    range_kind_t  dir;
    const char   *map;
@@ -39,37 +51,178 @@ struct vcd_data {
    watch_t      *watch;
 };
 
-static FILE    *vcd_file;
-static tree_t   vcd_top;
-static ident_t  vcd_data_i;
-static uint64_t last_time;
+typedef struct {
+   char   *data;
+   size_t  used;
+   size_t  size;
+} vcd_buf_t;
+
+static char      *vcd_fname = NULL;
+static FILE      *vcd_file = NULL;
+static gzFile     vcd_gz = NULL;
+static tree_t     vcd_top;
+static ident_t    vcd_data_i;
+static uint64_t   last_time;
+static vcd_buf_t  vcd_bufs[2];
+static vcd_buf_t *vcd_buf = NULL;
+
+#if RT_MULTITHREAD
+static pthread_t        vcd_thread;
+static bool             vcd_thread_running = false;
+static bool             vcd_stop = false;
+static vcd_buf_t       *vcd_full = NULL;
+static pthread_mutex_t  vcd_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   vcd_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+static void vcd_write_out(const vcd_buf_t *b)
+{
+   if (b->used == 0)
+      return;
+   else if (vcd_gz != NULL) {
+      if (gzwrite(vcd_gz, b->data, b->used) != (int)b->used) {
+         int errnum;
+         fatal("failed to write VCD output %s: %s", vcd_fname,
+               gzerror(vcd_gz, &errnum));
+      }
+   }
+   else if (fwrite(b->data, b->used, 1, vcd_file) != 1)
+      fatal_errno("failed to write VCD output %s", vcd_fname);
+}
+
+#if RT_MULTITHREAD
+static void *vcd_writer_thread(void *arg)
+{
+   pthread_mutex_lock(&vcd_lock);
+
+   for (;;) {
+      while (vcd_full == NULL && !vcd_stop)
+         pthread_cond_wait(&vcd_cond, &vcd_lock);
+
+      if (vcd_full == NULL)
+         break;
+
+      vcd_buf_t *b = vcd_full;
+      pthread_mutex_unlock(&vcd_lock);
+
+      vcd_write_out(b);
+
+      pthread_mutex_lock(&vcd_lock);
+      vcd_full = NULL;
+      pthread_cond_broadcast(&vcd_cond);
+   }
+
+   pthread_mutex_unlock(&vcd_lock);
+   return NULL;
+}
+#endif
+
+static void vcd_flush(void)
+{
+#if RT_MULTITHREAD
+   if (vcd_thread_running) {
+      // Hand the full buffer to the writer thread and carry on with the
+      // other one once the previous write has finished
+      pthread_mutex_lock(&vcd_lock);
+      while (vcd_full != NULL)
+         pthread_cond_wait(&vcd_cond, &vcd_lock);
+      vcd_full = vcd_buf;
+      pthread_cond_broadcast(&vcd_cond);
+      pthread_mutex_unlock(&vcd_lock);
+
+      vcd_buf = (vcd_buf == &(vcd_bufs[0])) ? &(vcd_bufs[1]) : &(vcd_bufs[0]);
+      vcd_buf->used = 0;
+      return;
+   }
+#endif
+
+   vcd_write_out(vcd_buf);
+   vcd_buf->used = 0;
+}
+
+static inline char *vcd_reserve(size_t len)
+{
+   if (unlikely(vcd_buf->used + len > vcd_buf->size)) {
+      vcd_flush();
+
+      if (len > vcd_buf->size) {
+         vcd_buf->size = MAX(len, vcd_buf->size * 2);
+         vcd_buf->data = xrealloc(vcd_buf->data, vcd_buf->size);
+      }
+   }
+
+   return vcd_buf->data + vcd_buf->used;
+}
+
+static void vcd_puts(const char *str)
+{
+   const size_t len = strlen(str);
+   memcpy(vcd_reserve(len), str, len);
+   vcd_buf->used += len;
+}
+
+static char *vcd_fmt_u64(char *p, uint64_t value)
+{
+   char tmp[20];
+   int n = 0;
+   do {
+      tmp[n++] = '0' + (value % 10);
+      value /= 10;
+   } while (value > 0);
+
+   while (n > 0)
+      *p++ = tmp[--n];
+
+   return p;
+}
+
+static inline void vcd_end_change(char *p, vcd_data_t *data)
+{
+   *p++ = ' ';
+   memcpy(p, data->key, data->key_len);
+   p += data->key_len;
+   *p++ = '\n';
+
+   vcd_buf->used = p - vcd_buf->data;
+}
 
 static void vcd_fmt_int(tree_t decl, watch_t *w, vcd_data_t *data)
 {
    uint64_t val;
    rt_watch_value(w, &val, 1, false);
 
-   char buf[data->size + 1];
+   char *p = vcd_reserve(data->size + data->key_len + 3);
+   *p++ = 'b';
    for (size_t i = 0; i < data->size; i++)
-      buf[data->size - 1 - i] = (val & (1 << i)) ? '1' : '0';
-   buf[data->size] = '\0';
+      p[data->size - 1 - i] = '0' + ((val >> i) & 1);
+   p += data->size;
 
-   fprintf(vcd_file, "b%s %s\n", buf, data->key);
+   vcd_end_change(p, data);
 }
 
 static void vcd_fmt_chars(tree_t decl, watch_t *w, vcd_data_t *data)
 {
+   // The string is written in place including the terminating NUL
+   // which is then overwritten by the separator
    const int nvals = data->size;
-   char buf[nvals + 1];
-   rt_watch_string(w, data->map, buf, nvals + 1);
+   char *p = vcd_reserve(nvals + data->key_len + 3);
+   *p++ = 'b';
+   rt_watch_string(w, data->map, p, nvals + 1);
+   p += nvals;
 
-   fprintf(vcd_file, "b%s %s\n", buf, data->key);
+   vcd_end_change(p, data);
 }
 
 static void vcd_event_cb(uint64_t now, tree_t decl, watch_t *w, void *user)
 {
    if (now != last_time) {
-      fprintf(vcd_file, "#%"PRIu64"\n", now);
+      // One timestamp line for all the changes in a time step
+      char *p = vcd_reserve(22);
+      *p++ = '#';
+      p = vcd_fmt_u64(p, now);
+      *p++ = '\n';
+      vcd_buf->used = p - vcd_buf->data;
+
       last_time = now;
    }
 
@@ -78,7 +231,7 @@ static void vcd_event_cb(uint64_t now, tree_t decl, watch_t *w, void *user)
       (*data->fmt)(decl, w, data);
 }
 
-static void vcd_key_fmt(int key, char *buf)
+static size_t vcd_key_fmt(int key, char *buf)
 {
    char *p = buf;
    do {
@@ -86,20 +239,92 @@ static void vcd_key_fmt(int key, char *buf)
       key /= (126 - 33);
    } while (key > 0);
    *p = '\0';
+
+   return p - buf;
+}
+
+static void vcd_close(void)
+{
+   if (vcd_buf == NULL)
+      return;
+
+   vcd_flush();
+
+#if RT_MULTITHREAD
+   if (vcd_thread_running) {
+      pthread_mutex_lock(&vcd_lock);
+      vcd_stop = true;
+      pthread_cond_broadcast(&vcd_cond);
+      pthread_mutex_unlock(&vcd_lock);
+
+      if (pthread_join(vcd_thread, NULL))
+         fatal_errno("pthread_join");
+
+      vcd_thread_running = false;
+      vcd_stop = false;
+   }
+#endif
+
+   if (vcd_gz != NULL) {
+      if (gzclose(vcd_gz) != Z_OK)
+         fatal("failed to close VCD output %s", vcd_fname);
+      vcd_gz = NULL;
+   }
+   else if (vcd_file != NULL) {
+      if (fclose(vcd_file) != 0)
+         fatal_errno("failed to close VCD output %s", vcd_fname);
+      vcd_file = NULL;
+   }
+
+   for (int i = 0; i < 2; i++) {
+      free(vcd_bufs[i].data);
+      vcd_bufs[i].data = NULL;
+   }
+   vcd_buf = NULL;
+}
+
+static void vcd_open(void)
+{
+   // The file is truncated when the header is written again
+   vcd_close();
+
+   for (int i = 0; i < 2; i++) {
+      vcd_bufs[i].data = xmalloc(VCD_BUF_SZ);
+      vcd_bufs[i].size = VCD_BUF_SZ;
+      vcd_bufs[i].used = 0;
+   }
+   vcd_buf = &(vcd_bufs[0]);
+
+   const size_t len = strlen(vcd_fname);
+   if (len > 3 && strcmp(vcd_fname + len - 3, ".gz") == 0) {
+      if ((vcd_gz = gzopen(vcd_fname, "wb")) == NULL)
+         fatal_errno("failed to open VCD output %s", vcd_fname);
+
+#if RT_MULTITHREAD
+      if (pthread_create(&vcd_thread, NULL, vcd_writer_thread, NULL))
+         fatal_errno("pthread_create");
+      vcd_thread_running = true;
+#endif
+   }
+   else if ((vcd_file = fopen(vcd_fname, "w")) == NULL)
+      fatal_errno("failed to open VCD output %s", vcd_fname);
 }
 
 static void vcd_emit_header(void)
 {
-   rewind(vcd_file);
+   vcd_open();
 
    char tmbuf[64];
    time_t t = time(NULL);
    struct tm *tm = localtime(&t);
    strftime(tmbuf, sizeof(tmbuf), "%a, %d %b %Y %T %z", tm);
-   fprintf(vcd_file, "$date\n  %s\n$end\n", tmbuf);
 
-   fprintf(vcd_file, "$version\n  "PACKAGE_STRING"\n$end\n");
-   fprintf(vcd_file, "$timescale\n  1 fs\n$end\n");
+   vcd_puts("$date\n  ");
+   vcd_puts(tmbuf);
+   vcd_puts("\n$end\n");
+
+   vcd_puts("$version\n  "PACKAGE_STRING"\n$end\n");
+   vcd_puts("$timescale\n  1 fs\n$end\n");
 }
 
 static bool vcd_can_fmt_chars(type_t type, vcd_data_t *data)
@@ -194,18 +419,27 @@ static void vcd_process_signal(tree_t d, int *next_key)
    tree_add_attr_ptr(d, vcd_data_i, data);
 
    data->watch = rt_set_event_cb(d, vcd_event_cb, data, true);
+   rt_watch_async(data->watch);
+
+   data->key_len = vcd_key_fmt(*next_key, data->key);
 
-   vcd_key_fmt(*next_key, data->key);
+   char *p = vcd_reserve(32);
+   memcpy(p, "$var reg ", 9);
+   p = vcd_fmt_u64(p + 9, data->size);
+   *p++ = ' ';
+   vcd_buf->used = p - vcd_buf->data;
 
-   fprintf(vcd_file, "$var reg %d %s %s $end\n",
-           (int)data->size, data->key, name);
+   vcd_puts(data->key);
+   vcd_puts(" ");
+   vcd_puts(name);
+   vcd_puts(" $end\n");
 
    ++(*next_key);
 }
 
 void vcd_restart(void)
 {
-   if (vcd_file == NULL)
+   if (vcd_fname == NULL)
       return;
 
    vcd_emit_header();
@@ -216,7 +450,9 @@ void vcd_restart(void)
       tree_t d = tree_decl(vcd_top, i);
       switch (tree_kind(d)) {
       case T_HIER:
-         fprintf(vcd_file, "$scope module %s $end\n", istr(tree_ident(d)));
+         vcd_puts("$scope module ");
+         vcd_puts(istr(tree_ident(d)));
+         vcd_puts(" $end\n");
          break;
       case T_SIGNAL_DECL:
          if (wave_should_dump(d))
@@ -228,12 +464,11 @@ void vcd_restart(void)
 
       int npop = tree_attr_int(d, ident_new("scope_pop"), 0);
       while (npop-- > 0)
-         fprintf(vcd_file, "$upscope $end\n");
+         vcd_puts("$upscope $end\n");
    }
 
-   fprintf(vcd_file, "$enddefinitions $end\n");
-
-   fprintf(vcd_file, "$dumpvars\n");
+   vcd_puts("$enddefinitions $end\n");
+   vcd_puts("$dumpvars\n");
 
    last_time = UINT64_MAX;
 
@@ -242,11 +477,11 @@ void vcd_restart(void)
       if (tree_kind(d) == T_SIGNAL_DECL) {
          vcd_data_t *data = tree_attr_ptr(d, vcd_data_i);
          if (likely(data != NULL))
-            vcd_event_cb(0, d, data->watch, data);
+            vcd_event_cb(rt_now(NULL), d, data->watch, data);
       }
    }
 
-   fprintf(vcd_file, "$end\n");
+   vcd_puts("$end\n");
 }
 
 void vcd_init(const char *filename, tree_t top)
@@ -260,7 +495,9 @@ void vcd_init(const char *filename, tree_t top)
          "designs. If you are using GtkWave the --wave option will generate "
          "an FST file that overcomes these limitations.");
 
-   vcd_file = fopen(filename, "w");
-   if (vcd_file == NULL)
-      fatal_errno("failed to open VCD output %s", filename);
+   // Opened when the header is written at the start of the dump
+   vcd_fname = xstrdup(filename);
+   vcd_open();
+
+   atexit(vcd_close);
 }
@@ -19,13 +19,45 @@
 #include "util.h"
 #include "tree.h"
 
+#include "hash.h"
+
 #include <string.h>
+#include <stdlib.h>
 
 typedef struct {
    char  *text;
    size_t len;
 } glob_t;
 
+// All the include and exclude globs are compiled into a trie where
+// each node is the position after matching a prefix of one or more
+// globs. A set of trie nodes is a state of the equivalent automaton and
+// the deterministic states are built lazily as signal names are
+// scanned. The state reached at the end of each scope name is cached so
+// only the characters after the final colon are scanned for each signal
+// and a scope where the result cannot change is decided without looking
+// at its signals at all.
+
+#define MATCH_INCL 0x01
+#define MATCH_EXCL 0x02
+
+typedef struct {
+   int     first;
+   int     next;
+   char    value;
+   bool    star;
+   uint8_t accept;
+   uint8_t reach;
+} match_node_t;
+
+typedef struct {
+   int     *nodes;
+   int      n_nodes;
+   int8_t   decided;
+   uint8_t  accept;
+   int      next[256];
+} match_state_t;
+
 static int     n_incl = 0;
 static int     incl_sz = 0;
 static int     n_excl = 0;
@@ -33,6 +65,38 @@ static int     excl_sz = 0;
 static glob_t *incl;
 static glob_t *excl;
 
+static match_node_t  *match_nodes = NULL;
+static int            n_match_nodes = 0;
+static match_state_t *match_states = NULL;
+static int            n_match_states = 0;
+static int            match_states_sz = 0;
+static int           *match_table = NULL;
+static int            match_table_sz = 0;
+static hash_t        *match_scopes = NULL;
+static int            max_depth = -1;
+
+static void wave_match_reset(void)
+{
+   for (int i = 0; i < n_match_states; i++)
+      free(match_states[i].nodes);
+
+   free(match_states);
+   free(match_nodes);
+   free(match_table);
+
+   if (match_scopes != NULL)
+      hash_free(match_scopes);
+
+   match_nodes     = NULL;
+   match_states    = NULL;
+   match_table     = NULL;
+   match_scopes    = NULL;
+   n_match_nodes   = 0;
+   n_match_states  = 0;
+   match_states_sz = 0;
+   match_table_sz  = 0;
+}
+
 void wave_include_glob(const char *glob)
 {
    if (n_incl == incl_sz) {
@@ -44,6 +108,8 @@ void wave_include_glob(const char *glob)
    incl[n_incl].len  = strlen(glob);
 
    n_incl++;
+
+   wave_match_reset();
 }
 
 void wave_exclude_glob(const char *glob)
@@ -57,6 +123,8 @@ void wave_exclude_glob(const char *glob)
    excl[n_excl].len  = strlen(glob);
 
    n_excl++;
+
+   wave_match_reset();
 }
 
 static void wave_process_file(const char *fname, bool include)
@@ -102,19 +170,295 @@ void wave_include_file(const char *base)
    wave_process_file(buf, false);
 }
 
+static int wave_match_child(int parent, char value, bool star)
+{
+   int *link = &(match_nodes[parent].first);
+   for (; *link != -1; link = &(match_nodes[*link].next)) {
+      const match_node_t *n = &(match_nodes[*link]);
+      if (n->star == star && (star || n->value == value))
+         return *link;
+   }
+
+   const int index = n_match_nodes++;
+   match_nodes[index].first  = -1;
+   match_nodes[index].next   = -1;
+   match_nodes[index].value  = value;
+   match_nodes[index].star   = star;
+   match_nodes[index].accept = 0;
+   match_nodes[index].reach  = 0;
+
+   return (*link = index);
+}
+
+static void wave_match_add(const glob_t *glob, uint8_t flag)
+{
+   int node = 0;
+   for (size_t i = 0; i < glob->len; i++)
+      node = wave_match_child(node, glob->text[i], glob->text[i] == '*');
+
+   match_nodes[node].accept |= flag;
+}
+
+static uint8_t wave_match_reach(int node)
+{
+   match_node_t *n = &(match_nodes[node]);
+   n->reach = n->accept;
+
+   for (int c = n->first; c != -1; c = match_nodes[c].next)
+      n->reach |= wave_match_reach(c);
+
+   return n->reach;
+}
+
+static uint32_t wave_match_hash(const int *nodes, int n_nodes)
+{
+   uint32_t h = 2166136261u;
+   for (int i = 0; i < n_nodes; i++)
+      h = (h ^ nodes[i]) * 16777619u;
+   return h;
+}
+
+static int8_t wave_match_decide(const match_state_t *s)
+{
+   // The result for every non-empty extension of a name reaching this
+   // state is fixed if some pattern ends in a star here or no pattern
+   // can match at all
+
+   uint8_t reach = 0, star = 0;
+   for (int i = 0; i < s->n_nodes; i++) {
+      const match_node_t *n = &(match_nodes[s->nodes[i]]);
+      reach |= n->reach;
+      if (n->star)
+         star |= n->accept;
+   }
+
+   if (star & MATCH_EXCL)
+      return 0;
+   else if (reach & MATCH_EXCL)
+      return -1;
+   else if (star & MATCH_INCL)
+      return 1;
+   else if (reach & MATCH_INCL)
+      return -1;
+   else
+      return (n_incl == 0);
+}
+
+static int wave_match_state(int *nodes, int n_nodes)
+{
+   const uint32_t hash = wave_match_hash(nodes, n_nodes);
+
+   int slot = hash & (match_table_sz - 1);
+   for (; match_table[slot] != 0; slot = (slot + 1) & (match_table_sz - 1)) {
+      const match_state_t *s = &(match_states[match_table[slot] - 1]);
+      if (s->n_nodes == n_nodes
+          && memcmp(s->nodes, nodes, n_nodes * sizeof(int)) == 0) {
+         free(nodes);
+         return match_table[slot] - 1;
+      }
+   }
+
+   if (n_match_states == match_states_sz) {
+      match_states_sz = MAX(match_states_sz * 2, 64);
+      match_states = xrealloc(match_states,
+                              match_states_sz * sizeof(match_state_t));
+   }
+
+   const int index = n_match_states++;
+   match_state_t *s = &(match_states[index]);
+   s->nodes   = nodes;
+   s->n_nodes = n_nodes;
+   s->accept  = 0;
+
+   for (int i = 0; i < n_nodes; i++)
+      s->accept |= match_nodes[nodes[i]].accept;
+
+   for (int i = 0; i < 256; i++)
+      s->next[i] = -1;
+
+   s->decided = wave_match_decide(s);
+
+   match_table[slot] = index + 1;
+
+   if (n_match_states * 2 > match_table_sz) {
+      const int old_sz = match_table_sz;
+      int *old = match_table;
+
+      match_table_sz *= 2;
+      match_table = xcalloc(match_table_sz * sizeof(int));
+
+      for (int i = 0; i < old_sz; i++) {
+         if (old[i] == 0)
+            continue;
+
+         const match_state_t *r = &(match_states[old[i] - 1]);
+         int j = wave_match_hash(r->nodes, r->n_nodes) & (match_table_sz - 1);
+         while (match_table[j] != 0)
+            j = (j + 1) & (match_table_sz - 1);
+         match_table[j] = old[i];
+      }
+
+      free(old);
+   }
+
+   return index;
+}
+
+static int wave_match_step(int state, char ch)
+{
+   const int cached = match_states[state].next[(unsigned char)ch];
+   if (cached != -1)
+      return cached;
+
+   // A star consumes at least one character and then any number more
+   bool seen[n_match_nodes];
+   memset(seen, '\0', sizeof(seen));
+
+   int n_nodes = 0;
+   const match_state_t *s = &(match_states[state]);
+   for (int i = 0; i < s->n_nodes; i++) {
+      const match_node_t *n = &(match_nodes[s->nodes[i]]);
+      if (n->star && !seen[s->nodes[i]]) {
+         seen[s->nodes[i]] = true;
+         n_nodes++;
+      }
+
+      for (int c = n->first; c != -1; c = match_nodes[c].next) {
+         const match_node_t *cn = &(match_nodes[c]);
+         if ((cn->star || cn->value == ch) && !seen[c]) {
+            seen[c] = true;
+            n_nodes++;
+         }
+      }
+   }
+
+   // Nodes are kept in index order so equal sets compare equal
+   int *nodes = xmalloc(MAX(n_nodes, 1) * sizeof(int));
+   for (int i = 0, j = 0; j < n_nodes; i++) {
+      if (seen[i])
+         nodes[j++] = i;
+   }
+
+   const int next = wave_match_state(nodes, n_nodes);
+   match_states[state].next[(unsigned char)ch] = next;
+   return next;
+}
+
+static void wave_match_compile(void)
+{
+   int total = 1;
+   for (int i = 0; i < n_incl; i++)
+      total += incl[i].len;
+   for (int i = 0; i < n_excl; i++)
+      total += excl[i].len;
+
+   match_nodes = xmalloc(total * sizeof(match_node_t));
+
+   n_match_nodes = 1;
+   match_nodes[0].first  = -1;
+   match_nodes[0].next   = -1;
+   match_nodes[0].value  = '\0';
+   match_nodes[0].star   = false;
+   match_nodes[0].accept = 0;
+
+   for (int i = 0; i < n_incl; i++)
+      wave_match_add(&(incl[i]), MATCH_INCL);
+   for (int i = 0; i < n_excl; i++)
+      wave_match_add(&(excl[i]), MATCH_EXCL);
+
+   wave_match_reach(0);
+
+   match_table_sz = 256;
+   match_table = xcalloc(match_table_sz * sizeof(int));
+
+   int *start = xmalloc(sizeof(int));
+   start[0] = 0;
+   wave_match_state(start, 1);
+
+   match_scopes = hash_new(1024, true);
+}
+
+static int wave_match_scan(int state, const char *str)
+{
+   for (; *str != '\0' && match_states[state].decided == -1; str++)
+      state = wave_match_step(state, *str);
+
+   return state;
+}
+
+static int wave_match_scope(ident_t scope)
+{
+   void *cached = hash_get(match_scopes, scope);
+   if (cached != NULL)
+      return (intptr_t)cached - 1;
+
+   ident_t parent = ident_runtil(scope, ':');
+
+   int state = 0, skip = 0;
+   if (parent != scope) {
+      state = wave_match_scope(parent);
+      skip  = ident_len(parent);
+   }
+
+   state = wave_match_scan(state, istr(scope) + skip);
+
+   hash_put(match_scopes, scope, (void *)(intptr_t)(state + 1));
+   return state;
+}
+
+void wave_set_depth(int depth)
+{
+   max_depth = depth;
+}
+
+static bool wave_within_depth(ident_t name)
+{
+   // Names of signals in the top-level unit contain two colons
+   int depth = -2;
+   for (const char *p = istr(name); *p != '\0'; p++) {
+      if (*p == ':' && ++depth > max_depth)
+         return false;
+   }
+
+   return true;
+}
+
 bool wave_should_dump(tree_t decl)
 {
    ident_t name = tree_ident(decl);
 
-   for (int i = 0; i < n_excl; i++) {
-      if (ident_glob(name, excl[i].text, excl[i].len))
-         return false;
+   if (max_depth >= 0 && !wave_within_depth(name))
+      return false;
+   else if (n_incl == 0 && n_excl == 0)
+      return true;
+
+   if (match_nodes == NULL)
+      wave_match_compile();
+
+   ident_t scope = ident_runtil(name, ':');
+
+   int state = 0, skip = 0;
+   if (scope != name) {
+      state = wave_match_scope(scope);
+      skip  = ident_len(scope);
+
+      // The remainder of the name always includes the colon
+      if (match_states[state].decided != -1)
+         return match_states[state].decided;
    }
 
-   for (int i = 0; i < n_incl; i++) {
-      if (ident_glob(name, incl[i].text, incl[i].len))
-         return true;
+   const char *str = istr(name) + skip;
+   for (; *str != '\0'; str++) {
+      if (match_states[state].decided != -1)
+         return match_states[state].decided;
+      state = wave_match_step(state, *str);
    }
 
-   return (n_incl == 0);
+   const uint8_t accept = match_states[state].accept;
+   if (accept & MATCH_EXCL)
+      return false;
+   else if (accept & MATCH_INCL)
+      return true;
+   else
+      return (n_incl == 0);
 }
@@ -0,0 +1,322 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "wheel.h"
+#include "heap.h"
+#include "alloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Hierarchical timing wheel with the same interface as the binary heap
+// in heap.c. Each level resolves eight bits of the key relative to the
+// current base: a key lives on the level containing the most significant
+// bit where it differs from the base. Finding the minimum only has to
+// scan the occupancy bitmap of the lowest non-empty level, and a slot on
+// a higher level is cascaded down at most once per level as the base
+// advances, so insert and extract-min are both O(1) amortised. Keys too
+// far in the future for the wheel, or earlier than the base, are kept in
+// an overflow heap.
+
+#define LEVEL_BITS  8
+#define LEVEL_SLOTS (1 << LEVEL_BITS)
+#define NLEVELS     6
+#define WHEEL_BITS  (LEVEL_BITS * NLEVELS)
+#define MAP_WORDS   (LEVEL_SLOTS / 64)
+
+typedef struct wheel_node wheel_node_t;
+
+struct wheel_node {
+   uint64_t      key;
+   void         *user;
+   wheel_node_t *next;
+};
+
+typedef struct {
+   wheel_node_t *head;
+   wheel_node_t *tail;
+} wheel_slot_t;
+
+typedef struct {
+   size_t       count;
+   uint64_t     map[MAP_WORDS];
+   wheel_slot_t slots[LEVEL_SLOTS];
+} wheel_level_t;
+
+struct wheel {
+   uint64_t          base;
+   size_t            size;
+   wheel_node_t     *min;
+   heap_t            overflow;
+   rt_alloc_stack_t  nodes;
+   wheel_level_t     levels[NLEVELS];
+};
+
+typedef struct {
+   wheel_walk_fn_t  fn;
+   void            *context;
+} walk_ctx_t;
+
+static void wheel_place(wheel_t w, wheel_node_t *n)
+{
+   const uint64_t diff = n->key ^ w->base;
+
+   if (unlikely((n->key < w->base) || (diff >> WHEEL_BITS) != 0)) {
+      heap_insert(w->overflow, n->key, n);
+      return;
+   }
+
+   const int level =
+      (diff < LEVEL_SLOTS) ? 0 : (63 - __builtin_clzll(diff)) / LEVEL_BITS;
+   const int slot = (n->key >> (level * LEVEL_BITS)) & (LEVEL_SLOTS - 1);
+
+   wheel_level_t *l = &(w->levels[level]);
+   wheel_slot_t *s = &(l->slots[slot]);
+
+   n->next = NULL;
+   if (s->head == NULL) {
+      s->head = s->tail = n;
+      l->map[slot / 64] |= UINT64_C(1) << (slot % 64);
+   }
+   else {
+      s->tail->next = n;
+      s->tail = n;
+   }
+
+   l->count++;
+}
+
+static int wheel_lowest_level(wheel_t w)
+{
+   int level = 0;
+   while (level < NLEVELS && w->levels[level].count == 0)
+      level++;
+   return level;
+}
+
+static int wheel_first_slot(const wheel_level_t *l)
+{
+   for (int i = 0; i < MAP_WORDS; i++) {
+      if (l->map[i] != 0)
+         return i * 64 + __builtin_ctzll(l->map[i]);
+   }
+
+   fatal_trace("wheel level has no occupied slots") LCOV_EXCL_LINE;
+}
+
+static wheel_node_t *wheel_take_slot(wheel_level_t *l, int slot)
+{
+   wheel_slot_t *s = &(l->slots[slot]);
+   wheel_node_t *list = s->head;
+
+   s->head = s->tail = NULL;
+   l->map[slot / 64] &= ~(UINT64_C(1) << (slot % 64));
+
+   return list;
+}
+
+static void wheel_cascade(wheel_t w, int level)
+{
+   // Advance the base to the start of the first occupied slot on this
+   // level and redistribute its contents onto the lower levels
+
+   wheel_level_t *l = &(w->levels[level]);
+   const int slot = wheel_first_slot(l);
+
+   const int shift = level * LEVEL_BITS;
+   const uint64_t mask = (UINT64_C(1) << (shift + LEVEL_BITS)) - 1;
+   w->base = (w->base & ~mask) | ((uint64_t)slot << shift);
+
+   wheel_node_t *it = wheel_take_slot(l, slot);
+   while (it != NULL) {
+      wheel_node_t *next = it->next;
+      l->count--;
+      wheel_place(w, it);
+      it = next;
+   }
+}
+
+static wheel_node_t *wheel_min_node(wheel_t w)
+{
+   if (w->min != NULL)
+      return w->min;
+
+   wheel_node_t *min = NULL;
+
+   const int level = wheel_lowest_level(w);
+   if (level < NLEVELS) {
+      const wheel_level_t *l = &(w->levels[level]);
+      min = l->slots[wheel_first_slot(l)].head;
+
+      // Only slots on level zero are guaranteed to hold a single key
+      if (level > 0) {
+         for (wheel_node_t *it = min->next; it != NULL; it = it->next) {
+            if (it->key < min->key)
+               min = it;
+         }
+      }
+   }
+
+   if (heap_size(w->overflow) > 0) {
+      wheel_node_t *h = heap_min(w->overflow);
+      if (min == NULL || h->key < min->key)
+         min = h;
+   }
+
+   return (w->min = min);
+}
+
+wheel_t wheel_new(void)
+{
+   struct wheel *w = xcalloc(sizeof(struct wheel));
+   w->overflow = heap_new(128);
+   w->nodes    = rt_alloc_stack_new(sizeof(wheel_node_t), "wheel");
+   return w;
+}
+
+static void wheel_free_walk(uint64_t key, void *user, void *context)
+{
+   rt_free(((wheel_t)context)->nodes, user);
+}
+
+void wheel_free(wheel_t w)
+{
+   for (int i = 0; i < NLEVELS; i++) {
+      wheel_level_t *l = &(w->levels[i]);
+      for (int j = 0; j < LEVEL_SLOTS; j++) {
+         for (wheel_node_t *it = l->slots[j].head, *next; it; it = next) {
+            next = it->next;
+            rt_free(w->nodes, it);
+         }
+      }
+   }
+
+   heap_walk(w->overflow, wheel_free_walk, w);
+
+   heap_free(w->overflow);
+   rt_alloc_stack_destroy(w->nodes);
+   free(w);
+}
+
+void *wheel_extract_min(wheel_t w)
+{
+   if (unlikely(w->size < 1))
+      fatal_trace("wheel underflow") LCOV_EXCL_LINE;
+
+   wheel_node_t *n = NULL;
+
+   int level = wheel_lowest_level(w);
+   if (level == NLEVELS) {
+      // Everything is in the overflow heap: move the base forward to
+      // the earliest key and pull in as many keys as the wheel covers
+      n = heap_extract_min(w->overflow);
+      w->base = n->key;
+
+      while (heap_size(w->overflow) > 0) {
+         wheel_node_t *next = heap_min(w->overflow);
+         if (((next->key ^ w->base) >> WHEEL_BITS) != 0)
+            break;
+
+         wheel_place(w, heap_extract_min(w->overflow));
+      }
+   }
+   else if (heap_size(w->overflow) > 0
+            && wheel_min_node(w) == heap_min(w->overflow))
+      n = heap_extract_min(w->overflow);
+   else {
+      while (level > 0) {
+         wheel_cascade(w, level);
+         level = wheel_lowest_level(w);
+      }
+
+      wheel_level_t *l = &(w->levels[0]);
+      const int slot = wheel_first_slot(l);
+      wheel_slot_t *s = &(l->slots[slot]);
+
+      n = s->head;
+      if ((s->head = n->next) == NULL) {
+         s->tail = NULL;
+         l->map[slot / 64] &= ~(UINT64_C(1) << (slot % 64));
+      }
+
+      l->count--;
+   }
+
+   w->size--;
+   w->min = NULL;
+
+   void *user = n->user;
+   rt_free(w->nodes, n);
+   return user;
+}
+
+void *wheel_min(wheel_t w)
+{
+   if (unlikely(w->size < 1))
+      fatal_trace("wheel underflow") LCOV_EXCL_LINE;
+
+   return wheel_min_node(w)->user;
+}
+
+void wheel_insert(wheel_t w, uint64_t key, void *user)
+{
+   wheel_node_t *n = rt_alloc(w->nodes);
+   n->key  = key;
+   n->user = user;
+   n->next = NULL;
+
+   if (w->size == 0)
+      w->base = key;
+
+   wheel_place(w, n);
+
+   if (w->min != NULL && key < w->min->key)
+      w->min = n;
+
+   w->size++;
+}
+
+size_t wheel_size(wheel_t w)
+{
+   return w->size;
+}
+
+static void wheel_walk_overflow(uint64_t key, void *user, void *context)
+{
+   const walk_ctx_t *ctx = context;
+   const wheel_node_t *n = user;
+   (*ctx->fn)(n->key, n->user, ctx->context);
+}
+
+void wheel_walk(wheel_t w, wheel_walk_fn_t fn, void *context)
+{
+   for (int i = 0; i < NLEVELS; i++) {
+      const wheel_level_t *l = &(w->levels[i]);
+      if (l->count == 0)
+         continue;
+
+      for (int j = 0; j < LEVEL_SLOTS; j++) {
+         for (wheel_node_t *it = l->slots[j].head; it; it = it->next)
+            (*fn)(it->key, it->user, context);
+      }
+   }
+
+   walk_ctx_t ctx = { fn, context };
+   heap_walk(w->overflow, wheel_walk_overflow, &ctx);
+}
@@ -34,6 +34,8 @@ typedef struct loop_stack  loop_stack_t;
 typedef struct type_set    type_set_t;
 typedef struct defer_check defer_check_t;
 typedef struct import_list import_list_t;
+typedef struct import_index import_index_t;
+typedef struct scope_import scope_import_t;
 
 typedef bool (*defer_fn_t)(tree_t t);
 typedef bool (*static_fn_t)(tree_t t);
@@ -50,6 +52,23 @@ struct import_list {
    import_list_t *next;
 };
 
+// Names made visible by importing a unit which are built once and
+// shared between every scope that imports it
+struct import_index {
+   hash_t   *decls;
+   tree_t   *uses;
+   unsigned  n_uses;
+   unsigned  max_uses;
+   bool      ok;
+};
+
+struct scope_import {
+   tree_t           unit;
+   bool             all;
+   import_index_t  *index;
+   scope_import_t  *next;
+};
+
 typedef enum {
    SCOPE_PACKAGE   = (1 << 0),
    SCOPE_FORMAL    = (1 << 1),
@@ -60,8 +79,10 @@ typedef enum {
 struct scope {
    scope_t       *down;
 
-   defer_check_t *deferred;
-   hash_t        *decls;
+   defer_check_t  *deferred;
+   hash_t         *decls;
+   scope_import_t *imports;
+   hash_t         *hidden;
    tree_t         subprog;
    wait_level_t   wait_level;
    impure_io_t    impure_io;
@@ -97,6 +118,20 @@ typedef struct {
    bool   partial;
 } formal_map_t;
 
+typedef struct {
+   scope_t        *where;
+   scope_import_t *import;
+   hash_iter_t     now;
+   bool            recur;
+} scope_iter_t;
+
+typedef struct {
+   unsigned  version;
+   unsigned  count;
+   unsigned  max;
+   tree_t   *decls;
+} visible_t;
+
 typedef tree_t (*get_fn_t)(tree_t);
 typedef void (*set_fn_t)(tree_t, tree_t);
 typedef tree_t (*get_nth_fn_t)(tree_t, unsigned);
@@ -121,6 +156,9 @@ static scope_t      *top_scope = NULL;
 static int           errors = 0;
 static type_set_t   *top_type_set = NULL;
 static loop_stack_t *loop_stack = NULL;
+static hash_t       *import_cache[2][2];
+static hash_t       *visible_cache = NULL;
+static unsigned      scope_version = 1;
 
 #define sem_error(t, ...) do {                        \
       error_at(t ? tree_loc(t) : NULL , __VA_ARGS__); \
@@ -131,7 +169,9 @@ static loop_stack_t *loop_stack = NULL;
 static void scope_push(ident_t prefix)
 {
    scope_t *s = xmalloc(sizeof(scope_t));
-   s->decls      = hash_new(1024, false);
+   s->decls      = hash_new(16, false);
+   s->imports    = NULL;
+   s->hidden     = NULL;
    s->prefix     = prefix;
    s->imported   = NULL;
    s->down       = top_scope;
@@ -156,7 +196,17 @@ static void scope_pop(void)
       top_scope->imported = tmp;
    }
 
+   while (top_scope->imports != NULL) {
+      scope_import_t *tmp = top_scope->imports->next;
+      free(top_scope->imports);
+      top_scope->imports = tmp;
+   }
+
    hash_free(top_scope->decls);
+   if (top_scope->hidden != NULL)
+      hash_free(top_scope->hidden);
+
+   scope_version++;
 
    scope_t *s = top_scope;
    if (s->down != NULL && s->down->subprog == s->subprog) {
@@ -212,29 +262,60 @@ static void scope_apply_prefix(tree_t t)
                                      tree_ident(t), '.'));
 }
 
-static scope_t *scope_containing(scope_t *s, tree_t decl)
+static tree_t scope_unhide(scope_t *s, tree_t decl)
+{
+   // Imported declarations hidden by an explicit declaration in this
+   // scope cannot be replaced in the shared index
+   tree_t with;
+   if (s->hidden != NULL && (with = hash_get(s->hidden, decl)))
+      return with;
+   else
+      return decl;
+}
+
+static bool scope_has_decl(hash_t *decls, scope_t *s, tree_t decl)
 {
    int k = 0, tmp;
    tree_t next;
    ident_t name = tree_ident(decl);
-   while (tmp = k++, (next = hash_get_nth(s->decls, name, &tmp))) {
-      if (next == decl)
+   while (tmp = k++, (next = hash_get_nth(decls, name, &tmp))) {
+      if (scope_unhide(s, next) == decl)
+         return true;
+   }
+   return false;
+}
+
+static scope_t *scope_containing(scope_t *s, tree_t decl)
+{
+   for (scope_import_t *it = s->imports; it != NULL; it = it->next) {
+      if (scope_has_decl(it->index->decls, s, decl))
          return s;
    }
+
+   if (scope_has_decl(s->decls, s, decl))
+      return s;
+
    return s->down == NULL ? NULL : scope_containing(s->down, decl);
 }
 
 static tree_t scope_find_in(ident_t i, scope_t *s, bool recur, int k)
 {
-   if (s == NULL)
-      return NULL;
-   else {
+   // Imported names are searched before those declared in the scope
+   // itself as that is the order they would have been inserted
+
+   for (; s != NULL; s = (recur ? s->down : NULL)) {
+      for (scope_import_t *it = s->imports; it != NULL; it = it->next) {
+         void *value = hash_get_nth(it->index->decls, i, &k);
+         if (value != NULL)
+            return scope_unhide(s, (tree_t)value);
+      }
+
       void *value = hash_get_nth(s->decls, i, &k);
       if (value != NULL)
          return (tree_t)value;
-      else
-         return (recur ? scope_find_in(i, s->down, true, k) : NULL);
    }
+
+   return NULL;
 }
 
 static tree_t scope_find(ident_t i)
@@ -247,26 +328,86 @@ static tree_t scope_find_nth(ident_t i, int n)
    return scope_find_in(i, top_scope, true, n);
 }
 
-static bool scope_walk(scope_t **where, hash_iter_t *now, tree_t *decl)
+static const visible_t *scope_visible(ident_t name)
 {
-   const void *key;
-   void *value;
-   scope_t *w = where == NULL ? top_scope : *where;
-   while (hash_iter(w->decls, now, &key, &value)) {
-      *decl = value;
-      if (tree_ident(*decl) != key)
-         continue;   // Skip aliases
-      else
-         return true;
+   // Cache the list of declarations visible under a name so that
+   // overload resolution at each call site does not have to search
+   // the scope again until the set of visible names changes
+
+   if (visible_cache == NULL)
+      visible_cache = hash_new(256, true);
+
+   visible_t *v = hash_get(visible_cache, name);
+   if (v != NULL && v->version == scope_version)
+      return v;
+   else if (v == NULL) {
+      v = xmalloc(sizeof(visible_t));
+      v->max   = 16;
+      v->decls = xmalloc(v->max * sizeof(tree_t));
+
+      hash_put(visible_cache, name, v);
    }
 
-   if (where == NULL || w->down == NULL)
-      return false;
-   else {
-      *where = w->down;
-      *now = HASH_BEGIN;
-      return scope_walk(where, now, decl);
+   v->count = 0;
+
+   tree_t decl;
+   int n = 0;
+   while ((decl = scope_find_nth(name, n++)))
+      ARRAY_APPEND(v->decls, decl, v->count, v->max);
+
+   v->version = scope_version;
+   return v;
+}
+
+static tree_t scope_visible_nth(const visible_t *v, int n)
+{
+   return (n < v->count) ? v->decls[n] : NULL;
+}
+
+static void scope_invalidate(ident_t name)
+{
+   visible_t *v;
+   if (visible_cache != NULL && (v = hash_get(visible_cache, name)))
+      v->version = 0;
+}
+
+static void scope_iter_begin(scope_iter_t *it, bool recur)
+{
+   it->where  = top_scope;
+   it->import = top_scope->imports;
+   it->now    = HASH_BEGIN;
+   it->recur  = recur;
+}
+
+static bool scope_walk(scope_iter_t *it, tree_t *decl)
+{
+   while (it->where != NULL) {
+      const bool imported = (it->import != NULL);
+      hash_t *h = imported ? it->import->index->decls : it->where->decls;
+
+      const void *key;
+      void *value;
+      while (hash_iter(h, &(it->now), &key, &value)) {
+         *decl = imported ? scope_unhide(it->where, value) : value;
+         if (tree_ident(*decl) != key)
+            continue;   // Skip aliases
+         else
+            return true;
+      }
+
+      it->now = HASH_BEGIN;
+
+      if (imported)
+         it->import = it->import->next;
+      else if (it->recur && it->where->down != NULL) {
+         it->where  = it->where->down;
+         it->import = it->where->imports;
+      }
+      else
+         it->where = NULL;
    }
+
+   return false;
 }
 
 static bool scope_can_overload(tree_t t)
@@ -336,6 +477,22 @@ static void scope_insert_fields(type_t type, ident_t prefix)
    }
 }
 
+static void scope_replace(tree_t t, tree_t with)
+{
+   assert(top_scope != NULL);
+   hash_replace(top_scope->decls, t, with);
+
+   scope_version++;
+
+   if (top_scope->imports != NULL) {
+      if (top_scope->hidden == NULL)
+         top_scope->hidden = hash_new(16, true);
+
+      hash_replace(top_scope->hidden, t, with);
+      hash_put(top_scope->hidden, t, with);
+   }
+}
+
 static bool scope_insert_aux(tree_t t, ident_t name, bool alias)
 {
    assert(top_scope != NULL);
@@ -382,7 +539,7 @@ static bool scope_insert_aux(tree_t t, ident_t name, bool alias)
             // Allow builtin functions to be hidden by explicit functins
             // declared in the same region
             if (same_region) {
-               hash_replace(top_scope->decls, existing, t);
+               scope_replace(existing, t);
                return true;
             }
          }
@@ -390,6 +547,7 @@ static bool scope_insert_aux(tree_t t, ident_t name, bool alias)
    } while (existing != NULL);
 
    hash_put(top_scope->decls, name, t);
+   scope_invalidate(name);
 
    const tree_kind_t kind = tree_kind(t);
    const bool may_have_fields = kind == T_VAR_DECL
@@ -415,12 +573,6 @@ static void scope_insert_alias(tree_t t, ident_t name)
    (void)scope_insert_aux(t, name, true);
 }
 
-static void scope_replace(tree_t t, tree_t with)
-{
-   assert(top_scope != NULL);
-   hash_replace(top_scope->decls, t, with);
-}
-
 static void loop_push(ident_t name)
 {
    loop_stack_t *ls = xmalloc(sizeof(loop_stack_t));
@@ -544,10 +696,9 @@ static bool sem_has_work_alias(ident_t name)
       && work_name != work_i;
 }
 
-static bool scope_import_decls(tree_t unit, bool all)
+static bool scope_index_decls(tree_t unit, bool all, bool work_alias,
+                              import_index_t *index)
 {
-   const bool work_alias = sem_has_work_alias(tree_ident(unit));
-
    const int ndecls = tree_decls(unit);
    for (int n = 0; n < ndecls; n++) {
       tree_t decl = tree_decl(unit, n);
@@ -556,8 +707,7 @@ static bool scope_import_decls(tree_t unit, bool all)
       if (kind == T_ATTR_SPEC)
          continue;
       else if (kind == T_USE) {
-         if (!scope_import_use_clause(decl, true))
-            return false;
+         ARRAY_APPEND(index->uses, decl, index->n_uses, index->max_uses);
          continue;
       }
 
@@ -644,6 +794,76 @@ static bool scope_import_decls(tree_t unit, bool all)
       }
    }
 
+   return true;
+}
+
+static import_index_t *scope_import_index(tree_t unit, bool all)
+{
+   // The names made visible by a unit are collected once into a table
+   // which is then shared by every scope importing it
+
+   const bool work_alias = sem_has_work_alias(tree_ident(unit));
+
+   hash_t **cache = &(import_cache[all][work_alias]);
+   if (*cache == NULL)
+      *cache = hash_new(64, true);
+
+   import_index_t *index = hash_get(*cache, unit);
+   if (index != NULL)
+      return index;
+
+   index = xmalloc(sizeof(import_index_t));
+   index->max_uses = 4;
+   index->n_uses   = 0;
+   index->uses     = xmalloc(index->max_uses * sizeof(tree_t));
+
+   scope_push(NULL);
+
+   index->ok = scope_index_decls(unit, all, work_alias, index);
+
+   scope_t *s = top_scope;
+   index->decls = s->decls;
+   top_scope = s->down;
+   free(s);
+
+   hash_put(*cache, unit, index);
+   return index;
+}
+
+static bool scope_import_decls(tree_t unit, bool all)
+{
+   import_index_t *index = scope_import_index(unit, all);
+   if (!index->ok)
+      return false;
+
+   for (unsigned i = 0; i < index->n_uses; i++) {
+      if (!scope_import_use_clause(index->uses[i], true))
+         return false;
+   }
+
+   scope_import_t **p;
+   for (p = &(top_scope->imports); *p != NULL; p = &((*p)->next)) {
+      if ((*p)->unit != unit)
+         continue;
+      else if (all && !(*p)->all) {
+         (*p)->all   = true;
+         (*p)->index = index;
+      }
+      break;
+   }
+
+   if (*p == NULL) {
+      scope_import_t *new = xmalloc(sizeof(scope_import_t));
+      new->unit  = unit;
+      new->all   = all;
+      new->index = index;
+      new->next  = NULL;
+
+      *p = new;
+   }
+
+   scope_version++;
+
    scope_append_import_list(tree_ident(unit), all);
    return true;
 }
@@ -1726,10 +1946,12 @@ static bool sem_check_type(tree_t t, type_t *ptype)
          if (!sem_check_subtype(t, *ptype, &base))
             return false;
 
-         if (type_kind(base) == T_UARRAY)
-            return sem_check_array_dims(*ptype, base);
-         else
-            return true;
+         if (type_kind(base) == T_UARRAY
+             && !sem_check_array_dims(*ptype, base))
+            return false;
+
+         *ptype = type_intern(*ptype);
+         return true;
       }
 
    case T_UNRESOLVED:
@@ -4030,10 +4252,12 @@ static bool sem_check_fcall(tree_t t)
    if (!sem_check_selected_name(name, t, NULL))
       return false;
 
+   const visible_t *visible = scope_visible(name);
+
    tree_t decl;
    int n = 0, found_func = 0;
    do {
-      if ((decl = scope_find_nth(name, n++))) {
+      if ((decl = scope_visible_nth(visible, n++))) {
          if (!class_has_type(class_of(decl)))
             continue;
 
@@ -4254,9 +4478,11 @@ static bool sem_check_pcall(tree_t t)
    tree_t *overloads LOCAL = xmalloc(max_overloads * sizeof(tree_t));
 
    tree_t decl;
+   const visible_t *visible = scope_visible(name);
+
    int n = 0, found_proc = 0;
    do {
-      if ((decl = scope_find_nth(name, n++))) {
+      if ((decl = scope_visible_nth(visible, n++))) {
          switch (tree_kind(decl)) {
          case T_PROC_DECL:
          case T_PROC_BODY:
@@ -4657,12 +4883,12 @@ static bool sem_check_concat(tree_t t)
       }
       else {
          // Find all one dimensional array types with this element type
-         hash_iter_t it = HASH_BEGIN;
+         scope_iter_t it;
+         scope_iter_begin(&it, true);
          tree_t obj;
-         scope_t *where = top_scope;
          type_t found[16];
          int nfound = 0;
-         while (nfound < ARRAY_LEN(found) && scope_walk(&where, &it, &obj)) {
+         while (nfound < ARRAY_LEN(found) && scope_walk(&it, &obj)) {
             if (tree_kind(obj) != T_TYPE_DECL)
                continue;
 
@@ -7349,9 +7575,10 @@ static bool sem_check_spec(tree_t t)
    }
    else {
       ident_t cname = tree_ident2(t);
-      hash_iter_t it = HASH_BEGIN;
+      scope_iter_t it;
+      scope_iter_begin(&it, false);
       tree_t obj;
-      while (scope_walk(NULL, &it, &obj)) {
+      while (scope_walk(&it, &obj)) {
          if (tree_kind(obj) != T_INSTANCE)
             continue;
 
@@ -18,6 +18,7 @@
 #include "phase.h"
 #include "util.h"
 #include "common.h"
+#include "hash.h"
 
 #include <assert.h>
 #include <string.h>
@@ -40,6 +41,13 @@ typedef struct {
    tree_t        top;
    ident_t       prefix;
    eval_flags_t  eval_flags;
+   bool          check;
+   tree_t       *checks;      // Trees to bounds check after rewriting
+   unsigned      n_checks;
+   unsigned      max_checks;
+   tree_t       *dead;        // Statements removed by constant folding
+   unsigned      n_dead;
+   unsigned      max_dead;
 } simp_ctx_t;
 
 static tree_t simp_tree(tree_t t, void *context);
@@ -517,6 +525,21 @@ static tree_t simp_array_ref(tree_t t)
    }
 }
 
+static void simp_discard(tree_t t, simp_ctx_t *ctx)
+{
+   // Anything inside a subtree removed by constant folding was queued
+   // for bounds checking already but must not report errors
+   if (ctx->check)
+      ARRAY_APPEND(ctx->dead, t, ctx->n_dead, ctx->max_dead);
+}
+
+static void simp_discard_stmts(tree_t t, simp_ctx_t *ctx)
+{
+   const int nstmts = tree_stmts(t);
+   for (int i = 0; i < nstmts; i++)
+      simp_discard(tree_stmt(t, i), ctx);
+}
+
 static tree_t simp_process(tree_t t)
 {
    // Replace sensitivity list with a "wait on" statement
@@ -566,7 +589,19 @@ static tree_t simp_wait(tree_t t)
    return t;
 }
 
-static tree_t simp_case(tree_t t)
+static tree_t simp_case_choose(tree_t t, tree_t a, simp_ctx_t *ctx)
+{
+   const int nassocs = tree_assocs(t);
+   for (int i = 0; i < nassocs; i++) {
+      tree_t other = tree_assoc(t, i);
+      if (other != a && tree_has_value(other))
+         simp_discard(tree_value(other), ctx);
+   }
+
+   return tree_has_value(a) ? tree_value(a) : NULL;
+}
+
+static tree_t simp_case(tree_t t, simp_ctx_t *ctx)
 {
    const int nassocs = tree_assocs(t);
    if (nassocs == 0)
@@ -580,12 +615,8 @@ static tree_t simp_case(tree_t t)
          case A_NAMED:
             {
                int64_t aval;
-               if (folded_int(tree_name(a), &aval) && (ival == aval)) {
-                  if (tree_has_value(a))
-                     return tree_value(a);
-                  else
-                     return NULL;
-               }
+               if (folded_int(tree_name(a), &aval) && (ival == aval))
+                  return simp_case_choose(t, a, ctx);
             }
             break;
 
@@ -593,10 +624,7 @@ static tree_t simp_case(tree_t t)
             continue;   // TODO
 
          case A_OTHERS:
-            if (tree_has_value(a))
-               return tree_value(a);
-            else
-               return NULL;
+            return simp_case_choose(t, a, ctx);
 
          case A_POS:
             break;
@@ -607,11 +635,15 @@ static tree_t simp_case(tree_t t)
    return t;
 }
 
-static tree_t simp_if(tree_t t)
+static tree_t simp_if(tree_t t, simp_ctx_t *ctx)
 {
    bool value_b;
    if (folded_bool(tree_value(t), &value_b)) {
       if (value_b) {
+         const int nelse = tree_else_stmts(t);
+         for (int i = 0; i < nelse; i++)
+            simp_discard(tree_else_stmt(t, i), ctx);
+
          // If statement always executes so replace with then part
          if (tree_stmts(t) == 1)
             return tree_stmt(t, 0);
@@ -624,6 +656,8 @@ static tree_t simp_if(tree_t t)
          }
       }
       else {
+         simp_discard_stmts(t, ctx);
+
          // If statement never executes so replace with else part
          if (tree_else_stmts(t) == 1)
             return tree_else_stmt(t, 0);
@@ -642,13 +676,14 @@ static tree_t simp_if(tree_t t)
       return t;
 }
 
-static tree_t simp_while(tree_t t)
+static tree_t simp_while(tree_t t, simp_ctx_t *ctx)
 {
    bool value_b;
    if (!tree_has_value(t))
       return t;
    else if (folded_bool(tree_value(t), &value_b) && !value_b) {
       // Condition is false so loop never executes
+      simp_discard_stmts(t, ctx);
       return NULL;
    }
    else
@@ -947,7 +982,7 @@ static tree_t simp_assert(tree_t t)
       return t;
 }
 
-static tree_t simp_if_generate(tree_t t)
+static tree_t simp_if_generate(tree_t t, simp_ctx_t *ctx)
 {
    bool value_b;
    if (!folded_bool(tree_value(t), &value_b))
@@ -968,8 +1003,14 @@ static tree_t simp_if_generate(tree_t t)
 
       return block;
    }
-   else
+   else {
+      const int ndecls = tree_decls(t);
+      for (int i = 0; i < ndecls; i++)
+         simp_discard(tree_decl(t, i), ctx);
+
+      simp_discard_stmts(t, ctx);
       return NULL;
+   }
 }
 
 static tree_t simp_signal_assign(tree_t t)
@@ -990,6 +1031,34 @@ static tree_t simp_assoc(tree_t t)
    return t;
 }
 
+static void simp_check_stmts(tree_t container, bool is_else,
+                             simp_ctx_t *ctx)
+{
+   const int nstmts =
+      is_else ? tree_else_stmts(container) : tree_stmts(container);
+   for (int i = 0; i < nstmts; i++) {
+      tree_t s = is_else ? tree_else_stmt(container, i)
+         : tree_stmt(container, i);
+
+      if (tree_kind(s) == T_IF) {
+         simp_check_stmts(s, false, ctx);
+         simp_check_stmts(s, true, ctx);
+      }
+      else if (bounds_check_kind(tree_kind(s)))
+         ARRAY_APPEND(ctx->checks, s, ctx->n_checks, ctx->max_checks);
+   }
+}
+
+static tree_t simp_concurrent(tree_t process, simp_ctx_t *ctx)
+{
+   // The statements inside a process made from a concurrent statement
+   // are new and so never passed to simp_visit
+   if (ctx->check)
+      simp_check_stmts(process, false, ctx);
+
+   return process;
+}
+
 static tree_t simp_tree(tree_t t, void *_ctx)
 {
    simp_ctx_t *ctx = _ctx;
@@ -1010,21 +1079,21 @@ static tree_t simp_tree(tree_t t, void *_ctx)
    case T_REF:
       return simp_ref(t);
    case T_IF:
-      return simp_if(t);
+      return simp_if(t, ctx);
    case T_CASE:
-      return simp_case(t);
+      return simp_case(t, ctx);
    case T_WHILE:
-      return simp_while(t);
+      return simp_while(t, ctx);
    case T_CASSIGN:
-      return simp_cassign(t);
+      return simp_concurrent(simp_cassign(t), ctx);
    case T_SELECT:
-      return simp_select(t);
+      return simp_concurrent(simp_select(t), ctx);
    case T_WAIT:
       return simp_wait(t);
    case T_NULL:
       return NULL;   // Delete it
    case T_CPCALL:
-      return simp_cpcall(t);
+      return simp_concurrent(simp_cpcall(t), ctx);
    case T_CASSERT:
       return simp_cassert(t);
    case T_CONCAT:
@@ -1036,7 +1105,7 @@ static tree_t simp_tree(tree_t t, void *_ctx)
    case T_ASSERT:
       return simp_assert(t);
    case T_IF_GENERATE:
-      return simp_if_generate(t);
+      return simp_if_generate(t, ctx);
    case T_SIGNAL_ASSIGN:
       return simp_signal_assign(t);
    case T_ASSOC:
@@ -1048,6 +1117,23 @@ static tree_t simp_tree(tree_t t, void *_ctx)
    }
 }
 
+static void simp_add_imp_signals(simp_ctx_t *ctx)
+{
+   while (ctx->imp_signals != NULL) {
+      tree_add_decl(ctx->top, ctx->imp_signals->signal);
+      tree_add_stmt(ctx->top, ctx->imp_signals->process);
+
+      if (ctx->check) {
+         bounds_check(ctx->imp_signals->signal);
+         bounds_check(ctx->imp_signals->process);
+      }
+
+      imp_signal_t *tmp = ctx->imp_signals->next;
+      free(ctx->imp_signals);
+      ctx->imp_signals = tmp;
+   }
+}
+
 void simplify(tree_t top, eval_flags_t flags)
 {
    simp_ctx_t ctx = {
@@ -1059,12 +1145,58 @@ void simplify(tree_t top, eval_flags_t flags)
 
    tree_rewrite(top, simp_tree, &ctx);
 
-   while (ctx.imp_signals != NULL) {
-      tree_add_decl(top, ctx.imp_signals->signal);
-      tree_add_stmt(top, ctx.imp_signals->process);
+   simp_add_imp_signals(&ctx);
+}
+
+static void simp_visit(tree_t t, void *_ctx)
+{
+   simp_ctx_t *ctx = _ctx;
+
+   if (bounds_check_kind(tree_kind(t)))
+      ARRAY_APPEND(ctx->checks, t, ctx->n_checks, ctx->max_checks);
+}
+
+static void simp_mark_dead(tree_t t, void *context)
+{
+   hash_put((hash_t *)context, t, t);
+}
+
+void simplify_check(tree_t top, eval_flags_t flags)
+{
+   // Trees are queued for bounds checking as they are rewritten and
+   // checked at the end once constant folding has removed any dead code
+   // so the result is the same as calling simplify then bounds_check
 
-      imp_signal_t *tmp = ctx.imp_signals->next;
-      free(ctx.imp_signals);
-      ctx.imp_signals = tmp;
+   simp_ctx_t ctx = {
+      .imp_signals = NULL,
+      .top         = top,
+      .prefix      = ident_runtil(tree_ident(top), '-'),
+      .eval_flags  = flags,
+      .check       = true,
+      .max_checks  = 256,
+      .checks      = xmalloc(256 * sizeof(tree_t)),
+      .max_dead    = 16,
+      .dead        = xmalloc(16 * sizeof(tree_t))
+   };
+
+   tree_rewrite_visit(top, simp_tree, simp_visit, &ctx);
+
+   hash_t *dead = NULL;
+   if (ctx.n_dead > 0) {
+      dead = hash_new(256, true);
+      for (unsigned i = 0; i < ctx.n_dead; i++)
+         tree_visit(ctx.dead[i], simp_mark_dead, dead);
    }
+
+   for (unsigned i = 0; i < ctx.n_checks; i++) {
+      if (dead == NULL || hash_get(dead, ctx.checks[i]) == NULL)
+         bounds_check_tree(ctx.checks[i]);
+   }
+
+   simp_add_imp_signals(&ctx);
+
+   if (dead != NULL)
+      hash_free(dead);
+   free(ctx.checks);
+   free(ctx.dead);
 }
@@ -18,10 +18,13 @@
 #ifndef _TOKEN_H
 #define _TOKEN_H
 
+#include "prim.h"
+
 typedef union {
-   double  d;
-   char   *s;
-   int64_t n;
+   double   d;
+   char    *s;
+   int64_t  n;
+   ident_t  id;
 } yylval_t;
 
 typedef enum {
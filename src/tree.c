@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
 static const imask_t has_map[T_LAST_TREE_KIND] = {
    // T_ENTITY
@@ -377,6 +378,21 @@ static void tree_assert_decl(tree_t t)
    tree_assert_kind(t, decl_kinds, ARRAY_LEN(decl_kinds), "a declaration");
 }
 
+typedef struct {
+   tree_t   *trees;
+   unsigned *order;
+   unsigned  count;
+   unsigned  max;
+} index_list_t;
+
+typedef struct {
+   tree_t        root;
+   unsigned      next;
+   index_list_t  kinds[T_LAST_TREE_KIND];
+} tree_index_t;
+
+static tree_index_t *kind_index = NULL;
+
 tree_t tree_new(tree_kind_t kind)
 {
    return (tree_t)object_new(&tree_object, kind);
@@ -384,9 +400,32 @@ tree_t tree_new(tree_kind_t kind)
 
 void tree_gc(void)
 {
+   assert(kind_index == NULL);
+
+   type_intern_reset();
    object_gc();
 }
 
+tree_arena_t *tree_arena_new(void)
+{
+   return object_arena_new();
+}
+
+void tree_arena_push(tree_arena_t *arena)
+{
+   object_arena_push(arena);
+}
+
+void tree_arena_pop(void)
+{
+   object_arena_pop();
+}
+
+void tree_arena_free(tree_arena_t *arena)
+{
+   object_arena_free(arena);
+}
+
 const loc_t *tree_loc(tree_t t)
 {
    assert(t != NULL);
@@ -449,7 +488,8 @@ void tree_change_kind(tree_t t, tree_kind_t kind)
 
 unsigned tree_ports(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_PORTS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_PORTS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_port(tree_t t, unsigned n)
@@ -477,7 +517,8 @@ void tree_set_subkind(tree_t t, unsigned sub)
 
 unsigned tree_generics(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_GENERICS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_GENERICS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_generic(tree_t t, unsigned n)
@@ -511,7 +552,8 @@ bool tree_has_type(tree_t t)
 
 unsigned tree_params(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_PARAMS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_PARAMS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_param(tree_t t, unsigned n)
@@ -528,14 +570,15 @@ void tree_add_param(tree_t t, tree_t e)
    tree_array_t *array = &(lookup_item(&tree_object, t, I_PARAMS)->tree_array);
 
    if (tree_subkind(e) == P_POS)
-      tree_set_pos(e, array->count);
+      tree_set_pos(e, tree_array_count(array));
 
    tree_array_add(array, e);
 }
 
 unsigned tree_genmaps(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_GENMAPS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_GENMAPS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_genmap(tree_t t, unsigned n)
@@ -551,7 +594,7 @@ void tree_add_genmap(tree_t t, tree_t e)
    tree_array_t *array = &(lookup_item(&tree_object, t, I_GENMAPS)->tree_array);
 
    if (tree_subkind(e) == P_POS)
-      tree_set_pos(e, array->count);
+      tree_set_pos(e, tree_array_count(array));
 
    tree_array_add(&(lookup_item(&tree_object, t, I_GENMAPS)->tree_array), e);
 }
@@ -593,7 +636,8 @@ void tree_set_flag(tree_t t, tree_flags_t mask)
 unsigned tree_chars(tree_t t)
 {
    assert((t->object.kind == T_LITERAL) && (tree_subkind(t) == L_STRING));
-   return lookup_item(&tree_object, t, I_CHARS)->ident_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_CHARS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_char(tree_t t, unsigned n)
@@ -630,13 +674,17 @@ void tree_set_value(tree_t t, tree_t v)
 
 unsigned tree_decls(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_DECLS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_DECLS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_decl(tree_t t, unsigned n)
 {
    item_t *item = lookup_item(&tree_object, t, I_DECLS);
-   return tree_array_nth(&(item->tree_array), n);
+   tree_t *slot = tree_array_nth_ptr(&(item->tree_array), n);
+   if (unlikely(OBJECT_LAZY(*slot)))
+      object_force(slot);
+   return *slot;
 }
 
 void tree_add_decl(tree_t t, tree_t d)
@@ -647,7 +695,8 @@ void tree_add_decl(tree_t t, tree_t d)
 
 unsigned tree_stmts(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_STMTS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_STMTS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_stmt(tree_t t, unsigned n)
@@ -662,9 +711,37 @@ void tree_add_stmt(tree_t t, tree_t s)
    tree_array_add(&(lookup_item(&tree_object, t, I_STMTS)->tree_array), s);
 }
 
+static void tree_array_filter(tree_array_t *a, tree_filter_fn_t fn,
+                              void *context)
+{
+   const unsigned count = tree_array_count(a);
+   unsigned n = 0;
+   for (unsigned i = 0; i < count; i++) {
+      tree_t *slot = tree_array_nth_ptr(a, i);
+      if (unlikely(OBJECT_LAZY(*slot)))
+         object_force(slot);
+      if ((*fn)(*slot, context))
+         a->block->items[n++] = *slot;
+   }
+   tree_array_resize(a, n, 0, false);
+}
+
+void tree_filter_decls(tree_t t, tree_filter_fn_t fn, void *context)
+{
+   item_t *item = lookup_item(&tree_object, t, I_DECLS);
+   tree_array_filter(&(item->tree_array), fn, context);
+}
+
+void tree_filter_stmts(tree_t t, tree_filter_fn_t fn, void *context)
+{
+   item_t *item = lookup_item(&tree_object, t, I_STMTS);
+   tree_array_filter(&(item->tree_array), fn, context);
+}
+
 unsigned tree_waveforms(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_WAVES)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_WAVES);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_waveform(tree_t t, unsigned n)
@@ -681,7 +758,8 @@ void tree_add_waveform(tree_t t, tree_t w)
 
 unsigned tree_else_stmts(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_ELSES)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_ELSES);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_else_stmt(tree_t t, unsigned n)
@@ -698,7 +776,8 @@ void tree_add_else_stmt(tree_t t, tree_t s)
 
 unsigned tree_conds(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_CONDS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_CONDS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_cond(tree_t t, unsigned n)
@@ -733,7 +812,8 @@ void tree_set_delay(tree_t t, tree_t d)
 
 unsigned tree_triggers(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_TRIGGERS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_TRIGGERS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_trigger(tree_t t, unsigned n)
@@ -750,7 +830,8 @@ void tree_add_trigger(tree_t t, tree_t s)
 
 unsigned tree_ops(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_OPS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_OPS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_op(tree_t t, unsigned n)
@@ -812,7 +893,8 @@ void tree_set_spec(tree_t t, tree_t s)
 
 unsigned tree_contexts(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_CONTEXT)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_CONTEXT);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_context(tree_t t, unsigned n)
@@ -830,7 +912,8 @@ void tree_add_context(tree_t t, tree_t ctx)
 
 unsigned tree_assocs(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_ASSOCS)->tree_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_ASSOCS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t tree_assoc(tree_t t, unsigned n)
@@ -846,14 +929,15 @@ void tree_add_assoc(tree_t t, tree_t a)
    tree_array_t *array = &(lookup_item(&tree_object, t, I_ASSOCS)->tree_array);
 
    if (tree_subkind(a) == A_POS)
-      tree_set_pos(a, array->count);
+      tree_set_pos(a, tree_array_count(array));
 
    tree_array_add(array, a);
 }
 
 unsigned tree_nets(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_NETS)->netid_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_NETS);
+   return netid_array_count(&(item->netid_array));
 }
 
 netid_t tree_net(tree_t t, unsigned n)
@@ -873,10 +957,10 @@ void tree_change_net(tree_t t, unsigned n, netid_t i)
 {
    item_t *item = lookup_item(&tree_object, t, I_NETS);
 
-   if (n >= item->netid_array.count)
-      netid_array_resize(&(item->netid_array), n + 1, 0xff);
+   if (n >= netid_array_count(&(item->netid_array)))
+      netid_array_resize(&(item->netid_array), n + 1, 0xff, false);
 
-   item->netid_array.items[n] = i;
+   *netid_array_nth_ptr(&(item->netid_array), n) = i;
 }
 
 tree_t tree_severity(tree_t t)
@@ -923,14 +1007,15 @@ range_t tree_range(tree_t t, unsigned n)
 
 unsigned tree_ranges(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_RANGES)->range_array.count;
+   item_t *item = lookup_item(&tree_object, t, I_RANGES);
+   return range_array_count(&(item->range_array));
 }
 
 void tree_change_range(tree_t t, unsigned n, range_t r)
 {
    item_t *item = lookup_item(&tree_object, t, I_RANGES);
-   assert(n < item->range_array.count);
-   item->range_array.items[n] = r;
+   assert(n < range_array_count(&(item->range_array)));
+   *range_array_nth_ptr(&(item->range_array), n) = r;
 }
 
 unsigned tree_pos(tree_t t)
@@ -1013,11 +1098,47 @@ unsigned tree_visit(tree_t t, tree_visit_fn_t fn, void *context)
    return ctx.count;
 }
 
+static unsigned tree_index_visit(const tree_kind_t *kinds, int nkinds,
+                                 tree_visit_fn_t fn, void *context)
+{
+   // Merge the lists for each kind back into the order tree_visit
+   // would have found them
+
+   unsigned pos[nkinds];
+   unsigned count = 0;
+   for (int i = 0; i < nkinds; i++) {
+      pos[i] = 0;
+      count += kind_index->kinds[kinds[i]].count;
+   }
+
+   if (fn == NULL)
+      return count;
+
+   for (unsigned n = 0; n < count; n++) {
+      int best = -1;
+      unsigned best_order = UINT_MAX;
+      for (int i = 0; i < nkinds; i++) {
+         const index_list_t *l = &(kind_index->kinds[kinds[i]]);
+         if (pos[i] < l->count && l->order[pos[i]] < best_order) {
+            best = i;
+            best_order = l->order[pos[i]];
+         }
+      }
+
+      (*fn)(kind_index->kinds[kinds[best]].trees[pos[best]++], context);
+   }
+
+   return count;
+}
+
 unsigned tree_visit_only(tree_t t, tree_visit_fn_t fn,
                          void *context, tree_kind_t kind)
 {
    assert(t != NULL);
 
+   if (kind_index != NULL && kind_index->root == t)
+      return tree_index_visit(&kind, 1, fn, context);
+
    object_visit_ctx_t ctx = {
       .count      = 0,
       .postorder  = fn,
@@ -1033,9 +1154,89 @@ unsigned tree_visit_only(tree_t t, tree_visit_fn_t fn,
    return ctx.count;
 }
 
-tree_wr_ctx_t tree_write_begin(fbuf_t *f)
+typedef struct {
+   tree_visit_fn_t  fn;
+   void            *context;
+   bool             want[T_LAST_TREE_KIND];
+   unsigned         count;
+} visit_kinds_ctx_t;
+
+static void tree_visit_kinds_fn(tree_t t, void *context)
+{
+   visit_kinds_ctx_t *ctx = context;
+
+   if (t->object.tag != OBJECT_TAG_TREE || !ctx->want[t->object.kind])
+      return;
+
+   if (ctx->fn != NULL)
+      (*ctx->fn)(t, ctx->context);
+   ctx->count++;
+}
+
+unsigned tree_visit_kinds(tree_t t, tree_visit_fn_t fn, void *context,
+                          const tree_kind_t *kinds, int nkinds)
+{
+   assert(t != NULL);
+
+   if (kind_index != NULL && kind_index->root == t)
+      return tree_index_visit(kinds, nkinds, fn, context);
+
+   visit_kinds_ctx_t kctx = {
+      .fn      = fn,
+      .context = context,
+      .count   = 0
+   };
+
+   for (int i = 0; i < nkinds; i++)
+      kctx.want[kinds[i]] = true;
+
+   tree_visit(t, tree_visit_kinds_fn, &kctx);
+   return kctx.count;
+}
+
+static void tree_index_add(tree_t t, void *context)
+{
+   if (t->object.tag != OBJECT_TAG_TREE)
+      return;
+
+   index_list_t *l = &(kind_index->kinds[t->object.kind]);
+   if (l->count == l->max) {
+      l->max    = MAX(l->max * 2, 16);
+      l->trees  = xrealloc(l->trees, l->max * sizeof(tree_t));
+      l->order  = xrealloc(l->order, l->max * sizeof(unsigned));
+   }
+
+   l->trees[l->count] = t;
+   l->order[l->count] = kind_index->next++;
+   l->count++;
+}
+
+void tree_index_begin(tree_t root)
+{
+   assert(kind_index == NULL);
+
+   kind_index = xcalloc(sizeof(tree_index_t));
+   kind_index->root = root;
+
+   tree_visit(root, tree_index_add, NULL);
+}
+
+void tree_index_end(void)
 {
-   return (tree_wr_ctx_t)object_write_begin(f);
+   assert(kind_index != NULL);
+
+   for (int i = 0; i < T_LAST_TREE_KIND; i++) {
+      free(kind_index->kinds[i].trees);
+      free(kind_index->kinds[i].order);
+   }
+
+   free(kind_index);
+   kind_index = NULL;
+}
+
+tree_wr_ctx_t tree_write_begin(fbuf_t *f, ident_table_t *idents)
+{
+   return (tree_wr_ctx_t)object_write_begin(f, idents);
 }
 
 void tree_write_end(tree_wr_ctx_t ctx)
@@ -1053,9 +1254,10 @@ tree_t tree_read(tree_rd_ctx_t ctx)
    return (tree_t)object_read((object_rd_ctx_t *)ctx, OBJECT_TAG_TREE);
 }
 
-tree_rd_ctx_t tree_read_begin(fbuf_t *f, const char *fname)
+tree_rd_ctx_t tree_read_begin(fbuf_t *f, const char *fname,
+                              ident_table_t *idents)
 {
-   return (tree_rd_ctx_t)object_read_begin(f, fname);
+   return (tree_rd_ctx_t)object_read_begin(f, fname, idents);
 }
 
 void tree_read_end(tree_rd_ctx_t ctx)
@@ -1068,11 +1270,13 @@ static attr_t *tree_find_attr(tree_t t, ident_t name, attr_kind_t kind)
    assert(t != NULL);
    assert(name != NULL);
 
-   item_t *item = lookup_item(&tree_object, t, I_ATTRS);
-   for (unsigned i = 0; i < item->attrs.num; i++) {
-      if ((item->attrs.table[i].kind == kind)
-          && (item->attrs.table[i].name == name))
-         return &(item->attrs.table[i]);
+   attr_tab_t *attrs = lookup_item(&tree_object, t, I_ATTRS)->attrs;
+   if (attrs == NULL)
+      return NULL;
+
+   for (unsigned i = 0; i < attrs->num; i++) {
+      if ((attrs->table[i].kind == kind) && (attrs->table[i].name == name))
+         return &(attrs->table[i]);
    }
 
    return NULL;
@@ -1089,21 +1293,25 @@ static attr_t *tree_add_attr(tree_t t, ident_t name, attr_kind_t kind)
 
    item_t *item = lookup_item(&tree_object, t, I_ATTRS);
 
-   if (item->attrs.table == NULL) {
-      item->attrs.alloc = 8;
-      item->attrs.table = xmalloc(sizeof(attr_t) * item->attrs.alloc);
+   attr_tab_t *attrs = item->attrs;
+   if (attrs == NULL) {
+      attrs = xmalloc(sizeof(attr_tab_t) + sizeof(attr_t) * 8);
+      attrs->num   = 0;
+      attrs->alloc = 8;
    }
-   else if (item->attrs.alloc == item->attrs.num) {
-      item->attrs.alloc *= 2;
-      item->attrs.table = xrealloc(item->attrs.table,
-                                   sizeof(attr_t) * item->attrs.alloc);
+   else if (attrs->alloc == attrs->num) {
+      attrs->alloc *= 2;
+      attrs = xrealloc(attrs, sizeof(attr_tab_t)
+                       + sizeof(attr_t) * attrs->alloc);
    }
 
-   unsigned i = item->attrs.num++;
-   item->attrs.table[i].kind = kind;
-   item->attrs.table[i].name = name;
+   item->attrs = attrs;
 
-   return &(item->attrs.table[i]);
+   unsigned i = attrs->num++;
+   attrs->table[i].kind = kind;
+   attrs->table[i].name = name;
+
+   return &(attrs->table[i]);
 }
 
 void tree_remove_attr(tree_t t, ident_t name)
@@ -1111,20 +1319,21 @@ void tree_remove_attr(tree_t t, ident_t name)
    assert(t != NULL);
    assert(name != NULL);
 
-   item_t *item = lookup_item(&tree_object, t, I_ATTRS);
+   attr_tab_t *attrs = lookup_item(&tree_object, t, I_ATTRS)->attrs;
+   if (attrs == NULL)
+      return;
 
    unsigned i;
-   for (i = 0; (i < item->attrs.num)
-           && (item->attrs.table[i].name != name); i++)
+   for (i = 0; (i < attrs->num) && (attrs->table[i].name != name); i++)
       ;
 
-   if (i == item->attrs.num)
+   if (i == attrs->num)
       return;
 
-   for (; i + 1 < item->attrs.num; i++)
-      item->attrs.table[i] = item->attrs.table[i + 1];
+   for (; i + 1 < attrs->num; i++)
+      attrs->table[i] = attrs->table[i + 1];
 
-   item->attrs.num--;
+   attrs->num--;
 }
 
 void tree_add_attr_str(tree_t t, ident_t name, ident_t str)
@@ -1186,6 +1395,22 @@ tree_t tree_rewrite(tree_t t, tree_rewrite_fn_t fn, void *context)
    return result;
 }
 
+tree_t tree_rewrite_visit(tree_t t, tree_rewrite_fn_t fn,
+                          tree_visit_fn_t visit, void *context)
+{
+   object_rewrite_ctx_t ctx = {
+      .index      = 0,
+      .generation = object_next_generation(),
+      .fn         = fn,
+      .visit      = visit,
+      .context    = context
+   };
+
+   tree_t result = (tree_t)object_rewrite(&(t->object), &ctx);
+   free(ctx.cache);
+   return result;
+}
+
 tree_t tree_copy(tree_t t, tree_copy_fn_t fn, void *context)
 {
    object_copy_ctx_t ctx = {
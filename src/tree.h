@@ -241,6 +241,11 @@ unsigned tree_stmts(tree_t t);
 tree_t tree_stmt(tree_t t, unsigned n);
 void tree_add_stmt(tree_t t, tree_t d);
 
+// Keep only the declarations or statements for which fn returns true
+typedef bool (*tree_filter_fn_t)(tree_t t, void *context);
+void tree_filter_decls(tree_t t, tree_filter_fn_t fn, void *context);
+void tree_filter_stmts(tree_t t, tree_filter_fn_t fn, void *context);
+
 unsigned tree_else_stmts(tree_t t);
 tree_t tree_else_stmt(tree_t t, unsigned n);
 void tree_add_else_stmt(tree_t t, tree_t d);
@@ -334,20 +339,44 @@ typedef void (*tree_visit_fn_t)(tree_t t, void *context);
 unsigned tree_visit(tree_t t, tree_visit_fn_t fn, void *context);
 unsigned tree_visit_only(tree_t t, tree_visit_fn_t fn,
                          void *context, tree_kind_t kind);
+unsigned tree_visit_kinds(tree_t t, tree_visit_fn_t fn, void *context,
+                          const tree_kind_t *kinds, int nkinds);
+
+// Record every tree reachable from root by kind so that several kind
+// filtered visits of root only touch the matching trees: root must not
+// be modified other than by adding attributes until tree_index_end
+void tree_index_begin(tree_t root);
+void tree_index_end(void);
 
 typedef tree_t (*tree_rewrite_fn_t)(tree_t t, void *context);
 tree_t tree_rewrite(tree_t t, tree_rewrite_fn_t fn, void *context);
 
+// As tree_rewrite but also call visit with each rewritten tree which is
+// not only reachable through a type, saving a separate tree_visit of the
+// result
+tree_t tree_rewrite_visit(tree_t t, tree_rewrite_fn_t fn,
+                          tree_visit_fn_t visit, void *context);
+
 typedef bool (*tree_copy_fn_t)(tree_t t, void *context);
 tree_t tree_copy(tree_t t, tree_copy_fn_t fn, void *context);
 
 void tree_gc(void);
 
-tree_wr_ctx_t tree_write_begin(fbuf_t *f);
+// Trees and types created while an arena is pushed are allocated from
+// it and freed together when the arena is freed rather than by tree_gc
+typedef struct object_arena tree_arena_t;
+
+tree_arena_t *tree_arena_new(void);
+void tree_arena_push(tree_arena_t *arena);
+void tree_arena_pop(void);
+void tree_arena_free(tree_arena_t *arena);
+
+tree_wr_ctx_t tree_write_begin(fbuf_t *f, ident_table_t *idents);
 void tree_write(tree_t t, tree_wr_ctx_t ctx);
 void tree_write_end(tree_wr_ctx_t ctx);
 
-tree_rd_ctx_t tree_read_begin(fbuf_t *f, const char *name);
+tree_rd_ctx_t tree_read_begin(fbuf_t *f, const char *name,
+                              ident_table_t *idents);
 tree_t tree_read(tree_rd_ctx_t ctx);
 void tree_read_end(tree_rd_ctx_t ctx);
 
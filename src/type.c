@@ -21,6 +21,7 @@
 #include "array.h"
 #include "common.h"
 #include "object.h"
+#include "hash.h"
 
 #include <assert.h>
 #include <limits.h>
@@ -110,6 +111,8 @@ struct type_rd_ctx {
    unsigned       store_sz;
 };
 
+static hash_t *intern_table = NULL;
+
 object_class_t type_object = {
    .name           = "type",
    .change_allowed = change_allowed,
@@ -151,6 +154,9 @@ bool type_eq(type_t a, type_t b)
    while ((kind_b = b->object.kind) == T_SUBTYPE)
       b = type_base(b);
 
+   if (a == b)
+      return true;
+
    const bool compare_c_u_arrays =
       (kind_a == T_CARRAY && kind_b == T_UARRAY)
       || (kind_a == T_UARRAY && kind_b == T_CARRAY);
@@ -247,7 +253,8 @@ void type_set_ident(type_t t, ident_t id)
 
 unsigned type_dims(type_t t)
 {
-   return lookup_item(&type_object, t, I_DIMS)->range_array.count;
+   item_t *item = lookup_item(&type_object, t, I_DIMS);
+   return range_array_count(&(item->range_array));
 }
 
 range_t type_dim(type_t t, unsigned n)
@@ -264,8 +271,8 @@ void type_add_dim(type_t t, range_t r)
 void type_change_dim(type_t t, unsigned n, range_t r)
 {
    item_t *item = lookup_item(&type_object, t, I_DIMS);
-   assert(n < item->range_array.count);
-   item->range_array.items[n] = r;
+   assert(n < range_array_count(&(item->range_array)));
+   *range_array_nth_ptr(&(item->range_array), n) = r;
 }
 
 type_t type_base(type_t t)
@@ -370,7 +377,8 @@ bool type_is_universal(type_t t)
 
 unsigned type_units(type_t t)
 {
-   return lookup_item(&type_object, t, I_UNITS)->tree_array.count;
+   item_t *item = lookup_item(&type_object, t, I_UNITS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t type_unit(type_t t, unsigned n)
@@ -386,7 +394,8 @@ void type_add_unit(type_t t, tree_t u)
 
 unsigned type_enum_literals(type_t t)
 {
-   return lookup_item(&type_object, t, I_LITERALS)->tree_array.count;
+   item_t *item = lookup_item(&type_object, t, I_LITERALS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t type_enum_literal(type_t t, unsigned n)
@@ -403,7 +412,8 @@ void type_enum_add_literal(type_t t, tree_t lit)
 
 unsigned type_params(type_t t)
 {
-   return lookup_item(&type_object, t, I_PTYPES)->type_array.count;
+   item_t *item = lookup_item(&type_object, t, I_PTYPES);
+   return type_array_count(&(item->type_array));
 }
 
 type_t type_param(type_t t, unsigned n)
@@ -420,16 +430,17 @@ void type_add_param(type_t t, type_t p)
 void type_change_param(type_t t, unsigned n, type_t p)
 {
    type_array_t *a = &(lookup_item(&type_object, t, I_PTYPES)->type_array);
-   assert(n < a->count);
-   a->items[n] = p;
+   *type_array_nth_ptr(a, n) = p;
 }
 
 unsigned type_fields(type_t t)
 {
    if (t->object.kind == T_SUBTYPE)
       return type_fields(type_base(t));
-   else
-      return lookup_item(&type_object, t, I_FIELDS)->tree_array.count;
+   else {
+      item_t *item = lookup_item(&type_object, t, I_FIELDS);
+      return tree_array_count(&(item->tree_array));
+   }
 }
 
 tree_t type_field(type_t t, unsigned n)
@@ -450,7 +461,8 @@ void type_add_field(type_t t, tree_t p)
 
 unsigned type_decls(type_t t)
 {
-   return lookup_item(&type_object, t, I_DECLS)->tree_array.count;
+   item_t *item = lookup_item(&type_object, t, I_DECLS);
+   return tree_array_count(&(item->tree_array));
 }
 
 tree_t type_decl(type_t t, unsigned n)
@@ -476,6 +488,114 @@ void type_set_result(type_t t, type_t r)
    lookup_item(&type_object, t, I_RESULT)->type = r;
 }
 
+static bool type_intern_bound(tree_t t, uint64_t *hash)
+{
+   // Only integer literal bounds are compared by value as any other
+   // expression may depend on the scope it appears in
+
+   if (tree_kind(t) != T_LITERAL || tree_subkind(t) != L_INT)
+      return false;
+   else if (!tree_has_type(t))
+      return false;
+
+   *hash = (*hash ^ tree_ival(t)) * UINT64_C(0x100000001b3);
+   *hash = (*hash ^ (uintptr_t)tree_type(t)) * UINT64_C(0x100000001b3);
+   return true;
+}
+
+static bool type_intern_same_bound(tree_t a, tree_t b)
+{
+   return tree_ival(a) == tree_ival(b) && tree_type(a) == tree_type(b);
+}
+
+static bool type_intern_same(type_t a, type_t b)
+{
+   if (type_base(a) != type_base(b))
+      return false;
+
+   if (lookup_item(&type_object, a, I_IDENT)->ident
+       != lookup_item(&type_object, b, I_IDENT)->ident)
+      return false;
+
+   tree_t ca = type_constraint(a);
+   tree_t cb = type_constraint(b);
+
+   if (tree_subkind(ca) != tree_subkind(cb))
+      return false;
+
+   const int nranges = tree_ranges(ca);
+   if (tree_ranges(cb) != nranges)
+      return false;
+
+   for (int i = 0; i < nranges; i++) {
+      range_t ra = tree_range(ca, i);
+      range_t rb = tree_range(cb, i);
+
+      if (ra.kind != rb.kind)
+         return false;
+      else if (!type_intern_same_bound(ra.left, rb.left))
+         return false;
+      else if (!type_intern_same_bound(ra.right, rb.right))
+         return false;
+   }
+
+   return true;
+}
+
+type_t type_intern(type_t t)
+{
+   // Anonymous subtypes such as std_logic_vector(7 downto 0) are
+   // created afresh at every use: share one object between all those
+   // with the same base and literal bounds so type_eq can compare
+   // pointers and the library only contains a single copy
+
+   if (t->object.kind != T_SUBTYPE)
+      return t;
+   else if (type_has_resolution(t) || !type_has_constraint(t))
+      return t;
+
+   tree_t c = type_constraint(t);
+
+   uint64_t hash = UINT64_C(0xcbf29ce484222325);
+   hash = (hash ^ (uintptr_t)type_base(t)) * UINT64_C(0x100000001b3);
+   hash = (hash ^ tree_subkind(c)) * UINT64_C(0x100000001b3);
+
+   const int nranges = tree_ranges(c);
+   for (int i = 0; i < nranges; i++) {
+      range_t r = tree_range(c, i);
+      hash = (hash ^ r.kind) * UINT64_C(0x100000001b3);
+      if (!type_intern_bound(r.left, &hash))
+         return t;
+      else if (!type_intern_bound(r.right, &hash))
+         return t;
+   }
+
+   if (intern_table == NULL)
+      intern_table = hash_new(256, false);
+
+   // Hash values are used directly as keys and zero is not allowed
+   const void *key = (const void *)(uintptr_t)(hash | 1);
+
+   int k = 0, tmp;
+   type_t it;
+   while (tmp = k++, (it = hash_get_nth(intern_table, key, &tmp))) {
+      if (it == t || type_intern_same(it, t))
+         return it;
+   }
+
+   hash_put(intern_table, key, t);
+   return t;
+}
+
+void type_intern_reset(void)
+{
+   // Called when objects may be freed as the table is not a GC root
+   if (intern_table != NULL) {
+      hash_free(intern_table);
+      intern_table = NULL;
+   }
+}
+
 void type_replace(type_t t, type_t a)
 {
    assert(t != NULL);
@@ -491,7 +611,8 @@ void type_change_kind(type_t t, type_kind_t kind)
 
 unsigned type_index_constrs(type_t t)
 {
-   return lookup_item(&type_object, t, I_INDEXCON)->type_array.count;
+   item_t *item = lookup_item(&type_object, t, I_INDEXCON);
+   return type_array_count(&(item->type_array));
 }
 
 void type_add_index_constr(type_t t, type_t c)
@@ -502,8 +623,7 @@ void type_add_index_constr(type_t t, type_t c)
 void type_change_index_constr(type_t t, unsigned n, type_t c)
 {
    type_array_t *a = &(lookup_item(&type_object, t, I_INDEXCON)->type_array);
-   assert(n < a->count);
-   a->items[n] = c;
+   *type_array_nth_ptr(a, n) = c;
 }
 
 type_t type_index_constr(type_t t, unsigned n)
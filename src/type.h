@@ -113,6 +113,10 @@ void type_set_body(type_t t, tree_t b);
 bool type_has_body(type_t t);
 
 void type_replace(type_t t, type_t a);
+
+// Returns a shared object for anonymous subtypes with literal bounds
+type_t type_intern(type_t t);
+void type_intern_reset(void);
 void type_change_kind(type_t t, type_kind_t kind);
 
 void type_set_resolution(type_t t, tree_t r);
@@ -1444,6 +1444,11 @@ int64_t ipow(int64_t x, int64_t y)
 
 void *mmap_guarded(size_t sz, const char *tag)
 {
+   // Reserve address space for sz bytes followed by a guard page. No
+   // memory is committed until mmap_commit is called on part of the
+   // range so large reservations are not charged against the commit
+   // limit
+
 #ifndef __MINGW32__
    const long pagesz = sysconf(_SC_PAGESIZE);
 #else
@@ -1454,36 +1459,24 @@ void *mmap_guarded(size_t sz, const char *tag)
       sz = (sz & ~pagemsk) + pagesz;
 
 #if (defined __APPLE__ || defined __OpenBSD__)
-   const int flags = MAP_SHARED | MAP_ANON;
+   const int flags = MAP_PRIVATE | MAP_ANON;
+#elif defined MAP_NORESERVE
+   const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
 #elif !(defined __MINGW32__)
-   const int flags = MAP_SHARED | MAP_ANONYMOUS;
+   const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
 #endif
 
 #ifndef __MINGW32__
-   void *ptr = mmap(NULL, sz + pagesz, PROT_READ | PROT_WRITE, flags, -1, 0);
+   void *ptr = mmap(NULL, sz + pagesz, PROT_NONE, flags, -1, 0);
    if (ptr == MAP_FAILED)
       fatal_errno("mmap");
 #else
-   HANDLE handle = CreateFileMapping(NULL, NULL, PAGE_READWRITE,
-                                     0, sz + pagesz, NULL);
-   if (!handle)
-      fatal_errno("CreateFileMapping");
-
-   void *ptr = MapViewOfFileEx(handle, FILE_MAP_ALL_ACCESS, 0,
-                               0, (SIZE_T) (sz + pagesz), (LPVOID) NULL);
-   CloseHandle(handle);
+   void *ptr = VirtualAlloc(NULL, sz + pagesz, MEM_RESERVE, PAGE_NOACCESS);
    if (ptr == NULL)
-      fatal_errno("MapViewOfFileEx");
+      fatal_errno("VirtualAlloc");
 #endif
    uint8_t *guard_ptr = (uint8_t *)ptr + sz;
-#ifndef __MINGW32__
-   if (mprotect(guard_ptr, pagesz, PROT_NONE) < 0)
-      fatal_errno("mprotect");
-#else
-   DWORD old_prot;
-   if (!VirtualProtect(guard_ptr, pagesz, PAGE_NOACCESS, &old_prot))
-      fatal_errno("VirtualProtect");
-#endif
+
    guard_t *guard = xmalloc(sizeof(guard_t));
    guard->next  = guards;
    guard->tag   = tag;
@@ -1495,6 +1488,20 @@ void *mmap_guarded(size_t sz, const char *tag)
    return ptr;
 }
 
+void mmap_commit(void *ptr, size_t sz)
+{
+   // Make sz bytes at page aligned ptr in a region returned by
+   // mmap_guarded readable and writable
+
+#ifndef __MINGW32__
+   if (mprotect(ptr, sz, PROT_READ | PROT_WRITE) < 0)
+      fatal_errno("mprotect");
+#else
+   if (VirtualAlloc(ptr, sz, MEM_COMMIT, PAGE_READWRITE) == NULL)
+      fatal_errno("VirtualAlloc");
+#endif
+}
+
 int checked_sprintf(char *buf, int len, const char *fmt, ...)
 {
    assert(len > 0);
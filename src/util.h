@@ -147,6 +147,7 @@ int ilog2(int64_t n) __attribute__((pure));
 int64_t ipow(int64_t x, int64_t y)  __attribute__((pure));
 
 void *mmap_guarded(size_t sz, const char *tag);
+void mmap_commit(void *ptr, size_t sz);
 
 void run_program(const char *const *args, size_t n_args);
 
@@ -52,6 +52,8 @@ DECLARE_AND_DEFINE_ARRAY(vcode_type);
    (x == VCODE_OP_CONST_REAL)
 #define OP_HAS_VALUE(x)                                                 \
    (x == VCODE_OP_CONST || x == VCODE_OP_ADDI)
+#define OP_HAS_DATA(x)                                                  \
+   (x == VCODE_OP_CONST_ARRAY)
 #define OP_HAS_SIGNAL(x)                                                \
    (x == VCODE_OP_NETS || x == VCODE_OP_RESOLVED_ADDRESS                \
     || x == VCODE_OP_SET_INITIAL || x == VCODE_OP_NEEDS_LAST_VALUE)
@@ -82,6 +84,13 @@ DECLARE_AND_DEFINE_ARRAY(vcode_type);
 #define OP_HAS_RESOLUTION(x)                                            \
    (x == VCODE_OP_SET_INITIAL)
 
+// Large constant arrays of integers hold their elements directly
+// rather than as a register per element
+typedef struct {
+   unsigned count;
+   int64_t  values[0];
+} const_data_t;
+
 typedef struct {
    vcode_op_t          kind;
    vcode_reg_array_t   args;
@@ -109,6 +118,7 @@ typedef struct {
       char            *hint;          // OP_HAS_HINT
       uint32_t         tag;           // OP_HAS_TAG
       image_map_t     *image_map;     // OP_HAS_IMAGE_MAP
+      const_data_t    *data;          // OP_HAS_DATA
    };
 } op_t;
 
@@ -234,12 +244,13 @@ struct vcode_unit {
    VCODE_FOR_EACH_OP(name) if (name->kind == k)
 
 #define VCODE_MAGIC        0x76636f64
-#define VCODE_VERSION      6
+#define VCODE_VERSION      8
 #define VCODE_CHECK_UNIONS 0
 
 static vcode_unit_t  active_unit = NULL;
 static vcode_block_t active_block = VCODE_INVALID_BLOCK;
 static hash_t       *registry = NULL;
+static unsigned      checks_elided = 0;
 
 static inline int64_t sadd64(int64_t a, int64_t b)
 {
@@ -597,6 +608,8 @@ void vcode_unit_unref(vcode_unit_t unit)
             free(o->image_map->values);
             free(o->image_map);
          }
+         if (OP_HAS_DATA(o->kind))
+            free(o->data);
          free(o->args.items);
       }
       free(b->ops.items);
@@ -617,6 +630,18 @@ void vcode_unit_unref(vcode_unit_t unit)
    free(unit);
 }
 
+void vcode_unit_free(vcode_unit_t unit)
+{
+   // Release a unit along with all its nested subprograms which each
+   // hold a reference to their parent
+
+   while (unit->children != NULL)
+      vcode_unit_free(unit->children);
+
+   assert(unit->refcount == 1);
+   vcode_unit_unref(unit);
+}
+
 vcode_unit_t vcode_unit_next(vcode_unit_t unit)
 {
    return unit->next;
@@ -670,6 +695,88 @@ bool vcode_reg_const(vcode_reg_t reg, int64_t *value)
       return false;
 }
 
+static void vcode_opt_mark_live(vcode_unit_t unit, unsigned depth, bool *live)
+{
+   for (int i = 0; i < unit->blocks.count; i++) {
+      block_t *b = &(unit->blocks.items[i]);
+
+      for (int j = 0; j < b->ops.count; j++) {
+         op_t *o = &(b->ops.items[j]);
+         switch (o->kind) {
+         case VCODE_OP_LOAD:
+         case VCODE_OP_INDEX:
+         case VCODE_OP_RESOLVED_ADDRESS:
+            if (MASK_CONTEXT(o->address) == depth)
+               live[MASK_INDEX(o->address)] = true;
+            break;
+
+         default:
+            break;
+         }
+      }
+   }
+
+   for (vcode_unit_t it = unit->children; it != NULL; it = it->next)
+      vcode_opt_mark_live(it, depth, live);
+}
+
+static void vcode_opt_kill_stores(vcode_unit_t unit, vcode_unit_t owner,
+                                  const bool *live)
+{
+   for (int i = 0; i < unit->blocks.count; i++) {
+      block_t *b = &(unit->blocks.items[i]);
+
+      for (int j = 0; j < b->ops.count; j++) {
+         op_t *o = &(b->ops.items[j]);
+         if (o->kind != VCODE_OP_STORE
+             || MASK_CONTEXT(o->address) != owner->depth)
+            continue;
+
+         const int index = MASK_INDEX(o->address);
+         if (live[index])
+            continue;
+
+         o->kind = VCODE_OP_COMMENT;
+         o->comment = xasprintf("Dead store to %s",
+                                istr(owner->vars.items[index].name));
+         vcode_reg_array_resize(&(o->args), 0, VCODE_INVALID_REG);
+      }
+   }
+
+   for (vcode_unit_t it = unit->children; it != NULL; it = it->next)
+      vcode_opt_kill_stores(it, owner, live);
+}
+
+static void vcode_opt_dead_stores(vcode_unit_t unit)
+{
+   // Remove stores to variables which are never read by this unit or
+   // any nested subprogram: emit_store can only see earlier stores in
+   // the same block so these are otherwise kept
+
+   if (unit->kind == VCODE_UNIT_CONTEXT)
+      return;   // Variables may be read by other units
+
+   const int nvars = unit->vars.count;
+   if (nvars == 0)
+      return;
+
+   bool *live LOCAL = xcalloc(nvars * sizeof(bool));
+
+   for (int i = 0; i < nvars; i++) {
+      if (unit->vars.items[i].flags & VAR_EXTERN)
+         live[i] = true;
+   }
+
+   for (unsigned i = 0; i < unit->signals.count; i++) {
+      const vcode_var_t shadow = unit->signals.items[i].shadow;
+      if (shadow != VCODE_INVALID_VAR && MASK_CONTEXT(shadow) == unit->depth)
+         live[MASK_INDEX(shadow)] = true;
+   }
+
+   vcode_opt_mark_live(unit, unit->depth, live);
+   vcode_opt_kill_stores(unit, unit, live);
+}
+
 void vcode_opt(void)
 {
    // Prune assignments to unused registers
@@ -773,6 +880,31 @@ void vcode_opt(void)
    }
 }
 
+static void vcode_optimise_aux(vcode_unit_t unit)
+{
+   vcode_select_unit(unit);
+
+   // Removing stores first leaves more registers unused for pruning
+   vcode_opt_dead_stores(unit);
+   vcode_opt();
+
+   for (vcode_unit_t it = unit->children; it != NULL; it = it->next)
+      vcode_optimise_aux(it);
+}
+
+void vcode_optimise(vcode_unit_t unit)
+{
+   // Passes here need to see all the nested subprograms of a unit so
+   // are run once lowering is complete rather than from vcode_opt
+
+   vcode_state_t state;
+   vcode_state_save(&state);
+
+   vcode_optimise_aux(unit);
+
+   vcode_state_restore(&state);
+}
+
 void vcode_close(void)
 {
    active_unit  = NULL;
@@ -979,6 +1111,18 @@ vcode_var_t vcode_get_type(int op)
    return o->type;
 }
 
+const int64_t *vcode_get_data(int op, int *count)
+{
+   op_t *o = vcode_op_data(op);
+   assert(OP_HAS_DATA(o->kind));
+
+   if (o->data == NULL)
+      return NULL;
+
+   *count = o->data->count;
+   return o->data->values;
+}
+
 int vcode_count_args(int op)
 {
    return vcode_op_data(op)->args.count;
@@ -1623,6 +1767,14 @@ void vcode_dump_with_mark(int mark_op)
                      col += printf(",");
                   col += vcode_dump_reg(op->args.items[k]);
                }
+               if (OP_HAS_DATA(op->kind) && op->data != NULL) {
+                  const unsigned nshow = MIN(op->data->count, 8);
+                  for (unsigned k = 0; k < nshow; k++)
+                     col += printf("%s%"PRIi64, k > 0 ? "," : "",
+                                   op->data->values[k]);
+                  if (nshow < op->data->count)
+                     col += printf(",... %u values", op->data->count);
+               }
 
                putchar(op->kind == VCODE_OP_CONST_ARRAY ? ']' : '}');
                vcode_dump_result_type(col + 1, op);
@@ -3072,6 +3224,7 @@ vcode_reg_t emit_const_array(vcode_type_t type, vcode_reg_t *values, int num,
    op_t *op = vcode_add_op(VCODE_OP_CONST_ARRAY);
    op->type   = type;
    op->result = vcode_add_reg(rtype);
+   op->data   = NULL;
 
    for (int i = 0; i < num; i++)
       vcode_add_arg(op, values[i]);
@@ -3087,6 +3240,48 @@ vcode_reg_t emit_const_array(vcode_type_t type, vcode_reg_t *values, int num,
    return op->result;
 }
 
+vcode_reg_t emit_const_data(vcode_type_t type, const int64_t *values, int num,
+                            bool allocate)
+{
+   // Same as emit_const_array but for integer elements given directly
+   // which avoids a register for each element of a large table
+
+   vtype_kind_t kind = vtype_kind(type);
+   vcode_type_t rtype = allocate && kind == VCODE_TYPE_CARRAY
+      ? vtype_pointer(vtype_elem(type))
+      : type;
+
+   VCODE_FOR_EACH_MATCHING_OP(other, VCODE_OP_CONST_ARRAY) {
+      if (other->data != NULL && other->data->count == num
+          && vtype_eq(type, other->type)
+          && vtype_eq(vcode_reg_type(other->result), rtype)
+          && memcmp(other->data->values, values,
+                    num * sizeof(int64_t)) == 0)
+         return other->result;
+   }
+
+   op_t *op = vcode_add_op(VCODE_OP_CONST_ARRAY);
+   op->type   = type;
+   op->result = vcode_add_reg(rtype);
+
+   op->data = xmalloc(sizeof(const_data_t) + num * sizeof(int64_t));
+   op->data->count = num;
+   memcpy(op->data->values, values, num * sizeof(int64_t));
+
+   VCODE_ASSERT(
+      kind == VCODE_TYPE_CARRAY || (allocate && kind == VCODE_TYPE_POINTER),
+      "constant array must have constrained array type");
+
+   reg_t *r = vcode_reg_data(op->result);
+   r->bounds = (kind == VCODE_TYPE_POINTER)
+      ? vtype_pointed(type) : vtype_elem(type);
+
+   VCODE_ASSERT(vtype_kind(r->bounds) == VCODE_TYPE_INT,
+                "constant data must have integer elements");
+
+   return op->result;
+}
+
 vcode_reg_t emit_const_record(vcode_type_t type, vcode_reg_t *values, int num)
 {
    // Reuse any previous constant in this block with the same type and value
@@ -3555,6 +3750,37 @@ vcode_reg_t emit_addi(vcode_reg_t lhs, int64_t rhs)
    return op->result;
 }
 
+static bool vcode_check_dominated(vcode_op_t kind, const vcode_reg_t *args,
+                                  int nargs, int nmatch, vcode_type_t bounds)
+{
+   // A check on the same registers as one earlier in the block with at
+   // least as narrow a range cannot fail as the earlier would have
+
+   VCODE_FOR_EACH_MATCHING_OP(other, kind) {
+      if (other->args.count != nargs)
+         continue;
+
+      int i = 0;
+      while (i < nmatch && other->args.items[i] == args[i])
+         i++;
+
+      if (i < nmatch)
+         continue;
+      else if (bounds == VCODE_INVALID_TYPE)
+         return true;
+      else if (other->type != VCODE_INVALID_TYPE
+               && vtype_includes(bounds, other->type))
+         return true;
+   }
+
+   return false;
+}
+
+unsigned vcode_checks_elided(void)
+{
+   return checks_elided;
+}
+
 void emit_bounds(vcode_reg_t reg, vcode_type_t bounds, bounds_kind_t kind,
                  const char *hint)
 {
@@ -3562,6 +3788,12 @@ void emit_bounds(vcode_reg_t reg, vcode_type_t bounds, bounds_kind_t kind,
       return;
    else if (vtype_includes(bounds, vcode_reg_data(reg)->bounds)) {
       emit_comment("Elided bounds check for r%d", reg);
+      checks_elided++;
+      return;
+   }
+   else if (vcode_check_dominated(VCODE_OP_BOUNDS, &reg, 1, 1, bounds)) {
+      emit_comment("Elided repeated bounds check for r%d", reg);
+      checks_elided++;
       return;
    }
 
@@ -4154,6 +4386,11 @@ vcode_reg_t emit_param_upref(int hops, vcode_reg_t reg)
 
 void emit_resolved_address(vcode_var_t var, vcode_signal_t signal)
 {
+   VCODE_FOR_EACH_MATCHING_OP(other, VCODE_OP_RESOLVED_ADDRESS) {
+      if (other->address == var && other->signal == signal)
+         return;
+   }
+
    op_t *op = vcode_add_op(VCODE_OP_RESOLVED_ADDRESS);
    op->signal  = signal;
    op->address = var;
@@ -4637,6 +4874,7 @@ void emit_dynamic_bounds(vcode_reg_t reg, vcode_reg_t low, vcode_reg_t high,
       vcode_type_t bounds = vcode_reg_bounds(reg);
       if (lconst <= vtype_low(bounds) && hconst >= vtype_high(bounds)) {
          emit_comment("Elided dynamic bounds check for r%d", reg);
+         checks_elided++;
          return;
       }
 
@@ -4648,6 +4886,31 @@ void emit_dynamic_bounds(vcode_reg_t reg, vcode_reg_t low, vcode_reg_t high,
    }
    else if (reg == low || reg == high) {
       emit_comment("Elided dynamic bounds check for r%d", reg);
+      checks_elided++;
+      return;
+   }
+   else if (vcode_reg_kind(reg) == VCODE_TYPE_INT) {
+      // The ranges of the registers may still show the value is always
+      // between the limits
+      vcode_type_t rbounds = vcode_reg_bounds(reg);
+      vcode_type_t lbounds = vcode_reg_bounds(low);
+      vcode_type_t hbounds = vcode_reg_bounds(high);
+      if (vtype_kind(lbounds) == VCODE_TYPE_INT
+          && vtype_kind(hbounds) == VCODE_TYPE_INT
+          && vtype_kind(rbounds) == VCODE_TYPE_INT
+          && vtype_high(lbounds) <= vtype_low(rbounds)
+          && vtype_high(rbounds) <= vtype_low(hbounds)) {
+         emit_comment("Elided dynamic bounds check for r%d", reg);
+         checks_elided++;
+         return;
+      }
+   }
+
+   const vcode_reg_t args[] = { reg, low, high, kind };
+   if (vcode_check_dominated(VCODE_OP_DYNAMIC_BOUNDS, args, 4, 3,
+                             VCODE_INVALID_TYPE)) {
+      emit_comment("Elided repeated dynamic bounds check for r%d", reg);
+      checks_elided++;
       return;
    }
 
@@ -4705,6 +4968,15 @@ void emit_index_check(vcode_reg_t rlow, vcode_reg_t rhigh, vcode_type_t bounds,
    if (vtype_includes(bounds, vcode_reg_data(rlow)->bounds)
        && vtype_includes(bounds, vcode_reg_data(rhigh)->bounds)) {
       emit_comment("Elided index check for r%d and r%d", rlow, rhigh);
+      checks_elided++;
+      return;
+   }
+
+   const vcode_reg_t args[] = { rlow, rhigh };
+   if (vcode_check_dominated(VCODE_OP_INDEX_CHECK, args, 2, 2, bounds)) {
+      emit_comment("Elided repeated index check for r%d and r%d",
+                   rlow, rhigh);
+      checks_elided++;
       return;
    }
 
@@ -4720,6 +4992,15 @@ void emit_dynamic_index_check(vcode_reg_t rlow, vcode_reg_t rhigh,
                               vcode_reg_t blow, vcode_reg_t bhigh,
                               bounds_kind_t kind)
 {
+   const vcode_reg_t args[] = { rlow, rhigh, blow, bhigh };
+   if (vcode_check_dominated(VCODE_OP_INDEX_CHECK, args, 4, 4,
+                             VCODE_INVALID_TYPE)) {
+      emit_comment("Elided repeated index check for r%d and r%d",
+                   rlow, rhigh);
+      checks_elided++;
+      return;
+   }
+
    op_t *op = emit_index_check_null(rlow, rhigh, kind);
    if (op != NULL) {
       vcode_add_arg(op, blow);
@@ -4898,6 +5179,67 @@ void emit_debug_info(const loc_t *loc)
    b->last_loc = *loc;
 }
 
+static void vcode_write_data(const const_data_t *data, fbuf_t *f)
+{
+   // Elements are stored little-endian in the fewest bytes that can
+   // hold every value
+   if (data == NULL) {
+      write_u8(0, f);
+      return;
+   }
+
+   int width = 1;
+   for (unsigned i = 0; i < data->count; i++) {
+      const int64_t v = data->values[i];
+      if (v < INT32_MIN || v > INT32_MAX)
+         width = 8;
+      else if (width < 4 && (v < INT16_MIN || v > INT16_MAX))
+         width = 4;
+      else if (width < 2 && (v < INT8_MIN || v > INT8_MAX))
+         width = 2;
+   }
+
+   write_u8(width, f);
+   write_u32(data->count, f);
+
+   uint8_t *buf LOCAL = xmalloc(data->count * width);
+   for (unsigned i = 0; i < data->count; i++) {
+      const uint64_t v = data->values[i];
+      for (int j = 0; j < width; j++)
+         buf[i * width + j] = v >> (j * 8);
+   }
+
+   write_raw(buf, data->count * width, f);
+}
+
+static const_data_t *vcode_read_data(fbuf_t *f)
+{
+   const int width = read_u8(f);
+   if (width == 0)
+      return NULL;
+
+   const unsigned count = read_u32(f);
+
+   const_data_t *data =
+      xmalloc(sizeof(const_data_t) + count * sizeof(int64_t));
+   data->count = count;
+
+   uint8_t *buf LOCAL = xmalloc(count * width);
+   read_raw(buf, count * width, f);
+
+   for (unsigned i = 0; i < count; i++) {
+      uint64_t v = 0;
+      for (int j = 0; j < width; j++)
+         v |= (uint64_t)buf[i * width + j] << (j * 8);
+
+      // Sign extend from the stored width
+      const int shift = 64 - width * 8;
+      data->values[i] = shift ? (int64_t)(v << shift) >> shift : (int64_t)v;
+   }
+
+   return data;
+}
+
 static void vcode_write_unit(vcode_unit_t unit, fbuf_t *f,
                              ident_wr_ctx_t ident_wr_ctx)
 {
@@ -4942,7 +5284,7 @@ static void vcode_write_unit(vcode_unit_t unit, fbuf_t *f,
          if (OP_HAS_FUNC(op->kind))
             ident_write(op->func, ident_wr_ctx);
          if (OP_HAS_SUBKIND(op->kind))
-            write_u8(op->subkind, f);
+            write_u32(op->subkind, f);
          if (OP_HAS_CMP(op->kind))
             write_u8(op->cmp, f);
          if (OP_HAS_VALUE(op->kind))
@@ -4988,6 +5330,8 @@ static void vcode_write_unit(vcode_unit_t unit, fbuf_t *f,
             else
                write_u8(0, f);
          }
+         if (OP_HAS_DATA(op->kind))
+            vcode_write_data(op->data, f);
          if (OP_HAS_RESOLUTION(op->kind)) {
             write_u32(op->resolution->count, f);
             if (op->resolution->count > 0) {
@@ -5094,14 +5438,14 @@ static void vcode_write_unit(vcode_unit_t unit, fbuf_t *f,
       vcode_write_unit(unit->children, f, ident_wr_ctx);
 }
 
-void vcode_write(vcode_unit_t unit, fbuf_t *f)
+void vcode_write(vcode_unit_t unit, fbuf_t *f, ident_table_t *idents)
 {
    assert(unit->kind = VCODE_UNIT_CONTEXT);
 
    write_u32(VCODE_MAGIC, f);
    write_u8(VCODE_VERSION, f);
 
-   ident_wr_ctx_t ident_wr_ctx = ident_write_begin(f);
+   ident_wr_ctx_t ident_wr_ctx = ident_write_begin(f, idents);
    vcode_write_unit(unit, f, ident_wr_ctx);
    write_u8(0xff, f);  // End marker
    ident_write_end(ident_wr_ctx);
@@ -5159,7 +5503,7 @@ static bool vcode_read_unit(fbuf_t *f, ident_rd_ctx_t ident_rd_ctx)
          if (OP_HAS_FUNC(op->kind))
             op->func = ident_read(ident_rd_ctx);
          if (OP_HAS_SUBKIND(op->kind))
-            op->subkind = read_u8(f);
+            op->subkind = read_u32(f);
          if (OP_HAS_CMP(op->kind))
             op->cmp = read_u8(f);
          if (OP_HAS_VALUE(op->kind))
@@ -5211,6 +5555,8 @@ static bool vcode_read_unit(fbuf_t *f, ident_rd_ctx_t ident_rd_ctx)
             else
                op->image_map->values = NULL;
          }
+         if (OP_HAS_DATA(op->kind))
+            op->data = vcode_read_data(f);
          if (OP_HAS_RESOLUTION(op->kind)) {
             size_t count = read_u32(f);
             if (count == 0)
@@ -5322,7 +5668,7 @@ static bool vcode_read_unit(fbuf_t *f, ident_rd_ctx_t ident_rd_ctx)
    return true;
 }
 
-void vcode_read(fbuf_t *f)
+void vcode_read(fbuf_t *f, ident_table_t *idents)
 {
    if (read_u32(f) != VCODE_MAGIC)
       fatal("%s has invalid vcode header", fbuf_file_name(f));
@@ -5332,7 +5678,7 @@ void vcode_read(fbuf_t *f)
       fatal("%s was created with vcode format version %d (expected %d)",
             fbuf_file_name(f), version, VCODE_VERSION);
 
-   ident_rd_ctx_t ident_rd_ctx = ident_read_begin(f);
+   ident_rd_ctx_t ident_rd_ctx = ident_read_begin(f, idents);
 
    while (vcode_read_unit(f, ident_rd_ctx))
       ;
@@ -5345,7 +5691,7 @@ void vcode_read(fbuf_t *f)
    (OP_HAS_CMP(x) + OP_HAS_VALUE(x) + OP_HAS_REAL(x) +                  \
     OP_HAS_COMMENT(x) + OP_HAS_SIGNAL(x) + OP_HAS_DIM(x) +              \
     OP_HAS_HOPS(x) + OP_HAS_FIELD(x) + OP_HAS_HINT(x) +                 \
-    OP_HAS_TAG(x))
+    OP_HAS_TAG(x) + OP_HAS_DATA(x))
 #define OP_USE_COUNT_U1(x)                                              \
    (OP_HAS_SUBKIND(x) + OP_HAS_FUNC(x) + OP_HAS_ADDRESS(x))
 #define OP_USE_COUNT_U2(x)                                              \
@@ -243,8 +243,11 @@ vcode_unit_t vcode_find_unit(ident_t name);
 vcode_unit_t vcode_unit_next(vcode_unit_t unit);
 vcode_unit_t vcode_unit_child(vcode_unit_t unit);
 void vcode_unit_unref(vcode_unit_t unit);
+void vcode_unit_free(vcode_unit_t unit);
 
 void vcode_opt(void);
+void vcode_optimise(vcode_unit_t unit);
+unsigned vcode_checks_elided(void);
 void vcode_close(void);
 void vcode_dump(void);
 void vcode_dump_with_mark(int mark_op);
@@ -265,8 +268,8 @@ vcode_block_t vcode_active_block(void);
 vcode_unit_t vcode_active_unit(void);
 vcode_unit_t vcode_unit_context(void);
 
-void vcode_write(vcode_unit_t unit, fbuf_t *fbuf);
-void vcode_read(fbuf_t *fbuf);
+void vcode_write(vcode_unit_t unit, fbuf_t *fbuf, ident_table_t *idents);
+void vcode_read(fbuf_t *fbuf, ident_table_t *idents);
 
 void vcode_state_save(vcode_state_t *state);
 void vcode_state_restore(const vcode_state_t *state);
@@ -302,6 +305,7 @@ const char *vcode_get_hint(int op);
 vcode_block_t vcode_get_target(int op, int nth);
 vcode_var_t vcode_get_address(int op);
 int vcode_count_args(int op);
+const int64_t *vcode_get_data(int op, int *count);
 vcode_reg_t vcode_get_arg(int op, int arg);
 vcode_type_t vcode_get_type(int op);
 vcode_reg_t vcode_get_result(int op);
@@ -345,6 +349,8 @@ vcode_reg_t emit_param(vcode_type_t type, vcode_type_t bounds, ident_t name);
 vcode_reg_t emit_const(vcode_type_t type, int64_t value);
 vcode_reg_t emit_const_array(vcode_type_t type, vcode_reg_t *values, int num,
                              bool allocate);
+vcode_reg_t emit_const_data(vcode_type_t type, const int64_t *values, int num,
+                            bool allocate);
 vcode_reg_t emit_const_record(vcode_type_t type, vcode_reg_t *values, int num);
 vcode_reg_t emit_const_real(double value);
 vcode_reg_t emit_add(vcode_reg_t lhs, vcode_reg_t rhs);
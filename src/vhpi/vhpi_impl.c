@@ -26,6 +26,7 @@
 //
 
 #include "vhpi_user.h"
+#include "vhpi_nvc.h"
 #include "util.h"
 #include "hash.h"
 #include "tree.h"
@@ -62,22 +63,34 @@ typedef enum {
    VHPI_CALLBACK,
    VHPI_TREE,
    VHPI_TYPE,
-   VHPI_RANGE
+   VHPI_RANGE,
+   VHPI_ITERATOR
 } vhpi_obj_kind_t;
 
 #define VHPI_ANY (vhpi_obj_kind_t)-1
 
+typedef struct {
+   tree_t   *decls;
+   unsigned  count;
+   unsigned  max;
+} vhpi_scope_t;
+
 struct vhpi_obj {
    uint32_t        magic;
    vhpiClassKindT  class;
    vhpi_obj_kind_t kind;
    unsigned        refcnt;
+   vhpiFormatT     format;
    vhpi_cb_t       cb;
    union {
       tree_t  tree;
       type_t  type;
       void   *pointer;
       range_t range;
+      struct {
+         vhpi_scope_t *scope;
+         unsigned      pos;
+      } iter;
    };
 };
 
@@ -90,6 +103,8 @@ typedef struct {
 static cb_list_t       cb_list;
 static tree_t          top_level;
 static hash_t         *handle_hash;
+static hash_t         *name_index;
+static hash_t         *scope_index;
 static vhpiErrorInfoT  last_error;
 static bool            trace_on = false;
 
@@ -170,7 +185,9 @@ static uint64_t vhpi_time_to_native(const vhpiTimeT *time)
 
 static const char *vhpi_obj_kind_str(vhpi_obj_kind_t kind)
 {
-   const char *names[] = { "callback", "tree", "type", "range" };
+   const char *names[] = {
+      "callback", "tree", "type", "range", "iterator"
+   };
    if ((unsigned int)kind > ARRAY_LEN(names))
       return "???";
    else
@@ -234,6 +251,10 @@ static const char *vhpi_pretty_handle(vhpiHandleT handle)
 
    case VHPI_RANGE:
       return "<range>";
+
+   case VHPI_ITERATOR:
+      return (buf = xasprintf("<iterator %u/%u>", handle->iter.pos,
+                              handle->iter.scope->count));
    }
 
    return "<\?\?\?>";
@@ -404,6 +425,69 @@ static vhpi_obj_t *vhpi_range_to_obj(range_t r)
    return obj;
 }
 
+static void vhpi_build_index(void)
+{
+   // Plugins such as cocotb resolve every signal by name at startup so
+   // index the elaborated declarations once rather than scanning them
+   // on each lookup
+   const int ndecls = tree_decls(top_level);
+
+   name_index  = hash_new(ndecls * 2, true);
+   scope_index = hash_new(64, true);
+
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top_level, i);
+      ident_t name = tree_ident(d);
+
+      if (hash_get(name_index, name) == NULL)
+         hash_put(name_index, name, d);
+
+      ident_t parent = ident_runtil(name, ':');
+      vhpi_scope_t *scope = hash_get(scope_index, parent);
+      if (scope == NULL) {
+         scope = xcalloc(sizeof(vhpi_scope_t));
+         hash_put(scope_index, parent, scope);
+      }
+
+      if (scope->count == scope->max) {
+         scope->max = MAX(scope->max * 2, 16);
+         scope->decls = xrealloc(scope->decls, scope->max * sizeof(tree_t));
+      }
+
+      scope->decls[(scope->count)++] = d;
+   }
+}
+
+static void vhpi_free_index(void)
+{
+   if (scope_index != NULL) {
+      hash_iter_t now = HASH_BEGIN;
+      const void *key;
+      void *value;
+      while (hash_iter(scope_index, &now, &key, &value)) {
+         vhpi_scope_t *scope = value;
+         free(scope->decls);
+         free(scope);
+      }
+
+      hash_free(scope_index);
+      scope_index = NULL;
+   }
+
+   if (name_index != NULL) {
+      hash_free(name_index);
+      name_index = NULL;
+   }
+}
+
+static ident_t vhpi_scope_name(tree_t scope)
+{
+   if (tree_kind(scope) == T_ELAB)
+      return tree_attr_str(scope, simple_name_i);
+   else
+      return tree_ident(scope);
+}
+
 static void vhpi_fire_event(vhpi_obj_t *obj)
 {
    if (obj->cb.released) {
@@ -666,20 +750,23 @@ vhpiHandleT vhpi_handle_by_name(const char *name, vhpiHandleT scope)
       root = scope->tree;
    }
 
-   ident_t search = NULL;
-   if (tree_kind(root) == T_ELAB)
-      search = ident_prefix(tree_attr_str(root, simple_name_i),
-                            ident_new(name), ':');
-   else
-      search = ident_prefix(tree_ident(root), ident_new(name), ':');
-
-   const int ndecls = tree_decls(top_level);
-   for (int i = 0; i < ndecls; i++) {
-      tree_t d = tree_decl(top_level, i);
-      if (tree_ident(d) == search)
-         return (vhpiHandleT)vhpi_tree_to_obj(d, vhpiSigDeclK);
+   // Nested names such as "sub.x" use the same separator as the
+   // elaborated hierarchical names
+   char *path LOCAL = xstrdup(name);
+   for (char *p = path; *p != '\0'; p++) {
+      if (*p == '.')
+         *p = ':';
    }
 
+   ident_t search = ident_prefix(vhpi_scope_name(root), ident_new(path), ':');
+
+   if (name_index == NULL)
+      vhpi_build_index();
+
+   tree_t d = hash_get(name_index, search);
+   if (d != NULL)
+      return (vhpiHandleT)vhpi_tree_to_obj(d, vhpiSigDeclK);
+
    vhpi_error(vhpiError, NULL, "object %s not found", istr(search));
    return NULL;
 }
@@ -761,15 +848,56 @@ vhpiHandleT vhpi_handle(vhpiOneToOneT type, vhpiHandleT referenceHandle)
 
 vhpiHandleT vhpi_iterator(vhpiOneToManyT type, vhpiHandleT handle)
 {
+   vhpi_clear_error();
+
    VHPI_TRACE("type=%s handle=%s", vhpi_one_to_many_str(type),
               vhpi_pretty_handle(handle));
 
-   VHPI_MISSING;
+   switch (type) {
+   case vhpiDecls:
+   case vhpiSigDecls:
+      {
+         if (!vhpi_validate_handle(handle, VHPI_TREE))
+            return NULL;
+
+         if (name_index == NULL)
+            vhpi_build_index();
+
+         vhpi_scope_t *scope =
+            hash_get(scope_index, vhpi_scope_name(handle->tree));
+         if (scope == NULL)
+            return NULL;
+
+         vhpi_obj_t *obj = xcalloc(sizeof(vhpi_obj_t));
+         obj->magic      = VHPI_MAGIC;
+         obj->kind       = VHPI_ITERATOR;
+         obj->class      = vhpiIteratorK;
+         obj->iter.scope = scope;
+         obj->iter.pos   = 0;
+
+         return obj;
+      }
+
+   default:
+      fatal_trace("relation %s not supported in vhpi_iterator",
+                  vhpi_one_to_many_str(type));
+   }
 }
 
 vhpiHandleT vhpi_scan(vhpiHandleT iterator)
 {
-   VHPI_MISSING;
+   vhpi_clear_error();
+
+   VHPI_TRACE("iterator=%s", vhpi_pretty_handle(iterator));
+
+   if (!vhpi_validate_handle(iterator, VHPI_ITERATOR))
+      return NULL;
+
+   if (iterator->iter.pos == iterator->iter.scope->count)
+      return NULL;
+
+   tree_t d = iterator->iter.scope->decls[(iterator->iter.pos)++];
+   return vhpi_tree_to_obj(d, vhpiSigDeclK);
 }
 
 vhpiIntT vhpi_get(vhpiIntPropertyT property, vhpiHandleT handle)
@@ -1020,19 +1148,17 @@ int vhpi_protected_call(vhpiHandleT varHdl,
    VHPI_MISSING;
 }
 
-int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
+static vhpiFormatT vhpi_natural_format(vhpiHandleT expr)
 {
-   vhpi_clear_error();
-
-   VHPI_TRACE("expr=%p value_p=%p", expr, value_p);
-
-   if (!vhpi_validate_handle(expr, VHPI_TREE))
-      return -1;
+   // The format only depends on the type of the object so is computed
+   // once per handle rather than on every read
+   if (expr->format != 0)
+      return expr->format;
 
    if (tree_kind(expr->tree) != T_SIGNAL_DECL) {
       vhpi_error(vhpiInternal, tree_loc(expr->tree), "vhpi_get_value is only "
                  "supported for signal declaration objects");
-      return -1;
+      return 0;
    }
 
    type_t type = tree_type(expr->tree);
@@ -1044,12 +1170,8 @@ int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
    switch (type_kind(base)) {
    case T_ENUM:
       if ((type_name == std_logic_i) || (type_name == std_ulogic_i)
-          || (type_name == std_bit_i)) {
-         if (value_p->format == vhpiBinStrVal)
-            format = value_p->format;
-         else
-            format = vhpiLogicVal;
-      }
+          || (type_name == std_bit_i))
+         format = vhpiLogicVal;
       else if (type_enum_literals(base) <= 256)
          format = vhpiSmallEnumVal;
       else
@@ -1069,12 +1191,8 @@ int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
             {
                ident_t elem_name = type_ident(elem);
                if ((elem_name == std_logic_i) || (elem_name == std_ulogic_i)
-                   || (elem_name == std_bit_i)) {
-                  if (value_p->format == vhpiBinStrVal)
-                     format = value_p->format;
-                  else
-                     format = vhpiLogicVecVal;
-               }
+                   || (elem_name == std_bit_i))
+                  format = vhpiLogicVecVal;
                else if (type_enum_literals(elem) <= 256)
                   format = vhpiSmallEnumVecVal;
                else
@@ -1085,7 +1203,7 @@ int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
          default:
             vhpi_error(vhpiInternal, tree_loc(expr->tree), "arrays of type %s "
                        "not supported in vhpi_get_value", type_pp(elem));
-            return -1;
+            return 0;
          }
       }
       break;
@@ -1093,9 +1211,26 @@ int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
    default:
       vhpi_error(vhpiInternal, tree_loc(expr->tree), "type %s not supported in "
                  "vhpi_get_value", type_pp(type));
-      return -1;
+      return 0;
    }
 
+   return (expr->format = format);
+}
+
+static int vhpi_do_get_value(vhpiHandleT expr, vhpiValueT *value_p)
+{
+   if (!vhpi_validate_handle(expr, VHPI_TREE))
+      return -1;
+
+   vhpiFormatT format = vhpi_natural_format(expr);
+   if (format == 0)
+      return -1;
+   else if (value_p->format == vhpiBinStrVal
+            && (format == vhpiLogicVal || format == vhpiLogicVecVal))
+      format = vhpiBinStrVal;
+
+   type_t type = tree_type(expr->tree);
+
    if (value_p->format == vhpiObjTypeVal)
       value_p->format = format;
    else if (value_p->format != format) {
@@ -1144,7 +1279,7 @@ int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
       case vhpiEnumVecVal:
          elemsz = sizeof(vhpiEnumT);
          break;
-      case vhpiSmallEnumVal:
+      case vhpiSmallEnumVecVal:
          elemsz = sizeof(vhpiSmallEnumT);
          break;
       default:
@@ -1163,7 +1298,7 @@ int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
          case vhpiEnumVecVal:
             value_p->value.enumvs[i] = values[i];
             break;
-         case vhpiSmallEnumVal:
+         case vhpiSmallEnumVecVal:
             value_p->value.smallenumvs[i] = values[i];
             break;
          default:
@@ -1175,17 +1310,12 @@ int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
    }
 }
 
-int vhpi_put_value(vhpiHandleT handle,
-                   vhpiValueT *value_p,
-                   vhpiPutValueModeT mode)
+static int vhpi_do_put_value(vhpiHandleT handle,
+                             vhpiValueT *value_p,
+                             vhpiPutValueModeT mode)
 {
    // See LRM 2008 section 22.5.3 for discussion of semantics
 
-   vhpi_clear_error();
-
-   VHPI_TRACE("handle=%s value_p=%p mode=%d", vhpi_pretty_handle(handle),
-              value_p, mode);
-
    if (!vhpi_validate_handle(handle, VHPI_TREE))
       return 1;
 
@@ -1267,6 +1397,90 @@ int vhpi_put_value(vhpiHandleT handle,
    }
 }
 
+int vhpi_get_value(vhpiHandleT expr, vhpiValueT *value_p)
+{
+   vhpi_clear_error();
+
+   VHPI_TRACE("expr=%p value_p=%p", expr, value_p);
+
+   return vhpi_do_get_value(expr, value_p);
+}
+
+int vhpi_put_value(vhpiHandleT handle,
+                   vhpiValueT *value_p,
+                   vhpiPutValueModeT mode)
+{
+   vhpi_clear_error();
+
+   VHPI_TRACE("handle=%s value_p=%p mode=%d", vhpi_pretty_handle(handle),
+              value_p, mode);
+
+   return vhpi_do_put_value(handle, value_p, mode);
+}
+
+int vhpi_get_values_nvc(vhpiHandleT *handles, vhpiValueT *values, int count)
+{
+   vhpi_clear_error();
+
+   VHPI_TRACE("handles=%p values=%p count=%d", handles, values, count);
+
+   int result = 0;
+   for (int i = 0; i < count; i++) {
+      const int r = vhpi_do_get_value(handles[i], &(values[i]));
+      if (r != 0 && result == 0)
+         result = r;
+   }
+
+   return result;
+}
+
+int vhpi_put_values_nvc(vhpiHandleT *handles, vhpiValueT *values, int count,
+                        vhpiPutValueModeT mode)
+{
+   vhpi_clear_error();
+
+   VHPI_TRACE("handles=%p values=%p count=%d mode=%d", handles, values,
+              count, mode);
+
+   int result = 0;
+   for (int i = 0; i < count; i++)
+      result |= vhpi_do_put_value(handles[i], &(values[i]), mode);
+
+   return result;
+}
+
+const void *vhpi_value_ptr_nvc(vhpiHandleT handle, vhpiIntT *elemsz,
+                               vhpiIntT *numElems)
+{
+   vhpi_clear_error();
+
+   VHPI_TRACE("handle=%s", vhpi_pretty_handle(handle));
+
+   if (!vhpi_validate_handle(handle, VHPI_TREE))
+      return NULL;
+
+   if (tree_kind(handle->tree) != T_SIGNAL_DECL) {
+      vhpi_error(vhpiError, tree_loc(handle->tree), "vhpi_value_ptr_nvc is "
+                 "only supported for signal declaration objects");
+      return NULL;
+   }
+
+   size_t size, count;
+   const void *ptr = rt_signal_map(handle->tree, &size, &count);
+   if (ptr == NULL) {
+      vhpi_error(vhpiError, tree_loc(handle->tree), "signal %s does not "
+                 "have contiguous storage", istr(tree_ident(handle->tree)));
+      return NULL;
+   }
+
+   if (elemsz != NULL)
+      *elemsz = size;
+   if (numElems != NULL)
+      *numElems = count;
+
+   return ptr;
+}
+
 int vhpi_schedule_transaction(vhpiHandleT drivHdl,
                               vhpiValueT *value_p,
                               uint32_t numValues,
@@ -1424,6 +1638,10 @@ int vhpi_release_handle(vhpiHandleT handle)
       }
       return 0;
 
+   case VHPI_ITERATOR:
+      vhpi_free_obj(handle);
+      return 0;
+
    default:
       assert(false);
    }
@@ -1474,6 +1692,8 @@ void vhpi_load_plugins(tree_t top, const char *plugins)
 
    handle_hash = hash_new(1024, true);
 
+   vhpi_free_index();
+
    trace_on = opt_get_int("vhpi_trace_en");
 
    vhpi_clear_error();
@@ -0,0 +1,52 @@
+//
+//  Copyright (C) 2018  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _VHPI_NVC_H
+#define _VHPI_NVC_H
+
+// NVC specific extensions to the VHPI interface
+
+#include "vhpi_user.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Read or write the values of COUNT handles in one call with the same
+// semantics as vhpi_get_value and vhpi_put_value for each element. The
+// result is the first non-zero result of an individual read, or
+// non-zero for writes if any failed. All elements are processed even
+// after an error.
+int vhpi_get_values_nvc(vhpiHandleT *handles, vhpiValueT *values, int count);
+int vhpi_put_values_nvc(vhpiHandleT *handles, vhpiValueT *values, int count,
+                        vhpiPutValueModeT mode);
+
+// Return a read-only pointer to the current value of a signal which
+// remains valid until the simulation is reset. Each of the numElems
+// elements is stored in elemsz bytes as the position of an enumeration
+// literal or an integer value. Returns NULL if the signal is not
+// stored contiguously, for example a record with mixed element sizes.
+const void *vhpi_value_ptr_nvc(vhpiHandleT handle, vhpiIntT *elemsz,
+                               vhpiIntT *numElems);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _VHPI_NVC_H
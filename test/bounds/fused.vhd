@@ -0,0 +1,21 @@
+entity fused is
+end entity;
+
+architecture test of fused is
+    constant C : boolean := false;
+    signal b : bit;
+begin
+
+    process is
+        variable v : bit_vector(1 to 10);
+    begin
+        if C then
+            v(11) := '1';               -- OK, never executed
+        end if;
+        v(0) := '1';                    -- Error
+        wait;
+    end process;
+
+    b <= '1' after -1 ns;               -- Error
+
+end architecture;
@@ -0,0 +1,51 @@
+-- library foo
+entity sub is
+end entity;
+
+architecture a of sub is
+    signal in_foo : bit;
+begin
+end architecture;
+
+-- library baz
+entity sub is
+end entity;
+
+architecture a of sub is
+    signal in_baz : bit;
+begin
+end architecture;
+
+-- library work
+library foo;
+
+entity mid1 is
+end entity;
+
+architecture a of mid1 is
+    component sub is
+    end component;
+begin
+    sub_i: component sub;
+end architecture;
+
+library baz;
+
+entity mid2 is
+end entity;
+
+architecture a of mid2 is
+    component sub is
+    end component;
+begin
+    sub_i: component sub;
+end architecture;
+
+entity libbind4 is
+end entity;
+
+architecture test of libbind4 is
+begin
+    mid2_i: entity work.mid2;
+    mid1_i: entity work.mid1;
+end architecture;
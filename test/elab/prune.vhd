@@ -0,0 +1,64 @@
+package prune_pkg is
+    signal pkgsig : bit;                -- Never read but kept
+end package;
+
+-------------------------------------------------------------------------------
+
+entity sub is
+    port ( i : in bit;
+           o : out bit );
+end entity;
+
+architecture test of sub is
+    signal count : integer := 0;        -- Never read
+begin
+
+    o <= not i;
+
+    process (i) is
+    begin
+        count <= count + 1;
+    end process;
+
+end architecture;
+
+-------------------------------------------------------------------------------
+
+use work.prune_pkg.all;
+
+entity prune is
+    port ( p : out bit );               -- Never read but kept
+end entity;
+
+architecture test of prune is
+    signal a, b   : bit;
+    signal unused : bit;                -- Never read
+    signal dbg    : bit;                -- Never read but kept
+    signal inc    : bit;                -- Listed in prune.include
+    signal chk    : bit;                -- Driver has an assertion
+begin
+
+    u: entity work.sub
+        port map ( a, b );
+
+    process is
+    begin
+        a <= '1';
+        wait for 1 ns;
+        assert b = '0';
+        wait;
+    end process;
+
+    unused <= a;
+    dbg <= a;
+    inc <= a;
+    p <= a;
+    pkgsig <= a;
+
+    process (a) is
+    begin
+        chk <= a;
+        assert a = '1' report "a is zero";
+    end process;
+
+end architecture;
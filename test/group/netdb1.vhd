@@ -0,0 +1,19 @@
+entity netdb1 is
+end entity;
+
+architecture test of netdb1 is
+    signal small : bit;                 -- 0
+    signal wide  : bit_vector(0 to 99);   -- 1..100
+    signal bits  : bit_vector(0 to 79);   -- 101..180
+    signal tail  : bit_vector(0 to 9);    -- 181..190
+begin
+
+    wide <= (others => '1');
+
+    g: for i in bits'range generate
+        bits(i) <= '1';
+    end generate;
+
+    tail(3 to 5) <= "101";
+
+end architecture;
@@ -0,0 +1,37 @@
+entity checkelide is
+end entity;
+
+architecture test of checkelide is
+    subtype small_t is integer range 1 to 10;
+    subtype narrow_t is integer range 2 to 5;
+
+    function scalar (x : integer; b : boolean) return integer is
+        variable a1, a2 : small_t;
+        variable n      : narrow_t;
+    begin
+        a1 := x;                        -- Checked
+        a2 := x;                        -- Dominated by check for A1
+        n := x;                         -- Narrower range
+        if b then
+            a2 := x;                    -- Different block
+        end if;
+        return a1 + a2 + n;
+    end function;
+
+    function dynamic (x, l, r : integer) return integer is
+        subtype up1_t is integer range l to r;
+        subtype up2_t is integer range l to r;
+        subtype down_t is integer range l downto r;
+        variable u1 : up1_t;
+        variable u2 : up2_t;
+        variable d  : down_t;
+    begin
+        u1 := x;                        -- Checked
+        u2 := x;                        -- Dominated by check for U1
+        d := x;                         -- Opposite direction
+        return u1 + u2 + d;
+    end function;
+
+begin
+
+end architecture;
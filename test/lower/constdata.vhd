@@ -0,0 +1,21 @@
+entity constdata is
+end entity;
+
+architecture test of constdata is
+begin
+
+    p1: process is
+        type int_array is array (natural range <>) of integer;
+        constant table : int_array(0 to 99) := (
+            0 => -5, 1 => 1000, 50 to 59 => 7, 99 => 2147483647,
+            others => 3 );
+        constant str : string :=
+            "0123456789abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        constant small : int_array(0 to 3) := (1, 2, 3, 4);
+        variable i : natural;
+    begin
+        report str(i + 1) & integer'image(table(i) + small(i));
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,25 @@
+entity deadstore is
+end entity;
+
+architecture test of deadstore is
+
+    function func (x : integer) return integer is
+        variable unused : integer;      -- Never read
+        variable kept   : integer;      -- Read by nested procedure
+        variable result : integer;
+
+        procedure bump is
+        begin
+            result := result + kept;
+        end procedure;
+    begin
+        unused := x * 2;
+        kept := x;
+        result := x;
+        bump;
+        return result;
+    end function;
+
+begin
+
+end architecture;
@@ -0,0 +1,316 @@
+#include "ident.h"
+#include "util.h"
+#include "hash.h"
+#include "fbuf.h"
+#include "rt/heap.h"
+#include "rt/alloc.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#define N_RANDOM 1000000
+#define N_DEPTH  7
+#define N_FANOUT 6
+#define N_HEAP   1000000
+#define N_ALLOC  10000000
+#define N_LIVE   1000
+#define N_HASH   1000000
+#define N_FBUF   4000000
+
+static uint64_t start_time;
+
+static void begin(void)
+{
+   start_time = get_timestamp_us();
+}
+
+static void report(const char *what, unsigned ops)
+{
+   const uint64_t elapsed = get_timestamp_us() - start_time;
+   printf("%-32s %8.1f ns/op\n", what, (elapsed * 1000.0) / ops);
+}
+
+static void random_string(char *buf, size_t max)
+{
+   size_t len = (random() % (max - 3)) + 2;
+
+   for (size_t j = 0; j < len; j++)
+      buf[j] = '0' + (random() % 80);
+   buf[len - 1] = '\0';
+}
+
+static unsigned build_hier(ident_t parent, int depth, ident_t *leaves,
+                           unsigned *nleaves)
+{
+   unsigned ops = 0;
+   for (int i = 0; i < N_FANOUT; i++) {
+      char name[16];
+      checked_sprintf(name, sizeof(name), "u_inst%d", i);
+
+      ident_t child = ident_prefix(parent, ident_new(name), ':');
+      ops++;
+
+      if (depth == 1)
+         leaves[(*nleaves)++] = child;
+      else
+         ops += build_hier(child, depth - 1, leaves, nleaves);
+   }
+
+   return ops;
+}
+
+static void ident_bench(void)
+{
+   char (*strings)[16] = xmalloc(N_RANDOM * sizeof(*strings));
+   for (int i = 0; i < N_RANDOM; i++)
+      random_string(strings[i], sizeof(strings[i]));
+
+   begin();
+   for (int i = 0; i < N_RANDOM; i++) {
+      ident_t i1 = ident_new(strings[i]);
+      assert(i1 != NULL);
+   }
+   report("ident_new (first use)", N_RANDOM);
+
+   begin();
+   for (int i = 0; i < N_RANDOM; i++) {
+      ident_t i1 = ident_new(strings[i]);
+      assert(strcmp(istr(i1), strings[i]) == 0);
+   }
+   report("ident_new + istr (interned)", N_RANDOM);
+
+   // Long hierarchical names like those created by elaboration
+   unsigned nleaves = 1;
+   for (int i = 0; i < N_DEPTH; i++)
+      nleaves *= N_FANOUT;
+
+   ident_t *leaves = xmalloc(nleaves * sizeof(ident_t));
+   ident_t top = ident_new(":top");
+
+   nleaves = 0;
+   begin();
+   unsigned ops = build_hier(top, N_DEPTH, leaves, &nleaves);
+   report("ident_prefix (hierarchy)", ops);
+
+   begin();
+   for (unsigned i = 0; i < nleaves; i++) {
+      ident_t i1 = ident_new(istr(leaves[i]));
+      assert(i1 == leaves[i]);
+   }
+   report("ident_new (hierarchical)", nleaves);
+
+   begin();
+   size_t total = 0;
+   for (unsigned i = 0; i < nleaves; i++)
+      total += ident_len(leaves[i]);
+   report("ident_len", nleaves);
+
+   begin();
+   for (unsigned i = 0; i < nleaves; i++) {
+      ident_t it = leaves[i];
+      for (int j = 0; j < N_DEPTH; j++)
+         it = ident_runtil(it, ':');
+      assert(it == top);
+   }
+   report("ident_runtil (to top)", nleaves * N_DEPTH);
+
+   begin();
+   for (unsigned i = 0; i < nleaves; i++)
+      total += ident_len(ident_until(leaves[i], '_'));
+   report("ident_until", nleaves);
+
+   begin();
+   unsigned matches = 0;
+   for (unsigned i = 0; i < nleaves; i++)
+      matches += ident_glob(leaves[i], ":top:*:u_inst*", -1);
+   report("ident_glob", nleaves);
+
+   printf("%u hierarchical names, %u matches, checksum %zu\n",
+          nleaves, matches, total);
+
+   free(leaves);
+   free(strings);
+}
+
+static void heap_bench(void)
+{
+   heap_t h = heap_new(128);
+
+   begin();
+   for (int i = 0; i < N_HEAP; i++)
+      heap_insert(h, random(), NULL);
+   report("heap_insert (random keys)", N_HEAP);
+
+   begin();
+   for (int i = 0; i < N_HEAP; i++)
+      heap_extract_min(h);
+   report("heap_extract_min", N_HEAP);
+
+   // Approximates the event queue where most new events are scheduled
+   // slightly after the current time
+   for (int i = 0; i < N_LIVE; i++)
+      heap_insert(h, i, NULL);
+
+   begin();
+   for (uint64_t i = 0; i < N_HEAP; i++) {
+      heap_extract_min(h);
+      heap_insert(h, i + N_LIVE + (random() % 16), NULL);
+   }
+   report("heap_extract_min + insert", N_HEAP);
+
+   heap_free(h);
+}
+
+static void alloc_bench(void)
+{
+   rt_alloc_stack_t s = rt_alloc_stack_new(64, "bench");
+   void **live = xmalloc(N_LIVE * sizeof(void *));
+
+   begin();
+   for (int i = 0; i < N_ALLOC; i++)
+      rt_free(s, rt_alloc(s));
+   report("rt_alloc + rt_free", N_ALLOC);
+
+   begin();
+   for (int i = 0; i < N_ALLOC / N_LIVE; i++) {
+      for (int j = 0; j < N_LIVE; j++)
+         live[j] = rt_alloc(s);
+      for (int j = 0; j < N_LIVE; j++)
+         rt_free(s, live[j]);
+   }
+   report("rt_alloc + rt_free (batched)", N_ALLOC);
+
+   free(live);
+   rt_alloc_stack_destroy(s);
+}
+
+static void hash_bench(void)
+{
+   // Keys are distinct pointers with the same alignment as tree objects
+   char *keys = xmalloc(N_HASH * 16);
+
+   hash_t *h = hash_new(16, true);
+
+   begin();
+   for (int i = 0; i < N_HASH; i++)
+      hash_put(h, keys + i * 16, keys);
+   report("hash_put", N_HASH);
+
+   begin();
+   for (int i = 0; i < N_HASH; i++) {
+      void *value = hash_get(h, keys + (random() % N_HASH) * 16);
+      assert(value == keys);
+   }
+   report("hash_get (hit)", N_HASH);
+
+   begin();
+   for (int i = 0; i < N_HASH; i++) {
+      void *value = hash_get(h, keys + i * 16 + 1);
+      assert(value == NULL);
+   }
+   report("hash_get (miss)", N_HASH);
+
+   hash_free(h);
+
+   ihash_t *ih = ihash_new(16);
+
+   begin();
+   for (int i = 0; i < N_HASH; i++)
+      ihash_put(ih, i * UINT64_C(7919), keys);
+   report("ihash_put", N_HASH);
+
+   begin();
+   for (int i = 0; i < N_HASH; i++) {
+      void *value = ihash_get(ih, (random() % N_HASH) * UINT64_C(7919));
+      assert(value == keys);
+   }
+   report("ihash_get", N_HASH);
+
+   ihash_free(ih);
+
+   char (*strings)[16] = xmalloc(N_HASH * sizeof(*strings));
+   for (int i = 0; i < N_HASH; i++)
+      checked_sprintf(strings[i], sizeof(strings[i]), "name%d", i);
+
+   shash_t *sh = shash_new(16);
+
+   begin();
+   for (int i = 0; i < N_HASH; i++)
+      shash_put(sh, strings[i], keys);
+   report("shash_put", N_HASH);
+
+   begin();
+   for (int i = 0; i < N_HASH; i++) {
+      void *value = shash_get(sh, strings[random() % N_HASH]);
+      assert(value == keys);
+   }
+   report("shash_get", N_HASH);
+
+   shash_free(sh);
+   free(strings);
+   free(keys);
+}
+
+static void fbuf_bench_codec(const char *path, fbuf_codec_t codec,
+                             const char *name)
+{
+   char what[64];
+
+   fbuf_set_codec(codec);
+
+   fbuf_t *f = fbuf_open(path, FBUF_OUT);
+   if (f == NULL)
+      fatal_errno("%s", path);
+
+   // Mostly small values like the fields written for each tree object
+   begin();
+   for (int i = 0; i < N_FBUF; i++) {
+      write_u16(i & 0x3f, f);
+      write_u32(i, f);
+   }
+   fbuf_close(f);
+   checked_sprintf(what, sizeof(what), "fbuf write (%s)", name);
+   report(what, N_FBUF);
+
+   if ((f = fbuf_open(path, FBUF_IN)) == NULL)
+      fatal_errno("%s", path);
+
+   begin();
+   for (int i = 0; i < N_FBUF; i++) {
+      const uint16_t u16 = read_u16(f);
+      const uint32_t u32 = read_u32(f);
+      assert(u16 == (i & 0x3f));
+      assert(u32 == i);
+   }
+   fbuf_close(f);
+   checked_sprintf(what, sizeof(what), "fbuf read (%s)", name);
+   report(what, N_FBUF);
+}
+
+static void fbuf_bench(void)
+{
+   const char *tmp = getenv("TEMP");
+   if (tmp == NULL)
+      tmp = "/tmp";
+
+   char *path LOCAL = xasprintf("%s" PATH_SEP "micro_perf.%d", tmp, getpid());
+
+   fbuf_bench_codec(path, FBUF_CODEC_NONE, "none");
+   fbuf_bench_codec(path, FBUF_CODEC_FASTLZ, "fastlz");
+   fbuf_bench_codec(path, FBUF_CODEC_LZ4, "lz4");
+
+   unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+   ident_bench();
+   heap_bench();
+   alloc_bench();
+   hash_bench();
+   fbuf_bench();
+   return 0;
+}
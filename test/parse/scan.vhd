@@ -0,0 +1,56 @@
+library ieee;
+use ieee.std_logic_1164.all, work.types.t_word;
+
+package pack is
+    function add(x, y : integer) return integer;
+    type rec is record
+        a : integer;
+    end record;
+end package;
+
+package body pack is
+    function add(x, y : integer) return integer is
+        variable r : integer;
+    begin
+        if x > 0 then
+            r := x + y;
+        end if;
+        return r;
+    end;
+
+    procedure nothing is
+    begin
+    end nothing;
+end package body;
+
+use work.pack.all;
+
+entity top is
+    port ( clk : in std_logic );
+end entity;
+
+architecture rtl of top is
+    component sub is
+    end component;
+    attribute foo : integer;
+    attribute foo of add : function is 1;
+    for u3 : sub use entity work.leaf2;
+begin
+    u1: entity work.leaf(a);
+    u2: entity lib2.other.deep port map ( clk );
+    u3: component sub;
+
+    process is
+    begin
+        wait;
+    end process;
+
+    g: for i in 1 to 3 generate
+        u4: entity work.leaf;
+    end generate;
+end rtl;
+
+context ctx is
+    library ieee;
+    use ieee.numeric_std.all;
+end context;
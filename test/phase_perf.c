@@ -0,0 +1,440 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef __MINGW32__
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "config.h"
+
+#define CYCLES 1000
+#define SCALES 3
+
+typedef void (*generate_fn_t)(FILE *, int);
+
+typedef struct {
+   const char    *name;
+   generate_fn_t  generate;
+   int            scales[SCALES];
+   bool           analyse_only;
+} design_t;
+
+typedef struct {
+   const char *note;
+   const char *phase;
+} elab_phase_t;
+
+// Elaboration is a single command so its phases are split using the
+// times printed by the --verbose option
+static const elab_phase_t elab_phases[] = {
+   { "elaborating design", "elab" },
+   { "grouping nets", "group" },
+   { "generating code", "codegen" },
+   { "saving library", "save" },
+};
+
+static char bin_dir[PATH_MAX];
+
+static void gen_clock(FILE *f)
+{
+   fprintf(f,
+           "   clk_p: process is\n"
+           "   begin\n"
+           "      for i in 1 to %d loop\n"
+           "         clk <= '1'; wait for 5 ns;\n"
+           "         clk <= '0'; wait for 5 ns;\n"
+           "      end loop;\n"
+           "      wait;\n"
+           "   end process;\n", CYCLES);
+}
+
+static void gen_counter(FILE *f, const char *name)
+{
+   fprintf(f,
+           "entity %s is\n"
+           "   port ( clk : in bit; q : out integer );\n"
+           "end entity;\n"
+           "architecture rtl of %s is\n"
+           "begin\n"
+           "   process (clk) is\n"
+           "      variable v : integer := 0;\n"
+           "   begin\n"
+           "      if clk'event and clk = '1' then\n"
+           "         v := (v + 1) mod 256;\n"
+           "         q <= v;\n"
+           "      end if;\n"
+           "   end process;\n"
+           "end architecture;\n\n", name, name);
+}
+
+static void gen_generate(FILE *f, int n)
+{
+   // Many instances of the same small entity
+
+   gen_counter(f, "counter");
+
+   fprintf(f,
+           "entity top is\n"
+           "end entity;\n"
+           "architecture test of top is\n"
+           "   type int_vector is array (natural range <>) of integer;\n"
+           "   signal clk : bit := '0';\n"
+           "   signal q   : int_vector(1 to %d);\n"
+           "begin\n", n);
+   gen_clock(f);
+   fprintf(f,
+           "   g: for i in 1 to %d generate\n"
+           "      u: entity work.counter port map ( clk, q(i) );\n"
+           "   end generate;\n"
+           "end architecture;\n", n);
+}
+
+static void gen_hier(FILE *f, int depth)
+{
+   // A chain of distinct entities each instantiating the next
+
+   gen_counter(f, "level0");
+
+   for (int i = 1; i <= depth; i++) {
+      fprintf(f,
+              "entity level%d is\n"
+              "   port ( clk : in bit; q : out integer );\n"
+              "end entity;\n"
+              "architecture rtl of level%d is\n"
+              "   signal r : integer;\n"
+              "begin\n"
+              "   u: entity work.level%d port map ( clk, r );\n"
+              "   q <= r + 1;\n"
+              "end architecture;\n\n", i, i, i - 1);
+   }
+
+   fprintf(f,
+           "entity top is\n"
+           "end entity;\n"
+           "architecture test of top is\n"
+           "   signal clk : bit := '0';\n"
+           "   signal q   : integer;\n"
+           "begin\n");
+   gen_clock(f);
+   fprintf(f,
+           "   u: entity work.level%d port map ( clk, q );\n"
+           "end architecture;\n", depth);
+}
+
+static void gen_bus(FILE *f, int width)
+{
+   // Wide vectors updated every cycle
+
+   fprintf(f,
+           "entity top is\n"
+           "end entity;\n"
+           "architecture test of top is\n"
+           "   signal clk  : bit := '0';\n"
+           "   signal a, b : bit_vector(%d downto 0);\n"
+           "begin\n", width - 1);
+   gen_clock(f);
+   fprintf(f,
+           "   shift: process (clk) is\n"
+           "   begin\n"
+           "      if clk'event and clk = '1' then\n"
+           "         a <= a(%d downto 0) & not a(%d);\n"
+           "      end if;\n"
+           "   end process;\n"
+           "   b <= a xor (a(0) & a(%d downto 1));\n"
+           "end architecture;\n", width - 2, width - 1, width - 1);
+}
+
+static void gen_netlist(FILE *f, int n)
+{
+   // A flat gate level netlist in the style written by synthesis tools
+   // which is large enough that analysis time is mostly the lexer
+
+   fprintf(f,
+           "entity NAND2_X1 is\n"
+           "   port ( A1, A2 : in bit; ZN : out bit );\n"
+           "end entity;\n"
+           "architecture behav of NAND2_X1 is\n"
+           "begin\n"
+           "   ZN <= A1 nand A2;\n"
+           "end architecture;\n\n"
+           "entity top is\n"
+           "end entity;\n"
+           "architecture netlist of top is\n"
+           "   component NAND2_X1 is\n"
+           "      port ( A1, A2 : in bit; ZN : out bit );\n"
+           "   end component;\n");
+
+   for (int i = 0; i <= n; i++)
+      fprintf(f, "   signal n_%d_net : bit;   -- net %d\n", i, i);
+
+   fprintf(f, "begin\n");
+
+   for (int i = 1; i <= n; i++)
+      fprintf(f,
+              "   U%d : NAND2_X1\n"
+              "      port map ( A1 => n_%d_net, A2 => N_%d_Net,\n"
+              "                 ZN => N_%d_NET );\n",
+              i, i - 1, i / 2, i);
+
+   fprintf(f, "end architecture;\n");
+}
+
+static const design_t designs[] = {
+   { "generate", gen_generate, { 10, 100, 1000 } },
+   { "hier",     gen_hier,     { 16, 64, 256 } },
+   { "bus",      gen_bus,      { 256, 4096, 65536 } },
+   { "netlist",  gen_netlist,  { 1000, 10000, 100000 }, true },
+};
+
+static void report(const char *bench, const char *phase, unsigned ms)
+{
+   printf("%-24s %-8s %10u ms\n", bench, phase, ms);
+   fflush(stdout);
+}
+
+#ifndef __MINGW32__
+static unsigned tv2ms(const struct timeval *tv)
+{
+   return (tv->tv_sec * 1000) + (tv->tv_usec / 1000);
+}
+
+static bool run_nvc(const char *log, const char *const *args,
+                    unsigned *ms, long *maxrss)
+{
+   const int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if (fd < 0) {
+      fprintf(stderr, "%s: %s\n", log, strerror(errno));
+      return false;
+   }
+
+   char nvc[PATH_MAX];
+   snprintf(nvc, sizeof(nvc), "%s/nvc%s", bin_dir, EXEEXT);
+
+   const int nargs = 8;
+   const char *argv[nargs + 2];
+   argv[0] = nvc;
+   for (int i = 0; i < nargs; i++) {
+      if ((argv[i + 1] = args[i]) == NULL)
+         break;
+   }
+   argv[nargs + 1] = NULL;
+
+   fflush(stdout);
+   fflush(stderr);
+
+   pid_t pid = fork();
+   if (pid < 0) {
+      fprintf(stderr, "Fork failed: %s\n", strerror(errno));
+      close(fd);
+      return false;
+   }
+   else if (pid == 0) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+
+      execv(nvc, (char **)argv);
+      fprintf(stderr, "Exec failed: %s\n", strerror(errno));
+      _exit(EXIT_FAILURE);
+   }
+
+   close(fd);
+
+   int status;
+   struct rusage ru;
+   if (wait4(pid, &status, 0, &ru) < 0) {
+      fprintf(stderr, "Waiting for child failed: %s\n", strerror(errno));
+      return false;
+   }
+
+   *ms = tv2ms(&(ru.ru_utime)) + tv2ms(&(ru.ru_stime));
+#ifdef __APPLE__
+   const long rss = ru.ru_maxrss / 1024;
+#else
+   const long rss = ru.ru_maxrss;
+#endif
+   if (rss > *maxrss)
+      *maxrss = rss;
+
+   if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "Command failed: see %s\n", log);
+      return false;
+   }
+
+   return true;
+}
+
+static bool report_elab(const char *bench, const char *log)
+{
+   FILE *f = fopen(log, "r");
+   if (f == NULL) {
+      fprintf(stderr, "%s: %s\n", log, strerror(errno));
+      return false;
+   }
+
+   const int nphases = sizeof(elab_phases) / sizeof(elab_phase_t);
+   unsigned ms[nphases];
+   memset(ms, 0, sizeof(ms));
+
+   char line[512];
+   while (fgets(line, sizeof(line), f)) {
+      const char *times = strrchr(line, '[');
+      if (times == NULL)
+         continue;
+
+      for (int i = 0; i < nphases; i++) {
+         if (strstr(line, elab_phases[i].note) != NULL) {
+            sscanf(times, "[%ums", &(ms[i]));
+            break;
+         }
+      }
+   }
+
+   fclose(f);
+
+   for (int i = 0; i < nphases; i++)
+      report(bench, elab_phases[i].phase, ms[i]);
+
+   return true;
+}
+
+static bool run_bench(const design_t *d, int scale)
+{
+   char bench[64];
+   snprintf(bench, sizeof(bench), "%s.%d", d->name, scale);
+
+   if (mkdir(bench, 0777) != 0 && errno != EEXIST) {
+      fprintf(stderr, "Failed to make bench/%s directory: %s\n",
+              bench, strerror(errno));
+      return false;
+   }
+
+   if (chdir(bench) != 0) {
+      fprintf(stderr, "Failed to switch to bench/%s directory: %s\n",
+              bench, strerror(errno));
+      return false;
+   }
+
+   bool ok = false;
+
+   FILE *f = fopen("top.vhd", "w");
+   if (f == NULL) {
+      fprintf(stderr, "Failed to create bench/%s/top.vhd: %s\n",
+              bench, strerror(errno));
+      goto out_chdir;
+   }
+
+   (*d->generate)(f, scale);
+   fclose(f);
+
+   unsigned ms;
+   long maxrss = 0;
+
+   // Parsing and semantic checking are interleaved for each design
+   // unit so they are measured together
+   const char *analyse[] = { "-a", "top.vhd", NULL };
+   if (!run_nvc("analyse.log", analyse, &ms, &maxrss))
+      goto out_chdir;
+   report(bench, "analyse", ms);
+
+   if (d->analyse_only) {
+      struct stat st;
+      if (stat("top.vhd", &st) == 0 && ms > 0)
+         printf("%-24s %-8s %10.1f MB/s\n", bench, "rate",
+                (double)st.st_size / (ms * 1000.0));
+      printf("%-24s %-8s %10ld kB\n", bench, "maxrss", maxrss);
+      ok = true;
+      goto out_chdir;
+   }
+
+   const char *elab[] = { "-e", "--verbose", "top", NULL };
+   if (!run_nvc("elab.log", elab, &ms, &maxrss))
+      goto out_chdir;
+   if (!report_elab(bench, "elab.log"))
+      goto out_chdir;
+
+   const char *run[] = { "-r", "top", NULL };
+   if (!run_nvc("run.log", run, &ms, &maxrss))
+      goto out_chdir;
+   report(bench, "run", ms);
+
+   printf("%-24s %-8s %10ld kB\n", bench, "maxrss", maxrss);
+   ok = true;
+
+ out_chdir:
+   if (chdir("..") != 0) {
+      fprintf(stderr, "Failed to switch to bench directory: %s\n",
+              strerror(errno));
+      return false;
+   }
+
+   return ok;
+}
+#endif  // __MINGW32__
+
+int main(int argc, char **argv)
+{
+#ifdef __MINGW32__
+   fprintf(stderr, "Phase benchmarks are not supported on this platform\n");
+   return EXIT_FAILURE;
+#else
+   char argv0_path[PATH_MAX];
+   if (realpath(argv[0], argv0_path) == NULL) {
+      fprintf(stderr, "Error: failed to get real path for %s: %s\n",
+              argv[0], strerror(errno));
+      return EXIT_FAILURE;
+   }
+   strncpy(bin_dir, dirname(argv0_path), sizeof(bin_dir) - 1);
+
+   char lib_dir[PATH_MAX];
+   snprintf(lib_dir, PATH_MAX, "%s/../lib", bin_dir);
+   setenv("NVC_LIBPATH", lib_dir, 1);
+
+   if (mkdir("bench", 0777) != 0 && errno != EEXIST) {
+      fprintf(stderr, "Failed to make bench directory: %s\n",
+              strerror(errno));
+      return EXIT_FAILURE;
+   }
+
+   if (chdir("bench") != 0) {
+      fprintf(stderr, "Failed to change to bench directory: %s\n",
+              strerror(errno));
+      return EXIT_FAILURE;
+   }
+
+   // Each result line is the benchmark name with its scale, the phase,
+   // and the CPU time used by that phase
+
+   bool pass = true;
+   const int ndesigns = sizeof(designs) / sizeof(design_t);
+   for (int i = 0; i < ndesigns; i++) {
+      bool found = argc == 1;
+      for (int j = 1; j < argc && !found; j++)
+         found = strcmp(argv[j], designs[i].name) == 0;
+
+      if (!found)
+         continue;
+
+      for (int j = 0; j < SCALES; j++) {
+         if (!run_bench(&(designs[i]), designs[i].scales[j]))
+            pass = false;
+      }
+   }
+
+   return pass ? 0 : EXIT_FAILURE;
+#endif
+}
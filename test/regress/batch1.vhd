@@ -0,0 +1,37 @@
+entity batch1 is
+end entity;
+
+architecture test of batch1 is
+    -- These are forced by each entry in the batch file
+    signal mode   : integer := 0;
+    signal enable : boolean := false;
+    signal vec    : bit_vector(1 to 4) := "0000";
+    signal expect : integer := -1;
+
+    signal count  : natural := 0;
+begin
+
+    counter: process is
+        variable inc : natural;
+    begin
+        wait for 1 ns;
+        inc := 0;
+        if enable then
+            inc := mode;
+        end if;
+        if vec(1) = '1' then
+            inc := inc + 1;
+        end if;
+        count <= count + inc;
+    end process;
+
+    check: process is
+    begin
+        wait for 10500 ps;
+        assert count = expect
+            report "count=" & integer'image(count) & " expect="
+            & integer'image(expect);
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,22 @@
+-- Built before the files it depends on
+use work.build1_pkg.all;
+
+entity build1 is
+end entity;
+
+architecture test of build1 is
+    signal x, y : natural;
+begin
+
+    sub_i: entity work.build1_sub
+        port map ( x, y );
+
+    process is
+    begin
+        x <= 5;
+        wait for 1 ns;
+        assert y = double(5) + WIDTH;
+        wait;
+    end process;
+
+end architecture;
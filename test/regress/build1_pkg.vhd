@@ -0,0 +1,11 @@
+package build1_pkg is
+    constant WIDTH : natural := 8;
+    function double (x : natural) return natural;
+end package;
+
+package body build1_pkg is
+    function double (x : natural) return natural is
+    begin
+        return x * 2;
+    end function;
+end package body;
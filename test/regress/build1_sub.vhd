@@ -0,0 +1,13 @@
+use work.build1_pkg.all;
+
+entity build1_sub is
+    port ( x : in natural;
+           y : out natural );
+end entity;
+
+architecture test of build1_sub is
+begin
+
+    y <= double(x) + WIDTH;
+
+end architecture;
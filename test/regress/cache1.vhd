@@ -0,0 +1,32 @@
+entity cache1_sub is
+    generic ( N : integer );
+    port ( x : out integer );
+end entity;
+
+architecture test of cache1_sub is
+begin
+    x <= N * 2;
+end architecture;
+
+-------------------------------------------------------------------------------
+
+entity cache1 is
+end entity;
+
+architecture test of cache1 is
+    signal a, b : integer;
+begin
+
+    u1: entity work.cache1_sub generic map (3) port map (a);
+    u2: entity work.cache1_sub generic map (5) port map (b);
+
+    process is
+    begin
+        wait for 1 ns;
+        assert a = 6;
+        assert b = 10;
+        report "a + b = " & integer'image(a + b);
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,37 @@
+entity checkpoint1 is
+end entity;
+
+architecture test of checkpoint1 is
+    signal clk   : bit := '0';
+    signal count : natural := 0;
+    signal total : natural := 0;
+    signal late  : natural := 0;
+begin
+
+    clk <= not clk after 5 ns;
+
+    counter: process (clk) is
+        variable sum : natural := 0;
+    begin
+        if clk = '1' then
+            sum := sum + count;
+            count <= count + 1;
+            total <= sum;
+        end if;
+    end process;
+
+    -- Transaction still pending in the driver at the checkpoint time
+    late <= transport 42 after 50 ns;
+
+    check: process is
+    begin
+        wait for 98 ns;
+        assert count = 10;
+        assert total = 45;
+        assert late = 42;
+        report "count=" & integer'image(count) & " total="
+            & integer'image(total) & " late=" & integer'image(late);
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,62 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+entity clock1 is
+end entity;
+
+architecture test of clock1 is
+    signal clk_b  : bit := '0';
+    signal clk_l  : std_logic := '0';
+    signal clk_u  : std_logic;          -- Stays 'U'
+    signal clk_t  : boolean := false;
+    signal n_b, n_l, n_t, n_u : natural := 0;
+begin
+
+    -- These are all toggled directly by the kernel
+    clk_b <= not clk_b after 5 ns;
+    clk_l <= not clk_l after 10 ns;
+    clk_u <= not clk_u after 1 ns;
+    clk_t <= not clk_t after 7 ns;
+
+    count_b: process (clk_b) is
+    begin
+        if clk_b = '1' then
+            assert now = (n_b * 10 + 5) * ns;
+            n_b <= n_b + 1;
+        end if;
+    end process;
+
+    count_l: process (clk_l) is
+    begin
+        if rising_edge(clk_l) then
+            assert now = (n_l * 20 + 10) * ns;
+            n_l <= n_l + 1;
+        end if;
+    end process;
+
+    count_t: process (clk_t) is
+    begin
+        if clk_t then
+            n_t <= n_t + 1;
+        end if;
+    end process;
+
+    count_u: process (clk_u) is
+    begin
+        n_u <= n_u + 1;
+    end process;
+
+    check: process is
+    begin
+        wait for 102 ns;
+        assert n_b = 10 report integer'image(n_b);
+        assert n_l = 5 report integer'image(n_l);
+        assert n_t = 7 report integer'image(n_t);
+        assert n_u = 1 report integer'image(n_u);
+        assert clk_u = 'U';
+        assert clk_b = '0';
+        assert clk_l = '0';
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,36 @@
+entity clock2 is
+end entity;
+
+architecture test of clock2 is
+    signal clk_b  : bit := '0';
+    signal clk_t  : boolean := false;
+    signal n_b, n_t : natural := 0;
+begin
+    -- Both toggled directly by the kernel after the reset run
+    clk_b <= not clk_b after 5 ns;
+    clk_t <= not clk_t after 7 ns;
+
+    count_b: process (clk_b) is
+    begin
+        if clk_b = '1' then
+            assert now = (n_b * 10 + 5) * ns;
+            n_b <= n_b + 1;
+        end if;
+    end process;
+
+    count_t: process (clk_t) is
+    begin
+        if clk_t then
+            n_t <= n_t + 1;
+        end if;
+    end process;
+
+    check: process is
+    begin
+        wait for 102 ns;
+        assert n_b = 10 report integer'image(n_b);
+        assert n_t = 7 report integer'image(n_t);
+        assert clk_b = '0';
+        wait;
+    end process;
+end architecture;
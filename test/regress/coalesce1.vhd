@@ -0,0 +1,53 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+entity coalesce1 is
+end entity;
+
+architecture test of coalesce1 is
+    signal bus_s  : std_logic;
+    signal n_evts : natural := 0;
+begin
+
+    -- Both drivers change in the same delta but the resolved value
+    -- stays the same so there must not be an event on the bus
+    drv_a: process is
+    begin
+        bus_s <= '1';
+        wait for 10 ns;
+        bus_s <= 'Z';
+        wait for 10 ns;
+        bus_s <= '0';
+        wait;
+    end process;
+
+    drv_b: process is
+    begin
+        bus_s <= 'Z';
+        wait for 10 ns;
+        bus_s <= '1';
+        wait for 10 ns;
+        bus_s <= '0';
+        wait;
+    end process;
+
+    count: process (bus_s) is
+    begin
+        n_evts <= n_evts + 1;
+    end process;
+
+    check: process is
+    begin
+        wait for 5 ns;
+        assert bus_s = '1';
+        assert n_evts = 2;              -- Initial run and 'U' to '1'
+        wait for 10 ns;
+        assert bus_s = '1';
+        assert n_evts = 2;
+        wait for 10 ns;
+        assert bus_s = '0';
+        assert n_evts = 3;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,137 @@
+package const8_pack is
+
+    type u8_array is array (natural range <>) of integer range 0 to 255;
+    type s16_array is array (natural range <>) of integer range -30000 to 30000;
+    type int_array is array (natural range <>) of integer;
+    type byte_array is array (natural range <>) of bit_vector(0 to 7);
+
+    -- Each of these is large enough to be emitted as raw data
+    constant rom8 : u8_array(0 to 63) := (
+        11, 48, 85, 122, 159, 196, 233, 14, 51, 88,
+        125, 162, 199, 236, 17, 54, 91, 128, 165, 202,
+        239, 20, 57, 94, 131, 168, 205, 242, 23, 60,
+        97, 134, 171, 208, 245, 26, 63, 100, 137, 174,
+        211, 248, 29, 66, 103, 140, 177, 214, 251, 32,
+        69, 106, 143, 180, 217, 254, 35, 72, 109, 146,
+        183, 220, 1, 38 );
+
+    constant rom16 : s16_array(79 downto 0) := (
+        -12818, -13795, -14772, -15749, -16726, -17703, -18680, -19657, -20634, -21611,
+        -22588, -23565, -24542, -25519, -26496, -27473, -28450, -29427, 29597, 28620,
+        27643, 26666, 25689, 24712, 23735, 22758, 21781, 20804, 19827, 18850,
+        17873, 16896, 15919, 14942, 13965, 12988, 12011, 11034, 10057, 9080,
+        8103, 7126, 6149, 5172, 4195, 3218, 2241, 1264, 287, -690,
+        -1667, -2644, -3621, -4598, -5575, -6552, -7529, -8506, -9483, -10460,
+        -11437, -12414, -13391, -14368, -15345, -16322, -17299, -18276, -19253, -20230,
+        -21207, -22184, -23161, -24138, -25115, -26092, -27069, -28046, -29023, -30000 );
+
+    constant rom32 : int_array(1 to 64) := (
+        -999999993, -999895264, -999790535, -999685806, -999581077,
+        -999476348, -999371619, -999266890, -999162161, -999057432,
+        -998952703, -998847974, -998743245, -998638516, -998533787,
+        -998429058, -998324329, -998219600, -998114871, -998010142,
+        -997905413, -997800684, -997695955, -997591226, -997486497,
+        -997381768, -997277039, -997172310, -997067581, -996962852,
+        -996858123, -996753394, -996648665, -996543936, -996439207,
+        -996334478, -996229749, -996125020, -996020291, -995915562,
+        -995810833, -995706104, -995601375, -995496646, -995391917,
+        -995287188, -995182459, -995077730, -994973001, -994868272,
+        -994763543, -994658814, -994554085, -994449356, -994344627,
+        -994239898, -994135169, -994030440, -993925711, -993820982,
+        -993716253, -993611524, -993506795, -993402066 );
+
+    constant sparse : int_array(0 to 99) := (
+        0 => -5, 1 => 1000, 50 to 59 => 7, 99 => 2147483647,
+        others => 3 );
+
+    constant bits : bit_vector(0 to 95) :=
+        "100100100100100100100100100100100100100100100100100100100100100100100100100100100100100100100100";
+
+    constant text : string := "The quick brown fox jumps over the lazy dog 0123456789 ABCDEFGHIJKLMNOP";
+
+    constant rows : byte_array(0 to 15) := (
+        "01010101", "10101010", "01010101", "10101010",
+        "01010101", "10101010", "01010101", "10101010",
+        "01010101", "10101010", "01010101", "10101010",
+        "01010101", "10101010", "01010101", "10101010" );
+
+end package;
+
+-------------------------------------------------------------------------------
+
+entity const8 is
+end entity;
+
+use work.const8_pack.all;
+
+architecture test of const8 is
+
+    function sum(x : s16_array(79 downto 0)) return integer is
+        variable r : integer := 0;
+    begin
+        for i in x'range loop
+            r := r + x(i);
+        end loop;
+        return r;
+    end function;
+
+    constant total16 : integer := sum(rom16);
+
+begin
+
+    process is
+        variable s8, s16, ones : integer := 0;
+        variable s32 : integer := 0;
+        variable n : natural;
+    begin
+        for i in rom8'range loop
+            s8 := s8 + rom8(i);
+        end loop;
+        assert s8 = 8224 report integer'image(s8);
+
+        for i in rom16'range loop
+            s16 := s16 + rom16(i);
+        end loop;
+        assert s16 = -392698 report integer'image(s16);
+        assert total16 = -392698 report integer'image(total16);
+        assert rom16(0) = -30000 and rom16(79) = -12818;
+
+        for i in rom32'range loop
+            s32 := s32 + rom32(i) / 64;
+        end loop;
+        assert s32 = -996700998 report integer'image(s32);
+        assert rom32(1) = -999999993 and rom32(64) = -993402066;
+
+        n := 0;
+        assert sparse(n) = -5 and sparse(n + 1) = 1000;
+        n := 55;
+        assert sparse(n) = 7 and sparse(n + 5) = 3;
+        n := 99;
+        assert sparse(n) = 2147483647;
+
+        for i in bits'range loop
+            if bits(i) = '1' then
+                ones := ones + 1;
+            end if;
+        end loop;
+        assert ones = 32 report integer'image(ones);
+
+        n := 5;
+        assert text(n to n + 4) = "quick";
+        assert text(text'right) = 'P';
+
+        ones := 0;
+        for i in rows'range loop
+            for j in 0 to 7 loop
+                if rows(i)(j) = '1' then
+                    ones := ones + 1;
+                end if;
+            end loop;
+        end loop;
+        assert ones = 64 report integer'image(ones);
+        assert rows(3) = "10101010";
+
+        wait;
+    end process;
+
+end architecture;
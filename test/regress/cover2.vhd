@@ -0,0 +1,23 @@
+entity cover2 is
+end entity;
+
+architecture test of cover2 is
+    signal n : natural;
+begin
+
+    process is
+        variable v : natural;
+    begin
+        for i in 1 to 100 loop
+            v := v + i;
+            if v = 0 then
+                v := 1;                 -- Never executed
+            end if;
+        end loop;
+        n <= v;
+        wait for 1 ns;
+        assert n = 5050;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,21 @@
+entity cover3 is
+end entity;
+
+architecture test of cover3 is
+    signal n : natural;
+begin
+
+    process is
+        variable first : boolean := true;
+    begin
+        wait for 1 ns;
+        first := false;                 -- Only runs in an unsampled cycle
+        for i in 1 to 40 loop
+            n <= n + 1;                 -- Runs in sampled cycles
+            wait for 1 ns;
+        end loop;
+        assert n = 40;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,48 @@
+entity delay3 is
+end entity;
+
+architecture test of delay3 is
+    signal x : integer := 0;
+    signal y : integer := 0;
+begin
+
+    -- Long transport waveform that does not fit in the initial
+    -- driver queue
+    stim_p: process is
+    begin
+        for i in 1 to 20 loop
+            x <= transport i after i * 1 ns;
+        end loop;
+        wait for 5 ns;
+        -- Replaces every transaction after 7 ns
+        x <= transport 100 after 2 ns;
+        wait;
+    end process;
+
+    check_p: process is
+    begin
+        for i in 1 to 6 loop
+            wait for 1 ns;
+            assert x = i report integer'image(x);
+        end loop;
+        wait for 1 ns;
+        assert x = 100 report integer'image(x);   -- 7 ns
+        wait for 10 ns;
+        assert x = 100 report integer'image(x);
+        wait;
+    end process;
+
+    -- Queue wraps around as transactions mature while more are added
+    wrap_p: process is
+    begin
+        for i in 1 to 50 loop
+            y <= transport i after 3 ns;
+            wait for 1 ns;
+            if i > 2 then
+                assert y = i - 2 report integer'image(y);
+            end if;
+        end loop;
+        wait;
+    end process;
+
+end architecture;
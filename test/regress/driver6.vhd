@@ -0,0 +1,57 @@
+entity driver6 is
+end entity;
+
+library ieee;
+use ieee.std_logic_1164.all;
+
+architecture test of driver6 is
+    constant N : integer := 16;
+
+    signal bus1 : std_logic;
+    signal vec  : std_logic_vector(0 to N - 1);
+begin
+
+    g: for i in 0 to N - 1 generate
+        process is
+        begin
+            bus1 <= 'Z';
+            vec(i) <= 'Z';
+            wait for i * 1 ns + 1 ns;
+            bus1 <= '1';
+            vec(i) <= '0';
+            wait for 1 ns;
+            bus1 <= 'Z';
+            wait;
+        end process;
+    end generate;
+
+    all_p: process is
+    begin
+        vec <= (others => 'H');
+        wait;
+    end process;
+
+    check: process is
+    begin
+        wait for 0.5 ns;
+        assert bus1 = 'Z';
+        assert vec = (0 to N - 1 => 'H');
+        for i in 0 to N - 1 loop
+            wait for 1 ns;
+            assert bus1 = '1';
+            assert vec(i) = '0';
+            if i > 0 then
+                assert vec(i - 1) = '0';
+            end if;
+            if i < N - 1 then
+                assert vec(i + 1) = 'H';
+            end if;
+        end loop;
+        wait for 1 ns;
+        assert bus1 = 'Z';
+        assert vec = (0 to N - 1 => '0');
+        report "done";
+        wait;
+    end process;
+
+end architecture;
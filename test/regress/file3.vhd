@@ -0,0 +1,72 @@
+entity file3 is
+end entity;
+
+architecture test of file3 is
+    type char_file is file of character;
+    type string_file is file of string;
+begin
+
+    process is
+        file f          : char_file;
+        file g          : string_file;
+        variable c      : character;
+        variable s      : string(1 to 10);
+        variable big    : string(1 to 70000);
+        variable len    : natural;
+        variable count  : natural;
+        variable sum    : natural;
+    begin
+        -- More characters than fit in the write buffer
+        file_open(f, "file3.txt", WRITE_MODE);
+        for i in 1 to 100000 loop
+            write(f, character'val(character'pos('a') + (i mod 26)));
+        end loop;
+        file_close(f);
+
+        file_open(f, "file3.txt", READ_MODE);
+        count := 0;
+        sum := 0;
+        while not endfile(f) loop
+            read(f, c);
+            count := count + 1;
+            sum := sum + (character'pos(c) - character'pos('a'));
+        end loop;
+        file_close(f);
+        assert count = 100000;
+        assert sum = 1249960 report integer'image(sum);
+
+        -- A single write larger than the buffer between two small writes
+        for i in big'range loop
+            big(i) := character'val(character'pos('0') + (i mod 10));
+        end loop;
+        file_open(g, "file3.txt", WRITE_MODE);
+        write(g, "head");
+        write(g, big);
+        write(g, "tail");
+        file_close(g);
+
+        file_open(g, "file3.txt", READ_MODE);
+        read(g, s, len);
+        assert len = 10;
+        assert s = "head123456";
+        count := 10;
+        while not endfile(g) loop
+            read(g, s, len);
+            count := count + len;
+        end loop;
+        file_close(g);
+        assert count = 70008 report integer'image(count);
+        assert len = 8;
+        assert s(1 to 8) = "7890tail";
+
+        -- An empty file is at the end as soon as it is opened
+        file_open(g, "file3.txt", WRITE_MODE);
+        file_close(g);
+        file_open(g, "file3.txt", READ_MODE);
+        assert endfile(g);
+        file_close(g);
+
+        wait;
+    end process;
+
+end architecture;
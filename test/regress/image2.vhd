@@ -0,0 +1,86 @@
+entity image2 is
+end entity;
+
+architecture test of image2 is
+    -- At least eight literals so 'value uses the hash table
+    type colour_t is (red, orange, yellow, green, blue, indigo, violet,
+                      black, white, \dark grey\, 'x', 'y');
+
+    type small_t is (one, two, three);
+
+    type int_array is array (natural range <>) of integer;
+    type real_array is array (natural range <>) of real;
+
+    type dist_t is range -1000 to 1000
+        units
+            mm;
+            cm = 10 mm;
+        end units;
+
+    -- Constrained so the argument is padded with spaces
+    subtype str12_t is string(1 to 12);
+
+    impure function get_colour (s : str12_t) return colour_t is
+    begin
+        return colour_t'value(s);
+    end function;
+
+    impure function get_small (s : str12_t) return small_t is
+    begin
+        return small_t'value(s);
+    end function;
+
+    impure function get_int (s : str12_t) return integer is
+    begin
+        return integer'value(s);
+    end function;
+begin
+
+    process is
+        variable i : int_array(1 to 5);
+        variable r : real_array(1 to 4);
+        variable d : dist_t;
+        variable c : colour_t;
+        variable v : small_t;
+    begin
+        i := (0, -1, integer'high, integer'low, -98765);
+        r := (42.0, -3.0, 0.5, 1.0e20);
+        d := 15 cm;
+        c := violet;
+        v := three;
+        wait for 0 ns;                  -- Prevent constant folding
+
+        assert integer'image(i(1)) = "0";
+        assert integer'image(i(2)) = "-1";
+        assert integer'image(i(3)) = "2147483647";
+        assert integer'image(i(4)) = "-2147483648";
+        assert integer'image(i(5)) = "-98765";
+
+        assert dist_t'image(d) = "150 MM";
+        assert dist_t'image(-d) = "-150 MM";
+
+        assert real'image(r(1)) = "42";
+        assert real'image(r(2)) = "-3";
+        assert real'image(r(3)) = "0.5";
+        assert real'image(r(4)) = "1e+20";
+
+        assert colour_t'image(c) = "violet";
+        assert colour_t'image(colour_t'succ(white)) = "\dark grey\";
+        assert colour_t'image(colour_t'pred(colour_t'high)) = "'x'";
+        assert small_t'image(v) = "three";
+
+        assert get_colour("red         ") = red;
+        assert get_colour("  Yellow    ") = yellow;
+        assert get_colour("WHITE       ") = white;
+        assert get_colour("'y'         ") = 'y';
+        assert get_colour("\dark grey\ ") = \dark grey\;
+        assert get_small(" Two        ") = two;
+
+        assert get_int("  -42       ") = -42;
+        assert get_int("0           ") = 0;
+        assert get_int("123         ") = 123;
+
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,22 @@
+-- Analysed with --jobs before the files it depends on
+use work.jobs1_pkg.all;
+
+entity jobs1 is
+end entity;
+
+architecture test of jobs1 is
+    signal x, y : natural;
+begin
+
+    sub_i: entity work.jobs1_sub
+        port map ( x, y );
+
+    process is
+    begin
+        x <= 5;
+        wait for 1 ns;
+        assert y = double(5) + WIDTH;
+        wait;
+    end process;
+
+end architecture;
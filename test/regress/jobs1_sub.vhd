@@ -0,0 +1,13 @@
+use work.jobs1_pkg.all;
+
+entity jobs1_sub is
+    port ( x : in natural;
+           y : out natural );
+end entity;
+
+architecture test of jobs1_sub is
+begin
+
+    y <= double(x) + WIDTH;
+
+end architecture;
@@ -0,0 +1,38 @@
+entity json1_sub is
+    port ( x : in natural );
+end entity;
+
+architecture test of json1_sub is
+begin
+
+    \watch"x\\y\ : process (x) is
+        variable count : natural := 0;
+    begin
+        -- The image is returned on the temporary stack
+        count := count + integer'image(x)'length;
+    end process;
+
+end architecture;
+
+-------------------------------------------------------------------------------
+
+entity json1 is
+end entity;
+
+architecture test of json1 is
+    signal \s"1\ : natural;
+begin
+
+    stim: process is
+    begin
+        for i in 1 to 10 loop
+            \s"1\ <= i;
+            wait for 1 ns;
+        end loop;
+        wait;
+    end process;
+
+    sub_i: entity work.json1_sub
+        port map ( \s"1\ );
+
+end architecture;
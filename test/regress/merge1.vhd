@@ -0,0 +1,23 @@
+entity merge1 is
+end entity;
+
+architecture test of merge1 is
+    -- Forced by each entry in the batch file
+    signal mode  : integer := 0;
+    signal count : integer := 0;
+begin
+
+    process is
+    begin
+        wait for 1 ns;
+        if mode = 1 then
+            count <= 1;
+        elsif mode = 2 then
+            count <= 2;
+        else
+            count <= 3;
+        end if;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,38 @@
+package pack is
+    constant results : bit_vector(1 to 3) := "101";
+    constant limit   : integer := 42;
+end package;
+
+-------------------------------------------------------------------------------
+
+use work.pack.all;
+
+entity pkgconst1 is
+end entity;
+
+architecture test of pkgconst1 is
+    signal count : integer := 0;
+begin
+
+    -- Each process reads package constants directly
+    count_p: process is
+    begin
+        for i in results'range loop
+            if results(i) = '1' then
+                count <= count + 1;
+                wait for 1 ns;
+            end if;
+        end loop;
+        wait;
+    end process;
+
+    check_p: process is
+    begin
+        wait for 5 ns;
+        assert count = 2;
+        assert limit = 42;
+        assert results = "101";
+        wait;
+    end process;
+
+end architecture;
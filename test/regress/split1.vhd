@@ -0,0 +1,39 @@
+-- Analysed, elaborated, and run by separate commands
+entity sub is
+    generic ( N : integer );
+    port ( x : in integer;
+           y : out integer );
+end entity;
+
+architecture test of sub is
+begin
+    y <= x * N;
+end architecture;
+
+-------------------------------------------------------------------------------
+
+entity split1 is
+end entity;
+
+architecture test of split1 is
+    signal a, b, c : integer := 0;
+begin
+
+    u1: entity work.sub
+        generic map ( 2 )
+        port map ( a, b );
+
+    u2: entity work.sub
+        generic map ( 3 )
+        port map ( b, c );
+
+    process is
+    begin
+        a <= 5;
+        wait for 1 ns;
+        assert b = 10;
+        assert c = 30;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,53 @@
+entity threads1 is
+end entity;
+
+architecture test of threads1 is
+    constant N : integer := 64;
+
+    type int_vec is array (natural range <>) of integer;
+
+    signal counts : int_vec(0 to N - 1) := (others => 0);
+    signal clk    : bit := '0';
+    signal sum    : integer := 0;
+begin
+
+    clkgen: process is
+    begin
+        for i in 1 to 20 loop
+            clk <= not clk;
+            wait for 5 ns;
+        end loop;
+        wait;
+    end process;
+
+    g: for i in 0 to N - 1 generate
+        process (clk) is
+        begin
+            if clk'event and clk = '1' then
+                counts(i) <= counts(i) + 1;
+                if counts(i) = 9 and i = 37 then
+                    report "done " & integer'image(i);
+                end if;
+            end if;
+        end process;
+    end generate;
+
+    adder: process (counts) is
+        variable s : integer;
+    begin
+        s := 0;
+        for i in counts'range loop
+            s := s + counts(i);
+        end loop;
+        sum <= s;
+    end process;
+
+    check: process is
+    begin
+        wait for 100 ns;
+        report "sum is " & integer'image(sum);
+        assert sum = N * 10;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,48 @@
+entity tiered1 is
+end entity;
+
+architecture test of tiered1 is
+    signal clk   : bit := '0';
+    signal count : natural := 0;
+    signal sum   : natural := 0;
+    signal done  : boolean := false;
+begin
+
+    clkgen: process is
+    begin
+        while not done loop
+            wait for 5 ns;
+            clk <= not clk;
+        end loop;
+        wait;
+    end process;
+
+    -- Runs often enough to be recompiled part way through the test and
+    -- must keep the value of its variable when it switches over
+    counter: process (clk) is
+        variable total : natural := 0;
+    begin
+        if clk'event and clk = '1' then
+            count <= count + 1;
+            total := (total + count) mod 1000003;
+            sum <= total;
+        end if;
+    end process;
+
+    check: process is
+        variable expect : natural := 0;
+    begin
+        for i in 1 to 20000 loop
+            wait until clk = '1';
+            wait for 1 ns;
+            assert count = i report "count " & integer'image(count)
+                severity failure;
+            expect := (expect + i - 1) mod 1000003;
+            assert sum = expect report "sum " & integer'image(sum)
+                severity failure;
+        end loop;
+        done <= true;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,62 @@
+entity tmpstack1 is
+end entity;
+
+architecture test of tmpstack1 is
+
+    type int_vec is array (natural range <>) of integer;
+
+    function make (n : natural; x : integer) return int_vec is
+        variable v : int_vec(1 to n);
+    begin
+        for i in v'range loop
+            v(i) := x + i;
+        end loop;
+        return v;
+    end function;
+
+    function sum (v : int_vec) return integer is
+        variable s : integer := 0;
+    begin
+        for i in v'range loop
+            s := s + (v(i) mod 7);
+        end loop;
+        return s;
+    end function;
+
+    procedure check (n : natural; delay : delay_length) is
+        variable v : int_vec(1 to n);
+    begin
+        v := make(n, 1);
+        wait for delay;                 -- Suspend with a private stack
+        assert v(n) = n + 1;
+        assert sum(make(n, 8)) = sum(v);
+    end procedure;
+
+    signal done : boolean := false;
+
+begin
+
+    -- Temporaries here are far larger than the old fixed 64k stack
+    big: process is
+    begin
+        for i in 1 to 10 loop
+            assert sum(make(100000, i)) = sum(make(100000, i + 7));
+            wait for 1 ns;
+        end loop;
+        check(50000, 5 ns);
+        done <= true;
+        wait;
+    end process;
+
+    small: process is
+        variable n : integer := 0;
+    begin
+        wait for 1 ns;
+        n := n + sum(make(10, n));
+        if not done then
+            wait for 0 ns;
+        end if;
+        wait;
+    end process;
+
+end architecture;
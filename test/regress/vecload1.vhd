@@ -0,0 +1,63 @@
+entity vecload1_sub is
+    port ( x : in bit_vector(0 to 11);
+           y : out bit_vector(0 to 11) );
+end entity;
+
+architecture test of vecload1_sub is
+begin
+    -- Slices of x come from different signals in the parent
+    y <= x;
+end architecture;
+
+-------------------------------------------------------------------------------
+
+entity vecload1 is
+end entity;
+
+architecture test of vecload1 is
+    signal bus_s : bit_vector(0 to 63);
+    signal a, b  : bit_vector(0 to 3);
+    signal c     : bit_vector(0 to 3);
+    signal y     : bit_vector(0 to 11);
+begin
+
+    -- Each byte has its own driver so the bus is split into groups
+    g: for i in 0 to 7 generate
+        process is
+        begin
+            bus_s(i * 8 to i * 8 + 7) <= X"A5";
+            wait for 1 ns;
+            bus_s(i * 8 to i * 8 + 7) <= bit_vector'(X"0F") ror i;
+            wait;
+        end process;
+    end generate;
+
+    sub_i: entity work.vecload1_sub
+        port map ( x(0 to 3) => a, x(4 to 7) => b, x(8 to 11) => c,
+                   y => y );
+
+    check: process is
+    begin
+        a <= "1100";
+        b <= "0011";
+        c <= "1010";
+        wait for 0 ns;
+        assert bus_s(4 to 19) = X"5A5A";
+        assert bus_s = X"A5A5A5A5A5A5A5A5";
+        wait for 0 ns;
+        assert y = "110000111010";
+        wait for 1 ns;
+        wait for 0 ns;
+        assert bus_s(0 to 15) = X"0F87";
+        assert bus_s(4 to 11) = X"F8";
+        assert bus_s(56 to 63) = X"1E";
+        assert bus_s(60) = '1';
+        a(2) <= '1';
+        wait for 0 ns;
+        wait for 0 ns;
+        assert y(0 to 7) = "11100011";
+        assert y(2 to 9) = "10001110";
+        wait;
+    end process;
+
+end architecture;
@@ -9,5 +9,6 @@ architecture test of vhpi3 is
         end units;
 
     signal x : weight := 2 g;
+    signal y : bit;
 begin
 end architecture;
@@ -0,0 +1,64 @@
+entity wait14 is
+end entity;
+
+architecture test of wait14 is
+    type int_vec is array (natural range <>) of integer;
+
+    signal small : int_vec(0 to 3) := (others => 0);
+    signal big   : int_vec(0 to 99) := (others => 0);
+
+    signal n_small, n_big, n_static : integer := 0;
+begin
+
+    -- Each element has its own driver so the signals are split into
+    -- many groups and waits on the whole signal span all of them
+    g: for i in big'range generate
+        process is
+        begin
+            wait for (i + 1) * 1 ns;
+            big(i) <= i;
+            wait;
+        end process;
+    end generate;
+
+    small_g: for i in small'range generate
+        process is
+        begin
+            wait for 200 ns + (i + 1) * 1 ns;
+            small(i) <= i + 1;
+            wait;
+        end process;
+    end generate;
+
+    big_p: process is
+    begin
+        loop
+            wait on big;
+            n_big <= n_big + 1;
+        end loop;
+    end process;
+
+    small_p: process is
+    begin
+        loop
+            wait on small;
+            n_small <= n_small + 1;
+        end loop;
+    end process;
+
+    static_p: process (big, small) is
+    begin
+        n_static <= n_static + 1;
+    end process;
+
+    check_p: process is
+    begin
+        wait for 300 ns;
+        -- big(0) is assigned zero which is not an event
+        assert n_big = 99 report integer'image(n_big);
+        assert n_small = 4 report integer'image(n_small);
+        assert n_static = 104 report integer'image(n_static);
+        wait;
+    end process;
+
+end architecture;
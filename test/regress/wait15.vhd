@@ -0,0 +1,116 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+entity wait15 is
+end entity;
+
+architecture test of wait15 is
+    signal clk : std_logic := '0';
+    signal en  : std_logic := '0';
+
+    signal n_rise, n_fall, n_en           : natural := 0;
+    signal n_wrise, n_wfall, n_wen, n_one : natural := 0;
+begin
+
+    -- Rising edges at 10, 30 and 80 ns and falling edges at 20, 40, 70
+    -- and 90 ns: the change to '1' at 60 ns is from 'X'
+    stim: process is
+    begin
+        wait for 10 ns; clk <= '1';
+        wait for 10 ns; clk <= '0';
+        wait for 10 ns; clk <= 'H';
+        wait for 10 ns; clk <= 'L';
+        wait for 10 ns; clk <= 'X';
+        wait for 10 ns; clk <= '1';
+        wait for 10 ns; clk <= '0';
+        wait for 10 ns; clk <= '1';
+        wait for 10 ns; clk <= '0';
+        wait;
+    end process;
+
+    en <= '1' after 25 ns, '0' after 62 ns, '1' after 95 ns;
+
+    -- Processes that are one if statement waiting on their sensitivity
+    -- list
+
+    rise_p: process (clk) is
+    begin
+        if rising_edge(clk) then
+            n_rise <= n_rise + 1;
+        end if;
+    end process;
+
+    fall_p: process (clk) is
+    begin
+        if falling_edge(clk) then
+            n_fall <= n_fall + 1;
+        end if;
+    end process;
+
+    en_p: process (clk) is
+    begin
+        if clk'event and clk = '1' and en = '1' then
+            n_en <= n_en + 1;
+        end if;
+    end process;
+
+    -- Wait until statements
+
+    wrise_p: process is
+    begin
+        wait until rising_edge(clk);
+        n_wrise <= n_wrise + 1;
+    end process;
+
+    wfall_p: process is
+    begin
+        wait until falling_edge(clk);
+        n_wfall <= n_wfall + 1;
+    end process;
+
+    wen_p: process is
+    begin
+        -- Also sensitive to en so every event wakes the process
+        wait until clk'event and clk = '1' and en = '1';
+        n_wen <= n_wen + 1;
+    end process;
+
+    one_p: process is
+    begin
+        wait until clk = '1';
+        n_one <= n_one + 1;
+    end process;
+
+    -- A timeout leaves the entry for the edge wait on the pending list
+    -- of clk after the process has moved on to wait for en
+    timeout_p: process is
+    begin
+        wait until rising_edge(clk) for 15 ns;
+        assert now = 10 ns;
+        wait on en;
+        assert now = 25 ns;
+        wait until rising_edge(clk) for 15 ns;
+        assert now = 30 ns;
+        wait on en;
+        assert now = 62 ns;
+        wait until rising_edge(clk) for 15 ns;
+        assert now = 77 ns;                 -- Falling edge at 70 ns
+        wait on en;
+        assert now = 95 ns;                 -- Not the rising edge at 80 ns
+        wait;
+    end process;
+
+    check: process is
+    begin
+        wait for 100 ns;
+        assert n_rise = 3 report integer'image(n_rise);
+        assert n_fall = 4 report integer'image(n_fall);
+        assert n_en = 1 report integer'image(n_en);
+        assert n_wrise = 3 report integer'image(n_wrise);
+        assert n_wfall = 4 report integer'image(n_wfall);
+        assert n_wen = 1 report integer'image(n_wen);
+        assert n_one = 3 report integer'image(n_one);
+        wait;
+    end process;
+
+end architecture;
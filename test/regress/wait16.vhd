@@ -0,0 +1,27 @@
+entity wait16 is
+end entity;
+
+architecture test of wait16 is
+    signal clk : bit := '1';
+    signal n   : natural;
+begin
+
+    clk <= '0' after 10 ns, '1' after 20 ns;
+
+    -- The condition is only false at 10 ns: the process must still wake
+    -- up then so coverage sees both outcomes
+    count_p: process (clk) is
+    begin
+        if clk = '1' then
+            n <= n + 1;
+        end if;
+    end process;
+
+    check: process is
+    begin
+        wait for 30 ns;
+        assert n = 2;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,25 @@
+entity wave2 is
+end entity;
+
+architecture test of wave2 is
+    signal clk   : bit := '0';
+    signal count : integer := 0;
+begin
+
+    clkgen: process is
+    begin
+        for i in 1 to 10 loop
+            wait for 5 ns;
+            clk <= not clk;
+        end loop;
+        wait;
+    end process;
+
+    counter: process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            count <= count + 1;
+        end if;
+    end process;
+
+end architecture;
@@ -0,0 +1,50 @@
+package wave4_pkg is
+    type state_t is (IDLE, START, DATA, PARITY, STOP);
+end package;
+
+-------------------------------------------------------------------------------
+
+use work.wave4_pkg.all;
+
+entity wave4 is
+end entity;
+
+architecture test of wave4 is
+    type colour_t is (RED, GREEN, BLUE);
+
+    signal clk    : bit := '0';
+    signal state  : state_t := IDLE;
+    signal colour : colour_t := RED;
+    signal flag   : boolean := false;
+begin
+
+    clkgen: process is
+    begin
+        for i in 1 to 20 loop
+            wait for 5 ns;
+            clk <= not clk;
+        end loop;
+        wait;
+    end process;
+
+    -- Enumeration signals are written as strings by the FST writer
+    fsm: process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            if state = state_t'right then
+                state <= state_t'left;
+            else
+                state <= state_t'succ(state);
+            end if;
+
+            if colour = colour_t'right then
+                colour <= colour_t'left;
+            else
+                colour <= colour_t'succ(colour);
+            end if;
+
+            flag <= not flag;
+        end if;
+    end process;
+
+end architecture;
@@ -21,6 +21,9 @@
 #include <fcntl.h>
 #include <assert.h>
 #include <signal.h>
+#include <time.h>
+#include <ctype.h>
+#include <dirent.h>
 
 #ifdef __CYGWIN__
 #include <process.h>
@@ -33,12 +36,20 @@
 #define realpath(N, R) _fullpath((R), (N), _MAX_PATH)
 #else
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #endif
 #include "config.h"
+#include "fstapi.h"
 
 #define WHITESPACE " \t\r\n"
 #define TIMEOUT    10
 
+// A test is reported as slower than the baseline when its CPU time
+// grows by more than this fraction and by at least the minimum
+#define SLOW_RATIO 0.25
+#define SLOW_MIN   0.1
+
 #define ANSI_RESET      0
 #define ANSI_BOLD       1
 #define ANSI_FG_BLACK   30
@@ -60,6 +71,17 @@
 #define F_COVER   (1 << 7)
 #define F_GENERIC (1 << 8)
 #define F_RELAX   (1 << 9)
+#define F_THREADS (1 << 10)
+#define F_CKPT    (1 << 11)
+#define F_SPLIT   (1 << 12)
+#define F_CACHE   (1 << 13)
+#define F_BATCH   (1 << 14)
+#define F_JSON    (1 << 15)
+#define F_JOBS    (1 << 16)
+#define F_BUILD   (1 << 17)
+#define F_MERGE   (1 << 18)
+#define F_WAVE    (1 << 19)
+#define F_TIERED  (1 << 20)
 
 typedef struct test test_t;
 typedef struct generic generic_t;
@@ -78,6 +100,18 @@ struct test {
    char      *stop;
    generic_t *generics;
    char      *relax;
+   char      *threads;
+   char      *checkpoint;
+   char      *jobs;
+   arglist_t *sources;
+   char      *cover;
+   arglist_t *runargs;
+   char      *wave;
+   bool       passed;
+   double     wall;
+   double     cpu;
+   long       maxrss;
+   double     baseline;
 };
 
 struct arglist {
@@ -90,6 +124,9 @@ static test_t *test_list = NULL;
 static char test_dir[PATH_MAX];
 static char bin_dir[PATH_MAX];
 static bool is_tty = false;
+static int timeout = TIMEOUT;
+
+static void push_arg(arglist_t **args, const char *fmt, ...);
 
 #ifdef __MINGW32__
 static char *strndup(const char *s, size_t n)
@@ -124,7 +161,7 @@ static DWORD win32_timeout_thread(LPVOID lpParam)
 {
    HANDLE hProcess = (HANDLE)lpParam;
 
-   if (WaitForSingleObject(hProcess, TIMEOUT * 1000) == WAIT_TIMEOUT) {
+   if (WaitForSingleObject(hProcess, timeout * 1000) == WAIT_TIMEOUT) {
       if (!TerminateProcess(hProcess, 0x500))
          win32_error("TerminateProcess");
    }
@@ -271,6 +308,7 @@ static bool parse_test_list(int argc, char **argv)
 
       test_t *test = calloc(sizeof(test_t), 1);
       test->name = strdup(name);
+      test->baseline = -1.0;
 
       if (last == NULL)
          test_list = test;
@@ -304,8 +342,30 @@ static bool parse_test_list(int argc, char **argv)
             test->flags |= F_VHPI;
          else if (strcmp(opt, "opt") == 0)
             test->flags |= F_OPT;
-         else if (strcmp(opt, "cover") == 0)
+         else if (strncmp(opt, "cover", 5) == 0) {
+            char *value = strchr(opt, '=');
+            if (value != NULL)
+               test->cover = strdup(value + 1);
+
             test->flags |= F_COVER;
+         }
+         else if (strcmp(opt, "split") == 0)
+            test->flags |= F_SPLIT;
+         else if (strcmp(opt, "cache") == 0)
+            test->flags |= F_CACHE;
+         else if (strcmp(opt, "batch") == 0)
+            test->flags |= F_BATCH;
+         else if (strcmp(opt, "json") == 0)
+            test->flags |= F_JSON;
+         else if (strcmp(opt, "merge") == 0)
+            test->flags |= F_MERGE;
+         else if (strncmp(opt, "wave", 4) == 0) {
+            char *value = strchr(opt, '=');
+            test->flags |= F_WAVE;
+            test->wave = strdup(value ? value + 1 : "vcd");
+         }
+         else if (strcmp(opt, "tiered") == 0)
+            test->flags |= F_TIERED;
          else if (strncmp(opt, "g", 1) == 0) {
             char *value = strchr(opt, '=');
             if (value == NULL) {
@@ -333,6 +393,70 @@ static bool parse_test_list(int argc, char **argv)
             test->flags |= F_RELAX;
             test->relax = strdup(value + 1);
          }
+         else if (strncmp(opt, "threads", 7) == 0) {
+            char *value = strchr(opt, '=');
+            if (value == NULL) {
+               fprintf(stderr, "Error on testlist line %d: missing argument to "
+                       "threads option in test %s\n", lineno, name);
+               goto out_close;
+            }
+
+            test->flags |= F_THREADS;
+            test->threads = strdup(value + 1);
+         }
+         else if (strncmp(opt, "checkpoint", 10) == 0) {
+            char *value = strchr(opt, '=');
+            if (value == NULL) {
+               fprintf(stderr, "Error on testlist line %d: missing argument to "
+                       "checkpoint option in test %s\n", lineno, name);
+               goto out_close;
+            }
+
+            test->flags |= F_CKPT;
+            test->checkpoint = strdup(value + 1);
+         }
+         else if (strncmp(opt, "jobs", 4) == 0) {
+            char *value = strchr(opt, '=');
+            if (value == NULL) {
+               fprintf(stderr, "Error on testlist line %d: missing argument to "
+                       "jobs option in test %s\n", lineno, name);
+               goto out_close;
+            }
+
+            test->flags |= F_JOBS;
+            test->jobs = strdup(value + 1);
+         }
+         else if (strncmp(opt, "build", 5) == 0) {
+            char *value = strchr(opt, '=');
+            if (value == NULL) {
+               fprintf(stderr, "Error on testlist line %d: missing argument to "
+                       "build option in test %s\n", lineno, name);
+               goto out_close;
+            }
+
+            test->flags |= F_BUILD;
+            test->jobs = strdup(value + 1);
+         }
+         else if (strncmp(opt, "with", 4) == 0) {
+            char *value = strchr(opt, '=');
+            if (value == NULL) {
+               fprintf(stderr, "Error on testlist line %d: missing argument to "
+                       "with option in test %s\n", lineno, name);
+               goto out_close;
+            }
+
+            push_arg(&(test->sources), "%s", value + 1);
+         }
+         else if (strncmp(opt, "run", 3) == 0) {
+            char *value = strchr(opt, '=');
+            if (value == NULL) {
+               fprintf(stderr, "Error on testlist line %d: missing argument to "
+                       "run option in test %s\n", lineno, name);
+               goto out_close;
+            }
+
+            push_arg(&(test->runargs), "%s", value + 1);
+         }
          else {
             fprintf(stderr, "Error on testlist line %d: invalid option %s in "
                  "test %s\n", lineno, opt, name);
@@ -425,7 +549,7 @@ static bool run_cmd(FILE *log, arglist_t **args)
 
       signal(SIGALRM, signal_handler);
       signal(SIGCHLD, signal_handler);
-      alarm(TIMEOUT);
+      alarm(timeout);
       pause();
       signal(SIGALRM, SIG_DFL);
       signal(SIGCHLD, SIG_DFL);
@@ -460,6 +584,58 @@ static void push_std(test_t *test, arglist_t **args)
       push_arg(args, "--std=2008");
 }
 
+static void push_analyse(test_t *test, arglist_t **args)
+{
+   if (test->flags & F_BUILD) {
+      push_arg(args, "--build");
+      push_arg(args, "--jobs=%s", test->jobs);
+   }
+   else {
+      push_arg(args, "-a");
+
+      if (test->flags & F_JOBS)
+         push_arg(args, "--jobs=%s", test->jobs);
+   }
+
+   push_arg(args, "%s" PATH_SEP "regress" PATH_SEP "%s.vhd",
+            test_dir, test->name);
+
+   // Any extra source files are given after the test's own file
+   for (arglist_t *it = test->sources; it != NULL; it = it->next)
+      push_arg(args, "%s" PATH_SEP "regress" PATH_SEP "%s.vhd",
+               test_dir, it->data);
+
+   if (test->flags & F_RELAX)
+      push_arg(args, "--relax=%s", test->relax);
+}
+
+static void push_elab(test_t *test, arglist_t **args)
+{
+   push_arg(args, "-e");
+   push_arg(args, "%s", test->name);
+
+   if (!(test->flags & F_OPT))
+      push_arg(args, "-O0");
+
+   if (test->flags & F_COVER) {
+      if (test->cover != NULL)
+         push_arg(args, "--cover=%s", test->cover);
+      else
+         push_arg(args, "--cover");
+   }
+
+   if (test->flags & F_CACHE) {
+      push_arg(args, "--cache");
+      push_arg(args, "--verbose");
+   }
+
+   if (test->flags & F_TIERED)
+      push_arg(args, "--tiered");
+
+   for (generic_t *g = test->generics; g != NULL; g = g->next)
+      push_arg(args, "-g%s=%s", g->name, g->value);
+}
+
 static void chomp(char *str)
 {
    const size_t len = strlen(str);
@@ -467,6 +643,296 @@ static void chomp(char *str)
       str[len - 1] = '\0';
 }
 
+static void json_skip_ws(const char **p)
+{
+   while (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n')
+      (*p)++;
+}
+
+static bool json_value(const char **p, int depth);
+
+static bool json_string(const char **p)
+{
+   if (*(*p)++ != '"')
+      return false;
+
+   for (;;) {
+      const unsigned char c = *(*p)++;
+      if (c == '"')
+         return true;
+      else if (c < 0x20)
+         return false;
+      else if (c == '\\') {
+         const char e = *(*p)++;
+         if (e == 'u') {
+            for (int i = 0; i < 4; i++) {
+               if (!isxdigit((unsigned char)*(*p)++))
+                  return false;
+            }
+         }
+         else if (strchr("\"\\/bfnrt", e) == NULL || e == '\0')
+            return false;
+      }
+   }
+}
+
+static bool json_list(const char **p, int depth, char close, bool object)
+{
+   (*p)++;
+   json_skip_ws(p);
+   if (**p == close) {
+      (*p)++;
+      return true;
+   }
+
+   for (;;) {
+      if (object) {
+         if (!json_string(p))
+            return false;
+         json_skip_ws(p);
+         if (*(*p)++ != ':')
+            return false;
+      }
+
+      if (!json_value(p, depth + 1))
+         return false;
+
+      json_skip_ws(p);
+      const char c = *(*p)++;
+      if (c == close)
+         return true;
+      else if (c != ',')
+         return false;
+
+      json_skip_ws(p);
+   }
+}
+
+static bool json_value(const char **p, int depth)
+{
+   if (depth > 64)
+      return false;
+
+   json_skip_ws(p);
+
+   switch (**p) {
+   case '{':
+      return json_list(p, depth, '}', true);
+   case '[':
+      return json_list(p, depth, ']', false);
+   case '"':
+      return json_string(p);
+   case 't':
+   case 'f':
+   case 'n':
+      {
+         static const char *words[] = { "true", "false", "null" };
+         for (int i = 0; i < 3; i++) {
+            const size_t len = strlen(words[i]);
+            if (strncmp(*p, words[i], len) == 0) {
+               *p += len;
+               return true;
+            }
+         }
+         return false;
+      }
+   default:
+      {
+         char *end;
+         strtod(*p, &end);
+         if (end == *p || (**p != '-' && !isdigit((unsigned char)**p)))
+            return false;
+         *p = end;
+         return true;
+      }
+   }
+}
+
+static bool check_json(FILE *log, const char *fname)
+{
+   // Check the file is valid JSON and append it to the log so the gold
+   // file can match its contents
+
+   FILE *f = fopen(fname, "r");
+   if (f == NULL) {
+      fprintf(log, "cannot open %s: %s\n", fname, strerror(errno));
+      return false;
+   }
+
+   char *text = NULL;
+   size_t len = 0, alloc = 0;
+   for (;;) {
+      if (len + 4096 + 1 > alloc) {
+         alloc = alloc * 2 + 4096 + 1;
+         if ((text = realloc(text, alloc)) == NULL)
+            abort();
+      }
+
+      const size_t n = fread(text + len, 1, 4096, f);
+      if (n == 0)
+         break;
+      len += n;
+   }
+   text[len] = '\0';
+   fclose(f);
+
+   const char *p = text;
+   bool valid = json_value(&p, 0);
+   if (valid) {
+      json_skip_ws(&p);
+      valid = (*p == '\0');
+   }
+
+   fseek(log, 0, SEEK_END);
+   if (valid)
+      fputs(text, log);
+   else
+      fprintf(log, "%s is not valid JSON at offset %d\n",
+              fname, (int)(p - text));
+
+   free(text);
+   return valid;
+}
+
+static int compare_lines(const void *a, const void *b)
+{
+   return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static char **read_vcd(const char *fname, int *nlines)
+{
+   // Read a VCD file into an array of lines without the $date and
+   // $version sections and with the value changes in each time step
+   // sorted as the order of signals within a step is not significant
+
+   FILE *f = fopen(fname, "r");
+   if (f == NULL)
+      return NULL;
+
+   char **lines = NULL;
+   int count = 0, alloc = 0, step = 0;
+   bool skip = false;
+
+   char line[256];
+   while (fgets(line, sizeof(line), f)) {
+      chomp(line);
+
+      if (skip) {
+         skip = strcmp(line, "$end") != 0;
+         continue;
+      }
+      else if (strcmp(line, "$date") == 0 || strcmp(line, "$version") == 0) {
+         skip = true;
+         continue;
+      }
+      else if (line[0] == '#') {
+         qsort(lines + step, count - step, sizeof(char *), compare_lines);
+         step = count + 1;
+      }
+
+      if (count == alloc) {
+         alloc = alloc * 2 + 64;
+         if ((lines = realloc(lines, alloc * sizeof(char *))) == NULL)
+            abort();
+      }
+
+      lines[count++] = strdup(line);
+   }
+
+   if (step > 0)
+      qsort(lines + step, count - step, sizeof(char *), compare_lines);
+
+   fclose(f);
+
+   *nlines = count;
+   return lines;
+}
+
+static bool fst_to_vcd(FILE *log, test_t *test)
+{
+   // Convert an FST dump to VCD with the reader from the FST library so
+   // it can be compared with the gold file
+
+   char fstname[PATH_MAX], vcdname[PATH_MAX];
+   snprintf(fstname, PATH_MAX, "%s.fst", test->name);
+   snprintf(vcdname, PATH_MAX, "%s.vcd", test->name);
+
+   fseek(log, 0, SEEK_END);
+
+   void *ctx = fstReaderOpen(fstname);
+   if (ctx == NULL) {
+      fprintf(log, "cannot read %s\n", fstname);
+      return false;
+   }
+
+   FILE *f = fopen(vcdname, "w");
+   if (f == NULL) {
+      fprintf(log, "cannot create %s: %s\n", vcdname, strerror(errno));
+      fstReaderClose(ctx);
+      return false;
+   }
+
+   fstReaderProcessHier(ctx, f);
+   fstReaderSetFacProcessMaskAll(ctx);
+   fstReaderIterBlocks(ctx, NULL, NULL, f);
+   fstReaderClose(ctx);
+
+   fclose(f);
+   return true;
+}
+
+static bool check_wave(FILE *log, test_t *test)
+{
+   // Compare the waveform dump with the gold VCD file
+
+   char goldname[PATH_MAX], fname[PATH_MAX];
+   snprintf(goldname, PATH_MAX, "%s" PATH_SEP "regress" PATH_SEP "gold"
+            PATH_SEP "%s.vcd", test_dir, test->name);
+   snprintf(fname, PATH_MAX, "%s.vcd", test->name);
+
+   fseek(log, 0, SEEK_END);
+
+   int ngold, nout;
+   char **gold = read_vcd(goldname, &ngold);
+   if (gold == NULL) {
+      fprintf(log, "cannot open %s: %s\n", goldname, strerror(errno));
+      return false;
+   }
+
+   char **out = read_vcd(fname, &nout);
+   if (out == NULL) {
+      fprintf(log, "cannot open %s: %s\n", fname, strerror(errno));
+      return false;
+   }
+
+   bool match = true;
+   for (int i = 0; match && i < ngold; i++) {
+      if (i == nout) {
+         fprintf(log, "%s ends before %s\n", fname, gold[i]);
+         match = false;
+      }
+      else if (strcmp(gold[i], out[i]) != 0) {
+         fprintf(log, "%s has %s where gold has %s\n", fname, out[i], gold[i]);
+         match = false;
+      }
+   }
+
+   if (match && nout > ngold) {
+      fprintf(log, "%s has extra line %s\n", fname, out[ngold]);
+      match = false;
+   }
+
+   for (int i = 0; i < ngold; i++)
+      free(gold[i]);
+   free(gold);
+
+   for (int i = 0; i < nout; i++)
+      free(out[i]);
+   free(out);
+
+   return match;
+}
+
 static int make_dir(const char *name)
 {
 #ifdef __MINGW32__
@@ -476,6 +942,50 @@ static int make_dir(const char *name)
 #endif
 }
 
+static void push_batch_covdbs(test_t *test, arglist_t **args)
+{
+   // Each entry in the batch file writes its own coverage database
+
+   char fname[PATH_MAX];
+   snprintf(fname, PATH_MAX, "%s" PATH_SEP "regress" PATH_SEP "batch"
+            PATH_SEP "%s.txt", test_dir, test->name);
+
+   FILE *f = fopen(fname, "r");
+   if (f == NULL)
+      return;
+
+   char line[256];
+   while (fgets(line, sizeof(line), f) != NULL) {
+      char entry[256];
+      if (line[0] != '#' && sscanf(line, " %255s", entry) == 1)
+         push_arg(args, "%s.covdb", entry);
+   }
+
+   fclose(f);
+}
+
+static void remove_work(void)
+{
+   // Delete the work library left by an earlier run of the test
+
+   DIR *d = opendir("work");
+   if (d == NULL)
+      return;
+
+   struct dirent *e;
+   while ((e = readdir(d)) != NULL) {
+      if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+         continue;
+
+      char path[PATH_MAX];
+      snprintf(path, PATH_MAX, "work" PATH_SEP "%s", e->d_name);
+      remove(path);
+   }
+
+   closedir(d);
+   rmdir("work");
+}
+
 static bool run_test(test_t *test)
 {
    bool result = false;
@@ -504,6 +1014,21 @@ static bool run_test(test_t *test)
    }
 #endif
 
+#if !defined LLVM_HAS_ORC_BINDINGS || !defined HAVE_PTHREAD \
+   || defined __MINGW32__
+   if (test->flags & F_TIERED) {
+      set_attr(ANSI_FG_CYAN);
+      printf("skipped\n");
+      set_attr(ANSI_RESET);
+      result = true;
+      goto out_chdir;
+   }
+#endif
+
+   // A build must start from an empty library to analyse every file
+   if (test->flags & F_BUILD)
+      remove_work();
+
    FILE *outf = fopen("out", "w");
    if (outf == NULL) {
       fprintf(stderr, "Failed to create logs/%s/out log file: %s\n",
@@ -515,26 +1040,52 @@ static bool run_test(test_t *test)
    push_arg(&args, "%s" PATH_SEP "nvc%s", bin_dir, EXEEXT);
    push_std(test, &args);
 
-   push_arg(&args, "-a");
-   push_arg(&args, "%s" PATH_SEP "regress" PATH_SEP "%s.vhd",
-            test_dir, test->name);
+   push_analyse(test, &args);
 
-   if (test->flags & F_RELAX)
-      push_arg(&args, "--relax=%s", test->relax);
+   if (test->flags & F_BUILD) {
+      // Elaborate after a fresh build and then build again which should
+      // find every file is up to date
+      push_elab(test, &args);
 
-   push_arg(&args, "-e");
-   push_arg(&args, "%s", test->name);
+      if (!run_cmd(outf, &args))
+         goto out_print;
 
-   if (!(test->flags & F_OPT))
-      push_arg(&args, "-O0");
+      push_arg(&args, "%s" PATH_SEP "nvc%s", bin_dir, EXEEXT);
+      push_std(test, &args);
+      push_analyse(test, &args);
+   }
+
+   if (test->flags & F_SPLIT) {
+      // Analyse, elaborate, and run each in a fresh process
+      if (!run_cmd(outf, &args))
+         goto out_print;
+
+      push_arg(&args, "%s" PATH_SEP "nvc%s", bin_dir, EXEEXT);
+      push_std(test, &args);
+   }
 
-   if (test->flags & F_COVER)
-      push_arg(&args, "--cover");
+   push_elab(test, &args);
 
-   for (generic_t *g = test->generics; g != NULL; g = g->next)
-      push_arg(&args, "-g%s=%s", g->name, g->value);
+   if (test->flags & F_CACHE) {
+      // Elaborating again should reuse the previous design but not once
+      // the source has been analysed again
+      if (!run_cmd(outf, &args))
+         goto out_print;
+
+      push_arg(&args, "%s" PATH_SEP "nvc%s", bin_dir, EXEEXT);
+      push_std(test, &args);
+      push_elab(test, &args);
+
+      if (!run_cmd(outf, &args))
+         goto out_print;
+
+      push_arg(&args, "%s" PATH_SEP "nvc%s", bin_dir, EXEEXT);
+      push_std(test, &args);
+      push_analyse(test, &args);
+      push_elab(test, &args);
+   }
 
-   if (test->flags & F_FAIL) {
+   if (test->flags & (F_FAIL | F_SPLIT)) {
       if (!run_cmd(outf, &args))
          goto out_print;
 
@@ -547,13 +1098,80 @@ static bool run_test(test_t *test)
    if (test->flags & F_STOP)
       push_arg(&args, "--stop-time=%s", test->stop);
 
+   if (test->flags & F_THREADS)
+      push_arg(&args, "--threads=%s", test->threads);
+
    if (test->flags & F_VHPI)
       push_arg(&args, "--load=%s/../lib/%s.so%s", bin_dir, test->name, EXEEXT);
 
+   if (test->flags & F_CKPT)
+      push_arg(&args, "--checkpoint=%s:%s.ckpt", test->checkpoint, test->name);
+
+   if (test->flags & F_BATCH) {
+      push_arg(&args, "--batch=%s" PATH_SEP "regress" PATH_SEP "batch"
+               PATH_SEP "%s.txt", test_dir, test->name);
+      push_arg(&args, "--jobs=2");
+   }
+
+   if (test->flags & F_JSON) {
+      push_arg(&args, "--profile=%s.prof.json", test->name);
+      push_arg(&args, "--stats=json:%s.stats.json", test->name);
+   }
+
+   if (test->flags & F_WAVE) {
+      push_arg(&args, "--format=%s", test->wave);
+      push_arg(&args, "--wave=%s.%s", test->name, test->wave);
+   }
+
+   for (arglist_t *it = test->runargs; it != NULL; it = it->next)
+      push_arg(&args, "%s", it->data);
+
    push_arg(&args, "%s", test->name);
 
    result = run_cmd(outf, &args);
 
+   if (result && (test->flags & F_JSON)) {
+      char fname[PATH_MAX];
+      snprintf(fname, PATH_MAX, "%s.prof.json", test->name);
+      result = check_json(outf, fname);
+
+      snprintf(fname, PATH_MAX, "%s.stats.json", test->name);
+      result = check_json(outf, fname) && result;
+   }
+
+   if (result && (test->flags & F_WAVE)) {
+      if (strcmp(test->wave, "fst") == 0)
+         result = fst_to_vcd(outf, test);
+
+      result = result && check_wave(outf, test);
+   }
+
+   if (result && (test->flags & F_MERGE)) {
+      // Combine the coverage from every entry in the batch
+      push_arg(&args, "%s" PATH_SEP "nvc%s", bin_dir, EXEEXT);
+      push_std(test, &args);
+      push_arg(&args, "--cover-merge");
+      push_batch_covdbs(test, &args);
+
+      result = run_cmd(outf, &args);
+   }
+
+   if (result && (test->flags & F_CKPT)) {
+      // Run again from the checkpoint: the gold file should match the
+      // output of both runs
+      push_arg(&args, "%s/nvc%s", bin_dir, EXEEXT);
+      push_std(test, &args);
+      push_arg(&args, "-r");
+
+      if (test->flags & F_STOP)
+         push_arg(&args, "--stop-time=%s", test->stop);
+
+      push_arg(&args, "--restore=%s.ckpt", test->name);
+      push_arg(&args, "%s", test->name);
+
+      result = run_cmd(outf, &args);
+   }
+
    if (test->flags & F_FAIL)
       result = !result;
 
@@ -630,6 +1248,227 @@ static bool run_test(test_t *test)
    return result;
 }
 
+static double wall_clock(void)
+{
+#ifdef __MINGW32__
+   return GetTickCount64() / 1000.0;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+#ifndef __MINGW32__
+typedef struct {
+   pid_t   pid;
+   test_t *test;
+   FILE   *out;
+   double  start;
+} slot_t;
+
+static bool start_test(slot_t *slot, test_t *test)
+{
+   // The output of each test is buffered in a temporary file so lines
+   // from tests running in parallel do not interleave
+
+   FILE *out = tmpfile();
+   if (out == NULL) {
+      fprintf(stderr, "Failed to create temporary file: %s\n",
+              strerror(errno));
+      return false;
+   }
+
+   fflush(stdout);
+   fflush(stderr);
+
+   pid_t pid = fork();
+   if (pid < 0) {
+      fprintf(stderr, "Fork failed: %s\n", strerror(errno));
+      fclose(out);
+      return false;
+   }
+   else if (pid == 0) {
+      dup2(fileno(out), STDOUT_FILENO);
+
+      const bool result = run_test(test);
+      fflush(stdout);
+      _exit(result ? EXIT_SUCCESS : EXIT_FAILURE);
+   }
+
+   slot->pid   = pid;
+   slot->test  = test;
+   slot->out   = out;
+   slot->start = wall_clock();
+
+   return true;
+}
+
+static void finish_test(slot_t *slot, int status, const struct rusage *ru)
+{
+   test_t *test = slot->test;
+
+   // The usage of the child includes every nvc process it waited for
+   test->passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+   test->wall   = wall_clock() - slot->start;
+   test->cpu    = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6
+      + ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+   test->maxrss = ru->ru_maxrss / 1024;
+#else
+   test->maxrss = ru->ru_maxrss;
+#endif
+
+   rewind(slot->out);
+
+   char buf[1024];
+   size_t nbytes;
+   while ((nbytes = fread(buf, 1, sizeof(buf), slot->out)) > 0)
+      fwrite(buf, 1, nbytes, stdout);
+   fflush(stdout);
+
+   fclose(slot->out);
+
+   slot->pid  = 0;
+   slot->test = NULL;
+   slot->out  = NULL;
+}
+#endif  // __MINGW32__
+
+static bool run_tests(int jobs)
+{
+#ifdef __MINGW32__
+   for (test_t *it = test_list; it != NULL; it = it->next) {
+      const double start = wall_clock();
+      it->passed = run_test(it);
+      it->wall = wall_clock() - start;
+   }
+#else
+   slot_t *slots = calloc(jobs, sizeof(slot_t));
+   int running = 0;
+
+   test_t *next = test_list;
+   while (next != NULL || running > 0) {
+      for (int i = 0; i < jobs && next != NULL; i++) {
+         if (slots[i].pid == 0) {
+            if (!start_test(&(slots[i]), next)) {
+               free(slots);
+               return false;
+            }
+
+            next = next->next;
+            running++;
+         }
+      }
+
+      int status;
+      struct rusage ru;
+      pid_t pid = wait4(-1, &status, 0, &ru);
+      if (pid < 0) {
+         if (errno == EINTR)
+            continue;
+
+         fprintf(stderr, "Waiting for child failed: %s\n", strerror(errno));
+         free(slots);
+         return false;
+      }
+
+      for (int i = 0; i < jobs; i++) {
+         if (slots[i].pid == pid) {
+            finish_test(&(slots[i]), status, &ru);
+            running--;
+            break;
+         }
+      }
+   }
+
+   free(slots);
+#endif
+
+   bool pass = true;
+   for (test_t *it = test_list; it != NULL; it = it->next)
+      pass = pass && it->passed;
+
+   return pass;
+}
+
+static bool read_baseline(const char *path)
+{
+   FILE *f = fopen(path, "r");
+   if (f == NULL) {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return false;
+   }
+
+   char line[512];
+   while (fgets(line, sizeof(line), f)) {
+      if (is_comment(line))
+         continue;
+
+      char name[256], status[16];
+      double wall, cpu;
+      if (sscanf(line, "%255s %15s %lf %lf", name, status, &wall, &cpu) != 4)
+         continue;
+
+      for (test_t *it = test_list; it != NULL; it = it->next) {
+         if (strcmp(it->name, name) == 0) {
+            it->baseline = cpu;
+            break;
+         }
+      }
+   }
+
+   fclose(f);
+   return true;
+}
+
+static void write_summary(FILE *f)
+{
+   fprintf(f, "# name status wall cpu maxrss\n");
+
+   for (test_t *it = test_list; it != NULL; it = it->next)
+      fprintf(f, "%s %s %.3f %.3f %ld\n", it->name,
+              it->passed ? "pass" : "fail", it->wall, it->cpu, it->maxrss);
+}
+
+static void report_slow(void)
+{
+   // CPU time is compared rather than wall time as it is less affected
+   // by the number of tests running in parallel
+
+   int nslow = 0;
+   for (test_t *it = test_list; it != NULL; it = it->next) {
+      if (!it->passed || it->baseline < 0.0)
+         continue;
+      else if (it->cpu < it->baseline * (1.0 + SLOW_RATIO))
+         continue;
+      else if (it->cpu - it->baseline < SLOW_MIN)
+         continue;
+
+      if (nslow++ == 0) {
+         set_attr(ANSI_FG_YELLOW);
+         printf("\nTests slower than baseline:\n");
+         set_attr(ANSI_RESET);
+      }
+
+      printf("%15s : %.3fs (baseline %.3fs)\n",
+             it->name, it->cpu, it->baseline);
+   }
+}
+
+static void usage(const char *prog)
+{
+   fprintf(stderr,
+           "Usage: %s [OPTION]... [TEST]...\n"
+           "\n"
+           " -b FILE\tCompare CPU time against a summary from a previous "
+           "run\n"
+           " -j N\t\tRun N tests in parallel\n"
+           " -s FILE\tWrite time and memory used by each test to FILE\n"
+           " -t SECS\tKill each command after SECS seconds (default %d)\n",
+           prog, TIMEOUT);
+}
+
 static void checked_realpath(const char *path, char *output)
 {
    if (realpath(path, output) == NULL) {
@@ -678,8 +1517,47 @@ int main(int argc, char **argv)
    if (getenv("QUICK"))
       return 0;
 
-   if (!parse_test_list(argc - 1, argv + 1))
+   int jobs = 1, c;
+   const char *baseline = NULL, *summary = NULL;
+   while ((c = getopt(argc, argv, "b:hj:s:t:")) != -1) {
+      switch (c) {
+      case 'b':
+         baseline = optarg;
+         break;
+      case 'j':
+         if ((jobs = atoi(optarg)) < 1) {
+            fprintf(stderr, "Error: invalid number of jobs %s\n", optarg);
+            return EXIT_FAILURE;
+         }
+         break;
+      case 's':
+         summary = optarg;
+         break;
+      case 't':
+         if ((timeout = atoi(optarg)) < 1) {
+            fprintf(stderr, "Error: invalid timeout %s\n", optarg);
+            return EXIT_FAILURE;
+         }
+         break;
+      default:
+         usage(argv[0]);
+         return c == 'h' ? 0 : EXIT_FAILURE;
+      }
+   }
+
+   if (!parse_test_list(argc - optind, argv + optind))
+      return EXIT_FAILURE;
+
+   if (baseline != NULL && !read_baseline(baseline))
+      return EXIT_FAILURE;
+
+   // Open the summary before changing into the logs directory so a
+   // relative path is interpreted as the user expects
+   FILE *summaryf = NULL;
+   if (summary != NULL && (summaryf = fopen(summary, "w")) == NULL) {
+      fprintf(stderr, "%s: %s\n", summary, strerror(errno));
       return EXIT_FAILURE;
+   }
 
    if (make_dir("logs") != 0 && errno != EEXIST) {
       fprintf(stderr, "Failed to make logs directory: %s\n", strerror(errno));
@@ -692,11 +1570,15 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
    }
 
-   bool pass = true;
-   for (test_t *it = test_list; it != NULL; it = it->next) {
-      if (!run_test(it))
-         pass = false;
+   const bool pass = run_tests(jobs);
+
+   if (summaryf != NULL) {
+      write_summary(summaryf);
+      fclose(summaryf);
    }
 
+   if (baseline != NULL)
+      report_slow();
+
    return pass ? 0 : EXIT_FAILURE;
 }
@@ -0,0 +1,14 @@
+entity hashcons is
+end entity;
+
+architecture test of hashcons is
+    constant N : integer := 7;
+    signal x : bit_vector(7 downto 0);
+    signal y : bit_vector(7 downto 0);
+    signal z : bit_vector(3 downto 0);
+    signal w : bit_vector(N downto 0);
+begin
+
+    x <= y;
+
+end architecture;
@@ -0,0 +1,52 @@
+package pack is
+    type t is (A, B, C);
+    function "="(l, r : t) return boolean;
+    function succ(x : t) return t;
+    constant K : t := B;
+end package;
+
+package body pack is
+    function "="(l, r : t) return boolean is
+    begin
+        return t'pos(l) = t'pos(r);
+    end function;
+
+    function succ(x : t) return t is
+    begin
+        return t'succ(x);
+    end function;
+end package body;
+
+entity lazyimport is
+end entity;
+
+use work.pack.all;
+
+architecture one of lazyimport is
+    signal s : t;
+begin
+
+    process is
+    begin
+        s <= succ(K);                   -- OK
+        assert s = C;                   -- OK, explicit "=" hides builtin
+        wait;
+    end process;
+
+end architecture;
+
+use work.pack.succ;
+
+architecture two of lazyimport is
+    signal s : work.pack.t;
+begin
+
+    process is
+    begin
+        s <= succ(work.pack.A);         -- OK
+        assert work.pack."="(s, work.pack.B);  -- OK
+        s <= K;                         -- Error
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,97 @@
+#include "rt/access.h"
+
+#include <check.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+static void teardown(void)
+{
+   access_release_all();
+}
+
+START_TEST(test_reuse)
+{
+   void *p1 = access_alloc(24);
+   fail_if(p1 == NULL);
+   fail_unless(((uintptr_t)p1 & 15) == 0);
+   memset(p1, 0xff, 24);
+
+   access_free(p1);
+
+   // Same size class comes back from the free list
+   void *p2 = access_alloc(30);
+   fail_unless(p2 == p1);
+
+   void *p3 = access_alloc(100);
+   fail_if(p3 == p2);
+
+   access_free(p2);
+   access_free(p3);
+   access_free(NULL);
+}
+END_TEST
+
+START_TEST(test_large)
+{
+   access_stats_t before;
+   access_stats(&before);
+
+   char *p = access_alloc(100000);
+   fail_if(p == NULL);
+   memset(p, 'x', 100000);
+
+   access_stats_t during;
+   access_stats(&during);
+   fail_unless(during.large == before.large + 1);
+   fail_unless(during.large_bytes >= 100000);
+
+   access_free(p);
+
+   access_stats_t after;
+   access_stats(&after);
+   fail_unless(after.large_bytes == before.large_bytes);
+   fail_unless(after.frees == before.frees + 1);
+}
+END_TEST
+
+START_TEST(test_many)
+{
+   const int n = 10000;
+   void **ptrs = calloc(n, sizeof(void *));
+
+   for (int i = 0; i < n; i++) {
+      const size_t size = 1 + (i * 37) % 3000;
+      ptrs[i] = access_alloc(size);
+      memset(ptrs[i], i & 0xff, size);
+   }
+
+   for (int i = 0; i < n; i++) {
+      const size_t size = 1 + (i * 37) % 3000;
+      const unsigned char *p = ptrs[i];
+      for (size_t j = 0; j < size; j++)
+         fail_unless(p[j] == (i & 0xff));
+   }
+
+   for (int i = 0; i < n; i += 2)
+      access_free(ptrs[i]);
+   for (int i = 1; i < n; i += 2)
+      access_free(ptrs[i]);
+
+   free(ptrs);
+}
+END_TEST
+
+Suite *get_access_tests(void)
+{
+   Suite *s = suite_create("access");
+
+   TCase *tc_core = tcase_create("Core");
+   tcase_add_checked_fixture(tc_core, NULL, teardown);
+   tcase_add_test(tc_core, test_reuse);
+   tcase_add_test(tc_core, test_large);
+   tcase_add_test(tc_core, test_many);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
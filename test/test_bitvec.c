@@ -0,0 +1,130 @@
+#include "util.h"
+#include "rt/rt.h"
+#include "rt/bitvec.h"
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lengths either side of each vector width to cover the tail loops
+static const size_t lengths[] = { 1, 15, 16, 17, 31, 32, 33, 100 };
+
+static void random_bits(uint8_t *buf, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      buf[i] = rand() % 2;
+}
+
+static uint8_t expect_op(int kind, uint8_t a, uint8_t b)
+{
+   switch (kind) {
+   case BIT_VEC_NOT:  return !a;
+   case BIT_VEC_AND:  return a && b;
+   case BIT_VEC_OR:   return a || b;
+   case BIT_VEC_XOR:  return a ^ b;
+   case BIT_VEC_XNOR: return !(a ^ b);
+   case BIT_VEC_NAND: return !(a && b);
+   case BIT_VEC_NOR:  return !(a || b);
+   default:           return 0xff;
+   }
+}
+
+START_TEST(test_op)
+{
+   for (int i = 0; i < ARRAY_LEN(lengths); i++) {
+      const size_t n = lengths[i];
+
+      uint8_t a[n], b[n], out[n + 1];
+      random_bits(a, n);
+      random_bits(b, n);
+
+      for (int kind = BIT_VEC_NOT; kind <= BIT_VEC_NOR; kind++) {
+         out[n] = 42;
+         bitvec_op(kind, a, b, out, n);
+
+         for (size_t j = 0; j < n; j++)
+            ck_assert_int_eq(out[j], expect_op(kind, a[j], b[j]));
+         ck_assert_int_eq(out[n], 42);
+      }
+   }
+}
+END_TEST
+
+START_TEST(test_shift)
+{
+   for (int i = 0; i < ARRAY_LEN(lengths); i++) {
+      const size_t n = lengths[i];
+
+      uint8_t data[n], out[n];
+      random_bits(data, n);
+
+      for (size_t shift = 0; shift < n; shift += (n / 4) + 1) {
+         bitvec_shift(BIT_SHIFT_SLL, data, out, n, shift);
+         for (size_t j = 0; j < n; j++)
+            ck_assert_int_eq(out[j], (j < n - shift) ? data[j + shift] : 0);
+
+         bitvec_shift(BIT_SHIFT_SRL, data, out, n, shift);
+         for (size_t j = 0; j < n; j++)
+            ck_assert_int_eq(out[j], (j >= shift) ? data[j - shift] : 0);
+
+         bitvec_shift(BIT_SHIFT_SLA, data, out, n, shift);
+         for (size_t j = 0; j < n; j++)
+            ck_assert_int_eq(out[j],
+                             (j < n - shift) ? data[j + shift] : data[n - 1]);
+
+         bitvec_shift(BIT_SHIFT_SRA, data, out, n, shift);
+         for (size_t j = 0; j < n; j++)
+            ck_assert_int_eq(out[j], (j >= shift) ? data[j - shift] : data[0]);
+
+         bitvec_shift(BIT_SHIFT_ROL, data, out, n, shift);
+         for (size_t j = 0; j < n; j++)
+            ck_assert_int_eq(out[j], data[(j + shift) % n]);
+
+         bitvec_shift(BIT_SHIFT_ROR, data, out, n, shift);
+         for (size_t j = 0; j < n; j++)
+            ck_assert_int_eq(out[j], data[(j + n - shift) % n]);
+      }
+   }
+}
+END_TEST
+
+START_TEST(test_pack)
+{
+   for (int i = 0; i < ARRAY_LEN(lengths); i++) {
+      const size_t n = lengths[i];
+
+      uint8_t data[n], out[n], packed[n + 1];
+      for (int bits = 1; bits <= 4; bits += 3) {
+         for (size_t j = 0; j < n; j++)
+            data[j] = rand() % (1 << bits);
+
+         ck_assert(bitvec_pack_bits(data, n, 1) <= bits);
+         ck_assert_int_eq(bitvec_pack_bits(data, n, 4), 4);
+
+         const size_t packedsz = bitvec_packed_size(n, bits);
+         packed[packedsz] = 42;
+         bitvec_pack(data, packed, n, bits);
+         ck_assert_int_eq(packed[packedsz], 42);
+
+         bitvec_unpack(packed, out, n, bits);
+         ck_assert(memcmp(data, out, n) == 0);
+      }
+
+      data[n - 1] = 0x10;
+      ck_assert_int_eq(bitvec_pack_bits(data, n, 1), 8);
+   }
+}
+END_TEST
+
+Suite *get_bitvec_tests(void)
+{
+   Suite *s = suite_create("bitvec");
+
+   TCase *tc_core = tcase_create("Core");
+   tcase_add_test(tc_core, test_op);
+   tcase_add_test(tc_core, test_shift);
+   tcase_add_test(tc_core, test_pack);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
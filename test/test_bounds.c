@@ -316,6 +316,26 @@ START_TEST(test_issue356)
 }
 END_TEST
 
+START_TEST(test_fused)
+{
+   input_from_file(TESTDIR "/bounds/fused.vhd");
+
+   const error_t expect[] = {
+      { 15, "array V index 0 out of bounds 1 to 10" },
+      { 19, "assignment delay may not be negative" },
+      { -1, NULL }
+   };
+   expect_errors(expect);
+
+   tree_t a = parse_and_check(T_ENTITY, T_ARCH);
+   fail_unless(sem_errors() == 0);
+
+   simplify_check(a, 0);
+
+   fail_unless(bounds_errors() == (sizeof(expect) / sizeof(error_t)) - 1);
+}
+END_TEST
+
 Suite *get_bounds_tests(void)
 {
    Suite *s = suite_create("bounds");
@@ -334,6 +354,7 @@ Suite *get_bounds_tests(void)
    tcase_add_test(tc_core, test_issue269);
    tcase_add_test(tc_core, test_issue307b);
    tcase_add_test(tc_core, test_issue356);
+   tcase_add_test(tc_core, test_fused);
    suite_add_tcase(s, tc_core);
 
    return s;
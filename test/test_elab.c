@@ -381,6 +381,42 @@ START_TEST(test_libbind3)
 }
 END_TEST
 
+START_TEST(test_libbind4)
+{
+   input_from_file(TESTDIR "/elab/libbind4.vhd");
+
+   lib_t work = lib_work();
+
+   lib_set_work(lib_tmp("foo"));
+   parse_check_and_simplify(T_ENTITY, T_ARCH, -1);
+   fail_if(sem_errors() > 0);
+
+   lib_set_work(lib_tmp("baz"));
+   parse_check_and_simplify(T_ENTITY, T_ARCH, -1);
+   fail_if(sem_errors() > 0);
+
+   lib_set_work(work);
+   tree_t top = run_elab();
+   fail_if(top == NULL);
+
+   // Library clauses are searched in the order they were elaborated so
+   // both components bind to BAZ.SUB even though MID1 names library FOO
+   // only. The entity cache must give the same result.
+   ident_t mid1_sub = ident_new(":libbind4:mid1_i:sub_i:in_baz");
+   ident_t mid2_sub = ident_new(":libbind4:mid2_i:sub_i:in_baz");
+   bool found1 = false, found2 = false;
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++) {
+      ident_t name = tree_ident(tree_decl(top, i));
+      found1 |= (name == mid1_sub);
+      found2 |= (name == mid2_sub);
+   }
+
+   fail_unless(found1);
+   fail_unless(found2);
+}
+END_TEST
+
 START_TEST(test_issue251)
 {
    input_from_file(TESTDIR "/elab/issue251.vhd");
@@ -629,6 +665,56 @@ START_TEST(test_issue374)
 }
 END_TEST
 
+static bool prune_has_signal(tree_t top, const char *name)
+{
+   ident_t id = ident_new(name);
+
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) == T_SIGNAL_DECL && tree_ident(d) == id)
+         return true;
+   }
+
+   return false;
+}
+
+START_TEST(test_prune)
+{
+   input_from_file(TESTDIR "/elab/prune.vhd");
+
+   const error_t expect[] = {
+      { -1, NULL }
+   };
+   expect_errors(expect);
+
+   tree_t top = run_elab();
+   fail_if(top == NULL);
+
+   prune_keep_glob(":prune:dbg");
+   prune_keep_file(TESTDIR "/elab/prune");
+   prune_design(top);
+   prune_reset_keep();
+
+   fail_if(prune_has_signal(top, ":prune:unused"));
+   fail_if(prune_has_signal(top, ":prune:u:count"));
+
+   fail_unless(prune_has_signal(top, ":prune:dbg"));
+   fail_unless(prune_has_signal(top, ":prune:inc"));
+   fail_unless(prune_has_signal(top, ":prune:chk"));
+   fail_unless(prune_has_signal(top, ":prune:p"));
+   fail_unless(prune_has_signal(top, ":work:prune_pkg:pkgsig"));
+
+   int nsignals = 0;
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++)
+      nsignals += (tree_kind(tree_decl(top, i)) == T_SIGNAL_DECL);
+
+   fail_unless(nsignals == 9);
+   fail_unless(tree_stmts(top) == 7);
+}
+END_TEST
+
 Suite *get_elab_tests(void)
 {
    Suite *s = suite_create("elab");
@@ -659,6 +745,7 @@ Suite *get_elab_tests(void)
    tcase_add_test(tc, test_libbind2);
    tcase_add_test(tc, test_toplevel2);
    tcase_add_test(tc, test_libbind3);
+   tcase_add_test(tc, test_libbind4);
    tcase_add_test(tc, test_issue251);
    tcase_add_test(tc, test_jcore1);
    tcase_add_test(tc, test_eval1);
@@ -675,6 +762,7 @@ Suite *get_elab_tests(void)
    tcase_add_test(tc, test_issue232);
    tcase_add_test(tc, test_issue373);
    tcase_add_test(tc, test_issue374);
+   tcase_add_test(tc, test_prune);
    suite_add_tcase(s, tc);
 
    return s;
@@ -0,0 +1,106 @@
+#include "test_util.h"
+#include "fbuf.h"
+
+#include <check.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NWORDS 100000
+
+static char *path;
+
+static void setup(void)
+{
+   const char *tmp = getenv("TEMP");
+   if (tmp == NULL)
+      tmp = "/tmp";
+
+   path = xasprintf("%s" PATH_SEP "test_fbuf.%d", tmp, getpid());
+}
+
+static void teardown(void)
+{
+   unlink(path);
+   free(path);
+   path = NULL;
+}
+
+static uint32_t word(unsigned i)
+{
+   // Compressible but not trivially so
+   return (i / 7) * 2654435761u % 1000;
+}
+
+static void round_trip(fbuf_codec_t codec)
+{
+   fbuf_set_codec(codec);
+
+   uint64_t *marks = xmalloc(sizeof(uint64_t) * (NWORDS / 1000));
+
+   fbuf_t *w = fbuf_open(path, FBUF_OUT);
+   fail_if(w == NULL);
+   for (unsigned i = 0; i < NWORDS; i++) {
+      if (i % 1000 == 0)
+         marks[i / 1000] = fbuf_tell(w);
+      write_u32(word(i), w);
+      if (i % 97 == 0)
+         write_u8(i & 0xff, w);
+   }
+   fbuf_set_footer(w, 42);
+   fbuf_close(w);
+
+   fbuf_t *r = fbuf_open(path, FBUF_IN);
+   fail_if(r == NULL);
+   fail_unless(fbuf_footer(r) == 42);
+
+   for (unsigned i = 0; i < NWORDS; i++) {
+      fail_unless(read_u32(r) == word(i));
+      if (i % 97 == 0)
+         fail_unless(read_u8(r) == (i & 0xff));
+   }
+
+   // Seek backwards and forwards between blocks
+   for (int n = 0; n < 50; n++) {
+      const unsigned m = (n * 37) % (NWORDS / 1000);
+      fbuf_seek(r, marks[m]);
+      fail_unless(fbuf_tell(r) == marks[m]);
+      fail_unless(read_u32(r) == word(m * 1000));
+   }
+
+   fbuf_close(r);
+   free(marks);
+
+   fbuf_set_codec(FBUF_CODEC_LZ4);
+}
+
+START_TEST(test_none)
+{
+   round_trip(FBUF_CODEC_NONE);
+}
+END_TEST
+
+START_TEST(test_fastlz)
+{
+   round_trip(FBUF_CODEC_FASTLZ);
+}
+END_TEST
+
+START_TEST(test_lz4)
+{
+   round_trip(FBUF_CODEC_LZ4);
+}
+END_TEST
+
+Suite *get_fbuf_tests(void)
+{
+   Suite *s = suite_create("fbuf");
+
+   TCase *tc_core = nvc_unit_test();
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, test_none);
+   tcase_add_test(tc_core, test_fastlz);
+   tcase_add_test(tc_core, test_lz4);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
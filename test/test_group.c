@@ -1,5 +1,6 @@
 #include "util.h"
 #include "test_util.h"
+#include "rt/netdb.h"
 
 #include <check.h>
 #include <stdlib.h>
@@ -165,6 +166,88 @@ START_TEST(test_group_six)
 }
 END_TEST
 
+static int group_tree_check(group_t *t, netid_t lo, netid_t hi)
+{
+   // Check the treap is ordered by first net and heap ordered by
+   // priority and return the number of nodes
+   if (t == NULL)
+      return 0;
+
+   fail_unless(t->first >= lo && t->first < hi);
+   fail_if(t->left != NULL && t->left->priority > t->priority);
+   fail_if(t->right != NULL && t->right->priority > t->priority);
+   fail_if(t->gid == GROUPID_INVALID);
+
+   return 1 + group_tree_check(t->left, lo, t->first)
+      + group_tree_check(t->right, t->first + 1, hi);
+}
+
+static void group_list_check(group_nets_ctx_t *ctx)
+{
+   int ngroups = 0;
+   group_t *prev = NULL;
+   for (group_t *it = ctx->groups; it != NULL; prev = it, it = it->next) {
+      fail_unless(it->prev == prev);
+      ngroups++;
+   }
+
+   fail_unless(group_tree_check(ctx->tree, 0, ctx->nnets) == ngroups);
+}
+
+START_TEST(test_group_random)
+{
+   group_nets_ctx_t ctx;
+   group_test_init(&ctx, NULL);
+
+   // Start from one group covering every net as elaboration does and
+   // split it with random ranges from a fixed seed
+   group_add(&ctx, 0, DEFAULT_NNETS);
+
+   uint32_t seed = 42;
+   for (int i = 0; i < 2000; i++) {
+      seed = seed * 1103515245 + 12345;
+      const netid_t first = (seed >> 8) % DEFAULT_NNETS;
+      seed = seed * 1103515245 + 12345;
+      const int length = 1 + (seed >> 8) % MIN(16, DEFAULT_NNETS - first);
+
+      group_add(&ctx, first, length);
+
+      if (i % 100 == 0) {
+         group_list_check(&ctx);
+         fail_unless(group_sanity_check(&ctx, DEFAULT_NNETS - 1));
+      }
+   }
+
+   group_list_check(&ctx);
+   fail_unless(group_sanity_check(&ctx, DEFAULT_NNETS - 1));
+
+   group_free_list(ctx.groups);
+   group_free_list(ctx.free_list);
+}
+END_TEST
+
+START_TEST(test_group_sparse)
+{
+   // Memory should not depend on the number of nets
+   group_nets_ctx_t ctx;
+   group_init_context(&ctx, 1 << 30);
+
+   fail_unless(group_add(&ctx, 0, 1 << 30) == 0);
+   fail_unless(group_add(&ctx, 1000, 5) != GROUPID_INVALID);
+   fail_unless(group_add(&ctx, (1 << 30) - 1, 1) != GROUPID_INVALID);
+
+   const group_expect_t expect[] = {
+      { 0, 999 }, { 1000, 1004 }, { 1005, (1 << 30) - 2 },
+      { (1 << 30) - 1, (1 << 30) - 1 }
+   };
+   group_expect(&ctx, expect, ARRAY_LEN(expect));
+   group_list_check(&ctx);
+
+   group_free_list(ctx.groups);
+   group_free_list(ctx.free_list);
+}
+END_TEST
+
 START_TEST(test_issue72)
 {
    input_from_file(TESTDIR "/group/issue72.vhd");
@@ -482,6 +565,60 @@ START_TEST(test_issue371)
 }
 END_TEST
 
+static netid_t netdb_walk_next;
+static unsigned netdb_walk_count;
+
+static void netdb_walk_check(groupid_t gid, netid_t first, unsigned length)
+{
+   fail_unless(first == netdb_walk_next, "gap before net %d", first);
+   netdb_walk_next = first + length;
+   netdb_walk_count++;
+}
+
+START_TEST(test_netdb1)
+{
+   input_from_file(TESTDIR "/group/netdb1.vhd");
+
+   tree_t top = run_elab();
+   fail_if(top == NULL);
+
+   group_nets(top);
+
+   group_nets_ctx_t ctx;
+   group_test_init(&ctx, NULL);
+   tree_visit(top, group_nets_visit_fn, &ctx);
+
+   const int nnets = tree_attr_int(top, ident_new("nnets"), 0);
+   fail_unless(nnets == 191);
+   fail_unless(group_sanity_check(&ctx, nnets - 1));
+
+   netdb_t *db = netdb_open(top);
+   fail_unless(netdb_nets(db) == nnets);
+   fail_unless(netdb_size(db) == ctx.next_gid);
+
+   // Every net in a group must map to the same ID as the group
+   // computed in memory including those in groups spanning a page
+   // boundary and in pages containing many groups
+   int ngroups = 0;
+   for (group_t *it = ctx.groups; it != NULL; it = it->next, ngroups++) {
+      for (netid_t nid = it->first; nid < it->first + it->length; nid++)
+         fail_unless(netdb_lookup(db, nid) == it->gid,
+                     "net %d maps to group %d not %d", nid,
+                     netdb_lookup(db, nid), it->gid);
+   }
+
+   fail_unless(ngroups == 85);
+
+   netdb_walk_next  = 0;
+   netdb_walk_count = 0;
+   netdb_walk(db, netdb_walk_check);
+   fail_unless(netdb_walk_next == nnets);
+   fail_unless(netdb_walk_count == ngroups);
+
+   netdb_close(db);
+}
+END_TEST
+
 Suite *get_group_tests(void)
 {
    Suite *s = suite_create("group");
@@ -493,6 +630,8 @@ Suite *get_group_tests(void)
    tcase_add_test(tc_core, test_group_four);
    tcase_add_test(tc_core, test_group_five);
    tcase_add_test(tc_core, test_group_six);
+   tcase_add_test(tc_core, test_group_random);
+   tcase_add_test(tc_core, test_group_sparse);
    tcase_add_test(tc_core, test_issue72);
    tcase_add_test(tc_core, test_issue73);
    tcase_add_test(tc_core, test_slice1);
@@ -507,6 +646,7 @@ Suite *get_group_tests(void)
    tcase_add_test(tc_core, test_jcore2);
    tcase_add_test(tc_core, test_jcore4);
    tcase_add_test(tc_core, test_issue371);
+   tcase_add_test(tc_core, test_netdb1);
    suite_add_tcase(s, tc_core);
 
    return s;
@@ -6,7 +6,7 @@
 #include <string.h>
 #include <time.h>
 
-#define VOIDP(x) ((void *)(uintptr_t)x)
+#define VOIDP(x) ((void *)(uintptr_t)(x))
 
 START_TEST(test_basic)
 {
@@ -69,6 +69,109 @@ START_TEST(test_replace)
 }
 END_TEST;
 
+START_TEST(test_delete)
+{
+   hash_t *h = hash_new(8, true);
+
+   static const int N = 1000;
+
+   for (int i = 1; i <= N; i++)
+      hash_put(h, VOIDP(i * 8), VOIDP(i));
+
+   for (int i = 1; i <= N; i += 2)
+      fail_unless(hash_delete(h, VOIDP(i * 8)));
+
+   fail_if(hash_delete(h, VOIDP(8)));
+   fail_unless(hash_members(h) == N / 2);
+
+   for (int i = 1; i <= N; i++) {
+      if (i % 2 == 0)
+         fail_unless(hash_get(h, VOIDP(i * 8)) == VOIDP(i));
+      else
+         fail_unless(hash_get(h, VOIDP(i * 8)) == NULL);
+   }
+
+   hash_shrink(h);
+
+   for (int i = 2; i <= N; i += 2)
+      fail_unless(hash_get(h, VOIDP(i * 8)) == VOIDP(i));
+
+   hash_free(h);
+}
+END_TEST;
+
+START_TEST(test_duplicates)
+{
+   // Values for the same key are returned in insertion order even
+   // after the table has grown
+   hash_t *h = hash_new(8, false);
+
+   for (int i = 0; i < 100; i++) {
+      hash_put(h, VOIDP(16), VOIDP(i + 1));
+      hash_put(h, VOIDP((i + 1) * 64), VOIDP(i + 1));
+   }
+
+   for (int i = 0; i < 100; i++) {
+      int n = i;
+      fail_unless(hash_get_nth(h, VOIDP(16), &n) == VOIDP(i + 1));
+   }
+
+   int n = 100;
+   fail_unless(hash_get_nth(h, VOIDP(16), &n) == NULL);
+   fail_unless(n == 0);
+
+   hash_free(h);
+}
+END_TEST;
+
+START_TEST(test_strings)
+{
+   shash_t *h = shash_new(4);
+
+   char buf[32];
+   for (int i = 0; i < 500; i++) {
+      checked_sprintf(buf, sizeof(buf), "key%d", i);
+      shash_put(h, buf, VOIDP(i + 1));
+   }
+
+   fail_unless(shash_members(h) == 500);
+   fail_unless(shash_get(h, "key0") == VOIDP(1));
+   fail_unless(shash_get(h, "key499") == VOIDP(500));
+   fail_unless(shash_get(h, "key500") == NULL);
+
+   shash_put(h, "key7", VOIDP(1234));
+   fail_unless(shash_get(h, "key7") == VOIDP(1234));
+   fail_unless(shash_members(h) == 500);
+
+   fail_unless(shash_delete(h, "key7"));
+   fail_if(shash_delete(h, "key7"));
+   fail_unless(shash_get(h, "key7") == NULL);
+   fail_unless(shash_get(h, "key8") == VOIDP(9));
+
+   shash_free(h);
+}
+END_TEST;
+
+START_TEST(test_integers)
+{
+   ihash_t *h = ihash_new(16);
+   ihash_reserve(h, 1000);
+
+   for (uint64_t i = 0; i < 1000; i++)
+      ihash_put(h, i << 40, VOIDP(i + 1));
+
+   fail_unless(ihash_members(h) == 1000);
+   fail_unless(ihash_get(h, 0) == VOIDP(1));
+   fail_unless(ihash_get(h, UINT64_C(999) << 40) == VOIDP(1000));
+   fail_unless(ihash_get(h, 1) == NULL);
+
+   fail_unless(ihash_delete(h, 0));
+   fail_unless(ihash_get(h, 0) == NULL);
+
+   ihash_free(h);
+}
+END_TEST;
+
 Suite *get_hash_tests(void)
 {
    Suite *s = suite_create("hash");
@@ -77,6 +180,10 @@ Suite *get_hash_tests(void)
    tcase_add_test(tc_core, test_basic);
    tcase_add_test(tc_core, test_rand);
    tcase_add_test(tc_core, test_replace);
+   tcase_add_test(tc_core, test_delete);
+   tcase_add_test(tc_core, test_duplicates);
+   tcase_add_test(tc_core, test_strings);
+   tcase_add_test(tc_core, test_integers);
    suite_add_tcase(s, tc_core);
 
    return s;
@@ -72,7 +72,7 @@ START_TEST(test_read_write)
    fbuf_t *f = fbuf_open("test.ident", FBUF_OUT);
    fail_if(f == NULL);
 
-   ident_wr_ctx_t wctx = ident_write_begin(f);
+   ident_wr_ctx_t wctx = ident_write_begin(f, NULL);
 
    ident_write(i1, wctx);
    ident_write(i2, wctx);
@@ -85,7 +85,7 @@ START_TEST(test_read_write)
    f = fbuf_open("test.ident", FBUF_IN);
    fail_if(f == NULL);
 
-   ident_rd_ctx_t rctx = ident_read_begin(f);
+   ident_rd_ctx_t rctx = ident_read_begin(f, NULL);
 
    ident_t j1, j2, j3;
    j1 = ident_read(rctx);
@@ -106,6 +106,65 @@ START_TEST(test_read_write)
 }
 END_TEST
 
+START_TEST(test_table)
+{
+   ident_t i1 = ident_new("WORK.FOO");
+   ident_t i2 = ident_new("IEEE.STD_LOGIC_1164");
+   ident_t i3 = ident_new("bar");
+
+   remove("test.idents");
+
+   ident_table_t *wtab = ident_table_new("test.idents");
+
+   fbuf_t *f = fbuf_open("test.ident1", FBUF_OUT);
+   fail_if(f == NULL);
+
+   ident_wr_ctx_t wctx = ident_write_begin(f, wtab);
+   ident_write(i1, wctx);
+   ident_write(i2, wctx);
+   ident_write(i1, wctx);
+   ident_write_end(wctx);
+   fbuf_close(f);
+
+   f = fbuf_open("test.ident2", FBUF_OUT);
+   fail_if(f == NULL);
+
+   wctx = ident_write_begin(f, wtab);
+   ident_write(i2, wctx);
+   ident_write(i3, wctx);
+   ident_write(NULL, wctx);
+   ident_write_end(wctx);
+   fbuf_close(f);
+
+   // A separate table object reads the records back from the file
+   ident_table_t *rtab = ident_table_new("test.idents");
+
+   f = fbuf_open("test.ident2", FBUF_IN);
+   fail_if(f == NULL);
+
+   ident_rd_ctx_t rctx = ident_read_begin(f, rtab);
+   fail_unless(ident_read(rctx) == i2);
+   fail_unless(ident_read(rctx) == i3);
+   fail_unless(ident_read(rctx) == NULL);
+   ident_read_end(rctx);
+   fbuf_close(f);
+
+   f = fbuf_open("test.ident1", FBUF_IN);
+   fail_if(f == NULL);
+
+   rctx = ident_read_begin(f, rtab);
+   fail_unless(ident_read(rctx) == i1);
+   fail_unless(ident_read(rctx) == i2);
+   fail_unless(ident_read(rctx) == i1);
+   ident_read_end(rctx);
+   fbuf_close(f);
+
+   remove("test.ident1");
+   remove("test.ident2");
+   remove("test.idents");
+}
+END_TEST
+
 START_TEST(test_prefix)
 {
    ident_t a, b, c, d, e, f;
@@ -284,6 +343,15 @@ START_TEST(test_suffix_until)
 }
 END_TEST
 
+START_TEST(test_new_n)
+{
+   const char *str = "hello.world";
+   fail_unless(ident_new_n(str, 5) == ident_new("hello"));
+   fail_unless(ident_new_n(str, strlen(str)) == ident_new(str));
+   fail_unless(ident_new_n(str + 6, 5) == ident_new("world"));
+}
+END_TEST
+
 Suite *get_ident_tests(void)
 {
    Suite *s = suite_create("ident");
@@ -294,6 +362,7 @@ Suite *get_ident_tests(void)
    tcase_add_test(tc_core, test_istr);
    tcase_add_test(tc_core, test_rand);
    tcase_add_test(tc_core, test_read_write);
+   tcase_add_test(tc_core, test_table);
    tcase_add_test(tc_core, test_prefix);
    tcase_add_test(tc_core, test_strip);
    tcase_add_test(tc_core, test_char);
@@ -308,6 +377,7 @@ Suite *get_ident_tests(void)
    tcase_add_test(tc_core, test_len);
    tcase_add_test(tc_core, test_downcase);
    tcase_add_test(tc_core, test_suffix_until);
+   tcase_add_test(tc_core, test_new_n);
    suite_add_tcase(s, tc_core);
 
    return s;
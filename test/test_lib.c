@@ -7,6 +7,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
+#ifndef __MINGW32__
+#include <sys/wait.h>
+#endif
 
 static lib_t work;
 static const char *tmp;
@@ -268,6 +273,234 @@ START_TEST(test_lib_save)
 }
 END_TEST
 
+START_TEST(test_lazy_decls)
+{
+   {
+      tree_t pack = tree_new(T_PACKAGE);
+      tree_set_ident(pack, ident_new("pack"));
+
+      type_t prev = type_universal_int();
+      for (int i = 0; i < 3; i++) {
+         char name[16];
+         checked_sprintf(name, sizeof(name), "t%d", i);
+
+         type_t sub = type_new(T_SUBTYPE);
+         type_set_ident(sub, ident_new(name));
+         type_set_base(sub, prev);
+
+         tree_t d = tree_new(T_TYPE_DECL);
+         tree_set_ident(d, ident_new(name));
+         tree_set_type(d, sub);
+         tree_add_decl(pack, d);
+
+         prev = sub;
+      }
+
+      lib_put(work, pack);
+   }
+
+   lib_save(work);
+   lib_free(work);
+
+   lib_add_search_path(tmp);
+   work = lib_find(ident_new("test_lib"), false);
+   fail_if(work == NULL);
+
+   tree_t pack = lib_get(work, ident_new("pack"));
+   fail_if(pack == NULL);
+   fail_unless(tree_decls(pack) == 3);
+
+   // Reading the last declaration first must resolve references into
+   // the earlier declarations which have not been read yet
+   tree_t t2 = tree_decl(pack, 2);
+   fail_unless(tree_ident(t2) == ident_new("t2"));
+
+   tree_t t1 = tree_decl(pack, 1);
+   fail_unless(tree_ident(t1) == ident_new("t1"));
+   fail_unless(type_base(tree_type(t2)) == tree_type(t1));
+
+   tree_t t0 = tree_decl(pack, 0);
+   fail_unless(tree_ident(t0) == ident_new("t0"));
+   fail_unless(type_base(tree_type(t1)) == tree_type(t0));
+   fail_unless(type_kind(type_base(tree_type(t0))) == T_INTEGER);
+}
+END_TEST
+
+START_TEST(test_index_append)
+{
+   tree_t ent = tree_new(T_ENTITY);
+   tree_set_ident(ent, ident_new("first"));
+   lib_put(work, ent);
+
+   lib_save(work);
+   lib_free(work);
+
+   lib_add_search_path(tmp);
+   work = lib_find(ident_new("test_lib"), false);
+   fail_if(work == NULL);
+   fail_unless(lib_index_size(work) == 1);
+
+   tree_t pack = tree_new(T_PACKAGE);
+   tree_set_ident(pack, ident_new("second"));
+   lib_put(work, pack);
+
+   // Only the new entry is appended to the index
+   lib_save(work);
+   lib_free(work);
+
+   work = lib_find(ident_new("test_lib"), false);
+   fail_if(work == NULL);
+   fail_unless(lib_index_size(work) == 2);
+   fail_unless(lib_index_kind(work, ident_new("first")) == T_ENTITY);
+   fail_unless(lib_index_kind(work, ident_new("second")) == T_PACKAGE);
+   fail_unless(lib_index_kind(work, ident_new("third")) == T_LAST_TREE_KIND);
+
+   // Analysis times are recorded in the index
+   fail_unless(lib_mtime(work, ident_new("second"))
+               > lib_mtime(work, ident_new("first")));
+
+   fail_if(lib_get(work, ident_new("first")) == NULL);
+   fail_if(lib_get(work, ident_new("second")) == NULL);
+}
+END_TEST
+
+#ifndef __MINGW32__
+START_TEST(test_refresh)
+{
+   tree_t ent = tree_new(T_ENTITY);
+   tree_set_ident(ent, ident_new("first"));
+   lib_put(work, ent);
+
+   lib_save(work);
+
+   // Another process reanalyses one unit and adds a new one
+   pid_t pid = fork();
+   if (pid == 0) {
+      lib_reopen_lock(work);
+
+      tree_t pack = tree_new(T_PACKAGE);
+      tree_set_ident(pack, ident_new("first"));
+      lib_put(work, pack);
+
+      tree_t second = tree_new(T_PACKAGE);
+      tree_set_ident(second, ident_new("second"));
+      lib_put(work, second);
+
+      lib_save(work);
+      _exit(0);
+   }
+
+   int status;
+   fail_unless(waitpid(pid, &status, 0) == pid);
+   fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+   fail_unless(lib_get(work, ident_new("first")) == ent);
+
+   lib_refresh(work);
+
+   tree_t first = lib_get(work, ident_new("first"));
+   fail_if(first == NULL);
+   fail_unless(tree_kind(first) == T_PACKAGE);
+   fail_unless(lib_index_kind(work, ident_new("second")) == T_PACKAGE);
+   fail_if(lib_get(work, ident_new("second")) == NULL);
+
+   // Nothing changed since the last refresh
+   lib_refresh(work);
+   fail_unless(lib_get(work, ident_new("first")) == first);
+}
+END_TEST
+#endif  // __MINGW32__
+
+START_TEST(test_arena)
+{
+   tree_t outside = tree_new(T_SIGNAL_DECL);
+   tree_set_ident(outside, ident_new("outside"));
+
+   tree_arena_t *arena = tree_arena_new();
+   tree_arena_push(arena);
+
+   tree_t ent = tree_new(T_ENTITY);
+   tree_set_ident(ent, ident_new("ent"));
+
+   for (int i = 0; i < 1000; i++) {
+      tree_t r = tree_new(T_REF);
+      tree_set_ident(r, ident_new("outside"));
+      tree_set_ref(r, outside);
+      tree_add_attr_tree(ent, ident_new("ref"), r);
+   }
+
+   tree_arena_pop();
+
+   // The declaration is only reachable from the arena
+   tree_gc();
+   fail_unless(tree_ident(outside) == ident_new("outside"));
+
+   tree_t r = tree_attr_tree(ent, ident_new("ref"));
+   fail_unless(tree_ref(r) == outside);
+
+   tree_arena_free(arena);
+   tree_gc();
+}
+END_TEST
+
+START_TEST(test_packed_arrays)
+{
+   {
+      tree_t pack = tree_new(T_PACKAGE);
+      tree_set_ident(pack, ident_new("pack"));
+
+      for (int i = 0; i < 3; i++) {
+         char name[16];
+         checked_sprintf(name, sizeof(name), "s%d", i);
+
+         tree_t d = tree_new(T_SIGNAL_DECL);
+         tree_set_ident(d, ident_new(name));
+         tree_set_type(d, type_universal_int());
+         tree_add_decl(pack, d);
+      }
+
+      lib_put(work, pack);
+   }
+
+   lib_save(work);
+   lib_free(work);
+
+   lib_add_search_path(tmp);
+   work = lib_find(ident_new("test_lib"), false);
+   fail_if(work == NULL);
+
+   tree_arena_t *arena = tree_arena_new();
+   tree_arena_push(arena);
+
+   // Arrays read inside an arena are packed next to their objects
+   tree_t pack = lib_get(work, ident_new("pack"));
+   fail_if(pack == NULL);
+   fail_unless(tree_decls(pack) == 3);
+
+   tree_arena_pop();
+
+   // Growing a packed array must copy it out of the arena
+   for (int i = 3; i < 20; i++) {
+      char name[16];
+      checked_sprintf(name, sizeof(name), "s%d", i);
+
+      tree_t d = tree_new(T_SIGNAL_DECL);
+      tree_set_ident(d, ident_new(name));
+      tree_add_decl(pack, d);
+   }
+
+   fail_unless(tree_decls(pack) == 20);
+   for (int i = 0; i < 20; i++) {
+      char name[16];
+      checked_sprintf(name, sizeof(name), "s%d", i);
+      fail_unless(tree_ident(tree_decl(pack, i)) == ident_new(name));
+   }
+
+   tree_gc();
+   fail_unless(tree_ident(tree_decl(pack, 19)) == ident_new("s19"));
+}
+END_TEST
+
 Suite *get_lib_tests(void)
 {
    Suite *s = suite_create("lib");
@@ -277,6 +510,13 @@ Suite *get_lib_tests(void)
    tcase_add_test(tc_core, test_lib_new);
    tcase_add_test(tc_core, test_lib_fopen);
    tcase_add_test(tc_core, test_lib_save);
+   tcase_add_test(tc_core, test_lazy_decls);
+   tcase_add_test(tc_core, test_index_append);
+#ifndef __MINGW32__
+   tcase_add_test(tc_core, test_refresh);
+#endif
+   tcase_add_test(tc_core, test_arena);
+   tcase_add_test(tc_core, test_packed_arrays);
    suite_add_tcase(s, tc_core);
 
    return s;
@@ -3115,6 +3115,164 @@ START_TEST(test_sum)
 }
 END_TEST
 
+START_TEST(test_constdata)
+{
+   input_from_file(TESTDIR "/lower/constdata.vhd");
+
+   tree_t e = run_elab();
+   lower_unit(e);
+
+   vcode_unit_t v0 = find_unit(tree_stmt(e, 0));
+   vcode_select_unit(v0);
+   vcode_select_block(0);
+
+   // Large tables are folded to raw data and small ones keep a
+   // register for each element
+   int ndata = 0, nargs = 0;
+   const int nops = vcode_count_ops();
+   for (int i = 0; i < nops; i++) {
+      if (vcode_get_op(i) != VCODE_OP_CONST_ARRAY)
+         continue;
+
+      int count;
+      const int64_t *data = vcode_get_data(i, &count);
+      if (data == NULL) {
+         fail_unless(vcode_count_args(i) == 4);
+         nargs++;
+      }
+      else if (count == 100) {
+         fail_unless(data[0] == -5);
+         fail_unless(data[1] == 1000);
+         fail_unless(data[2] == 3);
+         fail_unless(data[50] == 7);
+         fail_unless(data[59] == 7);
+         fail_unless(data[60] == 3);
+         fail_unless(data[99] == 2147483647);
+         ndata++;
+      }
+      else {
+         fail_unless(count == 72);
+         fail_unless(data[0] == '0');
+         fail_unless(data[10] == 'a');
+         fail_unless(data[71] == 'Z');
+         ndata++;
+      }
+   }
+
+   fail_unless(ndata == 2);
+   fail_unless(nargs == 1);
+}
+END_TEST
+
+START_TEST(test_checkelide)
+{
+   input_from_file(TESTDIR "/lower/checkelide.vhd");
+
+   tree_t e = run_elab();
+   lower_unit(e);
+
+   {
+      vcode_unit_t v0 = vcode_find_unit(ident_new(":checkelide:scalar(IB)I"));
+      fail_if(v0 == NULL);
+      vcode_select_unit(v0);
+
+      // The second check against 1 to 10 is removed but the narrower
+      // check and the check in another block remain
+      EXPECT_BB(0) = {
+         { VCODE_OP_BOUNDS, .low = 1, .high = 10 },
+         { VCODE_OP_STORE, .name = "A1" },
+         { VCODE_OP_STORE, .name = "A2" },
+         { VCODE_OP_BOUNDS, .low = 2, .high = 5 },
+         { VCODE_OP_STORE, .name = "N" },
+         { VCODE_OP_COND, .target = 1, .target_else = 2 }
+      };
+
+      CHECK_BB(0);
+
+      EXPECT_BB(1) = {
+         { VCODE_OP_BOUNDS, .low = 1, .high = 10 },
+         { VCODE_OP_STORE, .name = "A2" },
+         { VCODE_OP_JUMP, .target = 2 }
+      };
+
+      CHECK_BB(1);
+   }
+
+   {
+      vcode_unit_t v0 = vcode_find_unit(ident_new(":checkelide:dynamic(III)I"));
+      fail_if(v0 == NULL);
+      vcode_select_unit(v0);
+
+      // The check against l to r is only done once but the check against
+      // l downto r has the limits in the opposite order
+      EXPECT_BB(0) = {
+         { VCODE_OP_CONST, .value = 3 },
+         { VCODE_OP_CONST, .value = 4 },
+         { VCODE_OP_DYNAMIC_BOUNDS },
+         { VCODE_OP_STORE, .name = "U1" },
+         { VCODE_OP_STORE, .name = "U2" },
+         { VCODE_OP_DYNAMIC_BOUNDS },
+         { VCODE_OP_STORE, .name = "D" },
+         { VCODE_OP_ADD },
+         { VCODE_OP_ADD },
+         { VCODE_OP_BOUNDS, .low = INT32_MIN, .high = INT32_MAX },
+         { VCODE_OP_RETURN }
+      };
+
+      CHECK_BB(0);
+   }
+}
+END_TEST
+
+START_TEST(test_deadstore)
+{
+   input_from_file(TESTDIR "/lower/deadstore.vhd");
+
+   tree_t e = run_elab();
+   vcode_unit_t v0 = lower_unit(e);
+
+   vcode_unit_t v1 = vcode_find_unit(ident_new(":deadstore:func(I)I"));
+   fail_if(v1 == NULL);
+   vcode_select_unit(v1);
+
+   {
+      EXPECT_BB(0) = {
+         { VCODE_OP_CONST, .value = 2 },
+         { VCODE_OP_MUL },
+         { VCODE_OP_BOUNDS, .low = INT32_MIN, .high = INT32_MAX },
+         { VCODE_OP_STORE, .name = "UNUSED" },
+         { VCODE_OP_STORE, .name = "KEPT" },
+         { VCODE_OP_STORE, .name = "RESULT" },
+         { VCODE_OP_NESTED_FCALL, .func = ":deadstore:func(I)I__BUMP" },
+         { VCODE_OP_LOAD, .name = "RESULT" },
+         { VCODE_OP_RETURN }
+      };
+
+      CHECK_BB(0);
+   }
+
+   vcode_optimise(v0);
+   vcode_select_unit(v1);
+
+   {
+      // The store to UNUSED is removed but KEPT is read by the nested
+      // procedure and the overflow check on the product remains
+      EXPECT_BB(0) = {
+         { VCODE_OP_CONST, .value = 2 },
+         { VCODE_OP_MUL },
+         { VCODE_OP_BOUNDS, .low = INT32_MIN, .high = INT32_MAX },
+         { VCODE_OP_STORE, .name = "KEPT" },
+         { VCODE_OP_STORE, .name = "RESULT" },
+         { VCODE_OP_NESTED_FCALL, .func = ":deadstore:func(I)I__BUMP" },
+         { VCODE_OP_LOAD, .name = "RESULT" },
+         { VCODE_OP_RETURN }
+      };
+
+      CHECK_BB(0);
+   }
+}
+END_TEST
+
 Suite *get_lower_tests(void)
 {
    Suite *s = suite_create("lower");
@@ -3189,6 +3347,9 @@ Suite *get_lower_tests(void)
    tcase_add_test(tc, test_signal11);
    tcase_add_test(tc, test_access1);
    tcase_add_test(tc, test_sum);
+   tcase_add_test(tc, test_constdata);
+   tcase_add_test(tc, test_checkelide);
+   tcase_add_test(tc, test_deadstore);
    suite_add_tcase(s, tc);
 
    return s;
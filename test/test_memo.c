@@ -0,0 +1,86 @@
+#include "util.h"
+#include "rt/memo.h"
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int8_t tab1[16];
+static int8_t tab2[16][16];
+
+static void setup(void)
+{
+   for (int i = 0; i < 16; i++) {
+      tab1[i] = rand() % 16;
+      for (int j = 0; j < 16; j++)
+         tab2[i][j] = rand() % 16;
+   }
+}
+
+START_TEST(test_resolve1)
+{
+   // Lengths either side of each vector width to cover the tail loops
+   static const size_t lengths[] = { 0, 1, 15, 16, 17, 31, 32, 33, 100 };
+
+   for (int i = 0; i < ARRAY_LEN(lengths); i++) {
+      const size_t n = lengths[i];
+
+      int8_t in[n + 1], out[n + 1];
+      for (size_t j = 0; j < n; j++)
+         in[j] = rand() % 16;
+
+      out[n] = 42;
+      memo_resolve1(tab1, in, out, n);
+
+      for (size_t j = 0; j < n; j++)
+         ck_assert_int_eq(out[j], tab1[(int)in[j]]);
+      ck_assert_int_eq(out[n], 42);
+   }
+}
+END_TEST
+
+START_TEST(test_resolve2)
+{
+   static const size_t lengths[] = { 0, 1, 15, 16, 17, 31, 32, 33, 100 };
+
+   for (int i = 0; i < ARRAY_LEN(lengths); i++) {
+      const size_t n = lengths[i];
+
+      for (int nlits = 2; nlits <= 16; nlits += 7) {
+         int8_t a[n + 1], b[n + 1], out[n + 1];
+         for (size_t j = 0; j < n; j++) {
+            a[j] = rand() % nlits;
+            b[j] = rand() % nlits;
+         }
+
+         out[n] = 42;
+         memo_resolve2(tab2, nlits, a, b, out, n);
+
+         for (size_t j = 0; j < n; j++)
+            ck_assert_int_eq(out[j], tab2[(int)a[j]][(int)b[j]]);
+         ck_assert_int_eq(out[n], 42);
+
+         // Output may alias the first input
+         int8_t expect[n + 1];
+         for (size_t j = 0; j < n; j++)
+            expect[j] = tab2[(int)a[j]][(int)b[j]];
+
+         memo_resolve2(tab2, nlits, a, b, a, n);
+         ck_assert(memcmp(a, expect, n) == 0);
+      }
+   }
+}
+END_TEST
+
+Suite *get_memo_tests(void)
+{
+   Suite *s = suite_create("memo");
+
+   TCase *tc_core = tcase_create("Core");
+   tcase_add_checked_fixture(tc_core, setup, NULL);
+   tcase_add_test(tc_core, test_resolve1);
+   tcase_add_test(tc_core, test_resolve2);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
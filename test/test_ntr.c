@@ -0,0 +1,157 @@
+#include "test_util.h"
+#include "rt/ntr.h"
+#include "fstapi.h"
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char *path;
+
+static void setup(void)
+{
+   const char *tmp = getenv("TEMP");
+   if (tmp == NULL)
+      tmp = "/tmp";
+
+   path = xasprintf("%s" PATH_SEP "test_ntr.%d", tmp, getpid());
+}
+
+static void teardown(void)
+{
+   unlink(path);
+   free(path);
+   path = NULL;
+}
+
+static void write_trace(void)
+{
+   ntr_writer_t *w = ntr_writer_new(path);
+
+   const int clk = ntr_writer_add(w, ":top:clk", NTR_CHARS, 1, 1, "01", 2);
+   const int state = ntr_writer_add(w, ":top:state", NTR_ENUM, 1, 1,
+                                    "IDLE\0RUN", 9);
+   const int count = ntr_writer_add(w, ":top:sub:count", NTR_INT, 1, 8,
+                                    NULL, 0);
+   const int vec = ntr_writer_add(w, ":top:sub:vec", NTR_CHARS, 4, 1,
+                                  "01", 2);
+
+   uint64_t values[4] = { 0 };
+   ntr_writer_emit(w, state, 0, values);
+   ntr_writer_emit(w, vec, 0, values);
+
+   // Enough changes to span several chunks
+   for (uint64_t t = 0; t < 5000; t++) {
+      values[0] = t & 1;
+      ntr_writer_emit(w, clk, t * 10, values);
+
+      if (t % 2 == 1) {
+         values[0] = t / 2;
+         ntr_writer_emit(w, count, t * 10 + 1, values);
+      }
+   }
+
+   values[0] = 1;
+   ntr_writer_emit(w, state, 100, values);
+
+   const uint64_t ones[4] = { 1, 0, 1, 1 };
+   ntr_writer_emit(w, vec, 200, ones);
+
+   ntr_writer_close(w, 50000);
+}
+
+START_TEST(test_value_at)
+{
+   write_trace();
+
+   ntr_file_t *f = ntr_open(path);
+   fail_if(f == NULL);
+
+   fail_unless(ntr_signals(f) == 4);
+   fail_unless(ntr_end_time(f) == 50000);
+   fail_unless(ntr_find(f, ":top:nothere") == -1);
+
+   const int clk = ntr_find(f, ":top:clk");
+   fail_unless(clk == 0);
+   fail_unless(ntr_kind(f, clk) == NTR_CHARS);
+   fail_unless(ntr_width(f, clk) == 1);
+   fail_unless(ntr_changes(f, clk) == 5000);
+
+   size_t maplen;
+   const char *map = ntr_map(f, clk, &maplen);
+   fail_unless(maplen == 2);
+   fail_unless(memcmp(map, "01", 2) == 0);
+
+   uint64_t values[4];
+   fail_unless(ntr_value_at(f, clk, 0, values));
+   fail_unless(values[0] == 0);
+   fail_unless(ntr_value_at(f, clk, 15, values));
+   fail_unless(values[0] == 1);
+   fail_unless(ntr_value_at(f, clk, 49980, values));
+   fail_unless(values[0] == 0);
+   fail_unless(ntr_value_at(f, clk, 99999, values));
+   fail_unless(values[0] == 1);
+
+   const int count = ntr_find(f, ":top:sub:count");
+   fail_unless(ntr_kind(f, count) == NTR_INT);
+   fail_unless(ntr_changes(f, count) == 2500);
+   fail_if(ntr_value_at(f, count, 10, values));
+   fail_unless(ntr_value_at(f, count, 11, values));
+   fail_unless(values[0] == 0);
+   fail_unless(ntr_value_at(f, count, 30010, values));
+   fail_unless(values[0] == 1499);
+   fail_unless(ntr_value_at(f, count, 30011, values));
+   fail_unless(values[0] == 1500);
+
+   const int state = ntr_find(f, ":top:state");
+   fail_unless(ntr_value_at(f, state, 99, values));
+   fail_unless(values[0] == 0);
+   fail_unless(ntr_value_at(f, state, 100, values));
+   fail_unless(values[0] == 1);
+
+   const int vec = ntr_find(f, ":top:sub:vec");
+   fail_unless(ntr_width(f, vec) == 4);
+   fail_unless(ntr_value_at(f, vec, 500, values));
+   fail_unless(values[0] == 1);
+   fail_unless(values[1] == 0);
+   fail_unless(values[2] == 1);
+   fail_unless(values[3] == 1);
+
+   ntr_close(f);
+}
+END_TEST
+
+START_TEST(test_export)
+{
+   write_trace();
+
+   char *fst LOCAL = xasprintf("%s.fst", path);
+
+   ntr_file_t *f = ntr_open(path);
+   ntr_export_fst(f, fst);
+   ntr_close(f);
+
+   void *ctx = fstReaderOpen(fst);
+   fail_if(ctx == NULL);
+   fail_unless(fstReaderGetVarCount(ctx) == 4);
+   fail_unless(fstReaderGetScopeCount(ctx) == 2);
+   fail_unless(fstReaderGetEndTime(ctx) == 50000);
+   fstReaderClose(ctx);
+
+   unlink(fst);
+}
+END_TEST
+
+Suite *get_ntr_tests(void)
+{
+   Suite *s = suite_create("ntr");
+
+   TCase *tc_core = nvc_unit_test();
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, test_value_at);
+   tcase_add_test(tc_core, test_export);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
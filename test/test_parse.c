@@ -2812,6 +2812,60 @@ START_TEST(test_vests1)
 }
 END_TEST;
 
+START_TEST(test_scan)
+{
+   set_standard(STD_08);
+
+   input_from_file(TESTDIR "/parse/scan.vhd");
+
+   tree_t p = scan_unit();
+   fail_if(p == NULL);
+   fail_unless(tree_kind(p) == T_PACKAGE);
+   fail_unless(tree_ident(p) == ident_new("PACK"));
+   fail_unless(tree_contexts(p) == 2);
+   fail_unless(tree_kind(tree_context(p, 0)) == T_USE);
+   fail_unless(tree_ident(tree_context(p, 0))
+               == ident_new("IEEE.STD_LOGIC_1164"));
+   fail_unless(tree_ident(tree_context(p, 1)) == ident_new("WORK.TYPES"));
+
+   tree_t b = scan_unit();
+   fail_if(b == NULL);
+   fail_unless(tree_kind(b) == T_PACK_BODY);
+   fail_unless(tree_ident(b) == ident_new("PACK"));
+   fail_unless(tree_contexts(b) == 0);
+
+   tree_t e = scan_unit();
+   fail_if(e == NULL);
+   fail_unless(tree_kind(e) == T_ENTITY);
+   fail_unless(tree_ident(e) == ident_new("TOP"));
+   fail_unless(tree_contexts(e) == 1);
+   fail_unless(tree_ident(tree_context(e, 0)) == ident_new("WORK.PACK"));
+
+   tree_t a = scan_unit();
+   fail_if(a == NULL);
+   fail_unless(tree_kind(a) == T_ARCH);
+   fail_unless(tree_ident(a) == ident_new("RTL"));
+   fail_unless(tree_ident2(a) == ident_new("TOP"));
+   fail_unless(tree_stmts(a) == 4);
+   fail_unless(tree_ident2(tree_stmt(a, 0)) == ident_new("WORK.LEAF2"));
+   fail_unless(tree_ident2(tree_stmt(a, 1)) == ident_new("WORK.LEAF"));
+   fail_unless(tree_ident2(tree_stmt(a, 2)) == ident_new("LIB2.OTHER.DEEP"));
+   fail_unless(tree_ident2(tree_stmt(a, 3)) == ident_new("WORK.LEAF"));
+
+   tree_t c = scan_unit();
+   fail_if(c == NULL);
+   fail_unless(tree_kind(c) == T_CONTEXT);
+   fail_unless(tree_ident(c) == ident_new("CTX"));
+   fail_unless(tree_contexts(c) == 1);
+   fail_unless(tree_ident(tree_context(c, 0))
+               == ident_new("IEEE.NUMERIC_STD"));
+
+   fail_if(scan_unit() != NULL);
+
+   fail_unless(parse_errors() == 0);
+}
+END_TEST
+
 Suite *get_parse_tests(void)
 {
    Suite *s = suite_create("parse");
@@ -2858,6 +2912,7 @@ Suite *get_parse_tests(void)
    tcase_add_test(tc_core, test_issue367);
    tcase_add_test(tc_core, test_issue369);
    tcase_add_test(tc_core, test_vests1);
+   tcase_add_test(tc_core, test_scan);
    suite_add_tcase(s, tc_core);
 
    return s;
@@ -1991,6 +1991,43 @@ START_TEST(test_issue377)
 }
 END_TEST
 
+START_TEST(test_hashcons)
+{
+   input_from_file(TESTDIR "/sem/hashcons.vhd");
+
+   tree_t a = parse_and_check(T_ENTITY, T_ARCH);
+   fail_unless(sem_errors() == 0);
+
+   tree_t x = tree_decl(a, 1);
+   tree_t y = tree_decl(a, 2);
+   tree_t z = tree_decl(a, 3);
+   tree_t w = tree_decl(a, 4);
+   fail_unless(tree_ident(x) == ident_new("X"));
+   fail_unless(tree_ident(w) == ident_new("W"));
+
+   // Subtypes with the same literal bounds share one type object
+   fail_unless(tree_type(x) == tree_type(y));
+   fail_if(tree_type(x) == tree_type(z));
+   fail_if(tree_type(x) == tree_type(w));
+}
+END_TEST
+
+START_TEST(test_lazyimport)
+{
+   input_from_file(TESTDIR "/sem/lazyimport.vhd");
+
+   const error_t expect[] = {
+      { 48, "no visible declaration for K" },
+      { -1, NULL }
+   };
+   expect_errors(expect);
+
+   parse_and_check(T_PACKAGE, T_PACK_BODY, T_ENTITY, T_ARCH, T_ARCH);
+
+   fail_unless(sem_errors() == ARRAY_LEN(expect) - 1);
+}
+END_TEST
+
 Suite *get_sem_tests(void)
 {
    Suite *s = suite_create("sem");
@@ -2093,6 +2130,8 @@ Suite *get_sem_tests(void)
    tcase_add_test(tc_core, test_issue340);
    tcase_add_test(tc_core, test_issue225);
    tcase_add_test(tc_core, test_issue377);
+   tcase_add_test(tc_core, test_hashcons);
+   tcase_add_test(tc_core, test_lazyimport);
    suite_add_tcase(s, tc_core);
 
    return s;
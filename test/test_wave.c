@@ -0,0 +1,125 @@
+#include "test_util.h"
+#include "ident.h"
+#include "rt/rt.h"
+
+#include <check.h>
+#include <stdlib.h>
+
+static tree_t make_signal(const char *name)
+{
+   tree_t s = tree_new(T_SIGNAL_DECL);
+   tree_set_ident(s, ident_new(name));
+   return s;
+}
+
+START_TEST(test_none)
+{
+   fail_unless(wave_should_dump(make_signal(":top:x")));
+   fail_unless(wave_should_dump(make_signal(":top:sub:y")));
+}
+END_TEST
+
+START_TEST(test_include)
+{
+   wave_include_glob(":top:sub:*");
+   wave_include_glob("*:clk");
+
+   fail_unless(wave_should_dump(make_signal(":top:sub:x")));
+   fail_unless(wave_should_dump(make_signal(":top:sub:deep:y")));
+   fail_unless(wave_should_dump(make_signal(":top:other:clk")));
+   fail_if(wave_should_dump(make_signal(":top:sub")));
+   fail_if(wave_should_dump(make_signal(":top:other:x")));
+   fail_if(wave_should_dump(make_signal(":top:other:clk2")));
+}
+END_TEST
+
+START_TEST(test_exclude)
+{
+   wave_include_glob(":top:*");
+   wave_exclude_glob(":top:mem*");
+   wave_exclude_glob("*_tmp");
+
+   fail_unless(wave_should_dump(make_signal(":top:a")));
+   fail_unless(wave_should_dump(make_signal(":top:me")));
+   fail_if(wave_should_dump(make_signal(":top:mem:a")));
+   fail_if(wave_should_dump(make_signal(":top:memory")));
+   fail_if(wave_should_dump(make_signal(":top:sub:x_tmp")));
+   fail_unless(wave_should_dump(make_signal(":top:sub:x_tmpy")));
+   fail_if(wave_should_dump(make_signal(":other:a")));
+}
+END_TEST
+
+START_TEST(test_glob)
+{
+   // Results must agree with ident_glob for every combination
+
+   static const char *globs[] = {
+      "*", ":top:*", "*:clk", ":top:u*:x", "*a*", ":t*p:b*", "**",
+      ":top:sub:s1", "*_n*", ":top", "a"
+   };
+
+   static const char *names[] = {
+      ":top:clk", ":top:sub:s1", ":top:u1:x", ":top:u:x", ":tp:b",
+      ":top:b1:a_n", ":a", "a", ":top", ":top:sub:s1_n", ":t:b:clk"
+   };
+
+   const int n_globs = ARRAY_LEN(globs);
+   const int n_names = ARRAY_LEN(names);
+
+   for (int i = 0; i < n_globs; i++) {
+      if (i % 3 == 0)
+         wave_exclude_glob(globs[i]);
+      else
+         wave_include_glob(globs[i]);
+   }
+
+   for (int j = 0; j < n_names; j++) {
+      ident_t name = ident_new(names[j]);
+
+      bool expect = false, excluded = false;
+      for (int i = 0; i < n_globs; i++) {
+         if (ident_glob(name, globs[i], -1)) {
+            if (i % 3 == 0)
+               excluded = true;
+            else
+               expect = true;
+         }
+      }
+
+      fail_unless(wave_should_dump(make_signal(names[j])) == (expect && !excluded),
+                  "wrong result for %s", names[j]);
+   }
+}
+END_TEST
+
+START_TEST(test_depth)
+{
+   wave_set_depth(1);
+   wave_exclude_glob("*:b");
+
+   fail_unless(wave_should_dump(make_signal(":top:a")));
+   fail_unless(wave_should_dump(make_signal(":top:u1:a")));
+   fail_if(wave_should_dump(make_signal(":top:u1:b")));
+   fail_if(wave_should_dump(make_signal(":top:u1:u2:a")));
+
+   wave_set_depth(0);
+
+   fail_unless(wave_should_dump(make_signal(":top:a")));
+   fail_if(wave_should_dump(make_signal(":top:u1:a")));
+}
+END_TEST
+
+Suite *get_wave_tests(void)
+{
+   Suite *s = suite_create("wave");
+
+   TCase *tc_core = nvc_unit_test();
+   tcase_add_test(tc_core, test_none);
+   tcase_add_test(tc_core, test_include);
+   tcase_add_test(tc_core, test_exclude);
+   tcase_add_test(tc_core, test_glob);
+   tcase_add_test(tc_core, test_depth);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
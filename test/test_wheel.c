@@ -0,0 +1,162 @@
+#include "rt/wheel.h"
+#include "rt/heap.h"
+
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static wheel_t w = NULL;
+
+static void setup(void)
+{
+   w = wheel_new();
+}
+
+static void teardown(void)
+{
+   wheel_free(w);
+   w = NULL;
+}
+
+static int magnitude_compar(const void *a, const void *b)
+{
+   const uintptr_t l = *(const uintptr_t*)a;
+   const uintptr_t r = *(const uintptr_t*)b;
+   return (l > r) - (l < r);
+}
+
+static void walk_fn(uint64_t key, void *user, void *context)
+{
+   int *count = context;
+
+   fail_if(key != (uintptr_t)user);
+
+   (*count)++;
+}
+
+START_TEST(test_basic)
+{
+   wheel_insert(w, 5, (void*)5);
+   wheel_insert(w, 2, (void*)2);
+   wheel_insert(w, 62, (void*)62);
+
+   fail_unless(wheel_size(w) == 3);
+
+   fail_unless(wheel_min(w) == (void*)2);
+
+   fail_unless(wheel_extract_min(w) == (void*)2);
+   fail_unless(wheel_extract_min(w) == (void*)5);
+   fail_unless(wheel_extract_min(w) == (void*)62);
+
+   fail_unless(wheel_size(w) == 0);
+}
+END_TEST
+
+START_TEST(test_walk)
+{
+   wheel_insert(w, 5, (void*)5);
+   wheel_insert(w, 2, (void*)2);
+   wheel_insert(w, 62, (void*)62);
+   wheel_insert(w, UINT64_C(1) << 60, (void*)(UINT64_C(1) << 60));
+
+   int count = 0;
+   wheel_walk(w, walk_fn, &count);
+
+   fail_unless(count == 4);
+}
+END_TEST
+
+START_TEST(test_rand)
+{
+   static const int N = 1024;
+   uintptr_t keys[N];
+
+   for (int i = 0; i < N; i++) {
+      keys[i] = rand();
+      wheel_insert(w, keys[i], (void*)keys[i]);
+   }
+
+   qsort(keys, N, sizeof(uintptr_t), magnitude_compar);
+
+   for (int i = 0; i < N; i++)
+      fail_unless(wheel_extract_min(w) == (void*)keys[i]);
+}
+END_TEST
+
+START_TEST(test_far)
+{
+   // Keys beyond the range of the wheel go into the overflow heap
+
+   const uint64_t far = UINT64_C(1) << 62;
+
+   wheel_insert(w, 100, (void*)1);
+   wheel_insert(w, far + 5, (void*)4);
+   wheel_insert(w, far, (void*)3);
+   wheel_insert(w, 300, (void*)2);
+
+   fail_unless(wheel_extract_min(w) == (void*)1);
+   fail_unless(wheel_extract_min(w) == (void*)2);
+   fail_unless(wheel_min(w) == (void*)3);
+   fail_unless(wheel_extract_min(w) == (void*)3);
+
+   // Earlier than anything previously extracted
+   wheel_insert(w, 50, (void*)5);
+   fail_unless(wheel_extract_min(w) == (void*)5);
+   fail_unless(wheel_extract_min(w) == (void*)4);
+   fail_unless(wheel_size(w) == 0);
+}
+END_TEST
+
+START_TEST(test_interleave)
+{
+   // Simulate the kernel access pattern and compare with a heap
+
+   heap_t h = heap_new(128);
+
+   uint64_t now = 0;
+   for (int i = 0; i < 10000; i++) {
+      if ((rand() % 3) != 0 || heap_size(h) == 0) {
+         uint64_t key = (now + (rand() % 5000)) << 2;
+         if (rand() % 16 == 0)
+            key += (uint64_t)rand() << 24;
+         key |= rand() % 3;
+
+         heap_insert(h, key, (void*)(uintptr_t)key);
+         wheel_insert(w, key, (void*)(uintptr_t)key);
+      }
+      else {
+         fail_unless(wheel_min(w) == heap_min(h));
+
+         void *min = heap_extract_min(h);
+         fail_unless(wheel_extract_min(w) == min);
+
+         now = (uintptr_t)min >> 2;
+      }
+
+      fail_unless(wheel_size(w) == heap_size(h));
+   }
+
+   while (heap_size(h) > 0)
+      fail_unless(wheel_extract_min(w) == heap_extract_min(h));
+
+   heap_free(h);
+}
+END_TEST
+
+Suite *get_wheel_tests(void)
+{
+   Suite *s = suite_create("wheel");
+
+   TCase *tc_core = tcase_create("Core");
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, test_basic);
+   tcase_add_test(tc_core, test_rand);
+   tcase_add_test(tc_core, test_walk);
+   tcase_add_test(tc_core, test_far);
+   tcase_add_test(tc_core, test_interleave);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
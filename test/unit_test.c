@@ -50,6 +50,13 @@ int main(int argc, char **argv)
    nfail += RUN_TESTS(ident);
    nfail += RUN_TESTS(hash);
    nfail += RUN_TESTS(heap);
+   nfail += RUN_TESTS(wheel);
+   nfail += RUN_TESTS(access);
+   nfail += RUN_TESTS(wave);
+   nfail += RUN_TESTS(ntr);
+   nfail += RUN_TESTS(fbuf);
+   nfail += RUN_TESTS(memo);
+   nfail += RUN_TESTS(bitvec);
    nfail += RUN_TESTS(lib);
    nfail += RUN_TESTS(parse);
    nfail += RUN_TESTS(sem);
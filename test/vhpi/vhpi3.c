@@ -1,4 +1,5 @@
 #include "vhpi_user.h"
+#include "vhpi_nvc.h"
 
 #include <stdio.h>
 #include <assert.h>
@@ -71,6 +72,42 @@ static void start_of_sim(const vhpiCbDataT *cb_data)
    check_error();
    fail_unless(phys_to_i64(weight_right) == 4000);
 
+   vhpiHandleT handle_y = vhpi_handle_by_name("vhpi3.y", NULL);
+   check_error();
+   fail_if(handle_y == NULL);
+
+   int nsigs = 0;
+   vhpiHandleT it = vhpi_iterator(vhpiSigDecls, root);
+   check_error();
+   fail_if(it == NULL);
+   for (vhpiHandleT h = vhpi_scan(it); h != NULL; h = vhpi_scan(it)) {
+      fail_unless(h == handle_x || h == handle_y);
+      vhpi_release_handle(h);
+      nsigs++;
+   }
+   vhpi_release_handle(it);
+   fail_unless(nsigs == 2);
+
+   vhpiHandleT batch[2] = { handle_y, handle_y };
+   vhpiValueT values[2] = {
+      { .format = vhpiObjTypeVal },
+      { .format = vhpiLogicVal }
+   };
+   fail_unless(vhpi_get_values_nvc(batch, values, 2) == 0);
+   check_error();
+   fail_unless(values[0].format == vhpiLogicVal);
+   fail_unless(values[0].value.enumv == 0);
+   fail_unless(values[1].value.enumv == 0);
+
+   vhpiIntT elemsz, nelems;
+   const unsigned char *y_ptr = vhpi_value_ptr_nvc(handle_y, &elemsz, &nelems);
+   check_error();
+   fail_if(y_ptr == NULL);
+   fail_unless(elemsz == 1);
+   fail_unless(nelems == 1);
+   fail_unless(*y_ptr == 0);
+
+   vhpi_release_handle(handle_y);
    vhpi_release_handle(handle_weight_cons);
    vhpi_release_handle(handle_weight_type);
    vhpi_release_handle(handle_x);